@@ -153,38 +153,143 @@ typedef struct {
 	IMPPoint		p1;		/**<右下角点坐标信息  */
 } IMPRect;
 
+/**
+ * IMP图像格式描述.
+ *
+ * 平面p每行至少 ceil(pw * plane_bits[p] / 8) 字节, 共 ph 行; 平面0的 pw, ph
+ * 即图像宽高, 其余平面为宽高按 log2_chroma_w/log2_chroma_h 下采样并向上取整.
+ * 如NV12的UV平面: 每个采样点16位(U和V), 宽高各为一半.
+ * width, height须分别为align_w, align_h的整数倍.
+ */
+typedef struct {
+	const char	*name;				/**< 格式名 */
+	uint8_t		nb_planes;			/**< 平面数, 1到3 */
+	uint8_t		bpp;				/**< 整幅图像平均每像素位数 */
+	uint8_t		plane_bits[3];		/**< 各平面每个采样点的位数 */
+	uint8_t		log2_chroma_w;		/**< 平面1, 2的水平下采样 */
+	uint8_t		log2_chroma_h;		/**< 平面1, 2的垂直下采样 */
+	uint8_t		align_w;			/**< 宽度对齐 */
+	uint8_t		align_h;			/**< 高度对齐 */
+	uint8_t		flags;				/**< IMP_PIXFMT_FLAG_* */
+} IMPPixelFormatDesc;
+
+#define IMP_PIXFMT_FLAG_RGB		(1 << 0)	/**< RGB, 否则YUV或灰度 */
+#define IMP_PIXFMT_FLAG_ALPHA	(1 << 1)	/**< 有alpha通道 */
+#define IMP_PIXFMT_FLAG_BAYER	(1 << 2)	/**< sensor Bayer排列 */
+#define IMP_PIXFMT_FLAG_BE		(1 << 3)	/**< 16位采样为大端 */
+
+/**
+ * 取图像格式描述, 格式无效时返回NULL.
+ *
+ * 描述表按IMPPixelFormat的顺序排列, 新增格式时必须同时加入, 否则编译失败.
+ * PIX_FMT_RAW按每像素8位计算, 与FrameSource分配的最小空间一致.
+ */
+static inline const IMPPixelFormatDesc *imp_pixfmt_desc(IMPPixelFormat imp_pixfmt)
+{
+#define RGB		IMP_PIXFMT_FLAG_RGB
+#define ALPHA	IMP_PIXFMT_FLAG_ALPHA
+#define BAYER	IMP_PIXFMT_FLAG_BAYER
+#define BE		IMP_PIXFMT_FLAG_BE
+	static const IMPPixelFormatDesc descs[] = {
+		/* name			planes bpp	plane_bits	 chroma w/h align w/h	flags */
+		{ "yuv420p",		3, 12, { 8, 8, 8 },		1, 1,	2, 2,	0 },
+		{ "yuyv422",		1, 16, { 16, 0, 0 },	0, 0,	2, 1,	0 },
+		{ "uyvy422",		1, 16, { 16, 0, 0 },	0, 0,	2, 1,	0 },
+		{ "yuv422p",		3, 16, { 8, 8, 8 },		1, 0,	2, 1,	0 },
+		{ "yuv444p",		3, 24, { 8, 8, 8 },		0, 0,	1, 1,	0 },
+		{ "yuv410p",		3, 9,  { 8, 8, 8 },		2, 2,	4, 4,	0 },
+		{ "yuv411p",		3, 12, { 8, 8, 8 },		2, 0,	4, 1,	0 },
+		{ "gray8",			1, 8,  { 8, 0, 0 },		0, 0,	1, 1,	0 },
+		{ "monowhite",		1, 1,  { 1, 0, 0 },		0, 0,	1, 1,	0 },
+		{ "monoblack",		1, 1,  { 1, 0, 0 },		0, 0,	1, 1,	0 },
+
+		{ "nv12",			2, 12, { 8, 16, 0 },	1, 1,	2, 2,	0 },
+		{ "nv21",			2, 12, { 8, 16, 0 },	1, 1,	2, 2,	0 },
+
+		{ "rgb24",			1, 24, { 24, 0, 0 },	0, 0,	1, 1,	RGB },
+		{ "bgr24",			1, 24, { 24, 0, 0 },	0, 0,	1, 1,	RGB },
+
+		{ "argb",			1, 32, { 32, 0, 0 },	0, 0,	1, 1,	RGB | ALPHA },
+		{ "rgba",			1, 32, { 32, 0, 0 },	0, 0,	1, 1,	RGB | ALPHA },
+		{ "abgr",			1, 32, { 32, 0, 0 },	0, 0,	1, 1,	RGB | ALPHA },
+		{ "bgra",			1, 32, { 32, 0, 0 },	0, 0,	1, 1,	RGB | ALPHA },
+
+		{ "rgb565be",		1, 16, { 16, 0, 0 },	0, 0,	1, 1,	RGB | BE },
+		{ "rgb565le",		1, 16, { 16, 0, 0 },	0, 0,	1, 1,	RGB },
+		{ "rgb555be",		1, 16, { 16, 0, 0 },	0, 0,	1, 1,	RGB | BE },
+		{ "rgb555le",		1, 16, { 16, 0, 0 },	0, 0,	1, 1,	RGB },
+
+		{ "bgr565be",		1, 16, { 16, 0, 0 },	0, 0,	1, 1,	RGB | BE },
+		{ "bgr565le",		1, 16, { 16, 0, 0 },	0, 0,	1, 1,	RGB },
+		{ "bgr555be",		1, 16, { 16, 0, 0 },	0, 0,	1, 1,	RGB | BE },
+		{ "bgr555le",		1, 16, { 16, 0, 0 },	0, 0,	1, 1,	RGB },
+
+		{ "0rgb",			1, 32, { 32, 0, 0 },	0, 0,	1, 1,	RGB },
+		{ "rgb0",			1, 32, { 32, 0, 0 },	0, 0,	1, 1,	RGB },
+		{ "0bgr",			1, 32, { 32, 0, 0 },	0, 0,	1, 1,	RGB },
+		{ "bgr0",			1, 32, { 32, 0, 0 },	0, 0,	1, 1,	RGB },
+
+		{ "bayer_bggr8",	1, 8,  { 8, 0, 0 },		0, 0,	2, 2,	BAYER },
+		{ "bayer_rggb8",	1, 8,  { 8, 0, 0 },		0, 0,	2, 2,	BAYER },
+		{ "bayer_gbrg8",	1, 8,  { 8, 0, 0 },		0, 0,	2, 2,	BAYER },
+		{ "bayer_grbg8",	1, 8,  { 8, 0, 0 },		0, 0,	2, 2,	BAYER },
+
+		{ "raw",			1, 8,  { 8, 0, 0 },		0, 0,	1, 1,	BAYER },
+	};
+	/* 每个IMPPixelFormat一项 */
+	typedef char imp_pixfmt_desc_complete[sizeof(descs) / sizeof(descs[0]) == PIX_FMT_NB ? 1 : -1];
+#undef RGB
+#undef ALPHA
+#undef BAYER
+#undef BE
+
+	(void)sizeof(imp_pixfmt_desc_complete);
+	if ((unsigned)imp_pixfmt >= PIX_FMT_NB)
+		return NULL;
+	return &descs[imp_pixfmt];
+}
+
+/**
+ * 平面plane一行最少的字节数.
+ */
+static inline int imp_pixfmt_plane_row_bytes(const IMPPixelFormatDesc *desc, int plane, int width)
+{
+	if (plane > 0)
+		width = (width + (1 << desc->log2_chroma_w) - 1) >> desc->log2_chroma_w;
+	return (width * desc->plane_bits[plane] + 7) / 8;
+}
+
+/**
+ * 平面plane的行数.
+ */
+static inline int imp_pixfmt_plane_rows(const IMPPixelFormatDesc *desc, int plane, int height)
+{
+	if (plane > 0)
+		height = (height + (1 << desc->log2_chroma_h) - 1) >> desc->log2_chroma_h;
+	return height;
+}
+
+/**
+ * 紧密排列(无行填充)时一幅图像的字节数, 格式无效时返回0.
+ */
 static inline int calc_pic_size(int width, int height, IMPPixelFormat imp_pixfmt)
 {
-	int bpp1 = 0, bpp2 = 1,size;
-
-#define BPP(FMT, A, B) case FMT: bpp1 = A;bpp2 = B;break
-	switch (imp_pixfmt) {
-		BPP(PIX_FMT_NV12, 3, 2);
-		BPP(PIX_FMT_YUYV422, 2, 1);
-		BPP(PIX_FMT_UYVY422, 2, 1);
-		BPP(PIX_FMT_RGB565BE, 2, 1);
-	default: break;
-	}
-#undef BPP
-	size = width * height * bpp1 / bpp2;
+	const IMPPixelFormatDesc *desc = imp_pixfmt_desc(imp_pixfmt);
+	int plane, size = 0;
+
+	if (desc == NULL || width <= 0 || height <= 0)
+		return 0;
+	for (plane = 0; plane < desc->nb_planes; plane++)
+		size += imp_pixfmt_plane_row_bytes(desc, plane, width) * imp_pixfmt_plane_rows(desc, plane, height);
 
 	return size;
 }
 
 static inline const char *fmt_to_string(IMPPixelFormat imp_pixfmt)
 {
-	static const char *nv12 = "nv12";
-	static const char *yuyv422 = "yuyv422";
-
-	switch (imp_pixfmt) {
-	case PIX_FMT_NV12:
-		return nv12;
-	case PIX_FMT_YUYV422:
-		return yuyv422;
-	default:
-		break;
-	}
-	return NULL;
+	const IMPPixelFormatDesc *desc = imp_pixfmt_desc(imp_pixfmt);
+
+	return desc ? desc->name : NULL;
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,115 @@
+/*
+ * osdfont_ascii_8x16.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Printable ASCII, 0x20 to 0x7e, 8x16 pixels at 1 bit per pixel: 16 rows
+ * of one byte each, the leftmost pixel in bit 7. Rasterized from DejaVu
+ * Sans Mono Bold (Bitstream Vera license).
+ */
+
+#ifndef __OSDFONT_ASCII_8X16_H__
+#define __OSDFONT_ASCII_8X16_H__
+
+#define OSDFONT_ASCII_FIRST	0x20
+#define OSDFONT_ASCII_LAST	0x7e
+
+static const unsigned char osdfont_ascii_8x16[OSDFONT_ASCII_LAST - OSDFONT_ASCII_FIRST + 1][16] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* ' ' */
+	{ 0x00, 0x00, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 },	/* '!' */
+	{ 0x00, 0x00, 0x66, 0x66, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* '"' */
+	{ 0x00, 0x00, 0x1a, 0x12, 0x36, 0xff, 0x36, 0x24, 0xfe, 0xfe, 0x68, 0x48, 0x00, 0x00, 0x00, 0x00 },	/* '#' */
+	{ 0x00, 0x00, 0x18, 0x3c, 0x7e, 0x78, 0x78, 0x3c, 0x1e, 0x1e, 0x7e, 0x7c, 0x18, 0x18, 0x00, 0x00 },	/* '$' */
+	{ 0x00, 0x00, 0x60, 0xf0, 0x90, 0xf0, 0x66, 0x30, 0x4f, 0x09, 0x09, 0x0f, 0x00, 0x00, 0x00, 0x00 },	/* '%' */
+	{ 0x00, 0x00, 0x3c, 0x74, 0x60, 0x30, 0x78, 0xdb, 0xcf, 0xcf, 0xe6, 0x7f, 0x10, 0x00, 0x00, 0x00 },	/* '&' */
+	{ 0x00, 0x00, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* ''' */
+	{ 0x00, 0x04, 0x0c, 0x18, 0x18, 0x18, 0x30, 0x30, 0x30, 0x38, 0x18, 0x18, 0x08, 0x0c, 0x00, 0x00 },	/* '(' */
+	{ 0x00, 0x20, 0x30, 0x18, 0x18, 0x18, 0x0c, 0x0c, 0x0c, 0x1c, 0x18, 0x18, 0x10, 0x30, 0x00, 0x00 },	/* ')' */
+	{ 0x00, 0x00, 0x18, 0x5a, 0x3c, 0x3c, 0x5a, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* '*' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x18, 0xff, 0x7e, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* '+' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x18, 0x30, 0x00, 0x00 },	/* ',' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0x3c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* '-' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 },	/* '.' */
+	{ 0x00, 0x00, 0x02, 0x06, 0x04, 0x0c, 0x08, 0x18, 0x10, 0x30, 0x30, 0x60, 0x60, 0x40, 0x00, 0x00 },	/* '/' */
+	{ 0x00, 0x00, 0x3c, 0x7e, 0x66, 0x66, 0x7e, 0xff, 0x66, 0x66, 0x7e, 0x3c, 0x00, 0x00, 0x00, 0x00 },	/* '0' */
+	{ 0x00, 0x00, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x7e, 0x7f, 0x00, 0x00, 0x00, 0x00 },	/* '1' */
+	{ 0x00, 0x00, 0x7c, 0x6e, 0x06, 0x06, 0x0c, 0x1c, 0x38, 0x70, 0x7e, 0xfe, 0x00, 0x00, 0x00, 0x00 },	/* '2' */
+	{ 0x00, 0x00, 0x7c, 0x7e, 0x06, 0x06, 0x3c, 0x1e, 0x06, 0x06, 0x4e, 0xfe, 0x10, 0x00, 0x00, 0x00 },	/* '3' */
+	{ 0x00, 0x00, 0x0e, 0x1e, 0x1e, 0x3e, 0x6e, 0x4e, 0xfe, 0xff, 0x0e, 0x0e, 0x00, 0x00, 0x00, 0x00 },	/* '4' */
+	{ 0x00, 0x00, 0x7e, 0x7e, 0x60, 0x78, 0x7c, 0x46, 0x06, 0x06, 0x4e, 0x7c, 0x10, 0x00, 0x00, 0x00 },	/* '5' */
+	{ 0x00, 0x00, 0x3e, 0x7e, 0x60, 0x68, 0x7e, 0x66, 0x67, 0x67, 0x66, 0x3e, 0x08, 0x00, 0x00, 0x00 },	/* '6' */
+	{ 0x00, 0x00, 0x7e, 0x7e, 0x06, 0x0c, 0x0c, 0x1c, 0x18, 0x18, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00 },	/* '7' */
+	{ 0x00, 0x00, 0x3c, 0x7e, 0x66, 0x66, 0x3c, 0x7e, 0x66, 0x66, 0x66, 0x7e, 0x00, 0x00, 0x00, 0x00 },	/* '8' */
+	{ 0x00, 0x00, 0x3c, 0x6e, 0x66, 0xe6, 0x66, 0x7e, 0x3e, 0x06, 0x0e, 0x7c, 0x10, 0x00, 0x00, 0x00 },	/* '9' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x18, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 },	/* ':' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x18, 0x00, 0x00, 0x18, 0x18, 0x18, 0x30, 0x00, 0x00 },	/* ';' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x01, 0x0f, 0x7c, 0xe0, 0xf0, 0x1e, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* '<' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7e, 0xff, 0x00, 0x7e, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* '=' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x80, 0xf0, 0x3e, 0x07, 0x0f, 0x78, 0xe0, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* '>' */
+	{ 0x00, 0x00, 0x7c, 0x7e, 0x06, 0x0e, 0x1c, 0x18, 0x18, 0x10, 0x10, 0x18, 0x00, 0x00, 0x00, 0x00 },	/* '?' */
+	{ 0x00, 0x00, 0x08, 0x3e, 0x62, 0xcb, 0x9f, 0xb3, 0xb3, 0x93, 0x9f, 0xc0, 0x60, 0x3f, 0x00, 0x00 },	/* '@' */
+	{ 0x00, 0x00, 0x18, 0x3c, 0x3c, 0x3c, 0x66, 0x66, 0x7e, 0x7e, 0xc3, 0xc3, 0x00, 0x00, 0x00, 0x00 },	/* 'A' */
+	{ 0x00, 0x00, 0xfc, 0xfe, 0xe6, 0xe6, 0xfc, 0xfe, 0xe3, 0xe3, 0xff, 0xfe, 0x00, 0x00, 0x00, 0x00 },	/* 'B' */
+	{ 0x00, 0x00, 0x3e, 0x3e, 0x70, 0x60, 0x60, 0x60, 0x60, 0x60, 0x7e, 0x3e, 0x00, 0x00, 0x00, 0x00 },	/* 'C' */
+	{ 0x00, 0x00, 0x7c, 0x7e, 0x66, 0x67, 0x67, 0x67, 0x67, 0x66, 0x7e, 0x7c, 0x00, 0x00, 0x00, 0x00 },	/* 'D' */
+	{ 0x00, 0x00, 0x7e, 0x7e, 0x60, 0x60, 0x7e, 0x7e, 0x60, 0x60, 0x7e, 0x7e, 0x00, 0x00, 0x00, 0x00 },	/* 'E' */
+	{ 0x00, 0x00, 0x7f, 0x7e, 0x60, 0x60, 0x7e, 0x7e, 0x60, 0x60, 0x60, 0x60, 0x00, 0x00, 0x00, 0x00 },	/* 'F' */
+	{ 0x00, 0x00, 0x3e, 0x7e, 0x60, 0x60, 0xe0, 0xef, 0x67, 0x63, 0x7f, 0x3e, 0x08, 0x00, 0x00, 0x00 },	/* 'G' */
+	{ 0x00, 0x00, 0x66, 0x66, 0x66, 0x66, 0x7e, 0x7e, 0x66, 0x66, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00 },	/* 'H' */
+	{ 0x00, 0x00, 0x7e, 0x7e, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x7e, 0x7e, 0x00, 0x00, 0x00, 0x00 },	/* 'I' */
+	{ 0x00, 0x00, 0x3e, 0x3e, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0xfe, 0x7c, 0x10, 0x00, 0x00, 0x00 },	/* 'J' */
+	{ 0x00, 0x00, 0xe7, 0xe6, 0xec, 0xf8, 0xf8, 0xfc, 0xec, 0xee, 0xe6, 0xe7, 0x00, 0x00, 0x00, 0x00 },	/* 'K' */
+	{ 0x00, 0x00, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x7e, 0x7f, 0x00, 0x00, 0x00, 0x00 },	/* 'L' */
+	{ 0x00, 0x00, 0xe7, 0xe7, 0xef, 0xff, 0xdb, 0xdb, 0xc3, 0xc3, 0xc3, 0xc3, 0x00, 0x00, 0x00, 0x00 },	/* 'M' */
+	{ 0x00, 0x00, 0xe7, 0xe7, 0xf7, 0xf7, 0xdf, 0xdf, 0xcf, 0xcf, 0xc7, 0xc7, 0x00, 0x00, 0x00, 0x00 },	/* 'N' */
+	{ 0x00, 0x00, 0x3c, 0x7e, 0x66, 0xe7, 0xe7, 0xe7, 0xe7, 0x66, 0x7e, 0x3c, 0x00, 0x00, 0x00, 0x00 },	/* 'O' */
+	{ 0x00, 0x00, 0x7e, 0x7e, 0x67, 0x67, 0x66, 0x7e, 0x60, 0x60, 0x60, 0x60, 0x00, 0x00, 0x00, 0x00 },	/* 'P' */
+	{ 0x00, 0x00, 0x3c, 0x7e, 0x66, 0xe7, 0xe7, 0xe7, 0xe7, 0x66, 0x7e, 0x3c, 0x0e, 0x06, 0x00, 0x00 },	/* 'Q' */
+	{ 0x00, 0x00, 0x7c, 0x7e, 0x66, 0x66, 0x7e, 0x7c, 0x6c, 0x66, 0x66, 0x63, 0x00, 0x00, 0x00, 0x00 },	/* 'R' */
+	{ 0x00, 0x00, 0x3e, 0x7e, 0x60, 0x60, 0x7c, 0x1e, 0x06, 0x06, 0x46, 0x7e, 0x10, 0x00, 0x00, 0x00 },	/* 'S' */
+	{ 0x00, 0x00, 0xff, 0xff, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 },	/* 'T' */
+	{ 0x00, 0x00, 0xe7, 0xe7, 0xe7, 0xe7, 0xe7, 0xe7, 0xe7, 0xe7, 0x7e, 0x7e, 0x00, 0x00, 0x00, 0x00 },	/* 'U' */
+	{ 0x00, 0x00, 0xc3, 0xe7, 0x66, 0x66, 0x66, 0x66, 0x3c, 0x3c, 0x3c, 0x3c, 0x00, 0x00, 0x00, 0x00 },	/* 'V' */
+	{ 0x00, 0x00, 0xc3, 0xc3, 0xc3, 0xdb, 0xdb, 0xdf, 0xff, 0x66, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00 },	/* 'W' */
+	{ 0x00, 0x00, 0xe7, 0x66, 0x7e, 0x3c, 0x18, 0x18, 0x3c, 0x7e, 0x66, 0xe7, 0x00, 0x00, 0x00, 0x00 },	/* 'X' */
+	{ 0x00, 0x00, 0xc3, 0x66, 0x66, 0x3c, 0x3c, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 },	/* 'Y' */
+	{ 0x00, 0x00, 0x7f, 0x7f, 0x06, 0x0c, 0x1c, 0x18, 0x30, 0x70, 0x7e, 0xff, 0x00, 0x00, 0x00, 0x00 },	/* 'Z' */
+	{ 0x00, 0x1c, 0x1c, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1c, 0x00, 0x00 },	/* '[' */
+	{ 0x00, 0x00, 0x40, 0x60, 0x20, 0x30, 0x10, 0x18, 0x08, 0x0c, 0x0c, 0x06, 0x06, 0x02, 0x00, 0x00 },	/* '\\' */
+	{ 0x00, 0x38, 0x38, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x38, 0x00, 0x00 },	/* ']' */
+	{ 0x00, 0x00, 0x18, 0x3c, 0x66, 0x42, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* '^' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff },	/* '_' */
+	{ 0x00, 0x30, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* '`' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x3c, 0x7e, 0x06, 0x3e, 0x7f, 0xe7, 0xe7, 0x7f, 0x00, 0x00, 0x00, 0x00 },	/* 'a' */
+	{ 0x00, 0x40, 0x60, 0x60, 0x6c, 0x7e, 0x66, 0x67, 0x67, 0x67, 0x76, 0x7e, 0x00, 0x00, 0x00, 0x00 },	/* 'b' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x1c, 0x3e, 0x70, 0x60, 0x60, 0x60, 0x72, 0x3e, 0x08, 0x00, 0x00, 0x00 },	/* 'c' */
+	{ 0x00, 0x02, 0x06, 0x06, 0x36, 0x7e, 0x66, 0xe6, 0xe6, 0xe6, 0x6e, 0x7e, 0x00, 0x00, 0x00, 0x00 },	/* 'd' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x18, 0x7e, 0x66, 0xff, 0xff, 0xe0, 0x62, 0x3e, 0x08, 0x00, 0x00, 0x00 },	/* 'e' */
+	{ 0x00, 0x06, 0x1e, 0x18, 0x7e, 0x7e, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 },	/* 'f' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x32, 0x7e, 0x66, 0xe6, 0xe6, 0xe6, 0x7e, 0x3e, 0x06, 0x7e, 0x7c, 0x00 },	/* 'g' */
+	{ 0x00, 0x60, 0x60, 0x60, 0x6c, 0x7e, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00 },	/* 'h' */
+	{ 0x00, 0x18, 0x18, 0x00, 0x38, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0x7f, 0x00, 0x00, 0x00, 0x00 },	/* 'i' */
+	{ 0x00, 0x1c, 0x1c, 0x00, 0x38, 0x7c, 0x1c, 0x1c, 0x1c, 0x1c, 0x1c, 0x1c, 0x1c, 0x78, 0x78, 0x00 },	/* 'j' */
+	{ 0x00, 0x60, 0x60, 0x60, 0x62, 0x6e, 0x6c, 0x78, 0x7c, 0x6c, 0x66, 0x67, 0x00, 0x00, 0x00, 0x00 },	/* 'k' */
+	{ 0x00, 0x70, 0xf8, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x18, 0x1e, 0x00, 0x00, 0x00, 0x00 },	/* 'l' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x36, 0xff, 0xdb, 0xdb, 0xdb, 0xdb, 0xdb, 0xdb, 0x00, 0x00, 0x00, 0x00 },	/* 'm' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x6c, 0x7e, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00 },	/* 'n' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x18, 0x7e, 0x66, 0xe7, 0xe7, 0xe7, 0x66, 0x3c, 0x00, 0x00, 0x00, 0x00 },	/* 'o' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x4c, 0x7e, 0x66, 0x67, 0x67, 0x67, 0x76, 0x7e, 0x60, 0x60, 0x60, 0x00 },	/* 'p' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x32, 0x7e, 0x66, 0xe6, 0xe6, 0xe6, 0x6e, 0x7e, 0x06, 0x06, 0x06, 0x00 },	/* 'q' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x26, 0x3f, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00 },	/* 'r' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x1c, 0x7e, 0x60, 0x78, 0x3e, 0x06, 0x46, 0x7e, 0x00, 0x00, 0x00, 0x00 },	/* 's' */
+	{ 0x00, 0x00, 0x10, 0x38, 0x7e, 0xfe, 0x38, 0x38, 0x38, 0x38, 0x18, 0x1e, 0x00, 0x00, 0x00, 0x00 },	/* 't' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x46, 0x66, 0x66, 0x66, 0x66, 0x66, 0x6e, 0x7e, 0x00, 0x00, 0x00, 0x00 },	/* 'u' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x42, 0x66, 0x66, 0x66, 0x24, 0x3c, 0x3c, 0x18, 0x00, 0x00, 0x00, 0x00 },	/* 'v' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x81, 0xc3, 0xc3, 0xdb, 0xdb, 0x7e, 0x7e, 0x66, 0x00, 0x00, 0x00, 0x00 },	/* 'w' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x42, 0x66, 0x3c, 0x3c, 0x18, 0x3c, 0x7e, 0x66, 0x00, 0x00, 0x00, 0x00 },	/* 'x' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x42, 0x66, 0x66, 0x66, 0x3c, 0x3c, 0x3c, 0x18, 0x18, 0x70, 0xf0, 0x00 },	/* 'y' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x7e, 0x7e, 0x0e, 0x0c, 0x18, 0x30, 0x70, 0x7e, 0x00, 0x00, 0x00, 0x00 },	/* 'z' */
+	{ 0x00, 0x06, 0x1e, 0x18, 0x18, 0x18, 0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x1e, 0x06, 0x00 },	/* '{' */
+	{ 0x00, 0x00, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00 },	/* '|' */
+	{ 0x00, 0x60, 0x78, 0x18, 0x18, 0x18, 0x18, 0x1e, 0x1e, 0x18, 0x18, 0x18, 0x18, 0x78, 0x60, 0x00 },	/* '}' */
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x8e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* '~' */
+};
+
+#endif /* __OSDFONT_ASCII_8X16_H__ */
@@ -10,8 +10,11 @@
 #include <imp/imp_log.h>
 #include <imp/imp_decoder.h>
 
+#include "sample-pixfmt.h"
+
 #define TAG		"JPEGD"
 #define JPEGFILENAME		"1280x720.jpeg_1"
+#define DEC_PIXFMT			PIX_FMT_NV12
 
 static int sampe_decoder_system_init(void)
 {
@@ -32,7 +35,7 @@ static int sample_decoder_jpeg_init(void)
 			.decType		= PT_JPEG,
 			.maxWidth		= 1280,
 			.maxHeight		= 720,
-			.pixelFormat	= PIX_FMT_NV12,
+			.pixelFormat	= DEC_PIXFMT,
 			.nrKeepStream	= 2,
 			.frmRateNum		= 25,
 			.frmRateDen		= 1,
@@ -78,6 +81,7 @@ int sample_decoder_get_frame(void)
 	char videopath[128];
 	int videofd = -1;
 	IMPFrameInfo *frame = NULL;
+	pix_view_t view;
 
 	time(&now);
 	now_tm = localtime(&now);
@@ -112,8 +116,15 @@ retry_pooling_point:
 		goto err_IMP_Decoder_GetFrame;
 	}
 
-	ret = write(videofd, (void *)frame->virAddr, frame->size);
-	if (ret != frame->size) {
+	/* the picture alone, not the padding of the decoder's buffer */
+	ret = pix_view_from_frame_fmt(&view, frame, DEC_PIXFMT);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "decoded frame %ux%u of %u bytes is short\n", frame->width, frame->height, frame->size);
+		goto err_write_frame;
+	}
+
+	ret = write(videofd, view.plane[0], view.layout.size);
+	if (ret != view.layout.size) {
 		IMP_LOG_ERR(TAG, "IMP_Decoder_GetFrame(%d) failed\n", 0);
 		goto err_write_frame;
 	}
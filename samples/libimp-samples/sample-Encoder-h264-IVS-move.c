@@ -10,15 +10,31 @@
 #include <imp/imp_system.h>
 #include <imp/imp_framesource.h>
 #include <imp/imp_encoder.h>
+#include <imp/imp_osd.h>
 #include <imp/imp_ivs.h>
 #include <imp/imp_ivs_move.h>
 
 #include "sample-common.h"
+#include "sample-stream-pump.h"
+#include "sample-prerecord.h"
+#include "sample-scene-policy.h"
+#include "sample-vb-tuner.h"
+#include "sample-osd-pool.h"
 
 #define TAG "Sample-Encoder-h264-IVS-move"
 
+#define PRERECORD_SEC		8		/* video kept ahead of a motion event */
+#define PRERECORD_HOLD_MS	5000	/* recording goes on after the motion stops */
+#define MOTION_OSD_GRP		0		/* boxes drawn on the main stream */
+
 extern struct chn_conf chn[];
 
+static prerecord_t *prerecord;
+static scene_policy_t *scene_policy;
+static stream_pump_t *pump;
+static osd_pool_t *motion_boxes;
+static IMPRect motion_roi[IMP_IVS_MOVE_MAX_ROI_CNT];
+
 static int sample_ivs_move_init(int grp_num)
 {
 	int ret = 0;
@@ -59,33 +75,30 @@ static int sample_ivs_move_start(int grp_num, int chn_num, IMPIVSInterface **int
 	  param.sense[i] = 4;
 	}
 
-	/* printf("param.sense=%d, param.skipFrameCnt=%d, param.frameInfo.width=%d, param.frameInfo.height=%d\n", param.sense, param.skipFrameCnt, param.frameInfo.width, param.frameInfo.height); */
+	/* one ROI per quarter of the frame, each boxed on the main stream while it moves */
 	for (j = 0; j < 2; j++) {
 		for (i = 0; i < 2; i++) {
-		  if((i==0)&&(j==0)){
-			param.roiRect[j * 2 + i].p0.x = i * param.frameInfo.width /* / 2 */;
-			param.roiRect[j * 2 + i].p0.y = j * param.frameInfo.height /* / 2 */;
-			param.roiRect[j * 2 + i].p1.x = (i + 1) * param.frameInfo.width /* / 2 */ - 1;
-			param.roiRect[j * 2 + i].p1.y = (j + 1) * param.frameInfo.height /* / 2 */ - 1;
+			param.roiRect[j * 2 + i].p0.x = i * param.frameInfo.width / 2;
+			param.roiRect[j * 2 + i].p0.y = j * param.frameInfo.height / 2;
+			param.roiRect[j * 2 + i].p1.x = (i + 1) * param.frameInfo.width / 2 - 1;
+			param.roiRect[j * 2 + i].p1.y = (j + 1) * param.frameInfo.height / 2 - 1;
 			printf("(%d,%d) = ((%d,%d)-(%d,%d))\n", i, j, param.roiRect[j * 2 + i].p0.x, param.roiRect[j * 2 + i].p0.y,param.roiRect[j * 2 + i].p1.x, param.roiRect[j * 2 + i].p1.y);
-		  }
-		  else
-		    {
-		      	param.roiRect[j * 2 + i].p0.x = param.roiRect[0].p0.x;
-			param.roiRect[j * 2 + i].p0.y = param.roiRect[0].p0.y;
-			param.roiRect[j * 2 + i].p1.x = param.roiRect[0].p1.x;;
-			param.roiRect[j * 2 + i].p1.y = param.roiRect[0].p1.y;;
-			printf("(%d,%d) = ((%d,%d)-(%d,%d))\n", i, j, param.roiRect[j * 2 + i].p0.x, param.roiRect[j * 2 + i].p0.y,param.roiRect[j * 2 + i].p1.x, param.roiRect[j * 2 + i].p1.y);
-		    }
 		}
 	}
+	for (i = 0; i < param.roiRectCnt; i++) {
+		motion_roi[i].p0.x = param.roiRect[i].p0.x * SENSOR_WIDTH / SENSOR_WIDTH_SECOND;
+		motion_roi[i].p0.y = param.roiRect[i].p0.y * SENSOR_HEIGHT / SENSOR_HEIGHT_SECOND;
+		motion_roi[i].p1.x = (param.roiRect[i].p1.x + 1) * SENSOR_WIDTH / SENSOR_WIDTH_SECOND - 1;
+		motion_roi[i].p1.y = (param.roiRect[i].p1.y + 1) * SENSOR_HEIGHT / SENSOR_HEIGHT_SECOND - 1;
+	}
 	*interface = IMP_IVS_CreateMoveInterface(&param);
 	if (*interface == NULL) {
 		IMP_LOG_ERR(TAG, "IMP_IVS_CreateGroup(%d) failed\n", grp_num);
 		return -1;
 	}
 
-	ret = IMP_IVS_CreateChn(chn_num, *interface);
+	/* time the algorithm's hold on the frames while tuning, *interface is still the one to destroy */
+	ret = IMP_IVS_CreateChn(chn_num, fs_vb_tuner ? vb_tuner_wrap_ivs(fs_vb_tuner, chn[IVS_CHN_ID].index, *interface) : *interface);
 	if (ret < 0) {
 		IMP_LOG_ERR(TAG, "IMP_IVS_CreateChn(%d) failed\n", chn_num);
 		return -1;
@@ -161,7 +174,8 @@ static int sample_ivs_set_sense(int chn_num, int sensor)
 
 static void *sample_ivs_move_get_result_process(void *arg)
 {
-	int i = 0, ret = 0;
+	int i = 0, j, ret = 0, moving;
+	void *exit_code = (void *)-1;
 	int chn_num = (int)arg;
 	IMP_IVS_MoveOutput *result = NULL;
 
@@ -169,32 +183,133 @@ static void *sample_ivs_move_get_result_process(void *arg)
 		ret = IMP_IVS_PollingResult(chn_num, IMP_IVS_DEFAULT_TIMEOUTMS);
 		if (ret < 0) {
 			IMP_LOG_ERR(TAG, "IMP_IVS_PollingResult(%d, %d) failed\n", chn_num, IMP_IVS_DEFAULT_TIMEOUTMS);
-			return (void *)-1;
+			goto out;
 		}
 		ret = IMP_IVS_GetResult(chn_num, (void **)&result);
 		if (ret < 0) {
 			IMP_LOG_ERR(TAG, "IMP_IVS_GetResult(%d) failed\n", chn_num);
-			return (void *)-1;
+			goto out;
 		}
 		IMP_LOG_INFO(TAG, "frame[%d], result->retRoi(%d,%d,%d,%d)\n", i, result->retRoi[0], result->retRoi[1], result->retRoi[2], result->retRoi[3]);
+		moving = result->retRoi[0] || result->retRoi[1] || result->retRoi[2] || result->retRoi[3];
+		/* only the boxes that changed since the last result cost an OSD call */
+		osd_pool_begin(motion_boxes);
+		for (j = 0; j < IMP_IVS_MOVE_MAX_ROI_CNT; j++)
+			if (result->retRoi[j])
+				osd_pool_add(motion_boxes, &motion_roi[j]);
+		osd_pool_commit(motion_boxes);
+		/* full rate and an IDR before the pre-event buffer sees the event */
+		scene_policy_motion(scene_policy, moving);
+		prerecord_motion(prerecord, moving);
 
 		ret = IMP_IVS_ReleaseResult(chn_num, (void *)result);
 		if (ret < 0) {
 			IMP_LOG_ERR(TAG, "IMP_IVS_ReleaseResult(%d) failed\n", chn_num);
-			return (void *)-1;
+			goto out;
 		}
 #if 0
 		if (i % 20 == 0) {
 			ret = sample_ivs_set_sense(chn_num, i % 5);
 			if (ret < 0) {
 				IMP_LOG_ERR(TAG, "sample_ivs_set_sense(%d, %d) failed\n", chn_num, i % 5);
-				return (void *)-1;
+				goto out;
 			}
 		}
 #endif
 	}
+	exit_code = (void *)0;
+
+out:
+	/* the recording ends with the detection, or main would wait on it forever */
+	stream_pump_stop(pump);
+
+	return exit_code;
+}
+
+static int prerecord_cb(int encChn, IMPEncoderStream *stream, void *priv)
+{
+	if (stream == NULL) {
+		IMP_LOG_ERR(TAG, "Polling stream timeout, chn%d\n", encChn);
+		return STREAM_PUMP_RELEASE;
+	}
+
+	if (fs_vb_tuner)
+		vb_tuner_enc_stream(fs_vb_tuner, encChn, stream);
+	prerecord_push((prerecord_t *)priv, stream);
+
+	return STREAM_PUMP_RELEASE;
+}
+
+/* Size the pre-event buffer from the main stream bitrate */
+static int sample_prerecord_create(void)
+{
+	IMPEncoderCHNAttr attr;
+	prerecord_attr_t pr_attr;
+	scene_policy_attr_t sp_attr;
+	int ret;
+
+	ret = IMP_Encoder_GetChnAttr(chn[0].index, &attr);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_GetChnAttr(%d) failed\n", chn[0].index);
+		return -1;
+	}
+
+	/* whole GOPs are evicted, leave room for one more GOP and IDR peaks */
+	memset(&pr_attr, 0, sizeof(pr_attr));
+	pr_attr.budget = attr.rcAttr.attrH264Cbr.outBitRate * 1000 / 8 * PRERECORD_SEC * 3 / 2;
+	pr_attr.pre_ms = PRERECORD_SEC * 1000;
+	pr_attr.hold_off_ms = PRERECORD_HOLD_MS;
+	pr_attr.path_prefix = STREAM_FILE_PATH_PREFIX;
+
+	prerecord = prerecord_create(&pr_attr);
+	if (prerecord == NULL)
+		return -1;
+
+	pump = stream_pump_create();
+	if (pump == NULL)
+		return -1;
+
+	/* Low fps and long GOP while nothing moves */
+	memset(&sp_attr, 0, sizeof(sp_attr));
+	sp_attr.encChn = chn[0].index;
+	scene_policy = scene_policy_create(&sp_attr);
+	if (scene_policy == NULL)
+		return -1;
 
-	return (void *)0;
+	return stream_pump_add(pump, chn[0].index, 1000, prerecord_cb, prerecord);
+}
+
+/* Feed the main stream to the pre-event buffer until detection ends */
+static int sample_prerecord_run(void)
+{
+	int ret;
+
+	ret = IMP_Encoder_StartRecvPic(chn[0].index);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_StartRecvPic(%d) failed\n", chn[0].index);
+		return -1;
+	}
+
+	ret = stream_pump_run(pump);
+
+	if (IMP_Encoder_StopRecvPic(chn[0].index) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_StopRecvPic() failed\n");
+		return -1;
+	}
+
+	return ret;
+}
+
+static int sample_prerecord_destroy(void)
+{
+	stream_pump_dump_stat(pump);
+	stream_pump_destroy(pump);
+	scene_policy_dump_stat(scene_policy);
+	if (scene_policy_destroy(scene_policy) < 0)
+		return -1;
+	prerecord_dump_stat(prerecord);
+
+	return prerecord_destroy(prerecord);
 }
 
 static int sample_ivs_move_get_result_start(int chn_num, pthread_t *ptid)
@@ -213,12 +328,64 @@ static int sample_ivs_move_get_result_stop(pthread_t tid)
 	return 0;
 }
 
+/* A box on the main stream for each ROI in motion */
+static int sample_motion_osd_init(int grpNum)
+{
+	osd_pool_attr_t attr;
+
+	if (IMP_OSD_CreateGroup(grpNum) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_OSD_CreateGroup(%d) error !\n", grpNum);
+		return -1;
+	}
+
+	memset(&attr, 0, sizeof(osd_pool_attr_t));
+	attr.grpNum = grpNum;
+	attr.nr = IMP_IVS_MOVE_MAX_ROI_CNT;
+	attr.type = OSD_REG_RECT;
+	attr.color = OSD_GREEN;
+	attr.linewidth = 5;
+	attr.layer = 1;
+	attr.width = SENSOR_WIDTH;
+	attr.height = SENSOR_HEIGHT;
+	motion_boxes = osd_pool_create(&attr);
+	if (motion_boxes == NULL) {
+		IMP_LOG_ERR(TAG, "osd_pool_create failed\n");
+		return -1;
+	}
+
+	if (IMP_OSD_Start(grpNum) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_OSD_Start(%d) error !\n", grpNum);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int sample_motion_osd_exit(int grpNum)
+{
+	int ret = 0;
+
+	osd_pool_dump_stat(motion_boxes);
+	if (osd_pool_destroy(motion_boxes) < 0)
+		ret = -1;
+	motion_boxes = NULL;
+
+	if (IMP_OSD_DestroyGroup(grpNum) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_OSD_DestroyGroup(%d) error\n", grpNum);
+		return -1;
+	}
+
+	return ret;
+}
+
 int main(int argc, char *argv[])
 {
 	int i, ret;
 	pthread_t ivs_tid;
 	IMPIVSInterface *inteface = NULL;
 
+	sample_pipeline = SAMPLE_PIPE_H264 | SAMPLE_PIPE_OSD | SAMPLE_PIPE_IVS;
+
 	/* Step.1 System init */
 	ret = sample_system_init();
 	if (ret < 0) {
@@ -257,8 +424,27 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	ret = sample_motion_osd_init(MOTION_OSD_GRP);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "sample_motion_osd_init(%d) failed\n", MOTION_OSD_GRP);
+		return -1;
+	}
+
 	/* Step.5 Bind */
-	for (i = 0; i < FS_CHN_NUM; i++) {
+	IMPCell osdcell = {DEV_ID_OSD, MOTION_OSD_GRP, 0};
+	ret = IMP_System_Bind(&chn[0].framesource_chn, &osdcell);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Bind FrameSource channel0 and OSD failed\n");
+		return -1;
+	}
+
+	ret = IMP_System_Bind(&osdcell, &chn[0].imp_encoder);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Bind OSD and Encoder failed\n");
+		return -1;
+	}
+
+	for (i = 1; i < FS_CHN_NUM; i++) {
 		if (chn[i].enable) {
 			ret = IMP_System_Bind(&chn[i].framesource_chn, &chn[i].imp_encoder);
 			if (ret < 0) {
@@ -270,7 +456,7 @@ int main(int argc, char *argv[])
 
 	/* Bind framesource channel.1-output.1 to IVS group */
 	/**
-	 * FS.0 ----------------> Encoder.0(Main stream)
+	 * FS.0 ----------------> OSD.0 (motion boxes) ----> Encoder.0(Main stream)
 	 * FS.1 ----(output.0)--> Encoder.1(Second stream)
 	 *       |
 	 *       \--(output.1)--> IVS
@@ -297,17 +483,23 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	/* Step.8 start to get ivs move result */
+	/* Step.8 start to get ivs move result, motion triggers the recording */
+	ret = sample_prerecord_create();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "sample_prerecord_create failed\n");
+		return -1;
+	}
+
 	ret = sample_ivs_move_get_result_start(0, &ivs_tid);
 	if (ret < 0) {
 		IMP_LOG_ERR(TAG, "sample_ivs_move_get_result_start failed\n");
 		return -1;
 	}
 
-	/* Step.9 get h264 stream */
-	ret = sample_get_h264_stream();
+	/* Step.9 buffer h264 stream, flushed to an event file on motion */
+	ret = sample_prerecord_run();
 	if (ret < 0) {
-		IMP_LOG_ERR(TAG, "Get H264 stream failed\n");
+		IMP_LOG_ERR(TAG, "Pre-event recording failed\n");
 		return -1;
 	}
 
@@ -320,6 +512,12 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	ret = sample_prerecord_destroy();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "sample_prerecord_destroy failed\n");
+		return -1;
+	}
+
 	/* Step.11 ivs move stop */
 	ret = sample_ivs_move_stop(0, inteface);
 	if (ret < 0) {
@@ -341,7 +539,7 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	for (i = 0; i < FS_CHN_NUM; i++) {
+	for (i = 1; i < FS_CHN_NUM; i++) {
 		if (chn[i].enable) {
 			ret = IMP_System_UnBind(&chn[i].framesource_chn, &chn[i].imp_encoder);
 			if (ret < 0) {
@@ -351,6 +549,24 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	ret = IMP_System_UnBind(&osdcell, &chn[0].imp_encoder);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "UnBind OSD and Encoder failed\n");
+		return -1;
+	}
+
+	ret = IMP_System_UnBind(&chn[0].framesource_chn, &osdcell);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "UnBind FrameSource and OSD failed\n");
+		return -1;
+	}
+
+	ret = sample_motion_osd_exit(MOTION_OSD_GRP);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "sample_motion_osd_exit(%d) failed\n", MOTION_OSD_GRP);
+		return -1;
+	}
+
 	/* Step.14 ivs exit */
 	ret = sample_ivs_move_exit(0);
 	if (ret < 0) {
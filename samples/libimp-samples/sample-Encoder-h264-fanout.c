@@ -0,0 +1,305 @@
+/*
+ * sample-Encoder-h264-fanout.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_system.h>
+#include <imp/imp_framesource.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-common.h"
+#include "sample-enc-bufsize.h"
+#include "sample-stream-hub.h"
+
+#define TAG "Sample-Encoder-h264-fanout"
+
+/* The simulated network consumer needs this long per frame */
+#define LIVE_SEND_TIME_US	60000
+/* A viewer joins this late, in the middle of a GOP, and watches a while */
+#define VIEWER_JOIN_US		2500000
+#define VIEWER_FRAMES		25
+/* Subscribers' frames plus a GOP cache, maxGop as sample_encoder_init() sets it */
+#define HUB_GOP_FRAMES		(2 * SENSOR_FRAME_RATE_NUM / SENSOR_FRAME_RATE_DEN)
+#define HUB_FRAMES			(STREAM_HUB_MAX_FRAMES + HUB_GOP_FRAMES)
+
+extern struct chn_conf chn[];
+
+static int write_frame(int fd, stream_hub_frame_t *frame)
+{
+	IMPEncoderStream *stream = &frame->stream;
+	struct iovec iov[stream->packCount];
+	int i;
+
+	for (i = 0; i < stream->packCount; i++) {
+		iov[i].iov_base = (void *)(uintptr_t)stream->pack[i].virAddr;
+		iov[i].iov_len = stream->pack[i].length;
+	}
+
+	if (writev(fd, iov, stream->packCount) != frame->bytes) {
+		IMP_LOG_ERR(TAG, "stream write error:%s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Recorder: writes straight from the encoder buffer, no copy */
+static void *record_thread(void *arg)
+{
+	stream_hub_sub_t *sub = (stream_hub_sub_t *)arg;
+	stream_hub_frame_t *frame;
+	char stream_path[64];
+	int i, fd;
+
+	sprintf(stream_path, "%s/stream-fanout-%d.h264", STREAM_FILE_PATH_PREFIX, chn[0].index);
+	fd = open(stream_path, O_RDWR | O_CREAT | O_TRUNC, 0777);
+	if (fd < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", stream_path, strerror(errno));
+		return ((void *)-1);
+	}
+
+	for (i = 0; i < NR_FRAMES_TO_SAVE; ) {
+		frame = stream_hub_get(sub, 1000);
+		if (frame == NULL) {
+			IMP_LOG_ERR(TAG, "recorder: no frame within 1000ms\n");
+			continue;
+		}
+		write_frame(fd, frame);
+		stream_hub_put(sub, frame);
+		i++;
+	}
+
+	close(fd);
+	return ((void *)0);
+}
+
+/* Stand-in for a network client slower than the frame rate */
+static void *live_thread(void *arg)
+{
+	stream_hub_sub_t *sub = (stream_hub_sub_t *)arg;
+	stream_hub_frame_t *frame;
+
+	while ((frame = stream_hub_get(sub, 1000)) != NULL) {
+		usleep(LIVE_SEND_TIME_US);
+		stream_hub_put(sub, frame);
+	}
+
+	return ((void *)0);
+}
+
+/* Late joiner: starts on the cached GOP instead of waiting for an IDR */
+static void *viewer_thread(void *arg)
+{
+	stream_hub_t *hub = (stream_hub_t *)arg;
+	stream_hub_sub_stat_t stat;
+	stream_hub_sub_t *sub;
+	stream_hub_frame_t *frame;
+	int i, first_key = 0;
+
+	usleep(VIEWER_JOIN_US);
+	sub = stream_hub_subscribe(hub, "viewer", 0, HUB_DROP_OLDEST);
+	if (sub == NULL)
+		return ((void *)-1);
+
+	for (i = 0; i < VIEWER_FRAMES; i++) {
+		frame = stream_hub_get(sub, 1000);
+		if (frame == NULL)
+			break;
+		if (i == 0)
+			first_key = frame->key_frame;
+		stream_hub_put(sub, frame);
+	}
+
+	stream_hub_get_sub_stat(sub, &stat);
+	IMP_LOG_INFO(TAG, "viewer: first frame %s after %lld us, %u frames from the GOP cache\n",
+			first_key ? "(IDR)" : "(not an IDR!)", (long long)stat.first_frame_us, stat.replayed);
+	stream_hub_unsubscribe(sub);
+
+	return ((void *)0);
+}
+
+/*
+ * The hub holds a GOP on top of what the subscribers hold, all of it in
+ * the stream buffer sample_encoder_init() sized for HUB_FRAMES.
+ */
+static stream_hub_t *sample_hub_create(void)
+{
+	IMPEncoderCHNAttr attr;
+	IMPEncoderAttrH264CBR *cbr = &attr.rcAttr.attrH264Cbr;
+	stream_hub_t *hub;
+	uint32_t gop_bytes, cache_bytes, need, room;
+
+	if (IMP_Encoder_GetChnAttr(chn[0].index, &attr) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_GetChnAttr(%d) failed\n", chn[0].index);
+		return NULL;
+	}
+
+	/* twice the average GOP leaves room for a busy scene */
+	gop_bytes = (uint64_t)cbr->outBitRate * 1000 / 8 * cbr->maxGop
+		* cbr->outFrmRate.frmRateDen / cbr->outFrmRate.frmRateNum;
+	cache_bytes = gop_bytes * 2;
+
+	/* bufSize 0 is libimp's own size while calibrating, nothing to hold it to */
+	if (attr.encAttr.bufSize) {
+		need = enc_bufsize_get(NULL, chn[0].index, &attr, chn[0].enc_retain);
+		if (attr.encAttr.bufSize < need) {
+			IMP_LOG_ERR(TAG, "chn%d: stream buffer %u bytes, the hub needs %u\n",
+					chn[0].index, attr.encAttr.bufSize, need);
+			return NULL;
+		}
+		/* what is left once the encoder and the subscribers have theirs */
+		room = attr.encAttr.bufSize - enc_bufsize_get(NULL, chn[0].index, &attr, STREAM_HUB_MAX_FRAMES);
+		if (cache_bytes > room)
+			cache_bytes = room;
+	}
+
+	hub = stream_hub_create(chn[0].index, PT_H264, chn[0].enc_retain);
+	if (hub == NULL)
+		return NULL;
+
+	/* cache_bytes 0 would be no bound at all */
+	if (stream_hub_set_gop_cache(hub, cache_bytes ? cbr->maxGop : 0, cache_bytes) < 0) {
+		stream_hub_destroy(hub);
+		return NULL;
+	}
+
+	return hub;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+	stream_hub_t *hub;
+	stream_hub_sub_t *rec_sub, *live_sub;
+	pthread_t rec_tid, live_tid, viewer_tid;
+
+	/* only the main stream is fanned out here */
+	chn[0].enable = 1;
+	chn[1].enable = 0;
+	/* the stream buffer holds what the hub keeps, see sample_hub_create() */
+	chn[0].enc_retain = HUB_FRAMES;
+
+	sample_pipeline = SAMPLE_PIPE_H264;
+
+	/* Step.1 System init */
+	ret = sample_system_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_System_Init() failed\n");
+		return -1;
+	}
+
+	/* Step.2 FrameSource init */
+	ret = sample_framesource_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource init failed\n");
+		return -1;
+	}
+
+	ret = IMP_Encoder_CreateGroup(chn[0].index);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_CreateGroup(%d) error !\n", chn[0].index);
+		return -1;
+	}
+
+	/* Step.3 Encoder init */
+	ret = sample_encoder_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Encoder init failed\n");
+		return -1;
+	}
+
+	/* Step.4 Bind */
+	ret = IMP_System_Bind(&chn[0].framesource_chn, &chn[0].imp_encoder);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Bind FrameSource channel0 and Encoder failed\n");
+		return -1;
+	}
+
+	/* Step.5 Stream On */
+	ret = sample_framesource_streamon();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "ImpStreamOn failed\n");
+		return -1;
+	}
+
+	/* Step.6 One hub, two subscribers on the same encoder channel, a third joins late */
+	hub = sample_hub_create();
+	if (hub == NULL) {
+		IMP_LOG_ERR(TAG, "stream_hub_create(%d) failed\n", chn[0].index);
+		return -1;
+	}
+
+	rec_sub = stream_hub_subscribe(hub, "recorder", 8, HUB_DROP_TO_IDR);
+	live_sub = stream_hub_subscribe(hub, "live", 4, HUB_DROP_OLDEST);
+	if (rec_sub == NULL || live_sub == NULL) {
+		IMP_LOG_ERR(TAG, "stream_hub_subscribe failed\n");
+		return -1;
+	}
+
+	pthread_create(&rec_tid, NULL, record_thread, rec_sub);
+	pthread_create(&live_tid, NULL, live_thread, live_sub);
+	pthread_create(&viewer_tid, NULL, viewer_thread, hub);
+
+	ret = stream_hub_start(hub);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "stream_hub_start failed\n");
+		return -1;
+	}
+
+	/* Step.7 Run until the recorder has its frames */
+	pthread_join(rec_tid, NULL);
+	pthread_join(viewer_tid, NULL);
+	stream_hub_stop(hub);
+	pthread_join(live_tid, NULL);
+	stream_hub_dump_stat(hub);
+	stream_hub_destroy(hub);
+
+	/* Exit sequence as follow */
+	/* Step.a Stream Off */
+	ret = sample_framesource_streamoff();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource StreamOff failed\n");
+		return -1;
+	}
+
+	/* Step.b UnBind */
+	ret = IMP_System_UnBind(&chn[0].framesource_chn, &chn[0].imp_encoder);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "UnBind FrameSource channel0 and Encoder failed\n");
+		return -1;
+	}
+
+	/* Step.c Encoder exit */
+	ret = sample_encoder_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Encoder exit failed\n");
+		return -1;
+	}
+
+	/* Step.d FrameSource exit */
+	ret = sample_framesource_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource exit failed\n");
+		return -1;
+	}
+
+	/* Step.e System exit */
+	ret = sample_system_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "sample_system_exit() failed\n");
+		return -1;
+	}
+
+	return 0;
+}
@@ -20,22 +20,12 @@
 
 extern struct chn_conf chn[];
 
-static void *h264_stream_thread(void *m)
-{
-	int ret;
-	ret = sample_get_h264_stream();
-	if (ret < 0) {
-		IMP_LOG_ERR(TAG, "Get H264 stream failed\n");
-		return 0;
-	}
-
-	return 0;
-}
-
 int main(int argc, char *argv[])
 {
 	int i, ret;
 
+	sample_pipeline = SAMPLE_PIPE_H264 | SAMPLE_PIPE_JPEG;
+
 	/* Step.1 System init */
 	ret = sample_system_init();
 	if (ret < 0) {
@@ -92,24 +82,13 @@ int main(int argc, char *argv[])
 	}
 
 	/* Step.6 Get stream and Snap */
-	pthread_t tid; /* Stream capture in another thread */
-	ret = pthread_create(&tid, NULL, h264_stream_thread, NULL);
-	if (ret) {
-		IMP_LOG_ERR(TAG, "h264 stream create error\n");
-		return -1;
-	}
-
-	/* drop several pictures of invalid data */
-	sleep(SLEEP_TIME);
-
-	ret = sample_get_jpeg_snap();
+	/* H264 and JPEG channels are all pumped from this thread */
+	ret = sample_get_h264_jpeg_stream();
 	if (ret < 0) {
-		IMP_LOG_ERR(TAG, "Get H264 stream failed\n");
+		IMP_LOG_ERR(TAG, "Get H264 stream and Snap failed\n");
 		return -1;
 	}
 
-	pthread_join(tid, NULL);
-
 	/* Exit sequence as follow */
 
 	/* Step.a Stream Off */
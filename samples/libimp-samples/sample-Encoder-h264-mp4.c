@@ -0,0 +1,330 @@
+/*
+ * sample-Encoder-h264-mp4.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_system.h>
+#include <imp/imp_framesource.h>
+#include <imp/imp_encoder.h>
+#include <imp/imp_audio.h>
+
+#include "sample-common.h"
+#include "sample-stream-pump.h"
+#include "sample-fmp4-mux.h"
+
+#define TAG "Sample-Encoder-h264-mp4"
+
+#define AUDIO_DEV_ID		1
+#define AUDIO_CHN_ID		0
+#define AUDIO_ENC_CHN		0
+#define AUDIO_SAMPLE_RATE	8000
+#define AUDIO_NUM_PER_FRM	160		/* 20ms */
+
+extern struct chn_conf chn[];
+
+struct mp4_record_ctx {
+	stream_pump_t		*pump;
+	fmp4_mux_t			*mux;
+	int					nr_frames;
+	volatile int		audio_run;
+};
+
+static int mp4_video_cb(int encChn, IMPEncoderStream *stream, void *priv)
+{
+	struct mp4_record_ctx *ctx = priv;
+
+	if (stream == NULL) {
+		IMP_LOG_ERR(TAG, "Polling stream timeout, chn%d\n", encChn);
+		return STREAM_PUMP_RELEASE;
+	}
+
+	if (fmp4_mux_write_video(ctx->mux, stream) < 0)
+		return -1;
+
+	if (++ctx->nr_frames >= NR_FRAMES_TO_SAVE)
+		stream_pump_remove(ctx->pump, encChn);
+
+	return STREAM_PUMP_RELEASE;
+}
+
+static int audio_init(void)
+{
+	IMPAudioIOAttr attr;
+	IMPAudioIChnParam chnParam;
+	IMPAudioEncChnAttr enc_attr;
+	int ret;
+
+	attr.samplerate = AUDIO_SAMPLE_RATE_8000;
+	attr.bitwidth = AUDIO_BIT_WIDTH_16;
+	attr.soundmode = AUDIO_SOUND_MODE_MONO;
+	attr.frmNum = 20;
+	attr.numPerFrm = AUDIO_NUM_PER_FRM;
+	attr.chnCnt = 1;
+	ret = IMP_AI_SetPubAttr(AUDIO_DEV_ID, &attr);
+	if (ret != 0) {
+		IMP_LOG_ERR(TAG, "set ai %d attr err: %d\n", AUDIO_DEV_ID, ret);
+		return -1;
+	}
+
+	ret = IMP_AI_Enable(AUDIO_DEV_ID);
+	if (ret != 0) {
+		IMP_LOG_ERR(TAG, "enable ai %d err\n", AUDIO_DEV_ID);
+		return -1;
+	}
+
+	chnParam.usrFrmDepth = 20;
+	ret = IMP_AI_SetChnParam(AUDIO_DEV_ID, AUDIO_CHN_ID, &chnParam);
+	if (ret != 0) {
+		IMP_LOG_ERR(TAG, "set ai %d channel %d attr err: %d\n", AUDIO_DEV_ID, AUDIO_CHN_ID, ret);
+		return -1;
+	}
+
+	ret = IMP_AI_EnableChn(AUDIO_DEV_ID, AUDIO_CHN_ID);
+	if (ret != 0) {
+		IMP_LOG_ERR(TAG, "Audio Record enable channel failed\n");
+		return -1;
+	}
+
+	enc_attr.type = PT_G711A;
+	enc_attr.bufSize = 20;
+	ret = IMP_AENC_CreateChn(AUDIO_ENC_CHN, &enc_attr);
+	if (ret != 0) {
+		IMP_LOG_ERR(TAG, "imp audio encode create channel failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void audio_exit(void)
+{
+	IMP_AENC_DestroyChn(AUDIO_ENC_CHN);
+	IMP_AI_DisableChn(AUDIO_DEV_ID, AUDIO_CHN_ID);
+	IMP_AI_Disable(AUDIO_DEV_ID);
+}
+
+/* AI -> G.711A -> muxer, the AI timestamp places the frame on the video timeline */
+static void *audio_thread(void *arg)
+{
+	struct mp4_record_ctx *ctx = arg;
+	IMPAudioFrame frm;
+	IMPAudioStream stream;
+	int ret;
+
+	while (ctx->audio_run) {
+		if (IMP_AI_PollingFrame(AUDIO_DEV_ID, AUDIO_CHN_ID, 1000) != 0)
+			continue;
+		ret = IMP_AI_GetFrame(AUDIO_DEV_ID, AUDIO_CHN_ID, &frm, BLOCK);
+		if (ret != 0) {
+			IMP_LOG_ERR(TAG, "Audio Get Frame Data error\n");
+			break;
+		}
+
+		ret = IMP_AENC_SendFrame(AUDIO_ENC_CHN, &frm);
+		if (ret == 0 && IMP_AENC_PollingStream(AUDIO_ENC_CHN, 1000) == 0
+				&& IMP_AENC_GetStream(AUDIO_ENC_CHN, &stream, BLOCK) == 0) {
+			fmp4_mux_write_audio(ctx->mux, stream.stream, stream.len, frm.timeStamp);
+			IMP_AENC_ReleaseStream(AUDIO_ENC_CHN, &stream);
+		}
+
+		IMP_AI_ReleaseFrame(AUDIO_DEV_ID, AUDIO_CHN_ID, &frm);
+	}
+
+	return ((void *)0);
+}
+
+static int sample_get_h264_mp4_stream(int with_audio)
+{
+	struct mp4_record_ctx ctx;
+	IMPEncoderCHNAttr chn_attr;
+	fmp4_mux_attr_t attr;
+	fmp4_mux_stat_t stat;
+	pthread_t audio_tid;
+	char path[64];
+	int fd, ret;
+
+	memset(&ctx, 0, sizeof(ctx));
+
+	ret = IMP_Encoder_GetChnAttr(chn[0].index, &chn_attr);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_GetChnAttr(%d) failed\n", chn[0].index);
+		return -1;
+	}
+
+	/* One fragment per GOP */
+	memset(&attr, 0, sizeof(attr));
+	attr.width = chn_attr.encAttr.picWidth;
+	attr.height = chn_attr.encAttr.picHeight;
+	attr.max_gop = chn_attr.rcAttr.attrH264Cbr.maxGop;
+	attr.audio_type = with_audio ? FMP4_AUDIO_G711A : FMP4_AUDIO_NONE;
+	attr.audio_rate = AUDIO_SAMPLE_RATE;
+
+	sprintf(path, "%s/stream-%d.mp4", STREAM_FILE_PATH_PREFIX, chn[0].index);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0777);
+	if (fd < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	ctx.mux = fmp4_mux_create(fd, &attr);
+	ctx.pump = stream_pump_create();
+	if (ctx.mux == NULL || ctx.pump == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	ret = IMP_Encoder_StartRecvPic(chn[0].index);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_StartRecvPic(%d) failed\n", chn[0].index);
+		return -1;
+	}
+
+	if (with_audio) {
+		ctx.audio_run = 1;
+		pthread_create(&audio_tid, NULL, audio_thread, &ctx);
+	}
+
+	ret = stream_pump_add(ctx.pump, chn[0].index, 1000, mp4_video_cb, &ctx);
+	if (ret == 0)
+		ret = stream_pump_run(ctx.pump);
+
+	if (with_audio) {
+		ctx.audio_run = 0;
+		pthread_join(audio_tid, NULL);
+	}
+
+	if (IMP_Encoder_StopRecvPic(chn[0].index) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_StopRecvPic() failed\n");
+		ret = -1;
+	}
+
+	fmp4_mux_get_stat(ctx.mux, &stat);
+	IMP_LOG_INFO(TAG, "%s: %u fragments, %u video, %u audio frames, %u skipped, %u audio dropped, "
+			"max fragment close %lld us\n", path, stat.fragments, stat.video_frames,
+			stat.audio_frames, stat.skipped_frames, stat.dropped_audio, (long long)stat.max_close_us);
+	if (fmp4_mux_close(ctx.mux) < 0)
+		ret = -1;
+	stream_pump_destroy(ctx.pump);
+	close(fd);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret, with_audio = 1;
+
+	if (argc > 1 && strcmp(argv[1], "-n") == 0)
+		with_audio = 0;
+
+	/* only the main stream is recorded */
+	chn[0].enable = 1;
+	chn[1].enable = 0;
+
+	sample_pipeline = SAMPLE_PIPE_H264;
+
+	/* Step.1 System init */
+	ret = sample_system_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_System_Init() failed\n");
+		return -1;
+	}
+
+	/* Step.2 FrameSource init */
+	ret = sample_framesource_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource init failed\n");
+		return -1;
+	}
+
+	ret = IMP_Encoder_CreateGroup(chn[0].index);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_CreateGroup(%d) error !\n", chn[0].index);
+		return -1;
+	}
+
+	/* Step.3 Encoder init */
+	ret = sample_encoder_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Encoder init failed\n");
+		return -1;
+	}
+
+	/* Step.4 Bind */
+	ret = IMP_System_Bind(&chn[0].framesource_chn, &chn[0].imp_encoder);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Bind FrameSource channel0 and Encoder failed\n");
+		return -1;
+	}
+
+	/* Step.5 Audio init */
+	if (with_audio && audio_init() < 0) {
+		IMP_LOG_ERR(TAG, "Audio init failed, recording video only\n");
+		with_audio = 0;
+	}
+
+	/* Step.6 Stream On */
+	ret = sample_framesource_streamon();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "ImpStreamOn failed\n");
+		return -1;
+	}
+
+	/* Step.7 Record fragmented MP4 */
+	ret = sample_get_h264_mp4_stream(with_audio);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Record MP4 stream failed\n");
+		return -1;
+	}
+
+	/* Exit sequence as follow */
+	/* Step.a Stream Off */
+	ret = sample_framesource_streamoff();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource StreamOff failed\n");
+		return -1;
+	}
+
+	if (with_audio)
+		audio_exit();
+
+	/* Step.b UnBind */
+	ret = IMP_System_UnBind(&chn[0].framesource_chn, &chn[0].imp_encoder);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "UnBind FrameSource channel0 and Encoder failed\n");
+		return -1;
+	}
+
+	/* Step.c Encoder exit */
+	ret = sample_encoder_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Encoder exit failed\n");
+		return -1;
+	}
+
+	/* Step.d FrameSource exit */
+	ret = sample_framesource_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource exit failed\n");
+		return -1;
+	}
+
+	/* Step.e System exit */
+	ret = sample_system_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "sample_system_exit() failed\n");
+		return -1;
+	}
+
+	return 0;
+}
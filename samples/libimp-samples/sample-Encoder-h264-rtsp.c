@@ -0,0 +1,344 @@
+/*
+ * sample-Encoder-h264-rtsp.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * usage: sample-Encoder-h264-rtsp [port] [-l] [-m]
+ *   -l  low latency: packs go out one by one as the encoder hands them over
+ *   -m  measure capture -> arrival with a loopback viewer on "main"
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_system.h>
+#include <imp/imp_framesource.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-common.h"
+#include "sample-stream-pump.h"
+#include "sample-rtsp-server.h"
+#include "sample-rtp-probe.h"
+#include "sample-abr.h"
+#include "sample-idr-service.h"
+
+#define TAG "Sample-Encoder-h264-rtsp"
+
+#define RTSP_STAT_INTERVAL_US	(10 * 1000000)
+
+extern struct chn_conf chn[];
+
+static const char *stream_name[FS_CHN_NUM] = { "main", "sub" };
+
+struct rtsp_sample_ctx {
+	rtsp_server_t	*srv;
+	int				stream_id[FS_CHN_NUM];
+	abr_t			*abr[FS_CHN_NUM];
+	idr_service_t	*idr;
+	rtp_probe_t		*probe;
+	int64_t			last_stat;
+};
+
+static stream_pump_t *pump;
+
+static void sig_handler(int sig)
+{
+	stream_pump_stop(pump);
+}
+
+/* From the CBR rate the channel was created with down to an eighth of it */
+static abr_t *abr_init(int encChn)
+{
+	IMPEncoderCHNAttr attr;
+	IMPEncoderAttrH264CBR *cbr = &attr.rcAttr.attrH264Cbr;
+	abr_attr_t abr_attr;
+
+	if (IMP_Encoder_GetChnAttr(encChn, &attr) < 0 || attr.rcAttr.rcMode != ENC_RC_MODE_H264CBR)
+		return NULL;
+
+	memset(&abr_attr, 0, sizeof(abr_attr));
+	abr_attr.max_kbps = cbr->outBitRate;
+	abr_attr.min_kbps = cbr->outBitRate / 8;
+	if (cbr->outFrmRate.frmRateNum > 0)
+		abr_attr.gop_ms = (uint64_t)cbr->maxGop * 1000 * cbr->outFrmRate.frmRateDen
+			/ cbr->outFrmRate.frmRateNum;
+
+	return abr_create(&abr_attr);
+}
+
+static void abr_sample(struct rtsp_sample_ctx *ctx, int encChn, int64_t now)
+{
+	IMPEncoderRcAttr rc_attr;
+	rtsp_link_stat_t ls;
+	abr_link_t link;
+	uint32_t kbps;
+
+	if (rtsp_server_get_link_stat(ctx->srv, ctx->stream_id[encChn], &ls) < 0)
+		return;
+
+	link.clients = ls.clients;
+	link.queue_bytes = ls.queue_bytes;
+	link.rtt_us = ls.rtt_us;
+	link.loss_permille = ls.loss_permille;
+	link.rr_age_us = ls.rr_age_us;
+	link.reports = ls.reports;
+	link.dropped = ls.dropped;
+	kbps = abr_update(ctx->abr[encChn], &link, now);
+	if (kbps == 0)
+		return;
+
+	if (IMP_Encoder_GetChnRcAttr(encChn, &rc_attr) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_GetChnRcAttr(%d) failed\n", encChn);
+		return;
+	}
+	rc_attr.attrH264Cbr.outBitRate = kbps;
+	if (IMP_Encoder_SetChnRcAttr(encChn, &rc_attr) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_SetChnRcAttr(%d) failed\n", encChn);
+		return;
+	}
+	IMP_LOG_INFO(TAG, "chn%d: %u kbps, queue %u bytes, rtt %lld us, loss %u/1000\n", encChn,
+			kbps, ls.queue_bytes, (long long)ls.rtt_us, ls.loss_permille);
+}
+
+/* Sends straight from the encoder buffer, the pump releases it afterwards */
+static int rtsp_stream_cb(int encChn, IMPEncoderStream *stream, void *priv)
+{
+	struct rtsp_sample_ctx *ctx = priv;
+	int id = ctx->stream_id[encChn];
+	int64_t now;
+
+	if (stream == NULL) {
+		IMP_LOG_ERR(TAG, "Polling stream timeout, chn%d\n", encChn);
+		return STREAM_PUMP_RELEASE;
+	}
+
+	rtsp_server_push(ctx->srv, id, stream);
+
+	/* A new viewer would otherwise wait up to a GOP for its first picture */
+	if (rtsp_server_want_idr(ctx->srv, id))
+		idr_service_request(ctx->idr, encChn);
+	idr_service_frame(ctx->idr, encChn, stream);
+
+	now = IMP_System_GetTimeStamp();
+	if (ctx->abr[encChn])
+		abr_sample(ctx, encChn, now);
+
+	if (now - ctx->last_stat >= RTSP_STAT_INTERVAL_US) {
+		rtsp_server_dump_stat(ctx->srv);
+		idr_service_dump_stat(ctx->idr);
+		if (ctx->probe)
+			rtp_probe_dump_stat(ctx->probe);
+		ctx->last_stat = now;
+	}
+
+	return STREAM_PUMP_RELEASE;
+}
+
+static int sample_serve_rtsp(int port, int low_latency, int measure)
+{
+	struct rtsp_sample_ctx ctx;
+	idr_service_attr_t idr_attr;
+	enc_telemetry_t *tel;
+	int i, ret = 0;
+
+	memset(&ctx, 0, sizeof(ctx));
+	memset(&idr_attr, 0, sizeof(idr_attr));
+	ctx.srv = rtsp_server_create(port);
+	/* Viewers connecting together share one IDR */
+	ctx.idr = idr_service_create(&idr_attr);
+	pump = stream_pump_create();
+	if (ctx.srv == NULL || ctx.idr == NULL || pump == NULL)
+		return -1;
+
+	/* Bitrate, fps and frame sizes for sample-enc-telemetry-cli */
+	tel = enc_telemetry_create(NULL);
+	if (tel)
+		stream_pump_set_telemetry(pump, tel);
+
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (!chn[i].enable)
+			continue;
+		ctx.stream_id[chn[i].index] = rtsp_server_add_stream(ctx.srv, stream_name[i],
+				chn[i].fs_chn_attr.picWidth, chn[i].fs_chn_attr.picHeight);
+		if (ctx.stream_id[chn[i].index] < 0)
+			return -1;
+	}
+	if (low_latency) {
+		rtsp_server_set_low_latency(ctx.srv, 1);
+		stream_pump_set_max_block(pump, 1);
+	}
+	if (rtsp_server_start(ctx.srv) < 0)
+		return -1;
+
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (!chn[i].enable)
+			continue;
+		ret = IMP_Encoder_StartRecvPic(chn[i].index);
+		if (ret < 0) {
+			IMP_LOG_ERR(TAG, "IMP_Encoder_StartRecvPic(%d) failed\n", chn[i].index);
+			return -1;
+		}
+		if (idr_service_add_chn(ctx.idr, chn[i].index) < 0)
+			return -1;
+		/* Follow the link with the bitrate, CBR channels only */
+		ctx.abr[chn[i].index] = abr_init(chn[i].index);
+		ret = stream_pump_add(pump, chn[i].index, 1000, rtsp_stream_cb, &ctx);
+		if (ret < 0)
+			return -1;
+	}
+
+	/* Frame timestamps against arrival on this host, compare with and without -l */
+	if (measure && chn[0].enable)
+		ctx.probe = rtp_probe_start(ctx.srv, port, ctx.stream_id[chn[0].index], stream_name[0]);
+
+	signal(SIGINT, sig_handler);
+	signal(SIGTERM, sig_handler);
+
+	/* Both channels from this one thread, until Ctrl-C */
+	ret = stream_pump_run(pump);
+
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (chn[i].enable && IMP_Encoder_StopRecvPic(chn[i].index) < 0) {
+			IMP_LOG_ERR(TAG, "IMP_Encoder_StopRecvPic(%d) failed\n", chn[i].index);
+			ret = -1;
+		}
+	}
+
+	rtsp_server_dump_stat(ctx.srv);
+	idr_service_dump_stat(ctx.idr);
+	stream_pump_dump_stat(pump);
+	if (ctx.probe) {
+		rtp_probe_dump_stat(ctx.probe);
+		rtp_probe_stop(ctx.probe);
+	}
+	rtsp_server_destroy(ctx.srv);
+	idr_service_destroy(ctx.idr);
+	stream_pump_destroy(pump);
+	if (tel)
+		enc_telemetry_destroy(tel);
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (ctx.abr[i])
+			abr_destroy(ctx.abr[i]);
+	}
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, ret, port = RTSP_DEFAULT_PORT, low_latency = 0, measure = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-l") == 0)
+			low_latency = 1;
+		else if (strcmp(argv[i], "-m") == 0)
+			measure = 1;
+		else
+			port = atoi(argv[i]);
+	}
+
+	sample_pipeline = SAMPLE_PIPE_H264;
+
+	/* Step.1 System init */
+	ret = sample_system_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_System_Init() failed\n");
+		return -1;
+	}
+
+	/* Step.2 FrameSource init */
+	ret = sample_framesource_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource init failed\n");
+		return -1;
+	}
+
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (chn[i].enable) {
+			ret = IMP_Encoder_CreateGroup(chn[i].index);
+			if (ret < 0) {
+				IMP_LOG_ERR(TAG, "IMP_Encoder_CreateGroup(%d) error !\n", i);
+				return -1;
+			}
+		}
+	}
+
+	/* Step.3 Encoder init */
+	ret = sample_encoder_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Encoder init failed\n");
+		return -1;
+	}
+
+	/* Step.4 Bind */
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (chn[i].enable) {
+			ret = IMP_System_Bind(&chn[i].framesource_chn, &chn[i].imp_encoder);
+			if (ret < 0) {
+				IMP_LOG_ERR(TAG, "Bind FrameSource channel%d and Encoder failed\n", i);
+				return -1;
+			}
+		}
+	}
+
+	/* Step.5 Stream On */
+	ret = sample_framesource_streamon();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "ImpStreamOn failed\n");
+		return -1;
+	}
+
+	/* Step.6 Serve rtsp://<ip>:<port>/main and /sub */
+	ret = sample_serve_rtsp(port, low_latency, measure);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "RTSP server failed\n");
+		return -1;
+	}
+
+	/* Exit sequence as follow */
+	/* Step.a Stream Off */
+	ret = sample_framesource_streamoff();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource StreamOff failed\n");
+		return -1;
+	}
+
+	/* Step.b UnBind */
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (chn[i].enable) {
+			ret = IMP_System_UnBind(&chn[i].framesource_chn, &chn[i].imp_encoder);
+			if (ret < 0) {
+				IMP_LOG_ERR(TAG, "UnBind FrameSource channel%d and Encoder failed\n", i);
+				return -1;
+			}
+		}
+	}
+
+	/* Step.c Encoder exit */
+	ret = sample_encoder_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Encoder exit failed\n");
+		return -1;
+	}
+
+	/* Step.d FrameSource exit */
+	ret = sample_framesource_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource exit failed\n");
+		return -1;
+	}
+
+	/* Step.e System exit */
+	ret = sample_system_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "sample_system_exit() failed\n");
+		return -1;
+	}
+
+	return 0;
+}
@@ -21,6 +21,8 @@ int main(int argc, char *argv[])
 {
 	int i, ret;
 
+	sample_pipeline = SAMPLE_PIPE_H264;
+
 	/* Step.1 System init */
 	ret = sample_system_init();
 	if (ret < 0) {
@@ -0,0 +1,199 @@
+/*
+ * sample-Encoder-jpeg-service.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_system.h>
+#include <imp/imp_framesource.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-common.h"
+#include "sample-snap-service.h"
+
+#define TAG "Sample-Encoder-jpeg-service"
+
+/* Simulated API users: each fires a burst of requests now and then */
+#define NR_CLIENTS			8
+#define NR_BURSTS			10
+#define BURST_REQUESTS		4
+#define BURST_GAP_US		700000
+#define SNAP_TIMEOUT_MS		1000
+
+extern struct chn_conf chn[];
+
+static snap_service_t *svc;
+
+static void *client_thread(void *arg)
+{
+	int id = (int)(long)arg;
+	int encChn = 2 + chn[id % FS_CHN_NUM].index;
+	const snap_t *snap;
+	char snap_path[64];
+	int i, k, fd;
+
+	if (!chn[id % FS_CHN_NUM].enable)
+		encChn = 2 + chn[0].index;
+
+	for (i = 0; i < NR_BURSTS; i++) {
+		for (k = 0; k < BURST_REQUESTS; k++) {
+			snap = snap_service_get(svc, encChn, -1, SNAP_TIMEOUT_MS);
+			if (snap == NULL) {
+				IMP_LOG_ERR(TAG, "client%d: no snapshot of chn%d\n", id, encChn);
+				continue;
+			}
+			/* Hand it out from memory; the first client also keeps one on disk */
+			if (id == 0 && i == NR_BURSTS - 1 && k == 0) {
+				sprintf(snap_path, "%s/snap-service-%d.jpg", SNAP_FILE_PATH_PREFIX, encChn);
+				fd = open(snap_path, O_RDWR | O_CREAT | O_TRUNC, 0777);
+				if (fd >= 0) {
+					if (write(fd, snap->data, snap->len) != (ssize_t)snap->len)
+						IMP_LOG_ERR(TAG, "snap write error:%s\n", strerror(errno));
+					close(fd);
+				}
+			}
+			snap_service_put(svc, snap);
+		}
+		usleep(BURST_GAP_US + id * 10000);
+	}
+
+	return ((void *)0);
+}
+
+int main(int argc, char *argv[])
+{
+	snap_service_attr_t attr;
+	pthread_t tid[NR_CLIENTS];
+	int i, ret;
+
+	sample_pipeline = SAMPLE_PIPE_JPEG;
+
+	/* Step.1 System init */
+	ret = sample_system_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_System_Init() failed\n");
+		return -1;
+	}
+
+	/* Step.2 FrameSource init */
+	ret = sample_framesource_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource init failed\n");
+		return -1;
+	}
+
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (chn[i].enable) {
+			ret = IMP_Encoder_CreateGroup(chn[i].index);
+			if (ret < 0) {
+				IMP_LOG_ERR(TAG, "IMP_Encoder_CreateGroup(%d) error !\n", i);
+				return -1;
+			}
+		}
+	}
+
+	/* Step.3 Encoder init */
+	ret = sample_jpeg_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Encoder init failed\n");
+		return -1;
+	}
+
+	/* Step.4 Bind */
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (chn[i].enable) {
+			ret = IMP_System_Bind(&chn[i].framesource_chn, &chn[i].imp_encoder);
+			if (ret < 0) {
+				IMP_LOG_ERR(TAG, "Bind FrameSource channel%d and Encoder failed\n",i);
+				return -1;
+			}
+		}
+	}
+
+	/* Step.5 Stream On */
+	ret = sample_framesource_streamon();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "ImpStreamOn failed\n");
+		return -1;
+	}
+
+	/* drop several pictures of invalid data */
+	sleep(SLEEP_TIME);
+
+	/* Step.6 Snapshot service, the JPEG channels stay warm from now on */
+	memset(&attr, 0, sizeof(attr));
+	svc = snap_service_create(&attr);
+	if (svc == NULL)
+		return -1;
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (chn[i].enable && snap_service_add_chn(svc, 2 + chn[i].index) < 0)
+			return -1;
+	}
+	if (snap_service_start(svc) < 0)
+		return -1;
+
+	/* Step.7 Serve the clients */
+	for (i = 0; i < NR_CLIENTS; i++) {
+		ret = pthread_create(&tid[i], NULL, client_thread, (void *)(long)i);
+		if (ret != 0) {
+			IMP_LOG_ERR(TAG, "Create client%d thread failed\n", i);
+			return -1;
+		}
+	}
+	for (i = 0; i < NR_CLIENTS; i++)
+		pthread_join(tid[i], NULL);
+
+	snap_service_dump_stat(svc);
+	snap_service_destroy(svc);
+
+	/* Exit sequence as follow... */
+	/* Step.a Stream Off */
+	ret = sample_framesource_streamoff();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource StreamOff failed\n");
+		return -1;
+	}
+
+	/* Step.b UnBind */
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (chn[i].enable) {
+			ret = IMP_System_UnBind(&chn[i].framesource_chn, &chn[i].imp_encoder);
+			if (ret < 0) {
+				IMP_LOG_ERR(TAG, "UnBind FrameSource channel%d and Encoder failed\n",i);
+				return -1;
+			}
+		}
+	}
+
+	/* Step.c Encoder exit */
+	ret = sample_encoder_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "Encoder exit failed\n");
+		return -1;
+	}
+
+	/* Step.d FrameSource exit */
+	ret = sample_framesource_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource exit failed\n");
+		return -1;
+	}
+
+	/* Step.e System exit */
+	ret = sample_system_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "sample_system_exit() failed\n");
+		return -1;
+	}
+
+	return 0;
+}
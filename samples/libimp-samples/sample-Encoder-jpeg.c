@@ -22,6 +22,8 @@ int main(int argc, char *argv[])
 {
 	int i, ret;
 
+	sample_pipeline = SAMPLE_PIPE_JPEG;
+
 	/* Step.1 System init */
 	ret = sample_system_init();
 	if (ret < 0) {
@@ -0,0 +1,214 @@
+/*
+ * sample-FrameSource-fanout.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_system.h>
+#include <imp/imp_framesource.h>
+
+#include "sample-common.h"
+#include "sample-frame-hub.h"
+
+#define TAG "Sample-FrameSource-fanout"
+
+#define RUN_TIME_US			10000000
+/* frames the hub keeps, the channel needs one more to fill */
+#define HUB_FRAMES			3
+
+#define SNAP_INTERVAL_US	3000000
+#define SNAP_MAX_HOLD_MS	500
+/* analytics must be done within two frame intervals */
+#define ANALYTICS_MAX_HOLD_MS	(2000 * SENSOR_FRAME_RATE_DEN / SENSOR_FRAME_RATE_NUM)
+/* the simulated display takes this long per frame, and now and then stalls */
+#define PREVIEW_TIME_US		30000
+#define PREVIEW_STALL_US	300000
+#define PREVIEW_MAX_HOLD_MS	100
+
+extern struct chn_conf chn[];
+
+static volatile int running = 1;
+
+/* Raw snapshotter: writes the NV12 picture straight from the pool, no copy */
+static void *snap_thread(void *arg)
+{
+	frame_hub_sub_t *sub = (frame_hub_sub_t *)arg;
+	frame_hub_ref_t ref;
+	char path[64];
+	FILE *fp;
+	int n = 0;
+
+	while (running) {
+		usleep(SNAP_INTERVAL_US);
+		if (frame_hub_get(sub, &ref, 1000) < 0)
+			continue;
+
+		sprintf(path, "%s/snap-%d.nv12", SNAP_FILE_PATH_PREFIX, n);
+		fp = fopen(path, "wb");
+		if (fp == NULL) {
+			IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+			frame_hub_put(sub, &ref);
+			continue;
+		}
+		fwrite((void *)(uintptr_t)ref.info.virAddr, ref.info.size, 1, fp);
+		fclose(fp);
+
+		/* the picture may have been overwritten under the write */
+		if (frame_hub_put(sub, &ref) < 0) {
+			IMP_LOG_WARN(TAG, "%s taken back while written, discarded\n", path);
+			unlink(path);
+			continue;
+		}
+		IMP_LOG_INFO(TAG, "%s: frame %u, %ux%u\n", path, ref.seq, ref.info.width, ref.info.height);
+		n++;
+	}
+
+	return ((void *)0);
+}
+
+/* Stand-in for custom analytics: mean luma of every frame, read in place */
+static void *analytics_thread(void *arg)
+{
+	frame_hub_sub_t *sub = (frame_hub_sub_t *)arg;
+	frame_hub_ref_t ref;
+	const uint8_t *y;
+	uint64_t sum;
+	uint32_t i, n;
+
+	while (running) {
+		if (frame_hub_get(sub, &ref, 1000) < 0)
+			continue;
+
+		y = (const uint8_t *)(uintptr_t)ref.info.virAddr;
+		n = ref.info.width * ref.info.height;
+		sum = 0;
+		for (i = 0; i < n; i += 16)
+			sum += y[i];
+
+		if (frame_hub_put(sub, &ref) == 0 && ref.seq % 25 == 0)
+			IMP_LOG_INFO(TAG, "analytics: frame %u mean luma %llu\n", ref.seq,
+					(unsigned long long)(sum * 16 / n));
+	}
+
+	return ((void *)0);
+}
+
+/* Stand-in for a local display: always the newest frame, sometimes too slow */
+static void *preview_thread(void *arg)
+{
+	frame_hub_sub_t *sub = (frame_hub_sub_t *)arg;
+	frame_hub_ref_t ref;
+	int n = 0;
+
+	while (running) {
+		if (frame_hub_get(sub, &ref, 1000) < 0)
+			continue;
+
+		usleep(++n % 50 ? PREVIEW_TIME_US : PREVIEW_STALL_US);
+		if (frame_hub_put(sub, &ref) < 0)
+			IMP_LOG_WARN(TAG, "preview: frame %u taken back, not shown\n", ref.seq);
+	}
+
+	return ((void *)0);
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+	frame_hub_t *hub;
+	frame_hub_sub_t *snap_sub, *analytics_sub, *preview_sub;
+	pthread_t snap_tid, analytics_tid, preview_tid;
+
+	/* only the second channel is read, by the hub alone */
+	chn[0].enable = 0;
+	chn[1].enable = 1;
+	chn[1].fs_chn_attr.nrVBs = HUB_FRAMES + 1;
+
+	/* Step.1 System init */
+	ret = sample_system_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_System_Init() failed\n");
+		return -1;
+	}
+
+	/* Step.2 FrameSource init */
+	ret = sample_framesource_init();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource init failed\n");
+		return -1;
+	}
+
+	/* Step.3 Stream On */
+	ret = sample_framesource_streamon();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "ImpStreamOn failed\n");
+		return -1;
+	}
+
+	/* Step.4 One hub, three readers on the same frames */
+	hub = frame_hub_create(chn[1].index, HUB_FRAMES);
+	if (hub == NULL) {
+		IMP_LOG_ERR(TAG, "frame_hub_create(%d) failed\n", chn[1].index);
+		return -1;
+	}
+
+	snap_sub = frame_hub_subscribe(hub, "snap", 1, SNAP_MAX_HOLD_MS);
+	analytics_sub = frame_hub_subscribe(hub, "analytics", 1, ANALYTICS_MAX_HOLD_MS);
+	preview_sub = frame_hub_subscribe(hub, "preview", 1, PREVIEW_MAX_HOLD_MS);
+	if (snap_sub == NULL || analytics_sub == NULL || preview_sub == NULL) {
+		IMP_LOG_ERR(TAG, "frame_hub_subscribe failed\n");
+		return -1;
+	}
+
+	pthread_create(&snap_tid, NULL, snap_thread, snap_sub);
+	pthread_create(&analytics_tid, NULL, analytics_thread, analytics_sub);
+	pthread_create(&preview_tid, NULL, preview_thread, preview_sub);
+
+	ret = frame_hub_start(hub);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "frame_hub_start failed\n");
+		return -1;
+	}
+
+	/* Step.5 Run a while */
+	usleep(RUN_TIME_US);
+	running = 0;
+	frame_hub_stop(hub);
+	pthread_join(snap_tid, NULL);
+	pthread_join(analytics_tid, NULL);
+	pthread_join(preview_tid, NULL);
+	frame_hub_dump_stat(hub);
+	frame_hub_destroy(hub);
+
+	/* Exit sequence as follow */
+	/* Step.a Stream Off */
+	ret = sample_framesource_streamoff();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource StreamOff failed\n");
+		return -1;
+	}
+
+	/* Step.b FrameSource exit */
+	ret = sample_framesource_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "FrameSource exit failed\n");
+		return -1;
+	}
+
+	/* Step.c System exit */
+	ret = sample_system_exit();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "sample_system_exit() failed\n");
+		return -1;
+	}
+
+	return 0;
+}
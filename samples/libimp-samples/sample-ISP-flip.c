@@ -32,6 +32,8 @@ int main(int argc, char *argv[])
 	pthread_t tid;
 	int i, ret;
 
+	sample_pipeline = SAMPLE_PIPE_H264;
+
 	/* Step.1 System init */
 	ret = sample_system_init();
 	if (ret < 0) {
@@ -20,6 +20,9 @@
 #include <imp/imp_utils.h>
 
 #include "sample-common.h"
+#include "sample-osd-stamp.h"
+#include "sample-osd-sched.h"
+#include "sample-osd-text.h"
 
 #ifdef SUPPORT_RGB555LE
 #include "bgramapinfo_rgb555le.h"
@@ -29,6 +32,10 @@
 
 #define TAG "Sample-OSD"
 
+/* Camera name and site, bottom left */
+#define LABEL_TEXT		"Ingenic T20\n\xe5\x89\x8d\xe9\x97\xa8 CH0"
+#define LABEL_LINE_GAP	4
+
 extern struct chn_conf chn[];
 
 int grpNum = 0;
@@ -63,78 +70,93 @@ static int osd_show(void)
 	return 0;
 }
 
-static void *update_thread(void *p)
+/* The font tables' glyphs: the ten digits, then '-', ' ' and ':' */
+static osd_atlas_t *timestamp_atlas(void)
 {
-	int ret;
+	static const char chars[] = "0123456789- :";
+	osd_glyph_src_t glyphs[sizeof(chars) - 1];
+	int i;
+
+	for (i = 0; i < sizeof(glyphs) / sizeof(glyphs[0]); i++) {
+		glyphs[i].c = chars[i];
+		glyphs[i].width = gBgramap[i].width;
+		glyphs[i].data = (void *)gBgramap[i].pdata;
+	}
 
-	/*generate time*/
-	char DateStr[40];
-	time_t currTime;
-	struct tm *currDate;
-	unsigned i = 0, j = 0;
-	void *dateData = NULL;
-	uint32_t *data = p;
-	IMPOSDRgnAttrData rAttrData;
+	return osd_atlas_create(glyphs, sizeof(glyphs) / sizeof(glyphs[0]), OSD_REGION_HEIGHT,
+			OSD_FONT_PIXFMT, OSD_FONT_PIXFMT);
+}
 
-	ret = osd_show();
+static IMPRgnHandle label_rgn = INVHANDLE;
+
+/* A region of the label's size, with the label in it */
+static osd_text_t *label_init(osd_font_t *font)
+{
+	IMPOSDRgnAttr rAttr;
+	IMPOSDGrpRgnAttr grAttr;
+	osd_text_t *label;
+	int ret, w, h;
+
+	osd_font_measure(font, LABEL_TEXT, OSD_TEXT_UTF8, LABEL_LINE_GAP, &w, &h);
+
+	label_rgn = IMP_OSD_CreateRgn(NULL);
+	if (label_rgn == INVHANDLE) {
+		IMP_LOG_ERR(TAG, "IMP_OSD_CreateRgn Label error !\n");
+		return NULL;
+	}
+	ret = IMP_OSD_RegisterRgn(label_rgn, grpNum, NULL);
 	if (ret < 0) {
-		IMP_LOG_ERR(TAG, "OSD show error\n");
+		IMP_LOG_ERR(TAG, "IMP_OSD_RegisterRgn Label failed\n");
 		return NULL;
 	}
 
-	while(1) {
-			int penpos_t = 0;
-			int fontadv = 0;
-
-			time(&currTime);
-			currDate = localtime(&currTime);
-			memset(DateStr, 0, 40);
-			strftime(DateStr, 40, "%Y-%m-%d %I:%M:%S", currDate);
-			for (i = 0; i < 20; i++) {
-				switch(DateStr[i]) {
-					case '0' ... '9':
-						dateData = (void *)gBgramap[DateStr[i] - '0'].pdata;
-						fontadv = gBgramap[DateStr[i] - '0'].width;
-						penpos_t += gBgramap[DateStr[i] - '0'].width;
-						break;
-					case '-':
-						dateData = (void *)gBgramap[10].pdata;
-						fontadv = gBgramap[10].width;
-						penpos_t += gBgramap[10].width;
-						break;
-					case ' ':
-						dateData = (void *)gBgramap[11].pdata;
-						fontadv = gBgramap[11].width;
-						penpos_t += gBgramap[11].width;
-						break;
-					case ':':
-						dateData = (void *)gBgramap[12].pdata;
-						fontadv = gBgramap[12].width;
-						penpos_t += gBgramap[12].width;
-						break;
-					default:
-						break;
-				}
-#ifdef SUPPORT_RGB555LE
-				for (j = 0; j < OSD_REGION_HEIGHT; j++) {
-					memcpy((void *)((uint16_t *)data + j*20*OSD_REGION_WIDTH + penpos_t),
-							(void *)((uint16_t *)dateData + j*fontadv), fontadv*2);
-				}
-#else
-				for (j = 0; j < OSD_REGION_HEIGHT; j++) {
-					memcpy((void *)((uint32_t *)data + j*20*OSD_REGION_WIDTH + penpos_t),
-							(void *)((uint32_t *)dateData + j*fontadv), fontadv*4);
-				}
+	memset(&rAttr, 0, sizeof(IMPOSDRgnAttr));
+	rAttr.type = OSD_REG_PIC;
+	rAttr.rect.p0.x = 10;
+	rAttr.rect.p0.y = SENSOR_HEIGHT - 10 - h;
+	rAttr.rect.p1.x = rAttr.rect.p0.x + w - 1;
+	rAttr.rect.p1.y = rAttr.rect.p0.y + h - 1;
+	rAttr.fmt = OSD_FONT_PIXFMT;
+	rAttr.data.picData.pData = NULL;
+	ret = IMP_OSD_SetRgnAttr(label_rgn, &rAttr);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_OSD_SetRgnAttr Label error !\n");
+		return NULL;
+	}
 
-#endif
-			}
-			rAttrData.picData.pData = data;
-			IMP_OSD_UpdateRgnAttrData(prHander[0], &rAttrData);
+	memset(&grAttr, 0, sizeof(IMPOSDGrpRgnAttr));
+	grAttr.show = 0;
+	grAttr.gAlphaEn = 1;
+	grAttr.fgAlhpa = 0xff;
+	grAttr.layer = 3;
+	if (IMP_OSD_SetGrpRgnAttr(label_rgn, grpNum, &grAttr) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_OSD_SetGrpRgnAttr Label error !\n");
+		return NULL;
+	}
 
-			sleep(1);
+	label = osd_text_create(label_rgn, font, w, h);
+	if (label == NULL)
+		return NULL;
+	osd_text_set_layout(label, OSD_TEXT_LEFT, LABEL_LINE_GAP, 0);
+	if (osd_text_set(label, LABEL_TEXT, OSD_TEXT_UTF8) < 0) {
+		osd_text_destroy(label);
+		return NULL;
 	}
 
-	return NULL;
+	return label;
+}
+
+static void label_exit(osd_text_t *label)
+{
+	osd_text_dump_stat(label);
+	osd_text_destroy(label);
+
+	if (IMP_OSD_ShowRgn(label_rgn, grpNum, 0) < 0)
+		IMP_LOG_ERR(TAG, "IMP_OSD_ShowRgn close Label error\n");
+	if (IMP_OSD_UnRegisterRgn(label_rgn, grpNum) < 0)
+		IMP_LOG_ERR(TAG, "IMP_OSD_UnRegisterRgn Label error\n");
+	IMP_OSD_DestroyRgn(label_rgn);
+	label_rgn = INVHANDLE;
 }
 
 int main(int argc, char *argv[])
@@ -145,6 +167,8 @@ int main(int argc, char *argv[])
 	chn[0].enable = 1;
 	chn[1].enable = 0;
 
+	sample_pipeline = SAMPLE_PIPE_H264 | SAMPLE_PIPE_OSD;
+
 	/* Step.1 System init */
 	ret = sample_system_init();
 	if (ret < 0) {
@@ -198,21 +222,57 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	/* Step.6 Create OSD bgramap update thread */
-	pthread_t tid;
-#ifdef SUPPORT_RGB555LE
-	uint32_t *timeStampData = malloc(20 * OSD_REGION_HEIGHT * OSD_REGION_WIDTH * 2);
-#else
-	uint32_t *timeStampData = malloc(20 * OSD_REGION_HEIGHT * OSD_REGION_WIDTH * 4);
-#endif
-	if (timeStampData == NULL) {
-		IMP_LOG_ERR(TAG, "valloc timeStampData error\n");
+	/* Step.6 Schedule the timestamp updates on the second */
+	osd_atlas_t *atlas = timestamp_atlas();
+	if (atlas == NULL) {
+		IMP_LOG_ERR(TAG, "timestamp glyph atlas error\n");
+		return -1;
+	}
+	/* the timestamp region as sample_osd_init() set it up */
+	osd_stamp_t *stamp = osd_stamp_create(prHander[0], atlas, 20 * OSD_REGION_WIDTH, OSD_REGION_HEIGHT);
+	if (stamp == NULL) {
+		IMP_LOG_ERR(TAG, "timestamp renderer error\n");
+		return -1;
+	}
+
+	osd_sched_t *sched = osd_sched_create(chn[0].index, SENSOR_FRAME_RATE_NUM / SENSOR_FRAME_RATE_DEN);
+	if (sched == NULL || osd_sched_add_stamp(sched, stamp, "%Y-%m-%d %I:%M:%S") < 0) {
+		IMP_LOG_ERR(TAG, "OSD scheduler error\n");
 		return -1;
 	}
 
-	ret = pthread_create(&tid, NULL, update_thread, timeStampData);
-	if (ret) {
-		IMP_LOG_ERR(TAG, "thread create error\n");
+	/* a text label beside the timestamp */
+	osd_font_attr_t fattr = {
+		.fmt = OSD_FONT_PIXFMT,
+		.scale = 2,
+		.fg = 0xffffffff,
+		.bg = 0,
+		.hzk_path = OSD_HZK16_PATH,
+		.cache_bytes = OSD_LABEL_CACHE_BYTES,
+	};
+	osd_font_t *font = osd_font_create(&fattr);
+	osd_text_t *label = font ? label_init(font) : NULL;
+	if (label == NULL) {
+		IMP_LOG_ERR(TAG, "OSD label error\n");
+		return -1;
+	}
+
+	ret = osd_show();
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "OSD show error\n");
+		return -1;
+	}
+	ret = IMP_OSD_ShowRgn(label_rgn, grpNum, 1);
+	if (ret != 0) {
+		IMP_LOG_ERR(TAG, "IMP_OSD_ShowRgn() Label error\n");
+		return -1;
+	}
+
+	/* landing measured against the frames of chn[0]'s stream */
+	osd_sched = sched;
+	ret = osd_sched_start(sched);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "OSD scheduler start error\n");
 		return -1;
 	}
 
@@ -239,9 +299,16 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	pthread_cancel(tid);
-	pthread_join(tid, NULL);
-	free(timeStampData);
+	osd_sched_stop(sched);
+	osd_sched = NULL;
+	osd_sched_dump_stat(sched);
+	osd_sched_destroy(sched);
+	osd_stamp_dump_stat(stamp);
+	osd_stamp_destroy(stamp);
+	osd_atlas_destroy(atlas);
+	label_exit(label);
+	osd_font_dump_stat(font);
+	osd_font_destroy(font);
 
 	/* Step.b UnBind */
 	ret = IMP_System_UnBind(&osdcell, &chn[0].imp_encoder);
@@ -11,6 +11,7 @@
 #include <imp/imp_encoder.h>
 
 #include "sample-common.h"
+#include "sample-pixfmt.h"
 
 #define TAG "Sample-Snap-RAW"
 extern struct chn_conf chn[];
@@ -21,6 +22,7 @@ int main(int argc, char *argv[])
 
 	IMPFrameInfo *frame_bak;
 	IMPFSChnAttr fs_chn_attr[2];
+	pix_view_t raw;
 	FILE *fp;
 
 	fp = fopen("/tmp/snap.raw", "wb");
@@ -95,7 +97,15 @@ int main(int argc, char *argv[])
 		IMP_LOG_ERR(TAG, "%s(%d):IMP_FrameSource_GetFrame failed\n", __func__, __LINE__);
 		return -1;
 	}
-	fwrite((void *)frame_bak->virAddr, frame_bak->size, 1, fp);
+	/* a frame shorter than the channel's picture is not written */
+	ret = pix_view_from_frame_fmt(&raw, frame_bak, fs_chn_attr[0].pixFmt);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "%s(%d):raw frame %ux%u of %u bytes is short\n", __func__, __LINE__,
+				frame_bak->width, frame_bak->height, frame_bak->size);
+	} else {
+		/* the whole buffer, its samples may be wider than the 8 bits counted */
+		fwrite((void *)(uintptr_t)frame_bak->virAddr, frame_bak->size, 1, fp);
+	}
 	fclose(fp);
 	IMP_FrameSource_ReleaseFrame(0, frame_bak);
 	if (ret < 0) {
@@ -0,0 +1,437 @@
+/*
+ * sample-abr-sim.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host simulation of the adaptive bitrate controller against a link
+ * whose capacity follows a trace.
+ *
+ * The encoder makes frames of bitrate / fps bytes, shaped like the
+ * frames of in.h264 if one is given (I frames included), else with I
+ * frames 6 times the P frames. The RTP socket queues them up to the send
+ * buffer size and the link drains the queue at the trace rate; a frame
+ * that does not fit is dropped and the client waits for the next IDR,
+ * just like rtsp_server_push(). The client sends a receiver report each
+ * second, its round trip time is the base RTT plus the queue delay.
+ *
+ * Every run is done twice, with the controller and at a fixed rate, and
+ * the time the viewer sees a frozen picture (frames missing, or more
+ * than 1s late) is compared. For every capacity drop below the current
+ * rate it checks that the first cut came within one GOP.
+ *
+ * Trace file lines are "<second> <kbps> [loss permille]", the built-in
+ * trace is used without -t.
+ *
+ * usage: sample-abr-sim [-t trace] [-f fps] [-g gop] [-n min_kbps] [-m max_kbps]
+ *                       [-b sndbuf] [-r rtt_ms] [-l lag_frames] [-v] [in.h264]
+ *   -l  frames the encoder takes to reach a new bitrate
+ *   -v  print the state every second
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <imp/imp_log.h>
+
+#include "sample-common.h"
+#include "sample-h264-parse.h"
+#include "sample-abr.h"
+
+#define TAG "Sample-ABR-Sim"
+
+#define MAX_NALS_PER_FRAME	16
+#define MAX_STEPS			256
+#define RR_INTERVAL_US		1000000
+#define LATE_US				1000000		/* a frame this late counts as frozen */
+
+struct step {
+	int64_t		t;
+	uint32_t	kbps;
+	uint32_t	loss_permille;
+};
+
+struct sim_attr {
+	struct step	*step;
+	int			nr_steps;
+	int64_t		duration;
+	int			fps;
+	int			gop;
+	float		*shape;				/* relative frame sizes, average 1 */
+	uint8_t		*key;
+	int			nr_shape;
+	uint32_t	sndbuf;
+	int64_t		base_rtt;
+	int			lag;
+	abr_attr_t	abr;
+	int			verbose;
+};
+
+struct sim_result {
+	int64_t		frozen_us;
+	uint32_t	dropped;
+	uint64_t	sent_bits;
+	uint64_t	capacity_bits;
+	int64_t		lat_total_us;
+	int64_t		lat_max_us;
+	uint32_t	delivered;
+	uint32_t	decreases;
+	uint32_t	increases;
+	int			reactions;			/* capacity drops below the rate */
+	int			late_reactions;		/* first cut later than one GOP */
+	int64_t		max_reaction_us;
+};
+
+static const struct step default_trace[] = {
+	{   0 * 1000000LL, 4000, 0 },
+	{  20 * 1000000LL, 1500, 0 },
+	{  40 * 1000000LL,  600, 0 },
+	{  60 * 1000000LL, 2500, 0 },
+	{  80 * 1000000LL,  300, 0 },
+	{  95 * 1000000LL, 4000, 0 },
+	{ 110 * 1000000LL, 1200, 30 },
+};
+#define DEFAULT_DURATION	(130 * 1000000LL)
+
+static int load_trace(const char *path, struct sim_attr *sa)
+{
+	char line[128];
+	double sec;
+	unsigned int kbps, loss;
+	FILE *fp;
+	int n;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+		return -1;
+	}
+	sa->nr_steps = 0;
+	while (fgets(line, sizeof(line), fp) && sa->nr_steps < MAX_STEPS) {
+		loss = 0;
+		n = sscanf(line, "%lf %u %u", &sec, &kbps, &loss);
+		if (line[0] == '#' || n < 2)
+			continue;
+		sa->step[sa->nr_steps].t = sec * 1000000;
+		sa->step[sa->nr_steps].kbps = kbps;
+		sa->step[sa->nr_steps].loss_permille = loss;
+		sa->nr_steps++;
+	}
+	fclose(fp);
+	if (sa->nr_steps == 0) {
+		IMP_LOG_ERR(TAG, "%s: empty trace\n", path);
+		return -1;
+	}
+	/* the last step lasts as long as the one before it, at least 10s */
+	sa->duration = sa->step[sa->nr_steps - 1].t + 10000000;
+	if (sa->nr_steps > 1 && sa->step[sa->nr_steps - 1].t - sa->step[sa->nr_steps - 2].t > 10000000)
+		sa->duration = 2 * sa->step[sa->nr_steps - 1].t - sa->step[sa->nr_steps - 2].t;
+
+	return 0;
+}
+
+/* Frame sizes of the file relative to their average, key frames flagged */
+static int load_shape(const char *path, struct sim_attr *sa)
+{
+	h264_nal_t nal[MAX_NALS_PER_FRAME];
+	struct stat st;
+	uint8_t *buf;
+	size_t pos = 0;
+	double total = 0;
+	int fd, i, n, size = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+		return -1;
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED)
+		return -1;
+
+	sa->nr_shape = 0;
+	while ((n = h264_next_frame(buf, st.st_size, &pos, nal, MAX_NALS_PER_FRAME)) > 0) {
+		if (sa->nr_shape == size) {
+			size = size ? size * 2 : 1024;
+			sa->shape = realloc(sa->shape, size * sizeof(float));
+			sa->key = realloc(sa->key, size);
+		}
+		sa->shape[sa->nr_shape] = 0;
+		for (i = 0; i < n; i++)
+			sa->shape[sa->nr_shape] += nal[i].len;
+		sa->key[sa->nr_shape] = h264_is_key_frame(nal, n);
+		total += sa->shape[sa->nr_shape];
+		sa->nr_shape++;
+	}
+	munmap(buf, st.st_size);
+	if (sa->nr_shape == 0 || !sa->key[0]) {
+		IMP_LOG_ERR(TAG, "%s: no frames or no IDR first\n", path);
+		return -1;
+	}
+	for (i = 0; i < sa->nr_shape; i++)
+		sa->shape[i] *= sa->nr_shape / total;
+
+	return 0;
+}
+
+static void synthetic_shape(struct sim_attr *sa)
+{
+	int i;
+
+	sa->nr_shape = sa->gop;
+	sa->shape = malloc(sa->gop * sizeof(float));
+	sa->key = malloc(sa->gop);
+	for (i = 0; i < sa->gop; i++) {
+		sa->shape[i] = (i ? 1.0 : 6.0) * sa->gop / (sa->gop + 5);
+		sa->key[i] = i == 0;
+	}
+}
+
+static const struct step *step_at(const struct sim_attr *sa, int64_t t)
+{
+	int i;
+
+	for (i = sa->nr_steps - 1; i > 0 && sa->step[i].t > t; i--)
+		;
+	return &sa->step[i];
+}
+
+static int run(const struct sim_attr *sa, int adaptive, struct sim_result *res)
+{
+	const struct step *link;
+	abr_t *abr = NULL;
+	abr_link_t al;
+	abr_stat_t ast;
+	double queue = 0;				/* bytes */
+	uint32_t kbps = sa->abr.max_kbps, enc_kbps = kbps, pending = 0, size, new_kbps;
+	int64_t t, dt, frame_us = 1000000 / sa->fps, last_rr = -1, rr_rtt = -1;
+	int64_t lat, drop_at = -1, next_print = 0;
+	int64_t pending_at = 0;
+	uint32_t prev_link = step_at(sa, 0)->kbps, reports = 0, loss_permille = 0;
+	int i, wait_idr = 0, key;
+
+	memset(res, 0, sizeof(*res));
+	if (adaptive) {
+		abr = abr_create(&sa->abr);
+		if (abr == NULL)
+			return -1;
+	}
+
+	srand(1);
+	for (i = 0, t = 0; t < sa->duration; i++, t += frame_us) {
+		link = step_at(sa, t);
+
+		/* the link drained the queue since the last frame */
+		dt = i ? frame_us : 0;
+		queue -= (double)link->kbps * dt / 8000;
+		if (queue < 0)
+			queue = 0;
+		res->capacity_bits += (uint64_t)(link->kbps < sa->abr.max_kbps ? link->kbps : sa->abr.max_kbps)
+			* dt / 1000;
+
+		/* capacity now below what is sent: the controller has one GOP */
+		if (link->kbps != prev_link) {
+			if (link->kbps < enc_kbps && drop_at < 0) {
+				drop_at = t;
+				res->reactions++;
+			}
+			prev_link = link->kbps;
+		}
+
+		/* the encoder settles on a new rate after lag frames */
+		if (pending && i >= pending_at) {
+			enc_kbps = pending;
+			pending = 0;
+		}
+
+		size = (uint64_t)enc_kbps * 1000 / 8 / sa->fps * sa->shape[i % sa->nr_shape];
+		key = sa->key[i % sa->nr_shape];
+		if (wait_idr && !key) {
+			res->frozen_us += frame_us;
+		} else if (queue + size > sa->sndbuf) {
+			/* EAGAIN, the rest of the GOP is lost */
+			res->dropped++;
+			res->frozen_us += frame_us;
+			wait_idr = 1;
+		} else {
+			wait_idr = 0;
+			queue += size;
+			res->sent_bits += (uint64_t)size * 8;
+			lat = sa->base_rtt / 2 + queue * 8000 / link->kbps;
+			res->lat_total_us += lat;
+			if (lat > res->lat_max_us)
+				res->lat_max_us = lat;
+			res->delivered++;
+			if (lat > LATE_US)
+				res->frozen_us += frame_us;
+		}
+
+		/* receiver reports, lost at the trace loss rate */
+		if (last_rr < 0 || t - last_rr >= RR_INTERVAL_US) {
+			last_rr = t;
+			if (rand() % 1000 >= (int)link->loss_permille || reports == 0) {
+				rr_rtt = sa->base_rtt + (int64_t)(queue * 8000 / link->kbps);
+				loss_permille = link->loss_permille;
+				reports++;
+			}
+		}
+
+		if (!adaptive)
+			continue;
+
+		memset(&al, 0, sizeof(al));
+		al.clients = 1;
+		al.queue_bytes = queue;
+		al.rtt_us = rr_rtt;
+		al.loss_permille = loss_permille;
+		al.rr_age_us = t - last_rr;
+		al.reports = reports;
+		al.dropped = res->dropped;
+		new_kbps = abr_update(abr, &al, t);
+		if (new_kbps) {
+			if (new_kbps < kbps && drop_at >= 0) {
+				if (t - drop_at > (int64_t)sa->gop * frame_us)
+					res->late_reactions++;
+				if (t - drop_at > res->max_reaction_us)
+					res->max_reaction_us = t - drop_at;
+				drop_at = -1;
+			}
+			kbps = new_kbps;
+			pending = kbps;
+			pending_at = i + sa->lag;
+		}
+		/* the rate is already below the new capacity */
+		if (drop_at >= 0 && kbps <= link->kbps)
+			drop_at = -1;
+
+		if (sa->verbose && t >= next_print) {
+			abr_get_stat(abr, &ast);
+			printf("%6.1fs link %5u kbps, rate %5u kbps, queue %4.0f ms, rtt %4lld ms, %s\n",
+					t / 1e6, link->kbps, enc_kbps, queue * 8 / enc_kbps,
+					(long long)rr_rtt / 1000, ast.congested ? "congested" : "");
+			next_print += 1000000;
+		}
+	}
+
+	if (abr) {
+		abr_get_stat(abr, &ast);
+		res->decreases = ast.decreases;
+		res->increases = ast.increases;
+		abr_destroy(abr);
+	}
+
+	return 0;
+}
+
+static void print_result(const char *name, const struct sim_result *r)
+{
+	printf("%-8s frozen %5.1fs, %3u drops, latency avg %4lld ms max %5lld ms, "
+			"%3.0f%% of capacity used, %u cuts %u raises\n", name, r->frozen_us / 1e6,
+			r->dropped, (long long)(r->delivered ? r->lat_total_us / r->delivered / 1000 : 0),
+			(long long)r->lat_max_us / 1000,
+			r->capacity_bits ? 100.0 * r->sent_bits / r->capacity_bits : 0.0,
+			r->decreases, r->increases);
+}
+
+int main(int argc, char *argv[])
+{
+	struct step trace[MAX_STEPS];
+	struct sim_attr sa;
+	struct sim_result adaptive, fixed;
+	int opt;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.step = trace;
+	sa.fps = SENSOR_FRAME_RATE_NUM / SENSOR_FRAME_RATE_DEN;
+	sa.gop = 2 * sa.fps;
+	sa.abr.min_kbps = 256;
+	sa.abr.max_kbps = 2000;
+	sa.sndbuf = 160 * 1024;
+	sa.base_rtt = 20000;
+	memcpy(trace, default_trace, sizeof(default_trace));
+	sa.nr_steps = sizeof(default_trace) / sizeof(default_trace[0]);
+	sa.duration = DEFAULT_DURATION;
+
+	while ((opt = getopt(argc, argv, "t:f:g:n:m:b:r:l:v")) != -1) {
+		switch (opt) {
+		case 't':
+			if (load_trace(optarg, &sa) < 0)
+				return -1;
+			break;
+		case 'f':
+			sa.fps = atoi(optarg);
+			break;
+		case 'g':
+			sa.gop = atoi(optarg);
+			break;
+		case 'n':
+			sa.abr.min_kbps = atoi(optarg);
+			break;
+		case 'm':
+			sa.abr.max_kbps = atoi(optarg);
+			break;
+		case 'b':
+			sa.sndbuf = atoi(optarg);
+			break;
+		case 'r':
+			sa.base_rtt = atoi(optarg) * 1000LL;
+			break;
+		case 'l':
+			sa.lag = atoi(optarg);
+			break;
+		case 'v':
+			sa.verbose = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (sa.fps <= 0 || sa.gop <= 0 || sa.abr.max_kbps == 0)
+		goto usage;
+
+	if (optind < argc) {
+		if (load_shape(argv[optind], &sa) < 0)
+			return -1;
+		/* the file decides where the IDRs are */
+		for (sa.gop = 1; sa.gop < sa.nr_shape && !sa.key[sa.gop]; sa.gop++)
+			;
+	} else {
+		synthetic_shape(&sa);
+	}
+	sa.abr.gop_ms = sa.gop * 1000 / sa.fps;
+
+	printf("%lld s, %d fps, GOP %d frames, %u-%u kbps, send buffer %u bytes, base RTT %lld ms\n",
+			(long long)sa.duration / 1000000, sa.fps, sa.gop, sa.abr.min_kbps, sa.abr.max_kbps,
+			sa.sndbuf, (long long)sa.base_rtt / 1000);
+
+	if (run(&sa, 1, &adaptive) < 0 || run(&sa, 0, &fixed) < 0)
+		return -1;
+
+	print_result("adaptive", &adaptive);
+	print_result("fixed", &fixed);
+	printf("%d capacity drops below the rate, first cut after at most %lld ms, "
+			"%d later than one GOP (%d ms)\n", adaptive.reactions,
+			(long long)adaptive.max_reaction_us / 1000, adaptive.late_reactions, sa.abr.gop_ms);
+
+	free(sa.shape);
+	free(sa.key);
+
+	if (adaptive.late_reactions || adaptive.frozen_us > fixed.frozen_us) {
+		IMP_LOG_ERR(TAG, "controller did not keep up\n");
+		return -1;
+	}
+	printf("ok\n");
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-t trace] [-f fps] [-g gop] [-n min_kbps] [-m max_kbps]\n"
+			"       [-b sndbuf] [-r rtt_ms] [-l lag_frames] [-v] [in.h264]\n", argv[0]);
+	return -1;
+}
@@ -0,0 +1,245 @@
+/*
+ * sample-abr.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <imp/imp_log.h>
+
+#include "sample-abr.h"
+
+#define TAG "Sample-ABR"
+
+/* Cuts never come faster than this, whatever the GOP */
+#define ABR_MIN_CUT_SPACING_US	200000
+/* Queue samples in the window, one per frame */
+#define ABR_QUEUE_SAMPLES		64
+
+struct queue_sample {
+	int64_t		t;
+	uint32_t	bytes;
+};
+
+struct abr {
+	abr_attr_t	attr;
+	uint32_t	kbps;
+	int64_t		last_change;		/* 0: never */
+	uint32_t	queue_at_cut;
+	int64_t		rtt_at_cut;
+	int64_t		clean_since;		/* -1: not clean */
+	uint32_t	last_dropped;
+	int64_t		rtt_min[2];			/* this and the previous half of ABR_RTT_BASE_US */
+	int64_t		rtt_epoch;
+	struct queue_sample	queue[ABR_QUEUE_SAMPLES];
+	int			q_head;
+	int			q_nr;
+	int			q_valid;			/* samples cover the whole window */
+	uint32_t	last_reports;
+	int64_t		rtt[2];				/* last two receiver reports */
+	uint32_t	loss[2];
+	abr_stat_t	stat;
+};
+
+#define DEFAULT(v, d)	((v) ? (v) : (d))
+
+abr_t *abr_create(const abr_attr_t *attr)
+{
+	abr_t *abr;
+
+	if (attr->max_kbps == 0 || attr->min_kbps > attr->max_kbps) {
+		IMP_LOG_ERR(TAG, "bad bitrate range %u-%u kbps\n", attr->min_kbps, attr->max_kbps);
+		return NULL;
+	}
+
+	abr = calloc(1, sizeof(abr_t));
+	if (abr == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+
+	abr->attr = *attr;
+	abr->attr.min_kbps = DEFAULT(attr->min_kbps, 1);
+	abr->attr.gop_ms = DEFAULT(attr->gop_ms, 2000);
+	abr->attr.queue_high_ms = DEFAULT(attr->queue_high_ms, ABR_QUEUE_HIGH_MS);
+	abr->attr.queue_low_ms = DEFAULT(attr->queue_low_ms, ABR_QUEUE_LOW_MS);
+	abr->attr.rtt_high_ms = DEFAULT(attr->rtt_high_ms, ABR_RTT_HIGH_MS);
+	abr->attr.rtt_low_ms = DEFAULT(attr->rtt_low_ms, ABR_RTT_LOW_MS);
+	abr->attr.loss_high_permille = DEFAULT(attr->loss_high_permille, ABR_LOSS_HIGH_PERMILLE);
+	abr->attr.loss_low_permille = DEFAULT(attr->loss_low_permille, ABR_LOSS_LOW_PERMILLE);
+	abr->attr.rr_timeout_ms = DEFAULT(attr->rr_timeout_ms, ABR_RR_TIMEOUT_MS);
+	abr->attr.recover_ms = DEFAULT(attr->recover_ms, ABR_RECOVER_MS);
+	abr->attr.step_percent = DEFAULT(attr->step_percent, ABR_STEP_PERCENT);
+
+	abr->kbps = attr->max_kbps;
+	abr->clean_since = -1;
+	abr->rtt_min[0] = abr->rtt_min[1] = -1;
+	abr->rtt[0] = abr->rtt[1] = -1;
+
+	return abr;
+}
+
+void abr_destroy(abr_t *abr)
+{
+	free(abr);
+}
+
+/* Lowest RTT of the last ABR_RTT_BASE_US, in two halves so it can rise again */
+static int64_t rtt_base(abr_t *abr, int64_t rtt, int64_t now)
+{
+	if (now - abr->rtt_epoch >= ABR_RTT_BASE_US / 2) {
+		abr->rtt_min[1] = abr->rtt_min[0];
+		abr->rtt_min[0] = -1;
+		abr->rtt_epoch = now;
+	}
+	if (rtt >= 0 && (abr->rtt_min[0] < 0 || rtt < abr->rtt_min[0]))
+		abr->rtt_min[0] = rtt;
+
+	if (abr->rtt_min[1] >= 0 && abr->rtt_min[1] < abr->rtt_min[0])
+		return abr->rtt_min[1];
+	return abr->rtt_min[0];
+}
+
+/* Lowest queue depth over the last ABR_QUEUE_WINDOW_US, 0 until it is that old */
+static uint32_t standing_queue(abr_t *abr, uint32_t bytes, int64_t now)
+{
+	struct queue_sample *q;
+	uint32_t min = bytes;
+	int i;
+
+	while (abr->q_nr > 0) {
+		q = &abr->queue[(abr->q_head - abr->q_nr + ABR_QUEUE_SAMPLES) % ABR_QUEUE_SAMPLES];
+		if (abr->q_nr < ABR_QUEUE_SAMPLES && now - q->t <= ABR_QUEUE_WINDOW_US)
+			break;
+		abr->q_valid |= now - q->t > ABR_QUEUE_WINDOW_US;
+		abr->q_nr--;
+	}
+	q = &abr->queue[abr->q_head];
+	q->t = now;
+	q->bytes = bytes;
+	abr->q_head = (abr->q_head + 1) % ABR_QUEUE_SAMPLES;
+	abr->q_nr++;
+
+	if (!abr->q_valid)
+		return 0;
+	for (i = 1; i <= abr->q_nr; i++) {
+		q = &abr->queue[(abr->q_head - i + ABR_QUEUE_SAMPLES) % ABR_QUEUE_SAMPLES];
+		if (q->bytes < min)
+			min = q->bytes;
+	}
+
+	return min;
+}
+
+static uint32_t set_rate(abr_t *abr, uint32_t kbps, int64_t now)
+{
+	if (kbps < abr->attr.min_kbps)
+		kbps = abr->attr.min_kbps;
+	if (kbps > abr->attr.max_kbps)
+		kbps = abr->attr.max_kbps;
+	if (kbps == abr->kbps)
+		return 0;
+
+	abr->kbps = kbps;
+	abr->last_change = now;
+	abr->stat.kbps = kbps;
+
+	return kbps;
+}
+
+uint32_t abr_update(abr_t *abr, const abr_link_t *link, int64_t now)
+{
+	const abr_attr_t *a = &abr->attr;
+	uint32_t queue, queue_ms, loss, drops, kbps;
+	int64_t rtt, base, rtt_over = -1, spacing;
+	int congested, clean;
+
+	drops = link->dropped > abr->last_dropped ? link->dropped - abr->last_dropped : 0;
+	abr->last_dropped = link->dropped;
+	if (link->clients == 0) {
+		abr->clean_since = -1;
+		abr->q_nr = abr->q_valid = 0;
+		return 0;
+	}
+
+	queue = standing_queue(abr, link->queue_bytes, now);
+	queue_ms = (uint64_t)queue * 8 / abr->kbps;
+
+	if (link->reports != abr->last_reports) {
+		abr->last_reports = link->reports;
+		abr->rtt[1] = abr->rtt[0];
+		abr->rtt[0] = link->rtt_us;
+		abr->loss[1] = abr->loss[0];
+		abr->loss[0] = link->loss_permille;
+	}
+	rtt = abr->rtt[1] >= 0 && abr->rtt[1] < abr->rtt[0] ? abr->rtt[1] : abr->rtt[0];
+	loss = abr->loss[1] < abr->loss[0] ? abr->loss[1] : abr->loss[0];
+	base = rtt_base(abr, link->rtt_us, now);
+	if (rtt >= 0 && base >= 0)
+		rtt_over = rtt - base;
+
+	congested = queue_ms > a->queue_high_ms
+		|| rtt_over > (int64_t)a->rtt_high_ms * 1000
+		|| loss > a->loss_high_permille
+		|| drops
+		|| link->rr_age_us > (int64_t)a->rr_timeout_ms * 1000;
+	clean = !congested && queue_ms < a->queue_low_ms
+		&& rtt_over < (int64_t)a->rtt_low_ms * 1000
+		&& loss < a->loss_low_permille;
+
+	abr->stat.congested = congested;
+	abr->stat.rtt_base_us = base;
+
+	if (congested) {
+		abr->clean_since = -1;
+
+		/* let the last cut reach the queue before judging it */
+		spacing = (int64_t)a->gop_ms * 1000 / 2;
+		if (rtt > 0 && rtt * 2 < spacing)
+			spacing = rtt * 2;
+		if (spacing < ABR_MIN_CUT_SPACING_US)
+			spacing = ABR_MIN_CUT_SPACING_US;
+		if (abr->queue_at_cut && (now - abr->last_change < spacing
+					|| (!drops && queue < abr->queue_at_cut
+						&& (rtt < 0 || abr->rtt_at_cut < 0 || rtt <= abr->rtt_at_cut))))
+			return 0;
+
+		/* far behind or losing frames: halve */
+		if (drops || queue_ms > 4 * a->queue_high_ms)
+			kbps = abr->kbps / 2;
+		else
+			kbps = abr->kbps * ABR_DECREASE_PERCENT / 100;
+		abr->queue_at_cut = queue ? queue : 1;
+		abr->rtt_at_cut = rtt;
+		kbps = set_rate(abr, kbps, now);
+		if (kbps)
+			abr->stat.decreases++;
+		return kbps;
+	}
+
+	if (!clean) {
+		abr->clean_since = -1;
+		return 0;
+	}
+
+	/* a clean link ends the congestion episode */
+	abr->queue_at_cut = 0;
+	if (abr->clean_since < 0)
+		abr->clean_since = now;
+	if (now - abr->clean_since < (int64_t)a->recover_ms * 1000
+			|| now - abr->last_change < (int64_t)a->recover_ms * 1000 / 2)
+		return 0;
+
+	kbps = set_rate(abr, abr->kbps + a->max_kbps * a->step_percent / 100, now);
+	if (kbps)
+		abr->stat.increases++;
+	return kbps;
+}
+
+void abr_get_stat(abr_t *abr, abr_stat_t *stat)
+{
+	*stat = abr->stat;
+	stat->kbps = abr->kbps;
+}
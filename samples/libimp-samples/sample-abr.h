@@ -0,0 +1,110 @@
+/*
+ * sample-abr.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_ABR_H__
+#define __SAMPLE_ABR_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Adaptive bitrate controller for one H264 channel.
+ *
+ * Fed with what the streaming side sees of the link, after every frame:
+ * the send queue depth, the round trip time and loss from RTCP receiver
+ * reports, and frames dropped because the socket was full. It answers
+ * with a new encoder bitrate when one is due, the caller applies it with
+ * IMP_Encoder_SetChnRcAttr().
+ *
+ * A queue standing for ABR_QUEUE_WINDOW_US is what counts, not the
+ * burst every I frame makes; likewise the RTT and loss are the lower of
+ * the last two receiver reports.
+ *
+ * The link is congested when any signal crosses its high threshold; the
+ * first congested sample cuts the rate to ABR_DECREASE_PERCENT, deeper
+ * when the queue is far behind, so the rate is down well within a GOP.
+ * Further cuts wait for the previous one to show and only happen if the
+ * queue or RTT did not improve. The link is clean when every signal is
+ * below its low threshold; in between the rate holds. Only after
+ * recover_ms of clean link the rate goes up, by step_percent of the
+ * ceiling per recover_ms / 2, never above max_kbps nor below min_kbps.
+ *
+ * RTT thresholds are relative to the lowest RTT seen over the last
+ * ABR_RTT_BASE_US. No signal at all (no client yet) holds the rate.
+ */
+
+#define ABR_DECREASE_PERCENT	70
+#define ABR_RTT_BASE_US			(30 * 1000000)
+#define ABR_QUEUE_WINDOW_US		400000
+
+/* Used for the attr fields left 0 */
+#define ABR_QUEUE_HIGH_MS		150		/* send queue, at the current rate */
+#define ABR_QUEUE_LOW_MS		40
+#define ABR_RTT_HIGH_MS			150		/* above the base RTT */
+#define ABR_RTT_LOW_MS			40
+#define ABR_LOSS_HIGH_PERMILLE	50
+#define ABR_LOSS_LOW_PERMILLE	10
+#define ABR_RR_TIMEOUT_MS		3000	/* reports stopped coming: congested */
+#define ABR_RECOVER_MS			6000
+#define ABR_STEP_PERCENT		5
+
+typedef struct abr abr_t;
+
+typedef struct abr_attr {
+	uint32_t	min_kbps;			/* floor */
+	uint32_t	max_kbps;			/* ceiling and start rate */
+	uint32_t	gop_ms;				/* cuts are spaced by at most half of it */
+	uint32_t	queue_high_ms;
+	uint32_t	queue_low_ms;
+	uint32_t	rtt_high_ms;
+	uint32_t	rtt_low_ms;
+	uint32_t	loss_high_permille;
+	uint32_t	loss_low_permille;
+	uint32_t	rr_timeout_ms;
+	uint32_t	recover_ms;
+	uint32_t	step_percent;
+} abr_attr_t;
+
+/* One link sample, as rtsp_server_get_link_stat() gives it */
+typedef struct abr_link {
+	int			clients;			/* 0: nothing to measure, hold */
+	uint32_t	queue_bytes;
+	int64_t		rtt_us;				/* -1: unknown */
+	uint32_t	loss_permille;
+	int64_t		rr_age_us;			/* -1: no reports */
+	uint32_t	reports;			/* running count of receiver reports */
+	uint32_t	dropped;			/* running count */
+} abr_link_t;
+
+typedef struct abr_stat {
+	uint32_t	kbps;
+	uint32_t	decreases;
+	uint32_t	increases;
+	int			congested;			/* last sample */
+	int64_t		rtt_base_us;		/* -1: none yet */
+} abr_stat_t;
+
+abr_t *abr_create(const abr_attr_t *attr);
+void abr_destroy(abr_t *abr);
+
+/* now in us. Returns the new bitrate in kbps, 0 to keep the current one. */
+uint32_t abr_update(abr_t *abr, const abr_link_t *link, int64_t now);
+
+void abr_get_stat(abr_t *abr, abr_stat_t *stat);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_ABR_H__ */
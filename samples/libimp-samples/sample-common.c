@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <imp/imp_log.h>
@@ -25,9 +26,24 @@
 #include "logodata_100x100_bgra.h"
 
 #include "sample-common.h"
+#include "sample-stream-writer.h"
+#include "sample-stream-pump.h"
+#include "sample-segment-recorder.h"
+#include "sample-h264-index.h"
+#include "sample-enc-bufsize.h"
+#include "sample-rmem-plan.h"
+#include "sample-vb-tuner.h"
+#include "sample-osd-sched.h"
 
 #define TAG "Sample-Common"
 
+/* Peak frame sizes of the pumped channels, only while calibrating */
+static enc_bufsize_calib_t *bufsize_calib;
+
+vb_tuner_t *fs_vb_tuner;
+osd_sched_t *osd_sched;
+int sample_pipeline;
+
 
 struct chn_conf chn[FS_CHN_NUM] = {
 	{
@@ -84,11 +100,99 @@ struct chn_conf chn[FS_CHN_NUM] = {
 
 
 
+static void h264_chn_attr(const IMPFSChnAttr *imp_chn_attr_tmp, IMPEncoderCHNAttr *channel_attr);
+static void jpeg_chn_attr(const IMPFSChnAttr *imp_chn_attr_tmp, IMPEncoderCHNAttr *channel_attr);
+static uint32_t enc_bufsize(int encChn, const IMPEncoderCHNAttr *attr, int retain);
+
+/*
+ * The enabled channels with what sample_pipeline says the sample builds
+ * on them, as the samples set them up, against the rmem= reservation:
+ * better to know here than halfway through creating channels. nrVBs
+ * come from the VB tuner's conf first, unless tuning, and only as many
+ * as the reservation holds.
+ */
+static int sample_rmem_check(void)
+{
+	rmem_pipeline_t p;
+	rmem_enc_t *enc;
+	rmem_osd_t *osd;
+	uint32_t rmem, ispmem;
+	int untuned[FS_CHN_NUM], fs[FS_CHN_NUM];
+	int i, n;
+
+	memset(&p, 0, sizeof(p));
+	p.sensor_width = SENSOR_WIDTH;
+	p.sensor_height = SENSOR_HEIGHT;
+	p.ivs_fs = -1;
+
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (!chn[i].enable)
+			continue;
+		untuned[i] = chn[i].fs_chn_attr.nrVBs;
+#ifndef VB_TUNE
+		vb_tuner_get(NULL, chn[i].index, &chn[i].fs_chn_attr, NULL);
+#endif
+		fs[i] = p.nr_fs;
+		p.fs[p.nr_fs] = chn[i].fs_chn_attr;
+
+		if (sample_pipeline & SAMPLE_PIPE_H264) {
+			enc = &p.enc[p.nr_enc++];
+			enc->fs = p.nr_fs;
+			h264_chn_attr(&chn[i].fs_chn_attr, &enc->attr);
+			enc->attr.encAttr.bufSize = enc_bufsize(chn[i].index, &enc->attr, chn[i].enc_retain);
+		}
+		if (sample_pipeline & SAMPLE_PIPE_JPEG) {
+			enc = &p.enc[p.nr_enc++];
+			enc->fs = p.nr_fs;
+			jpeg_chn_attr(&chn[i].fs_chn_attr, &enc->attr);
+			enc->attr.encAttr.bufSize = enc_bufsize(2 + chn[i].index, &enc->attr, 0);
+		}
+		if ((sample_pipeline & SAMPLE_PIPE_OSD) && i == 0) {
+			/* the samples' regions are small, the group takes its pool */
+			osd = &p.osd[p.nr_osd++];
+			osd->grp = 0;
+			osd->attr.type = OSD_REG_RECT;
+		}
+		if ((sample_pipeline & SAMPLE_PIPE_IVS) && i == IVS_CHN_ID)
+			p.ivs_fs = p.nr_fs;
+
+		p.nr_fs++;
+	}
+
+	/* tuned VBs beyond what fits go back, never below the untuned count */
+	if (rmem_plan_read_cmdline(NULL, &rmem, &ispmem) == 0 && rmem) {
+		for (i = 0; i < FS_CHN_NUM; i++) {
+			if (!chn[i].enable || chn[i].fs_chn_attr.nrVBs <= untuned[i])
+				continue;
+			n = rmem_plan_max_nrvbs(&p, fs[i], rmem);
+			if (n < chn[i].fs_chn_attr.nrVBs) {
+				if (n < untuned[i])
+					n = untuned[i];
+				IMP_LOG_WARN(TAG, "fs%d: %d tuned VBs do not fit in rmem %u, %d\n",
+						chn[i].index, chn[i].fs_chn_attr.nrVBs, rmem, n);
+				chn[i].fs_chn_attr.nrVBs = n;
+			}
+			p.fs[fs[i]].nrVBs = chn[i].fs_chn_attr.nrVBs;
+		}
+	}
+
+	return rmem_plan_check(&p);
+}
+
 IMPSensorInfo sensor_info;
 int sample_system_init()
 {
 	int ret = 0;
 
+	if (sample_rmem_check() < 0) {
+#ifdef RMEM_CHECK_STRICT
+		IMP_LOG_ERR(TAG, "pipeline does not fit in the reserved memory\n");
+		return -1;
+#else
+		IMP_LOG_WARN(TAG, "pipeline may not fit in the reserved memory\n");
+#endif
+	}
+
 	memset(&sensor_info, 0, sizeof(IMPSensorInfo));
 	memcpy(sensor_info.name, SENSOR_NAME, sizeof(SENSOR_NAME));
 	sensor_info.cbus_type = SENSOR_CUBS_TYPE;
@@ -207,8 +311,20 @@ int sample_framesource_init()
 {
 	int i, ret;
 
+#ifdef VB_TUNE
+	fs_vb_tuner = vb_tuner_create(0);
+	if (fs_vb_tuner == NULL) {
+		IMP_LOG_ERR(TAG, "vb_tuner_create() error !\n");
+		return -1;
+	}
+#endif
+
 	for (i = 0; i <  FS_CHN_NUM; i++) {
 		if (chn[i].enable) {
+			/* nrVBs already tuned by sample_system_init() otherwise */
+			if (fs_vb_tuner)
+				vb_tuner_add_chn(fs_vb_tuner, chn[i].index, &chn[i].fs_chn_attr);
+
 			ret = IMP_FrameSource_CreateChn(chn[i].index, &chn[i].fs_chn_attr);
 			if(ret < 0){
 				IMP_LOG_ERR(TAG, "IMP_FrameSource_CreateChn(chn%d) error !\n", chn[i].index);
@@ -240,26 +356,94 @@ int sample_framesource_exit()
 			}
 		}
 	}
+
+	if (fs_vb_tuner) {
+		vb_tuner_dump_stat(fs_vb_tuner);
+		vb_tuner_write(fs_vb_tuner, NULL);
+		vb_tuner_destroy(fs_vb_tuner);
+		fs_vb_tuner = NULL;
+	}
 	return 0;
 }
 
+/*
+ * libimp's own, roomy size while calibrating, so no peak is cut short;
+ * retain is what a zero-copy reader holds on top, see chn_conf.enc_retain
+ */
+static uint32_t enc_bufsize(int encChn, const IMPEncoderCHNAttr *attr, int retain)
+{
+#ifdef ENC_BUFSIZE_CALIBRATE
+	return 0;
+#else
+	return enc_bufsize_get(NULL, encChn, attr, retain);
+#endif
+}
+
+static void h264_chn_attr(const IMPFSChnAttr *imp_chn_attr_tmp, IMPEncoderCHNAttr *channel_attr)
+{
+	IMPEncoderAttr *enc_attr;
+	IMPEncoderRcAttr *rc_attr;
+
+	memset(channel_attr, 0, sizeof(IMPEncoderCHNAttr));
+	enc_attr = &channel_attr->encAttr;
+	enc_attr->enType = PT_H264;
+	enc_attr->bufSize = 0;
+	enc_attr->profile = 1;
+	enc_attr->picWidth = imp_chn_attr_tmp->picWidth;
+	enc_attr->picHeight = imp_chn_attr_tmp->picHeight;
+	rc_attr = &channel_attr->rcAttr;
+#if 1
+	rc_attr->rcMode = ENC_RC_MODE_H264CBR;
+	rc_attr->attrH264Cbr.outFrmRate.frmRateNum = imp_chn_attr_tmp->outFrmRateNum;
+	rc_attr->attrH264Cbr.outFrmRate.frmRateDen = imp_chn_attr_tmp->outFrmRateDen;
+	rc_attr->attrH264Cbr.maxGop = 2 * rc_attr->attrH264Cbr.outFrmRate.frmRateNum / rc_attr->attrH264Cbr.outFrmRate.frmRateDen;
+	rc_attr->attrH264Cbr.outBitRate = 2000ULL * (imp_chn_attr_tmp->picWidth * imp_chn_attr_tmp->picHeight) / (1280 * 720);
+	rc_attr->attrH264Cbr.maxQp = 38;
+	rc_attr->attrH264Cbr.minQp = 15;
+	rc_attr->attrH264Cbr.maxFPS = 100;
+	rc_attr->attrH264Cbr.minFPS = 1;
+	rc_attr->attrH264Cbr.IBiasLvl = 2;
+	rc_attr->attrH264Cbr.FrmQPStep = 3;
+	rc_attr->attrH264Cbr.GOPQPStep = 15;
+	rc_attr->attrH264Cbr.AdaptiveMode = false;
+	rc_attr->attrH264Cbr.GOPRelation = false;
+#else
+	rc_attr->rcMode = ENC_RC_MODE_H264VBR;
+	rc_attr->attrH264Vbr.outFrmRate.frmRateNum = imp_chn_attr_tmp->outFrmRateNum;
+	rc_attr->attrH264Vbr.outFrmRate.frmRateDen = imp_chn_attr_tmp->outFrmRateDen;
+	rc_attr->attrH264Vbr.maxGop = 2 * rc_attr->attrH264Vbr.outFrmRate.frmRateNum / rc_attr->attrH264Vbr.outFrmRate.frmRateDen;
+	rc_attr->attrH264Vbr.maxQp = 38;
+	rc_attr->attrH264Vbr.minQp = 15;
+	rc_attr->attrH264Vbr.staticTime = 1;
+	rc_attr->attrH264Vbr.maxBitRate = 2000ULL * (imp_chn_attr_tmp->picWidth * imp_chn_attr_tmp->picHeight) / (1280 * 720);
+	rc_attr->attrH264Vbr.changePos = 100;
+	rc_attr->attrH264Vbr.FrmQPStep = 3;
+	rc_attr->attrH264Vbr.GOPQPStep = 15;
+#endif
+}
+
+static void jpeg_chn_attr(const IMPFSChnAttr *imp_chn_attr_tmp, IMPEncoderCHNAttr *channel_attr)
+{
+	IMPEncoderAttr *enc_attr;
+
+	memset(channel_attr, 0, sizeof(IMPEncoderCHNAttr));
+	enc_attr = &channel_attr->encAttr;
+	enc_attr->enType = PT_JPEG;
+	enc_attr->bufSize = 0;
+	enc_attr->profile = 0;
+	enc_attr->picWidth = imp_chn_attr_tmp->picWidth;
+	enc_attr->picHeight = imp_chn_attr_tmp->picHeight;
+}
+
 int sample_jpeg_init()
 {
 	int i, ret;
-	IMPEncoderAttr *enc_attr;
 	IMPEncoderCHNAttr channel_attr;
-	IMPFSChnAttr *imp_chn_attr_tmp;
 
 	for (i = 0; i <  FS_CHN_NUM; i++) {
 		if (chn[i].enable) {
-			imp_chn_attr_tmp = &chn[i].fs_chn_attr;
-			memset(&channel_attr, 0, sizeof(IMPEncoderCHNAttr));
-			enc_attr = &channel_attr.encAttr;
-			enc_attr->enType = PT_JPEG;
-			enc_attr->bufSize = 0;
-			enc_attr->profile = 0;
-			enc_attr->picWidth = imp_chn_attr_tmp->picWidth;
-			enc_attr->picHeight = imp_chn_attr_tmp->picHeight;
+			jpeg_chn_attr(&chn[i].fs_chn_attr, &channel_attr);
+			channel_attr.encAttr.bufSize = enc_bufsize(2 + chn[i].index, &channel_attr, 0);
 
 			/* Create Channel */
 			ret = IMP_Encoder_CreateChn(2 + chn[i].index, &channel_attr);
@@ -285,50 +469,12 @@ int sample_jpeg_init()
 int sample_encoder_init()
 {
 	int i, ret;
-	IMPEncoderAttr *enc_attr;
-	IMPEncoderRcAttr *rc_attr;
-	IMPFSChnAttr *imp_chn_attr_tmp;
 	IMPEncoderCHNAttr channel_attr;
 
 	for (i = 0; i <  FS_CHN_NUM; i++) {
 		if (chn[i].enable) {
-			imp_chn_attr_tmp = &chn[i].fs_chn_attr;
-			memset(&channel_attr, 0, sizeof(IMPEncoderCHNAttr));
-			enc_attr = &channel_attr.encAttr;
-			enc_attr->enType = PT_H264;
-			enc_attr->bufSize = 0;
-			enc_attr->profile = 1;
-			enc_attr->picWidth = imp_chn_attr_tmp->picWidth;
-			enc_attr->picHeight = imp_chn_attr_tmp->picHeight;
-			rc_attr = &channel_attr.rcAttr;
-#if 1
-			rc_attr->rcMode = ENC_RC_MODE_H264CBR;
-			rc_attr->attrH264Cbr.outFrmRate.frmRateNum = imp_chn_attr_tmp->outFrmRateNum;
-			rc_attr->attrH264Cbr.outFrmRate.frmRateDen = imp_chn_attr_tmp->outFrmRateDen;
-			rc_attr->attrH264Cbr.maxGop = 2 * rc_attr->attrH264Cbr.outFrmRate.frmRateNum / rc_attr->attrH264Cbr.outFrmRate.frmRateDen;
-			rc_attr->attrH264Cbr.outBitRate = 2000 * (imp_chn_attr_tmp->picWidth * imp_chn_attr_tmp->picHeight) / (1280 * 720);
-			rc_attr->attrH264Cbr.maxQp = 38;
-			rc_attr->attrH264Cbr.minQp = 15;
-			rc_attr->attrH264Cbr.maxFPS = 100;
-			rc_attr->attrH264Cbr.minFPS = 1;
-			rc_attr->attrH264Cbr.IBiasLvl = 2;
-			rc_attr->attrH264Cbr.FrmQPStep = 3;
-			rc_attr->attrH264Cbr.GOPQPStep = 15;
-			rc_attr->attrH264Cbr.AdaptiveMode = false;
-			rc_attr->attrH264Cbr.GOPRelation = false;
-#else
-			rc_attr->rcMode = ENC_RC_MODE_H264VBR;
-			rc_attr->attrH264Vbr.outFrmRate.frmRateNum = imp_chn_attr_tmp->outFrmRateNum;
-			rc_attr->attrH264Vbr.outFrmRate.frmRateDen = imp_chn_attr_tmp->outFrmRateDen;
-			rc_attr->attrH264Vbr.maxGop = 2 * rc_attr->attrH264Vbr.outFrmRate.frmRateNum / rc_attr->attrH264Vbr.outFrmRate.frmRateDen;
-			rc_attr->attrH264Vbr.maxQp = 38;
-			rc_attr->attrH264Vbr.minQp = 15;
-			rc_attr->attrH264Vbr.staticTime = 1;
-			rc_attr->attrH264Vbr.maxBitRate = 2000 * (imp_chn_attr_tmp->picWidth * imp_chn_attr_tmp->picHeight) / (1280 * 720);
-			rc_attr->attrH264Vbr.changePos = 100;
-			rc_attr->attrH264Vbr.FrmQPStep = 3;
-			rc_attr->attrH264Vbr.GOPQPStep = 15;
-#endif
+			h264_chn_attr(&chn[i].fs_chn_attr, &channel_attr);
+			channel_attr.encAttr.bufSize = enc_bufsize(chn[i].index, &channel_attr, chn[i].enc_retain);
 
 			ret = IMP_Encoder_CreateChn(chn[i].index, &channel_attr);
 			if (ret < 0) {
@@ -477,11 +623,7 @@ IMPRgnHandle *sample_osd_init(int grpNum)
 	rAttrFont.rect.p0.y = 10;
 	rAttrFont.rect.p1.x = rAttrFont.rect.p0.x + 20 * OSD_REGION_WIDTH- 1;   //p0 is start，and p1 well be epual p0+width(or heigth)-1
 	rAttrFont.rect.p1.y = rAttrFont.rect.p0.y + OSD_REGION_HEIGHT - 1;
-#ifdef SUPPORT_RGB555LE
-	rAttrFont.fmt = PIX_FMT_RGB555LE;
-#else
-	rAttrFont.fmt = PIX_FMT_BGRA;
-#endif
+	rAttrFont.fmt = OSD_FONT_PIXFMT;
 	rAttrFont.data.picData.pData = NULL;
 	ret = IMP_OSD_SetRgnAttr(rHanderFont, &rAttrFont);
 	if (ret < 0) {
@@ -688,16 +830,20 @@ int sample_osd_exit(IMPRgnHandle *prHander,int grpNum)
 
 static int save_stream(int fd, IMPEncoderStream *stream)
 {
-	int ret, i, nr_pack = stream->packCount;
+	int ret, i, nr_pack = stream->packCount, len = 0;
+	struct iovec iov[nr_pack];
 
+	/* One syscall per frame instead of one per pack */
 	for (i = 0; i < nr_pack; i++) {
-		ret = write(fd, (void *)stream->pack[i].virAddr,
-					stream->pack[i].length);
-		if (ret != stream->pack[i].length) {
-			IMP_LOG_ERR(TAG, "stream write error:%s\n", strerror(errno));
-			return -1;
-		}
-		//IMP_LOG_DBG(TAG, "stream->pack[%d].dataType=%d\n", i, ((int)stream->pack[i].dataType.h264Type));
+		iov[i].iov_base = (void *)(uintptr_t)stream->pack[i].virAddr;
+		iov[i].iov_len = stream->pack[i].length;
+		len += stream->pack[i].length;
+	}
+
+	ret = writev(fd, iov, nr_pack);
+	if (ret != len) {
+		IMP_LOG_ERR(TAG, "stream write error:%s\n", strerror(errno));
+		return -1;
 	}
 
 	return 0;
@@ -706,32 +852,40 @@ static int save_stream(int fd, IMPEncoderStream *stream)
 int sample_do_get_h264_stream(int nr_frames)
 {
 	int ret;
+	IMPEncoderCHNAttr chn_attr;
 
-	/* H264 Channel start receive picture */
-	ret = IMP_Encoder_StartRecvPic(ENC_H264_CHANNEL);
+	ret = IMP_Encoder_GetChnAttr(ENC_H264_CHANNEL, &chn_attr);
 	if (ret < 0) {
-		IMP_LOG_ERR(TAG, "IMP_Encoder_StartRecvPic(%d) failed\n", ENC_H264_CHANNEL);
+		IMP_LOG_ERR(TAG, "IMP_Encoder_GetChnAttr(%d) failed\n", ENC_H264_CHANNEL);
 		return -1;
 	}
 
-	time_t now;
-	time(&now);
-	struct tm *now_tm;
-	now_tm = localtime(&now);
-	char now_str[32];
-	strftime(now_str, 40, "%Y%m%d%I%M%S", now_tm);
+	/* A short run is one segment no longer than the run, and only keeps room for itself */
+	int record_ms = (int64_t)nr_frames * SENSOR_FRAME_RATE_DEN * 1000 / SENSOR_FRAME_RATE_NUM;
+	if (record_ms > SEGMENT_DURATION_MS)
+		record_ms = SEGMENT_DURATION_MS;
 
-	char stream_path[128];
-	sprintf(stream_path, "%s/stream-%s.h264",
-			STREAM_FILE_PATH_PREFIX, now_str);
+	/* Preallocate a segment for its duration at the target bitrate, plus 50% for CBR overshoot */
+	seg_recorder_attr_t attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.dir = STREAM_FILE_PATH_PREFIX;
+	attr.prefix = "stream";
+	attr.segment_ms = SEGMENT_DURATION_MS;
+	attr.segment_bytes = (uint64_t)chn_attr.rcAttr.attrH264Cbr.outBitRate * 1000 / 8
+		* record_ms / 1000 * 3 / 2;
+	attr.min_free = record_ms < SEGMENT_DURATION_MS ? attr.segment_bytes : SEGMENT_MIN_FREE;
 
-	IMP_LOG_DBG(TAG, "Open Stream file %s ", stream_path);
-	int stream_fd = open(stream_path, O_RDWR | O_CREAT | O_TRUNC, 0777);
-	if (stream_fd < 0) {
-		IMP_LOG_ERR(TAG, "failed: %s\n", strerror(errno));
+	seg_recorder_t *rec = seg_recorder_create(&attr);
+	if (rec == NULL)
+		return -1;
+
+	/* H264 Channel start receive picture */
+	ret = IMP_Encoder_StartRecvPic(ENC_H264_CHANNEL);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_StartRecvPic(%d) failed\n", ENC_H264_CHANNEL);
+		seg_recorder_destroy(rec);
 		return -1;
 	}
-	IMP_LOG_DBG(TAG, "OK\n");
 
 	int i;
 	for (i = 0; i < nr_frames; i++) {
@@ -747,27 +901,34 @@ int sample_do_get_h264_stream(int nr_frames)
 		ret = IMP_Encoder_GetStream(ENC_H264_CHANNEL, &stream, 1);
 		if (ret < 0) {
 			IMP_LOG_ERR(TAG, "IMP_Encoder_GetStream() failed\n");
+			seg_recorder_destroy(rec);
 			return -1;
 		}
 
-		ret = save_stream(stream_fd, &stream);
-		if (ret < 0) {
-			close(stream_fd);
-			return ret;
-		}
+		/* how far the OSD updates land from their target frames */
+		if (osd_sched)
+			osd_sched_stream(osd_sched, ENC_H264_CHANNEL, &stream);
 
+		/* Copied into a chunk buffer, the encoder buffer is released right away */
+		ret = seg_recorder_write(rec, &stream);
 		IMP_Encoder_ReleaseStream(ENC_H264_CHANNEL, &stream);
+		if (ret < 0) {
+			IMP_LOG_ERR(TAG, "stream write error\n");
+			seg_recorder_destroy(rec);
+			return -1;
+		}
 	}
 
-	close(stream_fd);
-
 	ret = IMP_Encoder_StopRecvPic(ENC_H264_CHANNEL);
 	if (ret < 0) {
 		IMP_LOG_ERR(TAG, "IMP_Encoder_StopRecvPic() failed\n");
+		seg_recorder_destroy(rec);
 		return -1;
 	}
 
-	return 0;
+	seg_recorder_flush(rec);
+	seg_recorder_dump_stat(rec);
+	return seg_recorder_destroy(rec);
 }
 
 int sample_do_get_jpeg_snap(void)
@@ -834,145 +995,300 @@ int sample_do_get_jpeg_snap(void)
 	return 0;
 }
 
-void *get_h264_stream(void *args)
+struct h264_record_ctx {
+	stream_pump_t		*pump;
+	int					encChn;
+	int					fd;
+	int					index_fd;
+	int					nr_frames;
+	int					misses;				/* deadlines missed in a row */
+	stream_writer_t		*writer;
+	char				path[64];
+};
+
+struct jpeg_snap_ctx {
+	stream_pump_t		*pump;
+	int					encChn;
+	int					fd;
+	int64_t				not_before;
+	int					misses;
+	char				path[64];
+};
+
+static int h264_record_cb(int encChn, IMPEncoderStream *stream, void *priv)
 {
-	int i, j, ret;
-	char stream_path[64];
+	struct h264_record_ctx *ctx = priv;
+	int ret;
+
+	if (stream == NULL) {
+		IMP_LOG_ERR(TAG, "Polling stream timeout, chn%d\n", encChn);
+		/* a channel that never delivers ends the recording */
+		return ++ctx->misses < NR_POLL_TIMEOUTS ? STREAM_PUMP_RELEASE : -1;
+	}
+	ctx->misses = 0;
+	if (bufsize_calib)
+		enc_bufsize_calib_frame(bufsize_calib, encChn, stream);
+	if (fs_vb_tuner)
+		vb_tuner_enc_stream(fs_vb_tuner, encChn, stream);
+	if (osd_sched)
+		osd_sched_stream(osd_sched, encChn, stream);
+
+	/* Copy into the writer ring, the pump releases the encoder buffer */
+	ret = stream_writer_enqueue(ctx->writer, stream);
+	if (ret < 0)
+		return ret;
+
+	if (++ctx->nr_frames >= NR_FRAMES_TO_SAVE)
+		stream_pump_remove(ctx->pump, encChn);
+
+	return STREAM_PUMP_RELEASE;
+}
+
+static int h264_record_open(struct h264_record_ctx *ctx, stream_pump_t *pump, int encChn)
+{
+	char index_path[sizeof(ctx->path) + sizeof(H264_INDEX_SUFFIX)];
+	IMPEncoderCHNAttr attr;
+	uint32_t ring_size = STREAM_BUFFER_SIZE;
+	int ret;
 
-	i = (int ) (*((int*)args));
+	memset(ctx, 0, sizeof(struct h264_record_ctx));
+	ctx->pump = pump;
+	ctx->encChn = encChn;
+	ctx->fd = -1;
+	ctx->index_fd = -1;
 
-	ret = IMP_Encoder_StartRecvPic(i);
+	ret = IMP_Encoder_StartRecvPic(encChn);
 	if (ret < 0) {
-		IMP_LOG_ERR(TAG, "IMP_Encoder_StartRecvPic(%d) failed\n", i);
-		return ((void *)-1);
+		IMP_LOG_ERR(TAG, "IMP_Encoder_StartRecvPic(%d) failed\n", encChn);
+		return -1;
 	}
 
-	sprintf(stream_path, "%s/stream-%d.h264",
-			STREAM_FILE_PATH_PREFIX, i);
-
-	IMP_LOG_DBG(TAG, "Open Stream file %s ", stream_path);
-	int stream_fd = open(stream_path, O_RDWR | O_CREAT | O_TRUNC, 0777);
-	if (stream_fd < 0) {
+	sprintf(ctx->path, "%s/stream-%d.h264", STREAM_FILE_PATH_PREFIX, encChn);
+	IMP_LOG_DBG(TAG, "Open Stream file %s ", ctx->path);
+	ctx->fd = open(ctx->path, O_RDWR | O_CREAT | O_TRUNC, 0777);
+	if (ctx->fd < 0) {
 		IMP_LOG_ERR(TAG, "failed: %s\n", strerror(errno));
-		return ((void *)-1);
+		return -1;
 	}
 	IMP_LOG_DBG(TAG, "OK\n");
 
-	for (j = 0; j < NR_FRAMES_TO_SAVE; j++) {
-		ret = IMP_Encoder_PollingStream(i, 1000);
-		if (ret < 0) {
-			IMP_LOG_ERR(TAG, "Polling stream timeout\n");
-			continue;
-		}
+	/* Enough of this channel's stream to ride out a slow card */
+	if (IMP_Encoder_GetChnAttr(encChn, &attr) == 0 && enc_bufsize_ring(&attr, STREAM_RING_MS))
+		ring_size = enc_bufsize_ring(&attr, STREAM_RING_MS);
 
-		IMPEncoderStream stream;
-		/* Get H264 Stream */
-		ret = IMP_Encoder_GetStream(i, &stream, 1);
-		if (ret < 0) {
-			IMP_LOG_ERR(TAG, "IMP_Encoder_GetStream() failed\n");
-			return ((void *)-1);
-		}
-		//IMP_LOG_DBG(TAG, "i=%d, stream.packCount=%d, stream.h264RefType=%d\n", i, stream.packCount, stream.h264RefType);
+	ctx->writer = stream_writer_create(ctx->fd, PT_H264, ring_size, 0);
+	if (ctx->writer == NULL)
+		return -1;
 
-		ret = save_stream(stream_fd, &stream);
-		if (ret < 0) {
-			close(stream_fd);
-			return ((void *)ret);
-		}
+	/* Seek index next to the stream, the recording goes on without it */
+	snprintf(index_path, sizeof(index_path), "%s%s", ctx->path, H264_INDEX_SUFFIX);
+	ctx->index_fd = h264_index_create(index_path);
+	if (ctx->index_fd >= 0)
+		stream_writer_set_index(ctx->writer, ctx->index_fd);
 
-		IMP_Encoder_ReleaseStream(i, &stream);
-	}
+	return stream_pump_add(pump, encChn, 1000, h264_record_cb, ctx);
+}
 
-	close(stream_fd);
+static int h264_record_close(struct h264_record_ctx *ctx)
+{
+	int ret = 0;
 
-	ret = IMP_Encoder_StopRecvPic(i);
-	if (ret < 0) {
+	if (ctx->writer) {
+		stream_writer_dump_stat(ctx->writer, ctx->path);
+		ret = stream_writer_destroy(ctx->writer);
+		ctx->writer = NULL;
+	}
+	if (ctx->fd >= 0) {
+		close(ctx->fd);
+		ctx->fd = -1;
+	}
+	if (ctx->index_fd >= 0) {
+		close(ctx->index_fd);
+		ctx->index_fd = -1;
+	}
+	if (ctx->misses >= NR_POLL_TIMEOUTS) {
+		IMP_LOG_ERR(TAG, "chn%d gave no stream, %d frames saved\n", ctx->encChn, ctx->nr_frames);
+		ret = -1;
+	}
+
+	if (IMP_Encoder_StopRecvPic(ctx->encChn) < 0) {
 		IMP_LOG_ERR(TAG, "IMP_Encoder_StopRecvPic() failed\n");
-		return ((void *)-1);
+		return -1;
 	}
 
-	return ((void *)0);
+	return ret;
 }
 
-int sample_get_h264_stream()
+static int jpeg_snap_cb(int encChn, IMPEncoderStream *stream, void *priv)
 {
-	unsigned int i;
+	struct jpeg_snap_ctx *ctx = priv;
 	int ret;
-	pthread_t tid[FS_CHN_NUM];
 
-	for (i = 0; i < FS_CHN_NUM; i++) {
-		if (chn[i].enable) {
-			ret = pthread_create(&tid[i], NULL, get_h264_stream, &chn[i].index);
-			if (ret < 0) {
-				IMP_LOG_ERR(TAG, "Create Chn%d get_h264_stream \n",chn[i].index);
-			}
-		}
+	if (stream == NULL) {
+		IMP_LOG_ERR(TAG, "Polling stream timeout, chn%d\n", encChn);
+		return ++ctx->misses < NR_POLL_TIMEOUTS ? STREAM_PUMP_RELEASE : -1;
 	}
+	ctx->misses = 0;
 
-	for (i = 0; i < FS_CHN_NUM; i++) {
-		if (chn[i].enable) {
-			pthread_join(tid[i],NULL);
-		}
+	if (bufsize_calib)
+		enc_bufsize_calib_frame(bufsize_calib, encChn, stream);
+	if (fs_vb_tuner)
+		vb_tuner_enc_stream(fs_vb_tuner, encChn - 2, stream);
+
+	/* drop the pictures encoded before the sensor settled */
+	if (IMP_System_GetTimeStamp() < ctx->not_before)
+		return STREAM_PUMP_RELEASE;
+
+	ret = save_stream(ctx->fd, stream);
+	if (ret < 0)
+		return ret;
+
+	stream_pump_remove(ctx->pump, encChn);
+	return STREAM_PUMP_RELEASE;
+}
+
+static int jpeg_snap_open(struct jpeg_snap_ctx *ctx, stream_pump_t *pump, int encChn, int index, int delay_sec)
+{
+	int ret;
+
+	memset(ctx, 0, sizeof(struct jpeg_snap_ctx));
+	ctx->pump = pump;
+	ctx->encChn = encChn;
+	ctx->fd = -1;
+	ctx->not_before = IMP_System_GetTimeStamp() + (int64_t)delay_sec * 1000000;
+
+	ret = IMP_Encoder_StartRecvPic(encChn);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_StartRecvPic(%d) failed\n", encChn);
+		return -1;
 	}
 
-	return 0;
+	sprintf(ctx->path, "%s/snap-%d.jpg", SNAP_FILE_PATH_PREFIX, index);
+	IMP_LOG_DBG(TAG, "Open Snap file %s ", ctx->path);
+	ctx->fd = open(ctx->path, O_RDWR | O_CREAT | O_TRUNC, 0777);
+	if (ctx->fd < 0) {
+		IMP_LOG_ERR(TAG, "failed: %s\n", strerror(errno));
+		return -1;
+	}
+	IMP_LOG_DBG(TAG, "OK\n");
+
+	return stream_pump_add(pump, encChn, 1000, jpeg_snap_cb, ctx);
 }
 
-int sample_get_jpeg_snap()
+static int jpeg_snap_close(struct jpeg_snap_ctx *ctx)
 {
-	int i, ret;
-	char snap_path[64];
+	int ret = 0;
 
-	for (i = 0; i < FS_CHN_NUM; i++) {
-		if (chn[i].enable) {
-			ret = IMP_Encoder_StartRecvPic(2 + chn[i].index);
-			if (ret < 0) {
-				IMP_LOG_ERR(TAG, "IMP_Encoder_StartRecvPic(%d) failed\n", 2 + chn[i].index);
-				return -1;
-			}
+	if (ctx->fd >= 0) {
+		close(ctx->fd);
+		ctx->fd = -1;
+	}
+	if (ctx->misses >= NR_POLL_TIMEOUTS) {
+		IMP_LOG_ERR(TAG, "chn%d gave no snapshot\n", ctx->encChn);
+		ret = -1;
+	}
 
-			sprintf(snap_path, "%s/snap-%d.jpg",
-					SNAP_FILE_PATH_PREFIX, chn[i].index);
+	if (IMP_Encoder_StopRecvPic(ctx->encChn) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_StopRecvPic() failed\n");
+		return -1;
+	}
 
-			IMP_LOG_ERR(TAG, "Open Snap file %s ", snap_path);
-			int snap_fd = open(snap_path, O_RDWR | O_CREAT | O_TRUNC, 0777);
-			if (snap_fd < 0) {
-				IMP_LOG_ERR(TAG, "failed: %s\n", strerror(errno));
-				return -1;
-			}
-			IMP_LOG_DBG(TAG, "OK\n");
+	return ret;
+}
 
-			/* Polling JPEG Snap, set timeout as 1000msec */
-			ret = IMP_Encoder_PollingStream(2 + chn[i].index, 1000);
-			if (ret < 0) {
-				IMP_LOG_ERR(TAG, "Polling stream timeout\n");
-				continue;
-			}
+#ifdef ENC_BUFSIZE_CALIBRATE
+static void bufsize_calib_add(int encChn)
+{
+	IMPEncoderCHNAttr attr;
 
-			IMPEncoderStream stream;
-			/* Get JPEG Snap */
-			ret = IMP_Encoder_GetStream(chn[i].index + 2, &stream, 1);
-			if (ret < 0) {
-				IMP_LOG_ERR(TAG, "IMP_Encoder_GetStream() failed\n");
-				return -1;
-			}
+	if (IMP_Encoder_GetChnAttr(encChn, &attr) == 0)
+		enc_bufsize_calib_add_chn(bufsize_calib, encChn, &attr);
+}
+#endif
 
-			ret = save_stream(snap_fd, &stream);
-			if (ret < 0) {
-				close(snap_fd);
-				return ret;
-			}
+/*
+ * Record the H264 channels and/or take one snapshot of each JPEG channel,
+ * all from the calling thread.
+ */
+static int sample_pump_streams(int do_h264, int do_jpeg, int jpeg_delay_sec)
+{
+	struct h264_record_ctx h264_ctx[FS_CHN_NUM];
+	struct jpeg_snap_ctx jpeg_ctx[FS_CHN_NUM];
+	int h264_open[FS_CHN_NUM] = {0}, jpeg_open[FS_CHN_NUM] = {0};
+	enc_telemetry_t *tel;
+	stream_pump_t *pump;
+	int i, ret = 0;
+
+	pump = stream_pump_create();
+	if (pump == NULL)
+		return -1;
 
-			IMP_Encoder_ReleaseStream(2 + chn[i].index, &stream);
+	/* Watch it with sample-enc-telemetry-cli, the recording goes on without it */
+	tel = enc_telemetry_create(NULL);
+	if (tel)
+		stream_pump_set_telemetry(pump, tel);
 
-			close(snap_fd);
+#ifdef ENC_BUFSIZE_CALIBRATE
+	/* Peak frames for the next runs' stream buffers, see ENC_BUFSIZE_CONF */
+	bufsize_calib = enc_bufsize_calib_create(ENC_BUFSIZE_DEPTH);
+	for (i = 0; i < FS_CHN_NUM && bufsize_calib; i++) {
+		if (!chn[i].enable)
+			continue;
+		if (do_h264)
+			bufsize_calib_add(chn[i].index);
+		if (do_jpeg)
+			bufsize_calib_add(2 + chn[i].index);
+	}
+#endif
 
-			ret = IMP_Encoder_StopRecvPic(2 + chn[i].index);
-			if (ret < 0) {
-				IMP_LOG_ERR(TAG, "IMP_Encoder_StopRecvPic() failed\n");
-				return -1;
-			}
+	for (i = 0; i < FS_CHN_NUM && ret == 0; i++) {
+		if (!chn[i].enable)
+			continue;
+		if (do_h264) {
+			h264_open[i] = 1;
+			ret = h264_record_open(&h264_ctx[i], pump, chn[i].index);
+		}
+		if (do_jpeg && ret == 0) {
+			jpeg_open[i] = 1;
+			ret = jpeg_snap_open(&jpeg_ctx[i], pump, 2 + chn[i].index, chn[i].index, jpeg_delay_sec);
 		}
 	}
-	return 0;
+
+	if (ret == 0)
+		ret = stream_pump_run(pump);
+
+	stream_pump_dump_stat(pump);
+	for (i = 0; i < FS_CHN_NUM; i++) {
+		if (h264_open[i] && h264_record_close(&h264_ctx[i]) < 0)
+			ret = -1;
+		if (jpeg_open[i] && jpeg_snap_close(&jpeg_ctx[i]) < 0)
+			ret = -1;
+	}
+	stream_pump_destroy(pump);
+	if (tel)
+		enc_telemetry_destroy(tel);
+	if (bufsize_calib) {
+		enc_bufsize_calib_dump(bufsize_calib);
+		enc_bufsize_calib_write(bufsize_calib, NULL);
+		enc_bufsize_calib_destroy(bufsize_calib);
+		bufsize_calib = NULL;
+	}
+
+	return ret;
+}
+
+int sample_get_h264_stream()
+{
+	return sample_pump_streams(1, 0, 0);
+}
+
+int sample_get_jpeg_snap()
+{
+	return sample_pump_streams(0, 1, 0);
+}
+
+int sample_get_h264_jpeg_stream()
+{
+	/* drop several pictures of invalid data before the snapshot */
+	return sample_pump_streams(1, 1, SLEEP_TIME);
 }
@@ -112,12 +112,16 @@ extern "C"
 #define SENSOR_HEIGHT_SECOND		360
 
 #define NR_FRAMES_TO_SAVE		100
-#define STREAM_BUFFER_SIZE		(1 * 1024 * 1024)
+#define NR_POLL_TIMEOUTS		5			/* 1s stream deadlines missed in a row before a channel is given up */
+#define STREAM_BUFFER_SIZE		(1 * 1024 * 1024)	/* writer ring when the channel has no rate */
+#define STREAM_RING_MS			3000			/* stream the writer ring holds for a slow card */
 
 #define ENC_H264_CHANNEL		0
 #define ENC_JPEG_CHANNEL		1
 
 #define STREAM_FILE_PATH_PREFIX		"/tmp"
+#define SEGMENT_DURATION_MS		60000			/* recorder segments, cut at the next IDR */
+#define SEGMENT_MIN_FREE		(64 * 1024 * 1024)	/* oldest segments go below this */
 #define SNAP_FILE_PATH_PREFIX		"/tmp"
 
 #define OSD_REGION_WIDTH		16
@@ -137,6 +141,38 @@ extern "C"
 #define CHN_DISABLE 0
 
 /*#define SUPPORT_RGB555LE*/
+#ifdef SUPPORT_RGB555LE
+#define OSD_FONT_PIXFMT			PIX_FMT_RGB555LE
+#else
+#define OSD_FONT_PIXFMT			PIX_FMT_BGRA
+#endif
+
+/* GB2312 glyphs of text labels, see sample-osd-text.h */
+#define OSD_HZK16_PATH			"/etc/hzk16"
+#define OSD_LABEL_CACHE_BYTES		(64 * 1024)
+
+/* Record peak frame sizes and write tighter encoder buffer sizes, see sample-enc-bufsize.h */
+/*#define ENC_BUFSIZE_CALIBRATE*/
+
+/* Measure how long frames are held and write tighter nrVBs, see sample-vb-tuner.h */
+/*#define VB_TUNE*/
+
+/*
+ * Refuse to start when the rmem plan does not fit, see sample-rmem-plan.h.
+ * Off until its terms match the calculator's example, a warning then.
+ */
+/*#define RMEM_CHECK_STRICT*/
+
+/*
+ * What a sample builds on its enabled FrameSource channels, in
+ * sample_pipeline before sample_system_init() for the rmem check: an
+ * H264 and/or a JPEG encoder per channel, an OSD group on the main
+ * channel, IVS on IVS_CHN_ID. 0 is the FrameSource alone.
+ */
+#define SAMPLE_PIPE_H264		(1 << 0)
+#define SAMPLE_PIPE_JPEG		(1 << 1)
+#define SAMPLE_PIPE_OSD			(1 << 2)
+#define SAMPLE_PIPE_IVS			(1 << 3)
 
 struct chn_conf{
 	unsigned int index;//0 for main channel ,1 for second channel
@@ -144,10 +180,17 @@ struct chn_conf{
 	IMPFSChnAttr fs_chn_attr;
 	IMPCell framesource_chn;
 	IMPCell imp_encoder;
+	int enc_retain;		/* H264 frames a stream hub keeps out of the encoder, set before sample_system_init() */
 };
 
 #define  CHN_NUM  ARRAY_SIZE(chn)
 
+extern int sample_pipeline;
+/* Set by sample_framesource_init() while tuning, NULL otherwise */
+extern struct vb_tuner *fs_vb_tuner;
+/* Set by samples with scheduled OSD updates, fed the H264 streams */
+extern struct osd_sched *osd_sched;
+
 int sample_system_init();
 int sample_system_exit();
 
@@ -168,6 +211,7 @@ int sample_do_get_h264_stream(int nr_frames);
 int sample_get_h264_stream();
 int sample_do_get_jpeg_snap(void);
 int sample_get_jpeg_snap();
+int sample_get_h264_jpeg_stream();
 
 
 #ifdef __cplusplus
@@ -0,0 +1,429 @@
+/*
+ * sample-enc-bufsize.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-enc-bufsize.h"
+
+#define TAG "Sample-Enc-Bufsize"
+
+/*
+ * Bits per pixel of a detailed, high motion I frame at QP 26, x100; the
+ * size halves every 6 QP. JPEG at the default quality likewise.
+ */
+#define I_BPP_QP26_X100		160
+#define JPEG_BPP_X100		180
+#define I_P_RATIO			8			/* I frame bytes over an average P frame's */
+#define CBR_OVERSHOOT_PCT	150			/* I frames above their share of the GOP */
+#define P_PEAK_PCT			300			/* P frames above the average frame */
+#define P_AT_QP_PCT			50			/* high motion P frame against the I frame, same QP */
+#define HDR_BYTES			(16 * 1024)	/* SPS, PPS, SEI and slack */
+#define BUF_ALIGN			4096
+#define MAX_DEPTH			16
+
+/* 2^(n/6), x1000 */
+static const uint32_t qp_step[6] = { 1000, 1122, 1260, 1414, 1587, 1782 };
+
+struct rc_params {
+	uint32_t	fps_num;
+	uint32_t	fps_den;
+	uint32_t	gop;
+	uint32_t	kbps;				/* 0: fixed QP */
+	uint32_t	qp;					/* the coarsest QP the rate control may use */
+};
+
+struct calib_chn {
+	int			used;
+	int			encChn;
+	int			jpeg;
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	estimate;
+	uint32_t	frames;
+	uint32_t	peak_i;
+	uint32_t	peak_p;
+	uint32_t	peak_run;			/* largest depth frames in a row */
+	uint32_t	run[MAX_DEPTH];
+};
+
+struct enc_bufsize_calib {
+	int					depth;
+	struct calib_chn	chn[ENC_BUFSIZE_MAX_CHN];
+};
+
+struct conf_entry {
+	int			encChn;
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	bufsize;
+	uint32_t	peak_i;
+	uint32_t	peak_p;
+	uint32_t	frames;
+};
+
+static uint32_t align_up(uint64_t n)
+{
+	return (n + BUF_ALIGN - 1) / BUF_ALIGN * BUF_ALIGN;
+}
+
+/* Bytes of a detailed I frame of pixels at qp */
+static uint64_t i_frame_at_qp(uint64_t pixels, int qp)
+{
+	uint64_t bytes = pixels * I_BPP_QP26_X100 / 800;
+	int d = 26 - qp;
+
+	if (d >= 0)
+		return (bytes << (d / 6)) * qp_step[d % 6] / 1000;
+
+	d = -d;
+	return (bytes >> (d / 6)) * 1000 / qp_step[d % 6];
+}
+
+static int get_rc_params(const IMPEncoderRcAttr *rc, struct rc_params *p)
+{
+	const IMPEncoderFrmRate *fr;
+
+	switch (rc->rcMode) {
+	case ENC_RC_MODE_H264FIXQP:
+		fr = &rc->attrH264FixQp.outFrmRate;
+		p->gop = rc->attrH264FixQp.maxGop;
+		p->kbps = 0;
+		p->qp = rc->attrH264FixQp.qp;
+		break;
+	case ENC_RC_MODE_H264CBR:
+		fr = &rc->attrH264Cbr.outFrmRate;
+		p->gop = rc->attrH264Cbr.maxGop;
+		p->kbps = rc->attrH264Cbr.outBitRate;
+		p->qp = rc->attrH264Cbr.maxQp;
+		break;
+	case ENC_RC_MODE_H264VBR:
+		fr = &rc->attrH264Vbr.outFrmRate;
+		p->gop = rc->attrH264Vbr.maxGop;
+		p->kbps = rc->attrH264Vbr.maxBitRate;
+		p->qp = rc->attrH264Vbr.maxQp;
+		break;
+	default:
+		return -1;
+	}
+
+	p->fps_num = fr->frmRateNum ? fr->frmRateNum : 25;
+	p->fps_den = fr->frmRateDen ? fr->frmRateDen : 1;
+	if (p->gop == 0)
+		p->gop = 1;
+
+	return 0;
+}
+
+/* Largest I and P frames the rate control lets through */
+static int peak_frames(const IMPEncoderCHNAttr *attr, uint64_t *i_max, uint64_t *p_max)
+{
+	uint64_t pixels = (uint64_t)attr->encAttr.picWidth * attr->encAttr.picHeight;
+	uint64_t frame, gop_bytes, i_rate, i_qp, p_qp;
+	struct rc_params p;
+
+	if (attr->encAttr.enType == PT_JPEG) {
+		*i_max = pixels * JPEG_BPP_X100 / 800;
+		*p_max = *i_max;
+		return 0;
+	}
+	if (get_rc_params(&attr->rcAttr, &p) < 0)
+		return -1;
+
+	i_qp = i_frame_at_qp(pixels, p.qp);
+	p_qp = i_qp * P_AT_QP_PCT / 100;
+	if (p.kbps == 0) {
+		*i_max = i_qp;
+		*p_max = p_qp;
+		return 0;
+	}
+
+	frame = (uint64_t)p.kbps * 1000 / 8 * p.fps_den / p.fps_num;
+	gop_bytes = frame * p.gop;
+	i_rate = gop_bytes * I_P_RATIO / (I_P_RATIO + p.gop - 1) * CBR_OVERSHOOT_PCT / 100;
+
+	*i_max = i_rate > i_qp ? i_rate : i_qp;
+	*p_max = frame * P_PEAK_PCT / 100;
+	if (*p_max < p_qp)
+		*p_max = p_qp;
+
+	return 0;
+}
+
+uint32_t enc_bufsize_estimate(const IMPEncoderCHNAttr *attr, int depth)
+{
+	uint64_t i_max, p_max;
+
+	if (peak_frames(attr, &i_max, &p_max) < 0)
+		return 0;
+	if (depth < 1)
+		depth = ENC_BUFSIZE_DEPTH;
+	/* pictures are taken one at a time, one more may be on its way */
+	if (attr->encAttr.enType == PT_JPEG && depth > 2)
+		depth = 2;
+
+	return align_up(i_max + (depth - 1) * p_max + HDR_BYTES);
+}
+
+uint32_t enc_bufsize_ring(const IMPEncoderCHNAttr *attr, uint32_t ms)
+{
+	uint64_t i_max, p_max, bytes;
+	struct rc_params p;
+
+	if (peak_frames(attr, &i_max, &p_max) < 0)
+		return 0;
+
+	if (attr->encAttr.enType != PT_JPEG && get_rc_params(&attr->rcAttr, &p) == 0 && p.kbps)
+		bytes = (uint64_t)p.kbps * 1000 / 8 * ms / 1000;
+	else
+		bytes = p_max * ms / 40;		/* no rate to go by, 25 fps of peak frames */
+
+	return align_up(bytes + i_max);
+}
+
+static int conf_read(const char *conf, struct conf_entry *e, int max)
+{
+	char line[128];
+	FILE *f;
+	int n = 0;
+
+	f = fopen(conf, "r");
+	if (f == NULL)
+		return 0;
+
+	while (n < max && fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%d %ux%u %u %u %u %u", &e[n].encChn, &e[n].width, &e[n].height,
+					&e[n].bufsize, &e[n].peak_i, &e[n].peak_p, &e[n].frames) == 7)
+			n++;
+	}
+	fclose(f);
+
+	return n;
+}
+
+/* Bytes of frames in a row at peak size, an I frame every gop */
+static uint64_t retained_bytes(uint64_t i_max, uint64_t p_max, uint32_t gop, int frames)
+{
+	uint64_t nr_i;
+
+	if (frames <= 0)
+		return 0;
+	nr_i = (frames - 1) / gop + 1;
+
+	return nr_i * i_max + (frames - nr_i) * p_max;
+}
+
+uint32_t enc_bufsize_get(const char *conf, int encChn, const IMPEncoderCHNAttr *attr, int retain)
+{
+	struct conf_entry e[ENC_BUFSIZE_MAX_CHN];
+	uint64_t i_max = 0, p_max = 0, extra;
+	uint32_t estimate, gop = 1;
+	struct rc_params p;
+	int i, n;
+
+	estimate = enc_bufsize_estimate(attr, ENC_BUFSIZE_DEPTH);
+	if (retain > 0 && peak_frames(attr, &i_max, &p_max) < 0)
+		retain = 0;
+	if (attr->encAttr.enType != PT_JPEG && get_rc_params(&attr->rcAttr, &p) == 0)
+		gop = p.gop;
+
+	n = conf_read(conf ? conf : ENC_BUFSIZE_CONF, e, ENC_BUFSIZE_MAX_CHN);
+	for (i = 0; i < n; i++) {
+		if (e[i].encChn == encChn && e[i].width == attr->encAttr.picWidth
+				&& e[i].height == attr->encAttr.picHeight && e[i].bufsize) {
+			/* the peaks seen, with the same headroom as the calibrated size */
+			extra = retained_bytes(e[i].peak_i, e[i].peak_p, gop, retain)
+				* (100 + ENC_BUFSIZE_HEADROOM) / 100;
+			IMP_LOG_INFO(TAG, "chn%d: %u bytes calibrated, estimate %u, %d frames retained %llu\n",
+					encChn, e[i].bufsize, estimate, retain, (unsigned long long)extra);
+			return align_up(e[i].bufsize + extra);
+		}
+	}
+
+	extra = retained_bytes(i_max, p_max, gop, retain);
+	IMP_LOG_INFO(TAG, "chn%d: %u bytes estimated, %d frames retained %llu\n",
+			encChn, estimate, retain, (unsigned long long)extra);
+	return align_up(estimate + extra);
+}
+
+enc_bufsize_calib_t *enc_bufsize_calib_create(int depth)
+{
+	enc_bufsize_calib_t *calib;
+
+	calib = calloc(1, sizeof(enc_bufsize_calib_t));
+	if (calib == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+	calib->depth = depth < 1 ? ENC_BUFSIZE_DEPTH : depth > MAX_DEPTH ? MAX_DEPTH : depth;
+
+	return calib;
+}
+
+void enc_bufsize_calib_destroy(enc_bufsize_calib_t *calib)
+{
+	free(calib);
+}
+
+static struct calib_chn *calib_chn(enc_bufsize_calib_t *calib, int encChn)
+{
+	int i;
+
+	for (i = 0; i < ENC_BUFSIZE_MAX_CHN; i++) {
+		if (calib->chn[i].used && calib->chn[i].encChn == encChn)
+			return &calib->chn[i];
+	}
+
+	return NULL;
+}
+
+int enc_bufsize_calib_add_chn(enc_bufsize_calib_t *calib, int encChn, const IMPEncoderCHNAttr *attr)
+{
+	struct calib_chn *ch = NULL;
+	int i;
+
+	if (calib_chn(calib, encChn))
+		return 0;
+	for (i = 0; i < ENC_BUFSIZE_MAX_CHN; i++) {
+		if (!calib->chn[i].used) {
+			ch = &calib->chn[i];
+			break;
+		}
+	}
+	if (ch == NULL) {
+		IMP_LOG_ERR(TAG, "no room for chn%d\n", encChn);
+		return -1;
+	}
+
+	memset(ch, 0, sizeof(*ch));
+	ch->encChn = encChn;
+	ch->jpeg = attr->encAttr.enType == PT_JPEG;
+	ch->width = attr->encAttr.picWidth;
+	ch->height = attr->encAttr.picHeight;
+	ch->estimate = enc_bufsize_estimate(attr, calib->depth);
+	ch->used = 1;
+
+	return 0;
+}
+
+void enc_bufsize_calib_frame(enc_bufsize_calib_t *calib, int encChn, const IMPEncoderStream *stream)
+{
+	struct calib_chn *ch = calib_chn(calib, encChn);
+	uint32_t size = 0, run = 0;
+	int i, key = 0;
+
+	if (ch == NULL)
+		return;
+
+	for (i = 0; i < stream->packCount; i++) {
+		size += stream->pack[i].length;
+		if (stream->pack[i].dataType.h264Type == IMP_H264_NAL_SLICE_IDR
+				|| stream->pack[i].dataType.h264Type == IMP_H264_NAL_SPS)
+			key = 1;
+	}
+
+	if (key || ch->jpeg) {
+		if (size > ch->peak_i)
+			ch->peak_i = size;
+	} else if (size > ch->peak_p) {
+		ch->peak_p = size;
+	}
+
+	ch->run[ch->frames++ % calib->depth] = size;
+	for (i = 0; i < calib->depth; i++)
+		run += ch->run[i];
+	if (run > ch->peak_run)
+		ch->peak_run = run;
+}
+
+/* What the peaks need, with headroom */
+static uint32_t calibrated(enc_bufsize_calib_t *calib, struct calib_chn *ch)
+{
+	uint64_t need;
+
+	if (ch->jpeg) {
+		need = (uint64_t)ch->peak_i * (calib->depth > 1 ? 2 : 1);
+	} else {
+		need = (uint64_t)ch->peak_i + (uint64_t)(calib->depth - 1) * ch->peak_p;
+		if (need < ch->peak_run)
+			need = ch->peak_run;
+	}
+
+	return align_up(need * (100 + ENC_BUFSIZE_HEADROOM) / 100);
+}
+
+int enc_bufsize_calib_write(enc_bufsize_calib_t *calib, const char *conf)
+{
+	struct conf_entry e[ENC_BUFSIZE_MAX_CHN];
+	struct calib_chn *ch;
+	FILE *f;
+	int i, k, n;
+
+	if (conf == NULL)
+		conf = ENC_BUFSIZE_CONF;
+	n = conf_read(conf, e, ENC_BUFSIZE_MAX_CHN);
+
+	for (i = 0; i < ENC_BUFSIZE_MAX_CHN; i++) {
+		ch = &calib->chn[i];
+		if (!ch->used || ch->frames == 0)
+			continue;
+		for (k = 0; k < n; k++) {
+			if (e[k].encChn == ch->encChn)
+				break;
+		}
+		if (k == n) {
+			if (n == ENC_BUFSIZE_MAX_CHN)
+				continue;
+			n++;
+		}
+		e[k].encChn = ch->encChn;
+		e[k].width = ch->width;
+		e[k].height = ch->height;
+		e[k].bufsize = calibrated(calib, ch);
+		e[k].peak_i = ch->peak_i;
+		e[k].peak_p = ch->peak_p;
+		e[k].frames = ch->frames;
+	}
+
+	f = fopen(conf, "w");
+	if (f == NULL) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", conf, strerror(errno));
+		return -1;
+	}
+	fprintf(f, "# encChn WxH bufsize peak_i peak_p frames\n");
+	for (k = 0; k < n; k++)
+		fprintf(f, "%d %ux%u %u %u %u %u\n", e[k].encChn, e[k].width, e[k].height,
+				e[k].bufsize, e[k].peak_i, e[k].peak_p, e[k].frames);
+	if (fclose(f) != 0) {
+		IMP_LOG_ERR(TAG, "write %s failed: %s\n", conf, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+void enc_bufsize_calib_dump(enc_bufsize_calib_t *calib)
+{
+	struct calib_chn *ch;
+	int i;
+
+	for (i = 0; i < ENC_BUFSIZE_MAX_CHN; i++) {
+		ch = &calib->chn[i];
+		if (!ch->used || ch->frames == 0)
+			continue;
+		IMP_LOG_INFO(TAG, "chn%d %ux%u: %u frames, peak I %u P %u, %d in a row %u bytes; "
+				"needs %u, estimate %u\n", ch->encChn, ch->width, ch->height, ch->frames,
+				ch->peak_i, ch->peak_p, calib->depth, ch->peak_run,
+				calibrated(calib, ch), ch->estimate);
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * sample-enc-bufsize.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_ENC_BUFSIZE_H__
+#define __SAMPLE_ENC_BUFSIZE_H__
+
+#include <stdint.h>
+#include <imp/imp_encoder.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Encoder stream buffer sizing.
+ *
+ * With bufSize = 0 libimp sizes the stream buffer from the picture
+ * alone: far more reserved memory than a sub stream needs, and still
+ * not always enough for a high motion 1080p I frame. The estimate here
+ * starts from the largest frames the rate control lets through:
+ *  - an I frame takes its share of a GOP's bytes, with CBR overshoot,
+ *    or what a detailed picture costs at maxQp when the rate control
+ *    runs out of room, whichever is larger;
+ *  - a P frame up to a few times the average frame;
+ * and makes room for one I frame plus depth - 1 P frames waiting to be
+ * fetched. JPEG channels go by the picture size, two pictures deep.
+ *
+ * A calibration run records the peak I and P frames and the largest
+ * depth frames in a row of each channel, and writes them, with
+ * ENC_BUFSIZE_HEADROOM percent on top, to a small config file. Later
+ * runs take the size from there for a channel of the same picture size.
+ */
+
+#define ENC_BUFSIZE_CONF		"/tmp/enc-bufsize.conf"
+#define ENC_BUFSIZE_DEPTH		3			/* frames waiting in the stream buffer */
+#define ENC_BUFSIZE_HEADROOM	25			/* percent over the calibrated peaks */
+#define ENC_BUFSIZE_MAX_CHN		8
+
+/* 0 if the rate control mode is unknown: let libimp choose */
+uint32_t enc_bufsize_estimate(const IMPEncoderCHNAttr *attr, int depth);
+
+/*
+ * For IMPEncoderAttr.bufSize: the calibrated size of encChn in conf
+ * (NULL: ENC_BUFSIZE_CONF) if it was calibrated at this picture size,
+ * the estimate otherwise. retain frames held out of the buffer by a
+ * zero-copy reader, e.g. a stream hub and its GOP cache, come on top,
+ * at peak size with an I frame per GOP they span.
+ */
+uint32_t enc_bufsize_get(const char *conf, int encChn, const IMPEncoderCHNAttr *attr, int retain);
+
+/* Bytes of stream in ms milliseconds plus an I frame, for a write-behind ring */
+uint32_t enc_bufsize_ring(const IMPEncoderCHNAttr *attr, uint32_t ms);
+
+/* Calibration, fed every stream from the channel's stream thread */
+typedef struct enc_bufsize_calib enc_bufsize_calib_t;
+
+enc_bufsize_calib_t *enc_bufsize_calib_create(int depth);
+void enc_bufsize_calib_destroy(enc_bufsize_calib_t *calib);
+
+int enc_bufsize_calib_add_chn(enc_bufsize_calib_t *calib, int encChn, const IMPEncoderCHNAttr *attr);
+void enc_bufsize_calib_frame(enc_bufsize_calib_t *calib, int encChn, const IMPEncoderStream *stream);
+
+/* Updates the calibrated channels in conf (NULL: ENC_BUFSIZE_CONF), keeps the others */
+int enc_bufsize_calib_write(enc_bufsize_calib_t *calib, const char *conf);
+void enc_bufsize_calib_dump(enc_bufsize_calib_t *calib);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_ENC_BUFSIZE_H__ */
@@ -0,0 +1,220 @@
+/*
+ * sample-enc-telemetry-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check for the encoder telemetry: replays a recorded .h264 file
+ * into the shared memory counters as fast as possible, loops times,
+ * while a reader in another thread takes snapshots nonstop. Every
+ * snapshot must be consistent (frame counts against the histograms and
+ * latency counts), which a torn read would break. At the end the totals,
+ * windowed fps and bitrate are compared with the file.
+ *
+ * Leave it running with -r and watch it with sample-enc-telemetry-cli.
+ *
+ * usage: sample-enc-telemetry-check [-r] [-f fps] [-l loops] <in.h264>
+ *   -r  replay at fps instead of as fast as possible
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_system.h>
+
+#include "sample-common.h"
+#include "sample-h264-parse.h"
+#include "sample-enc-telemetry.h"
+
+#define TAG "Sample-Enc-Telemetry-Check"
+
+#define CHECK_NAME			"/imp-enc-telemetry-check"
+#define CHECK_CHN			0
+#define MAX_NALS_PER_FRAME	16
+
+struct reader_ctx {
+	const enc_telemetry_shm_t	*shm;
+	volatile int				stop;
+	uint64_t					reads;
+	uint64_t					retries;
+	uint64_t					bad;
+};
+
+static uint32_t hist_sum(const uint32_t *hist)
+{
+	uint32_t sum = 0;
+	int i;
+
+	for (i = 0; i < ENC_TELEMETRY_BUCKETS; i++)
+		sum += hist[i];
+
+	return sum;
+}
+
+static int consistent(const enc_telemetry_chn_t *c)
+{
+	return c->frames == c->i_frames + c->p_frames
+		&& hist_sum(c->i_size_hist) == c->i_frames
+		&& hist_sum(c->p_size_hist) == c->p_frames
+		&& c->get.count == c->frames && hist_sum(c->get.hist) == c->get.count
+		&& c->poll_wait.count == (c->frames ? c->frames - 1 : 0)
+		&& hist_sum(c->poll_wait.hist) == c->poll_wait.count
+		&& (c->hold.count == c->frames || c->hold.count + 1 == c->frames)
+		&& hist_sum(c->hold.hist) == c->hold.count
+		&& c->i_bytes <= c->bytes;
+}
+
+static void *reader_thread(void *arg)
+{
+	struct reader_ctx *r = arg;
+	enc_telemetry_chn_t c;
+
+	while (!r->stop) {
+		r->retries += enc_telemetry_read(r->shm, CHECK_CHN, &c);
+		r->reads++;
+		if (c.encChn == CHECK_CHN && !consistent(&c)) {
+			if (r->bad++ == 0)
+				IMP_LOG_ERR(TAG, "torn snapshot at frame %u\n", c.frames);
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	int fps = SENSOR_FRAME_RATE_NUM / SENSOR_FRAME_RATE_DEN, loops = 20, paced = 0;
+	h264_nal_t nal[MAX_NALS_PER_FRAME];
+	IMPEncoderCHNAttr attr;
+	struct reader_ctx r;
+	enc_telemetry_t *tel;
+	enc_telemetry_chn_t c;
+	pthread_t tid;
+	struct stat st;
+	uint8_t *buf;
+	size_t pos;
+	uint64_t bytes = 0, win_bytes;
+	uint32_t size, frames = 0, keys = 0, win_frames, *sizes = NULL;
+	int64_t ts, t0, t1, start;
+	int fd, opt, i, n, l;
+
+	while ((opt = getopt(argc, argv, "rf:l:")) != -1) {
+		switch (opt) {
+		case 'r':
+			paced = 1;
+			break;
+		case 'f':
+			fps = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind >= argc || fps <= 0 || loops <= 0)
+		goto usage;
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", argv[optind], strerror(errno));
+		return -1;
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED)
+		return -1;
+
+	tel = enc_telemetry_create(CHECK_NAME);
+	if (tel == NULL)
+		return -1;
+	memset(&attr, 0, sizeof(attr));
+	attr.encAttr.enType = PT_H264;
+	attr.rcAttr.rcMode = ENC_RC_MODE_H264CBR;
+	attr.rcAttr.attrH264Cbr.outBitRate = 2000;
+	attr.rcAttr.attrH264Cbr.maxQp = 45;
+	attr.rcAttr.attrH264Cbr.minQp = 15;
+	if (enc_telemetry_add_chn(tel, CHECK_CHN, &attr) < 0)
+		return -1;
+
+	memset(&r, 0, sizeof(r));
+	r.shm = enc_telemetry_open(CHECK_NAME);
+	if (r.shm == NULL)
+		return -1;
+	pthread_create(&tid, NULL, reader_thread, &r);
+
+	t0 = IMP_System_GetTimeStamp();
+	for (l = 0; l < loops; l++) {
+		pos = 0;
+		while ((n = h264_next_frame(buf, st.st_size, &pos, nal, MAX_NALS_PER_FRAME)) > 0) {
+			for (i = 0, size = 0; i < n; i++)
+				size += nal[i].len;
+			ts = (int64_t)frames * 1000000 / fps;
+			if (paced) {
+				while (IMP_System_GetTimeStamp() - t0 < ts)
+					usleep(1000);
+			}
+
+			/* latencies made up, they only have to land in the histograms */
+			start = IMP_System_GetTimeStamp();
+			enc_telemetry_get_frame(tel, CHECK_CHN, size, h264_is_key_frame(nal, n), ts,
+					frames % 1000, frames % 7);
+			enc_telemetry_release(tel, CHECK_CHN, IMP_System_GetTimeStamp() - start);
+
+			if (frames % 1024 == 0)
+				sizes = realloc(sizes, (frames + 1024) * sizeof(uint32_t));
+			sizes[frames] = size;
+			bytes += size;
+			keys += h264_is_key_frame(nal, n);
+			frames++;
+		}
+	}
+	t1 = IMP_System_GetTimeStamp();
+
+	r.stop = 1;
+	pthread_join(tid, NULL);
+	enc_telemetry_read(r.shm, CHECK_CHN, &c);
+
+	/* frames whose timestamp is within the window of the last one */
+	for (i = frames - 1, win_frames = 0, win_bytes = 0;
+			i >= 0 && (int64_t)(frames - 1 - i) * 1000000 / fps < ENC_TELEMETRY_WINDOW_US; i--) {
+		win_frames++;
+		win_bytes += sizes[i];
+	}
+
+	printf("%u frames in %lld ms, %.0f ns per update\n", frames, (long long)(t1 - t0) / 1000,
+			frames ? (t1 - t0) * 1000.0 / frames / 2 : 0.0);
+	printf("reader: %llu snapshots, %llu retries, %llu torn\n", (unsigned long long)r.reads,
+			(unsigned long long)r.retries, (unsigned long long)r.bad);
+	printf("frames %u/%u, I %u/%u, bytes %llu/%llu, fps %u.%02u/%u, kbps %u/%llu\n",
+			c.frames, frames, c.i_frames, keys, (unsigned long long)c.bytes,
+			(unsigned long long)bytes, c.window_fps_x100 / 100, c.window_fps_x100 % 100,
+			win_frames, c.window_kbps, (unsigned long long)win_bytes * 8 / 1000);
+
+	enc_telemetry_close(r.shm);
+	enc_telemetry_destroy(tel);
+	free(sizes);
+
+	if (r.bad || !consistent(&c) || c.frames != frames || c.i_frames != keys || c.bytes != bytes
+			|| c.window_fps_x100 != win_frames * 100
+			|| c.window_kbps != win_bytes * 8 / 1000) {
+		IMP_LOG_ERR(TAG, "check failed\n");
+		return -1;
+	}
+	printf("ok\n");
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-r] [-f fps] [-l loops] <in.h264>\n", argv[0]);
+	return -1;
+}
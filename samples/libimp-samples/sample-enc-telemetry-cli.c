@@ -0,0 +1,142 @@
+/*
+ * sample-enc-telemetry-cli.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Prints the encoder counters that a running sample publishes with
+ * sample-enc-telemetry, without stopping or slowing its stream loop.
+ * Averages are over the last interval, maxima since the start.
+ *
+ * usage: sample-enc-telemetry-cli [-n name] [-i interval_ms] [-c count] [-H]
+ *   -H  also print the frame size and latency histograms
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+
+#include "sample-enc-telemetry.h"
+
+#define TAG "Sample-Enc-Telemetry-Cli"
+
+static uint32_t lat_avg(const enc_telemetry_lat_t *now, const enc_telemetry_lat_t *prev)
+{
+	uint32_t n = now->count - prev->count;
+
+	return n ? (now->total_us - prev->total_us) / n : 0;
+}
+
+static uint32_t size_avg(uint64_t bytes, uint64_t prev_bytes, uint32_t n)
+{
+	return n ? (bytes - prev_bytes) / n : 0;
+}
+
+static void print_hist(const char *name, const uint32_t *hist, const char *unit)
+{
+	int i;
+
+	printf("      %-10s", name);
+	for (i = 0; i < ENC_TELEMETRY_BUCKETS; i++) {
+		if (hist[i] == 0)
+			continue;
+		/* lower bound of the bucket */
+		if (i >= 20)
+			printf(" %uM:%u", 1 << (i - 20), hist[i]);
+		else if (i >= 10)
+			printf(" %uK:%u", 1 << (i - 10), hist[i]);
+		else
+			printf(" %u:%u", i ? 1 << i : 0, hist[i]);
+	}
+	printf(" %s\n", unit);
+}
+
+static void print_chn(const enc_telemetry_chn_t *c, const enc_telemetry_chn_t *p, int hist)
+{
+	uint32_t i_frames = c->i_frames - p->i_frames, p_frames = c->p_frames - p->p_frames;
+
+	printf("%4d %-4s %8u %6u.%02u %6u/%-6u %6u %8u %8u %6u/%-6u %6u/%-6u %6u/%-6u\n",
+			c->encChn, c->payload == PT_H264 ? "h264" : "jpeg", c->frames,
+			c->window_fps_x100 / 100, c->window_fps_x100 % 100,
+			c->window_kbps, c->target_kbps, c->inst_kbps,
+			size_avg(c->i_bytes, p->i_bytes, i_frames),
+			size_avg(c->bytes - c->i_bytes, p->bytes - p->i_bytes, p_frames),
+			lat_avg(&c->poll_wait, &p->poll_wait), c->poll_wait.max_us,
+			lat_avg(&c->get, &p->get), c->get.max_us,
+			lat_avg(&c->hold, &p->hold), c->hold.max_us);
+
+	if (hist) {
+		print_hist("I size", c->i_size_hist, "bytes");
+		print_hist("P size", c->p_size_hist, "bytes");
+		print_hist("poll wait", c->poll_wait.hist, "us");
+		print_hist("get", c->get.hist, "us");
+		print_hist("hold", c->hold.hist, "us");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	enc_telemetry_chn_t chn[ENC_TELEMETRY_MAX_CHN], prev[ENC_TELEMETRY_MAX_CHN];
+	const enc_telemetry_shm_t *shm;
+	const char *name = NULL;
+	int interval_ms = 1000, count = 0, hist = 0, opt, i, n;
+
+	while ((opt = getopt(argc, argv, "n:i:c:H")) != -1) {
+		switch (opt) {
+		case 'n':
+			name = optarg;
+			break;
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		case 'H':
+			hist = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n name] [-i interval_ms] [-c count] [-H]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	shm = enc_telemetry_open(name);
+	if (shm == NULL)
+		return -1;
+
+	memset(prev, 0, sizeof(prev));
+	for (n = 0; count == 0 || n < count; n++) {
+		if (shm->magic != ENC_TELEMETRY_MAGIC) {
+			IMP_LOG_ERR(TAG, "writer %d is gone\n", shm->pid);
+			break;
+		}
+
+		printf("%4s %-4s %8s %9s %13s %6s %8s %8s %13s %13s %13s\n", "chn", "type", "frames",
+				"fps", "kbps/target", "inst", "I avg", "P avg", "wait us", "get us", "hold us");
+		for (i = 0; i < ENC_TELEMETRY_MAX_CHN; i++) {
+			enc_telemetry_read(shm, i, &chn[i]);
+			if (chn[i].encChn < 0)
+				continue;
+			/* restarted channel, nothing to diff against */
+			if (prev[i].encChn != chn[i].encChn || prev[i].frames > chn[i].frames) {
+				memset(&prev[i], 0, sizeof(prev[i]));
+				prev[i].encChn = chn[i].encChn;
+			}
+			print_chn(&chn[i], &prev[i], hist);
+			prev[i] = chn[i];
+		}
+		printf("\n");
+		fflush(stdout);
+
+		if (count == 0 || n + 1 < count)
+			usleep(interval_ms * 1000);
+	}
+
+	enc_telemetry_close(shm);
+
+	return 0;
+}
@@ -0,0 +1,344 @@
+/*
+ * sample-enc-telemetry.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_system.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-enc-telemetry.h"
+#include "sample-h264-parse.h"
+
+#define TAG "Sample-Enc-Telemetry"
+
+/* Frames kept for the window, enough for 1s at 240fps */
+#define WINDOW_FRAMES	256
+
+struct window_frame {
+	int64_t		timestamp;
+	uint32_t	size;
+};
+
+/* Writer private state of a slot, the shared record is derived from it */
+struct tel_chn {
+	struct window_frame	win[WINDOW_FRAMES];
+	int					win_head;
+	int					win_nr;
+	uint64_t			win_bytes;
+};
+
+struct enc_telemetry {
+	enc_telemetry_shm_t	*shm;
+	char				name[64];
+	struct tel_chn		chn[ENC_TELEMETRY_MAX_CHN];
+};
+
+static int bucket(uint64_t v)
+{
+	int n = 0;
+
+	while (v > 1 && n < ENC_TELEMETRY_BUCKETS - 1) {
+		v >>= 1;
+		n++;
+	}
+
+	return n;
+}
+
+static void lat_add(enc_telemetry_lat_t *lat, int64_t us)
+{
+	if (us < 0)
+		us = 0;
+	lat->count++;
+	lat->total_us += us;
+	if (us > lat->max_us)
+		lat->max_us = us;
+	lat->hist[bucket(us)]++;
+}
+
+/* Odd while the record is being changed, readers retry meanwhile */
+static void write_begin(enc_telemetry_slot_t *slot)
+{
+	slot->seq++;
+	__sync_synchronize();
+}
+
+static void write_end(enc_telemetry_slot_t *slot)
+{
+	__sync_synchronize();
+	slot->seq++;
+}
+
+static int find_slot(enc_telemetry_t *tel, int encChn)
+{
+	int i;
+
+	for (i = 0; i < ENC_TELEMETRY_MAX_CHN; i++) {
+		if (tel->shm->slot[i].chn.encChn == encChn)
+			return i;
+	}
+
+	return -1;
+}
+
+enc_telemetry_t *enc_telemetry_create(const char *name)
+{
+	enc_telemetry_t *tel;
+	int fd, i;
+
+	tel = calloc(1, sizeof(enc_telemetry_t));
+	if (tel == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+	snprintf(tel->name, sizeof(tel->name), "%s", name ? name : ENC_TELEMETRY_NAME);
+
+	fd = shm_open(tel->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		IMP_LOG_ERR(TAG, "shm_open %s failed: %s\n", tel->name, strerror(errno));
+		free(tel);
+		return NULL;
+	}
+	if (ftruncate(fd, sizeof(enc_telemetry_shm_t)) < 0) {
+		IMP_LOG_ERR(TAG, "ftruncate %s failed: %s\n", tel->name, strerror(errno));
+		goto err;
+	}
+	tel->shm = mmap(NULL, sizeof(enc_telemetry_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (tel->shm == MAP_FAILED) {
+		IMP_LOG_ERR(TAG, "mmap %s failed: %s\n", tel->name, strerror(errno));
+		goto err;
+	}
+	close(fd);
+
+	for (i = 0; i < ENC_TELEMETRY_MAX_CHN; i++)
+		tel->shm->slot[i].chn.encChn = -1;
+	tel->shm->version = ENC_TELEMETRY_VERSION;
+	tel->shm->size = sizeof(enc_telemetry_shm_t);
+	tel->shm->pid = getpid();
+	tel->shm->start_us = IMP_System_GetTimeStamp();
+	/* last, readers check it first */
+	__sync_synchronize();
+	tel->shm->magic = ENC_TELEMETRY_MAGIC;
+
+	return tel;
+
+err:
+	close(fd);
+	shm_unlink(tel->name);
+	free(tel);
+	return NULL;
+}
+
+void enc_telemetry_destroy(enc_telemetry_t *tel)
+{
+	tel->shm->magic = 0;
+	munmap(tel->shm, sizeof(enc_telemetry_shm_t));
+	shm_unlink(tel->name);
+	free(tel);
+}
+
+int enc_telemetry_add_chn(enc_telemetry_t *tel, int encChn, const IMPEncoderCHNAttr *attr)
+{
+	const IMPEncoderRcAttr *rc = &attr->rcAttr;
+	enc_telemetry_slot_t *slot;
+	int i;
+
+	i = find_slot(tel, encChn);
+	if (i < 0)
+		i = find_slot(tel, -1);
+	if (i < 0) {
+		IMP_LOG_ERR(TAG, "no slot for chn%d\n", encChn);
+		return -1;
+	}
+	slot = &tel->shm->slot[i];
+	memset(&tel->chn[i], 0, sizeof(struct tel_chn));
+
+	write_begin(slot);
+	memset(&slot->chn, 0, sizeof(enc_telemetry_chn_t));
+	slot->chn.encChn = encChn;
+	slot->chn.payload = attr->encAttr.enType;
+	if (attr->encAttr.enType == PT_H264) {
+		switch (rc->rcMode) {
+		case ENC_RC_MODE_H264CBR:
+			slot->chn.target_kbps = rc->attrH264Cbr.outBitRate;
+			slot->chn.min_qp = rc->attrH264Cbr.minQp;
+			slot->chn.max_qp = rc->attrH264Cbr.maxQp;
+			break;
+		case ENC_RC_MODE_H264VBR:
+			slot->chn.target_kbps = rc->attrH264Vbr.maxBitRate;
+			slot->chn.min_qp = rc->attrH264Vbr.minQp;
+			slot->chn.max_qp = rc->attrH264Vbr.maxQp;
+			break;
+		case ENC_RC_MODE_H264FIXQP:
+			slot->chn.min_qp = slot->chn.max_qp = rc->attrH264FixQp.qp;
+			break;
+		default:
+			break;
+		}
+	}
+	write_end(slot);
+
+	return 0;
+}
+
+void enc_telemetry_get_frame(enc_telemetry_t *tel, int encChn, uint32_t size, int key_frame,
+		int64_t timestamp, int64_t poll_wait_us, int64_t get_us)
+{
+	enc_telemetry_slot_t *slot;
+	enc_telemetry_chn_t *c;
+	struct tel_chn *t;
+	struct window_frame *f;
+	int64_t dt;
+	int i;
+
+	i = find_slot(tel, encChn);
+	if (i < 0)
+		return;
+	slot = &tel->shm->slot[i];
+	c = &slot->chn;
+	t = &tel->chn[i];
+
+	/* Drop what fell out of the window, or the oldest if it is full */
+	while (t->win_nr > 0) {
+		f = &t->win[(t->win_head - t->win_nr + WINDOW_FRAMES) % WINDOW_FRAMES];
+		if (t->win_nr < WINDOW_FRAMES && timestamp - f->timestamp < ENC_TELEMETRY_WINDOW_US)
+			break;
+		t->win_bytes -= f->size;
+		t->win_nr--;
+	}
+	f = &t->win[t->win_head];
+	f->timestamp = timestamp;
+	f->size = size;
+	t->win_head = (t->win_head + 1) % WINDOW_FRAMES;
+	t->win_nr++;
+	t->win_bytes += size;
+
+	write_begin(slot);
+	dt = timestamp - c->last_timestamp;
+	c->inst_kbps = c->frames && dt > 0 ? (uint64_t)size * 8 * 1000 / dt : 0;
+	c->frames++;
+	if (key_frame) {
+		c->i_frames++;
+		c->i_bytes += size;
+		c->i_size_hist[bucket(size)]++;
+	} else {
+		c->p_frames++;
+		c->p_size_hist[bucket(size)]++;
+	}
+	c->bytes += size;
+	c->last_size = size;
+	c->last_timestamp = timestamp;
+	c->window_kbps = t->win_bytes * 8 * 1000 / ENC_TELEMETRY_WINDOW_US;
+	c->window_fps_x100 = (uint64_t)t->win_nr * 100 * 1000000 / ENC_TELEMETRY_WINDOW_US;
+	if (c->frames > 1)
+		lat_add(&c->poll_wait, poll_wait_us);
+	lat_add(&c->get, get_us);
+	write_end(slot);
+}
+
+void enc_telemetry_get(enc_telemetry_t *tel, int encChn, const IMPEncoderStream *stream,
+		int64_t poll_wait_us, int64_t get_us)
+{
+	uint32_t size = 0;
+	int i, slot, key;
+
+	slot = find_slot(tel, encChn);
+	if (slot < 0 || stream->packCount == 0)
+		return;
+
+	for (i = 0; i < stream->packCount; i++)
+		size += stream->pack[i].length;
+	/* every JPEG picture stands alone */
+	key = tel->shm->slot[slot].chn.payload != PT_H264 || h264_stream_is_key_frame(stream);
+
+	enc_telemetry_get_frame(tel, encChn, size, key, stream->pack[0].timestamp,
+			poll_wait_us, get_us);
+}
+
+void enc_telemetry_release(enc_telemetry_t *tel, int encChn, int64_t hold_us)
+{
+	enc_telemetry_slot_t *slot;
+	int i;
+
+	i = find_slot(tel, encChn);
+	if (i < 0)
+		return;
+	slot = &tel->shm->slot[i];
+
+	write_begin(slot);
+	lat_add(&slot->chn.hold, hold_us);
+	write_end(slot);
+}
+
+const enc_telemetry_shm_t *enc_telemetry_open(const char *name)
+{
+	enc_telemetry_shm_t *shm;
+	struct stat st;
+	int fd;
+
+	if (name == NULL)
+		name = ENC_TELEMETRY_NAME;
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		IMP_LOG_ERR(TAG, "shm_open %s failed: %s\n", name, strerror(errno));
+		return NULL;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(enc_telemetry_shm_t)) {
+		IMP_LOG_ERR(TAG, "%s is not ready\n", name);
+		close(fd);
+		return NULL;
+	}
+	shm = mmap(NULL, sizeof(enc_telemetry_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		IMP_LOG_ERR(TAG, "mmap %s failed: %s\n", name, strerror(errno));
+		return NULL;
+	}
+	if (shm->magic != ENC_TELEMETRY_MAGIC || shm->version != ENC_TELEMETRY_VERSION
+			|| shm->size != sizeof(enc_telemetry_shm_t)) {
+		IMP_LOG_ERR(TAG, "%s: unknown layout\n", name);
+		munmap(shm, sizeof(enc_telemetry_shm_t));
+		return NULL;
+	}
+
+	return shm;
+}
+
+void enc_telemetry_close(const enc_telemetry_shm_t *shm)
+{
+	munmap((void *)shm, sizeof(enc_telemetry_shm_t));
+}
+
+int enc_telemetry_read(const enc_telemetry_shm_t *shm, int i, enc_telemetry_chn_t *chn)
+{
+	const enc_telemetry_slot_t *slot = &shm->slot[i];
+	uint32_t seq;
+	int retries = 0;
+
+	for (;;) {
+		seq = slot->seq;
+		__sync_synchronize();
+		if (!(seq & 1)) {
+			memcpy(chn, &slot->chn, sizeof(enc_telemetry_chn_t));
+			__sync_synchronize();
+			if (slot->seq == seq)
+				return retries;
+		}
+		/* the writer holds it for a few hundred ns, unless it was preempted */
+		if (++retries % 64 == 0)
+			sched_yield();
+	}
+}
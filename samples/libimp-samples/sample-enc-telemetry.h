@@ -0,0 +1,122 @@
+/*
+ * sample-enc-telemetry.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_ENC_TELEMETRY_H__
+#define __SAMPLE_ENC_TELEMETRY_H__
+
+#include <stdint.h>
+#include <imp/imp_encoder.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Per encoder channel counters in POSIX shared memory.
+ *
+ * The stream loop updates a channel's record after every GetStream and
+ * ReleaseStream; any other process maps the same object read only and
+ * takes snapshots, e.g. sample-enc-telemetry-cli. Each record is guarded
+ * by a sequence counter: the single writer makes it odd while updating,
+ * a reader copies the record and retries if the counter was odd or moved.
+ * Neither side takes a lock, the stream loop never waits for a reader.
+ *
+ * Bitrate and fps follow the encoder timestamps, not the delivery times,
+ * so they describe the stream itself. Histograms are log2: bucket n
+ * counts values in [2^n, 2^(n+1)), bucket 0 also 0, the last bucket
+ * everything above.
+ */
+
+#define ENC_TELEMETRY_NAME		"/imp-enc-telemetry"
+#define ENC_TELEMETRY_MAGIC		0x544c4d45		/* "EMLT" */
+#define ENC_TELEMETRY_VERSION	1
+#define ENC_TELEMETRY_MAX_CHN	8
+#define ENC_TELEMETRY_BUCKETS	24				/* up to 8MB frames, 8s latencies */
+#define ENC_TELEMETRY_WINDOW_US	1000000			/* windowed bitrate and fps */
+
+typedef struct enc_telemetry_lat {
+	uint32_t	count;
+	uint32_t	max_us;
+	uint64_t	total_us;
+	uint32_t	hist[ENC_TELEMETRY_BUCKETS];
+} enc_telemetry_lat_t;
+
+typedef struct enc_telemetry_chn {
+	int32_t		encChn;				/* -1: slot unused */
+	uint32_t	payload;			/* PT_H264, PT_JPEG */
+	uint32_t	target_kbps;		/* CBR outBitRate, VBR maxBitRate, 0 for fixed QP */
+	uint32_t	min_qp;
+	uint32_t	max_qp;
+	uint32_t	frames;
+	uint32_t	i_frames;			/* IDR, every JPEG frame */
+	uint32_t	p_frames;
+	uint64_t	bytes;
+	uint64_t	i_bytes;
+	uint32_t	last_size;
+	uint32_t	inst_kbps;			/* last frame over its frame interval */
+	uint32_t	window_kbps;		/* over the last ENC_TELEMETRY_WINDOW_US */
+	uint32_t	window_fps_x100;
+	int64_t		last_timestamp;		/* encoder timestamp of the last frame */
+	uint32_t	i_size_hist[ENC_TELEMETRY_BUCKETS];	/* bytes */
+	uint32_t	p_size_hist[ENC_TELEMETRY_BUCKETS];
+	enc_telemetry_lat_t	poll_wait;	/* previous release -> next stream ready */
+	enc_telemetry_lat_t	get;		/* ready -> GetStream returned */
+	enc_telemetry_lat_t	hold;		/* GetStream -> ReleaseStream */
+} enc_telemetry_chn_t;
+
+typedef struct enc_telemetry_slot {
+	volatile uint32_t	seq;
+	uint32_t			reserved;
+	enc_telemetry_chn_t	chn;
+} enc_telemetry_slot_t;
+
+typedef struct enc_telemetry_shm {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	size;				/* sizeof(enc_telemetry_shm_t) */
+	int32_t		pid;				/* writer */
+	int64_t		start_us;			/* IMP_System_GetTimeStamp() at create */
+	enc_telemetry_slot_t slot[ENC_TELEMETRY_MAX_CHN];
+} enc_telemetry_shm_t;
+
+typedef struct enc_telemetry enc_telemetry_t;
+
+/* Writer side, name NULL for ENC_TELEMETRY_NAME. destroy() unlinks it. */
+enc_telemetry_t *enc_telemetry_create(const char *name);
+void enc_telemetry_destroy(enc_telemetry_t *tel);
+
+/* attr from IMP_Encoder_GetChnAttr(), for the payload and rate control */
+int enc_telemetry_add_chn(enc_telemetry_t *tel, int encChn, const IMPEncoderCHNAttr *attr);
+
+/*
+ * From the thread that owns encChn: stream right after GetStream, with
+ * the time the channel waited for it and the time GetStream took to be
+ * reached and return; then the time the stream was held at release.
+ * get_frame() is the same for callers that only have the frame size.
+ */
+void enc_telemetry_get(enc_telemetry_t *tel, int encChn, const IMPEncoderStream *stream,
+		int64_t poll_wait_us, int64_t get_us);
+void enc_telemetry_get_frame(enc_telemetry_t *tel, int encChn, uint32_t size, int key_frame,
+		int64_t timestamp, int64_t poll_wait_us, int64_t get_us);
+void enc_telemetry_release(enc_telemetry_t *tel, int encChn, int64_t hold_us);
+
+/* Reader side */
+const enc_telemetry_shm_t *enc_telemetry_open(const char *name);
+void enc_telemetry_close(const enc_telemetry_shm_t *shm);
+
+/* Consistent copy of slot i, returns the number of retries */
+int enc_telemetry_read(const enc_telemetry_shm_t *shm, int i, enc_telemetry_chn_t *chn);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_ENC_TELEMETRY_H__ */
@@ -0,0 +1,477 @@
+/*
+ * sample-fmp4-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check for the fragmented MP4 muxer: muxes a recorded .h264 file
+ * together with generated G.711 audio, then parses the result and
+ * verifies that
+ *  - the box tree covers the file and every fragment is moof/free/mdat,
+ *  - the video samples give back the source NALs in order,
+ *  - fragments start with an IDR (unless the GOP exceeds max_gop) and
+ *    decode times are continuous,
+ *  - every mfra entry seeks to a moof whose first sample is an IDR,
+ *  - a copy taken mid-fragment (as after a crash) still parses.
+ *
+ * usage: sample-fmp4-check <in.h264> [out.mp4] [fps] [max_gop]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <imp/imp_log.h>
+
+#include "sample-common.h"
+#include "sample-h264-parse.h"
+#include "sample-fmp4-mux.h"
+
+#define TAG "Sample-FMP4-Check"
+
+#define MAX_NALS_PER_FRAME	16
+#define AUDIO_FRAME_BYTES	160		/* 20ms of 8kHz G.711 */
+#define AUDIO_RATE			8000
+
+#define CHECK(cond, ...) do {										\
+	if (!(cond)) {													\
+		IMP_LOG_ERR(TAG, __VA_ARGS__);								\
+		return -1;													\
+	}																\
+} while (0)
+
+struct src {
+	const uint8_t	*buf;
+	size_t			len;
+	size_t			pos;		/* next frame to compare */
+	int				nr_key;
+};
+
+struct frag_info {
+	uint64_t	v_base;
+	uint32_t	v_count;
+	uint64_t	v_dur;
+	uint32_t	v_first_flags;
+	const uint8_t *v_first;		/* data of the first video sample */
+	uint32_t	a_count;
+	uint64_t	a_bytes;
+};
+
+static uint32_t rd32(const uint8_t *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64_t rd64(const uint8_t *p)
+{
+	return ((uint64_t)rd32(p) << 32) | rd32(p + 4);
+}
+
+static int is_box(const uint8_t *p, const char *tag)
+{
+	return memcmp(p + 4, tag, 4) == 0;
+}
+
+/* NAL type of the first slice of a length prefixed sample */
+static int first_slice_type(const uint8_t *p, uint32_t size)
+{
+	uint32_t off = 0, len;
+	int type;
+
+	while (off + 4 < size) {
+		len = rd32(p + off);
+		type = H264_NAL_TYPE(p[off + 4]);
+		if (type == H264_NAL_SLICE || type == H264_NAL_IDR)
+			return type;
+		off += 4 + len;
+	}
+
+	return -1;
+}
+
+/* Compare one sample with the next source frame, minus SPS/PPS/AUD */
+static int compare_sample(struct src *src, const uint8_t *p, uint32_t size, uint32_t flags)
+{
+	h264_nal_t nal[MAX_NALS_PER_FRAME];
+	uint32_t off = 0, len;
+	int i, n, sc;
+
+	n = h264_next_frame(src->buf, src->len, &src->pos, nal, MAX_NALS_PER_FRAME);
+	CHECK(n > 0, "more samples than source frames\n");
+
+	for (i = 0; i < n; i++) {
+		if (nal[i].type == H264_NAL_SPS || nal[i].type == H264_NAL_PPS || nal[i].type == H264_NAL_AUD)
+			continue;
+		sc = nal[i].sc_len;
+		CHECK(off + 4 <= size, "sample shorter than source frame\n");
+		len = rd32(p + off);
+		CHECK(len == nal[i].len - sc && off + 4 + len <= size, "NAL length mismatch\n");
+		CHECK(memcmp(p + off + 4, nal[i].data + sc, len) == 0, "NAL payload mismatch\n");
+		off += 4 + len;
+	}
+	CHECK(off == size, "sample has %u extra bytes\n", size - off);
+
+	CHECK(!!(flags & 0x02000000) == !!h264_is_key_frame(nal, n),
+			"sync flag does not match the frame\n");
+
+	return 0;
+}
+
+/*
+ * Parse the moof at buf + pos and its mdat. With src set, the video
+ * samples are compared with the source.
+ */
+static int parse_fragment(const uint8_t *buf, size_t len, size_t pos, struct src *src,
+		struct frag_info *fi, size_t *next)
+{
+	const uint8_t *moof = buf + pos, *traf, *box, *mdat;
+	uint32_t moof_size = rd32(moof), traf_size, size, tflags, count, track = 0, i;
+	uint32_t dur, ssize, sflags;
+	uint64_t base = 0, mdat_end;
+	size_t mpos, off, data;
+	int32_t data_offset;
+
+	memset(fi, 0, sizeof(*fi));
+	CHECK(is_box(moof, "moof") && pos + moof_size <= len, "no moof at %zu\n", pos);
+
+	/* free room, then mdat */
+	mpos = pos + moof_size;
+	while (mpos + 8 <= len && is_box(buf + mpos, "free"))
+		mpos += rd32(buf + mpos);
+	CHECK(mpos + 8 <= len && is_box(buf + mpos, "mdat"), "no mdat after moof at %zu\n", pos);
+	mdat = buf + mpos;
+	mdat_end = rd32(mdat) ? mpos + rd32(mdat) : len;
+	CHECK(mdat_end <= len, "mdat past end of file\n");
+	*next = mdat_end;
+
+	for (off = 8; off < moof_size; off += rd32(moof + off)) {
+		if (!is_box(moof + off, "traf"))
+			continue;
+		traf = moof + off;
+		traf_size = rd32(traf);
+		for (box = traf + 8; box < traf + traf_size; box += size) {
+			size = rd32(box);
+			CHECK(size >= 8, "bad box in traf\n");
+			if (is_box(box, "tfhd")) {
+				track = rd32(box + 12);
+			} else if (is_box(box, "tfdt")) {
+				base = box[8] == 1 ? rd64(box + 12) : rd32(box + 12);
+			} else if (is_box(box, "trun")) {
+				tflags = rd32(box + 8) & 0xffffff;
+				count = rd32(box + 12);
+				CHECK(tflags & 1, "trun without data offset\n");
+				data_offset = (int32_t)rd32(box + 16);
+				data = pos + data_offset;
+				if (track == 1) {
+					CHECK(tflags == 0x701, "unexpected video trun flags %x\n", tflags);
+					fi->v_base = base;
+					fi->v_count = count;
+					for (i = 0; i < count; i++) {
+						dur = rd32(box + 20 + 12 * i);
+						ssize = rd32(box + 24 + 12 * i);
+						sflags = rd32(box + 28 + 12 * i);
+						CHECK(data >= mpos + 8 && data + ssize <= mdat_end,
+								"video sample %u outside mdat\n", i);
+						if (i == 0) {
+							fi->v_first_flags = sflags;
+							fi->v_first = buf + data;
+						}
+						if (src && compare_sample(src, buf + data, ssize, sflags) < 0)
+							return -1;
+						fi->v_dur += dur;
+						data += ssize;
+					}
+				} else if (track == 2) {
+					CHECK(tflags == 0x301, "unexpected audio trun flags %x\n", tflags);
+					fi->a_count = count;
+					for (i = 0; i < count; i++) {
+						ssize = rd32(box + 24 + 8 * i);
+						CHECK(data >= mpos + 8 && data + ssize <= mdat_end,
+								"audio sample %u outside mdat\n", i);
+						fi->a_bytes += ssize;
+						data += ssize;
+					}
+				}
+			}
+		}
+	}
+	CHECK(fi->v_count > 0, "fragment at %zu has no video\n", pos);
+
+	return 0;
+}
+
+/*
+ * Walk the whole file. complete == 0 accepts an unfinished last fragment,
+ * the state a crash leaves behind.
+ */
+static int check_file(const uint8_t *buf, size_t len, struct src *src, int complete,
+		int *nr_frag, uint64_t *audio_bytes)
+{
+	struct frag_info fi;
+	size_t pos = 0, next;
+	uint64_t dts = 0;
+	uint32_t size;
+
+	CHECK(len >= 16 && is_box(buf, "ftyp"), "no ftyp\n");
+	pos = rd32(buf);
+	CHECK(pos + 8 <= len && is_box(buf + pos, "moov"), "no moov\n");
+	pos += rd32(buf + pos);
+
+	*nr_frag = 0;
+	*audio_bytes = 0;
+	while (pos + 8 <= len) {
+		if (is_box(buf + pos, "moof")) {
+			if (parse_fragment(buf, len, pos, src, &fi, &next) < 0)
+				return -1;
+			/* only a GOP longer than max_gop spills into a fragment without IDR */
+			CHECK((fi.v_first_flags == 0x02000000) ==
+					(first_slice_type(fi.v_first, len - (fi.v_first - buf)) == H264_NAL_IDR),
+					"fragment %d: sync flag does not match its first slice\n", *nr_frag);
+			CHECK(*nr_frag == 0 || fi.v_base == dts,
+					"fragment %d decode time %llu, expected %llu\n", *nr_frag,
+					(unsigned long long)fi.v_base, (unsigned long long)dts);
+			dts = fi.v_base + fi.v_dur;
+			*audio_bytes += fi.a_bytes;
+			(*nr_frag)++;
+			pos = next;
+			continue;
+		}
+
+		size = rd32(buf + pos);
+		if (is_box(buf + pos, "mfra")) {
+			CHECK(complete, "mfra in an unfinished file\n");
+			CHECK(pos + size == len, "mfra is not the last box\n");
+		} else if (is_box(buf + pos, "free")) {
+			/* moof room of the fragment being written */
+			CHECK(!complete, "stray free box at %zu\n", pos);
+		} else if (is_box(buf + pos, "mdat")) {
+			CHECK(!complete && size == 0, "stray mdat at %zu\n", pos);
+			break;
+		} else {
+			CHECK(0, "unexpected box at %zu\n", pos);
+		}
+		CHECK(size >= 8, "bad box size at %zu\n", pos);
+		pos += size;
+	}
+	CHECK(pos == len || !complete, "%zu trailing bytes\n", len - pos);
+
+	return 0;
+}
+
+/* Every mfra entry must seek to an IDR at the right time */
+static int check_seek(const uint8_t *buf, size_t len, int nr_key)
+{
+	const uint8_t *mfra, *tfra;
+	struct frag_info fi;
+	uint32_t i, count;
+	uint64_t time, offset;
+	size_t next;
+
+	CHECK(len > 16 && is_box(buf + len - 16, "mfro"), "no mfro\n");
+	mfra = buf + len - rd32(buf + len - 4);
+	CHECK(is_box(mfra, "mfra"), "mfro does not point to mfra\n");
+	tfra = mfra + 8;
+	CHECK(is_box(tfra, "tfra") && tfra[8] == 1 && rd32(tfra + 16) == 0,
+			"unexpected tfra layout\n");
+	count = rd32(tfra + 20);
+	CHECK(count == nr_key, "%u index entries for %d IDR frames\n", count, nr_key);
+
+	for (i = 0; i < count; i++) {
+		time = rd64(tfra + 24 + 19 * i);
+		offset = rd64(tfra + 32 + 19 * i);
+		CHECK(offset < len, "entry %u past end of file\n", i);
+		if (parse_fragment(buf, len, offset, NULL, &fi, &next) < 0)
+			return -1;
+		CHECK(fi.v_base == time, "entry %u time %llu, moof has %llu\n", i,
+				(unsigned long long)time, (unsigned long long)fi.v_base);
+		CHECK(fi.v_first_flags == 0x02000000, "entry %u sample is not sync\n", i);
+		CHECK(first_slice_type(fi.v_first, len - (fi.v_first - buf)) == H264_NAL_IDR,
+				"entry %u does not land on an IDR\n", i);
+	}
+
+	return 0;
+}
+
+static uint8_t *map_file(const char *path, size_t *len)
+{
+	struct stat st;
+	uint8_t *buf;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		IMP_LOG_ERR(TAG, "mmap %s failed: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	*len = st.st_size;
+
+	return buf;
+}
+
+static int copy_file(const char *from, const char *to)
+{
+	uint8_t *buf;
+	size_t len;
+	int fd, ret;
+
+	buf = map_file(from, &len);
+	if (buf == NULL)
+		return -1;
+	fd = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	ret = (fd >= 0 && write(fd, buf, len) == (ssize_t)len) ? 0 : -1;
+	if (fd >= 0)
+		close(fd);
+	munmap(buf, len);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *out_path = "/tmp/fmp4-check.mp4";
+	char crash_path[256];
+	int fps = SENSOR_FRAME_RATE_NUM / SENSOR_FRAME_RATE_DEN, max_gop = 0;
+	h264_nal_t nal[MAX_NALS_PER_FRAME];
+	struct iovec iov[MAX_NALS_PER_FRAME];
+	uint8_t audio[AUDIO_FRAME_BYTES];
+	fmp4_mux_attr_t attr;
+	fmp4_mux_stat_t stat;
+	fmp4_mux_t *mux;
+	struct src src;
+	uint8_t *in, *out;
+	size_t in_len, out_len, pos = 0;
+	int64_t ts = 0, audio_ts = 0;
+	uint64_t audio_bytes;
+	int i, n, fd, frames = 0, nr_frag, crash_frag = -1;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <in.h264> [out.mp4] [fps] [max_gop]\n", argv[0]);
+		return -1;
+	}
+	if (argc > 2)
+		out_path = argv[2];
+	if (argc > 3)
+		fps = atoi(argv[3]);
+	if (argc > 4)
+		max_gop = atoi(argv[4]);
+	if (max_gop <= 0)
+		max_gop = 2 * fps;		/* as sample_encoder_init() sets it */
+	snprintf(crash_path, sizeof(crash_path), "%s.crash", out_path);
+
+	in = map_file(argv[1], &in_len);
+	if (in == NULL)
+		return -1;
+
+	fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", out_path, strerror(errno));
+		return -1;
+	}
+
+	memset(&attr, 0, sizeof(attr));
+	attr.width = SENSOR_WIDTH;
+	attr.height = SENSOR_HEIGHT;
+	attr.max_gop = max_gop;
+	attr.audio_type = FMP4_AUDIO_G711A;
+	attr.audio_rate = AUDIO_RATE;
+	mux = fmp4_mux_create(fd, &attr);
+	if (mux == NULL)
+		return -1;
+
+	memset(audio, 0xd5, sizeof(audio));		/* A-law silence */
+	while ((n = h264_next_frame(in, in_len, &pos, nal, MAX_NALS_PER_FRAME)) > 0) {
+		for (i = 0; i < n; i++) {
+			iov[i].iov_base = (void *)nal[i].data;
+			iov[i].iov_len = nal[i].len;
+		}
+		if (fmp4_mux_write_video_iov(mux, iov, n, ts) < 0)
+			return -1;
+		for (; audio_ts <= ts; audio_ts += AUDIO_FRAME_BYTES * 1000000LL / AUDIO_RATE)
+			fmp4_mux_write_audio(mux, audio, sizeof(audio), audio_ts);
+		ts += 1000000 / fps;
+		frames++;
+
+		/* snapshot half way through a GOP, as a crash would leave it */
+		fmp4_mux_get_stat(mux, &stat);
+		if (crash_frag < 0 && stat.fragments >= 2 && !h264_is_key_frame(nal, n)) {
+			crash_frag = stat.fragments;
+			if (copy_file(out_path, crash_path) < 0)
+				return -1;
+		}
+	}
+	fmp4_mux_get_stat(mux, &stat);
+	if (fmp4_mux_close(mux) < 0)
+		return -1;
+	close(fd);
+
+	printf("muxed %d frames: %u video, %u audio, %u skipped, %u audio dropped, "
+			"%llu bytes, max close %lld us\n", frames, stat.video_frames,
+			stat.audio_frames, stat.skipped_frames, stat.dropped_audio,
+			(unsigned long long)stat.bytes, (long long)stat.max_close_us);
+
+	memset(&src, 0, sizeof(src));
+	src.buf = in;
+	src.len = in_len;
+	/* frames before the first IDR are not muxed */
+	for (i = 0; i < stat.skipped_frames; i++)
+		h264_next_frame(in, in_len, &src.pos, nal, MAX_NALS_PER_FRAME);
+	pos = src.pos;
+	while ((n = h264_next_frame(in, in_len, &pos, nal, MAX_NALS_PER_FRAME)) > 0) {
+		for (i = 0; i < n; i++)
+			if (nal[i].type == H264_NAL_IDR)
+				break;
+		src.nr_key += i < n;
+	}
+
+	out = map_file(out_path, &out_len);
+	if (out == NULL)
+		return -1;
+	if (check_file(out, out_len, &src, 1, &nr_frag, &audio_bytes) < 0)
+		return -1;
+	if (src.pos < in_len && h264_next_frame(in, in_len, &src.pos, nal, MAX_NALS_PER_FRAME) > 0) {
+		IMP_LOG_ERR(TAG, "source frames missing from the file\n");
+		return -1;
+	}
+	if (audio_bytes != (uint64_t)stat.audio_frames * AUDIO_FRAME_BYTES) {
+		IMP_LOG_ERR(TAG, "%llu audio bytes in the file, %u frames muxed\n",
+				(unsigned long long)audio_bytes, stat.audio_frames);
+		return -1;
+	}
+	printf("parse: ok, %d fragments, %d IDR frames, %llu audio bytes\n",
+			nr_frag, src.nr_key, (unsigned long long)audio_bytes);
+
+	if (check_seek(out, out_len, src.nr_key) < 0)
+		return -1;
+	printf("seek: ok, all %d index entries land on IDR frames\n", src.nr_key);
+	munmap(out, out_len);
+
+	if (crash_frag > 0) {
+		out = map_file(crash_path, &out_len);
+		if (out == NULL)
+			return -1;
+		if (check_file(out, out_len, NULL, 0, &nr_frag, &audio_bytes) < 0)
+			return -1;
+		if (nr_frag != crash_frag) {
+			IMP_LOG_ERR(TAG, "crash copy: %d fragments, %d were complete\n", nr_frag, crash_frag);
+			return -1;
+		}
+		printf("crash: ok, %d complete fragments readable\n", nr_frag);
+		munmap(out, out_len);
+		unlink(crash_path);
+	}
+
+	munmap(in, in_len);
+
+	return 0;
+}
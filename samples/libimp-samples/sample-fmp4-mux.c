@@ -0,0 +1,896 @@
+/*
+ * sample-fmp4-mux.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-fmp4-mux.h"
+
+#define TAG "Sample-FMP4-Mux"
+
+#define NAL_TYPE_IDR	5
+#define NAL_TYPE_SPS	7
+#define NAL_TYPE_PPS	8
+#define NAL_TYPE_AUD	9
+
+/* trun sample_flags */
+#define SAMPLE_FLAGS_SYNC		0x02000000	/* depends on no other sample */
+#define SAMPLE_FLAGS_NON_SYNC	0x01010000	/* depends on others, non-sync */
+
+#define TRACK_VIDEO		1
+#define TRACK_AUDIO		2
+
+#define INIT_SEGMENT_SIZE	(1024 + 2 * FMP4_MAX_PARAM_SET)
+#define MFRA_CHUNK_ENTRIES	64
+
+struct bbuf {
+	uint8_t		*p;
+	uint32_t	len;
+	uint32_t	size;
+};
+
+struct fmp4_index {
+	uint64_t	time;
+	uint64_t	moof_offset;
+};
+
+struct fmp4_mux {
+	int					fd;
+	fmp4_mux_attr_t		attr;
+	pthread_mutex_t		mutex;
+
+	uint8_t				sps[FMP4_MAX_PARAM_SET];
+	uint8_t				pps[FMP4_MAX_PARAM_SET];
+	uint32_t			sps_len;
+	uint32_t			pps_len;
+
+	int					started;		/* init segment written */
+	int64_t				first_ts;
+	uint64_t			offset;			/* file offset of the next write */
+	uint32_t			seq;
+
+	/* current fragment */
+	int					open;
+	uint64_t			frag_offset;	/* start of the reserved moof room */
+	uint32_t			reserve;		/* bytes of moof room, largest moof + free header */
+	uint64_t			mdat_offset;
+	uint32_t			video_bytes;
+
+	uint32_t			nr_video;
+	uint32_t			*v_size;
+	uint32_t			*v_dur;
+	uint32_t			*v_flags;
+	uint64_t			v_base;			/* decode time of the first sample */
+	uint64_t			v_last_dts;
+
+	uint32_t			nr_audio;
+	uint32_t			*a_size;
+	uint8_t				*a_buf;
+	uint32_t			a_bytes;
+	uint64_t			a_base;
+	uint64_t			a_next_dts;
+	int					a_started;
+	int					a_overflow;
+
+	uint8_t				*moof_buf;
+
+	struct fmp4_index	*index;
+	uint32_t			nr_index;
+
+	fmp4_mux_stat_t		stat;
+};
+
+static void put8(struct bbuf *b, uint32_t v)
+{
+	if (b->len < b->size)
+		b->p[b->len] = v;
+	b->len++;
+}
+
+static void put16(struct bbuf *b, uint32_t v)
+{
+	put8(b, v >> 8);
+	put8(b, v);
+}
+
+static void put32(struct bbuf *b, uint32_t v)
+{
+	put16(b, v >> 16);
+	put16(b, v);
+}
+
+static void put64(struct bbuf *b, uint64_t v)
+{
+	put32(b, v >> 32);
+	put32(b, v);
+}
+
+static void put_tag(struct bbuf *b, const char *tag)
+{
+	put8(b, tag[0]);
+	put8(b, tag[1]);
+	put8(b, tag[2]);
+	put8(b, tag[3]);
+}
+
+static void put_zero(struct bbuf *b, int n)
+{
+	while (n-- > 0)
+		put8(b, 0);
+}
+
+static uint32_t box_open(struct bbuf *b, const char *tag)
+{
+	uint32_t pos = b->len;
+
+	put32(b, 0);
+	put_tag(b, tag);
+
+	return pos;
+}
+
+static uint32_t full_box_open(struct bbuf *b, const char *tag, int version, uint32_t flags)
+{
+	uint32_t pos = box_open(b, tag);
+
+	put32(b, (version << 24) | flags);
+
+	return pos;
+}
+
+static void box_close(struct bbuf *b, uint32_t pos)
+{
+	uint32_t size = b->len - pos;
+
+	if (pos + 4 <= b->size) {
+		b->p[pos] = size >> 24;
+		b->p[pos + 1] = size >> 16;
+		b->p[pos + 2] = size >> 8;
+		b->p[pos + 3] = size;
+	}
+}
+
+static void put_matrix(struct bbuf *b)
+{
+	put32(b, 0x00010000); put32(b, 0); put32(b, 0);
+	put32(b, 0); put32(b, 0x00010000); put32(b, 0);
+	put32(b, 0); put32(b, 0); put32(b, 0x40000000);
+}
+
+static uint32_t moof_max_size(const fmp4_mux_attr_t *attr)
+{
+	/* moof + mfhd, then per traf: traf + tfhd + tfdt(v1) + trun header */
+	uint32_t size = 8 + 16;
+
+	size += 8 + 16 + 20 + 20 + 12 * attr->max_gop;
+	if (attr->audio_type != FMP4_AUDIO_NONE)
+		size += 8 + 16 + 20 + 20 + 8 * attr->audio_max_frames;
+
+	return size;
+}
+
+static int write_all(fmp4_mux_t *mux, struct iovec *iov, int cnt)
+{
+	ssize_t total = 0, ret;
+	int i;
+
+	for (i = 0; i < cnt; i++)
+		total += iov[i].iov_len;
+
+	ret = writev(mux->fd, iov, cnt);
+	if (ret != total) {
+		IMP_LOG_ERR(TAG, "writev error: %s\n", ret < 0 ? strerror(errno) : "short write");
+		return -1;
+	}
+	mux->offset += total;
+	mux->stat.bytes += total;
+
+	return 0;
+}
+
+static int write_at(fmp4_mux_t *mux, const void *buf, size_t len, uint64_t offset)
+{
+	if (pwrite(mux->fd, buf, len, offset) != (ssize_t)len) {
+		IMP_LOG_ERR(TAG, "pwrite error: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+fmp4_mux_t *fmp4_mux_create(int fd, const fmp4_mux_attr_t *attr)
+{
+	fmp4_mux_t *mux;
+
+	if (attr->max_gop == 0) {
+		IMP_LOG_ERR(TAG, "max_gop must not be 0\n");
+		return NULL;
+	}
+
+	mux = calloc(1, sizeof(fmp4_mux_t));
+	if (mux == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+
+	mux->fd = fd;
+	mux->attr = *attr;
+	if (mux->attr.audio_type != FMP4_AUDIO_NONE) {
+		if (mux->attr.audio_rate == 0)
+			mux->attr.audio_rate = 8000;
+		if (mux->attr.audio_buf_size == 0)
+			mux->attr.audio_buf_size = 4 * mux->attr.audio_rate;
+		if (mux->attr.audio_max_frames == 0)
+			mux->attr.audio_max_frames = mux->attr.audio_buf_size / 80;
+	} else {
+		mux->attr.audio_buf_size = 0;
+		mux->attr.audio_max_frames = 0;
+	}
+	if (mux->attr.max_fragments == 0)
+		mux->attr.max_fragments = FMP4_MAX_FRAGMENTS;
+
+	mux->reserve = moof_max_size(&mux->attr) + 8;
+	mux->moof_buf = calloc(1, mux->reserve);
+	mux->v_size = malloc(3 * mux->attr.max_gop * sizeof(uint32_t));
+	mux->index = malloc(mux->attr.max_fragments * sizeof(struct fmp4_index));
+	if (mux->attr.audio_type != FMP4_AUDIO_NONE) {
+		mux->a_size = malloc(mux->attr.audio_max_frames * sizeof(uint32_t));
+		mux->a_buf = malloc(mux->attr.audio_buf_size);
+	}
+	if (mux->moof_buf == NULL || mux->v_size == NULL || mux->index == NULL
+			|| (mux->attr.audio_type != FMP4_AUDIO_NONE && (mux->a_size == NULL || mux->a_buf == NULL))) {
+		IMP_LOG_ERR(TAG, "buffer alloc error !\n");
+		goto err;
+	}
+	mux->v_dur = mux->v_size + mux->attr.max_gop;
+	mux->v_flags = mux->v_dur + mux->attr.max_gop;
+
+	mux->offset = lseek(fd, 0, SEEK_CUR);
+	pthread_mutex_init(&mux->mutex, NULL);
+
+	return mux;
+
+err:
+	free(mux->moof_buf);
+	free(mux->v_size);
+	free(mux->index);
+	free(mux->a_size);
+	free(mux->a_buf);
+	free(mux);
+	return NULL;
+}
+
+static void put_video_trak(fmp4_mux_t *mux, struct bbuf *b)
+{
+	uint32_t trak, mdia, minf, dinf, dref, stbl, stsd, avc1, avcc;
+	uint32_t pos;
+
+	trak = box_open(b, "trak");
+
+	pos = full_box_open(b, "tkhd", 0, 3);
+	put32(b, 0); put32(b, 0);				/* creation, modification time */
+	put32(b, TRACK_VIDEO);
+	put32(b, 0);
+	put32(b, 0);							/* duration, fragments carry it */
+	put_zero(b, 8);
+	put16(b, 0); put16(b, 0);				/* layer, alternate group */
+	put16(b, 0); put16(b, 0);				/* volume, reserved */
+	put_matrix(b);
+	put32(b, mux->attr.width << 16);
+	put32(b, mux->attr.height << 16);
+	box_close(b, pos);
+
+	mdia = box_open(b, "mdia");
+	pos = full_box_open(b, "mdhd", 0, 0);
+	put32(b, 0); put32(b, 0);
+	put32(b, FMP4_VIDEO_TIMESCALE);
+	put32(b, 0);
+	put16(b, 0x55c4);						/* "und" */
+	put16(b, 0);
+	box_close(b, pos);
+
+	pos = full_box_open(b, "hdlr", 0, 0);
+	put32(b, 0);
+	put_tag(b, "vide");
+	put_zero(b, 12);
+	put_tag(b, "Vide"); put_tag(b, "oHan"); put_tag(b, "dler"); put8(b, 0);
+	box_close(b, pos);
+
+	minf = box_open(b, "minf");
+	pos = full_box_open(b, "vmhd", 0, 1);
+	put_zero(b, 8);
+	box_close(b, pos);
+
+	dinf = box_open(b, "dinf");
+	dref = full_box_open(b, "dref", 0, 0);
+	put32(b, 1);
+	pos = full_box_open(b, "url ", 0, 1);
+	box_close(b, pos);
+	box_close(b, dref);
+	box_close(b, dinf);
+
+	stbl = box_open(b, "stbl");
+	stsd = full_box_open(b, "stsd", 0, 0);
+	put32(b, 1);
+	avc1 = box_open(b, "avc1");
+	put_zero(b, 6);
+	put16(b, 1);							/* data reference index */
+	put_zero(b, 16);
+	put16(b, mux->attr.width);
+	put16(b, mux->attr.height);
+	put32(b, 0x00480000); put32(b, 0x00480000);	/* 72 dpi */
+	put32(b, 0);
+	put16(b, 1);							/* frame count */
+	put_zero(b, 32);						/* compressor name */
+	put16(b, 0x0018);
+	put16(b, 0xffff);
+
+	avcc = box_open(b, "avcC");
+	put8(b, 1);
+	put8(b, mux->sps[1]);					/* profile */
+	put8(b, mux->sps[2]);					/* compatibility */
+	put8(b, mux->sps[3]);					/* level */
+	put8(b, 0xff);							/* 4 byte NAL lengths */
+	put8(b, 0xe1);							/* one SPS */
+	put16(b, mux->sps_len);
+	memcpy(b->p + b->len, mux->sps, mux->sps_len);
+	b->len += mux->sps_len;
+	put8(b, 1);								/* one PPS */
+	put16(b, mux->pps_len);
+	memcpy(b->p + b->len, mux->pps, mux->pps_len);
+	b->len += mux->pps_len;
+	box_close(b, avcc);
+	box_close(b, avc1);
+	box_close(b, stsd);
+
+	pos = full_box_open(b, "stts", 0, 0); put32(b, 0); box_close(b, pos);
+	pos = full_box_open(b, "stsc", 0, 0); put32(b, 0); box_close(b, pos);
+	pos = full_box_open(b, "stsz", 0, 0); put32(b, 0); put32(b, 0); box_close(b, pos);
+	pos = full_box_open(b, "stco", 0, 0); put32(b, 0); box_close(b, pos);
+	box_close(b, stbl);
+
+	box_close(b, minf);
+	box_close(b, mdia);
+	box_close(b, trak);
+}
+
+static void put_audio_trak(fmp4_mux_t *mux, struct bbuf *b)
+{
+	uint32_t trak, mdia, minf, dinf, dref, stbl, stsd, entry;
+	uint32_t pos;
+
+	trak = box_open(b, "trak");
+
+	pos = full_box_open(b, "tkhd", 0, 3);
+	put32(b, 0); put32(b, 0);
+	put32(b, TRACK_AUDIO);
+	put32(b, 0);
+	put32(b, 0);
+	put_zero(b, 8);
+	put16(b, 0); put16(b, 0);
+	put16(b, 0x0100); put16(b, 0);			/* full volume */
+	put_matrix(b);
+	put32(b, 0);
+	put32(b, 0);
+	box_close(b, pos);
+
+	mdia = box_open(b, "mdia");
+	pos = full_box_open(b, "mdhd", 0, 0);
+	put32(b, 0); put32(b, 0);
+	put32(b, mux->attr.audio_rate);
+	put32(b, 0);
+	put16(b, 0x55c4);
+	put16(b, 0);
+	box_close(b, pos);
+
+	pos = full_box_open(b, "hdlr", 0, 0);
+	put32(b, 0);
+	put_tag(b, "soun");
+	put_zero(b, 12);
+	put_tag(b, "Soun"); put_tag(b, "dHan"); put_tag(b, "dler"); put8(b, 0);
+	box_close(b, pos);
+
+	minf = box_open(b, "minf");
+	pos = full_box_open(b, "smhd", 0, 0);
+	put32(b, 0);
+	box_close(b, pos);
+
+	dinf = box_open(b, "dinf");
+	dref = full_box_open(b, "dref", 0, 0);
+	put32(b, 1);
+	pos = full_box_open(b, "url ", 0, 1);
+	box_close(b, pos);
+	box_close(b, dref);
+	box_close(b, dinf);
+
+	stbl = box_open(b, "stbl");
+	stsd = full_box_open(b, "stsd", 0, 0);
+	put32(b, 1);
+	entry = box_open(b, mux->attr.audio_type == FMP4_AUDIO_G711A ? "alaw" : "ulaw");
+	put_zero(b, 6);
+	put16(b, 1);
+	put_zero(b, 8);
+	put16(b, 1);							/* mono */
+	put16(b, 16);							/* sample size, as ISO requires */
+	put32(b, 0);
+	put32(b, mux->attr.audio_rate << 16);
+	box_close(b, entry);
+	box_close(b, stsd);
+
+	pos = full_box_open(b, "stts", 0, 0); put32(b, 0); box_close(b, pos);
+	pos = full_box_open(b, "stsc", 0, 0); put32(b, 0); box_close(b, pos);
+	pos = full_box_open(b, "stsz", 0, 0); put32(b, 0); put32(b, 0); box_close(b, pos);
+	pos = full_box_open(b, "stco", 0, 0); put32(b, 0); box_close(b, pos);
+	box_close(b, stbl);
+
+	box_close(b, minf);
+	box_close(b, mdia);
+	box_close(b, trak);
+}
+
+static void put_trex(struct bbuf *b, uint32_t track)
+{
+	uint32_t pos = full_box_open(b, "trex", 0, 0);
+
+	put32(b, track);
+	put32(b, 1);							/* sample description index */
+	put32(b, 0);
+	put32(b, 0);
+	put32(b, 0);
+	box_close(b, pos);
+}
+
+static int write_init_segment(fmp4_mux_t *mux)
+{
+	uint8_t buf[INIT_SEGMENT_SIZE];
+	struct bbuf b = { buf, 0, sizeof(buf) };
+	struct iovec iov;
+	uint32_t moov, mvex, pos;
+
+	pos = box_open(&b, "ftyp");
+	put_tag(&b, "isom");
+	put32(&b, 0x200);
+	put_tag(&b, "isom");
+	put_tag(&b, "iso6");
+	put_tag(&b, "avc1");
+	put_tag(&b, "mp41");
+	box_close(&b, pos);
+
+	moov = box_open(&b, "moov");
+	pos = full_box_open(&b, "mvhd", 0, 0);
+	put32(&b, 0); put32(&b, 0);
+	put32(&b, 1000);
+	put32(&b, 0);
+	put32(&b, 0x00010000);					/* rate 1.0 */
+	put16(&b, 0x0100);						/* volume 1.0 */
+	put_zero(&b, 10);
+	put_matrix(&b);
+	put_zero(&b, 24);
+	put32(&b, mux->attr.audio_type != FMP4_AUDIO_NONE ? TRACK_AUDIO + 1 : TRACK_VIDEO + 1);
+	box_close(&b, pos);
+
+	put_video_trak(mux, &b);
+	if (mux->attr.audio_type != FMP4_AUDIO_NONE)
+		put_audio_trak(mux, &b);
+
+	mvex = box_open(&b, "mvex");
+	put_trex(&b, TRACK_VIDEO);
+	if (mux->attr.audio_type != FMP4_AUDIO_NONE)
+		put_trex(&b, TRACK_AUDIO);
+	box_close(&b, mvex);
+	box_close(&b, moov);
+
+	if (b.len > b.size) {
+		IMP_LOG_ERR(TAG, "init segment overflow (%u > %u)\n", b.len, b.size);
+		return -1;
+	}
+
+	iov.iov_base = buf;
+	iov.iov_len = b.len;
+
+	return write_all(mux, &iov, 1);
+}
+
+/* Reserve the moof room, covered by a 'free' box, and open an mdat running to EOF */
+static int open_fragment(fmp4_mux_t *mux)
+{
+	uint8_t hdr[16];
+	struct iovec iov[3];
+
+	mux->frag_offset = mux->offset;
+	mux->mdat_offset = mux->offset + mux->reserve;
+
+	hdr[0] = mux->reserve >> 24;
+	hdr[1] = mux->reserve >> 16;
+	hdr[2] = mux->reserve >> 8;
+	hdr[3] = mux->reserve;
+	memcpy(hdr + 4, "free", 4);
+	memset(hdr + 8, 0, 4);					/* size 0: up to the end of file */
+	memcpy(hdr + 12, "mdat", 4);
+
+	memset(mux->moof_buf, 0, mux->reserve);
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = 8;
+	iov[1].iov_base = mux->moof_buf;
+	iov[1].iov_len = mux->reserve - 8;
+	iov[2].iov_base = hdr + 8;
+	iov[2].iov_len = 8;
+	if (write_all(mux, iov, 3) < 0)
+		return -1;
+
+	mux->open = 1;
+	mux->nr_video = 0;
+	mux->video_bytes = 0;
+	mux->nr_audio = 0;
+	mux->a_bytes = 0;
+	mux->a_overflow = 0;
+
+	return 0;
+}
+
+static void put_traf_header(struct bbuf *b, uint32_t track, uint64_t base)
+{
+	uint32_t pos;
+
+	pos = full_box_open(b, "tfhd", 0, 0x020000);	/* default-base-is-moof */
+	put32(b, track);
+	box_close(b, pos);
+
+	pos = full_box_open(b, "tfdt", 1, 0);
+	put64(b, base);
+	box_close(b, pos);
+}
+
+/* last_dur: duration of the last video sample */
+static int close_fragment(fmp4_mux_t *mux, uint32_t last_dur)
+{
+	struct bbuf b = { mux->moof_buf, 0, mux->reserve };
+	struct iovec iov;
+	uint32_t moof, traf, trun, mdat_size, i;
+	uint8_t hdr[4];
+	int64_t start = IMP_System_GetTimeStamp();
+
+	mux->open = 0;
+	mux->v_dur[mux->nr_video - 1] = last_dur;
+
+	/* audio goes right behind the video of the same mdat */
+	if (mux->a_bytes) {
+		iov.iov_base = mux->a_buf;
+		iov.iov_len = mux->a_bytes;
+		if (write_all(mux, &iov, 1) < 0)
+			return -1;
+	}
+
+	mdat_size = 8 + mux->video_bytes + mux->a_bytes;
+	hdr[0] = mdat_size >> 24;
+	hdr[1] = mdat_size >> 16;
+	hdr[2] = mdat_size >> 8;
+	hdr[3] = mdat_size;
+	if (write_at(mux, hdr, 4, mux->mdat_offset) < 0)
+		return -1;
+
+	moof = box_open(&b, "moof");
+	i = full_box_open(&b, "mfhd", 0, 0);
+	put32(&b, ++mux->seq);
+	box_close(&b, i);
+
+	traf = box_open(&b, "traf");
+	put_traf_header(&b, TRACK_VIDEO, mux->v_base);
+	trun = full_box_open(&b, "trun", 0, 0x000701);	/* offset, duration, size, flags */
+	put32(&b, mux->nr_video);
+	put32(&b, mux->mdat_offset + 8 - mux->frag_offset);
+	for (i = 0; i < mux->nr_video; i++) {
+		put32(&b, mux->v_dur[i]);
+		put32(&b, mux->v_size[i]);
+		put32(&b, mux->v_flags[i]);
+	}
+	box_close(&b, trun);
+	box_close(&b, traf);
+
+	if (mux->nr_audio) {
+		traf = box_open(&b, "traf");
+		put_traf_header(&b, TRACK_AUDIO, mux->a_base);
+		trun = full_box_open(&b, "trun", 0, 0x000301);	/* offset, duration, size */
+		put32(&b, mux->nr_audio);
+		put32(&b, mux->mdat_offset + 8 + mux->video_bytes - mux->frag_offset);
+		for (i = 0; i < mux->nr_audio; i++) {
+			put32(&b, mux->a_size[i]);		/* G.711: one byte per sample */
+			put32(&b, mux->a_size[i]);
+		}
+		box_close(&b, trun);
+		box_close(&b, traf);
+	}
+	box_close(&b, moof);
+
+	/* the rest of the reserved room stays skippable */
+	i = box_open(&b, "free");
+	b.len = mux->reserve;
+	box_close(&b, i);
+
+	if (write_at(mux, mux->moof_buf, mux->reserve, mux->frag_offset) < 0)
+		return -1;
+
+	if (mux->v_flags[0] == SAMPLE_FLAGS_SYNC && mux->nr_index < mux->attr.max_fragments) {
+		mux->index[mux->nr_index].time = mux->v_base;
+		mux->index[mux->nr_index].moof_offset = mux->frag_offset;
+		mux->nr_index++;
+	}
+
+	mux->stat.fragments++;
+	if (IMP_System_GetTimeStamp() - start > mux->stat.max_close_us)
+		mux->stat.max_close_us = IMP_System_GetTimeStamp() - start;
+
+	return 0;
+}
+
+static int nal_start_code_len(const uint8_t *p, size_t len)
+{
+	if (len >= 4 && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1)
+		return 4;
+	if (len >= 3 && p[0] == 0 && p[1] == 0 && p[2] == 1)
+		return 3;
+
+	return 0;
+}
+
+static void save_param_set(uint8_t *dst, uint32_t *dst_len, const uint8_t *nal, uint32_t len)
+{
+	if (len > FMP4_MAX_PARAM_SET) {
+		IMP_LOG_WARN(TAG, "parameter set of %u bytes ignored\n", len);
+		return;
+	}
+	memcpy(dst, nal, len);
+	*dst_len = len;
+}
+
+static int write_video_locked(fmp4_mux_t *mux, const struct iovec *nal, int nr_nal,
+		int64_t timestamp)
+{
+	struct iovec iov[2 * FMP4_MAX_NALS];
+	uint8_t len_hdr[FMP4_MAX_NALS][4];
+	const uint8_t *p;
+	uint32_t len, bytes = 0;
+	uint64_t dts;
+	int i, sc, type, cnt = 0, key = 0;
+
+	if (nr_nal > FMP4_MAX_NALS) {
+		IMP_LOG_ERR(TAG, "frame with %d NALs, at most %d\n", nr_nal, FMP4_MAX_NALS);
+		return -1;
+	}
+
+	/* Parameter sets go to avcC, NALs get 4 byte length prefixes */
+	for (i = 0; i < nr_nal; i++) {
+		p = nal[i].iov_base;
+		sc = nal_start_code_len(p, nal[i].iov_len);
+		p += sc;
+		len = nal[i].iov_len - sc;
+		if (len == 0)
+			continue;
+
+		type = p[0] & 0x1f;
+		if (type == NAL_TYPE_SPS) {
+			save_param_set(mux->sps, &mux->sps_len, p, len);
+			continue;
+		} else if (type == NAL_TYPE_PPS) {
+			save_param_set(mux->pps, &mux->pps_len, p, len);
+			continue;
+		} else if (type == NAL_TYPE_AUD) {
+			continue;
+		} else if (type == NAL_TYPE_IDR) {
+			key = 1;
+		}
+
+		len_hdr[i][0] = len >> 24;
+		len_hdr[i][1] = len >> 16;
+		len_hdr[i][2] = len >> 8;
+		len_hdr[i][3] = len;
+		iov[cnt].iov_base = len_hdr[i];
+		iov[cnt].iov_len = 4;
+		iov[cnt + 1].iov_base = (void *)p;
+		iov[cnt + 1].iov_len = len;
+		cnt += 2;
+		bytes += 4 + len;
+	}
+
+	if (cnt == 0)
+		return 0;
+
+	if (!mux->started) {
+		if (!key || mux->sps_len < 4 || mux->pps_len == 0) {
+			mux->stat.skipped_frames++;
+			return 0;
+		}
+		if (write_init_segment(mux) < 0)
+			return -1;
+		mux->started = 1;
+		mux->first_ts = timestamp;
+	}
+
+	dts = timestamp > mux->first_ts ? (uint64_t)(timestamp - mux->first_ts) * 9 / 100 : 0;
+	if (dts <= mux->v_last_dts && mux->stat.video_frames)
+		dts = mux->v_last_dts + 1;
+
+	if (mux->open && (key || mux->nr_video == mux->attr.max_gop)) {
+		if (close_fragment(mux, dts - mux->v_last_dts) < 0)
+			return -1;
+	}
+	if (!mux->open) {
+		if (open_fragment(mux) < 0)
+			return -1;
+		mux->v_base = dts;
+	} else {
+		mux->v_dur[mux->nr_video - 1] = dts - mux->v_last_dts;
+	}
+
+	if (write_all(mux, iov, cnt) < 0)
+		return -1;
+
+	mux->v_size[mux->nr_video] = bytes;
+	mux->v_flags[mux->nr_video] = key ? SAMPLE_FLAGS_SYNC : SAMPLE_FLAGS_NON_SYNC;
+	mux->nr_video++;
+	mux->video_bytes += bytes;
+	mux->v_last_dts = dts;
+	mux->stat.video_frames++;
+
+	return 0;
+}
+
+int fmp4_mux_write_video_iov(fmp4_mux_t *mux, const struct iovec *nal, int nr_nal,
+		int64_t timestamp)
+{
+	int ret;
+
+	pthread_mutex_lock(&mux->mutex);
+	ret = write_video_locked(mux, nal, nr_nal, timestamp);
+	pthread_mutex_unlock(&mux->mutex);
+
+	return ret;
+}
+
+int fmp4_mux_write_video(fmp4_mux_t *mux, IMPEncoderStream *stream)
+{
+	struct iovec iov[FMP4_MAX_NALS];
+	int i;
+
+	if (stream->packCount > FMP4_MAX_NALS) {
+		IMP_LOG_ERR(TAG, "stream with %d packs, at most %d\n", stream->packCount, FMP4_MAX_NALS);
+		return -1;
+	}
+
+	for (i = 0; i < stream->packCount; i++) {
+		iov[i].iov_base = (void *)(uintptr_t)stream->pack[i].virAddr;
+		iov[i].iov_len = stream->pack[i].length;
+	}
+
+	return fmp4_mux_write_video_iov(mux, iov, stream->packCount, stream->pack[0].timestamp);
+}
+
+int fmp4_mux_write_audio(fmp4_mux_t *mux, const uint8_t *data, int len, int64_t timestamp)
+{
+	if (mux->attr.audio_type == FMP4_AUDIO_NONE || len <= 0)
+		return 0;
+
+	pthread_mutex_lock(&mux->mutex);
+
+	/* audio starts with the first fragment */
+	if (!mux->open || timestamp < mux->first_ts) {
+		pthread_mutex_unlock(&mux->mutex);
+		return 0;
+	}
+
+	if (!mux->a_started) {
+		mux->a_next_dts = (uint64_t)(timestamp - mux->first_ts) * mux->attr.audio_rate / 1000000;
+		mux->a_started = 1;
+	}
+
+	if (mux->a_overflow || mux->nr_audio == mux->attr.audio_max_frames
+			|| mux->a_bytes + len > mux->attr.audio_buf_size) {
+		/* keep the timeline, the gap shows up in the next tfdt */
+		mux->a_overflow = 1;
+		mux->a_next_dts += len;
+		mux->stat.dropped_audio++;
+		pthread_mutex_unlock(&mux->mutex);
+		return 1;
+	}
+
+	if (mux->nr_audio == 0)
+		mux->a_base = mux->a_next_dts;
+	memcpy(mux->a_buf + mux->a_bytes, data, len);
+	mux->a_size[mux->nr_audio++] = len;
+	mux->a_bytes += len;
+	mux->a_next_dts += len;
+	mux->stat.audio_frames++;
+
+	pthread_mutex_unlock(&mux->mutex);
+
+	return 0;
+}
+
+static int write_mfra(fmp4_mux_t *mux)
+{
+	uint8_t buf[16 + 32 + MFRA_CHUNK_ENTRIES * 19];
+	struct bbuf b = { buf, 0, sizeof(buf) };
+	uint32_t mfra_size, tfra_size, i;
+	struct iovec iov;
+
+	/* tfra v1: 8 byte time and offset, 1 byte traf/trun/sample numbers */
+	tfra_size = 12 + 12 + mux->nr_index * 19;
+	mfra_size = 8 + tfra_size + 16;
+
+	put32(&b, mfra_size);
+	put_tag(&b, "mfra");
+	put32(&b, tfra_size);
+	put_tag(&b, "tfra");
+	put32(&b, 1 << 24);
+	put32(&b, TRACK_VIDEO);
+	put32(&b, 0);
+	put32(&b, mux->nr_index);
+
+	for (i = 0; i < mux->nr_index; i++) {
+		put64(&b, mux->index[i].time);
+		put64(&b, mux->index[i].moof_offset);
+		put8(&b, 1);						/* traf */
+		put8(&b, 1);						/* trun */
+		put8(&b, 1);						/* sample */
+		if (b.len + 19 > b.size) {
+			iov.iov_base = buf;
+			iov.iov_len = b.len;
+			if (write_all(mux, &iov, 1) < 0)
+				return -1;
+			b.len = 0;
+		}
+	}
+
+	i = full_box_open(&b, "mfro", 0, 0);
+	put32(&b, mfra_size);
+	box_close(&b, i);
+
+	iov.iov_base = buf;
+	iov.iov_len = b.len;
+
+	return write_all(mux, &iov, 1);
+}
+
+int fmp4_mux_close(fmp4_mux_t *mux)
+{
+	uint32_t last_dur;
+	int ret = 0;
+
+	pthread_mutex_lock(&mux->mutex);
+	if (mux->open) {
+		/* repeat the previous frame duration for the last one */
+		last_dur = mux->nr_video > 1 ? mux->v_dur[mux->nr_video - 2] : FMP4_VIDEO_TIMESCALE / 25;
+		ret = close_fragment(mux, last_dur);
+	}
+	if (ret == 0 && mux->started)
+		ret = write_mfra(mux);
+	pthread_mutex_unlock(&mux->mutex);
+
+	pthread_mutex_destroy(&mux->mutex);
+	free(mux->moof_buf);
+	free(mux->v_size);
+	free(mux->index);
+	free(mux->a_size);
+	free(mux->a_buf);
+	free(mux);
+
+	return ret;
+}
+
+void fmp4_mux_get_stat(fmp4_mux_t *mux, fmp4_mux_stat_t *stat)
+{
+	pthread_mutex_lock(&mux->mutex);
+	*stat = mux->stat;
+	pthread_mutex_unlock(&mux->mutex);
+}
@@ -0,0 +1,99 @@
+/*
+ * sample-fmp4-mux.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_FMP4_MUX_H__
+#define __SAMPLE_FMP4_MUX_H__
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <imp/imp_encoder.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Streaming fragmented MP4 muxer for H264 with optional G.711 audio.
+ *
+ * The init segment (ftyp + moov) is written at the first IDR, then every
+ * GOP becomes one moof + mdat fragment starting with its IDR. Frame data
+ * goes to the file as it arrives; room for the moof is reserved at the
+ * start of the fragment and filled in when the GOP closes, the unused
+ * tail of it becomes a 'free' box. Until then the fragment is a 'free'
+ * box followed by an open-ended mdat, so a file cut short by a crash
+ * still parses up to the last complete GOP. close() appends an mfra
+ * index of all IDR fragments for seeking.
+ *
+ * All buffers are sized at create time from max_gop, nothing is allocated
+ * per frame. Audio of a fragment is held in memory and written behind
+ * the video of the same fragment.
+ *
+ * The muxer is locked internally, video and audio may come from
+ * different threads.
+ */
+
+#define FMP4_VIDEO_TIMESCALE	90000
+#define FMP4_MAX_NALS			16		/* NALs (packs) per video frame */
+#define FMP4_MAX_PARAM_SET		256		/* SPS/PPS bytes */
+#define FMP4_MAX_FRAGMENTS		4096	/* default mfra entries */
+
+typedef enum {
+	FMP4_AUDIO_NONE,
+	FMP4_AUDIO_G711A,
+	FMP4_AUDIO_G711U,
+} fmp4_audio_type_t;
+
+typedef struct fmp4_mux_attr {
+	uint16_t			width;
+	uint16_t			height;
+	uint32_t			max_gop;			/* frames per fragment, attrH264Cbr.maxGop */
+	fmp4_audio_type_t	audio_type;
+	uint32_t			audio_rate;			/* Hz, 8000 if 0 */
+	uint32_t			audio_buf_size;		/* audio bytes per fragment, 0: 4s worth */
+	uint32_t			audio_max_frames;	/* audio frames per fragment, 0: buf_size / 80 */
+	uint32_t			max_fragments;		/* mfra entries, 0: FMP4_MAX_FRAGMENTS */
+} fmp4_mux_attr_t;
+
+typedef struct fmp4_mux_stat {
+	uint32_t	fragments;
+	uint32_t	video_frames;
+	uint32_t	audio_frames;
+	uint32_t	skipped_frames;		/* video before the first IDR */
+	uint32_t	dropped_audio;		/* audio that did not fit its fragment */
+	uint64_t	bytes;
+	int64_t		max_close_us;		/* longest fragment close */
+} fmp4_mux_stat_t;
+
+/* fd must be positioned at the start of the file and stay open until close */
+typedef struct fmp4_mux fmp4_mux_t;
+
+fmp4_mux_t *fmp4_mux_create(int fd, const fmp4_mux_attr_t *attr);
+
+/* Finish the last fragment, append the mfra index and free the muxer. fd is not closed. */
+int fmp4_mux_close(fmp4_mux_t *mux);
+
+/* One H264 frame, one NAL per pack with start code; timestamp from the first pack */
+int fmp4_mux_write_video(fmp4_mux_t *mux, IMPEncoderStream *stream);
+
+/* Same from memory, one iovec per NAL, start code optional; timestamp in us */
+int fmp4_mux_write_video_iov(fmp4_mux_t *mux, const struct iovec *nal, int nr_nal,
+		int64_t timestamp);
+
+/* One G.711 frame as returned by IMP_AENC_GetStream(); timestamp in us */
+int fmp4_mux_write_audio(fmp4_mux_t *mux, const uint8_t *data, int len, int64_t timestamp);
+
+void fmp4_mux_get_stat(fmp4_mux_t *mux, fmp4_mux_stat_t *stat);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_FMP4_MUX_H__ */
@@ -0,0 +1,240 @@
+/*
+ * sample-frame-hub-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check for the FrameSource frame hub. Frames are published by hand
+ * and this file stands in for IMP_FrameSource_ReleaseFrame(), so every
+ * release is counted: each frame must go back exactly once, and only
+ * after its last reader is done or its hold time ran out. Covers several
+ * readers on one frame, a queue of one keeping only the newest frame, a
+ * reader taken back after its max hold while another still reads, a
+ * stale handle on a slot that was reused, and a pool held full.
+ *
+ * usage: sample-frame-hub-check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_framesource.h>
+
+#include "sample-frame-hub.h"
+
+#define TAG "Sample-Frame-Hub-Check"
+
+#define NR_FRAMES		64
+#define FS_CHN			1
+
+static IMPFrameInfo frames[NR_FRAMES];
+static int released[NR_FRAMES];
+static int nr_published;
+static int errors;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		IMP_LOG_ERR(TAG, "line %d: %s\n", __LINE__, #cond); \
+		errors++; \
+	} \
+} while (0)
+
+int IMP_FrameSource_ReleaseFrame(int chnNum, IMPFrameInfo *frame)
+{
+	int i = frame - frames;
+
+	if (chnNum != FS_CHN || i < 0 || i >= nr_published) {
+		IMP_LOG_ERR(TAG, "release of a frame never published\n");
+		errors++;
+		return -1;
+	}
+	if (released[i]++)
+		IMP_LOG_ERR(TAG, "frame %d released twice\n", i), errors++;
+
+	return 0;
+}
+
+static int publish(frame_hub_t *hub)
+{
+	IMPFrameInfo *frame = &frames[nr_published];
+
+	frame->index = nr_published;
+	frame->virAddr = 0x10000000 + nr_published * 0x1000;
+	frame->phyAddr = 0x20000000 + nr_published * 0x1000;
+	frame->size = 640 * 360 * 3 / 2;
+	nr_published++;
+
+	return frame_hub_publish(hub, frame);
+}
+
+static int nr_released(void)
+{
+	int i, n = 0;
+
+	for (i = 0; i < nr_published; i++)
+		n += released[i];
+
+	return n;
+}
+
+/* Three readers share every frame, it goes back after the last put */
+static void check_shared(void)
+{
+	frame_hub_t *hub = frame_hub_create(FS_CHN, 3);
+	frame_hub_sub_t *sub[3];
+	frame_hub_ref_t ref[3];
+	int i, first = nr_published;
+
+	sub[0] = frame_hub_subscribe(hub, "snap", 1, 0);
+	sub[1] = frame_hub_subscribe(hub, "analytics", 2, 0);
+	sub[2] = frame_hub_subscribe(hub, "preview", 1, 0);
+
+	CHECK(publish(hub) == 0);
+	for (i = 0; i < 3; i++) {
+		CHECK(frame_hub_get(sub[i], &ref[i], 0) == 0);
+		CHECK(ref[i].info.virAddr == frames[first].virAddr);
+		CHECK(ref[i].info.phyAddr == frames[first].phyAddr);
+		CHECK(ref[i].deadline == 0);
+	}
+	CHECK(frame_hub_put(sub[0], &ref[0]) == 0);
+	CHECK(frame_hub_put(sub[2], &ref[2]) == 0);
+	CHECK(!released[first]);
+	CHECK(frame_hub_put(sub[1], &ref[1]) == 0);
+	CHECK(released[first] == 1);
+
+	/* a frame with no reader goes back at once */
+	for (i = 0; i < 3; i++)
+		frame_hub_unsubscribe(sub[i]);
+	CHECK(publish(hub) == 0);
+	CHECK(released[nr_published - 1] == 1);
+
+	frame_hub_destroy(hub);
+}
+
+/* A queue of one keeps the newest frame, the older ones go back unseen */
+static void check_newest(void)
+{
+	frame_hub_t *hub = frame_hub_create(FS_CHN, 3);
+	frame_hub_sub_t *sub = frame_hub_subscribe(hub, "preview", 1, 0);
+	frame_hub_sub_stat_t stat;
+	frame_hub_ref_t ref;
+	int i, first = nr_published;
+
+	for (i = 0; i < 5; i++)
+		CHECK(publish(hub) == 0);
+	for (i = 0; i < 4; i++)
+		CHECK(released[first + i] == 1);
+	CHECK(frame_hub_get(sub, &ref, 0) == 0);
+	CHECK(ref.info.index == first + 4);
+	CHECK(frame_hub_get(sub, &ref, 10) < 0);
+	frame_hub_get_sub_stat(sub, &stat);
+	CHECK(stat.dropped == 4 && stat.frames == 1 && stat.held == 1);
+
+	frame_hub_unsubscribe(sub);
+	CHECK(released[first + 4] == 1);
+	frame_hub_destroy(hub);
+}
+
+/*
+ * A reader past its max hold loses the frame while another still has it;
+ * its handle stays stale after the slot is reused.
+ */
+static void check_max_hold(void)
+{
+	frame_hub_t *hub = frame_hub_create(FS_CHN, 2);
+	frame_hub_sub_t *slow = frame_hub_subscribe(hub, "slow", 1, 20);
+	frame_hub_sub_t *snap = frame_hub_subscribe(hub, "snap", 1, 0);
+	frame_hub_sub_stat_t stat;
+	frame_hub_ref_t old, ref, snap_ref;
+	int first = nr_published;
+
+	CHECK(publish(hub) == 0);
+	CHECK(frame_hub_get(slow, &old, 0) == 0);
+	CHECK(old.deadline > 0);
+	CHECK(frame_hub_get(snap, &snap_ref, 0) == 0);
+
+	usleep(40000);
+	frame_hub_reap(hub);
+	frame_hub_get_sub_stat(slow, &stat);
+	CHECK(stat.revoked == 1 && stat.held == 0);
+	/* still read by snap */
+	CHECK(!released[first]);
+	CHECK(frame_hub_put(snap, &snap_ref) == 0);
+	CHECK(released[first] == 1);
+
+	/* the slot of the old frame comes back with a new one */
+	CHECK(publish(hub) == 0);
+	CHECK(frame_hub_get(slow, &ref, 0) == 0);
+	CHECK(ref.slot == old.slot && ref.seq != old.seq);
+	CHECK(frame_hub_put(slow, &old) < 0);
+	CHECK(!released[first + 1]);
+	CHECK(frame_hub_get(snap, &snap_ref, 0) == 0);
+	CHECK(frame_hub_put(snap, &snap_ref) == 0);
+	CHECK(!released[first + 1]);
+	CHECK(frame_hub_put(slow, &ref) == 0);
+	CHECK(released[first + 1] == 1);
+
+	frame_hub_unsubscribe(slow);
+	frame_hub_unsubscribe(snap);
+	frame_hub_destroy(hub);
+}
+
+/* Queued frames are reclaimed first, a pool held full loses the new frame */
+static void check_full(void)
+{
+	frame_hub_t *hub = frame_hub_create(FS_CHN, 2);
+	frame_hub_sub_t *hog = frame_hub_subscribe(hub, "hog", 2, 0);
+	frame_hub_sub_t *lazy = frame_hub_subscribe(hub, "lazy", 2, 0);
+	frame_hub_stat_t stat;
+	frame_hub_ref_t ref[2];
+	int first = nr_published;
+
+	CHECK(publish(hub) == 0);
+	CHECK(publish(hub) == 0);
+	CHECK(frame_hub_get(hog, &ref[0], 0) == 0);
+	/*
+	 * Oldest queued first: lazy's frame 0 (hog reads it), then both
+	 * queued copies of frame 1, which frees its slot for frame 2.
+	 */
+	CHECK(publish(hub) == 0);
+	CHECK(released[first + 1] == 1 && !released[first]);
+	frame_hub_get_stat(hub, &stat);
+	CHECK(stat.reclaimed == 3);
+
+	CHECK(frame_hub_get(hog, &ref[1], 0) == 0);
+	CHECK(ref[1].info.index == first + 2);
+	frame_hub_unsubscribe(lazy);
+	frame_hub_get_stat(hub, &stat);
+	CHECK(stat.in_flight == 2);
+	/* both slots held by hog, the new frame goes straight back */
+	CHECK(publish(hub) < 0);
+	CHECK(released[nr_published - 1] == 1);
+	frame_hub_get_stat(hub, &stat);
+	CHECK(stat.full == 1);
+
+	CHECK(frame_hub_put(hog, &ref[0]) == 0);
+	CHECK(frame_hub_put(hog, &ref[1]) == 0);
+	CHECK(released[first] == 1 && released[first + 2] == 1);
+	frame_hub_unsubscribe(hog);
+	frame_hub_destroy(hub);
+}
+
+int main(int argc, char *argv[])
+{
+	check_shared();
+	check_newest();
+	check_max_hold();
+	check_full();
+
+	/* every frame back exactly once */
+	CHECK(nr_released() == nr_published);
+	printf("%d frames published, %d released\n", nr_published, nr_released());
+
+	if (errors)
+		return -1;
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,564 @@
+/*
+ * sample-frame-hub.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_framesource.h>
+
+#include "sample-frame-hub.h"
+
+#define TAG "Sample-Frame-Hub"
+
+/* How long the hub thread sleeps on a full pool before it looks at the deadlines again */
+#define HUB_FULL_WAIT_MS	10
+
+struct hub_frame {
+	IMPFrameInfo		*imp;		/* as GetFrame returned it, for ReleaseFrame */
+	IMPFrameInfo		info;
+	uint32_t			seq;
+	int					ref;
+	int					busy;
+};
+
+struct held_frame {
+	struct hub_frame	*frame;
+	uint32_t			seq;
+	int64_t				t_get;
+};
+
+struct frame_hub_sub {
+	frame_hub_t			*hub;
+	char				name[32];
+	int64_t				max_hold_us;
+
+	struct hub_frame	**queue;
+	int					queue_len;
+	int					q_head;
+	int					q_count;
+
+	struct held_frame	*held;		/* hub->max_frames entries */
+	pthread_cond_t		cond;
+	frame_hub_sub_stat_t stat;
+};
+
+struct frame_hub {
+	int					fsChn;
+
+	struct hub_frame	*slot;
+	int					max_frames;
+	int					nr_inflight;
+	uint32_t			seq;
+
+	frame_hub_sub_t		*sub[FRAME_HUB_MAX_SUBSCRIBERS];
+
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;		/* a slot came free */
+	pthread_t			tid;
+	int					depth_set;
+	int					running;
+	int					stop;
+	frame_hub_stat_t	stat;
+};
+
+/* Called with hub->mutex held */
+static void frame_unref(frame_hub_t *hub, struct hub_frame *frame)
+{
+	if (--frame->ref > 0)
+		return;
+
+	if (IMP_FrameSource_ReleaseFrame(hub->fsChn, frame->imp) < 0)
+		IMP_LOG_ERR(TAG, "IMP_FrameSource_ReleaseFrame(%d) frame %u failed\n", hub->fsChn, frame->seq);
+	frame->busy = 0;
+	hub->nr_inflight--;
+	pthread_cond_signal(&hub->cond);
+}
+
+static struct hub_frame *sub_pop(frame_hub_sub_t *sub)
+{
+	struct hub_frame *frame = sub->queue[sub->q_head];
+
+	sub->q_head = (sub->q_head + 1) % sub->queue_len;
+	sub->q_count--;
+
+	return frame;
+}
+
+static void sub_drop_head(frame_hub_sub_t *sub)
+{
+	sub->stat.dropped++;
+	frame_unref(sub->hub, sub_pop(sub));
+}
+
+/* Called with hub->mutex held */
+static void hub_reap(frame_hub_t *hub, int64_t now)
+{
+	frame_hub_sub_t *sub;
+	int i, n;
+
+	for (i = 0; i < FRAME_HUB_MAX_SUBSCRIBERS; i++) {
+		sub = hub->sub[i];
+		if (sub == NULL || sub->max_hold_us == 0)
+			continue;
+		for (n = 0; n < hub->max_frames; n++) {
+			if (sub->held[n].frame == NULL || now - sub->held[n].t_get <= sub->max_hold_us)
+				continue;
+			if (sub->stat.revoked++ == 0)
+				IMP_LOG_WARN(TAG, "%s: frame %u held %lld us, taken back\n", sub->name,
+						sub->held[n].seq, (long long)(now - sub->held[n].t_get));
+			frame_unref(hub, sub->held[n].frame);
+			sub->held[n].frame = NULL;
+		}
+	}
+}
+
+/*
+ * Called with hub->mutex held. Frees a slot by dropping the oldest frame
+ * nobody has started on yet, -1 if every slot is held by a subscriber.
+ */
+static int hub_reclaim(frame_hub_t *hub)
+{
+	frame_hub_sub_t *oldest;
+	int i;
+
+	while (hub->nr_inflight == hub->max_frames) {
+		oldest = NULL;
+		for (i = 0; i < FRAME_HUB_MAX_SUBSCRIBERS; i++) {
+			if (hub->sub[i] && hub->sub[i]->q_count && (oldest == NULL
+						|| hub->sub[i]->queue[hub->sub[i]->q_head]->seq
+						< oldest->queue[oldest->q_head]->seq))
+				oldest = hub->sub[i];
+		}
+		if (oldest == NULL)
+			return -1;
+		sub_drop_head(oldest);
+		hub->stat.reclaimed++;
+	}
+
+	return 0;
+}
+
+static void sub_deliver(frame_hub_sub_t *sub, struct hub_frame *frame)
+{
+	/* The newest frame is worth more than the oldest queued one */
+	if (sub->q_count == sub->queue_len)
+		sub_drop_head(sub);
+
+	frame->ref++;
+	sub->queue[(sub->q_head + sub->q_count) % sub->queue_len] = frame;
+	sub->q_count++;
+	if (sub->q_count > sub->stat.max_queued)
+		sub->stat.max_queued = sub->q_count;
+	pthread_cond_signal(&sub->cond);
+}
+
+int frame_hub_publish(frame_hub_t *hub, IMPFrameInfo *imp)
+{
+	struct hub_frame *frame = NULL;
+	int i;
+
+	pthread_mutex_lock(&hub->mutex);
+	hub_reap(hub, IMP_System_GetTimeStamp());
+	if (hub_reclaim(hub) < 0) {
+		/* Every slot is held by a subscriber, the frame is lost for all */
+		IMP_FrameSource_ReleaseFrame(hub->fsChn, imp);
+		hub->stat.full++;
+		pthread_mutex_unlock(&hub->mutex);
+		return -1;
+	}
+
+	for (i = 0; i < hub->max_frames; i++) {
+		if (!hub->slot[i].busy) {
+			frame = &hub->slot[i];
+			break;
+		}
+	}
+	frame->imp = imp;
+	frame->info = *imp;
+	frame->seq = hub->seq++;
+	frame->ref = 1;
+	frame->busy = 1;
+	hub->nr_inflight++;
+	hub->stat.frames++;
+	if (hub->nr_inflight > hub->stat.max_in_flight)
+		hub->stat.max_in_flight = hub->nr_inflight;
+
+	for (i = 0; i < FRAME_HUB_MAX_SUBSCRIBERS; i++) {
+		if (hub->sub[i])
+			sub_deliver(hub->sub[i], frame);
+	}
+
+	/* Drop the hub's own reference, releases at once if nobody took it */
+	frame_unref(hub, frame);
+	pthread_mutex_unlock(&hub->mutex);
+
+	return 0;
+}
+
+void frame_hub_reap(frame_hub_t *hub)
+{
+	pthread_mutex_lock(&hub->mutex);
+	hub_reap(hub, IMP_System_GetTimeStamp());
+	pthread_mutex_unlock(&hub->mutex);
+}
+
+/* Wait for a free slot, taking frames back meanwhile; 0 when one is free */
+static int hub_wait_slot(frame_hub_t *hub)
+{
+	struct timespec ts;
+	int full = 0;
+
+	pthread_mutex_lock(&hub->mutex);
+	for (;;) {
+		hub_reap(hub, IMP_System_GetTimeStamp());
+		if (hub->stop || hub_reclaim(hub) == 0)
+			break;
+		if (!full++)
+			hub->stat.full++;
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += HUB_FULL_WAIT_MS * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&hub->cond, &hub->mutex, &ts);
+	}
+	pthread_mutex_unlock(&hub->mutex);
+
+	return hub->stop ? -1 : 0;
+}
+
+static void *hub_thread(void *arg)
+{
+	frame_hub_t *hub = (frame_hub_t *)arg;
+	IMPFrameInfo *frame;
+	int ret;
+
+	while (!hub->stop) {
+		/* Never ask for more frames than the depth leaves the hub */
+		if (hub_wait_slot(hub) < 0)
+			break;
+
+		ret = IMP_FrameSource_GetFrame(hub->fsChn, &frame);
+		if (ret < 0) {
+			IMP_LOG_ERR(TAG, "IMP_FrameSource_GetFrame(%d) failed\n", hub->fsChn);
+			continue;
+		}
+
+		frame_hub_publish(hub, frame);
+	}
+
+	return NULL;
+}
+
+frame_hub_t *frame_hub_create(int fsChn, int max_frames)
+{
+	frame_hub_t *hub;
+
+	hub = calloc(1, sizeof(frame_hub_t));
+	if (hub == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+
+	hub->fsChn = fsChn;
+	hub->max_frames = max_frames > 0 ? max_frames : FRAME_HUB_MAX_FRAMES;
+	hub->slot = calloc(hub->max_frames, sizeof(struct hub_frame));
+	if (hub->slot == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() slots error !\n");
+		free(hub);
+		return NULL;
+	}
+
+	pthread_mutex_init(&hub->mutex, NULL);
+	pthread_cond_init(&hub->cond, NULL);
+
+	return hub;
+}
+
+int frame_hub_start(frame_hub_t *hub)
+{
+	int ret;
+
+	ret = IMP_FrameSource_SetFrameDepth(hub->fsChn, hub->max_frames);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_FrameSource_SetFrameDepth(%d, %d) failed\n", hub->fsChn, hub->max_frames);
+		return -1;
+	}
+	hub->depth_set = 1;
+
+	hub->stop = 0;
+	if (pthread_create(&hub->tid, NULL, hub_thread, hub)) {
+		IMP_LOG_ERR(TAG, "create hub thread failed\n");
+		IMP_FrameSource_SetFrameDepth(hub->fsChn, 0);
+		hub->depth_set = 0;
+		return -1;
+	}
+	hub->running = 1;
+
+	return 0;
+}
+
+int frame_hub_stop(frame_hub_t *hub)
+{
+	int i;
+
+	if (!hub->running)
+		return 0;
+
+	pthread_mutex_lock(&hub->mutex);
+	hub->stop = 1;
+	pthread_cond_broadcast(&hub->cond);
+	pthread_mutex_unlock(&hub->mutex);
+	pthread_join(hub->tid, NULL);
+	hub->running = 0;
+
+	pthread_mutex_lock(&hub->mutex);
+	for (i = 0; i < FRAME_HUB_MAX_SUBSCRIBERS; i++) {
+		if (hub->sub[i])
+			pthread_cond_broadcast(&hub->sub[i]->cond);
+	}
+	pthread_mutex_unlock(&hub->mutex);
+
+	return 0;
+}
+
+int frame_hub_destroy(frame_hub_t *hub)
+{
+	int i;
+
+	frame_hub_stop(hub);
+
+	for (i = 0; i < FRAME_HUB_MAX_SUBSCRIBERS; i++) {
+		if (hub->sub[i])
+			frame_hub_unsubscribe(hub->sub[i]);
+	}
+
+	if (hub->nr_inflight)
+		IMP_LOG_ERR(TAG, "fs%d: %d frames still held at destroy\n", hub->fsChn, hub->nr_inflight);
+	for (i = 0; i < hub->max_frames; i++) {
+		if (hub->slot[i].busy)
+			IMP_FrameSource_ReleaseFrame(hub->fsChn, hub->slot[i].imp);
+	}
+
+	/* The frames the FrameSource kept for the hub go back to the pool */
+	if (hub->depth_set)
+		IMP_FrameSource_SetFrameDepth(hub->fsChn, 0);
+
+	pthread_cond_destroy(&hub->cond);
+	pthread_mutex_destroy(&hub->mutex);
+	free(hub->slot);
+	free(hub);
+
+	return 0;
+}
+
+frame_hub_sub_t *frame_hub_subscribe(frame_hub_t *hub, const char *name,
+		int queue_len, int max_hold_ms)
+{
+	frame_hub_sub_t *sub;
+	int i;
+
+	if (queue_len <= 0 || queue_len > hub->max_frames)
+		queue_len = hub->max_frames;
+
+	sub = calloc(1, sizeof(frame_hub_sub_t));
+	if (sub == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+	sub->queue = calloc(queue_len, sizeof(struct hub_frame *));
+	sub->held = calloc(hub->max_frames, sizeof(struct held_frame));
+	if (sub->queue == NULL || sub->held == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() queue error !\n");
+		goto err_calloc;
+	}
+
+	sub->hub = hub;
+	snprintf(sub->name, sizeof(sub->name), "%s", name);
+	sub->queue_len = queue_len;
+	sub->max_hold_us = max_hold_ms > 0 ? (int64_t)max_hold_ms * 1000 : 0;
+	pthread_cond_init(&sub->cond, NULL);
+
+	pthread_mutex_lock(&hub->mutex);
+	for (i = 0; i < FRAME_HUB_MAX_SUBSCRIBERS; i++) {
+		if (hub->sub[i] == NULL) {
+			hub->sub[i] = sub;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&hub->mutex);
+
+	if (i == FRAME_HUB_MAX_SUBSCRIBERS) {
+		IMP_LOG_ERR(TAG, "fs%d: too many subscribers\n", hub->fsChn);
+		pthread_cond_destroy(&sub->cond);
+		goto err_calloc;
+	}
+
+	return sub;
+
+err_calloc:
+	free(sub->held);
+	free(sub->queue);
+	free(sub);
+	return NULL;
+}
+
+void frame_hub_unsubscribe(frame_hub_sub_t *sub)
+{
+	frame_hub_t *hub = sub->hub;
+	int i;
+
+	pthread_mutex_lock(&hub->mutex);
+	for (i = 0; i < FRAME_HUB_MAX_SUBSCRIBERS; i++) {
+		if (hub->sub[i] == sub)
+			hub->sub[i] = NULL;
+	}
+	while (sub->q_count)
+		frame_unref(hub, sub_pop(sub));
+	for (i = 0; i < hub->max_frames; i++) {
+		if (sub->held[i].frame) {
+			IMP_LOG_WARN(TAG, "%s: frame %u not put before unsubscribe\n",
+					sub->name, sub->held[i].seq);
+			frame_unref(hub, sub->held[i].frame);
+		}
+	}
+	pthread_mutex_unlock(&hub->mutex);
+
+	pthread_cond_destroy(&sub->cond);
+	free(sub->held);
+	free(sub->queue);
+	free(sub);
+}
+
+int frame_hub_get(frame_hub_sub_t *sub, frame_hub_ref_t *ref, int timeout_ms)
+{
+	frame_hub_t *hub = sub->hub;
+	struct hub_frame *frame;
+	struct timespec ts;
+	int i, ret = 0;
+
+	if (timeout_ms >= 0) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += timeout_ms / 1000;
+		ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock(&hub->mutex);
+	while (sub->q_count == 0 && !hub->stop && ret != ETIMEDOUT) {
+		if (timeout_ms >= 0)
+			ret = pthread_cond_timedwait(&sub->cond, &hub->mutex, &ts);
+		else
+			pthread_cond_wait(&sub->cond, &hub->mutex);
+	}
+
+	if (sub->q_count == 0) {
+		pthread_mutex_unlock(&hub->mutex);
+		return -1;
+	}
+
+	frame = sub_pop(sub);
+	/* a subscriber cannot hold more frames than the hub has */
+	for (i = 0; sub->held[i].frame; i++)
+		;
+	sub->held[i].frame = frame;
+	sub->held[i].seq = frame->seq;
+	sub->held[i].t_get = IMP_System_GetTimeStamp();
+	sub->stat.frames++;
+
+	ref->info = frame->info;
+	ref->seq = frame->seq;
+	ref->deadline = sub->max_hold_us ? sub->held[i].t_get + sub->max_hold_us : 0;
+	ref->slot = frame;
+	pthread_mutex_unlock(&hub->mutex);
+
+	return 0;
+}
+
+int frame_hub_put(frame_hub_sub_t *sub, frame_hub_ref_t *ref)
+{
+	frame_hub_t *hub = sub->hub;
+	int64_t hold;
+	int i, ret = -1;
+
+	pthread_mutex_lock(&hub->mutex);
+	for (i = 0; i < hub->max_frames; i++) {
+		if (sub->held[i].frame == ref->slot && sub->held[i].seq == ref->seq) {
+			hold = IMP_System_GetTimeStamp() - sub->held[i].t_get;
+			if (hold > sub->stat.max_hold_us)
+				sub->stat.max_hold_us = hold;
+			frame_unref(hub, sub->held[i].frame);
+			sub->held[i].frame = NULL;
+			ret = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&hub->mutex);
+	ref->slot = NULL;
+
+	return ret;
+}
+
+static int sub_nr_held(frame_hub_sub_t *sub)
+{
+	int i, n = 0;
+
+	for (i = 0; i < sub->hub->max_frames; i++) {
+		if (sub->held[i].frame)
+			n++;
+	}
+
+	return n;
+}
+
+void frame_hub_get_stat(frame_hub_t *hub, frame_hub_stat_t *stat)
+{
+	pthread_mutex_lock(&hub->mutex);
+	*stat = hub->stat;
+	stat->in_flight = hub->nr_inflight;
+	pthread_mutex_unlock(&hub->mutex);
+}
+
+void frame_hub_get_sub_stat(frame_hub_sub_t *sub, frame_hub_sub_stat_t *stat)
+{
+	pthread_mutex_lock(&sub->hub->mutex);
+	*stat = sub->stat;
+	stat->queued = sub->q_count;
+	stat->held = sub_nr_held(sub);
+	pthread_mutex_unlock(&sub->hub->mutex);
+}
+
+void frame_hub_dump_stat(frame_hub_t *hub)
+{
+	int i;
+
+	pthread_mutex_lock(&hub->mutex);
+	IMP_LOG_INFO(TAG, "fs%d: %u frames, %u reclaimed, %u times full, %d in flight (max %u of %d)\n",
+			hub->fsChn, hub->stat.frames, hub->stat.reclaimed, hub->stat.full,
+			hub->nr_inflight, hub->stat.max_in_flight, hub->max_frames);
+	for (i = 0; i < FRAME_HUB_MAX_SUBSCRIBERS; i++) {
+		frame_hub_sub_t *sub = hub->sub[i];
+		if (sub == NULL)
+			continue;
+		IMP_LOG_INFO(TAG, "  %s: %u frames, %u dropped, %d queued (max %u of %d), %d held, "
+				"max hold %lld of %lld us, %u taken back\n",
+				sub->name, sub->stat.frames, sub->stat.dropped, sub->q_count,
+				sub->stat.max_queued, sub->queue_len, sub_nr_held(sub),
+				(long long)sub->stat.max_hold_us, (long long)sub->max_hold_us, sub->stat.revoked);
+	}
+	pthread_mutex_unlock(&hub->mutex);
+}
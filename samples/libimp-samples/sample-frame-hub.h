@@ -0,0 +1,118 @@
+/*
+ * sample-frame-hub.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_FRAME_HUB_H__
+#define __SAMPLE_FRAME_HUB_H__
+
+#include <stdint.h>
+#include <imp/imp_common.h>
+#include <imp/imp_framesource.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * FrameSource frame hub.
+ *
+ * Gets every frame of one FrameSource channel once, with
+ * IMP_FrameSource_GetFrame(), and shares it read-only among any number
+ * of subscribers (raw snapshots, analytics, a local preview...) instead
+ * of each of them copying the picture out. Each frame carries a
+ * reference count and goes back with IMP_FrameSource_ReleaseFrame() when
+ * the last subscriber has put it. Unlike encoder streams, frames may go
+ * back in any order.
+ *
+ * A subscriber owns a bounded queue that drops its oldest frame when
+ * full, so a queue of one always yields the newest frame. It also has a
+ * maximum hold time: a frame it keeps longer is taken back and returned
+ * to the pool, so one stuck subscriber cannot starve the channel of
+ * buffers. The picture of a frame taken back may be overwritten at any
+ * moment; frame_hub_put() tells the subscriber, which must then throw
+ * away whatever it made from it.
+ */
+
+#define FRAME_HUB_MAX_FRAMES		3	/* default frames held at once */
+#define FRAME_HUB_MAX_SUBSCRIBERS	8
+
+typedef struct frame_hub frame_hub_t;
+typedef struct frame_hub_sub frame_hub_sub_t;
+
+/* A subscriber's handle on a frame, from frame_hub_get() to frame_hub_put() */
+typedef struct frame_hub_ref {
+	IMPFrameInfo	info;			/* virAddr/phyAddr point into the FrameSource pool */
+	uint32_t		seq;			/* hub sequence number */
+	int64_t			deadline;		/* taken back after this, IMP_System_GetTimeStamp(); 0: never */
+
+	/* private */
+	void			*slot;
+} frame_hub_ref_t;
+
+typedef struct frame_hub_sub_stat {
+	uint32_t	frames;				/* frames delivered */
+	uint32_t	dropped;			/* queued frames replaced by newer ones */
+	uint32_t	queued;				/* frames waiting now */
+	uint32_t	max_queued;			/* high-water mark */
+	uint32_t	held;				/* frames got and not put now */
+	int64_t		max_hold_us;		/* longest get -> put interval */
+	uint32_t	revoked;			/* frames taken back after max_hold */
+} frame_hub_sub_stat_t;
+
+typedef struct frame_hub_stat {
+	uint32_t	frames;				/* frames taken from the FrameSource */
+	uint32_t	reclaimed;			/* queued frames dropped to get a slot back */
+	uint32_t	full;				/* times every slot was held by a subscriber */
+	uint32_t	in_flight;			/* frames held now */
+	uint32_t	max_in_flight;		/* high-water mark */
+} frame_hub_stat_t;
+
+/*
+ * max_frames bounds how many frames the hub keeps at once, it becomes
+ * the channel's frame depth and comes out of its nrVBs.
+ */
+frame_hub_t *frame_hub_create(int fsChn, int max_frames);
+int frame_hub_destroy(frame_hub_t *hub);
+
+/* Run the GetFrame loop in a thread of the hub, the channel must be on */
+int frame_hub_start(frame_hub_t *hub);
+int frame_hub_stop(frame_hub_t *hub);
+
+/*
+ * Hand a frame obtained elsewhere to the hub, which then owns it and
+ * releases it. Returns -1 if the frame had to be released right away.
+ */
+int frame_hub_publish(frame_hub_t *hub, IMPFrameInfo *frame);
+
+/* Take back frames held past their deadline, the hub thread does it every frame */
+void frame_hub_reap(frame_hub_t *hub);
+
+/* max_hold_ms 0: no limit */
+frame_hub_sub_t *frame_hub_subscribe(frame_hub_t *hub, const char *name,
+		int queue_len, int max_hold_ms);
+void frame_hub_unsubscribe(frame_hub_sub_t *sub);
+
+/*
+ * Wait up to timeout_ms (-1 forever) for the next frame. Returns -1 on
+ * timeout or when the hub stops. Every frame got must be given back with
+ * frame_hub_put(), which returns -1 if the hub had taken it back already.
+ */
+int frame_hub_get(frame_hub_sub_t *sub, frame_hub_ref_t *ref, int timeout_ms);
+int frame_hub_put(frame_hub_sub_t *sub, frame_hub_ref_t *ref);
+
+void frame_hub_get_stat(frame_hub_t *hub, frame_hub_stat_t *stat);
+void frame_hub_get_sub_stat(frame_hub_sub_t *sub, frame_hub_sub_stat_t *stat);
+void frame_hub_dump_stat(frame_hub_t *hub);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_FRAME_HUB_H__ */
@@ -0,0 +1,213 @@
+/*
+ * sample-h264-index-build.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host tool for the sidecar seek index: builds <file>.idx for a .h264
+ * file recorded without one, by scanning it for start codes (SSE2 on
+ * x86). When the file already has an index, e.g. written by the stream
+ * writer at record time, the scan is compared against it instead.
+ * Either way the index is then opened with mmap() and every entry and a
+ * binary search for every frame time are checked.
+ *
+ * Timestamps of a rebuilt index are the frame number at fps, a raw
+ * .h264 file does not carry the capture time.
+ *
+ * usage: sample-h264-index-build [-f] [-r fps] <in.h264>
+ *   -f  rebuild even if an index exists
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+
+#include "sample-common.h"
+#include "sample-h264-parse.h"
+#include "sample-h264-index.h"
+
+#define TAG "Sample-H264-Index-Build"
+
+#define MAX_NALS_PER_FRAME	16
+
+static uint8_t *map_file(const char *path, size_t *len)
+{
+	struct stat st;
+	uint8_t *buf;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		IMP_LOG_ERR(TAG, "mmap %s failed: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	*len = st.st_size;
+
+	return buf;
+}
+
+/* One entry per key frame, as the stream writer records them */
+static h264_index_entry_t *scan(const uint8_t *buf, size_t len, int fps, uint32_t *count,
+		uint32_t *frames)
+{
+	h264_nal_t nal[MAX_NALS_PER_FRAME];
+	h264_index_entry_t *entry = NULL;
+	uint32_t n = 0, size = 0, bytes;
+	size_t pos = 0;
+	int i, nr;
+
+	*frames = 0;
+	while ((nr = h264_next_frame(buf, len, &pos, nal, MAX_NALS_PER_FRAME)) > 0) {
+		if (h264_is_key_frame(nal, nr)) {
+			if (n == size) {
+				size = size ? size * 2 : 256;
+				entry = realloc(entry, size * sizeof(*entry));
+			}
+			for (i = 0, bytes = 0; i < nr; i++)
+				bytes += nal[i].len;
+			entry[n].offset = nal[0].data - buf;
+			entry[n].timestamp = (int64_t)*frames * 1000000 / fps;
+			entry[n].size = bytes;
+			entry[n].type = nal[0].type;
+			n++;
+		}
+		(*frames)++;
+	}
+	*count = n;
+
+	return entry;
+}
+
+static int check_index(const char *path, const uint8_t *buf, size_t len)
+{
+	h264_index_t idx;
+	const h264_index_entry_t *e;
+	int64_t t;
+	uint32_t i;
+	int sc_len, hit;
+
+	if (h264_index_open(&idx, path) < 0)
+		return -1;
+
+	for (i = 0; i < idx.count; i++) {
+		e = &idx.entry[i];
+		if (e->offset + e->size > len || h264_find_start_code(buf, len, e->offset, &sc_len) != e->offset
+				|| H264_NAL_TYPE(buf[e->offset + sc_len]) != e->type
+				|| (e->type != H264_NAL_SPS && e->type != H264_NAL_IDR)) {
+			IMP_LOG_ERR(TAG, "entry %u at %llu is not a key frame\n", i, (unsigned long long)e->offset);
+			goto err;
+		}
+		if (i && e->timestamp < idx.entry[i - 1].timestamp) {
+			IMP_LOG_ERR(TAG, "entry %u goes back in time\n", i);
+			goto err;
+		}
+	}
+
+	/* every point in time must land on the IDR at or just before it */
+	for (i = 0; i < idx.count; i++) {
+		for (t = idx.entry[i].timestamp - 1; t <= idx.entry[i].timestamp + 1; t++) {
+			hit = h264_index_find(&idx, t);
+			if (t < idx.entry[0].timestamp ? hit != 0 :
+					(idx.entry[hit].timestamp > t
+					 || (hit + 1 < (int)idx.count && idx.entry[hit + 1].timestamp <= t))) {
+				IMP_LOG_ERR(TAG, "seek to %lld found entry %d\n", (long long)t, hit);
+				goto err;
+			}
+		}
+	}
+
+	printf("%s: %u entries, seek ok\n", path, idx.count);
+	h264_index_close(&idx);
+	return 0;
+
+err:
+	h264_index_close(&idx);
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	int fps = SENSOR_FRAME_RATE_NUM / SENSOR_FRAME_RATE_DEN, force = 0, opt, fd, sc_len;
+	h264_index_entry_t *entry;
+	h264_index_t idx;
+	char path[512];
+	uint8_t *buf;
+	size_t len, pos;
+	uint32_t i, count, frames, nr_sc = 0;
+	int64_t t0, t1;
+
+	while ((opt = getopt(argc, argv, "fr:")) != -1) {
+		switch (opt) {
+		case 'f':
+			force = 1;
+			break;
+		case 'r':
+			fps = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind >= argc || fps <= 0)
+		goto usage;
+
+	buf = map_file(argv[optind], &len);
+	if (buf == NULL)
+		return -1;
+	snprintf(path, sizeof(path), "%s%s", argv[optind], H264_INDEX_SUFFIX);
+
+	t0 = IMP_System_GetTimeStamp();
+	for (pos = h264_find_start_code(buf, len, 0, &sc_len); pos < len;
+			pos = h264_find_start_code(buf, len, pos + sc_len, &sc_len))
+		nr_sc++;
+	t1 = IMP_System_GetTimeStamp();
+	printf("%zu bytes, %u start codes, scanned in %lld us (%.0f MB/s)\n", len, nr_sc,
+			(long long)(t1 - t0), t1 > t0 ? (double)len / (t1 - t0) : 0.0);
+
+	entry = scan(buf, len, fps, &count, &frames);
+	printf("%u frames, %u key frames\n", frames, count);
+
+	if (!force && access(path, F_OK) == 0) {
+		/* recorded index: same frames, the timestamps are the real ones */
+		if (h264_index_open(&idx, path) < 0)
+			return -1;
+		for (i = 0; i < count && i < idx.count; i++) {
+			if (idx.entry[i].offset != entry[i].offset || idx.entry[i].size != entry[i].size
+					|| idx.entry[i].type != entry[i].type)
+				break;
+		}
+		if (i != count || idx.count != count) {
+			IMP_LOG_ERR(TAG, "%s differs from the scan at entry %u (%u recorded)\n",
+					path, i, idx.count);
+			return -1;
+		}
+		h264_index_close(&idx);
+		printf("%s matches the scan\n", path);
+	} else {
+		fd = h264_index_create(path);
+		if (fd < 0 || (count && h264_index_append(fd, entry, count) < 0))
+			return -1;
+		close(fd);
+		printf("%s written\n", path);
+	}
+	free(entry);
+
+	return check_index(path, buf, len);
+
+usage:
+	fprintf(stderr, "usage: %s [-f] [-r fps] <in.h264>\n", argv[0]);
+	return -1;
+}
@@ -0,0 +1,124 @@
+/*
+ * sample-h264-index.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <imp/imp_log.h>
+
+#include "sample-h264-index.h"
+
+#define TAG "Sample-H264-Index"
+
+int h264_index_create(const char *path)
+{
+	h264_index_header_t hdr;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+	if (fd < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, H264_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.entry_size = sizeof(h264_index_entry_t);
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		IMP_LOG_ERR(TAG, "write %s failed: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int h264_index_append(int fd, const h264_index_entry_t *entry, int count)
+{
+	ssize_t len = count * sizeof(h264_index_entry_t);
+
+	if (write(fd, entry, len) != len) {
+		IMP_LOG_ERR(TAG, "index write error: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+int h264_index_open(h264_index_t *idx, const char *path)
+{
+	const h264_index_header_t *hdr;
+	struct stat st;
+	int fd;
+
+	memset(idx, 0, sizeof(*idx));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(h264_index_header_t)) {
+		IMP_LOG_ERR(TAG, "%s: no index header\n", path);
+		close(fd);
+		return -1;
+	}
+
+	idx->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (idx->map == MAP_FAILED) {
+		IMP_LOG_ERR(TAG, "mmap %s failed: %s\n", path, strerror(errno));
+		idx->map = NULL;
+		return -1;
+	}
+	idx->map_len = st.st_size;
+
+	hdr = idx->map;
+	if (memcmp(hdr->magic, H264_INDEX_MAGIC, sizeof(hdr->magic))
+			|| hdr->entry_size != sizeof(h264_index_entry_t)) {
+		IMP_LOG_ERR(TAG, "%s: not an index of this format\n", path);
+		h264_index_close(idx);
+		return -1;
+	}
+
+	idx->entry = (const h264_index_entry_t *)(hdr + 1);
+	idx->count = (st.st_size - sizeof(*hdr)) / sizeof(h264_index_entry_t);
+
+	return 0;
+}
+
+void h264_index_close(h264_index_t *idx)
+{
+	if (idx->map)
+		munmap(idx->map, idx->map_len);
+	memset(idx, 0, sizeof(*idx));
+}
+
+int h264_index_find(const h264_index_t *idx, int64_t timestamp)
+{
+	uint32_t lo = 0, hi = idx->count, mid;
+
+	if (idx->count == 0)
+		return -1;
+
+	/* first entry after timestamp */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (idx->entry[mid].timestamp <= timestamp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo ? lo - 1 : 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * sample-h264-index.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_H264_INDEX_H__
+#define __SAMPLE_H264_INDEX_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Sidecar seek index for recorded .h264 files, <file>.idx.
+ *
+ * A 16 byte header followed by one fixed size entry per IDR, in file
+ * order, so timestamps ascend and the entries can be searched in place
+ * after mmap(). The recorder appends an entry once the frame is on the
+ * card; a torn last entry after a power cut is ignored on open.
+ *
+ * Fields are in the byte order of the writer, little endian on the
+ * T10/T20 and on x86 hosts.
+ */
+
+#define H264_INDEX_MAGIC		"H264IDX1"
+#define H264_INDEX_SUFFIX		".idx"
+
+typedef struct h264_index_header {
+	char		magic[8];
+	uint32_t	entry_size;		/* sizeof(h264_index_entry_t) */
+	uint32_t	reserved;
+} h264_index_header_t;
+
+typedef struct h264_index_entry {
+	uint64_t	offset;			/* first byte of the frame, its SPS if it has one */
+	int64_t		timestamp;		/* IMP_System_GetTimeStamp() of the frame, us */
+	uint32_t	size;			/* frame bytes */
+	uint32_t	type;			/* NAL type the frame starts with, SPS or IDR slice */
+} h264_index_entry_t;
+
+typedef struct h264_index {
+	const h264_index_entry_t	*entry;
+	uint32_t					count;
+
+	/* private */
+	void						*map;
+	size_t						map_len;
+} h264_index_t;
+
+/* Create or truncate an index file and write its header. Returns the fd. */
+int h264_index_create(const char *path);
+int h264_index_append(int fd, const h264_index_entry_t *entry, int count);
+
+int h264_index_open(h264_index_t *idx, const char *path);
+void h264_index_close(h264_index_t *idx);
+
+/*
+ * Binary search for the entry to start decoding from to show timestamp:
+ * the last IDR at or before it, the first one if timestamp is earlier.
+ * Returns -1 for an empty index.
+ */
+int h264_index_find(const h264_index_t *idx, int64_t timestamp);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_H264_INDEX_H__ */
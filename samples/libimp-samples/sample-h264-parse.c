@@ -0,0 +1,118 @@
+/*
+ * sample-h264-parse.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "sample-h264-parse.h"
+
+#ifdef __SSE2__
+/*
+ * 16 candidate positions per step: a start code begins at i where
+ * buf[i] == 0, buf[i + 1] == 0 and buf[i + 2] == 1, three unaligned
+ * loads compared at once.
+ */
+static size_t find_00_00_01(const uint8_t *buf, size_t len, size_t pos)
+{
+	const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+	__m128i m;
+	int mask;
+
+	for (; pos + 18 <= len; pos += 16) {
+		m = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + pos)), zero),
+				_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + pos + 1)), zero));
+		m = _mm_and_si128(m,
+				_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + pos + 2)), one));
+		mask = _mm_movemask_epi8(m);
+		if (mask)
+			return pos + __builtin_ctz(mask);
+	}
+
+	return pos;
+}
+#endif
+
+size_t h264_find_start_code(const uint8_t *buf, size_t len, size_t pos, int *sc_len)
+{
+	const uint8_t *p;
+
+#ifdef __SSE2__
+	pos = find_00_00_01(buf, len, pos);
+#endif
+	/* word at a time memchr() for the tail, or all of it without SSE2 */
+	while (pos + 3 <= len) {
+		p = memchr(buf + pos + 2, 0x01, len - pos - 2);
+		if (p == NULL)
+			break;
+		pos = p - buf - 2;
+		if (buf[pos] == 0 && buf[pos + 1] == 0) {
+			if (pos > 0 && buf[pos - 1] == 0) {
+				*sc_len = 4;
+				return pos - 1;
+			}
+			*sc_len = 3;
+			return pos;
+		}
+		pos++;
+	}
+
+	*sc_len = 0;
+	return len;
+}
+
+int h264_next_frame(const uint8_t *buf, size_t len, size_t *pos,
+		h264_nal_t *nal, int max_nals)
+{
+	size_t start, next;
+	int sc_len, next_sc_len, type, n = 0;
+
+	start = h264_find_start_code(buf, len, *pos, &sc_len);
+	while (start < len && n < max_nals) {
+		next = h264_find_start_code(buf, len, start + sc_len, &next_sc_len);
+		type = start + sc_len < len ? H264_NAL_TYPE(buf[start + sc_len]) : 0;
+
+		nal[n].data = buf + start;
+		nal[n].len = next - start;
+		nal[n].sc_len = sc_len;
+		nal[n].type = type;
+		n++;
+
+		start = next;
+		sc_len = next_sc_len;
+		if (type >= H264_NAL_SLICE && type <= H264_NAL_IDR)
+			break;
+	}
+	*pos = start;
+
+	return n;
+}
+
+int h264_is_key_frame(const h264_nal_t *nal, int nr_nal)
+{
+	int i;
+
+	for (i = 0; i < nr_nal; i++) {
+		if (nal[i].type == H264_NAL_IDR || nal[i].type == H264_NAL_SPS)
+			return 1;
+	}
+
+	return 0;
+}
+
+int h264_stream_is_key_frame(const IMPEncoderStream *stream)
+{
+	int i;
+
+	for (i = 0; i < stream->packCount; i++) {
+		IMPEncoderH264NaluType type = stream->pack[i].dataType.h264Type;
+		if (type == IMP_H264_NAL_SLICE_IDR || type == IMP_H264_NAL_SPS)
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * sample-h264-parse.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_H264_PARSE_H__
+#define __SAMPLE_H264_PARSE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <imp/imp_encoder.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Minimal Annex-B helpers, used to replay recorded .h264 files through
+ * the stream code paths as if they came from IMP_Encoder_GetStream().
+ */
+
+#define H264_NAL_TYPE(b)	((b) & 0x1f)
+
+#define H264_NAL_SLICE		1
+#define H264_NAL_IDR		5
+#define H264_NAL_SEI		6
+#define H264_NAL_SPS		7
+#define H264_NAL_PPS		8
+#define H264_NAL_AUD		9
+
+typedef struct h264_nal {
+	const uint8_t	*data;		/* start code included */
+	uint32_t		len;
+	int				sc_len;		/* 3 or 4 */
+	int				type;
+} h264_nal_t;
+
+/*
+ * Return the offset of the next 00 00 01 start code at or after pos, the
+ * leading zero of a 4-byte start code included. *sc_len gets 3 or 4.
+ * Returns len if there is none.
+ */
+size_t h264_find_start_code(const uint8_t *buf, size_t len, size_t pos, int *sc_len);
+
+/*
+ * Split the next access unit starting at *pos into NALs, the way the
+ * encoder hands them out as packs. A frame ends with its first VCL NAL.
+ * Returns the number of NALs, 0 at the end of buffer.
+ */
+int h264_next_frame(const uint8_t *buf, size_t len, size_t *pos,
+		h264_nal_t *nal, int max_nals);
+
+/* 1 if any NAL of the frame is an IDR slice or an SPS */
+int h264_is_key_frame(const h264_nal_t *nal, int nr_nal);
+
+/* The same for an encoder stream, from the packs' NAL types */
+int h264_stream_is_key_frame(const IMPEncoderStream *stream);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_H264_PARSE_H__ */
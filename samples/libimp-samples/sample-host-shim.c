@@ -0,0 +1,67 @@
+/*
+ * sample-host-shim.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Stand-ins for the few libimp symbols the stream helpers use, so they
+ * can be linked into tools and benchmarks that run on the build host.
+ * Never link this into a device binary.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_framesource.h>
+
+static int host_log_level = -1;
+
+void imp_log_fun(int le, int op, int out, const char *tag, const char *file,
+		int line, const char *func, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (host_log_level < 0) {
+		const char *env = getenv("SAMPLE_HOST_LOG_LEVEL");
+		host_log_level = env ? atoi(env) : IMP_LOG_LEVEL_INFO;
+	}
+	if (le < host_log_level)
+		return;
+
+	fprintf(stderr, "[%s] ", tag);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+int IMP_Log_Get_Option(void)
+{
+	return IMP_LOG_OP_DEFAULT;
+}
+
+int64_t IMP_System_GetTimeStamp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* No FrameSource on the host, weak so a check can bring its own */
+__attribute__((weak)) int IMP_FrameSource_GetFrame(int chnNum, IMPFrameInfo **frame)
+{
+	return -1;
+}
+
+__attribute__((weak)) int IMP_FrameSource_ReleaseFrame(int chnNum, IMPFrameInfo *frame)
+{
+	return -1;
+}
+
+__attribute__((weak)) int IMP_FrameSource_SetFrameDepth(int chnNum, int depth)
+{
+	return -1;
+}
@@ -0,0 +1,252 @@
+/*
+ * sample-idr-service.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-idr-service.h"
+#include "sample-h264-parse.h"
+
+#define TAG "Sample-IDR-Service"
+
+struct idr_chn {
+	int					used;
+	int64_t				gop_us;
+	int64_t				last_key;		/* 0: none yet */
+	int64_t				last_forced;
+
+	/* the open batch */
+	int					nr_pending;
+	int64_t				first_req;
+	int64_t				req_sum;		/* of the request times, for the average */
+	int64_t				forced_at;		/* 0: not forced yet */
+	int					limited;
+
+	idr_service_stat_t	stat;
+};
+
+struct idr_service {
+	idr_service_attr_t	attr;
+	pthread_mutex_t		mutex;
+	struct idr_chn		chn[IDR_SERVICE_MAX_CHN];
+};
+
+static struct idr_chn *get_chn(idr_service_t *svc, int encChn)
+{
+	if (encChn < 0 || encChn >= IDR_SERVICE_MAX_CHN || !svc->chn[encChn].used)
+		return NULL;
+
+	return &svc->chn[encChn];
+}
+
+idr_service_t *idr_service_create(const idr_service_attr_t *attr)
+{
+	idr_service_t *svc;
+
+	svc = calloc(1, sizeof(idr_service_t));
+	if (svc == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+
+	svc->attr = *attr;
+	if (svc->attr.merge_ms == 0)
+		svc->attr.merge_ms = IDR_MERGE_MS;
+	if (svc->attr.min_interval_ms == 0)
+		svc->attr.min_interval_ms = IDR_MIN_INTERVAL_MS;
+	pthread_mutex_init(&svc->mutex, NULL);
+
+	return svc;
+}
+
+void idr_service_destroy(idr_service_t *svc)
+{
+	pthread_mutex_destroy(&svc->mutex);
+	free(svc);
+}
+
+int idr_service_add_chn(idr_service_t *svc, int encChn)
+{
+	IMPEncoderCHNAttr attr;
+	IMPEncoderFrmRate *fr;
+	uint32_t gop;
+	struct idr_chn *ch;
+
+	if (encChn < 0 || encChn >= IDR_SERVICE_MAX_CHN) {
+		IMP_LOG_ERR(TAG, "chn%d out of range\n", encChn);
+		return -1;
+	}
+	if (IMP_Encoder_GetChnAttr(encChn, &attr) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_GetChnAttr(%d) failed\n", encChn);
+		return -1;
+	}
+
+	switch (attr.rcAttr.rcMode) {
+	case ENC_RC_MODE_H264FIXQP:
+		fr = &attr.rcAttr.attrH264FixQp.outFrmRate;
+		gop = attr.rcAttr.attrH264FixQp.maxGop;
+		break;
+	case ENC_RC_MODE_H264CBR:
+		fr = &attr.rcAttr.attrH264Cbr.outFrmRate;
+		gop = attr.rcAttr.attrH264Cbr.maxGop;
+		break;
+	case ENC_RC_MODE_H264VBR:
+		fr = &attr.rcAttr.attrH264Vbr.outFrmRate;
+		gop = attr.rcAttr.attrH264Vbr.maxGop;
+		break;
+	default:
+		IMP_LOG_ERR(TAG, "chn%d: not an H264 channel\n", encChn);
+		return -1;
+	}
+
+	pthread_mutex_lock(&svc->mutex);
+	ch = &svc->chn[encChn];
+	memset(ch, 0, sizeof(*ch));
+	ch->used = 1;
+	if (fr->frmRateNum)
+		ch->gop_us = (int64_t)gop * fr->frmRateDen * 1000000 / fr->frmRateNum;
+	pthread_mutex_unlock(&svc->mutex);
+
+	return 0;
+}
+
+int idr_service_request(idr_service_t *svc, int encChn)
+{
+	int64_t now = IMP_System_GetTimeStamp();
+	struct idr_chn *ch;
+
+	pthread_mutex_lock(&svc->mutex);
+	ch = get_chn(svc, encChn);
+	if (ch == NULL) {
+		pthread_mutex_unlock(&svc->mutex);
+		return -1;
+	}
+
+	ch->stat.requests++;
+	if (ch->nr_pending++ == 0) {
+		ch->first_req = now;
+		ch->limited = 0;
+		ch->stat.batches++;
+	}
+	ch->req_sum += now;
+	pthread_mutex_unlock(&svc->mutex);
+
+	return 0;
+}
+
+/* Called with svc->mutex held */
+static void serve_batch(struct idr_chn *ch, int64_t now)
+{
+	int64_t natural = 0;
+
+	/* the GOP restarts at every IDR, forced ones included */
+	if (ch->last_key && ch->last_key + ch->gop_us > now)
+		natural = ch->last_key + ch->gop_us - now;
+
+	ch->stat.lat_total_us += ch->nr_pending * now - ch->req_sum;
+	if (now - ch->first_req > ch->stat.lat_max_us)
+		ch->stat.lat_max_us = now - ch->first_req;
+	ch->stat.saved_total_us += ch->nr_pending * natural;
+	if (!ch->forced_at)
+		ch->stat.natural++;
+
+	ch->nr_pending = 0;
+	ch->req_sum = 0;
+}
+
+/* Called with svc->mutex held */
+static void force_due(idr_service_t *svc, int encChn, struct idr_chn *ch, int64_t now)
+{
+	int64_t merge = (int64_t)svc->attr.merge_ms * 1000;
+	int64_t interval = (int64_t)svc->attr.min_interval_ms * 1000;
+
+	/* an encoder that did not take the request gets another one */
+	if (ch->forced_at && now - ch->forced_at > interval)
+		ch->forced_at = 0;
+	if (ch->forced_at || now - ch->first_req < merge)
+		return;
+
+	/* the GOP's own IDR is as good and costs nothing */
+	if (ch->last_key && ch->last_key + ch->gop_us - now <= merge)
+		return;
+
+	if (ch->last_forced && now - ch->last_forced < interval) {
+		if (!ch->limited) {
+			ch->limited = 1;
+			ch->stat.limited++;
+		}
+		return;
+	}
+
+	if (IMP_Encoder_RequestIDR(encChn) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_RequestIDR(%d) failed\n", encChn);
+		return;
+	}
+	ch->forced_at = ch->last_forced = now;
+	ch->stat.forced++;
+}
+
+void idr_service_frame(idr_service_t *svc, int encChn, IMPEncoderStream *stream)
+{
+	int64_t now = IMP_System_GetTimeStamp();
+	struct idr_chn *ch;
+
+	pthread_mutex_lock(&svc->mutex);
+	ch = get_chn(svc, encChn);
+	if (ch == NULL) {
+		pthread_mutex_unlock(&svc->mutex);
+		return;
+	}
+
+	if (h264_stream_is_key_frame(stream)) {
+		if (ch->nr_pending)
+			serve_batch(ch, now);
+		ch->last_key = now;
+		ch->forced_at = 0;
+	} else if (ch->nr_pending) {
+		force_due(svc, encChn, ch, now);
+	}
+	pthread_mutex_unlock(&svc->mutex);
+}
+
+int idr_service_get_stat(idr_service_t *svc, int encChn, idr_service_stat_t *stat)
+{
+	struct idr_chn *ch;
+
+	pthread_mutex_lock(&svc->mutex);
+	ch = get_chn(svc, encChn);
+	if (ch) {
+		*stat = ch->stat;
+		stat->pending = ch->nr_pending;
+	}
+	pthread_mutex_unlock(&svc->mutex);
+
+	return ch ? 0 : -1;
+}
+
+void idr_service_dump_stat(idr_service_t *svc)
+{
+	idr_service_stat_t s;
+	uint32_t served;
+	int i;
+
+	for (i = 0; i < IDR_SERVICE_MAX_CHN; i++) {
+		if (idr_service_get_stat(svc, i, &s) < 0)
+			continue;
+		served = s.requests - s.pending;
+		IMP_LOG_INFO(TAG, "chn%d: %u requests in %u batches, %u forced IDRs, %u natural, "
+				"%u rate limited; wait avg %lld max %lld ms, saved avg %lld ms\n", i,
+				s.requests, s.batches, s.forced, s.natural, s.limited,
+				(long long)(served ? s.lat_total_us / served / 1000 : 0),
+				(long long)s.lat_max_us / 1000,
+				(long long)(served ? s.saved_total_us / served / 1000 : 0));
+	}
+}
@@ -0,0 +1,80 @@
+/*
+ * sample-idr-service.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_IDR_SERVICE_H__
+#define __SAMPLE_IDR_SERVICE_H__
+
+#include <stdint.h>
+#include <imp/imp_encoder.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * On demand IDR requests, shared by everyone who wants a key frame from
+ * an H264 channel: client (re)connects, snapshots, recorder rotation.
+ *
+ * The first request opens a batch; every request until a key frame
+ * comes joins it. The batch is forced with IMP_Encoder_RequestIDR()
+ * merge_ms after it opened, but not sooner than min_interval_ms after
+ * the previous forced IDR of the channel, and not at all if the GOP
+ * brings an IDR by then anyway. Any key frame, forced or not, serves
+ * the whole batch.
+ *
+ * Each request is timed to its key frame and compared with the wait
+ * for the next IDR of the GOP, which is what it would have cost
+ * without the service: that difference is reported as saved.
+ */
+
+#define IDR_SERVICE_MAX_CHN		8
+#define IDR_MERGE_MS			100
+#define IDR_MIN_INTERVAL_MS		1000
+
+typedef struct idr_service idr_service_t;
+
+typedef struct idr_service_attr {
+	uint32_t	merge_ms;			/* 0: IDR_MERGE_MS */
+	uint32_t	min_interval_ms;	/* 0: IDR_MIN_INTERVAL_MS */
+} idr_service_attr_t;
+
+typedef struct idr_service_stat {
+	uint32_t	requests;
+	uint32_t	pending;			/* requests waiting for a key frame now */
+	uint32_t	batches;			/* requests minus the merged ones */
+	uint32_t	forced;				/* IMP_Encoder_RequestIDR() calls */
+	uint32_t	natural;			/* batches served by the GOP's own IDR */
+	uint32_t	limited;			/* batches held back by min_interval_ms */
+	int64_t		lat_total_us;		/* request -> key frame */
+	int64_t		lat_max_us;
+	int64_t		saved_total_us;		/* against waiting for the GOP's IDR */
+} idr_service_stat_t;
+
+idr_service_t *idr_service_create(const idr_service_attr_t *attr);
+void idr_service_destroy(idr_service_t *svc);
+
+/* The GOP length is read from the channel */
+int idr_service_add_chn(idr_service_t *svc, int encChn);
+
+/* From any thread */
+int idr_service_request(idr_service_t *svc, int encChn);
+
+/* Every stream of the channel, from its stream thread; forces due IDRs */
+void idr_service_frame(idr_service_t *svc, int encChn, IMPEncoderStream *stream);
+
+int idr_service_get_stat(idr_service_t *svc, int encChn, idr_service_stat_t *stat);
+void idr_service_dump_stat(idr_service_t *svc);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_IDR_SERVICE_H__ */
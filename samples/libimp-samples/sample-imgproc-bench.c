@@ -0,0 +1,250 @@
+/*
+ * sample-imgproc-bench.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check and benchmark for the NV12 image kernels. Every kernel is
+ * first run with the vector paths and with the scalar reference on
+ * random pictures of a few sizes, strides and both chroma orders, and
+ * the outputs must match to the byte. Then each kernel is timed both
+ * ways on a WxH picture and reported in source megapixels per second.
+ *
+ * usage: sample-imgproc-bench [-s WxH] [-t seconds per kernel]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_system.h>
+
+#include "sample-imgproc.h"
+
+#define TAG "Sample-Imgproc-Bench"
+
+enum {
+	K_CROP,
+	K_BOX2,
+	K_BOX4,
+	K_BILINEAR,
+	K_GRAY8,
+	K_RGB24,
+	K_BGRA,
+	K_TO_YUYV,
+	K_TO_UYVY,
+	K_FROM_YUYV,
+	K_FROM_UYVY,
+	K_HIST,
+	K_NR,
+};
+
+static const char *names[K_NR] = {
+	"crop", "box/2", "box/4", "bilinear 2/3", "nv12->gray8", "nv12->rgb24", "nv12->bgra",
+	"nv12->yuyv", "nv12->uyvy", "yuyv->nv12", "uyvy->nv12", "luma hist",
+};
+
+struct pic {
+	img_nv12_t	src;
+	uint8_t		*src_buf;
+	uint8_t		*packed;		/* the picture as YUYV/UYVY, 2 * width per row */
+	uint8_t		*out;
+	size_t		out_size;
+	int			nv21;
+};
+
+static uint32_t rand_state = 1;
+
+static uint8_t rand8(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 16;
+}
+
+static int pic_alloc(struct pic *p, int w, int h, int stride, int nv21)
+{
+	size_t i, n = (size_t)stride * h * 3 / 2;
+
+	memset(p, 0, sizeof(*p));
+	p->src_buf = malloc(n);
+	p->packed = malloc((size_t)w * 2 * h);
+	p->out_size = (size_t)w * 4 * h;
+	p->out = malloc(p->out_size);
+	if (p->src_buf == NULL || p->packed == NULL || p->out == NULL)
+		return -1;
+	for (i = 0; i < n; i++)
+		p->src_buf[i] = rand8();
+	for (i = 0; i < (size_t)w * 2 * h; i++)
+		p->packed[i] = rand8();
+	p->nv21 = nv21;
+
+	return img_nv12_init(&p->src, p->src_buf, w, h, stride, nv21);
+}
+
+static void pic_free(struct pic *p)
+{
+	free(p->src_buf);
+	free(p->packed);
+	free(p->out);
+}
+
+/* Runs kernel k on p into p->out, output bytes or -1 */
+static long run(struct pic *p, int k)
+{
+	img_nv12_t dst;
+	int w = p->src.width, h = p->src.height;
+
+	memset(p->out, 0x5a, p->out_size);
+
+	switch (k) {
+	case K_CROP:
+		if (img_nv12_crop_view(&p->src, w / 4 & ~1, h / 4 & ~1, w / 2 & ~1, h / 2 & ~1, &dst) < 0)
+			return -1;
+		{
+			img_nv12_t copy;
+			img_nv12_init(&copy, p->out, dst.width, dst.height, dst.width, p->nv21);
+			img_nv12_copy(&dst, &copy);
+			return dst.width * dst.height * 3 / 2;
+		}
+	case K_BOX2:
+	case K_BOX4:
+		{
+			int f = k == K_BOX2 ? 2 : 4;
+			/* the other chroma order on the way out */
+			img_nv12_init(&dst, p->out, w / f & ~1, h / f & ~1, (w / f & ~1) + 4, !p->nv21);
+			if (img_nv12_box_down(&p->src, &dst, f) < 0)
+				return -1;
+			return dst.stride * dst.height * 3 / 2;
+		}
+	case K_BILINEAR:
+		img_nv12_init(&dst, p->out, w * 2 / 3 & ~1, h * 2 / 3 & ~1, w * 2 / 3 & ~1, p->nv21);
+		if (img_nv12_bilinear(&p->src, &dst) < 0)
+			return -1;
+		return dst.stride * dst.height * 3 / 2;
+	case K_GRAY8:
+		img_nv12_to_gray8(&p->src, p->out, w);
+		return w * h;
+	case K_RGB24:
+		img_nv12_to_rgb24(&p->src, p->out, w * 3);
+		return w * h * 3;
+	case K_BGRA:
+		img_nv12_to_bgra(&p->src, p->out, w * 4);
+		return w * h * 4;
+	case K_TO_YUYV:
+	case K_TO_UYVY:
+		img_nv12_to_packed422(&p->src, p->out, w * 2, k == K_TO_YUYV ? PIX_FMT_YUYV422 : PIX_FMT_UYVY422);
+		return w * h * 2;
+	case K_FROM_YUYV:
+	case K_FROM_UYVY:
+		img_nv12_init(&dst, p->out, w, h, w, p->nv21);
+		img_packed422_to_nv12(p->packed, w * 2, k == K_FROM_YUYV ? PIX_FMT_YUYV422 : PIX_FMT_UYVY422, &dst);
+		return w * h * 3 / 2;
+	case K_HIST:
+		img_nv12_luma_hist(&p->src, (uint32_t *)p->out);
+		return 256 * sizeof(uint32_t);
+	}
+
+	return -1;
+}
+
+/* Vector and scalar give the same bytes */
+static int verify(int w, int h, int stride, int nv21)
+{
+	struct pic p;
+	uint8_t *ref;
+	long n, m;
+	int k, ret = 0;
+
+	if (pic_alloc(&p, w, h, stride, nv21) < 0)
+		return -1;
+	ref = malloc(p.out_size);
+	if (ref == NULL)
+		return -1;
+
+	for (k = 0; k < K_NR; k++) {
+		img_set_simd(0);
+		n = run(&p, k);
+		memcpy(ref, p.out, p.out_size);
+		img_set_simd(1);
+		m = run(&p, k);
+		if (n < 0 || n != m || memcmp(ref, p.out, n)) {
+			IMP_LOG_ERR(TAG, "%s differs from the reference at %dx%d stride %d%s\n",
+					names[k], w, h, stride, nv21 ? " nv21" : "");
+			ret = -1;
+		}
+	}
+
+	free(ref);
+	pic_free(&p);
+	return ret;
+}
+
+static double mpix_per_s(struct pic *p, int k, int64_t run_us)
+{
+	int64_t start = IMP_System_GetTimeStamp(), t;
+	long n = 0;
+
+	do {
+		run(p, k);
+		n++;
+		t = IMP_System_GetTimeStamp() - start;
+	} while (t < run_us);
+
+	return (double)n * p->src.width * p->src.height / t;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int sizes[][3] = {
+		{ 1280, 720, 1280 }, { 646, 362, 672 }, { 34, 18, 40 }, { 70, 8, 96 },
+	};
+	struct pic p;
+	const char *simd;
+	double scalar, vector;
+	int opt, i, w = 1280, h = 720, ret = 0;
+	int64_t run_us = 300000;
+
+	while ((opt = getopt(argc, argv, "s:t:")) != -1) {
+		switch (opt) {
+		case 's':
+			if (sscanf(optarg, "%dx%d", &w, &h) != 2 || (w | h) & 1 || w < 8 || h < 8)
+				goto usage;
+			break;
+		case 't':
+			run_us = atof(optarg) * 1000000;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	simd = img_set_simd(1);
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (verify(sizes[i][0], sizes[i][1], sizes[i][2], 0) < 0
+				|| verify(sizes[i][0], sizes[i][1], sizes[i][2], 1) < 0)
+			ret = -1;
+	}
+	if (ret < 0)
+		return ret;
+	printf("%s matches the scalar reference\n", simd);
+
+	if (pic_alloc(&p, w, h, w, 0) < 0)
+		return -1;
+	printf("%dx%d, source MPix/s:\n%-14s %10s %10s\n", w, h, "kernel", "scalar", simd);
+	for (i = 0; i < K_NR; i++) {
+		img_set_simd(0);
+		scalar = mpix_per_s(&p, i, run_us);
+		img_set_simd(1);
+		vector = mpix_per_s(&p, i, run_us);
+		printf("%-14s %10.1f %10.1f  x%.2f\n", names[i], scalar, vector, vector / scalar);
+	}
+	pic_free(&p);
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-s WxH] [-t seconds per kernel]\n", argv[0]);
+	return -1;
+}
@@ -0,0 +1,899 @@
+/*
+ * sample-imgproc.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+
+#if defined(__mips_msa)
+#include <msa.h>
+#define IMG_SIMD		"msa"
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define IMG_SIMD		"sse2"
+#endif
+
+#include "sample-imgproc.h"
+#include "sample-pixfmt.h"
+
+#define TAG "Sample-Imgproc"
+
+/* bilinear weights */
+#define BL_BITS			7
+#define BL_ONE			(1 << BL_BITS)
+
+#ifdef IMG_SIMD
+static int simd_enabled = 1;
+#endif
+
+static inline uint8_t clip8(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+const char *img_set_simd(int enable)
+{
+#ifdef IMG_SIMD
+	simd_enabled = enable;
+	return enable ? IMG_SIMD : "none";
+#else
+	return "none";
+#endif
+}
+
+int img_nv12_init(img_nv12_t *img, void *buf, int width, int height, int stride, int nv21)
+{
+	if ((width | height) & 1 || width <= 0 || height <= 0 || stride < width) {
+		IMP_LOG_ERR(TAG, "bad NV12 picture %dx%d stride %d\n", width, height, stride);
+		return -1;
+	}
+
+	img->y = buf;
+	img->uv = img->y + stride * height;
+	img->width = width;
+	img->height = height;
+	img->stride = stride;
+	img->nv21 = nv21;
+
+	return 0;
+}
+
+int img_nv12_from_frame(img_nv12_t *img, const IMPFrameInfo *frame)
+{
+	pix_view_t view;
+
+	if (frame->pixfmt != PIX_FMT_NV12 && frame->pixfmt != PIX_FMT_NV21) {
+		IMP_LOG_ERR(TAG, "frame is not NV12 or NV21\n");
+		return -1;
+	}
+	/* checks the frame holds both planes */
+	if (pix_view_from_frame(&view, frame) < 0)
+		return -1;
+
+	return img_nv12_init(img, view.plane[0], view.layout.width, view.layout.height,
+			view.layout.stride[0], frame->pixfmt == PIX_FMT_NV21);
+}
+
+int img_nv12_crop_view(const img_nv12_t *src, int x, int y, int w, int h, img_nv12_t *dst)
+{
+	if ((x | y | w | h) & 1 || x < 0 || y < 0 || w <= 0 || h <= 0
+			|| x + w > src->width || y + h > src->height) {
+		IMP_LOG_ERR(TAG, "crop %dx%d+%d+%d outside %dx%d\n", w, h, x, y, src->width, src->height);
+		return -1;
+	}
+
+	*dst = *src;
+	dst->y = src->y + y * src->stride + x;
+	dst->uv = src->uv + y / 2 * src->stride + x;
+	dst->width = w;
+	dst->height = h;
+
+	return 0;
+}
+
+int img_nv12_copy(const img_nv12_t *src, img_nv12_t *dst)
+{
+	int i;
+
+	if (src->width != dst->width || src->height != dst->height || src->nv21 != dst->nv21) {
+		IMP_LOG_ERR(TAG, "copy of %dx%d into %dx%d\n", src->width, src->height, dst->width, dst->height);
+		return -1;
+	}
+
+	for (i = 0; i < src->height; i++)
+		memcpy(dst->y + i * dst->stride, src->y + i * src->stride, src->width);
+	for (i = 0; i < src->height / 2; i++)
+		memcpy(dst->uv + i * dst->stride, src->uv + i * src->stride, src->width);
+
+	return 0;
+}
+
+/*
+ * Vector row kernels. Each does what it can of a row in whole vectors
+ * and returns how far it got, the scalar loop does the rest.
+ */
+#if defined(__mips_msa)
+
+/* 2x2 means of n luma samples from two rows */
+static int box2_row_simd(const uint8_t *s0, const uint8_t *s1, uint8_t *d, int n)
+{
+	v16u8 a0, a1, b0, b1;
+	v8u16 lo, hi;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a0 = (v16u8)__msa_ld_b((void *)(s0 + 2 * i), 0);
+		a1 = (v16u8)__msa_ld_b((void *)(s0 + 2 * i + 16), 0);
+		b0 = (v16u8)__msa_ld_b((void *)(s1 + 2 * i), 0);
+		b1 = (v16u8)__msa_ld_b((void *)(s1 + 2 * i + 16), 0);
+		lo = __msa_hadd_u_h(a0, a0) + __msa_hadd_u_h(b0, b0);
+		hi = __msa_hadd_u_h(a1, a1) + __msa_hadd_u_h(b1, b1);
+		lo = (v8u16)__msa_srari_h((v8i16)lo, 2);
+		hi = (v8u16)__msa_srari_h((v8i16)hi, 2);
+		__msa_st_b(__msa_pckev_b((v16i8)hi, (v16i8)lo), d + i, 0);
+	}
+
+	return i;
+}
+
+/* 2x2 means of n chroma pairs */
+static int box2_uv_row_simd(const uint8_t *s0, const uint8_t *s1, uint8_t *d, int n)
+{
+	v16u8 a0, a1, b0, b1;
+	v8u16 u, v;
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		a0 = (v16u8)__msa_ld_b((void *)(s0 + 4 * i), 0);
+		a1 = (v16u8)__msa_ld_b((void *)(s0 + 4 * i + 16), 0);
+		b0 = (v16u8)__msa_ld_b((void *)(s1 + 4 * i), 0);
+		b1 = (v16u8)__msa_ld_b((void *)(s1 + 4 * i + 16), 0);
+		u = __msa_hadd_u_h((v16u8)__msa_pckev_b((v16i8)a1, (v16i8)a0), (v16u8)__msa_pckev_b((v16i8)a1, (v16i8)a0))
+			+ __msa_hadd_u_h((v16u8)__msa_pckev_b((v16i8)b1, (v16i8)b0), (v16u8)__msa_pckev_b((v16i8)b1, (v16i8)b0));
+		v = __msa_hadd_u_h((v16u8)__msa_pckod_b((v16i8)a1, (v16i8)a0), (v16u8)__msa_pckod_b((v16i8)a1, (v16i8)a0))
+			+ __msa_hadd_u_h((v16u8)__msa_pckod_b((v16i8)b1, (v16i8)b0), (v16u8)__msa_pckod_b((v16i8)b1, (v16i8)b0));
+		u = (v8u16)__msa_srari_h((v8i16)u, 2);
+		v = (v8u16)__msa_srari_h((v8i16)v, 2);
+		__msa_st_b((v16i8)(u | (v << 8)), d + 2 * i, 0);
+	}
+
+	return i;
+}
+
+/* (h0 * (BL_ONE - fy) + h1 * fy) rounded back to 8 bits */
+static int blend_row_simd(const uint16_t *h0, const uint16_t *h1, int fy, uint8_t *d, int n)
+{
+	v8i16 w = (v8i16)__msa_fill_w((fy << 16) | (BL_ONE - fy));
+	v8i16 a, b, lo, hi;
+	v4i32 p0, p1, p2, p3;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a = __msa_ld_h((void *)(h0 + i), 0);
+		b = __msa_ld_h((void *)(h1 + i), 0);
+		p0 = __msa_srari_w(__msa_dotp_s_w(__msa_ilvr_h(b, a), w), 2 * BL_BITS);
+		p1 = __msa_srari_w(__msa_dotp_s_w(__msa_ilvl_h(b, a), w), 2 * BL_BITS);
+		a = __msa_ld_h((void *)(h0 + i + 8), 0);
+		b = __msa_ld_h((void *)(h1 + i + 8), 0);
+		p2 = __msa_srari_w(__msa_dotp_s_w(__msa_ilvr_h(b, a), w), 2 * BL_BITS);
+		p3 = __msa_srari_w(__msa_dotp_s_w(__msa_ilvl_h(b, a), w), 2 * BL_BITS);
+		lo = __msa_pckev_h((v8i16)p1, (v8i16)p0);
+		hi = __msa_pckev_h((v8i16)p3, (v8i16)p2);
+		__msa_st_b(__msa_pckev_b((v16i8)hi, (v16i8)lo), d + i, 0);
+	}
+
+	return i;
+}
+
+/* 8 pixels: c = Y - 16, d = U - 128, e = V - 128 to clipped R, G, B halfwords */
+static inline void yuv2rgb8(v8i16 c, v8i16 d, v8i16 e, v8i16 *r, v8i16 *g, v8i16 *b)
+{
+	const v8i16 k_ce = (v8i16)__msa_fill_w((409 << 16) | 298);
+	const v8i16 k_cd_g = (v8i16)__msa_fill_w((-100 * 65536) | 298);
+	const v8i16 k_cd_b = (v8i16)__msa_fill_w((516 << 16) | 298);
+	const v8i16 k_e1 = (v8i16)__msa_fill_w((128 << 16) | (-208 & 0xffff));
+	const v4i32 half = __msa_fill_w(128);
+	const v8i16 one = __msa_fill_h(1);
+	v4i32 lo, hi;
+
+	lo = __msa_srai_w(__msa_dotp_s_w(__msa_ilvr_h(e, c), k_ce) + half, 8);
+	hi = __msa_srai_w(__msa_dotp_s_w(__msa_ilvl_h(e, c), k_ce) + half, 8);
+	*r = __msa_pckev_h((v8i16)hi, (v8i16)lo);
+	lo = __msa_dpadd_s_w(__msa_dotp_s_w(__msa_ilvr_h(d, c), k_cd_g), __msa_ilvr_h(one, e), k_e1);
+	hi = __msa_dpadd_s_w(__msa_dotp_s_w(__msa_ilvl_h(d, c), k_cd_g), __msa_ilvl_h(one, e), k_e1);
+	*g = __msa_pckev_h((v8i16)__msa_srai_w(hi, 8), (v8i16)__msa_srai_w(lo, 8));
+	lo = __msa_srai_w(__msa_dotp_s_w(__msa_ilvr_h(d, c), k_cd_b) + half, 8);
+	hi = __msa_srai_w(__msa_dotp_s_w(__msa_ilvl_h(d, c), k_cd_b) + half, 8);
+	*b = __msa_pckev_h((v8i16)hi, (v8i16)lo);
+}
+
+static inline v16u8 pack_clip(v8i16 lo, v8i16 hi)
+{
+	lo = (v8i16)__msa_sat_u_h((v8u16)__msa_maxi_s_h(lo, 0), 7);
+	hi = (v8i16)__msa_sat_u_h((v8u16)__msa_maxi_s_h(hi, 0), 7);
+	return (v16u8)__msa_pckev_b((v16i8)hi, (v16i8)lo);
+}
+
+/* 16 pixels of a row to R, G, B bytes */
+static inline void yuv2rgb16(const uint8_t *y, const uint8_t *uv, int nv21, v16u8 *r, v16u8 *g, v16u8 *b)
+{
+	v16i8 zero = __msa_ldi_b(0);
+	v16i8 yv = __msa_ld_b((void *)y, 0), cv = __msa_ld_b((void *)uv, 0);
+	v8i16 c_lo, c_hi, u, v, d_lo, d_hi, e_lo, e_hi, r0, g0, b0, r1, g1, b1;
+
+	c_lo = (v8i16)__msa_ilvr_b(zero, yv) - __msa_fill_h(16);
+	c_hi = (v8i16)__msa_ilvl_b(zero, yv) - __msa_fill_h(16);
+	u = (v8i16)__msa_pckev_b(zero, cv);
+	v = (v8i16)__msa_pckod_b(zero, cv);
+	u = (v8i16)__msa_ilvr_b(zero, (v16i8)u) - __msa_fill_h(128);
+	v = (v8i16)__msa_ilvr_b(zero, (v16i8)v) - __msa_fill_h(128);
+	if (nv21) {
+		v8i16 t = u;
+		u = v;
+		v = t;
+	}
+	d_lo = __msa_ilvr_h(u, u);
+	d_hi = __msa_ilvl_h(u, u);
+	e_lo = __msa_ilvr_h(v, v);
+	e_hi = __msa_ilvl_h(v, v);
+
+	yuv2rgb8(c_lo, d_lo, e_lo, &r0, &g0, &b0);
+	yuv2rgb8(c_hi, d_hi, e_hi, &r1, &g1, &b1);
+	*r = pack_clip(r0, r1);
+	*g = pack_clip(g0, g1);
+	*b = pack_clip(b0, b1);
+}
+
+static int bgra_row_simd(const uint8_t *y, const uint8_t *uv, int nv21, uint8_t *d, int n)
+{
+	v16u8 r, g, b, a = (v16u8)__msa_ldi_b(-1);
+	v8i16 bg, ra;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		yuv2rgb16(y + i, uv + i, nv21, &r, &g, &b);
+		bg = (v8i16)__msa_ilvr_b((v16i8)g, (v16i8)b);
+		ra = (v8i16)__msa_ilvr_b((v16i8)a, (v16i8)r);
+		__msa_st_b((v16i8)__msa_ilvr_h(ra, bg), d + 4 * i, 0);
+		__msa_st_b((v16i8)__msa_ilvl_h(ra, bg), d + 4 * i + 16, 0);
+		bg = (v8i16)__msa_ilvl_b((v16i8)g, (v16i8)b);
+		ra = (v8i16)__msa_ilvl_b((v16i8)a, (v16i8)r);
+		__msa_st_b((v16i8)__msa_ilvr_h(ra, bg), d + 4 * i + 32, 0);
+		__msa_st_b((v16i8)__msa_ilvl_h(ra, bg), d + 4 * i + 48, 0);
+	}
+
+	return i;
+}
+
+static int rgb24_row_simd(const uint8_t *y, const uint8_t *uv, int nv21, uint8_t *d, int n)
+{
+	uint8_t rb[16] __attribute__((aligned(16))), gb[16] __attribute__((aligned(16)));
+	uint8_t bb[16] __attribute__((aligned(16)));
+	v16u8 r, g, b;
+	int i, k;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		yuv2rgb16(y + i, uv + i, nv21, &r, &g, &b);
+		__msa_st_b((v16i8)r, rb, 0);
+		__msa_st_b((v16i8)g, gb, 0);
+		__msa_st_b((v16i8)b, bb, 0);
+		for (k = 0; k < 16; k++) {
+			d[3 * (i + k)] = rb[k];
+			d[3 * (i + k) + 1] = gb[k];
+			d[3 * (i + k) + 2] = bb[k];
+		}
+	}
+
+	return i;
+}
+
+/* Two rows of n packed 422 pixels to two luma rows and one averaged chroma row */
+static int from422_row_simd(const uint8_t *s0, const uint8_t *s1, int uyvy, int swap,
+		uint8_t *y0, uint8_t *y1, uint8_t *uv, int n)
+{
+	v16i8 a0, a1, b0, b1, c0, c1, c;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a0 = __msa_ld_b((void *)(s0 + 2 * i), 0);
+		a1 = __msa_ld_b((void *)(s0 + 2 * i + 16), 0);
+		b0 = __msa_ld_b((void *)(s1 + 2 * i), 0);
+		b1 = __msa_ld_b((void *)(s1 + 2 * i + 16), 0);
+		if (uyvy) {
+			__msa_st_b(__msa_pckod_b(a1, a0), y0 + i, 0);
+			__msa_st_b(__msa_pckod_b(b1, b0), y1 + i, 0);
+			c0 = __msa_pckev_b(a1, a0);
+			c1 = __msa_pckev_b(b1, b0);
+		} else {
+			__msa_st_b(__msa_pckev_b(a1, a0), y0 + i, 0);
+			__msa_st_b(__msa_pckev_b(b1, b0), y1 + i, 0);
+			c0 = __msa_pckod_b(a1, a0);
+			c1 = __msa_pckod_b(b1, b0);
+		}
+		c = (v16i8)__msa_aver_u_b((v16u8)c0, (v16u8)c1);
+		if (swap)
+			c = __msa_shf_b(c, 0xb1);
+		__msa_st_b(c, uv + i, 0);
+	}
+
+	return i;
+}
+
+static int to422_row_simd(const uint8_t *y, const uint8_t *uv, int uyvy, int swap, uint8_t *d, int n)
+{
+	v16i8 yv, c;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		yv = __msa_ld_b((void *)(y + i), 0);
+		c = __msa_ld_b((void *)(uv + i), 0);
+		if (swap)
+			c = __msa_shf_b(c, 0xb1);
+		if (uyvy) {
+			__msa_st_b(__msa_ilvr_b(yv, c), d + 2 * i, 0);
+			__msa_st_b(__msa_ilvl_b(yv, c), d + 2 * i + 16, 0);
+		} else {
+			__msa_st_b(__msa_ilvr_b(c, yv), d + 2 * i, 0);
+			__msa_st_b(__msa_ilvl_b(c, yv), d + 2 * i + 16, 0);
+		}
+	}
+
+	return i;
+}
+
+#elif defined(__SSE2__)
+
+/* Sum of each pair of bytes of a and b, as 8 halfwords */
+static inline __m128i pair_sum(__m128i a, __m128i b)
+{
+	const __m128i lo8 = _mm_set1_epi16(0xff);
+
+	return _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, lo8), _mm_srli_epi16(a, 8)),
+			_mm_add_epi16(_mm_and_si128(b, lo8), _mm_srli_epi16(b, 8)));
+}
+
+static int box2_row_simd(const uint8_t *s0, const uint8_t *s1, uint8_t *d, int n)
+{
+	const __m128i two = _mm_set1_epi16(2);
+	__m128i lo, hi;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		lo = pair_sum(_mm_loadu_si128((const __m128i *)(s0 + 2 * i)),
+				_mm_loadu_si128((const __m128i *)(s1 + 2 * i)));
+		hi = pair_sum(_mm_loadu_si128((const __m128i *)(s0 + 2 * i + 16)),
+				_mm_loadu_si128((const __m128i *)(s1 + 2 * i + 16)));
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+		_mm_storeu_si128((__m128i *)(d + i), _mm_packus_epi16(lo, hi));
+	}
+
+	return i;
+}
+
+/* U bytes and V bytes of 16 chroma pairs */
+static inline void uv_split(const uint8_t *p, __m128i *u, __m128i *v)
+{
+	const __m128i lo8 = _mm_set1_epi16(0xff);
+	__m128i a = _mm_loadu_si128((const __m128i *)p), b = _mm_loadu_si128((const __m128i *)(p + 16));
+
+	*u = _mm_packus_epi16(_mm_and_si128(a, lo8), _mm_and_si128(b, lo8));
+	*v = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+}
+
+static int box2_uv_row_simd(const uint8_t *s0, const uint8_t *s1, uint8_t *d, int n)
+{
+	const __m128i two = _mm_set1_epi16(2);
+	__m128i u0, v0, u1, v1, u, v;
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		uv_split(s0 + 4 * i, &u0, &v0);
+		uv_split(s1 + 4 * i, &u1, &v1);
+		u = _mm_srli_epi16(_mm_add_epi16(pair_sum(u0, u1), two), 2);
+		v = _mm_srli_epi16(_mm_add_epi16(pair_sum(v0, v1), two), 2);
+		_mm_storeu_si128((__m128i *)(d + 2 * i), _mm_or_si128(u, _mm_slli_epi16(v, 8)));
+	}
+
+	return i;
+}
+
+static int blend_row_simd(const uint16_t *h0, const uint16_t *h1, int fy, uint8_t *d, int n)
+{
+	const __m128i w = _mm_set1_epi32((fy << 16) | (BL_ONE - fy));
+	const __m128i half = _mm_set1_epi32(1 << (2 * BL_BITS - 1));
+	__m128i a, b, p0, p1, p2, p3;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a = _mm_loadu_si128((const __m128i *)(h0 + i));
+		b = _mm_loadu_si128((const __m128i *)(h1 + i));
+		p0 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), w), half), 2 * BL_BITS);
+		p1 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), w), half), 2 * BL_BITS);
+		a = _mm_loadu_si128((const __m128i *)(h0 + i + 8));
+		b = _mm_loadu_si128((const __m128i *)(h1 + i + 8));
+		p2 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), w), half), 2 * BL_BITS);
+		p3 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), w), half), 2 * BL_BITS);
+		_mm_storeu_si128((__m128i *)(d + i),
+				_mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3)));
+	}
+
+	return i;
+}
+
+/* a * ka + b * kb + k, 8 lanes in two halves, shifted down by 8 */
+static inline __m128i dot2(__m128i a, __m128i b, int ka, int kb, int k)
+{
+	const __m128i w = _mm_set1_epi32((kb << 16) | (ka & 0xffff)), c = _mm_set1_epi32(k);
+	__m128i lo, hi;
+
+	lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), w), c), 8);
+	hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), w), c), 8);
+
+	return _mm_packs_epi32(lo, hi);
+}
+
+/* 8 pixels: c = Y - 16, d = U - 128, e = V - 128 to R, G, B halfwords */
+static inline void yuv2rgb8(__m128i c, __m128i d, __m128i e, __m128i *r, __m128i *g, __m128i *b)
+{
+	const __m128i w_cd = _mm_set1_epi32((-100 * 65536) | 298), w_e = _mm_set1_epi32((128 << 16) | (-208 & 0xffff));
+	const __m128i one = _mm_set1_epi16(1);
+	__m128i lo, hi;
+
+	*r = dot2(c, e, 298, 409, 128);
+	*b = dot2(c, d, 298, 516, 128);
+	lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(c, d), w_cd), _mm_madd_epi16(_mm_unpacklo_epi16(e, one), w_e));
+	hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(c, d), w_cd), _mm_madd_epi16(_mm_unpackhi_epi16(e, one), w_e));
+	*g = _mm_packs_epi32(_mm_srai_epi32(lo, 8), _mm_srai_epi32(hi, 8));
+}
+
+/* 16 pixels of a row to R, G, B bytes */
+static inline void yuv2rgb16(const uint8_t *y, const uint8_t *uv, int nv21, __m128i *r, __m128i *g, __m128i *b)
+{
+	const __m128i zero = _mm_setzero_si128(), lo8 = _mm_set1_epi16(0xff);
+	const __m128i k16 = _mm_set1_epi16(16), k128 = _mm_set1_epi16(128);
+	__m128i yv = _mm_loadu_si128((const __m128i *)y), cv = _mm_loadu_si128((const __m128i *)uv);
+	__m128i c_lo, c_hi, u, v, t, r0, g0, b0, r1, g1, b1;
+
+	c_lo = _mm_sub_epi16(_mm_unpacklo_epi8(yv, zero), k16);
+	c_hi = _mm_sub_epi16(_mm_unpackhi_epi8(yv, zero), k16);
+	u = _mm_sub_epi16(_mm_and_si128(cv, lo8), k128);
+	v = _mm_sub_epi16(_mm_srli_epi16(cv, 8), k128);
+	if (nv21) {
+		t = u;
+		u = v;
+		v = t;
+	}
+
+	yuv2rgb8(c_lo, _mm_unpacklo_epi16(u, u), _mm_unpacklo_epi16(v, v), &r0, &g0, &b0);
+	yuv2rgb8(c_hi, _mm_unpackhi_epi16(u, u), _mm_unpackhi_epi16(v, v), &r1, &g1, &b1);
+	*r = _mm_packus_epi16(r0, r1);
+	*g = _mm_packus_epi16(g0, g1);
+	*b = _mm_packus_epi16(b0, b1);
+}
+
+static int bgra_row_simd(const uint8_t *y, const uint8_t *uv, int nv21, uint8_t *d, int n)
+{
+	const __m128i a = _mm_set1_epi8(-1);
+	__m128i r, g, b, bg, ra;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		yuv2rgb16(y + i, uv + i, nv21, &r, &g, &b);
+		bg = _mm_unpacklo_epi8(b, g);
+		ra = _mm_unpacklo_epi8(r, a);
+		_mm_storeu_si128((__m128i *)(d + 4 * i), _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128((__m128i *)(d + 4 * i + 16), _mm_unpackhi_epi16(bg, ra));
+		bg = _mm_unpackhi_epi8(b, g);
+		ra = _mm_unpackhi_epi8(r, a);
+		_mm_storeu_si128((__m128i *)(d + 4 * i + 32), _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128((__m128i *)(d + 4 * i + 48), _mm_unpackhi_epi16(bg, ra));
+	}
+
+	return i;
+}
+
+static int rgb24_row_simd(const uint8_t *y, const uint8_t *uv, int nv21, uint8_t *d, int n)
+{
+	uint8_t rb[16] __attribute__((aligned(16))), gb[16] __attribute__((aligned(16)));
+	uint8_t bb[16] __attribute__((aligned(16)));
+	__m128i r, g, b;
+	int i, k;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		yuv2rgb16(y + i, uv + i, nv21, &r, &g, &b);
+		_mm_store_si128((__m128i *)rb, r);
+		_mm_store_si128((__m128i *)gb, g);
+		_mm_store_si128((__m128i *)bb, b);
+		for (k = 0; k < 16; k++) {
+			d[3 * (i + k)] = rb[k];
+			d[3 * (i + k) + 1] = gb[k];
+			d[3 * (i + k) + 2] = bb[k];
+		}
+	}
+
+	return i;
+}
+
+/* swap the bytes of each chroma pair */
+static inline __m128i uv_swap(__m128i c)
+{
+	return _mm_or_si128(_mm_slli_epi16(c, 8), _mm_srli_epi16(c, 8));
+}
+
+static int from422_row_simd(const uint8_t *s0, const uint8_t *s1, int uyvy, int swap,
+		uint8_t *y0, uint8_t *y1, uint8_t *uv, int n)
+{
+	const __m128i lo8 = _mm_set1_epi16(0xff);
+	__m128i a0, a1, b0, b1, ya, yb, c0, c1, c;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a0 = _mm_loadu_si128((const __m128i *)(s0 + 2 * i));
+		a1 = _mm_loadu_si128((const __m128i *)(s0 + 2 * i + 16));
+		b0 = _mm_loadu_si128((const __m128i *)(s1 + 2 * i));
+		b1 = _mm_loadu_si128((const __m128i *)(s1 + 2 * i + 16));
+		if (uyvy) {
+			ya = _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(a1, 8));
+			yb = _mm_packus_epi16(_mm_srli_epi16(b0, 8), _mm_srli_epi16(b1, 8));
+			c0 = _mm_packus_epi16(_mm_and_si128(a0, lo8), _mm_and_si128(a1, lo8));
+			c1 = _mm_packus_epi16(_mm_and_si128(b0, lo8), _mm_and_si128(b1, lo8));
+		} else {
+			ya = _mm_packus_epi16(_mm_and_si128(a0, lo8), _mm_and_si128(a1, lo8));
+			yb = _mm_packus_epi16(_mm_and_si128(b0, lo8), _mm_and_si128(b1, lo8));
+			c0 = _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(a1, 8));
+			c1 = _mm_packus_epi16(_mm_srli_epi16(b0, 8), _mm_srli_epi16(b1, 8));
+		}
+		c = _mm_avg_epu8(c0, c1);
+		if (swap)
+			c = uv_swap(c);
+		_mm_storeu_si128((__m128i *)(y0 + i), ya);
+		_mm_storeu_si128((__m128i *)(y1 + i), yb);
+		_mm_storeu_si128((__m128i *)(uv + i), c);
+	}
+
+	return i;
+}
+
+static int to422_row_simd(const uint8_t *y, const uint8_t *uv, int uyvy, int swap, uint8_t *d, int n)
+{
+	__m128i yv, c;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		yv = _mm_loadu_si128((const __m128i *)(y + i));
+		c = _mm_loadu_si128((const __m128i *)(uv + i));
+		if (swap)
+			c = uv_swap(c);
+		if (uyvy) {
+			_mm_storeu_si128((__m128i *)(d + 2 * i), _mm_unpacklo_epi8(c, yv));
+			_mm_storeu_si128((__m128i *)(d + 2 * i + 16), _mm_unpackhi_epi8(c, yv));
+		} else {
+			_mm_storeu_si128((__m128i *)(d + 2 * i), _mm_unpacklo_epi8(yv, c));
+			_mm_storeu_si128((__m128i *)(d + 2 * i + 16), _mm_unpackhi_epi8(yv, c));
+		}
+	}
+
+	return i;
+}
+
+#endif
+
+#ifdef IMG_SIMD
+#define SIMD(call)		(simd_enabled ? (call) : 0)
+#else
+#define SIMD(call)		0
+#endif
+
+int img_nv12_box_down(const img_nv12_t *src, img_nv12_t *dst, int factor)
+{
+	int x, y, i, j, n = factor * factor, cw = dst->width / 2;
+	const uint8_t *s;
+	uint8_t *d;
+	uint32_t sum, sum_v;
+
+	if (factor < 1 || dst->width * factor > src->width || dst->height * factor > src->height) {
+		IMP_LOG_ERR(TAG, "box %d of %dx%d into %dx%d\n", factor, src->width, src->height,
+				dst->width, dst->height);
+		return -1;
+	}
+
+	for (y = 0; y < dst->height; y++) {
+		s = src->y + y * factor * src->stride;
+		d = dst->y + y * dst->stride;
+		x = factor == 2 ? SIMD(box2_row_simd(s, s + src->stride, d, dst->width)) : 0;
+		for (; x < dst->width; x++) {
+			sum = 0;
+			for (j = 0; j < factor; j++)
+				for (i = 0; i < factor; i++)
+					sum += s[j * src->stride + x * factor + i];
+			d[x] = (sum + n / 2) / n;
+		}
+	}
+
+	for (y = 0; y < dst->height / 2; y++) {
+		s = src->uv + y * factor * src->stride;
+		d = dst->uv + y * dst->stride;
+		x = factor == 2 && src->nv21 == dst->nv21 ? SIMD(box2_uv_row_simd(s, s + src->stride, d, cw)) : 0;
+		for (; x < cw; x++) {
+			sum = sum_v = 0;
+			for (j = 0; j < factor; j++) {
+				for (i = 0; i < factor; i++) {
+					sum += s[j * src->stride + 2 * (x * factor + i)];
+					sum_v += s[j * src->stride + 2 * (x * factor + i) + 1];
+				}
+			}
+			if (src->nv21 != dst->nv21) {
+				uint32_t t = sum;
+				sum = sum_v;
+				sum_v = t;
+			}
+			d[2 * x] = (sum + n / 2) / n;
+			d[2 * x + 1] = (sum_v + n / 2) / n;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Source position of each of n destination samples of a plane m samples
+ * wide, at pixel centres, in 16.16 fixed point and clamped to the edges:
+ * the integer part and the BL_BITS weight of the next sample.
+ */
+static void bl_map(int m, int n, int *pos, uint8_t *frac)
+{
+	int64_t step = ((int64_t)m << 16) / n, p;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		p = i * step + step / 2 - (1 << 15);
+		if (p < 0)
+			p = 0;
+		if (p > (int64_t)(m - 1) << 16)
+			p = (int64_t)(m - 1) << 16;
+		pos[i] = p >> 16;
+		frac[i] = (p >> (16 - BL_BITS)) & (BL_ONE - 1);
+		/* the last sample has no right neighbour */
+		if (pos[i] == m - 1)
+			frac[i] = 0;
+	}
+}
+
+/* Horizontal pass of one source row, comps samples per pixel, swap U and V */
+static void bl_hrow(const uint8_t *s, int comps, int swap, const int *xpos, const uint8_t *xfrac,
+		int n, uint16_t *h)
+{
+	int x, c, sc, a;
+
+	for (x = 0; x < n; x++) {
+		for (c = 0; c < comps; c++) {
+			sc = swap ? c ^ 1 : c;
+			a = xpos[x] * comps + sc;
+			h[x * comps + c] = s[a] * (BL_ONE - xfrac[x])
+				+ (xfrac[x] ? s[a + comps] * xfrac[x] : 0);
+		}
+	}
+}
+
+static void bl_plane(const uint8_t *s, int s_stride, int sw, int sh, int comps, int swap,
+		uint8_t *d, int d_stride, int dw, int dh, int *xpos, uint8_t *xfrac, int *ypos, uint8_t *yfrac,
+		uint16_t *h0, uint16_t *h1)
+{
+	int x, y, row0 = -1, row1 = -1, y1, n = dw * comps;
+	uint16_t *t;
+
+	bl_map(sw, dw, xpos, xfrac);
+	bl_map(sh, dh, ypos, yfrac);
+
+	for (y = 0; y < dh; y++) {
+		y1 = yfrac[y] ? ypos[y] + 1 : ypos[y];
+		/* going down, the second row of the last line is often the first of this one */
+		if (row1 == ypos[y]) {
+			t = h0;
+			h0 = h1;
+			h1 = t;
+			row0 = row1;
+			row1 = -1;
+		}
+		if (row0 != ypos[y]) {
+			bl_hrow(s + ypos[y] * s_stride, comps, swap, xpos, xfrac, dw, h0);
+			row0 = ypos[y];
+		}
+		if (row1 != y1) {
+			if (y1 == row0)
+				memcpy(h1, h0, n * sizeof(uint16_t));
+			else
+				bl_hrow(s + y1 * s_stride, comps, swap, xpos, xfrac, dw, h1);
+			row1 = y1;
+		}
+
+		x = SIMD(blend_row_simd(h0, h1, yfrac[y], d + y * d_stride, n));
+		for (; x < n; x++)
+			d[y * d_stride + x] = (h0[x] * (BL_ONE - yfrac[y]) + h1[x] * yfrac[y]
+					+ (1 << (2 * BL_BITS - 1))) >> (2 * BL_BITS);
+	}
+}
+
+int img_nv12_bilinear(const img_nv12_t *src, img_nv12_t *dst)
+{
+	int m = src->width > src->height ? src->width : src->height;
+	int *xpos, *ypos;
+	uint8_t *xfrac, *yfrac;
+	uint16_t *h;
+
+	if (dst->width > src->width || dst->height > src->height) {
+		IMP_LOG_ERR(TAG, "bilinear of %dx%d up to %dx%d\n", src->width, src->height,
+				dst->width, dst->height);
+		return -1;
+	}
+
+	xpos = malloc(2 * m * sizeof(int) + 2 * m + 2 * dst->width * sizeof(uint16_t) + 16);
+	if (xpos == NULL) {
+		IMP_LOG_ERR(TAG, "malloc() error !\n");
+		return -1;
+	}
+	ypos = xpos + m;
+	h = (uint16_t *)(ypos + m);
+	xfrac = (uint8_t *)(h + 2 * dst->width);
+	yfrac = xfrac + m;
+
+	bl_plane(src->y, src->stride, src->width, src->height, 1, 0,
+			dst->y, dst->stride, dst->width, dst->height, xpos, xfrac, ypos, yfrac,
+			h, h + dst->width);
+	bl_plane(src->uv, src->stride, src->width / 2, src->height / 2, 2, src->nv21 != dst->nv21,
+			dst->uv, dst->stride, dst->width / 2, dst->height / 2, xpos, xfrac, ypos, yfrac,
+			h, h + dst->width);
+	free(xpos);
+
+	return 0;
+}
+
+void img_nv12_to_gray8(const img_nv12_t *src, uint8_t *dst, int dst_stride)
+{
+	int y;
+
+	/* the luma plane is the picture, memcpy() is as fast as it gets */
+	for (y = 0; y < src->height; y++)
+		memcpy(dst + y * dst_stride, src->y + y * src->stride, src->width);
+}
+
+static inline void yuv2rgb(int y, int u, int v, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+	int c = y - 16, d = u - 128, e = v - 128;
+
+	*r = clip8((298 * c + 409 * e + 128) >> 8);
+	*g = clip8((298 * c - 100 * d - 208 * e + 128) >> 8);
+	*b = clip8((298 * c + 516 * d + 128) >> 8);
+}
+
+void img_nv12_to_rgb24(const img_nv12_t *src, uint8_t *dst, int dst_stride)
+{
+	const uint8_t *s, *c;
+	uint8_t *d;
+	int x, y, u, v;
+
+	for (y = 0; y < src->height; y++) {
+		s = src->y + y * src->stride;
+		c = src->uv + y / 2 * src->stride;
+		d = dst + y * dst_stride;
+		x = SIMD(rgb24_row_simd(s, c, src->nv21, d, src->width));
+		for (; x < src->width; x++) {
+			u = c[x & ~1];
+			v = c[x | 1];
+			if (src->nv21)
+				yuv2rgb(s[x], v, u, &d[3 * x], &d[3 * x + 1], &d[3 * x + 2]);
+			else
+				yuv2rgb(s[x], u, v, &d[3 * x], &d[3 * x + 1], &d[3 * x + 2]);
+		}
+	}
+}
+
+void img_nv12_to_bgra(const img_nv12_t *src, uint8_t *dst, int dst_stride)
+{
+	const uint8_t *s, *c;
+	uint8_t *d;
+	int x, y, u, v;
+
+	for (y = 0; y < src->height; y++) {
+		s = src->y + y * src->stride;
+		c = src->uv + y / 2 * src->stride;
+		d = dst + y * dst_stride;
+		x = SIMD(bgra_row_simd(s, c, src->nv21, d, src->width));
+		for (; x < src->width; x++) {
+			u = c[x & ~1];
+			v = c[x | 1];
+			if (src->nv21)
+				yuv2rgb(s[x], v, u, &d[4 * x + 2], &d[4 * x + 1], &d[4 * x]);
+			else
+				yuv2rgb(s[x], u, v, &d[4 * x + 2], &d[4 * x + 1], &d[4 * x]);
+			d[4 * x + 3] = 255;
+		}
+	}
+}
+
+int img_packed422_to_nv12(const uint8_t *src, int src_stride, IMPPixelFormat fmt, img_nv12_t *dst)
+{
+	const uint8_t *s0, *s1;
+	uint8_t *y0, *y1, *uv;
+	int x, y, uyvy = (fmt == PIX_FMT_UYVY422), yo = uyvy, co = !uyvy, swap = dst->nv21;
+
+	if (fmt != PIX_FMT_YUYV422 && fmt != PIX_FMT_UYVY422) {
+		IMP_LOG_ERR(TAG, "not a packed 422 format: %d\n", fmt);
+		return -1;
+	}
+
+	for (y = 0; y < dst->height; y += 2) {
+		s0 = src + y * src_stride;
+		s1 = s0 + src_stride;
+		y0 = dst->y + y * dst->stride;
+		y1 = y0 + dst->stride;
+		uv = dst->uv + y / 2 * dst->stride;
+		x = SIMD(from422_row_simd(s0, s1, uyvy, swap, y0, y1, uv, dst->width));
+		for (; x < dst->width; x++) {
+			y0[x] = s0[2 * x + yo];
+			y1[x] = s1[2 * x + yo];
+			uv[x ^ swap] = (s0[2 * x + co] + s1[2 * x + co] + 1) >> 1;
+		}
+	}
+
+	return 0;
+}
+
+int img_nv12_to_packed422(const img_nv12_t *src, uint8_t *dst, int dst_stride, IMPPixelFormat fmt)
+{
+	const uint8_t *s, *c;
+	uint8_t *d;
+	int x, y, uyvy = (fmt == PIX_FMT_UYVY422), yo = uyvy, co = !uyvy, swap = src->nv21;
+
+	if (fmt != PIX_FMT_YUYV422 && fmt != PIX_FMT_UYVY422) {
+		IMP_LOG_ERR(TAG, "not a packed 422 format: %d\n", fmt);
+		return -1;
+	}
+
+	/* each chroma row serves the two luma rows it was sampled from */
+	for (y = 0; y < src->height; y++) {
+		s = src->y + y * src->stride;
+		c = src->uv + y / 2 * src->stride;
+		d = dst + y * dst_stride;
+		x = SIMD(to422_row_simd(s, c, uyvy, swap, d, src->width));
+		for (; x < src->width; x++) {
+			d[2 * x + yo] = s[x];
+			d[2 * x + co] = c[x ^ swap];
+		}
+	}
+
+	return 0;
+}
+
+void img_nv12_luma_hist(const img_nv12_t *src, uint32_t hist[256])
+{
+	/*
+	 * Scattered increments do not vectorise; four tables break the
+	 * dependency of runs of equal samples on the same counter instead.
+	 */
+	uint32_t h[4][256];
+	const uint8_t *s;
+	int x, y, i;
+
+	memset(h, 0, sizeof(h));
+	for (y = 0; y < src->height; y++) {
+		s = src->y + y * src->stride;
+		for (x = 0; x + 4 <= src->width; x += 4) {
+			h[0][s[x]]++;
+			h[1][s[x + 1]]++;
+			h[2][s[x + 2]]++;
+			h[3][s[x + 3]]++;
+		}
+		for (; x < src->width; x++)
+			h[0][s[x]]++;
+	}
+
+	for (i = 0; i < 256; i++)
+		hist[i] = h[0][i] + h[1][i] + h[2][i] + h[3][i];
+}
@@ -0,0 +1,84 @@
+/*
+ * sample-imgproc.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_IMGPROC_H__
+#define __SAMPLE_IMGPROC_H__
+
+#include <stdint.h>
+#include <imp/imp_common.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Software image kernels for NV12/NV21 frames: crop, box and bilinear
+ * downscale, conversion to GRAY8, RGB24 and BGRA, to and from
+ * YUYV422/UYVY422, and a luma histogram.
+ *
+ * Every kernel has a scalar reference. Built with -mmsa (MIPS SIMD128)
+ * or on a host with SSE2 the inner loops use 128-bit vectors and give
+ * the very same bytes as the reference; img_set_simd(0) falls back to
+ * the reference, e.g. to compare or time both. Rows of any width work,
+ * the vector loops leave the tail of a row to the scalar code.
+ *
+ * Rounding, the same on every path:
+ *  - box: (sum + n / 2) / n over the n source samples;
+ *  - bilinear: 7-bit weights, horizontal then vertical, rounded once at
+ *    the end, source positions taken at pixel centres;
+ *  - YUV to RGB: BT.601 limited range, 8-bit fixed point coefficients;
+ *  - 422 to 420: the two rows' chroma averaged, rounding up.
+ */
+
+typedef struct img_nv12 {
+	uint8_t		*y;
+	uint8_t		*uv;		/* interleaved chroma, half width and height */
+	int			width;		/* even */
+	int			height;		/* even */
+	int			stride;		/* bytes per row of both planes */
+	int			nv21;		/* V before U */
+} img_nv12_t;
+
+/* A picture at buf, the chroma plane right after height rows of luma */
+int img_nv12_init(img_nv12_t *img, void *buf, int width, int height, int stride, int nv21);
+/* A FrameSource frame in PIX_FMT_NV12 or PIX_FMT_NV21 */
+int img_nv12_from_frame(img_nv12_t *img, const IMPFrameInfo *frame);
+
+/* Part of src without copying, x, y, w and h even */
+int img_nv12_crop_view(const img_nv12_t *src, int x, int y, int w, int h, img_nv12_t *dst);
+/* src into dst of the same size; a crop is a crop view copied */
+int img_nv12_copy(const img_nv12_t *src, img_nv12_t *dst);
+
+/* dst is factor times smaller than src, each pixel the mean of factor x factor */
+int img_nv12_box_down(const img_nv12_t *src, img_nv12_t *dst, int factor);
+/* src to the size of dst, which may not be larger */
+int img_nv12_bilinear(const img_nv12_t *src, img_nv12_t *dst);
+
+void img_nv12_to_gray8(const img_nv12_t *src, uint8_t *dst, int dst_stride);
+/* R, G, B bytes */
+void img_nv12_to_rgb24(const img_nv12_t *src, uint8_t *dst, int dst_stride);
+/* B, G, R, A bytes as PIX_FMT_BGRA, alpha 255 */
+void img_nv12_to_bgra(const img_nv12_t *src, uint8_t *dst, int dst_stride);
+
+/* fmt PIX_FMT_YUYV422 or PIX_FMT_UYVY422, of the size of the NV12 picture */
+int img_packed422_to_nv12(const uint8_t *src, int src_stride, IMPPixelFormat fmt, img_nv12_t *dst);
+int img_nv12_to_packed422(const img_nv12_t *src, uint8_t *dst, int dst_stride, IMPPixelFormat fmt);
+
+void img_nv12_luma_hist(const img_nv12_t *src, uint32_t hist[256]);
+
+/* 0: scalar reference only; returns the vector unit in use, "none" without */
+const char *img_set_simd(int enable);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_IMGPROC_H__ */
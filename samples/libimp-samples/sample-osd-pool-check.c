@@ -0,0 +1,478 @@
+/*
+ * sample-osd-pool-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check and benchmark for the OSD region pool. This file stands
+ * in for the IMP_OSD region calls and keeps each region's state. Each
+ * call spins for a set cost to model the trip into the OSD. Blobs that
+ * move, stop, appear and leave are boxed frame by frame. After every
+ * commit the regions on show must hold exactly the frame's boxes,
+ * clipped. No region may be created or registered after the pool is.
+ * A still frame must make no call. Boxes past the pool's size are
+ * dropped, and so are boxes left empty by clipping. A region whose move
+ * fails must be hidden. A failed create must leave no region behind,
+ * and destroy must leave none registered.
+ * Then the same blobs are boxed with a region created and destroyed
+ * per box and frame, for comparison.
+ *
+ * usage: sample-osd-pool-check [-n frames] [-c us per OSD call]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_osd.h>
+
+#include "sample-osd-pool.h"
+
+#define TAG "Sample-OSD-Pool-Check"
+
+#define GRP				0
+#define FRAME_W			1280
+#define FRAME_H			720
+#define POOL_RGNS		8
+#define MAX_HANDLES		256
+#define NR_BLOBS		10
+
+static int errors;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		IMP_LOG_ERR(TAG, "line %d: %s\n", __LINE__, #cond); \
+		errors++; \
+	} \
+} while (0)
+
+/* The OSD as these stand-ins have it */
+static struct {
+	int		created;
+	int		registered;
+	int		show;
+	IMPRect	rect;
+} rgn[MAX_HANDLES];
+
+static int nr_handles, nr_calls, nr_creates, fail_create_at = -1, fail_set;
+static int call_us;
+
+static void call_cost(void)
+{
+	struct timespec t0, t;
+
+	nr_calls++;
+	if (call_us == 0)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &t);
+	} while ((t.tv_sec - t0.tv_sec) * 1000000 + (t.tv_nsec - t0.tv_nsec) / 1000 < call_us);
+}
+
+static int handle_ok(IMPRgnHandle handle)
+{
+	if (handle < 0 || handle >= nr_handles || !rgn[handle].created) {
+		IMP_LOG_ERR(TAG, "no region %d\n", handle);
+		errors++;
+		return 0;
+	}
+	return 1;
+}
+
+IMPRgnHandle IMP_OSD_CreateRgn(IMPOSDRgnAttr *prAttr)
+{
+	call_cost();
+	if (nr_creates++ == fail_create_at || nr_handles == MAX_HANDLES)
+		return INVHANDLE;
+	/* handles are not reused, so a stale one shows */
+	memset(&rgn[nr_handles], 0, sizeof(rgn[0]));
+	rgn[nr_handles].created = 1;
+	return nr_handles++;
+}
+
+void IMP_OSD_DestroyRgn(IMPRgnHandle handle)
+{
+	call_cost();
+	if (!handle_ok(handle))
+		return;
+	if (rgn[handle].registered)
+		IMP_LOG_ERR(TAG, "region %d destroyed while registered\n", handle), errors++;
+	rgn[handle].created = 0;
+}
+
+int IMP_OSD_RegisterRgn(IMPRgnHandle handle, int grpNum, IMPOSDGrpRgnAttr *pgrAttr)
+{
+	call_cost();
+	if (!handle_ok(handle) || grpNum != GRP)
+		return -1;
+	rgn[handle].registered = 1;
+	return 0;
+}
+
+int IMP_OSD_UnRegisterRgn(IMPRgnHandle handle, int grpNum)
+{
+	call_cost();
+	if (!handle_ok(handle) || !rgn[handle].registered)
+		return -1;
+	rgn[handle].registered = 0;
+	rgn[handle].show = 0;
+	return 0;
+}
+
+int IMP_OSD_SetRgnAttr(IMPRgnHandle handle, IMPOSDRgnAttr *prAttr)
+{
+	IMPRect *r = &prAttr->rect;
+
+	call_cost();
+	if (!handle_ok(handle))
+		return -1;
+	if (fail_set)
+		return -1;
+	if (prAttr->type != OSD_REG_RECT || prAttr->fmt != PIX_FMT_MONOWHITE
+			|| prAttr->data.lineRectData.color != OSD_GREEN
+			|| r->p0.x < 0 || r->p0.y < 0 || r->p1.x >= FRAME_W || r->p1.y >= FRAME_H
+			|| r->p1.x < r->p0.x || r->p1.y < r->p0.y) {
+		IMP_LOG_ERR(TAG, "region %d set to (%d,%d)-(%d,%d)\n", handle, r->p0.x, r->p0.y, r->p1.x, r->p1.y);
+		errors++;
+		return -1;
+	}
+	rgn[handle].rect = *r;
+	return 0;
+}
+
+int IMP_OSD_SetGrpRgnAttr(IMPRgnHandle handle, int grpNum, IMPOSDGrpRgnAttr *pgrAttr)
+{
+	call_cost();
+	if (!handle_ok(handle) || !rgn[handle].registered)
+		return -1;
+	rgn[handle].show = pgrAttr->show;
+	return 0;
+}
+
+int IMP_OSD_ShowRgn(IMPRgnHandle handle, int grpNum, int showFlag)
+{
+	call_cost();
+	if (!handle_ok(handle) || !rgn[handle].registered)
+		return -1;
+	rgn[handle].show = showFlag;
+	return 0;
+}
+
+static int rect_cmp(const void *a, const void *b)
+{
+	return memcmp(a, b, sizeof(IMPRect));
+}
+
+static void clip(IMPRect *r)
+{
+	if (r->p0.x < 0)
+		r->p0.x = 0;
+	if (r->p0.y < 0)
+		r->p0.y = 0;
+	if (r->p1.x >= FRAME_W)
+		r->p1.x = FRAME_W - 1;
+	if (r->p1.y >= FRAME_H)
+		r->p1.y = FRAME_H - 1;
+}
+
+/* The regions on show hold exactly the n boxes */
+static void check_shown(IMPRect *boxes, int n, int frame)
+{
+	IMPRect shown[MAX_HANDLES];
+	int i, nr_shown = 0;
+
+	for (i = 0; i < nr_handles; i++)
+		if (rgn[i].created && rgn[i].registered && rgn[i].show)
+			shown[nr_shown++] = rgn[i].rect;
+	qsort(shown, nr_shown, sizeof(IMPRect), rect_cmp);
+	qsort(boxes, n, sizeof(IMPRect), rect_cmp);
+	if (nr_shown != n || memcmp(shown, boxes, n * sizeof(IMPRect)))
+		IMP_LOG_ERR(TAG, "frame %d: %d regions on show for %d boxes\n", frame, nr_shown, n), errors++;
+}
+
+struct blob {
+	int		x, y, w, h;
+	int		vx, vy;
+	int		still;				/* frames left standing */
+	int		gone;				/* frames left away */
+};
+
+static uint32_t seed = 1;
+
+static int rnd(int n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+static void blob_reset(struct blob *b)
+{
+	b->w = 40 + rnd(200);
+	b->h = 40 + rnd(200);
+	b->x = rnd(FRAME_W) - b->w / 2;
+	b->y = rnd(FRAME_H) - b->h / 2;
+	b->vx = rnd(9) - 4;
+	b->vy = rnd(9) - 4;
+	b->still = 0;
+	b->gone = 0;
+}
+
+/* This frame's boxes; 0 when nothing moved or changed */
+static int blobs_step(struct blob *blob, IMPRect *boxes, int *n)
+{
+	struct blob *b;
+	int changed = 0;
+
+	*n = 0;
+	for (b = blob; b < blob + NR_BLOBS; b++) {
+		if (b->gone) {
+			if (--b->gone == 0) {
+				blob_reset(b);
+				changed = 1;
+			}
+			continue;
+		}
+		if (rnd(200) == 0) {
+			b->gone = 1 + rnd(50);
+			changed = 1;
+			continue;
+		}
+		if (b->still) {
+			b->still--;
+		} else if (rnd(30) == 0) {
+			b->still = rnd(100);
+		} else {
+			b->x += b->vx;
+			b->y += b->vy;
+			/* off the edge a while, then back */
+			if (b->x < -b->w / 2 || b->x > FRAME_W - b->w / 2)
+				b->vx = -b->vx;
+			if (b->y < -b->h / 2 || b->y > FRAME_H - b->h / 2)
+				b->vy = -b->vy;
+			changed = 1;
+		}
+		boxes[*n].p0.x = b->x;
+		boxes[*n].p0.y = b->y;
+		boxes[*n].p1.x = b->x + b->w - 1;
+		boxes[*n].p1.y = b->y + b->h - 1;
+		(*n)++;
+	}
+
+	return changed;
+}
+
+static osd_pool_t *make_pool(int nr)
+{
+	osd_pool_attr_t attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.grpNum = GRP;
+	attr.nr = nr;
+	attr.type = OSD_REG_RECT;
+	attr.color = OSD_GREEN;
+	attr.linewidth = 2;
+	attr.layer = 1;
+	attr.width = FRAME_W;
+	attr.height = FRAME_H;
+
+	return osd_pool_create(&attr);
+}
+
+static void check_edges(void)
+{
+	IMPRect off = { { -50, -50 }, { 20, 30 } }, out = { { FRAME_W, 0 }, { FRAME_W + 9, 9 } };
+	IMPRect in = { { 100, 100 }, { 199, 199 } }, boxes[2];
+	osd_pool_stat_t st;
+	osd_pool_t *pool;
+	int i, handles = nr_handles;
+
+	/* the 3rd region cannot be made: none is left behind */
+	fail_create_at = nr_creates + 2;
+	CHECK(make_pool(4) == NULL);
+	fail_create_at = -1;
+	for (i = handles; i < nr_handles; i++)
+		CHECK(!rgn[i].created);
+
+	pool = make_pool(2);
+	CHECK(pool != NULL);
+	if (pool == NULL)
+		return;
+	osd_pool_begin(pool);
+	CHECK(osd_pool_add(pool, &off) == 0);
+	CHECK(osd_pool_add(pool, &out) < 0);
+	CHECK(osd_pool_add(pool, &in) == 0);
+	CHECK(osd_pool_add(pool, &in) < 0);
+	CHECK(osd_pool_commit(pool) == 4);
+	boxes[0] = off;
+	clip(&boxes[0]);
+	boxes[1] = in;
+	check_shown(boxes, 2, -1);
+
+	/* the same again makes no call, then both go */
+	osd_pool_begin(pool);
+	osd_pool_add(pool, &in);
+	osd_pool_add(pool, &off);
+	CHECK(osd_pool_commit(pool) == 0);
+	osd_pool_begin(pool);
+	CHECK(osd_pool_commit(pool) == 2);
+	check_shown(boxes, 0, -1);
+	/* and come back where they were, only shown */
+	osd_pool_begin(pool);
+	osd_pool_add(pool, &in);
+	CHECK(osd_pool_commit(pool) == 1);
+
+	/* a move that fails hides the box rather than leave it where it was */
+	fail_set = 1;
+	osd_pool_begin(pool);
+	osd_pool_add(pool, &off);
+	CHECK(osd_pool_commit(pool) < 0);
+	fail_set = 0;
+	check_shown(boxes, 0, -1);
+
+	osd_pool_get_stat(pool, &st);
+	CHECK(st.dropped == 2 && st.kept == 2 && st.hidden == 3 && st.shown == 3 && st.call_fail == 1);
+	CHECK(osd_pool_destroy(pool) == 0);
+	for (i = handles; i < nr_handles; i++)
+		CHECK(!rgn[i].created && !rgn[i].registered);
+}
+
+static double frame_us(struct timespec *t0)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0->tv_sec) * 1e6 + (t.tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+/* The blobs with a region per box, created and destroyed each frame */
+static double per_box_regions(int frames, double *calls)
+{
+	struct blob blob[NR_BLOBS];
+	IMPRect boxes[NR_BLOBS];
+	IMPRgnHandle h[NR_BLOBS];
+	IMPOSDRgnAttr rAttr;
+	IMPOSDGrpRgnAttr grAttr;
+	struct timespec t0;
+	double us = 0;
+	int f, i, j, n, start_calls = nr_calls;
+
+	seed = 1;
+	for (i = 0; i < NR_BLOBS; i++)
+		blob_reset(&blob[i]);
+	for (f = 0; f < frames; f++) {
+		blobs_step(blob, boxes, &i);
+		for (j = n = 0; j < i; j++) {
+			clip(&boxes[j]);
+			if (boxes[j].p1.x >= boxes[j].p0.x && boxes[j].p1.y >= boxes[j].p0.y)
+				boxes[n++] = boxes[j];
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (i = 0; i < n && i < POOL_RGNS; i++) {
+			h[i] = IMP_OSD_CreateRgn(NULL);
+			IMP_OSD_RegisterRgn(h[i], GRP, NULL);
+			memset(&rAttr, 0, sizeof(rAttr));
+			rAttr.type = OSD_REG_RECT;
+			rAttr.rect = boxes[i];
+			rAttr.fmt = PIX_FMT_MONOWHITE;
+			rAttr.data.lineRectData.color = OSD_GREEN;
+			rAttr.data.lineRectData.linewidth = 2;
+			IMP_OSD_SetRgnAttr(h[i], &rAttr);
+			memset(&grAttr, 0, sizeof(grAttr));
+			grAttr.layer = 1;
+			IMP_OSD_SetGrpRgnAttr(h[i], GRP, &grAttr);
+			IMP_OSD_ShowRgn(h[i], GRP, 1);
+		}
+		/* shown for the frame, gone before the next */
+		for (i = 0; i < n && i < POOL_RGNS; i++) {
+			IMP_OSD_ShowRgn(h[i], GRP, 0);
+			IMP_OSD_UnRegisterRgn(h[i], GRP);
+			IMP_OSD_DestroyRgn(h[i]);
+		}
+		us += frame_us(&t0);
+		/* handles are not reused here */
+		nr_handles = 0;
+	}
+	*calls = (double)(nr_calls - start_calls) / frames;
+
+	return us / frames;
+}
+
+int main(int argc, char *argv[])
+{
+	struct blob blob[NR_BLOBS];
+	IMPRect boxes[NR_BLOBS];
+	osd_pool_stat_t st;
+	osd_pool_t *pool;
+	double pool_calls, box_calls, box_us;
+	int opt, f, i, n, changed, still = 0, frames = 3000;
+
+	while ((opt = getopt(argc, argv, "n:c:")) != -1) {
+		switch (opt) {
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		case 'c':
+			call_us = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n frames] [-c us per OSD call]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (frames <= 0 || call_us < 0) {
+		fprintf(stderr, "usage: %s [-n frames] [-c us per OSD call]\n", argv[0]);
+		return -1;
+	}
+
+	check_edges();
+
+	nr_handles = nr_calls = 0;
+	pool = make_pool(POOL_RGNS);
+	CHECK(pool != NULL);
+	if (pool == NULL)
+		return -1;
+	n = nr_handles;
+
+	seed = 1;
+	for (i = 0; i < NR_BLOBS; i++)
+		blob_reset(&blob[i]);
+	pool_calls = nr_calls;
+	for (f = 0; f < frames; f++) {
+		changed = blobs_step(blob, boxes, &i);
+		osd_pool_begin(pool);
+		for (n = 0; i > 0; i--)
+			if (osd_pool_add(pool, &boxes[n]) == 0)
+				clip(&boxes[n++]);
+			else
+				memmove(&boxes[n], &boxes[n + 1], (i - 1) * sizeof(IMPRect));
+		CHECK(osd_pool_commit(pool) >= 0);
+		osd_pool_get_stat(pool, &st);
+		if (!changed) {
+			CHECK(st.calls_last == 0);
+			still++;
+		}
+		check_shown(boxes, n, f);
+	}
+	pool_calls = (nr_calls - pool_calls) / frames;
+	CHECK(nr_handles == POOL_RGNS);
+	osd_pool_dump_stat(pool);
+	CHECK(osd_pool_destroy(pool) == 0);
+	for (i = 0; i < nr_handles; i++)
+		CHECK(!rgn[i].created && !rgn[i].registered);
+	if (errors)
+		return -1;
+	printf("ok\n");
+
+	box_us = per_box_regions(frames, &box_calls);
+	printf("%d frames of up to %d boxes (%d still), at %d us per OSD call:\n", frames, POOL_RGNS,
+			still, call_us);
+	printf("  pooled regions     %.2f calls, %.1f us a frame (max %u us)\n", pool_calls,
+			(double)st.us_sum / st.frames, st.us_max);
+	printf("  region per box     %.2f calls, %.1f us a frame\n", box_calls, box_us);
+
+	return 0;
+}
@@ -0,0 +1,353 @@
+/*
+ * sample-osd-pool.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_osd.h>
+
+#include "sample-osd-pool.h"
+
+#define TAG "Sample-OSD-Pool"
+
+/* Where a hidden region waits */
+#define PARK_SIZE			16
+/* Create, register, SetRgnAttr, SetGrpRgnAttr, show, hide, unregister, destroy */
+#define CALLS_PER_NEW_RGN	8
+
+struct pool_rgn {
+	IMPRgnHandle	handle;
+	IMPRect			rect;				/* as the OSD has it */
+	int				show;
+
+	/* the plan of the frame being committed */
+	int				claimed;
+	int				set;
+	int				to_show;
+	IMPRect			next;
+};
+
+struct osd_pool {
+	osd_pool_attr_t		attr;
+	struct pool_rgn		rgn[OSD_POOL_MAX_RGNS];
+	int					nr_rgns;
+	IMPRect				box[OSD_POOL_MAX_RGNS];
+	int					nr_boxes;
+	osd_pool_stat_t		stat;
+};
+
+static int rect_eq(const IMPRect *a, const IMPRect *b)
+{
+	return a->p0.x == b->p0.x && a->p0.y == b->p0.y && a->p1.x == b->p1.x && a->p1.y == b->p1.y;
+}
+
+static int rect_dist(const IMPRect *a, const IMPRect *b)
+{
+	return abs(a->p0.x - b->p0.x) + abs(a->p0.y - b->p0.y) + abs(a->p1.x - b->p1.x) + abs(a->p1.y - b->p1.y);
+}
+
+static int rgn_set_rect(osd_pool_t *pool, struct pool_rgn *r, const IMPRect *rect)
+{
+	IMPOSDRgnAttr rAttr;
+
+	memset(&rAttr, 0, sizeof(IMPOSDRgnAttr));
+	rAttr.type = pool->attr.type;
+	rAttr.rect = *rect;
+	if (pool->attr.type == OSD_REG_RECT) {
+		rAttr.fmt = PIX_FMT_MONOWHITE;
+		rAttr.data.lineRectData.color = pool->attr.color;
+		rAttr.data.lineRectData.linewidth = pool->attr.linewidth;
+	} else {
+		rAttr.fmt = PIX_FMT_BGRA;
+		rAttr.data.coverData.color = pool->attr.color;
+	}
+	if (IMP_OSD_SetRgnAttr(r->handle, &rAttr) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_OSD_SetRgnAttr(%d) error !\n", r->handle);
+		return -1;
+	}
+	r->rect = *rect;
+
+	return 0;
+}
+
+static int rgn_init(osd_pool_t *pool, struct pool_rgn *r)
+{
+	IMPOSDGrpRgnAttr grAttr;
+	IMPRect park = { { 0, 0 }, { PARK_SIZE - 1, PARK_SIZE - 1 } };
+
+	if (rgn_set_rect(pool, r, &park) < 0)
+		return -1;
+
+	memset(&grAttr, 0, sizeof(IMPOSDGrpRgnAttr));
+	grAttr.show = 0;
+	grAttr.layer = pool->attr.layer;
+	grAttr.scalex = 1;
+	grAttr.scaley = 1;
+	if (pool->attr.type == OSD_REG_COVER) {
+		grAttr.gAlphaEn = 1;
+		grAttr.fgAlhpa = 0xff;
+	}
+	if (IMP_OSD_SetGrpRgnAttr(r->handle, pool->attr.grpNum, &grAttr) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_OSD_SetGrpRgnAttr(%d) error !\n", r->handle);
+		return -1;
+	}
+
+	return 0;
+}
+
+osd_pool_t *osd_pool_create(const osd_pool_attr_t *attr)
+{
+	osd_pool_t *pool;
+	struct pool_rgn *r;
+
+	if (attr->nr <= 0 || attr->nr > OSD_POOL_MAX_RGNS
+			|| (attr->type != OSD_REG_RECT && attr->type != OSD_REG_COVER)) {
+		IMP_LOG_ERR(TAG, "pool of %d regions of type %d\n", attr->nr, attr->type);
+		return NULL;
+	}
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		IMP_LOG_ERR(TAG, "calloc pool failed\n");
+		return NULL;
+	}
+	pool->attr = *attr;
+
+	while (pool->nr_rgns < attr->nr) {
+		r = &pool->rgn[pool->nr_rgns];
+		r->handle = IMP_OSD_CreateRgn(NULL);
+		if (r->handle == INVHANDLE) {
+			IMP_LOG_ERR(TAG, "IMP_OSD_CreateRgn %d error !\n", pool->nr_rgns);
+			goto err_rgn;
+		}
+		if (IMP_OSD_RegisterRgn(r->handle, attr->grpNum, NULL) < 0) {
+			IMP_LOG_ERR(TAG, "IMP_OSD_RegisterRgn(%d, %d) failed\n", r->handle, attr->grpNum);
+			IMP_OSD_DestroyRgn(r->handle);
+			goto err_rgn;
+		}
+		pool->nr_rgns++;
+		if (rgn_init(pool, r) < 0)
+			goto err_rgn;
+	}
+
+	return pool;
+
+err_rgn:
+	osd_pool_destroy(pool);
+	return NULL;
+}
+
+int osd_pool_destroy(osd_pool_t *pool)
+{
+	struct pool_rgn *r;
+	int ret = 0;
+
+	if (pool == NULL)
+		return 0;
+
+	for (r = pool->rgn; r < pool->rgn + pool->nr_rgns; r++) {
+		if (r->show && IMP_OSD_ShowRgn(r->handle, pool->attr.grpNum, 0) < 0) {
+			IMP_LOG_ERR(TAG, "IMP_OSD_ShowRgn close %d error\n", r->handle);
+			ret = -1;
+		}
+		if (IMP_OSD_UnRegisterRgn(r->handle, pool->attr.grpNum) < 0) {
+			IMP_LOG_ERR(TAG, "IMP_OSD_UnRegisterRgn %d error\n", r->handle);
+			ret = -1;
+		}
+		IMP_OSD_DestroyRgn(r->handle);
+	}
+	free(pool);
+
+	return ret;
+}
+
+void osd_pool_begin(osd_pool_t *pool)
+{
+	pool->nr_boxes = 0;
+}
+
+int osd_pool_add(osd_pool_t *pool, const IMPRect *rect)
+{
+	IMPRect b = *rect;
+
+	pool->stat.boxes++;
+	if (b.p0.x < 0)
+		b.p0.x = 0;
+	if (b.p0.y < 0)
+		b.p0.y = 0;
+	if (b.p1.x >= pool->attr.width)
+		b.p1.x = pool->attr.width - 1;
+	if (b.p1.y >= pool->attr.height)
+		b.p1.y = pool->attr.height - 1;
+	if (b.p1.x < b.p0.x || b.p1.y < b.p0.y || pool->nr_boxes == pool->nr_rgns) {
+		pool->stat.dropped++;
+		return -1;
+	}
+	pool->box[pool->nr_boxes++] = b;
+
+	return 0;
+}
+
+/* Which region shows which box, and what that takes */
+static void plan(osd_pool_t *pool)
+{
+	struct pool_rgn *r, *best;
+	int box_rgn[OSD_POOL_MAX_RGNS];
+	int b, d, best_d;
+
+	for (r = pool->rgn; r < pool->rgn + pool->nr_rgns; r++)
+		r->claimed = r->set = r->to_show = 0;
+
+	/* on show already */
+	for (b = 0; b < pool->nr_boxes; b++) {
+		box_rgn[b] = -1;
+		for (r = pool->rgn; r < pool->rgn + pool->nr_rgns; r++) {
+			if (r->show && !r->claimed && rect_eq(&r->rect, &pool->box[b])) {
+				r->claimed = 1;
+				box_rgn[b] = r - pool->rgn;
+				pool->stat.kept++;
+				break;
+			}
+		}
+	}
+
+	/* the nearest on show moves */
+	for (b = 0; b < pool->nr_boxes; b++) {
+		if (box_rgn[b] >= 0)
+			continue;
+		best = NULL;
+		best_d = 0;
+		for (r = pool->rgn; r < pool->rgn + pool->nr_rgns; r++) {
+			if (!r->show || r->claimed)
+				continue;
+			d = rect_dist(&r->rect, &pool->box[b]);
+			if (best == NULL || d < best_d) {
+				best = r;
+				best_d = d;
+			}
+		}
+		if (best == NULL)
+			continue;
+		best->claimed = 1;
+		best->set = 1;
+		best->next = pool->box[b];
+		box_rgn[b] = best - pool->rgn;
+	}
+
+	/* then hidden ones, one already in place first */
+	for (b = 0; b < pool->nr_boxes; b++) {
+		if (box_rgn[b] >= 0)
+			continue;
+		best = NULL;
+		for (r = pool->rgn; r < pool->rgn + pool->nr_rgns; r++) {
+			if (r->show || r->claimed)
+				continue;
+			if (best == NULL || rect_eq(&r->rect, &pool->box[b]))
+				best = r;
+			if (rect_eq(&r->rect, &pool->box[b]))
+				break;
+		}
+		best->claimed = 1;
+		best->set = !rect_eq(&best->rect, &pool->box[b]);
+		best->to_show = 1;
+		best->next = pool->box[b];
+	}
+}
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int osd_pool_commit(osd_pool_t *pool)
+{
+	osd_pool_stat_t *s = &pool->stat;
+	struct pool_rgn *r;
+	int calls = 0, ret = 0;
+	uint64_t start;
+	uint32_t us;
+
+	plan(pool);
+
+	start = now_us();
+	for (r = pool->rgn; r < pool->rgn + pool->nr_rgns; r++) {
+		if (!r->set)
+			continue;
+		calls++;
+		if (rgn_set_rect(pool, r, &r->next) < 0) {
+			/* not shown in the wrong place: hidden below if it is on show */
+			r->claimed = 0;
+			r->to_show = 0;
+			s->call_fail++;
+			ret = -1;
+			continue;
+		}
+		s->moved++;
+	}
+	for (r = pool->rgn; r < pool->rgn + pool->nr_rgns; r++) {
+		if (r->to_show) {
+			calls++;
+			if (IMP_OSD_ShowRgn(r->handle, pool->attr.grpNum, 1) < 0) {
+				IMP_LOG_ERR(TAG, "IMP_OSD_ShowRgn(%d) error\n", r->handle);
+				s->call_fail++;
+				ret = -1;
+				continue;
+			}
+			r->show = 1;
+			s->shown++;
+		} else if (r->show && !r->claimed) {
+			calls++;
+			if (IMP_OSD_ShowRgn(r->handle, pool->attr.grpNum, 0) < 0) {
+				IMP_LOG_ERR(TAG, "IMP_OSD_ShowRgn close %d error\n", r->handle);
+				s->call_fail++;
+				ret = -1;
+				continue;
+			}
+			r->show = 0;
+			s->hidden++;
+		}
+	}
+	us = now_us() - start;
+
+	s->frames++;
+	s->calls_last = calls;
+	if (calls > s->calls_max)
+		s->calls_max = calls;
+	s->us_last = us;
+	s->us_sum += us;
+	if (us > s->us_max)
+		s->us_max = us;
+
+	return ret < 0 ? -1 : calls;
+}
+
+void osd_pool_get_stat(osd_pool_t *pool, osd_pool_stat_t *stat)
+{
+	*stat = pool->stat;
+}
+
+void osd_pool_dump_stat(osd_pool_t *pool)
+{
+	osd_pool_stat_t *s = &pool->stat;
+	uint32_t calls = s->moved + s->shown + s->hidden + s->call_fail;
+	double frames = s->frames ? s->frames : 1;
+
+	IMP_LOG_INFO(TAG, "grp%d, %d %s regions: %u frames, %.2f boxes a frame, %u dropped\n",
+			pool->attr.grpNum, pool->nr_rgns, pool->attr.type == OSD_REG_RECT ? "rect" : "cover",
+			s->frames, (s->boxes - s->dropped) / frames, s->dropped);
+	IMP_LOG_INFO(TAG, "boxes kept %u, moved %u, shown %u, hidden %u, %u calls failed\n",
+			s->kept, s->moved, s->shown, s->hidden, s->call_fail);
+	IMP_LOG_INFO(TAG, "OSD per frame: %.2f calls (max %u, %.1f creating a region per box), "
+			"%.1f us (max %u us)\n", calls / frames, s->calls_max,
+			(s->boxes - s->dropped) * CALLS_PER_NEW_RGN / frames, s->us_sum / frames, s->us_max);
+}
@@ -0,0 +1,103 @@
+/*
+ * sample-osd-pool.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_OSD_POOL_H__
+#define __SAMPLE_OSD_POOL_H__
+
+#include <stdint.h>
+#include <imp/imp_common.h>
+#include <imp/imp_osd.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * A pool of OSD_REG_RECT or OSD_REG_COVER regions for boxes that
+ * change every frame, such as one per detected motion blob.
+ *
+ * Creating, registering and destroying a region per box and frame
+ * costs several calls into the OSD each, so the pool does that once.
+ * At create it makes and registers nr regions in the group, each with
+ * its own SetRgnAttr() and SetGrpRgnAttr(), parked and hidden. After
+ * that a region is only reassigned: its rect changes through
+ * IMP_OSD_SetRgnAttr() and its show state through IMP_OSD_ShowRgn().
+ *
+ * A frame's boxes are added between osd_pool_begin() and
+ * osd_pool_commit(). Boxes are clipped to the frame, and those left
+ * empty or past nr are dropped. The commit works out all the changes
+ * from the last frame first, then makes the calls back to back:
+ *  - A box with the same rect as a region on show keeps that region,
+ *    with no call at all.
+ *  - Any other box takes the nearest region on show that is not
+ *    claimed, and moves it with one SetRgnAttr().
+ *  - Past those, a box takes a hidden region: SetRgnAttr(), unless the
+ *    region is already there, then ShowRgn(1).
+ *  - Regions no box claimed are hidden with ShowRgn(0), and so are
+ *    regions whose SetRgnAttr() failed, rather than left on show at the
+ *    old rect; their box is not shown that frame.
+ * A box that moves a little from frame to frame stays in its region.
+ * A still scene then costs no calls.
+ *
+ * Each commit's calls are counted and timed, which is the OSD cost of
+ * the frame. The pool is used from one thread.
+ */
+
+#define OSD_POOL_MAX_RGNS		32
+
+typedef struct osd_pool osd_pool_t;
+
+typedef struct osd_pool_attr {
+	int				grpNum;
+	int				nr;					/* regions, at most OSD_POOL_MAX_RGNS */
+	IMPOsdRgnType	type;				/* OSD_REG_RECT or OSD_REG_COVER */
+	uint32_t		color;				/* OSD_GREEN, ...: the outline or the cover */
+	uint32_t		linewidth;			/* OSD_REG_RECT */
+	int				layer;
+	int				width;				/* of the group's frames */
+	int				height;
+} osd_pool_attr_t;
+
+typedef struct osd_pool_stat {
+	uint32_t	frames;				/* commits */
+	uint32_t	boxes;
+	uint32_t	dropped;			/* empty after clipping, or no region left */
+	uint32_t	kept;				/* boxes on show as they were, no call */
+	uint32_t	moved;				/* IMP_OSD_SetRgnAttr */
+	uint32_t	shown;				/* IMP_OSD_ShowRgn(1) */
+	uint32_t	hidden;				/* IMP_OSD_ShowRgn(0) */
+	uint32_t	call_fail;
+	uint32_t	calls_last;			/* of the last frame */
+	uint32_t	calls_max;
+	uint32_t	us_last;			/* the calls of the last frame */
+	uint32_t	us_max;
+	uint64_t	us_sum;
+} osd_pool_stat_t;
+
+osd_pool_t *osd_pool_create(const osd_pool_attr_t *attr);
+/* Hides, unregisters and destroys the regions */
+int osd_pool_destroy(osd_pool_t *pool);
+
+/* A new frame's boxes, in place of the last frame's */
+void osd_pool_begin(osd_pool_t *pool);
+/* 0, or -1 when the box was dropped */
+int osd_pool_add(osd_pool_t *pool, const IMPRect *rect);
+/* Shows the frame's boxes; returns the calls made, -1 if one failed */
+int osd_pool_commit(osd_pool_t *pool);
+
+void osd_pool_get_stat(osd_pool_t *pool, osd_pool_stat_t *stat);
+void osd_pool_dump_stat(osd_pool_t *pool);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_OSD_POOL_H__ */
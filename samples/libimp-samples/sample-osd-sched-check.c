@@ -0,0 +1,249 @@
+/*
+ * sample-osd-sched-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check for the OSD update scheduler. A timestamp stamp and two
+ * recording tasks are scheduled for a few seconds, one of them slow to
+ * render. Meanwhile a frame thread feeds 25 fps of capture timestamps.
+ * Every tick must render and flip the same second, the one after the
+ * last, and flip it within TOLERANCE_US after the wall clock reached
+ * it. Once the lead has grown past the slow task, no render may run
+ * past its deadline. Most updates must land before the next frame.
+ * Then a render-and-sleep(1) loop, as sample-OSD had, is run for
+ * comparison, and both are shown by how far after the second they
+ * flip.
+ *
+ * usage: sample-osd-sched-check [-t seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_system.h>
+#include <imp/imp_osd.h>
+
+#include "sample-osd-sched.h"
+
+#define TAG "Sample-OSD-Sched-Check"
+
+#define ENC_CHN			0
+#define FPS				25
+#define SLOW_RENDER_US	20000
+/* a busy build host may be that late */
+#define TOLERANCE_US	50000
+#define MAX_TICKS		64
+
+static int errors;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		IMP_LOG_ERR(TAG, "line %d: %s\n", __LINE__, #cond); \
+		errors++; \
+	} \
+} while (0)
+
+struct recorder {
+	int			slow;
+	time_t		rendered;
+	int			n;
+	time_t		sec[MAX_TICKS];
+	int64_t		wall_us[MAX_TICKS];		/* CLOCK_REALTIME at the flip */
+};
+
+static volatile int feeding = 1;
+
+/* The stamp's region, nothing to show on the host */
+int IMP_OSD_UpdateRgnAttrData(IMPRgnHandle handle, IMPOSDRgnAttrData *prAttrData)
+{
+	return 0;
+}
+
+static int64_t wall_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int rec_render(void *arg, time_t sec)
+{
+	struct recorder *r = arg;
+
+	if (r->slow)
+		usleep(SLOW_RENDER_US);
+	r->rendered = sec;
+
+	return 0;
+}
+
+static int rec_flip(void *arg)
+{
+	struct recorder *r = arg;
+
+	if (r->n < MAX_TICKS) {
+		r->sec[r->n] = r->rendered;
+		r->wall_us[r->n] = wall_us();
+		r->n++;
+	}
+
+	return 0;
+}
+
+/* Capture timestamps on a 25 fps grid, as an encoder stream would have them */
+static void *frame_thread(void *arg)
+{
+	osd_sched_t *sched = arg;
+	int64_t next = IMP_System_GetTimeStamp();
+
+	while (feeding) {
+		next += 1000000 / FPS;
+		while (IMP_System_GetTimeStamp() < next)
+			usleep(1000);
+		osd_sched_frame(sched, next);
+	}
+
+	return ((void *)0);
+}
+
+static osd_stamp_t *make_stamp(osd_atlas_t **atlas)
+{
+	static uint32_t glyph[13][8 * 16];
+	osd_glyph_src_t glyphs[13];
+	int i;
+
+	for (i = 0; i < 13; i++) {
+		glyphs[i].c = "0123456789- :"[i];
+		glyphs[i].width = 8;
+		glyphs[i].data = glyph[i];
+	}
+	*atlas = osd_atlas_create(glyphs, 13, 16, PIX_FMT_BGRA, PIX_FMT_BGRA);
+	if (*atlas == NULL)
+		return NULL;
+
+	return osd_stamp_create(1, *atlas, 20 * 8, 16);
+}
+
+static void check_recorder(struct recorder *r, time_t first)
+{
+	int i;
+	int64_t off;
+
+	CHECK(r->n >= 2);
+	if (r->n < 2)
+		return;
+	CHECK(r->sec[0] == first);
+	for (i = 1; i < r->n; i++) {
+		if (r->sec[i] != r->sec[i - 1] + 1)
+			IMP_LOG_ERR(TAG, "tick %d shows %ld after %ld\n", i, (long)r->sec[i], (long)r->sec[i - 1]), errors++;
+		off = r->wall_us[i] - (int64_t)r->sec[i] * 1000000;
+		if (off < 0 || off > TOLERANCE_US)
+			IMP_LOG_ERR(TAG, "tick %d flipped %lld us off its second\n", i, (long long)off), errors++;
+	}
+}
+
+/* How far after the second the updates of sample-OSD's old loop landed */
+static double sleep_loop_offset(int n)
+{
+	double sum = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		/* the render the old loop did, then the update lands */
+		usleep(SLOW_RENDER_US / 4);
+		sum += wall_us() % 1000000;
+		sleep(1);
+	}
+
+	return sum / n / 1000;
+}
+
+int main(int argc, char *argv[])
+{
+	struct recorder fast, slow;
+	osd_sched_t *sched;
+	osd_sched_stat_t stat;
+	osd_atlas_t *atlas;
+	osd_stamp_t *stamp;
+	pthread_t tid;
+	time_t first;
+	double sched_ms = 0;
+	int opt, i, seconds = 4, frames = 0;
+
+	while ((opt = getopt(argc, argv, "t:")) != -1) {
+		switch (opt) {
+		case 't':
+			seconds = atoi(optarg);
+			if (seconds >= 2 && seconds < MAX_TICKS)
+				break;
+		default:
+			fprintf(stderr, "usage: %s [-t seconds]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	memset(&fast, 0, sizeof(fast));
+	memset(&slow, 0, sizeof(slow));
+	slow.slow = 1;
+
+	stamp = make_stamp(&atlas);
+	sched = osd_sched_create(ENC_CHN, FPS);
+	CHECK(stamp != NULL && sched != NULL);
+	if (stamp == NULL || sched == NULL)
+		return -1;
+	CHECK(osd_sched_add_stamp(sched, stamp, "%Y-%m-%d %I:%M:%S") == 0);
+	CHECK(osd_sched_add(sched, "fast", rec_render, rec_flip, &fast) == 0);
+	CHECK(osd_sched_add(sched, "slow", rec_render, rec_flip, &slow) == 0);
+
+	pthread_create(&tid, NULL, frame_thread, sched);
+	first = time(NULL);
+	CHECK(osd_sched_start(sched) == 0);
+	CHECK(osd_sched_add(sched, "late", rec_render, rec_flip, &fast) < 0);
+	usleep(seconds * 1000000 + 200000);
+	CHECK(osd_sched_stop(sched) == 0);
+	feeding = 0;
+	pthread_join(tid, NULL);
+
+	/* the start shows the second under way, a busy host may cross into the next */
+	if (fast.n && fast.sec[0] == first + 1)
+		first++;
+	check_recorder(&fast, first);
+	check_recorder(&slow, first);
+	CHECK(fast.n == slow.n);
+	for (i = 0; i < fast.n && i < slow.n; i++)
+		CHECK(fast.sec[i] == slow.sec[i]);
+
+	osd_sched_get_stat(sched, &stat);
+	osd_sched_dump_stat(sched);
+	CHECK(stat.ticks == fast.n - 1);
+	CHECK(stat.ticks >= seconds - 1);
+	CHECK(stat.skipped == 0);
+	/* only the first slow render, before the lead grew */
+	CHECK(stat.render_late <= 1);
+	CHECK(stat.lead_us >= 2 * SLOW_RENDER_US);
+	for (i = 0; i < OSD_SCHED_FRAMES_HIST; i++)
+		frames += stat.frames[i];
+	CHECK(frames >= stat.ticks - 1);
+	CHECK(stat.frames[0] * 2 > frames);
+	for (i = 1; i < fast.n; i++)
+		sched_ms += (fast.wall_us[i] - (int64_t)fast.sec[i] * 1000000) / 1000.0;
+
+	osd_sched_destroy(sched);
+	osd_stamp_destroy(stamp);
+	osd_atlas_destroy(atlas);
+	if (errors)
+		return -1;
+	printf("ok\n");
+
+	printf("updates land after the second: scheduled %.1f ms, sleep(1) loop %.1f ms\n",
+			sched_ms / (fast.n - 1), sleep_loop_offset(3));
+
+	return 0;
+}
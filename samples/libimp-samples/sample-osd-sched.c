@@ -0,0 +1,372 @@
+/*
+ * sample-osd-sched.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_system.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-osd-sched.h"
+
+#define TAG "Sample-OSD-Sched"
+
+/* Updates waiting for the frames around them */
+#define NR_PENDING			4
+#define STAMP_TEXT_LEN		64
+
+struct sched_task {
+	const char			*name;
+	osd_sched_render_t	render;
+	osd_sched_flip_t	flip;
+	void				*arg;
+};
+
+struct stamp_task {
+	osd_stamp_t			*stamp;
+	char				fmt[STAMP_TEXT_LEN];
+};
+
+struct pending {
+	int64_t		deadline;			/* IMP timestamps */
+	int64_t		done;
+	int			missed;				/* frames captured in between */
+};
+
+struct osd_sched {
+	int					encChn;
+	int					fps;
+	struct sched_task	task[OSD_SCHED_MAX_TASKS];
+	struct stamp_task	stamp[OSD_SCHED_MAX_TASKS];
+	int					nr_tasks;
+	int					nr_stamps;
+
+	pthread_t			tid;
+	volatile int		running;
+	int64_t				imp_base;		/* CLOCK_MONOTONIC minus IMP timestamp, us */
+	int64_t				wall_off;		/* CLOCK_REALTIME minus CLOCK_MONOTONIC, us */
+
+	pthread_mutex_t		mutex;			/* pending and stat */
+	struct pending		pending[NR_PENDING];
+	int					nr_pending;
+	osd_sched_stat_t	stat;
+};
+
+static int64_t clock_us(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t wall_offset(void)
+{
+	int64_t mono = clock_us(CLOCK_MONOTONIC);
+
+	return clock_us(CLOCK_REALTIME) - mono;
+}
+
+static void sleep_until(int64_t mono_us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = mono_us / 1000000;
+	ts.tv_nsec = mono_us % 1000000 * 1000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+osd_sched_t *osd_sched_create(int encChn, int fps)
+{
+	osd_sched_t *sched;
+
+	if (fps <= 0) {
+		IMP_LOG_ERR(TAG, "bad frame rate %d\n", fps);
+		return NULL;
+	}
+
+	sched = calloc(1, sizeof(*sched));
+	if (sched == NULL) {
+		IMP_LOG_ERR(TAG, "calloc sched failed\n");
+		return NULL;
+	}
+	sched->encChn = encChn;
+	sched->fps = fps;
+	sched->stat.lead_us = OSD_SCHED_MIN_LEAD_US;
+	pthread_mutex_init(&sched->mutex, NULL);
+
+	return sched;
+}
+
+int osd_sched_destroy(osd_sched_t *sched)
+{
+	if (sched == NULL)
+		return 0;
+	if (sched->running) {
+		IMP_LOG_ERR(TAG, "destroy while running\n");
+		return -1;
+	}
+	pthread_mutex_destroy(&sched->mutex);
+	free(sched);
+
+	return 0;
+}
+
+int osd_sched_add(osd_sched_t *sched, const char *name, osd_sched_render_t render,
+		osd_sched_flip_t flip, void *arg)
+{
+	struct sched_task *t;
+
+	if (sched->running || sched->nr_tasks == OSD_SCHED_MAX_TASKS) {
+		IMP_LOG_ERR(TAG, "cannot add %s, running or %d tasks\n", name, sched->nr_tasks);
+		return -1;
+	}
+
+	t = &sched->task[sched->nr_tasks++];
+	t->name = name;
+	t->render = render;
+	t->flip = flip;
+	t->arg = arg;
+
+	return 0;
+}
+
+static int stamp_render(void *arg, time_t sec)
+{
+	struct stamp_task *t = arg;
+	char text[STAMP_TEXT_LEN];
+	struct tm tm;
+
+	localtime_r(&sec, &tm);
+	strftime(text, sizeof(text), t->fmt, &tm);
+
+	return osd_stamp_render(t->stamp, text);
+}
+
+static int stamp_flip(void *arg)
+{
+	struct stamp_task *t = arg;
+
+	return osd_stamp_flip(t->stamp);
+}
+
+int osd_sched_add_stamp(osd_sched_t *sched, osd_stamp_t *stamp, const char *fmt)
+{
+	struct stamp_task *t;
+
+	if (sched->nr_stamps == OSD_SCHED_MAX_TASKS || strlen(fmt) >= STAMP_TEXT_LEN) {
+		IMP_LOG_ERR(TAG, "cannot add stamp \"%s\"\n", fmt);
+		return -1;
+	}
+
+	t = &sched->stamp[sched->nr_stamps];
+	t->stamp = stamp;
+	strcpy(t->fmt, fmt);
+	if (osd_sched_add(sched, "stamp", stamp_render, stamp_flip, t) < 0)
+		return -1;
+	sched->nr_stamps++;
+
+	return 0;
+}
+
+/* Once a frame came after the update, the frames before it are counted */
+static void pending_add(osd_sched_t *sched, int64_t deadline, int64_t done)
+{
+	struct pending *p;
+
+	/* nobody feeds frames, or not for a while */
+	if (sched->nr_pending == NR_PENDING) {
+		memmove(&sched->pending[0], &sched->pending[1], (NR_PENDING - 1) * sizeof(struct pending));
+		sched->nr_pending--;
+	}
+	p = &sched->pending[sched->nr_pending++];
+	p->deadline = deadline;
+	p->done = done;
+	p->missed = 0;
+}
+
+static void tick_done(osd_sched_t *sched, int64_t deadline, int64_t start, int64_t done)
+{
+	osd_sched_stat_t *s = &sched->stat;
+	uint32_t late = done > deadline ? done - deadline : 0;
+
+	pthread_mutex_lock(&sched->mutex);
+	s->ticks++;
+	s->late_us_sum += late;
+	if (late > s->late_us_max)
+		s->late_us_max = late;
+	if (done - start > s->flip_us_max)
+		s->flip_us_max = done - start;
+	pending_add(sched, deadline - sched->imp_base, done - sched->imp_base);
+	pthread_mutex_unlock(&sched->mutex);
+}
+
+static void *sched_thread(void *arg)
+{
+	osd_sched_t *sched = arg;
+	osd_sched_stat_t *s = &sched->stat;
+	int64_t deadline, start, end, off;
+	time_t sec, next;
+	uint32_t us;
+	int i;
+
+	sched->wall_off = wall_offset();
+	sec = (clock_us(CLOCK_MONOTONIC) + sched->wall_off) / 1000000;
+
+	/* the second under way at once, not counted, so no region starts empty */
+	for (i = 0; i < sched->nr_tasks; i++) {
+		if (sched->task[i].render(sched->task[i].arg, sec) == 0)
+			sched->task[i].flip(sched->task[i].arg);
+	}
+	sec++;
+
+	while (sched->running) {
+		deadline = (int64_t)sec * 1000000 - sched->wall_off;
+
+		/* pre-render every task's second sec */
+		sleep_until(deadline - s->lead_us);
+		if (!sched->running)
+			break;
+		start = clock_us(CLOCK_MONOTONIC);
+		for (i = 0; i < sched->nr_tasks; i++) {
+			if (sched->task[i].render(sched->task[i].arg, sec) < 0)
+				IMP_LOG_WARN(TAG, "%s: render of %ld failed\n", sched->task[i].name, (long)sec);
+		}
+		end = clock_us(CLOCK_MONOTONIC);
+		us = end - start;
+		pthread_mutex_lock(&sched->mutex);
+		if (us > s->render_us_max) {
+			s->render_us_max = us;
+			if (2 * us > s->lead_us)
+				s->lead_us = 2 * us;
+		}
+		if (end > deadline)
+			s->render_late++;
+		pthread_mutex_unlock(&sched->mutex);
+
+		/* and show them in one go */
+		sleep_until(deadline);
+		start = clock_us(CLOCK_MONOTONIC);
+		for (i = 0; i < sched->nr_tasks; i++)
+			sched->task[i].flip(sched->task[i].arg);
+		end = clock_us(CLOCK_MONOTONIC);
+		tick_done(sched, deadline, start, end);
+
+		/* the next second, unless the wall clock was stepped or we overslept */
+		off = wall_offset();
+		next = sec + 1;
+		if (off - sched->wall_off > OSD_SCHED_RESYNC_US || sched->wall_off - off > OSD_SCHED_RESYNC_US) {
+			sched->wall_off = off;
+			next = (end + off) / 1000000 + 1;
+			pthread_mutex_lock(&sched->mutex);
+			s->resyncs++;
+			pthread_mutex_unlock(&sched->mutex);
+		} else if ((int64_t)next * 1000000 - off - s->lead_us < clock_us(CLOCK_MONOTONIC)) {
+			next = (clock_us(CLOCK_MONOTONIC) + off) / 1000000 + 1;
+			pthread_mutex_lock(&sched->mutex);
+			s->skipped += next - sec - 1;
+			pthread_mutex_unlock(&sched->mutex);
+		}
+		sec = next;
+	}
+
+	return ((void *)0);
+}
+
+int osd_sched_start(osd_sched_t *sched)
+{
+	int ret;
+
+	if (sched->running)
+		return 0;
+
+	sched->imp_base = clock_us(CLOCK_MONOTONIC) - IMP_System_GetTimeStamp();
+	sched->running = 1;
+	ret = pthread_create(&sched->tid, NULL, sched_thread, sched);
+	if (ret) {
+		IMP_LOG_ERR(TAG, "pthread_create failed: %s\n", strerror(ret));
+		sched->running = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+int osd_sched_stop(osd_sched_t *sched)
+{
+	if (!sched->running)
+		return 0;
+
+	sched->running = 0;
+	pthread_join(sched->tid, NULL);
+
+	return 0;
+}
+
+void osd_sched_frame(osd_sched_t *sched, int64_t timestamp)
+{
+	osd_sched_stat_t *s = &sched->stat;
+	struct pending *p;
+	int i = 0;
+
+	pthread_mutex_lock(&sched->mutex);
+	while (i < sched->nr_pending) {
+		p = &sched->pending[i];
+		if (timestamp < p->deadline) {
+			i++;
+		} else if (timestamp < p->done) {
+			p->missed++;
+			i++;
+		} else {
+			s->frames[p->missed < OSD_SCHED_FRAMES_HIST ? p->missed : OSD_SCHED_FRAMES_HIST - 1]++;
+			if (p->missed > s->frames_max)
+				s->frames_max = p->missed;
+			sched->nr_pending--;
+			memmove(p, p + 1, (sched->nr_pending - i) * sizeof(struct pending));
+		}
+	}
+	pthread_mutex_unlock(&sched->mutex);
+}
+
+void osd_sched_stream(osd_sched_t *sched, int encChn, IMPEncoderStream *stream)
+{
+	if (encChn != sched->encChn || stream->packCount == 0)
+		return;
+
+	osd_sched_frame(sched, stream->pack[0].timestamp);
+}
+
+void osd_sched_get_stat(osd_sched_t *sched, osd_sched_stat_t *stat)
+{
+	pthread_mutex_lock(&sched->mutex);
+	*stat = sched->stat;
+	pthread_mutex_unlock(&sched->mutex);
+}
+
+void osd_sched_dump_stat(osd_sched_t *sched)
+{
+	osd_sched_stat_t s;
+	double late;
+
+	osd_sched_get_stat(sched, &s);
+	late = s.ticks ? (double)s.late_us_sum / s.ticks : 0;
+
+	IMP_LOG_INFO(TAG, "%d tasks, %u ticks, %u seconds skipped, %u resyncs; render max %u us, "
+			"lead %u us, %u late\n", sched->nr_tasks, s.ticks, s.skipped, s.resyncs,
+			s.render_us_max, s.lead_us, s.render_late);
+	IMP_LOG_INFO(TAG, "landed %.0f us after the deadline (max %u us, %.2f frames at %d fps), "
+			"batch max %u us\n", late, s.late_us_max, late * sched->fps / 1000000,
+			sched->fps, s.flip_us_max);
+	IMP_LOG_INFO(TAG, "enc%d frames missed per update: 0: %u, 1: %u, 2: %u, 3+: %u (max %u)\n",
+			sched->encChn, s.frames[0], s.frames[1], s.frames[2], s.frames[3], s.frames_max);
+}
@@ -0,0 +1,107 @@
+/*
+ * sample-osd-sched.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_OSD_SCHED_H__
+#define __SAMPLE_OSD_SCHED_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <imp/imp_common.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-osd-stamp.h"
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Frame-synchronous OSD updates, in place of render-then-sleep(1)
+ * loops. Those drift against the frames and now and then skip or
+ * repeat a second.
+ *
+ * At start every task shows the second under way, and the wall clock
+ * is tied to CLOCK_MONOTONIC. Second S is then due at the monotonic
+ * time where the tied wall clock reaches S. The thread sleeps with
+ * clock_nanosleep(TIMER_ABSTIME) for each deadline, so a late wakeup
+ * does not push back the next one. It wakes
+ * lead_us early and has every task render second S into its back
+ * buffer. It sleeps again until the deadline, then flips all the tasks
+ * back to back in one batch. Each tick shows the second after the one
+ * before, so none is skipped or repeated while the clocks hold. If the
+ * thread wakes more than a second late, the missed seconds are counted
+ * as skipped. If the wall clock is stepped (date, NTP) by more than
+ * OSD_SCHED_RESYNC_US, the clocks are tied again and a resync is
+ * counted. The lead follows the slowest render seen, so pre-rendering
+ * finishes before the deadline.
+ *
+ * Each update's lateness is measured from its deadline to the end of
+ * its batch, in IMP_System_GetTimeStamp() time, the clock of the
+ * frame timestamps. Fed with the stream of the encoder channel the OSD
+ * sits in front of (osd_sched_stream()), an update also counts the
+ * frames captured between its deadline and its flip. Those frames may
+ * have gone out with the old second. 0 means the update landed on its
+ * target frame.
+ */
+
+#define OSD_SCHED_MAX_TASKS		8
+#define OSD_SCHED_MIN_LEAD_US	5000
+#define OSD_SCHED_RESYNC_US		100000
+#define OSD_SCHED_FRAMES_HIST	4			/* 0, 1, 2, 3 and more frames off */
+
+typedef struct osd_sched osd_sched_t;
+
+/* Draws second sec (wall clock, seconds since the epoch) into a back buffer */
+typedef int (*osd_sched_render_t)(void *arg, time_t sec);
+/* Shows what was drawn */
+typedef int (*osd_sched_flip_t)(void *arg);
+
+typedef struct osd_sched_stat {
+	uint32_t	ticks;
+	uint32_t	skipped;			/* seconds never shown */
+	uint32_t	resyncs;			/* wall clock stepped */
+	uint32_t	render_late;		/* renders that ran past the deadline */
+	uint32_t	lead_us;			/* the current lead */
+	uint32_t	render_us_max;		/* all tasks of a tick */
+	int64_t		late_us_sum;		/* deadline to the end of the batch */
+	uint32_t	late_us_max;
+	uint32_t	flip_us_max;		/* the batch itself */
+	uint32_t	frames[OSD_SCHED_FRAMES_HIST];	/* updates by frames they missed */
+	uint32_t	frames_max;
+} osd_sched_stat_t;
+
+/* encChn the channel whose streams are fed in, fps its frame rate */
+osd_sched_t *osd_sched_create(int encChn, int fps);
+int osd_sched_destroy(osd_sched_t *sched);
+
+/* Tasks are added before start */
+int osd_sched_add(osd_sched_t *sched, const char *name, osd_sched_render_t render,
+		osd_sched_flip_t flip, void *arg);
+/* A timestamp stamp showing the local time in strftime() format fmt */
+int osd_sched_add_stamp(osd_sched_t *sched, osd_stamp_t *stamp, const char *fmt);
+
+int osd_sched_start(osd_sched_t *sched);
+/* Returns after the tick in progress, within a second */
+int osd_sched_stop(osd_sched_t *sched);
+
+/* Every stream of the channel, from the stream loop */
+void osd_sched_stream(osd_sched_t *sched, int encChn, IMPEncoderStream *stream);
+/* The same with a frame's capture time in IMP_System_GetTimeStamp() time */
+void osd_sched_frame(osd_sched_t *sched, int64_t timestamp);
+
+void osd_sched_get_stat(osd_sched_t *sched, osd_sched_stat_t *stat);
+void osd_sched_dump_stat(osd_sched_t *sched);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_OSD_SCHED_H__ */
@@ -0,0 +1,272 @@
+/*
+ * sample-osd-stamp-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check and benchmark for the OSD timestamp renderer. A font of
+ * glyphs of different widths is made up, and the timestamp of every
+ * second over a day is rendered into a region of sample-OSD's size.
+ * This file stands in for IMP_OSD_UpdateRgnAttrData(). After each
+ * update the picture handed over must match a full redraw of the text,
+ * and the buffers must alternate. The buffer on show must not be
+ * touched until the next one replaces it. Shorter texts, unknown
+ * characters and texts past the right edge are covered too. This runs
+ * for the BGRA atlas and for RGB555LE converted from BGRA glyphs.
+ * Then CPU time per update is timed with dirty glyphs only and with
+ * every glyph redrawn, as the old loop did.
+ *
+ * usage: sample-osd-stamp-check [-n updates to time]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_osd.h>
+
+#include "sample-osd-stamp.h"
+
+#define TAG "Sample-OSD-Stamp-Check"
+
+#define RGN_HANDLE		3
+#define REGION_WIDTH	(20 * 16)
+#define REGION_HEIGHT	34
+#define GLYPH_CHARS		"0123456789- :"
+#define NR_GLYPHS		(sizeof(GLYPH_CHARS) - 1)
+
+static int errors;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		IMP_LOG_ERR(TAG, "line %d: %s\n", __LINE__, #cond); \
+		errors++; \
+	} \
+} while (0)
+
+static uint8_t *glyph_bgra[NR_GLYPHS];
+static int glyph_width[NR_GLYPHS];
+
+/* What the region shows, and a copy of it as it was handed over */
+static void *shown;
+static uint8_t shown_copy[REGION_WIDTH * REGION_HEIGHT * 4];
+static size_t shown_size;
+static int nr_updates;
+
+int IMP_OSD_UpdateRgnAttrData(IMPRgnHandle handle, IMPOSDRgnAttrData *prAttrData)
+{
+	void *p = prAttrData->picData.pData;
+
+	if (handle != RGN_HANDLE) {
+		IMP_LOG_ERR(TAG, "update of region %d\n", handle);
+		errors++;
+		return -1;
+	}
+	if (p == shown)
+		IMP_LOG_ERR(TAG, "update %d hands over the buffer on show\n", nr_updates), errors++;
+	shown = p;
+	memcpy(shown_copy, p, shown_size);
+	nr_updates++;
+
+	return 0;
+}
+
+static void make_font(void)
+{
+	static const int widths[NR_GLYPHS] = { 14, 10, 14, 14, 15, 14, 14, 13, 14, 14, 9, 7, 5 };
+	uint32_t seed = 7;
+	int i, j;
+
+	for (i = 0; i < NR_GLYPHS; i++) {
+		glyph_width[i] = widths[i];
+		glyph_bgra[i] = malloc(widths[i] * REGION_HEIGHT * 4);
+		for (j = 0; j < widths[i] * REGION_HEIGHT * 4; j++) {
+			seed = seed * 1103515245 + 12345;
+			glyph_bgra[i][j] = seed >> 16;
+		}
+	}
+}
+
+static osd_atlas_t *make_atlas(IMPPixelFormat fmt)
+{
+	osd_glyph_src_t glyphs[NR_GLYPHS];
+	int i;
+
+	for (i = 0; i < NR_GLYPHS; i++) {
+		glyphs[i].c = GLYPH_CHARS[i];
+		glyphs[i].width = glyph_width[i];
+		glyphs[i].data = glyph_bgra[i];
+	}
+
+	return osd_atlas_create(glyphs, NR_GLYPHS, REGION_HEIGHT, PIX_FMT_BGRA, fmt);
+}
+
+/* One pixel of the glyph of c in fmt, worked out on its own */
+static void glyph_pixel(int g, int x, int y, IMPPixelFormat fmt, uint8_t *d)
+{
+	const uint8_t *s = glyph_bgra[g] + (y * glyph_width[g] + x) * 4;
+	uint16_t p;
+
+	if (fmt == PIX_FMT_BGRA) {
+		memcpy(d, s, 4);
+		return;
+	}
+	p = (s[3] & 0x80) << 8 | (s[2] & 0xf8) << 7 | (s[1] & 0xf8) << 2 | s[0] >> 3;
+	d[0] = p;
+	d[1] = p >> 8;
+}
+
+/* Full redraw of text from the glyphs */
+static void reference(const char *text, IMPPixelFormat fmt, uint8_t *out)
+{
+	int bytes = fmt == PIX_FMT_BGRA ? 4 : 2;
+	int x0 = 0, x, y, g;
+	const char *c, *pos;
+
+	memset(out, 0, REGION_WIDTH * REGION_HEIGHT * bytes);
+	for (c = text; *c && x0 < REGION_WIDTH; c++) {
+		pos = strchr(GLYPH_CHARS, *c);
+		if (pos == NULL)
+			continue;
+		g = pos - GLYPH_CHARS;
+		for (y = 0; y < REGION_HEIGHT; y++)
+			for (x = 0; x < glyph_width[g] && x0 + x < REGION_WIDTH; x++)
+				glyph_pixel(g, x, y, fmt, out + (y * REGION_WIDTH + x0 + x) * bytes);
+		x0 += glyph_width[g];
+	}
+}
+
+static void check_update(osd_stamp_t *stamp, const char *text, IMPPixelFormat fmt)
+{
+	static uint8_t ref[REGION_WIDTH * REGION_HEIGHT * 4];
+	const pix_view_t *front;
+
+	/* the buffer on show is left alone while the next one is drawn */
+	CHECK(osd_stamp_render(stamp, text) == 0);
+	if (shown)
+		CHECK(memcmp(shown, shown_copy, shown_size) == 0);
+	CHECK(osd_stamp_flip(stamp) == 0);
+
+	front = osd_stamp_front(stamp);
+	CHECK(front != NULL && front->plane[0] == shown);
+	reference(text, fmt, ref);
+	if (memcmp(shown, ref, shown_size))
+		IMP_LOG_ERR(TAG, "%s: \"%s\" differs from a full redraw\n", fmt_to_string(fmt), text), errors++;
+}
+
+static void check_fmt(IMPPixelFormat fmt)
+{
+	static const char *odd[] = {
+		"12:00", "", "1-2 3:4", "1x2?3", "88888888888888888888888888888", "2016-12-31 11:59:59",
+		"2016-12-31 11:59:59", "9",
+	};
+	osd_atlas_t *atlas = make_atlas(fmt);
+	osd_stamp_t *stamp;
+	osd_stamp_stat_t stat;
+	char text[40];
+	struct tm tm;
+	time_t t = 1483228790;	/* 2016-12-31 23:59:50 */
+	int i, first = nr_updates;
+
+	CHECK(atlas != NULL);
+	if (atlas == NULL)
+		return;
+	CHECK(osd_stamp_create(RGN_HANDLE, atlas, REGION_WIDTH, REGION_HEIGHT + 1) == NULL);
+	stamp = osd_stamp_create(RGN_HANDLE, atlas, REGION_WIDTH, REGION_HEIGHT);
+	CHECK(stamp != NULL);
+	if (stamp == NULL)
+		return;
+	CHECK(osd_stamp_front(stamp) == NULL);
+	shown = NULL;
+	shown_size = REGION_WIDTH * REGION_HEIGHT * (fmt == PIX_FMT_BGRA ? 4 : 2);
+
+	/* a day of seconds, across a new year and through noon and midnight */
+	for (i = 0; i < 86400; i++, t++) {
+		gmtime_r(&t, &tm);
+		strftime(text, sizeof(text), "%Y-%m-%d %I:%M:%S", &tm);
+		check_update(stamp, text, fmt);
+	}
+	osd_stamp_get_stat(stamp, &stat);
+	CHECK(nr_updates - first == 86400);
+	/* each buffer is two seconds behind: the last digit, the next one every 10 s */
+	IMP_LOG_INFO(TAG, "%s: %.2f glyphs drawn per update, %.2f kept\n", fmt_to_string(fmt),
+			(double)stat.glyphs_drawn / 86400, (double)stat.glyphs_kept / 86400);
+	CHECK(stat.glyphs_drawn < 86400 * 3 / 2);
+
+	for (i = 0; i < sizeof(odd) / sizeof(odd[0]); i++)
+		check_update(stamp, odd[i], fmt);
+
+	/* a full redraw gives the same picture */
+	osd_stamp_set_full_redraw(stamp, 1);
+	check_update(stamp, "2017-01-01 12:00:00", fmt);
+	check_update(stamp, "2017-01-01 12:00:01", fmt);
+
+	osd_stamp_destroy(stamp);
+	osd_atlas_destroy(atlas);
+}
+
+static double us_per_update(osd_atlas_t *atlas, int full, int n)
+{
+	osd_stamp_t *stamp = osd_stamp_create(RGN_HANDLE, atlas, REGION_WIDTH, REGION_HEIGHT);
+	osd_stamp_stat_t stat;
+	char text[40];
+	struct tm tm;
+	time_t t = 1483228790;
+	int i;
+
+	shown = NULL;
+	shown_size = 0;
+	osd_stamp_set_full_redraw(stamp, full);
+	for (i = 0; i < n; i++, t++) {
+		gmtime_r(&t, &tm);
+		strftime(text, sizeof(text), "%Y-%m-%d %I:%M:%S", &tm);
+		osd_stamp_update(stamp, text);
+	}
+	osd_stamp_get_stat(stamp, &stat);
+	osd_stamp_dump_stat(stamp);
+	osd_stamp_destroy(stamp);
+
+	return stat.cpu_ns / 1000.0 / n;
+}
+
+int main(int argc, char *argv[])
+{
+	static const IMPPixelFormat fmts[] = { PIX_FMT_BGRA, PIX_FMT_RGB555LE };
+	osd_atlas_t *atlas;
+	double dirty, full;
+	int opt, i, n = 200000;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = atoi(optarg);
+			if (n > 0)
+				break;
+		default:
+			fprintf(stderr, "usage: %s [-n updates to time]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	make_font();
+	for (i = 0; i < 2; i++)
+		check_fmt(fmts[i]);
+	if (errors)
+		return -1;
+	printf("ok\n");
+
+	printf("%dx%d region, CPU per update:\n", REGION_WIDTH, REGION_HEIGHT);
+	for (i = 0; i < 2; i++) {
+		atlas = make_atlas(fmts[i]);
+		full = us_per_update(atlas, 1, n);
+		dirty = us_per_update(atlas, 0, n);
+		printf("%-9s full %.2f us, dirty glyphs %.2f us, x%.1f\n", fmt_to_string(fmts[i]),
+				full, dirty, full / dirty);
+		osd_atlas_destroy(atlas);
+	}
+
+	return 0;
+}
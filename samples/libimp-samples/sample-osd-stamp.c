@@ -0,0 +1,321 @@
+/*
+ * sample-osd-stamp.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_osd.h>
+
+#include "sample-osd-stamp.h"
+
+#define TAG "Sample-OSD-Stamp"
+
+struct osd_atlas {
+	pix_view_t		strip;
+	int16_t			x[256];				/* of each character's glyph in the strip, -1 for none */
+	int16_t			width[256];
+};
+
+struct stamp_buf {
+	pix_view_t		view;
+	unsigned char	c[OSD_STAMP_MAX_CHARS];	/* the glyphs in the buffer */
+	int16_t			x[OSD_STAMP_MAX_CHARS];
+	int				n;
+	int				end;				/* pixels in use from the left */
+};
+
+struct osd_stamp {
+	IMPRgnHandle		handle;
+	const osd_atlas_t	*atlas;
+	struct stamp_buf	buf[2];
+	int					back;
+	int					shown;			/* a buffer was handed over */
+	int					full;
+	osd_stamp_stat_t	stat;
+};
+
+static int atlas_fmt_ok(IMPPixelFormat fmt)
+{
+	return fmt == PIX_FMT_BGRA || fmt == PIX_FMT_RGB555LE;
+}
+
+/* Alpha of 128 and more sets the alpha bit */
+static void bgra_to_rgb555le(const uint8_t *s, uint8_t *d, int n)
+{
+	uint16_t p;
+
+	for (; n > 0; n--, s += 4, d += 2) {
+		p = (s[3] >= 0x80 ? 0x8000 : 0) | (s[2] >> 3) << 10 | (s[1] >> 3) << 5 | s[0] >> 3;
+		d[0] = p;
+		d[1] = p >> 8;
+	}
+}
+
+static void rgb555le_to_bgra(const uint8_t *s, uint8_t *d, int n)
+{
+	uint16_t p;
+	uint8_t r, g, b;
+
+	for (; n > 0; n--, s += 2, d += 4) {
+		p = s[0] | s[1] << 8;
+		r = p >> 10 & 0x1f;
+		g = p >> 5 & 0x1f;
+		b = p & 0x1f;
+		d[0] = b << 3 | b >> 2;
+		d[1] = g << 3 | g >> 2;
+		d[2] = r << 3 | r >> 2;
+		d[3] = p & 0x8000 ? 0xff : 0;
+	}
+}
+
+osd_atlas_t *osd_atlas_create(const osd_glyph_src_t *glyphs, int nr_glyphs, int height,
+		IMPPixelFormat src_fmt, IMPPixelFormat fmt)
+{
+	osd_atlas_t *atlas;
+	const uint8_t *s;
+	uint8_t *d;
+	int i, y, x, total = 0, src_bytes, bytes;
+	unsigned char c;
+
+	if (!atlas_fmt_ok(src_fmt) || !atlas_fmt_ok(fmt)) {
+		IMP_LOG_ERR(TAG, "atlas from %s to %s, only bgra and rgb555le\n",
+				fmt_to_string(src_fmt), fmt_to_string(fmt));
+		return NULL;
+	}
+
+	atlas = calloc(1, sizeof(*atlas));
+	if (atlas == NULL) {
+		IMP_LOG_ERR(TAG, "calloc atlas failed\n");
+		return NULL;
+	}
+	memset(atlas->x, 0xff, sizeof(atlas->x));
+
+	for (i = 0; i < nr_glyphs; i++) {
+		c = glyphs[i].c;
+		if (atlas->x[c] >= 0 || glyphs[i].width <= 0 || glyphs[i].data == NULL
+				|| total + glyphs[i].width > INT16_MAX) {
+			IMP_LOG_ERR(TAG, "glyph %d ('%c') twice, empty or past the atlas\n", i, c);
+			goto err_glyph;
+		}
+		atlas->x[c] = total;
+		atlas->width[c] = glyphs[i].width;
+		total += glyphs[i].width;
+	}
+	if (pix_view_alloc(&atlas->strip, fmt, total, height, 1) < 0)
+		goto err_glyph;
+
+	src_bytes = imp_pixfmt_desc(src_fmt)->bpp / 8;
+	bytes = pix_layout_pixel_bytes(&atlas->strip.layout);
+	for (i = 0; i < nr_glyphs; i++) {
+		c = glyphs[i].c;
+		x = atlas->x[c];
+		for (y = 0; y < height; y++) {
+			s = (const uint8_t *)glyphs[i].data + y * glyphs[i].width * src_bytes;
+			d = atlas->strip.plane[0] + y * atlas->strip.layout.stride[0] + x * bytes;
+			if (src_fmt == fmt)
+				memcpy(d, s, glyphs[i].width * bytes);
+			else if (fmt == PIX_FMT_RGB555LE)
+				bgra_to_rgb555le(s, d, glyphs[i].width);
+			else
+				rgb555le_to_bgra(s, d, glyphs[i].width);
+		}
+	}
+
+	return atlas;
+
+err_glyph:
+	free(atlas);
+	return NULL;
+}
+
+void osd_atlas_destroy(osd_atlas_t *atlas)
+{
+	if (atlas == NULL)
+		return;
+	pix_view_free(&atlas->strip);
+	free(atlas);
+}
+
+int osd_atlas_text_width(const osd_atlas_t *atlas, const char *text)
+{
+	const unsigned char *c;
+	int width = 0;
+
+	for (c = (const unsigned char *)text; *c; c++)
+		if (atlas->x[*c] >= 0)
+			width += atlas->width[*c];
+
+	return width;
+}
+
+osd_stamp_t *osd_stamp_create(IMPRgnHandle handle, const osd_atlas_t *atlas, int width, int height)
+{
+	osd_stamp_t *stamp;
+	int i;
+
+	if (height != atlas->strip.layout.height) {
+		IMP_LOG_ERR(TAG, "region %d rows high, glyphs %d\n", height, atlas->strip.layout.height);
+		return NULL;
+	}
+
+	stamp = calloc(1, sizeof(*stamp));
+	if (stamp == NULL) {
+		IMP_LOG_ERR(TAG, "calloc stamp failed\n");
+		return NULL;
+	}
+	stamp->handle = handle;
+	stamp->atlas = atlas;
+
+	/* both start transparent */
+	for (i = 0; i < 2; i++) {
+		if (pix_view_alloc(&stamp->buf[i].view, atlas->strip.layout.fmt, width, height, 1) < 0)
+			goto err_alloc;
+	}
+
+	return stamp;
+
+err_alloc:
+	pix_view_free(&stamp->buf[0].view);
+	free(stamp);
+	return NULL;
+}
+
+void osd_stamp_destroy(osd_stamp_t *stamp)
+{
+	if (stamp == NULL)
+		return;
+	pix_view_free(&stamp->buf[0].view);
+	pix_view_free(&stamp->buf[1].view);
+	free(stamp);
+}
+
+static void draw_glyph(struct stamp_buf *b, const osd_atlas_t *atlas, unsigned char c, int x, int bytes)
+{
+	const pix_layout_t *l = &b->view.layout;
+	const uint8_t *s = atlas->strip.plane[0] + atlas->x[c] * bytes;
+	uint8_t *d = b->view.plane[0] + x * bytes;
+	int y, n = atlas->width[c];
+
+	if (x + n > l->width)
+		n = l->width - x;
+	for (y = 0; y < l->height; y++)
+		memcpy(d + y * l->stride[0], s + y * atlas->strip.layout.stride[0], n * bytes);
+}
+
+int osd_stamp_render(osd_stamp_t *stamp, const char *text)
+{
+	const osd_atlas_t *atlas = stamp->atlas;
+	struct stamp_buf *b = &stamp->buf[stamp->back];
+	const pix_layout_t *l = &b->view.layout;
+	int bytes = pix_layout_pixel_bytes(l);
+	const unsigned char *c;
+	int n = 0, x = 0, y;
+
+	for (c = (const unsigned char *)text; *c && n < OSD_STAMP_MAX_CHARS && x < l->width; c++) {
+		if (atlas->x[*c] < 0)
+			continue;
+		if (!stamp->full && n < b->n && b->c[n] == *c && b->x[n] == x) {
+			stamp->stat.glyphs_kept++;
+		} else {
+			draw_glyph(b, atlas, *c, x, bytes);
+			b->c[n] = *c;
+			b->x[n] = x;
+			stamp->stat.glyphs_drawn++;
+		}
+		x += atlas->width[*c];
+		n++;
+	}
+	if (x > l->width)
+		x = l->width;
+
+	/* what the last text had past the end of this one */
+	if (x < b->end) {
+		for (y = 0; y < l->height; y++)
+			memset(b->view.plane[0] + y * l->stride[0] + x * bytes, 0, (b->end - x) * bytes);
+	}
+	b->n = n;
+	b->end = x;
+
+	return 0;
+}
+
+int osd_stamp_flip(osd_stamp_t *stamp)
+{
+	IMPOSDRgnAttrData data;
+	int ret;
+
+	memset(&data, 0, sizeof(data));
+	data.picData.pData = stamp->buf[stamp->back].view.plane[0];
+	ret = IMP_OSD_UpdateRgnAttrData(stamp->handle, &data);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_OSD_UpdateRgnAttrData(%d) failed\n", stamp->handle);
+		stamp->stat.update_fail++;
+		return -1;
+	}
+	/* the old front one is drawn into next, an update interval from now */
+	stamp->back ^= 1;
+	stamp->shown = 1;
+
+	return 0;
+}
+
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int osd_stamp_update(osd_stamp_t *stamp, const char *text)
+{
+	uint64_t start = thread_cpu_ns();
+	uint32_t ns;
+	int ret;
+
+	ret = osd_stamp_render(stamp, text);
+	if (ret == 0)
+		ret = osd_stamp_flip(stamp);
+
+	ns = thread_cpu_ns() - start;
+	stamp->stat.updates++;
+	stamp->stat.cpu_ns += ns;
+	stamp->stat.cpu_ns_last = ns;
+	if (ns > stamp->stat.cpu_ns_max)
+		stamp->stat.cpu_ns_max = ns;
+
+	return ret;
+}
+
+const pix_view_t *osd_stamp_front(osd_stamp_t *stamp)
+{
+	return stamp->shown ? &stamp->buf[stamp->back ^ 1].view : NULL;
+}
+
+void osd_stamp_set_full_redraw(osd_stamp_t *stamp, int full)
+{
+	stamp->full = full;
+}
+
+void osd_stamp_get_stat(osd_stamp_t *stamp, osd_stamp_stat_t *stat)
+{
+	*stat = stamp->stat;
+}
+
+void osd_stamp_dump_stat(osd_stamp_t *stamp)
+{
+	osd_stamp_stat_t *s = &stamp->stat;
+
+	IMP_LOG_INFO(TAG, "rgn%d: %u updates, %u glyphs drawn, %u kept, %u failed, "
+			"CPU per update %.1f us (max %.1f us)%s\n", stamp->handle, s->updates,
+			s->glyphs_drawn, s->glyphs_kept, s->update_fail,
+			s->updates ? s->cpu_ns / 1000.0 / s->updates : 0.0, s->cpu_ns_max / 1000.0,
+			stamp->full ? ", full redraw" : "");
+}
@@ -0,0 +1,102 @@
+/*
+ * sample-osd-stamp.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_OSD_STAMP_H__
+#define __SAMPLE_OSD_STAMP_H__
+
+#include <stdint.h>
+#include <imp/imp_common.h>
+#include <imp/imp_osd.h>
+
+#include "sample-pixfmt.h"
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * OSD timestamp renderer for an OSD_REG_PIC region.
+ *
+ * The glyphs are packed once into an atlas: one strip, height rows
+ * high, the glyphs side by side and already in the region's pixel
+ * format (PIX_FMT_BGRA or PIX_FMT_RGB555LE, converted from either).
+ * Drawing a glyph is then a memcpy per row.
+ *
+ * The stamp keeps two region buffers. The region shows the front one
+ * while the next text is drawn into the back one. The back buffer is
+ * then handed over with IMP_OSD_UpdateRgnAttrData(), so the OSD never
+ * reads a half-drawn picture. Each buffer remembers the glyphs it
+ * holds and where. A glyph is redrawn only when its buffer held a
+ * different glyph at that position, and the area past the end of a
+ * shorter text is cleared. From one update to the next that is usually
+ * one or two digits, not the whole string. Both buffers are compared
+ * against their own earlier content, not against each other. Glyphs are
+ * laid out with their own widths, from x = 0; characters without a
+ * glyph are skipped, and glyphs past the region's right edge are clipped.
+ *
+ * The CPU time of every update (drawing and handing over) is counted,
+ * so it can be compared with redrawing everything
+ * (osd_stamp_set_full_redraw()). A stamp is used from one thread.
+ */
+
+#define OSD_STAMP_MAX_CHARS		64
+
+typedef struct osd_atlas osd_atlas_t;
+typedef struct osd_stamp osd_stamp_t;
+
+/* One glyph as the font tables have it: height rows of width pixels */
+typedef struct osd_glyph_src {
+	char			c;
+	int				width;
+	const void		*data;
+} osd_glyph_src_t;
+
+typedef struct osd_stamp_stat {
+	uint32_t	updates;
+	uint32_t	glyphs_drawn;		/* copied into a buffer */
+	uint32_t	glyphs_kept;		/* already in the buffer, left alone */
+	uint32_t	update_fail;		/* IMP_OSD_UpdateRgnAttrData failed */
+	uint64_t	cpu_ns;				/* thread CPU time in updates, all of them */
+	uint32_t	cpu_ns_max;
+	uint32_t	cpu_ns_last;
+} osd_stamp_stat_t;
+
+/* Glyphs in src_fmt, packed into an atlas in fmt */
+osd_atlas_t *osd_atlas_create(const osd_glyph_src_t *glyphs, int nr_glyphs, int height,
+		IMPPixelFormat src_fmt, IMPPixelFormat fmt);
+void osd_atlas_destroy(osd_atlas_t *atlas);
+/* Width of text in pixels */
+int osd_atlas_text_width(const osd_atlas_t *atlas, const char *text);
+
+/* A width x height region in the atlas' format; the atlas must outlive it */
+osd_stamp_t *osd_stamp_create(IMPRgnHandle handle, const osd_atlas_t *atlas, int width, int height);
+void osd_stamp_destroy(osd_stamp_t *stamp);
+
+/* Draws text into the back buffer, nothing is shown yet */
+int osd_stamp_render(osd_stamp_t *stamp, const char *text);
+/* Hands the back buffer to the region, it becomes the front one */
+int osd_stamp_flip(osd_stamp_t *stamp);
+/* Both, timed */
+int osd_stamp_update(osd_stamp_t *stamp, const char *text);
+
+/* The buffer the region shows, NULL before the first flip */
+const pix_view_t *osd_stamp_front(osd_stamp_t *stamp);
+/* 1: every update redraws every glyph, as the old loop did */
+void osd_stamp_set_full_redraw(osd_stamp_t *stamp, int full);
+
+void osd_stamp_get_stat(osd_stamp_t *stamp, osd_stamp_stat_t *stat);
+void osd_stamp_dump_stat(osd_stamp_t *stamp);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_OSD_STAMP_H__ */
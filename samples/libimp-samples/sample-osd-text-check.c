@@ -0,0 +1,455 @@
+/*
+ * sample-osd-text-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check and benchmark for the text OSD engine. An HZK16 file of
+ * made-up GB2312 glyphs is written to /tmp. Labels are shown through
+ * this file's IMP_OSD_UpdateRgnAttrData(), and each is compared with a
+ * reference drawn straight from the font bits. The labels cover ASCII,
+ * GB2312 and the same text in UTF-8, lines, alignment, wrapping,
+ * clipping, characters without a glyph, scale 2 in RGB555LE, and a
+ * glyph cache far smaller than the label. The same label set twice
+ * must not be drawn again, and the buffers handed over must alternate.
+ * Then CPU time per label is timed with a warm cache, with a cache too
+ * small to hold a label, and for unchanged labels.
+ *
+ * usage: sample-osd-text-check [-n labels to time]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <iconv.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_osd.h>
+
+#include "sample-osd-text.h"
+#include "osdfont_ascii_8x16.h"
+
+#define TAG "Sample-OSD-Text-Check"
+
+#define RGN_HANDLE		5
+#define MAX_W			320
+#define MAX_H			160
+
+static int errors;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		IMP_LOG_ERR(TAG, "line %d: %s\n", __LINE__, #cond); \
+		errors++; \
+	} \
+} while (0)
+
+static char hzk_path[] = "/tmp/osd-text-hzk16-XXXXXX";
+static const void *shown;
+static int nr_updates;
+
+int IMP_OSD_UpdateRgnAttrData(IMPRgnHandle handle, IMPOSDRgnAttrData *prAttrData)
+{
+	if (handle != RGN_HANDLE) {
+		IMP_LOG_ERR(TAG, "update of region %d\n", handle);
+		errors++;
+		return -1;
+	}
+	if (prAttrData->picData.pData == shown)
+		IMP_LOG_ERR(TAG, "update %d hands over the buffer on show\n", nr_updates), errors++;
+	shown = prAttrData->picData.pData;
+	nr_updates++;
+
+	return 0;
+}
+
+/* Row r of the made-up glyph of GB2312 code gb */
+static uint16_t hzk_row(uint16_t gb, int r)
+{
+	uint32_t h = (gb * 16 + r) * 2654435761u;
+
+	return h >> 16;
+}
+
+static int write_hzk(void)
+{
+	uint8_t glyph[32];
+	int fd, hi, lo, r;
+	FILE *fp;
+
+	fd = mkstemp(hzk_path);
+	fp = fd < 0 ? NULL : fdopen(fd, "w");
+	if (fp == NULL) {
+		IMP_LOG_ERR(TAG, "cannot write %s\n", hzk_path);
+		return -1;
+	}
+	for (hi = 0xa1; hi <= 0xfe; hi++) {
+		for (lo = 0xa1; lo <= 0xfe; lo++) {
+			for (r = 0; r < 16; r++) {
+				glyph[2 * r] = hzk_row(hi << 8 | lo, r) >> 8;
+				glyph[2 * r + 1] = hzk_row(hi << 8 | lo, r);
+			}
+			fwrite(glyph, 1, sizeof(glyph), fp);
+		}
+	}
+	fclose(fp);
+
+	return 0;
+}
+
+struct ref {
+	IMPPixelFormat	fmt;
+	int				scale;
+	uint32_t		fg, bg;
+	int				hzk;		/* the GB2312 glyphs are there */
+	int				width, height;
+	uint8_t			pic[MAX_W * MAX_H * 4];
+};
+
+static void ref_pixel(const struct ref *r, uint32_t argb, uint8_t *d)
+{
+	uint16_t p;
+
+	if (r->fmt == PIX_FMT_BGRA) {
+		d[0] = argb;
+		d[1] = argb >> 8;
+		d[2] = argb >> 16;
+		d[3] = argb >> 24;
+		return;
+	}
+	p = (argb >> 31) << 15 | (argb >> 19 & 0x1f) << 10 | (argb >> 11 & 0x1f) << 5 | (argb >> 3 & 0x1f);
+	d[0] = p;
+	d[1] = p >> 8;
+}
+
+static void ref_clear(struct ref *r)
+{
+	int i, bytes = r->fmt == PIX_FMT_BGRA ? 4 : 2;
+
+	for (i = 0; i < r->width * r->height; i++)
+		ref_pixel(r, r->bg, r->pic + i * bytes);
+}
+
+/*
+ * One line of ASCII and GB2312 pairs, 0xff for a box, at x, y.
+ * Returns the x after it.
+ */
+static int ref_line(struct ref *r, const char *line, int x, int y)
+{
+	static const uint16_t box[16] = {
+		0, 0, 0x3ffc, 0x2004, 0x2004, 0x2004, 0x2004, 0x2004,
+		0x2004, 0x2004, 0x2004, 0x2004, 0x2004, 0x3ffc, 0, 0,
+	};
+	const unsigned char *c = (const unsigned char *)line;
+	int bytes = r->fmt == PIX_FMT_BGRA ? 4 : 2;
+	uint16_t rows[16];
+	int w, i, px, py;
+
+	while (*c) {
+		if (*c < 0x80) {
+			for (i = 0; i < 16; i++)
+				rows[i] = osdfont_ascii_8x16[*c - OSDFONT_ASCII_FIRST][i] << 8;
+			w = 8;
+			c++;
+		} else if (*c == 0xff || !r->hzk) {
+			memcpy(rows, box, sizeof(rows));
+			w = 16;
+			c += *c == 0xff ? 1 : 2;
+		} else {
+			for (i = 0; i < 16; i++)
+				rows[i] = hzk_row(c[0] << 8 | c[1], i);
+			w = 16;
+			c += 2;
+		}
+		for (py = 0; py < 16 * r->scale; py++) {
+			for (px = 0; px < w * r->scale; px++) {
+				if (x + px >= r->width || y + py >= r->height)
+					continue;
+				ref_pixel(r, rows[py / r->scale] & 0x8000 >> px / r->scale ? r->fg : r->bg,
+						r->pic + ((y + py) * r->width + x + px) * bytes);
+			}
+		}
+		x += w * r->scale;
+	}
+
+	return x;
+}
+
+static int ref_width(const struct ref *r, const char *line)
+{
+	const unsigned char *c = (const unsigned char *)line;
+	int w = 0;
+
+	for (; *c; c += *c < 0x80 || *c == 0xff ? 1 : 2)
+		w += (*c < 0x80 ? 8 : 16) * r->scale;
+
+	return w;
+}
+
+/* Lines as the label should lay them out */
+static void ref_label(struct ref *r, const char **lines, int n, int align, int gap)
+{
+	int i, x;
+
+	ref_clear(r);
+	for (i = 0; i < n; i++) {
+		x = 0;
+		if (align == OSD_TEXT_CENTER)
+			x = (r->width - ref_width(r, lines[i])) / 2;
+		else if (align == OSD_TEXT_RIGHT)
+			x = r->width - ref_width(r, lines[i]);
+		ref_line(r, lines[i], x < 0 ? 0 : x, i * (16 * r->scale + gap));
+	}
+}
+
+static void check_label(osd_text_t *text, struct ref *r, const char *str, int enc,
+		const char **lines, int n, int align, int gap)
+{
+	const pix_view_t *front;
+	int updates = nr_updates;
+
+	CHECK(osd_text_set(text, str, enc) == 0);
+	CHECK(nr_updates == updates + 1);
+	front = osd_text_front(text);
+	CHECK(front != NULL && front->plane[0] == shown);
+	if (front == NULL)
+		return;
+	ref_label(r, lines, n, align, gap);
+	if (memcmp(front->plane[0], r->pic, front->layout.size))
+		IMP_LOG_ERR(TAG, "%s x%d: \"%s\" differs from the reference\n", fmt_to_string(r->fmt),
+				r->scale, lines[0]), errors++;
+}
+
+static osd_font_t *make_font(struct ref *r, int cache_bytes)
+{
+	osd_font_attr_t attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.fmt = r->fmt;
+	attr.scale = r->scale;
+	attr.fg = r->fg;
+	attr.bg = r->bg;
+	attr.hzk_path = r->hzk ? hzk_path : "/nonexistent/hzk16";
+	attr.cache_bytes = cache_bytes;
+
+	return osd_font_create(&attr);
+}
+
+static void check_bgra(int utf8)
+{
+	static struct ref r = { PIX_FMT_BGRA, 1, 0xffffffff, 0, 1, 160, 48 };
+	const char *l[3];
+	osd_font_t *font = make_font(&r, 64 * 1024);
+	osd_text_t *text = osd_text_create(RGN_HANDLE, font, r.width, r.height);
+	osd_text_stat_t ts;
+	int updates, w, h;
+
+	CHECK(font != NULL && text != NULL);
+	if (font == NULL || text == NULL)
+		return;
+	shown = NULL;
+	CHECK(osd_text_front(text) == NULL);
+
+	l[0] = "Cam 01";
+	check_label(text, &r, "Cam 01", OSD_TEXT_UTF8, l, 1, OSD_TEXT_LEFT, 0);
+	/* the same label again is not drawn */
+	updates = nr_updates;
+	CHECK(osd_text_set(text, "Cam 01", OSD_TEXT_UTF8) == 0);
+	CHECK(nr_updates == updates);
+
+	l[0] = "Gate \xd6\xd0\xce\xc4";
+	l[1] = "{[x]} ~";
+	check_label(text, &r, "Gate \xd6\xd0\xce\xc4\n{[x]} ~", OSD_TEXT_GB2312, l, 2, OSD_TEXT_LEFT, 0);
+	if (utf8) {
+		/* as UTF-8 the same, redrawn as the encoding differs */
+		check_label(text, &r, "Gate \xe4\xb8\xad\xe6\x96\x87\n{[x]} ~", OSD_TEXT_UTF8, l, 2,
+				OSD_TEXT_LEFT, 0);
+		/* not in GB2312, and not UTF-8 */
+		l[0] = "A\xff" "B\xff" "C\xff";
+		check_label(text, &r, "A\xe2\x82\xac" "B\xf0\x9f\x98\x80" "C\xff", OSD_TEXT_UTF8, l, 1,
+				OSD_TEXT_LEFT, 0);
+	}
+
+	/* a new layout redraws the same text; a shorter one clears the old */
+	osd_text_set_layout(text, OSD_TEXT_RIGHT, 0, 0);
+	l[0] = "1";
+	l[1] = "\xd6\xd0";
+	check_label(text, &r, "1\n\xd6\xd0", OSD_TEXT_GB2312, l, 2, OSD_TEXT_RIGHT, 0);
+	l[0] = "7";
+	check_label(text, &r, "7", OSD_TEXT_GB2312, l, 1, OSD_TEXT_RIGHT, 0);
+	osd_text_set_layout(text, OSD_TEXT_CENTER, 8, 0);
+	l[0] = "x";
+	check_label(text, &r, "x", OSD_TEXT_GB2312, l, 1, OSD_TEXT_CENTER, 8);
+
+	/* 3 lines 24 pixels apart in 48 rows */
+	l[0] = "one";
+	l[1] = "two";
+	check_label(text, &r, "one\ntwo\nthree", OSD_TEXT_UTF8, l, 2, OSD_TEXT_CENTER, 8);
+	osd_text_get_stat(text, &ts);
+	CHECK(ts.clipped == 1);
+	CHECK(ts.unchanged == 1);
+
+	CHECK(osd_font_measure(font, "ab\n\xd6\xd0\xce\xc4" "c", OSD_TEXT_GB2312, 3, &w, &h) == 0);
+	CHECK(w == 40 && h == 35);
+	osd_text_destroy(text);
+
+	/* wrapped at 40 pixels, before the glyph that would cross */
+	text = osd_text_create(RGN_HANDLE, font, 40, r.height);
+	r.width = 40;
+	osd_text_set_layout(text, OSD_TEXT_LEFT, 0, 1);
+	l[0] = "ABCDE";
+	l[1] = "FGHIJ";
+	check_label(text, &r, "ABCDEFGHIJ", OSD_TEXT_UTF8, l, 2, OSD_TEXT_LEFT, 0);
+	l[0] = "AB\xd6\xd0" "C";
+	l[1] = "D";
+	check_label(text, &r, "AB\xd6\xd0" "CD", OSD_TEXT_GB2312, l, 2, OSD_TEXT_LEFT, 0);
+	osd_text_destroy(text);
+	osd_font_dump_stat(font);
+	osd_font_destroy(font);
+}
+
+static void check_rgb555(void)
+{
+	/* semi-opaque black behind, as alpha bit 1 */
+	static struct ref r = { PIX_FMT_RGB555LE, 2, 0xffffff00, 0x80000000, 1, 320, 160 };
+	char label[64], first[8], second[16];
+	const char *l[2];
+	osd_font_t *font;
+	osd_text_t *text;
+	osd_font_stat_t fs;
+	int i;
+
+	/* 4 slots, 12 glyphs a label */
+	font = make_font(&r, 4 * 32 * 32 * 2);
+	text = osd_text_create(RGN_HANDLE, font, r.width, r.height);
+	CHECK(font != NULL && text != NULL);
+	if (font == NULL || text == NULL)
+		return;
+	shown = NULL;
+	osd_text_set_layout(text, OSD_TEXT_CENTER, 4, 0);
+
+	for (i = 0; i < 4; i++) {
+		snprintf(first, sizeof(first), "CH%d", i);
+		snprintf(second, sizeof(second), "\xb0\xa1\xb0\xa2\xb0\xa3\xb0\xa4\xb0\xa5\xb0%c", 0xa6 + i);
+		snprintf(label, sizeof(label), "%s\n%s", first, second);
+		l[0] = first;
+		l[1] = second;
+		check_label(text, &r, label, OSD_TEXT_GB2312, l, 2, OSD_TEXT_CENTER, 4);
+	}
+	osd_font_get_stat(font, &fs);
+	CHECK(fs.slots == 4);
+	CHECK(fs.evictions > 0);
+	CHECK(fs.missing == 0);
+	osd_font_dump_stat(font);
+	osd_text_destroy(text);
+	osd_font_destroy(font);
+
+	/* no HZK16: GB2312 shows as boxes */
+	r.hzk = 0;
+	r.width = 96;
+	r.height = 32;
+	font = make_font(&r, 64 * 1024);
+	text = osd_text_create(RGN_HANDLE, font, r.width, r.height);
+	shown = NULL;
+	l[0] = "a\xd6\xd0";
+	check_label(text, &r, "a\xd6\xd0", OSD_TEXT_GB2312, l, 1, OSD_TEXT_LEFT, 0);
+	osd_text_destroy(text);
+	osd_font_destroy(font);
+}
+
+static double us_per_label(int cache_bytes, int n, osd_font_stat_t *fs)
+{
+	static struct ref r = { PIX_FMT_BGRA, 2, 0xffffffff, 0, 1, 320, 68 };
+	static const char *labels[2] = {
+		"CH0 Front Gate\n\xc7\xb0\xc3\xc5\xb1\xb1\xb2\xe0 01",
+		"CH1 Front Gate\n\xc7\xb0\xc3\xc5\xb1\xb1\xb2\xe0 02",
+	};
+	osd_font_t *font = make_font(&r, cache_bytes);
+	osd_text_t *text = osd_text_create(RGN_HANDLE, font, r.width, r.height);
+	osd_text_stat_t ts;
+	int i;
+
+	shown = NULL;
+	osd_text_set_layout(text, OSD_TEXT_LEFT, 4, 0);
+	for (i = 0; i < n; i++)
+		osd_text_set(text, labels[i & 1], OSD_TEXT_GB2312);
+	osd_text_get_stat(text, &ts);
+	osd_font_get_stat(font, fs);
+	osd_text_dump_stat(text);
+	osd_font_dump_stat(font);
+	osd_text_destroy(text);
+	osd_font_destroy(font);
+
+	return ts.cpu_ns / 1000.0 / ts.renders;
+}
+
+/* Unchanged labels are not timed by the engine */
+static double us_unchanged(int n)
+{
+	static struct ref r = { PIX_FMT_BGRA, 2, 0xffffffff, 0, 1, 320, 68 };
+	osd_font_t *font = make_font(&r, 64 * 1024);
+	osd_text_t *text = osd_text_create(RGN_HANDLE, font, r.width, r.height);
+	struct timespec t0, t1;
+	int i;
+
+	shown = NULL;
+	osd_text_set(text, "CH0 Front Gate\n\xc7\xb0\xc3\xc5\xb1\xb1\xb2\xe0 01", OSD_TEXT_GB2312);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++)
+		osd_text_set(text, "CH0 Front Gate\n\xc7\xb0\xc3\xc5\xb1\xb1\xb2\xe0 01", OSD_TEXT_GB2312);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	osd_text_destroy(text);
+	osd_font_destroy(font);
+
+	return ((t1.tv_sec - t0.tv_sec) * 1e9 + t1.tv_nsec - t0.tv_nsec) / 1000.0 / n;
+}
+
+int main(int argc, char *argv[])
+{
+	osd_font_stat_t warm, cold;
+	iconv_t cd;
+	double w, c, u;
+	int opt, utf8, n = 20000;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = atoi(optarg);
+			if (n > 0)
+				break;
+		default:
+			fprintf(stderr, "usage: %s [-n labels to time]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if (write_hzk() < 0)
+		return -1;
+	cd = iconv_open("GB2312", "UTF-8");
+	utf8 = cd != (iconv_t)-1;
+	if (utf8)
+		iconv_close(cd);
+	else
+		IMP_LOG_WARN(TAG, "no UTF-8 to GB2312 iconv here, UTF-8 labels not checked\n");
+
+	check_bgra(utf8);
+	check_rgb555();
+	if (errors) {
+		unlink(hzk_path);
+		return -1;
+	}
+	printf("ok\n");
+
+	/* a 2 x 16 glyph label at scale 2, two labels taking turns */
+	w = us_per_label(256 * 1024, n, &warm);
+	c = us_per_label(2 * 32 * 32 * 4, n, &cold);
+	u = us_unchanged(n * 10);
+	printf("320x68 bgra label, CPU per label: warm cache %.2f us (%.1f%% hits), "
+			"2-slot cache %.2f us (%u file reads), unchanged %.3f us\n",
+			w, 100.0 * warm.hits / warm.lookups, c, cold.file_reads, u);
+	unlink(hzk_path);
+
+	return 0;
+}
@@ -0,0 +1,690 @@
+/*
+ * sample-osd-text.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <iconv.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_osd.h>
+
+#include "sample-osd-text.h"
+#include "osdfont_ascii_8x16.h"
+
+#define TAG "Sample-OSD-Text"
+
+/*
+ * Cache keys: ASCII and other Unicode code points as they are, GB2312
+ * codes given as such with KEY_GB set, and KEY_BOX for bytes that are
+ * no character at all.
+ */
+#define KEY_GB				0x80000000
+#define KEY_BOX				0x40000000
+
+#define HZK_ROWS			94
+#define HZK_GLYPH_BYTES		32
+
+/* The glyph of characters without one */
+static const uint16_t box_16x16[OSD_FONT_ROWS] = {
+	0x0000, 0x0000, 0x3ffc, 0x2004, 0x2004, 0x2004, 0x2004, 0x2004,
+	0x2004, 0x2004, 0x2004, 0x2004, 0x2004, 0x3ffc, 0x0000, 0x0000,
+};
+
+struct glyph_slot {
+	uint32_t	key;
+	int			prev;				/* LRU list, most recent first */
+	int			next;
+	int			hnext;				/* hash chain */
+};
+
+struct osd_font {
+	IMPPixelFormat		fmt;
+	int					scale;
+	int					bytes;			/* per pixel */
+	uint8_t				fg[4];			/* in fmt */
+	uint8_t				bg[4];
+	int					bg_zero;
+	int					fd;				/* HZK16, -1 for none */
+	iconv_t				cd;				/* UTF-8 to GB2312, (iconv_t)-1 for none */
+
+	struct glyph_slot	*slot;
+	uint8_t				*pool;
+	int					nr_slots;
+	int					used;
+	int					slot_w;			/* pixels */
+	int					slot_bytes;
+	int					mru;
+	int					lru;
+	int					*bucket;
+	uint32_t			hash_mask;
+	osd_font_stat_t		stat;
+};
+
+struct text_buf {
+	pix_view_t	view;
+	int			x0, y0, x1, y1;			/* drawn in, cleared before the next label */
+};
+
+struct osd_text {
+	IMPRgnHandle		handle;
+	osd_font_t			*font;
+	struct text_buf		buf[2];
+	int					back;
+	int					shown;
+	int					align;
+	int					line_gap;
+	int					wrap;
+	int					dirty;			/* layout changed */
+	char				str[OSD_TEXT_MAX_LEN + 1];
+	int					enc;
+	osd_text_stat_t		stat;
+};
+
+struct text_line {
+	int		start;
+	int		n;
+	int		width;
+};
+
+static void color_to_fmt(uint32_t argb, IMPPixelFormat fmt, uint8_t *d)
+{
+	uint8_t a = argb >> 24, r = argb >> 16, g = argb >> 8, b = argb;
+	uint16_t p;
+
+	if (fmt == PIX_FMT_BGRA) {
+		d[0] = b;
+		d[1] = g;
+		d[2] = r;
+		d[3] = a;
+		return;
+	}
+	p = (a >= 0x80 ? 0x8000 : 0) | (r >> 3) << 10 | (g >> 3) << 5 | b >> 3;
+	d[0] = p;
+	d[1] = p >> 8;
+}
+
+osd_font_t *osd_font_create(const osd_font_attr_t *attr)
+{
+	osd_font_t *font;
+	int i, nr_buckets;
+
+	if ((attr->fmt != PIX_FMT_BGRA && attr->fmt != PIX_FMT_RGB555LE) || attr->scale < 1) {
+		IMP_LOG_ERR(TAG, "font in %s at scale %d, only bgra and rgb555le\n",
+				fmt_to_string(attr->fmt), attr->scale);
+		return NULL;
+	}
+
+	font = calloc(1, sizeof(*font));
+	if (font == NULL) {
+		IMP_LOG_ERR(TAG, "calloc font failed\n");
+		return NULL;
+	}
+	font->fmt = attr->fmt;
+	font->scale = attr->scale;
+	font->bytes = attr->fmt == PIX_FMT_BGRA ? 4 : 2;
+	color_to_fmt(attr->fg, attr->fmt, font->fg);
+	color_to_fmt(attr->bg, attr->fmt, font->bg);
+	font->bg_zero = !memcmp(font->bg, "\0\0\0\0", font->bytes);
+	font->fd = -1;
+	font->cd = (iconv_t)-1;
+
+	font->slot_w = OSD_FONT_GB_WIDTH * font->scale;
+	font->slot_bytes = font->slot_w * OSD_FONT_ROWS * font->scale * font->bytes;
+	font->nr_slots = attr->cache_bytes / font->slot_bytes;
+	if (font->nr_slots < 1) {
+		IMP_LOG_ERR(TAG, "glyph cache of %d bytes, a glyph takes %d\n", attr->cache_bytes, font->slot_bytes);
+		goto err_cache;
+	}
+	for (nr_buckets = 1; nr_buckets < font->nr_slots; nr_buckets <<= 1)
+		;
+	font->hash_mask = nr_buckets - 1;
+	font->slot = calloc(font->nr_slots, sizeof(struct glyph_slot));
+	font->bucket = malloc(nr_buckets * sizeof(int));
+	font->pool = malloc((size_t)font->nr_slots * font->slot_bytes);
+	if (font->slot == NULL || font->bucket == NULL || font->pool == NULL) {
+		IMP_LOG_ERR(TAG, "glyph cache alloc failed\n");
+		goto err_cache;
+	}
+	for (i = 0; i < nr_buckets; i++)
+		font->bucket[i] = -1;
+	font->mru = font->lru = -1;
+	font->stat.slots = font->nr_slots;
+	font->stat.slot_bytes = font->slot_bytes;
+
+	/* without them everything past ASCII shows as boxes */
+	if (attr->hzk_path) {
+		font->fd = open(attr->hzk_path, O_RDONLY);
+		if (font->fd < 0)
+			IMP_LOG_WARN(TAG, "no HZK16 font %s, GB2312 shows as boxes\n", attr->hzk_path);
+		font->cd = iconv_open("GB2312", "UTF-8");
+		if (font->cd == (iconv_t)-1)
+			IMP_LOG_WARN(TAG, "no UTF-8 to GB2312 iconv, only GB2312 labels show\n");
+	}
+
+	return font;
+
+err_cache:
+	free(font->slot);
+	free(font->bucket);
+	free(font->pool);
+	free(font);
+	return NULL;
+}
+
+void osd_font_destroy(osd_font_t *font)
+{
+	if (font == NULL)
+		return;
+	if (font->fd >= 0)
+		close(font->fd);
+	if (font->cd != (iconv_t)-1)
+		iconv_close(font->cd);
+	free(font->slot);
+	free(font->bucket);
+	free(font->pool);
+	free(font);
+}
+
+int osd_font_line_height(const osd_font_t *font)
+{
+	return OSD_FONT_ROWS * font->scale;
+}
+
+static int key_width(const osd_font_t *font, uint32_t key)
+{
+	return (key < 0x80 ? OSD_FONT_ASCII_WIDTH : OSD_FONT_GB_WIDTH) * font->scale;
+}
+
+/* The next character's key, '\n' as such, 0 at the end */
+static uint32_t next_key(const unsigned char **p, int enc)
+{
+	const unsigned char *s = *p;
+	uint32_t cp;
+	int i, n;
+
+	if (*s < 0x80) {
+		if (*s)
+			(*p)++;
+		return *s;
+	}
+
+	if (enc == OSD_TEXT_GB2312) {
+		if (s[0] >= 0xa1 && s[0] <= 0xf7 && s[1] >= 0xa1 && s[1] <= 0xfe) {
+			*p += 2;
+			return KEY_GB | s[0] << 8 | s[1];
+		}
+		(*p)++;
+		return KEY_BOX;
+	}
+
+	if ((s[0] & 0xe0) == 0xc0) {
+		cp = s[0] & 0x1f;
+		n = 1;
+	} else if ((s[0] & 0xf0) == 0xe0) {
+		cp = s[0] & 0x0f;
+		n = 2;
+	} else if ((s[0] & 0xf8) == 0xf0) {
+		cp = s[0] & 0x07;
+		n = 3;
+	} else {
+		(*p)++;
+		return KEY_BOX;
+	}
+	for (i = 1; i <= n; i++) {
+		if ((s[i] & 0xc0) != 0x80) {
+			*p += i;
+			return KEY_BOX;
+		}
+		cp = cp << 6 | (s[i] & 0x3f);
+	}
+	*p += n + 1;
+
+	return cp < 0x80 ? KEY_BOX : cp;
+}
+
+/* Code point cp in GB2312, 0 for none */
+static uint16_t unicode_to_gb(osd_font_t *font, uint32_t cp)
+{
+	char in[4], out[4], *ip = in, *op = out;
+	size_t il, ol = sizeof(out);
+	unsigned char *o = (unsigned char *)out;
+
+	if (font->cd == (iconv_t)-1 || cp > 0x10ffff)
+		return 0;
+	if (cp < 0x800) {
+		in[0] = 0xc0 | cp >> 6;
+		in[1] = 0x80 | (cp & 0x3f);
+		il = 2;
+	} else if (cp < 0x10000) {
+		in[0] = 0xe0 | cp >> 12;
+		in[1] = 0x80 | (cp >> 6 & 0x3f);
+		in[2] = 0x80 | (cp & 0x3f);
+		il = 3;
+	} else {
+		in[0] = 0xf0 | cp >> 18;
+		in[1] = 0x80 | (cp >> 12 & 0x3f);
+		in[2] = 0x80 | (cp >> 6 & 0x3f);
+		in[3] = 0x80 | (cp & 0x3f);
+		il = 4;
+	}
+	iconv(font->cd, NULL, NULL, NULL, NULL);
+	if (iconv(font->cd, &ip, &il, &op, &ol) == (size_t)-1 || op - out != 2
+			|| o[0] < 0xa1 || o[0] > 0xf7 || o[1] < 0xa1 || o[1] > 0xfe)
+		return 0;
+
+	return o[0] << 8 | o[1];
+}
+
+/* 16 rows of the glyph's font pixels, bit 15 leftmost; 0 for none */
+static int glyph_bits(osd_font_t *font, uint32_t key, uint16_t *rows)
+{
+	const unsigned char *a;
+	uint8_t hzk[HZK_GLYPH_BYTES];
+	uint16_t gb;
+	off_t off;
+	int i;
+
+	if (key < 0x80) {
+		if (key < OSDFONT_ASCII_FIRST || key > OSDFONT_ASCII_LAST)
+			return 0;
+		a = osdfont_ascii_8x16[key - OSDFONT_ASCII_FIRST];
+		for (i = 0; i < OSD_FONT_ROWS; i++)
+			rows[i] = a[i] << 8;
+		return 1;
+	}
+
+	if (key == KEY_BOX || font->fd < 0)
+		return 0;
+	gb = key & KEY_GB ? key & 0xffff : unicode_to_gb(font, key);
+	if (gb == 0)
+		return 0;
+
+	off = ((gb >> 8) - 0xa1) * HZK_ROWS + (gb & 0xff) - 0xa1;
+	font->stat.file_reads++;
+	if (pread(font->fd, hzk, sizeof(hzk), off * HZK_GLYPH_BYTES) != sizeof(hzk))
+		return 0;
+	for (i = 0; i < OSD_FONT_ROWS; i++)
+		rows[i] = hzk[2 * i] << 8 | hzk[2 * i + 1];
+
+	return 1;
+}
+
+/* Into slot memory, rows of slot_w pixels */
+static void rasterize(osd_font_t *font, uint32_t key, uint8_t *d)
+{
+	uint16_t rows[OSD_FONT_ROWS];
+	int w = key_width(font, key) / font->scale;
+	int s = font->scale, bytes = font->bytes;
+	int x, y, i;
+	uint8_t *row;
+
+	if (!glyph_bits(font, key, rows)) {
+		memcpy(rows, box_16x16, sizeof(rows));
+		font->stat.missing++;
+	}
+	for (y = 0; y < OSD_FONT_ROWS; y++) {
+		row = d + y * s * font->slot_w * bytes;
+		for (x = 0; x < w; x++)
+			for (i = 0; i < s; i++)
+				memcpy(row + (x * s + i) * bytes, rows[y] & 0x8000 >> x ? font->fg : font->bg, bytes);
+		for (i = 1; i < s; i++)
+			memcpy(row + i * font->slot_w * bytes, row, w * s * bytes);
+	}
+}
+
+static uint32_t key_hash(const osd_font_t *font, uint32_t key)
+{
+	return (key * 2654435761u >> 8) & font->hash_mask;
+}
+
+static void lru_unlink(osd_font_t *font, int i)
+{
+	struct glyph_slot *g = &font->slot[i];
+
+	if (g->prev >= 0)
+		font->slot[g->prev].next = g->next;
+	else
+		font->mru = g->next;
+	if (g->next >= 0)
+		font->slot[g->next].prev = g->prev;
+	else
+		font->lru = g->prev;
+}
+
+static void lru_push(osd_font_t *font, int i)
+{
+	struct glyph_slot *g = &font->slot[i];
+
+	g->prev = -1;
+	g->next = font->mru;
+	if (font->mru >= 0)
+		font->slot[font->mru].prev = i;
+	else
+		font->lru = i;
+	font->mru = i;
+}
+
+static void hash_remove(osd_font_t *font, int i)
+{
+	int *p = &font->bucket[key_hash(font, font->slot[i].key)];
+
+	while (*p != i)
+		p = &font->slot[*p].hnext;
+	*p = font->slot[i].hnext;
+}
+
+/* The glyph of key in slot memory, rasterized now if it was not cached */
+static const uint8_t *glyph_lookup(osd_font_t *font, uint32_t key)
+{
+	uint32_t h = key_hash(font, key);
+	int i;
+
+	font->stat.lookups++;
+	for (i = font->bucket[h]; i >= 0; i = font->slot[i].hnext) {
+		if (font->slot[i].key == key) {
+			font->stat.hits++;
+			if (font->mru != i) {
+				lru_unlink(font, i);
+				lru_push(font, i);
+			}
+			return font->pool + (size_t)i * font->slot_bytes;
+		}
+	}
+
+	/* a free slot, or the least recently drawn glyph's */
+	if (font->used < font->nr_slots) {
+		i = font->used++;
+	} else {
+		i = font->lru;
+		lru_unlink(font, i);
+		hash_remove(font, i);
+		font->stat.evictions++;
+	}
+	font->stat.misses++;
+	rasterize(font, key, font->pool + (size_t)i * font->slot_bytes);
+	font->slot[i].key = key;
+	font->slot[i].hnext = font->bucket[h];
+	font->bucket[h] = i;
+	lru_push(font, i);
+
+	return font->pool + (size_t)i * font->slot_bytes;
+}
+
+int osd_font_measure(const osd_font_t *font, const char *text, int enc, int line_gap,
+		int *width, int *height)
+{
+	const unsigned char *p = (const unsigned char *)text;
+	int lines = 1, w = 0;
+	uint32_t key;
+
+	*width = 0;
+	while ((key = next_key(&p, enc)) != 0) {
+		if (key == '\n') {
+			lines++;
+			w = 0;
+			continue;
+		}
+		if (key < 0x20 || key == 0x7f)
+			continue;
+		w += key_width(font, key);
+		if (w > *width)
+			*width = w;
+	}
+	*height = lines * osd_font_line_height(font) + (lines - 1) * line_gap;
+
+	return 0;
+}
+
+void osd_font_get_stat(osd_font_t *font, osd_font_stat_t *stat)
+{
+	*stat = font->stat;
+}
+
+void osd_font_dump_stat(osd_font_t *font)
+{
+	osd_font_stat_t *s = &font->stat;
+
+	IMP_LOG_INFO(TAG, "%s x%d font: %u lookups, %.1f%% hits, %u rasterized, %u evicted, "
+			"%u file reads, %u boxes; %u of %u slots of %u bytes\n", fmt_to_string(font->fmt),
+			font->scale, s->lookups, s->lookups ? 100.0 * s->hits / s->lookups : 0.0, s->misses,
+			s->evictions, s->file_reads, s->missing, font->used, s->slots, s->slot_bytes);
+}
+
+static void fill(struct text_buf *b, const uint8_t *px, int bytes, int zero)
+{
+	const pix_layout_t *l = &b->view.layout;
+	uint8_t *row;
+	int x, y;
+
+	if (b->x1 <= b->x0 || b->y1 <= b->y0)
+		return;
+	for (y = b->y0; y < b->y1; y++) {
+		row = b->view.plane[0] + y * l->stride[0];
+		if (zero) {
+			memset(row + b->x0 * bytes, 0, (b->x1 - b->x0) * bytes);
+			continue;
+		}
+		for (x = b->x0; x < b->x1; x++)
+			memcpy(row + x * bytes, px, bytes);
+	}
+}
+
+osd_text_t *osd_text_create(IMPRgnHandle handle, osd_font_t *font, int width, int height)
+{
+	osd_text_t *text;
+	int i;
+
+	text = calloc(1, sizeof(*text));
+	if (text == NULL) {
+		IMP_LOG_ERR(TAG, "calloc text failed\n");
+		return NULL;
+	}
+	text->handle = handle;
+	text->font = font;
+
+	/* both start all background */
+	for (i = 0; i < 2; i++) {
+		if (pix_view_alloc(&text->buf[i].view, font->fmt, width, height, 1) < 0)
+			goto err_alloc;
+		text->buf[i].x1 = width;
+		text->buf[i].y1 = height;
+		fill(&text->buf[i], font->bg, font->bytes, font->bg_zero);
+		text->buf[i].x1 = text->buf[i].y1 = 0;
+	}
+
+	return text;
+
+err_alloc:
+	pix_view_free(&text->buf[0].view);
+	free(text);
+	return NULL;
+}
+
+void osd_text_destroy(osd_text_t *text)
+{
+	if (text == NULL)
+		return;
+	pix_view_free(&text->buf[0].view);
+	pix_view_free(&text->buf[1].view);
+	free(text);
+}
+
+void osd_text_set_layout(osd_text_t *text, int align, int line_gap, int wrap)
+{
+	text->align = align;
+	text->line_gap = line_gap;
+	text->wrap = wrap;
+	text->dirty = 1;
+}
+
+static void draw_glyph(struct text_buf *b, osd_font_t *font, uint32_t key, int x, int y)
+{
+	const pix_layout_t *l = &b->view.layout;
+	const uint8_t *s = glyph_lookup(font, key);
+	int w = key_width(font, key), h = osd_font_line_height(font);
+	int r;
+
+	if (x + w > l->width)
+		w = l->width - x;
+	if (y + h > l->height)
+		h = l->height - y;
+	for (r = 0; r < h; r++)
+		memcpy(b->view.plane[0] + (y + r) * l->stride[0] + x * font->bytes,
+				s + r * font->slot_w * font->bytes, w * font->bytes);
+
+	if (x < b->x0)
+		b->x0 = x;
+	if (y < b->y0)
+		b->y0 = y;
+	if (x + w > b->x1)
+		b->x1 = x + w;
+	if (y + h > b->y1)
+		b->y1 = y + h;
+}
+
+/* Lays str out into the back buffer */
+static void render(osd_text_t *text, const char *str, int enc)
+{
+	osd_font_t *font = text->font;
+	struct text_buf *b = &text->buf[text->back];
+	const pix_layout_t *l = &b->view.layout;
+	const unsigned char *p = (const unsigned char *)str;
+	uint32_t key, keys[OSD_TEXT_MAX_LEN];
+	struct text_line line[OSD_TEXT_MAX_LINES], *ln = line;
+	int lh = osd_font_line_height(font), pitch = lh + text->line_gap;
+	int nr_keys = 0, nr_lines = 1, n = 0, width = 0, fit, i, w, x, y;
+
+	/* lines of keys, wrapped where they would cross the right edge */
+	memset(ln, 0, sizeof(*ln));
+	while ((key = next_key(&p, enc)) != 0) {
+		w = key_width(font, key);
+		if (key == '\n' || (text->wrap && n && width + w > l->width)) {
+			if (nr_lines++ < OSD_TEXT_MAX_LINES) {
+				ln++;
+				ln->start = nr_keys;
+				ln->n = ln->width = 0;
+			}
+			n = width = 0;
+			if (key == '\n')
+				continue;
+		}
+		if (key < 0x20 || key == 0x7f)
+			continue;
+		n++;
+		width += w;
+		if (nr_lines > OSD_TEXT_MAX_LINES)
+			continue;
+		keys[nr_keys++] = key;
+		ln->n++;
+		ln->width += w;
+	}
+	fit = (l->height + text->line_gap) / pitch;
+	if (fit > OSD_TEXT_MAX_LINES)
+		fit = OSD_TEXT_MAX_LINES;
+	if (nr_lines > fit) {
+		text->stat.clipped += nr_lines - fit;
+		nr_lines = fit;
+	}
+
+	/* what this buffer showed two labels ago */
+	fill(b, font->bg, font->bytes, font->bg_zero);
+	b->x0 = l->width;
+	b->y0 = l->height;
+	b->x1 = b->y1 = 0;
+
+	for (ln = line, y = 0; ln < line + nr_lines; ln++, y += pitch) {
+		x = 0;
+		if (text->align == OSD_TEXT_CENTER)
+			x = (l->width - ln->width) / 2;
+		else if (text->align == OSD_TEXT_RIGHT)
+			x = l->width - ln->width;
+		if (x < 0)
+			x = 0;
+		for (i = ln->start; i < ln->start + ln->n && x < l->width; i++) {
+			draw_glyph(b, font, keys[i], x, y);
+			x += key_width(font, keys[i]);
+			text->stat.glyphs++;
+		}
+	}
+}
+
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int osd_text_set(osd_text_t *text, const char *str, int enc)
+{
+	IMPOSDRgnAttrData data;
+	uint64_t start;
+	uint32_t ns;
+	size_t len = strlen(str);
+	int ret;
+
+	text->stat.sets++;
+	if (len > OSD_TEXT_MAX_LEN) {
+		IMP_LOG_ERR(TAG, "label of %d bytes, at most %d\n", (int)len, OSD_TEXT_MAX_LEN);
+		return -1;
+	}
+	if (text->shown && !text->dirty && enc == text->enc && !strcmp(str, text->str)) {
+		text->stat.unchanged++;
+		return 0;
+	}
+
+	start = thread_cpu_ns();
+	render(text, str, enc);
+
+	memset(&data, 0, sizeof(data));
+	data.picData.pData = text->buf[text->back].view.plane[0];
+	ret = IMP_OSD_UpdateRgnAttrData(text->handle, &data);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_OSD_UpdateRgnAttrData(%d) failed\n", text->handle);
+		text->stat.update_fail++;
+	} else {
+		text->back ^= 1;
+		text->shown = 1;
+		text->dirty = 0;
+		text->enc = enc;
+		memcpy(text->str, str, len + 1);
+	}
+
+	ns = thread_cpu_ns() - start;
+	text->stat.renders++;
+	text->stat.cpu_ns += ns;
+	text->stat.cpu_ns_last = ns;
+	if (ns > text->stat.cpu_ns_max)
+		text->stat.cpu_ns_max = ns;
+
+	return ret < 0 ? -1 : 0;
+}
+
+const pix_view_t *osd_text_front(osd_text_t *text)
+{
+	return text->shown ? &text->buf[text->back ^ 1].view : NULL;
+}
+
+void osd_text_get_stat(osd_text_t *text, osd_text_stat_t *stat)
+{
+	*stat = text->stat;
+}
+
+void osd_text_dump_stat(osd_text_t *text)
+{
+	osd_text_stat_t *s = &text->stat;
+
+	IMP_LOG_INFO(TAG, "rgn%d: %u labels set, %u unchanged, %u drawn with %u glyphs, %u lines clipped, "
+			"%u failed, CPU per label %.1f us (max %.1f us)\n", text->handle, s->sets, s->unchanged,
+			s->renders, s->glyphs, s->clipped, s->update_fail,
+			s->renders ? s->cpu_ns / 1000.0 / s->renders : 0.0, s->cpu_ns_max / 1000.0);
+}
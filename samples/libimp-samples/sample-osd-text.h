@@ -0,0 +1,138 @@
+/*
+ * sample-osd-text.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_OSD_TEXT_H__
+#define __SAMPLE_OSD_TEXT_H__
+
+#include <stdint.h>
+#include <imp/imp_common.h>
+#include <imp/imp_osd.h>
+
+#include "sample-pixfmt.h"
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Text labels (camera names, sites) for an OSD_REG_PIC region, in
+ * UTF-8 or GB2312.
+ *
+ * The font has 16 rows. ASCII glyphs are 8 pixels wide and built in
+ * (osdfont_ascii_8x16.h). GB2312 glyphs are 16 pixels wide and come
+ * from an HZK16 file: 94 x 94 glyphs of 32 bytes, in GB2312 code
+ * order. Each glyph is read from the file when it is first needed. A
+ * UTF-8 character outside ASCII is converted to GB2312 with iconv(3).
+ * A character with no glyph shows as a box, as wide as a GB2312 glyph.
+ * An integer scale repeats each font pixel.
+ *
+ * Glyphs are rasterized once into the region's pixel format
+ * (PIX_FMT_BGRA or PIX_FMT_RGB555LE), in the label's colours, and kept
+ * in an LRU cache. The cache takes cache_bytes at create and never
+ * grows. Each glyph takes one slot, 16 x 16 scaled pixels. When every
+ * slot is in use, the least recently drawn glyph is dropped. Drawing a
+ * cached glyph is then a memcpy per row. The cache is keyed by
+ * character, so a label drawn again usually reads nothing from the
+ * font file.
+ *
+ * A label is laid out from '\n' separated lines. With wrap, a line
+ * breaks before the glyph that would cross the right edge. Each line
+ * is aligned on its own. Lines past the bottom are dropped, and glyphs
+ * past the right edge are clipped. osd_text_set() lays out and draws
+ * only when the text differs from the last one set. Otherwise it
+ * returns at once. As with osd_stamp, the label has two region
+ * buffers. The back one is drawn and handed over with
+ * IMP_OSD_UpdateRgnAttrData(). The OSD never reads a half-drawn label.
+ *
+ * A font and its labels are used from one thread.
+ */
+
+#define OSD_FONT_ROWS			16
+#define OSD_FONT_ASCII_WIDTH	8
+#define OSD_FONT_GB_WIDTH		16
+#define OSD_TEXT_MAX_LEN		256			/* bytes of a label */
+#define OSD_TEXT_MAX_LINES		8
+
+typedef struct osd_font osd_font_t;
+typedef struct osd_text osd_text_t;
+
+enum osd_text_enc {
+	OSD_TEXT_UTF8,
+	OSD_TEXT_GB2312,
+};
+
+enum osd_text_align {
+	OSD_TEXT_LEFT,
+	OSD_TEXT_CENTER,
+	OSD_TEXT_RIGHT,
+};
+
+typedef struct osd_font_attr {
+	IMPPixelFormat	fmt;				/* PIX_FMT_BGRA or PIX_FMT_RGB555LE */
+	int				scale;				/* 1, 2, ...: pixels per font pixel */
+	uint32_t		fg;					/* 0xAARRGGBB */
+	uint32_t		bg;					/* 0 for transparent */
+	const char		*hzk_path;			/* HZK16 file, NULL for ASCII only */
+	int				cache_bytes;		/* glyph cache, at least one slot */
+} osd_font_attr_t;
+
+typedef struct osd_font_stat {
+	uint32_t	lookups;
+	uint32_t	hits;
+	uint32_t	misses;				/* rasterized into a slot */
+	uint32_t	evictions;
+	uint32_t	file_reads;
+	uint32_t	missing;			/* no glyph, the box drawn */
+	uint32_t	slots;
+	uint32_t	slot_bytes;
+} osd_font_stat_t;
+
+typedef struct osd_text_stat {
+	uint32_t	sets;
+	uint32_t	unchanged;			/* nothing drawn */
+	uint32_t	renders;
+	uint32_t	glyphs;				/* drawn */
+	uint32_t	clipped;			/* lines dropped at the bottom */
+	uint32_t	update_fail;		/* IMP_OSD_UpdateRgnAttrData failed */
+	uint64_t	cpu_ns;				/* thread CPU time in renders, all of them */
+	uint32_t	cpu_ns_max;
+	uint32_t	cpu_ns_last;
+} osd_text_stat_t;
+
+osd_font_t *osd_font_create(const osd_font_attr_t *attr);
+void osd_font_destroy(osd_font_t *font);
+/* Pixels per line, scale included */
+int osd_font_line_height(const osd_font_t *font);
+/* Size text needs, unwrapped, with line_gap pixels between lines; a region is made from it */
+int osd_font_measure(const osd_font_t *font, const char *text, int enc, int line_gap,
+		int *width, int *height);
+void osd_font_get_stat(osd_font_t *font, osd_font_stat_t *stat);
+void osd_font_dump_stat(osd_font_t *font);
+
+/* A width x height region in the font's format; the font must outlive it */
+osd_text_t *osd_text_create(IMPRgnHandle handle, osd_font_t *font, int width, int height);
+void osd_text_destroy(osd_text_t *text);
+/* Applies from the next osd_text_set(), which then draws even the same text */
+void osd_text_set_layout(osd_text_t *text, int align, int line_gap, int wrap);
+/* Shows str if it differs from the last one; returns 0 then as well */
+int osd_text_set(osd_text_t *text, const char *str, int enc);
+
+/* The buffer the region shows, NULL before the first label */
+const pix_view_t *osd_text_front(osd_text_t *text);
+
+void osd_text_get_stat(osd_text_t *text, osd_text_stat_t *stat);
+void osd_text_dump_stat(osd_text_t *text);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_OSD_TEXT_H__ */
@@ -0,0 +1,198 @@
+/*
+ * sample-pixfmt-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check for the pixel format table and the layouts built on it.
+ * Every IMPPixelFormat must have a name of its own and a bpp that
+ * agrees with its planes. calc_pic_size() must give the known sizes,
+ * including the four formats it knew before the table. Layouts are
+ * checked for padded strides, uneven chroma and rejected sizes. Views
+ * must refuse short buffers and frames, and a padded view must write
+ * out exactly the packed picture.
+ *
+ * usage: sample-pixfmt-check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+
+#include "sample-pixfmt.h"
+
+#define TAG "Sample-Pixfmt-Check"
+
+static int errors;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		IMP_LOG_ERR(TAG, "line %d: %s\n", __LINE__, #cond); \
+		errors++; \
+	} \
+} while (0)
+
+/* Every format described, named once, with a bpp its planes add up to */
+static void check_table(void)
+{
+	const IMPPixelFormatDesc *desc, *other;
+	int fmt, i, bits, p;
+
+	CHECK(imp_pixfmt_desc(PIX_FMT_NB) == NULL);
+	CHECK(imp_pixfmt_desc((IMPPixelFormat)-1) == NULL);
+	CHECK(fmt_to_string(PIX_FMT_NB) == NULL);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_NB) == 0);
+
+	for (fmt = 0; fmt < PIX_FMT_NB; fmt++) {
+		desc = imp_pixfmt_desc(fmt);
+		CHECK(desc != NULL && desc->name != NULL);
+		if (desc == NULL || desc->name == NULL)
+			continue;
+		CHECK(fmt_to_string(fmt) == desc->name);
+		CHECK(desc->nb_planes >= 1 && desc->nb_planes <= PIX_MAX_PLANES);
+		CHECK(desc->align_w >= 1 && desc->align_h >= 1);
+		for (i = 0; i < fmt; i++) {
+			other = imp_pixfmt_desc(i);
+			if (other->name && strcmp(other->name, desc->name) == 0)
+				IMP_LOG_ERR(TAG, "%d and %d both named %s\n", i, fmt, desc->name), errors++;
+		}
+
+		/* 64x64 is on every alignment and every subsampling */
+		bits = 0;
+		for (p = 0; p < desc->nb_planes; p++)
+			bits += imp_pixfmt_plane_row_bytes(desc, p, 64) * 8 * imp_pixfmt_plane_rows(desc, p, 64);
+		if (bits != 64 * 64 * desc->bpp || calc_pic_size(64, 64, fmt) * 8 != bits)
+			IMP_LOG_ERR(TAG, "%s: %d bits in 64x64, bpp %d\n", desc->name, bits, desc->bpp), errors++;
+	}
+}
+
+static void check_sizes(void)
+{
+	/* what calc_pic_size() knew before */
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_NV12) == 1280 * 720 * 3 / 2);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_YUYV422) == 1280 * 720 * 2);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_UYVY422) == 1280 * 720 * 2);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_RGB565BE) == 1280 * 720 * 2);
+
+	/* and what it returned 0 for */
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_NV21) == 1280 * 720 * 3 / 2);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_YUV420P) == 1280 * 720 * 3 / 2);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_YUV422P) == 1280 * 720 * 2);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_YUV444P) == 1280 * 720 * 3);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_YUV410P) == 1280 * 720 * 9 / 8);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_YUV411P) == 1280 * 720 * 3 / 2);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_GRAY8) == 1280 * 720);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_MONOWHITE) == 1280 / 8 * 720);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_BGRA) == 1280 * 720 * 4);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_RGB555LE) == 1280 * 720 * 2);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_RGB24) == 1280 * 720 * 3);
+	CHECK(calc_pic_size(1280, 720, PIX_FMT_BAYER_GRBG8) == 1280 * 720);
+
+	/* rows of bits round up to a byte, chroma rounds up to a sample */
+	CHECK(calc_pic_size(13, 3, PIX_FMT_MONOBLACK) == 2 * 3);
+	CHECK(calc_pic_size(5, 5, PIX_FMT_YUV420P) == 25 + 2 * 3 * 3);
+	CHECK(calc_pic_size(0, 720, PIX_FMT_NV12) == 0);
+}
+
+static void check_layouts(void)
+{
+	pix_layout_t l;
+
+	/* FrameSource NV12, packed */
+	CHECK(pix_layout_init(&l, PIX_FMT_NV12, 1280, 720, 1) == 0);
+	CHECK(l.nb_planes == 2 && l.stride[0] == 1280 && l.stride[1] == 1280);
+	CHECK(l.rows[1] == 360 && l.offset[1] == 1280 * 720 && l.size == 1280 * 720 * 3 / 2);
+
+	/* rows padded to 16 bytes */
+	CHECK(pix_layout_init(&l, PIX_FMT_NV12, 646, 362, 16) == 0);
+	CHECK(l.stride[0] == 656 && l.stride[1] == 656 && l.size == 656 * (362 + 181));
+	CHECK(pix_layout_init(&l, PIX_FMT_YUV420P, 646, 362, 16) == 0);
+	CHECK(l.stride[0] == 656 && l.stride[1] == 336 && l.stride[2] == 336);
+	CHECK(l.offset[2] == 656 * 362 + 336 * 181 && l.size == 656 * 362 + 2 * 336 * 181);
+
+	/* the OSD timestamp region */
+	CHECK(pix_layout_init(&l, PIX_FMT_RGB555LE, 320, 34, 1) == 0);
+	CHECK(pix_layout_pixel_bytes(&l) == 2 && l.size == 320 * 34 * 2);
+	CHECK(pix_layout_init(&l, PIX_FMT_BGRA, 320, 34, 1) == 0);
+	CHECK(pix_layout_pixel_bytes(&l) == 4 && l.size == 320 * 34 * 4);
+
+	/* off the format's alignment, or a bad stride alignment */
+	CHECK(pix_layout_init(&l, PIX_FMT_NV12, 641, 360, 1) < 0);
+	CHECK(pix_layout_init(&l, PIX_FMT_YUYV422, 641, 360, 1) < 0);
+	CHECK(pix_layout_init(&l, PIX_FMT_YUV410P, 640, 362, 1) < 0);
+	CHECK(pix_layout_init(&l, PIX_FMT_BAYER_RGGB8, 640, 361, 1) < 0);
+	CHECK(pix_layout_init(&l, PIX_FMT_GRAY8, 641, 361, 1) == 0);
+	CHECK(pix_layout_init(&l, PIX_FMT_GRAY8, 640, 360, 12) < 0);
+	CHECK(pix_layout_init(&l, PIX_FMT_NB, 640, 360, 1) < 0);
+}
+
+static void check_views(void)
+{
+	static uint8_t buf[64 * 1024];
+	IMPFrameInfo frame;
+	pix_layout_t l;
+	pix_view_t v;
+	uint8_t out[sizeof(buf)];
+	FILE *fp;
+	int i, y;
+
+	/* a frame one byte short is refused, an exact or roomy one is not */
+	memset(&frame, 0, sizeof(frame));
+	frame.width = 64;
+	frame.height = 48;
+	frame.pixfmt = PIX_FMT_NV21;
+	frame.virAddr = 0x10000000;
+	frame.size = 64 * 48 * 3 / 2 - 1;
+	CHECK(pix_view_from_frame(&v, &frame) < 0);
+	frame.size++;
+	CHECK(pix_view_from_frame(&v, &frame) == 0);
+	CHECK((uintptr_t)v.plane[1] == 0x10000000 + 64 * 48);
+	frame.size += 4096;
+	CHECK(pix_view_from_frame(&v, &frame) == 0);
+	/* the channel's format, not the frame's */
+	CHECK(pix_view_from_frame_fmt(&v, &frame, PIX_FMT_BGRA) < 0);
+	frame.pixfmt = PIX_FMT_NB;
+	CHECK(pix_view_from_frame(&v, &frame) < 0);
+
+	/* a padded picture writes out packed */
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 7;
+	CHECK(pix_layout_init(&l, PIX_FMT_NV12, 30, 10, 16) == 0);
+	CHECK(pix_view_init(&v, buf, l.size - 1, &l) < 0);
+	CHECK(pix_view_init(&v, buf, sizeof(buf), &l) == 0);
+	fp = tmpfile();
+	CHECK(fp != NULL);
+	if (fp == NULL)
+		return;
+	CHECK(pix_view_write(&v, fp) == calc_pic_size(30, 10, PIX_FMT_NV12));
+	rewind(fp);
+	CHECK(fread(out, 1, sizeof(out), fp) == calc_pic_size(30, 10, PIX_FMT_NV12));
+	fclose(fp);
+	for (y = 0; y < 10; y++)
+		CHECK(memcmp(out + y * 30, v.plane[0] + y * 32, 30) == 0);
+	for (y = 0; y < 5; y++)
+		CHECK(memcmp(out + 300 + y * 30, v.plane[1] + y * 32, 30) == 0);
+
+	/* an allocated view is zeroed and of the exact size */
+	CHECK(pix_view_alloc(&v, PIX_FMT_YUV420P, 6, 4, 1) == 0);
+	CHECK(v.layout.size == 6 * 4 + 2 * 3 * 2 && v.plane[2] == v.plane[0] + 6 * 4 + 3 * 2);
+	for (i = 0; i < v.layout.size; i++)
+		CHECK(v.plane[0][i] == 0);
+	pix_view_free(&v);
+	CHECK(v.plane[0] == NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	check_table();
+	check_sizes();
+	check_layouts();
+	check_views();
+
+	if (errors)
+		return -1;
+	printf("%d pixel formats, ok\n", PIX_FMT_NB);
+	return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * sample-pixfmt.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+
+#include "sample-pixfmt.h"
+
+#define TAG "Sample-Pixfmt"
+
+int pix_layout_init(pix_layout_t *layout, IMPPixelFormat fmt, int width, int height, int stride_align)
+{
+	const IMPPixelFormatDesc *desc = imp_pixfmt_desc(fmt);
+	uint64_t size = 0;
+	int p;
+
+	if (desc == NULL) {
+		IMP_LOG_ERR(TAG, "unknown pixel format %d\n", fmt);
+		return -1;
+	}
+	if (width <= 0 || height <= 0 || width % desc->align_w || height % desc->align_h) {
+		IMP_LOG_ERR(TAG, "%s picture %dx%d, must be a multiple of %dx%d\n", desc->name,
+				width, height, desc->align_w, desc->align_h);
+		return -1;
+	}
+	if (stride_align <= 0 || stride_align & (stride_align - 1)) {
+		IMP_LOG_ERR(TAG, "stride alignment %d is not a power of 2\n", stride_align);
+		return -1;
+	}
+
+	memset(layout, 0, sizeof(*layout));
+	layout->fmt = fmt;
+	layout->desc = desc;
+	layout->width = width;
+	layout->height = height;
+	layout->nb_planes = desc->nb_planes;
+	for (p = 0; p < desc->nb_planes; p++) {
+		layout->stride[p] = (imp_pixfmt_plane_row_bytes(desc, p, width) + stride_align - 1) & ~(stride_align - 1);
+		layout->rows[p] = imp_pixfmt_plane_rows(desc, p, height);
+		layout->offset[p] = size;
+		size += (uint64_t)layout->stride[p] * layout->rows[p];
+	}
+	if (size > UINT32_MAX) {
+		IMP_LOG_ERR(TAG, "%s picture %dx%d too large\n", desc->name, width, height);
+		return -1;
+	}
+	layout->size = size;
+
+	return 0;
+}
+
+int pix_layout_pixel_bytes(const pix_layout_t *layout)
+{
+	return layout->desc->plane_bits[0] / 8;
+}
+
+int pix_view_init(pix_view_t *view, void *buf, uint32_t buf_size, const pix_layout_t *layout)
+{
+	int p;
+
+	if (buf == NULL || buf_size < layout->size) {
+		IMP_LOG_ERR(TAG, "%s %dx%d needs %u bytes, buffer has %u\n", layout->desc->name,
+				layout->width, layout->height, layout->size, buf ? buf_size : 0);
+		return -1;
+	}
+
+	memset(view, 0, sizeof(*view));
+	view->layout = *layout;
+	for (p = 0; p < layout->nb_planes; p++)
+		view->plane[p] = (uint8_t *)buf + layout->offset[p];
+
+	return 0;
+}
+
+int pix_view_from_frame_fmt(pix_view_t *view, const IMPFrameInfo *frame, IMPPixelFormat fmt)
+{
+	pix_layout_t layout;
+
+	if (pix_layout_init(&layout, fmt, frame->width, frame->height, 1) < 0)
+		return -1;
+
+	return pix_view_init(view, (void *)(uintptr_t)frame->virAddr, frame->size, &layout);
+}
+
+int pix_view_from_frame(pix_view_t *view, const IMPFrameInfo *frame)
+{
+	return pix_view_from_frame_fmt(view, frame, frame->pixfmt);
+}
+
+int pix_view_alloc(pix_view_t *view, IMPPixelFormat fmt, int width, int height, int stride_align)
+{
+	pix_layout_t layout;
+	void *buf;
+
+	if (pix_layout_init(&layout, fmt, width, height, stride_align) < 0)
+		return -1;
+
+	buf = calloc(1, layout.size);
+	if (buf == NULL) {
+		IMP_LOG_ERR(TAG, "calloc(%u) failed\n", layout.size);
+		return -1;
+	}
+	pix_view_init(view, buf, layout.size, &layout);
+	view->owned = 1;
+
+	return 0;
+}
+
+void pix_view_free(pix_view_t *view)
+{
+	if (view->owned)
+		free(view->plane[0]);
+	memset(view, 0, sizeof(*view));
+}
+
+int pix_view_write(const pix_view_t *view, FILE *fp)
+{
+	const pix_layout_t *l = &view->layout;
+	int p, y, row, n = 0;
+
+	for (p = 0; p < l->nb_planes; p++) {
+		row = imp_pixfmt_plane_row_bytes(l->desc, p, l->width);
+		if (row == l->stride[p]) {
+			if (fwrite(view->plane[p], (size_t)row * l->rows[p], 1, fp) != 1)
+				goto err_write;
+		} else {
+			for (y = 0; y < l->rows[p]; y++)
+				if (fwrite(view->plane[p] + y * l->stride[p], row, 1, fp) != 1)
+					goto err_write;
+		}
+		n += row * l->rows[p];
+	}
+
+	return n;
+
+err_write:
+	IMP_LOG_ERR(TAG, "write %s picture failed\n", l->desc->name);
+	return -1;
+}
@@ -0,0 +1,77 @@
+/*
+ * sample-pixfmt.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_PIXFMT_H__
+#define __SAMPLE_PIXFMT_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <imp/imp_common.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Plane layout of a picture in any IMPPixelFormat, worked out from the
+ * descriptor table in imp_common.h (imp_pixfmt_desc()).
+ *
+ * The planes follow one another in the buffer, each row padded to
+ * stride_align bytes. FrameSource, OSD and decoder pictures are
+ * packed, so stride_align is 1 for them. With a stride_align of 1 the
+ * size equals calc_pic_size(). A view is a layout on a buffer. Views
+ * made from a frame or a buffer are checked against the buffer size,
+ * so a short frame is caught before anything reads past its end.
+ */
+
+#define PIX_MAX_PLANES		3
+
+typedef struct pix_layout {
+	IMPPixelFormat				fmt;
+	const IMPPixelFormatDesc	*desc;
+	int							width;
+	int							height;
+	int							nb_planes;
+	int							stride[PIX_MAX_PLANES];		/* bytes from one row to the next */
+	int							rows[PIX_MAX_PLANES];
+	uint32_t					offset[PIX_MAX_PLANES];		/* from the start of the buffer */
+	uint32_t					size;						/* all planes */
+} pix_layout_t;
+
+typedef struct pix_view {
+	pix_layout_t	layout;
+	uint8_t			*plane[PIX_MAX_PLANES];
+	int				owned;						/* buffer from pix_view_alloc() */
+} pix_view_t;
+
+/* width and height on the format's alignment, stride_align a power of 2 */
+int pix_layout_init(pix_layout_t *layout, IMPPixelFormat fmt, int width, int height, int stride_align);
+/* Bytes of one row of pixels in plane 0, 0 for formats below a byte per pixel */
+int pix_layout_pixel_bytes(const pix_layout_t *layout);
+
+/* layout on buf, which must hold at least layout->size bytes */
+int pix_view_init(pix_view_t *view, void *buf, uint32_t buf_size, const pix_layout_t *layout);
+/* A FrameSource or decoder frame, packed, in frame->pixfmt */
+int pix_view_from_frame(pix_view_t *view, const IMPFrameInfo *frame);
+/* The same, with the format the channel was set up with */
+int pix_view_from_frame_fmt(pix_view_t *view, const IMPFrameInfo *frame, IMPPixelFormat fmt);
+/* A zeroed buffer of exactly the layout's size */
+int pix_view_alloc(pix_view_t *view, IMPPixelFormat fmt, int width, int height, int stride_align);
+void pix_view_free(pix_view_t *view);
+
+/* The picture without row padding, bytes written or -1 */
+int pix_view_write(const pix_view_t *view, FILE *fp);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_PIXFMT_H__ */
@@ -0,0 +1,341 @@
+/*
+ * sample-prerecord-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check for the GOP aligned pre-event buffer. Frames of varying
+ * size carry their number and are pushed by hand; the event files are
+ * read back and must hold whole GOPs of intact frames, in order:
+ *  - a ring that wrapped many times keeps only whole GOPs, starting
+ *    with an IDR, within its budget,
+ *  - nothing is kept before the first IDR, nor after a frame too big
+ *    for the ring until the next IDR,
+ *  - an event starts with the GOPs of the last pre_ms,
+ *  - an event file that blocks (a FIFO nobody reads yet) makes new
+ *    frames drop up to the next IDR and never loses one already taken.
+ *
+ * usage: sample-prerecord-check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <imp/imp_log.h>
+
+#include "sample-prerecord.h"
+
+#define TAG "Sample-Prerecord-Check"
+
+#define NR_FRAMES		1024
+#define GOP				4
+#define FRAME_US		40000
+#define HEAD_BYTES		8
+#define MAX_BYTES		4096
+
+static uint32_t frame_len[NR_FRAMES];
+static char dir[64];
+static int errors;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		IMP_LOG_ERR(TAG, "line %d: %s\n", __LINE__, #cond); \
+		errors++; \
+	} \
+} while (0)
+
+/* Frame n: its number and key flag, then n's low byte up to len */
+static int push(prerecord_t *pr, uint32_t n, uint32_t len)
+{
+	static uint8_t body[MAX_BYTES];
+	uint32_t head[2] = { n, n % GOP == 0 };
+	struct iovec iov[2];
+
+	frame_len[n] = len;
+	memset(body, n & 0xff, len - HEAD_BYTES);
+	iov[0].iov_base = head;
+	iov[0].iov_len = HEAD_BYTES;
+	iov[1].iov_base = body;
+	iov[1].iov_len = len - HEAD_BYTES;
+
+	return prerecord_push_iov(pr, iov, 2, head[1], (int64_t)n * FRAME_US);
+}
+
+/*
+ * Walk the frames in buf: each intact, numbers rising, and every gap
+ * resumes at a key frame. Returns the frame count, -1 if broken.
+ */
+static int parse(const uint8_t *buf, size_t len, uint32_t *first, uint32_t *last, int *nr_keys)
+{
+	uint32_t head[2], i;
+	size_t pos = 0;
+	int n = 0;
+
+	*nr_keys = 0;
+	while (pos < len) {
+		if (len - pos < HEAD_BYTES)
+			return -1;
+		memcpy(head, buf + pos, HEAD_BYTES);
+		if (head[0] >= NR_FRAMES || head[1] != (head[0] % GOP == 0)
+				|| len - pos < frame_len[head[0]])
+			return -1;
+		if (n == 0 ? !head[1] : (head[0] <= *last || (head[0] != *last + 1 && !head[1])))
+			return -1;
+		for (i = HEAD_BYTES; i < frame_len[head[0]]; i++) {
+			if (buf[pos + i] != (head[0] & 0xff))
+				return -1;
+		}
+		if (n++ == 0)
+			*first = head[0];
+		*last = head[0];
+		*nr_keys += head[1];
+		pos += frame_len[head[0]];
+	}
+
+	return n;
+}
+
+/* Read fd to its end */
+static uint8_t *read_fd(int fd, size_t *len)
+{
+	uint8_t *buf = NULL;
+	size_t size = 0;
+	ssize_t rd;
+
+	*len = 0;
+	do {
+		if (*len == size) {
+			size = size ? size * 2 : 65536;
+			buf = realloc(buf, size);
+		}
+		rd = read(fd, buf + *len, size - *len);
+		if (rd > 0)
+			*len += rd;
+	} while (rd > 0);
+
+	return buf;
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+	uint8_t *buf;
+	int fd;
+
+	*len = 0;
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	buf = read_fd(fd, len);
+	close(fd);
+
+	return buf;
+}
+
+static void event_path(char *path, int n)
+{
+	sprintf(path, "%s/event-%d.h264", dir, n);
+}
+
+/* A ring wrapped many times over still holds whole, intact GOPs */
+static void check_eviction(void)
+{
+	prerecord_attr_t attr = { 10000, 0, 60000, 60000, dir };
+	prerecord_t *pr = prerecord_create(&attr);
+	prerecord_stat_t stat;
+	uint32_t n, first, last;
+	char path[128];
+	uint8_t *buf;
+	size_t len;
+	int frames, keys;
+
+	srand(1);
+	for (n = 0; n < 400; n++) {
+		CHECK(push(pr, n, HEAD_BYTES + rand() % 1500) == 0);
+		prerecord_get_stat(pr, &stat);
+		CHECK(stat.buffered_bytes <= attr.budget);
+		CHECK(stat.buffered_frames >= (n % GOP) + 1);
+	}
+	prerecord_get_stat(pr, &stat);
+	CHECK(stat.frames == 400 && stat.dropped == 0);
+	CHECK(stat.buffered_us == (int64_t)(stat.buffered_frames - 1) * FRAME_US);
+
+	/* pre_ms covers the whole ring, the event gets all of it */
+	prerecord_motion(pr, 1);
+	CHECK(prerecord_destroy(pr) == 0);
+
+	event_path(path, 0);
+	buf = read_file(path, &len);
+	frames = parse(buf, len, &first, &last, &keys);
+	CHECK(frames == stat.buffered_frames);
+	CHECK(len == stat.buffered_bytes);
+	CHECK(first % GOP == 0 && last == 399);
+	CHECK(stat.evicted_gops + keys == 400 / GOP);
+	free(buf);
+	unlink(path);
+}
+
+/* Nothing before the first IDR, nor after a frame too big for the ring */
+static void check_idr_wait(void)
+{
+	prerecord_attr_t attr = { 3000, 0, 60000, 60000, dir };
+	prerecord_t *pr = prerecord_create(&attr);
+	prerecord_stat_t stat;
+
+	CHECK(push(pr, 1, 1000) == 1);
+	CHECK(push(pr, 2, 1000) == 1);
+	CHECK(push(pr, 4, 1000) == 0);
+	CHECK(push(pr, 5, 1000) == 0);
+	CHECK(push(pr, 6, 4000) == 1);
+	CHECK(push(pr, 7, 1000) == 1);
+	CHECK(push(pr, 8, 1000) == 0);
+	prerecord_get_stat(pr, &stat);
+	CHECK(stat.frames == 3 && stat.dropped == 4);
+	CHECK(stat.buffered_frames == 3);
+	CHECK(prerecord_destroy(pr) == 0);
+}
+
+/* An event starts with the GOPs of the last pre_ms, then every new frame */
+static void check_event(void)
+{
+	prerecord_attr_t attr = { 65536, 0, 300, 60000, dir };
+	prerecord_t *pr = prerecord_create(&attr);
+	prerecord_stat_t stat;
+	uint32_t n, first, last;
+	char path[128];
+	uint8_t *buf;
+	size_t len;
+	int frames, keys;
+
+	for (n = 0; n < 12; n++)
+		CHECK(push(pr, n, 1000) == 0);
+	/* newest at 440 ms: the GOP at 320 ms, and the one at 160 ms */
+	prerecord_motion(pr, 1);
+	for (; n < 16; n++)
+		CHECK(push(pr, n, 1000) == 0);
+	prerecord_motion(pr, 1);
+	CHECK(prerecord_destroy(pr) == 0);
+
+	event_path(path, 0);
+	buf = read_file(path, &len);
+	frames = parse(buf, len, &first, &last, &keys);
+	CHECK(frames == 12 && first == 4 && last == 15 && keys == 3);
+	free(buf);
+	unlink(path);
+
+	/* pre_ms 0 still gets the current GOP */
+	attr.pre_ms = 0;
+	pr = prerecord_create(&attr);
+	for (n = 0; n < 7; n++)
+		CHECK(push(pr, n, 1000) == 0);
+	prerecord_motion(pr, 1);
+	prerecord_get_stat(pr, &stat);
+	CHECK(stat.buffered_frames == 7);
+	CHECK(prerecord_destroy(pr) == 0);
+
+	buf = read_file(path, &len);
+	frames = parse(buf, len, &first, &last, &keys);
+	CHECK(frames == 3 && first == 4 && last == 6);
+	free(buf);
+	unlink(path);
+}
+
+struct fifo_reader {
+	int			fd;
+	uint8_t		*buf;
+	size_t		len;
+};
+
+static void *fifo_reader_thread(void *arg)
+{
+	struct fifo_reader *r = (struct fifo_reader *)arg;
+
+	/* returns once the writer closes the event */
+	r->buf = read_fd(r->fd, &r->len);
+
+	return NULL;
+}
+
+/*
+ * The event file blocks while the ring fills with frames still to be
+ * written: those are kept, new frames are dropped up to the next IDR.
+ */
+static void check_backlog(void)
+{
+	prerecord_attr_t attr = { 16000, 0, 0, 60000, dir };
+	prerecord_t *pr;
+	prerecord_stat_t stat;
+	struct fifo_reader reader;
+	pthread_t tid;
+	uint32_t n, first, last;
+	char path[128];
+	int i, frames, keys;
+
+	/* a FIFO nobody reads yet, held open so what is written stays */
+	event_path(path, 0);
+	if (mkfifo(path, 0666) < 0
+			|| (reader.fd = open(path, O_RDONLY | O_NONBLOCK)) < 0) {
+		IMP_LOG_ERR(TAG, "FIFO %s failed: %s\n", path, strerror(errno));
+		errors++;
+		return;
+	}
+	fcntl(reader.fd, F_SETFL, 0);
+
+	pr = prerecord_create(&attr);
+	CHECK(push(pr, 0, 1000) == 0);
+	prerecord_motion(pr, 1);
+	for (i = 0; i < 1000; i++) {
+		prerecord_get_stat(pr, &stat);
+		if (stat.events)
+			break;
+		usleep(2000);
+	}
+	CHECK(stat.events == 1);
+	/* far more than the FIFO and the ring hold together */
+	for (n = 1; n < 400; n++)
+		push(pr, n, 1000);
+	prerecord_get_stat(pr, &stat);
+	CHECK(stat.frames + stat.dropped == 400);
+	CHECK(stat.dropped > 0);
+	CHECK(stat.max_pending_bytes <= attr.budget);
+
+	pthread_create(&tid, NULL, fifo_reader_thread, &reader);
+	CHECK(prerecord_destroy(pr) == 0);
+	pthread_join(tid, NULL);
+	close(reader.fd);
+
+	/* every frame taken got written, gaps end at an IDR */
+	frames = parse(reader.buf, reader.len, &first, &last, &keys);
+	CHECK(frames == stat.frames);
+	CHECK(first == 0);
+	free(reader.buf);
+	unlink(path);
+}
+
+int main(int argc, char *argv[])
+{
+	strcpy(dir, "/tmp/prerecord-check-XXXXXX");
+	if (mkdtemp(dir) == NULL) {
+		IMP_LOG_ERR(TAG, "mkdtemp failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	check_eviction();
+	check_idr_wait();
+	check_event();
+	check_backlog();
+
+	rmdir(dir);
+
+	if (errors)
+		return -1;
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,432 @@
+/*
+ * sample-prerecord.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-prerecord.h"
+#include "sample-h264-parse.h"
+
+#define TAG "Sample-Prerecord"
+
+struct pr_frame {
+	uint32_t	off;
+	uint32_t	len;
+	int			key;
+	int64_t		ts;
+};
+
+struct prerecord {
+	prerecord_attr_t	attr;
+
+	uint8_t				*ring;
+	uint32_t			ring_size;
+	uint32_t			head;			/* next free byte */
+
+	struct pr_frame		*desc;
+	uint32_t			max_frames;
+	uint32_t			first;			/* oldest frame */
+	uint32_t			nr_frames;
+	uint32_t			nr_pending;		/* newest frames not yet written */
+	uint32_t			nr_unrecorded;	/* frames after the event end, file still open */
+	uint32_t			bytes;
+	uint32_t			pending_bytes;
+	int					wait_idr;
+
+	int					recording;
+	int					open_req;
+	int					fd;
+	int					event;
+	int64_t				last_motion;
+	int					stop;
+	int					error;
+
+	pthread_t			tid;
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;
+
+	prerecord_stat_t	stat;
+};
+
+#define FRAME(pr, n)	(&(pr)->desc[((pr)->first + (n)) % (pr)->max_frames])
+
+/* Find len contiguous bytes behind the newest frame, called with mutex held */
+static int ring_reserve(prerecord_t *pr, uint32_t len, uint32_t *off)
+{
+	uint32_t tail;
+
+	if (pr->nr_frames >= pr->max_frames)
+		return -1;
+	if (pr->nr_frames == 0) {
+		pr->head = 0;
+		*off = 0;
+		return len <= pr->ring_size ? 0 : -1;
+	}
+
+	tail = FRAME(pr, 0)->off;
+	if (pr->head > tail) {
+		if (pr->ring_size - pr->head >= len)
+			*off = pr->head;
+		else if (tail >= len)
+			*off = 0;
+		else
+			return -1;
+	} else {
+		if (tail - pr->head >= len)
+			*off = pr->head;
+		else
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Drop the oldest GOP, unless part of it still has to be written */
+static int evict_gop(prerecord_t *pr)
+{
+	uint32_t n, i, evictable;
+
+	evictable = pr->nr_frames - pr->nr_pending - pr->nr_unrecorded;
+	for (n = 1; n < pr->nr_frames; n++) {
+		if (FRAME(pr, n)->key)
+			break;
+	}
+	if (n > evictable)
+		return -1;
+
+	for (i = 0; i < n; i++)
+		pr->bytes -= FRAME(pr, i)->len;
+	pr->first = (pr->first + n) % pr->max_frames;
+	pr->nr_frames -= n;
+	pr->stat.evicted_gops++;
+
+	return 0;
+}
+
+/* Mark the GOPs of the last pre_ms for writing, called with mutex held */
+static void start_event(prerecord_t *pr)
+{
+	int64_t newest;
+	uint32_t n, start;
+
+	if (pr->nr_frames == 0)
+		return;
+
+	newest = FRAME(pr, pr->nr_frames - 1)->ts;
+	start = pr->nr_frames;
+	for (n = pr->nr_frames; n-- > 0; ) {
+		if (!FRAME(pr, n)->key)
+			continue;
+		/* at least the current GOP, even if longer than pre_ms */
+		if (start < pr->nr_frames && newest - FRAME(pr, n)->ts > (int64_t)pr->attr.pre_ms * 1000)
+			break;
+		start = n;
+	}
+	if (start == pr->nr_frames)
+		return;
+
+	pr->nr_pending = pr->nr_frames - start;
+	for (n = start; n < pr->nr_frames; n++)
+		pr->pending_bytes += FRAME(pr, n)->len;
+}
+
+static void *writer_thread(void *arg)
+{
+	prerecord_t *pr = (prerecord_t *)arg;
+	struct iovec iov[PRERECORD_BATCH_FRAMES];
+	struct pr_frame *f;
+	char path[128];
+	uint32_t i, n, idx, bytes;
+	int iovcnt, fd, ret;
+	ssize_t wr;
+	int64_t t0, t1;
+
+	pthread_mutex_lock(&pr->mutex);
+	while (1) {
+		while (!pr->stop && !pr->open_req
+				&& !(pr->fd >= 0 && (pr->nr_pending || !pr->recording)))
+			pthread_cond_wait(&pr->cond, &pr->mutex);
+
+		if (pr->open_req) {
+			pr->open_req = 0;
+			sprintf(path, "%s/event-%d.h264", pr->attr.path_prefix, pr->event++);
+			pthread_mutex_unlock(&pr->mutex);
+			fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0777);
+			pthread_mutex_lock(&pr->mutex);
+			if (fd < 0) {
+				IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+				pr->recording = 0;
+				pr->nr_pending = 0;
+				pr->pending_bytes = 0;
+				continue;
+			}
+			IMP_LOG_INFO(TAG, "event %s, %u frames before the trigger\n", path, pr->nr_pending);
+			pr->fd = fd;
+			pr->stat.events++;
+			continue;
+		}
+
+		if (pr->fd >= 0 && pr->nr_pending == 0 && !pr->recording) {
+			fd = pr->fd;
+			pr->fd = -1;
+			pr->nr_unrecorded = 0;
+			pthread_mutex_unlock(&pr->mutex);
+			close(fd);
+			pthread_mutex_lock(&pr->mutex);
+			continue;
+		}
+
+		if (pr->fd < 0 || pr->nr_pending == 0) {
+			if (pr->stop)
+				break;
+			continue;
+		}
+
+		/* the oldest pending frames, neighbours in the ring share an iovec */
+		n = pr->nr_pending < PRERECORD_BATCH_FRAMES ? pr->nr_pending : PRERECORD_BATCH_FRAMES;
+		idx = pr->nr_frames - pr->nr_pending;
+		iovcnt = 0;
+		bytes = 0;
+		for (i = 0; i < n; i++) {
+			f = FRAME(pr, idx + i);
+			if (iovcnt && (uint8_t *)iov[iovcnt - 1].iov_base + iov[iovcnt - 1].iov_len
+					== pr->ring + f->off) {
+				iov[iovcnt - 1].iov_len += f->len;
+			} else {
+				iov[iovcnt].iov_base = pr->ring + f->off;
+				iov[iovcnt].iov_len = f->len;
+				iovcnt++;
+			}
+			bytes += f->len;
+		}
+		fd = pr->fd;
+		pthread_mutex_unlock(&pr->mutex);
+
+		t0 = IMP_System_GetTimeStamp();
+		wr = writev(fd, iov, iovcnt);
+		t1 = IMP_System_GetTimeStamp();
+		ret = (wr == (ssize_t)bytes) ? 0 : -1;
+		if (ret < 0)
+			IMP_LOG_ERR(TAG, "event write error: %s\n", wr < 0 ? strerror(errno) : "short write");
+
+		pthread_mutex_lock(&pr->mutex);
+		pr->nr_pending -= n;
+		pr->pending_bytes -= bytes;
+		if (t1 - t0 > pr->stat.max_write_us)
+			pr->stat.max_write_us = t1 - t0;
+		if (ret == 0) {
+			pr->stat.bytes_written += bytes;
+		} else {
+			/* give up on this event, the ring keeps buffering */
+			pr->error = 1;
+			pr->recording = 0;
+			pr->nr_pending = 0;
+			pr->pending_bytes = 0;
+		}
+	}
+	pthread_mutex_unlock(&pr->mutex);
+
+	return NULL;
+}
+
+prerecord_t *prerecord_create(const prerecord_attr_t *attr)
+{
+	prerecord_t *pr;
+
+	pr = calloc(1, sizeof(prerecord_t));
+	if (pr == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+
+	pr->attr = *attr;
+	pr->ring_size = attr->budget;
+	pr->max_frames = attr->max_frames ? attr->max_frames : PRERECORD_MAX_FRAMES;
+	pr->ring = malloc(pr->ring_size);
+	pr->desc = malloc(pr->max_frames * sizeof(struct pr_frame));
+	if (pr->ring == NULL || pr->desc == NULL) {
+		IMP_LOG_ERR(TAG, "malloc(%u) error !\n", pr->ring_size);
+		free(pr->ring);
+		free(pr->desc);
+		free(pr);
+		return NULL;
+	}
+	pr->fd = -1;
+	pr->wait_idr = 1;
+
+	pthread_mutex_init(&pr->mutex, NULL);
+	pthread_cond_init(&pr->cond, NULL);
+	if (pthread_create(&pr->tid, NULL, writer_thread, pr) != 0) {
+		IMP_LOG_ERR(TAG, "create writer thread failed\n");
+		pthread_mutex_destroy(&pr->mutex);
+		pthread_cond_destroy(&pr->cond);
+		free(pr->ring);
+		free(pr->desc);
+		free(pr);
+		return NULL;
+	}
+
+	return pr;
+}
+
+int prerecord_destroy(prerecord_t *pr)
+{
+	int ret;
+
+	pthread_mutex_lock(&pr->mutex);
+	pr->recording = 0;
+	pr->stop = 1;
+	pthread_cond_signal(&pr->cond);
+	pthread_mutex_unlock(&pr->mutex);
+	pthread_join(pr->tid, NULL);
+
+	if (pr->fd >= 0)
+		close(pr->fd);
+	ret = pr->error ? -1 : 0;
+
+	pthread_mutex_destroy(&pr->mutex);
+	pthread_cond_destroy(&pr->cond);
+	free(pr->ring);
+	free(pr->desc);
+	free(pr);
+
+	return ret;
+}
+
+int prerecord_push_iov(prerecord_t *pr, const struct iovec *iov, int iovcnt,
+		int key_frame, int64_t timestamp)
+{
+	struct pr_frame *f;
+	uint32_t off, len = 0;
+	uint8_t *dst;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	if (len == 0)
+		return 0;
+
+	pthread_mutex_lock(&pr->mutex);
+
+	if (pr->wait_idr && !key_frame)
+		goto drop;
+
+	/* make room a whole GOP at a time */
+	while (len > pr->ring_size || ring_reserve(pr, len, &off) < 0) {
+		if (len > pr->ring_size || evict_gop(pr) < 0)
+			goto drop;
+	}
+	/* the GOP this frame belongs to is gone */
+	if (pr->nr_frames == 0 && !key_frame)
+		goto drop;
+	pr->wait_idr = 0;
+
+	dst = pr->ring + off;
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+		dst += iov[i].iov_len;
+	}
+	f = FRAME(pr, pr->nr_frames);
+	f->off = off;
+	f->len = len;
+	f->key = key_frame;
+	f->ts = timestamp;
+	pr->head = off + len;
+	pr->nr_frames++;
+	pr->bytes += len;
+	pr->stat.frames++;
+
+	if (pr->recording) {
+		pr->nr_pending++;
+		pr->pending_bytes += len;
+		if (pr->pending_bytes > pr->stat.max_pending_bytes)
+			pr->stat.max_pending_bytes = pr->pending_bytes;
+		if (IMP_System_GetTimeStamp() - pr->last_motion > (int64_t)pr->attr.hold_off_ms * 1000) {
+			IMP_LOG_INFO(TAG, "event %d ends\n", pr->event - 1);
+			pr->recording = 0;
+		}
+		pthread_cond_signal(&pr->cond);
+	} else if (pr->fd >= 0) {
+		pr->nr_unrecorded++;
+	}
+
+	pthread_mutex_unlock(&pr->mutex);
+	return 0;
+
+drop:
+	pr->wait_idr = 1;
+	pr->stat.dropped++;
+	pthread_mutex_unlock(&pr->mutex);
+	return 1;
+}
+
+int prerecord_push(prerecord_t *pr, IMPEncoderStream *stream)
+{
+	struct iovec iov[stream->packCount];
+	int i;
+
+	for (i = 0; i < stream->packCount; i++) {
+		iov[i].iov_base = (void *)(uintptr_t)stream->pack[i].virAddr;
+		iov[i].iov_len = stream->pack[i].length;
+	}
+
+	return prerecord_push_iov(pr, iov, stream->packCount, h264_stream_is_key_frame(stream),
+			stream->pack[0].timestamp);
+}
+
+void prerecord_motion(prerecord_t *pr, int moving)
+{
+	if (!moving)
+		return;
+
+	pthread_mutex_lock(&pr->mutex);
+	pr->last_motion = IMP_System_GetTimeStamp();
+	if (!pr->recording) {
+		pr->recording = 1;
+		if (pr->fd >= 0) {
+			/* previous event still draining, continue it */
+			pr->nr_pending += pr->nr_unrecorded;
+			pr->nr_unrecorded = 0;
+		} else {
+			start_event(pr);
+			pr->open_req = 1;
+		}
+		pthread_cond_signal(&pr->cond);
+	}
+	pthread_mutex_unlock(&pr->mutex);
+}
+
+void prerecord_get_stat(prerecord_t *pr, prerecord_stat_t *stat)
+{
+	pthread_mutex_lock(&pr->mutex);
+	*stat = pr->stat;
+	stat->buffered_frames = pr->nr_frames;
+	stat->buffered_bytes = pr->bytes;
+	stat->buffered_us = pr->nr_frames ? FRAME(pr, pr->nr_frames - 1)->ts - FRAME(pr, 0)->ts : 0;
+	pthread_mutex_unlock(&pr->mutex);
+}
+
+void prerecord_dump_stat(prerecord_t *pr)
+{
+	prerecord_stat_t s;
+
+	prerecord_get_stat(pr, &s);
+	IMP_LOG_INFO(TAG, "%u frames, %u dropped, %u GOPs evicted, %u events, %llu bytes written\n",
+			s.frames, s.dropped, s.evicted_gops, s.events, (unsigned long long)s.bytes_written);
+	IMP_LOG_INFO(TAG, "ring: %u frames, %u of %u bytes, %lld ms; max backlog %u bytes, max write %lld us\n",
+			s.buffered_frames, s.buffered_bytes, pr->ring_size, (long long)s.buffered_us / 1000,
+			s.max_pending_bytes, (long long)s.max_write_us);
+}
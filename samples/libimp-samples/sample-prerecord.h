@@ -0,0 +1,95 @@
+/*
+ * sample-prerecord.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_PRERECORD_H__
+#define __SAMPLE_PRERECORD_H__
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <imp/imp_encoder.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * GOP aligned pre-event buffer.
+ *
+ * Every H264 frame is copied into a RAM ring with a fixed byte budget,
+ * both allocated once at create time. The ring always starts with an
+ * IDR: when room is needed the oldest whole GOP is evicted.
+ *
+ * A motion trigger opens an event file and writes the buffered GOPs of
+ * the last pre_ms, then every new frame, from a writer thread reading
+ * the same ring, no second copy. The event ends hold_off_ms after the
+ * last motion report. Frames still waiting to be written are never
+ * evicted; if the card falls that far behind the new frames are dropped
+ * up to the next IDR.
+ */
+
+#define PRERECORD_MAX_FRAMES	512		/* default descriptor count */
+#define PRERECORD_BATCH_FRAMES	16		/* max frames per writev() */
+
+typedef struct prerecord prerecord_t;
+
+typedef struct prerecord_attr {
+	uint32_t	budget;			/* ring bytes, bitrate * seconds to keep */
+	uint32_t	max_frames;		/* 0: PRERECORD_MAX_FRAMES */
+	int			pre_ms;			/* video written ahead of the trigger */
+	int			hold_off_ms;	/* recording goes on this long after the motion */
+	const char	*path_prefix;	/* events go to <prefix>/event-<n>.h264 */
+} prerecord_attr_t;
+
+typedef struct prerecord_stat {
+	uint32_t	frames;			/* frames buffered */
+	uint32_t	dropped;		/* frames lost, ring full of unwritten data */
+	uint32_t	evicted_gops;
+	uint32_t	events;
+	uint32_t	buffered_frames;	/* in the ring now */
+	uint32_t	buffered_bytes;
+	int64_t		buffered_us;		/* time span in the ring now */
+	uint32_t	max_pending_bytes;	/* worst writer backlog */
+	int64_t		max_write_us;
+	uint64_t	bytes_written;
+} prerecord_stat_t;
+
+prerecord_t *prerecord_create(const prerecord_attr_t *attr);
+
+/*
+ * End a running event after writing what is pending. Returns -1 if an
+ * event write failed on the way.
+ */
+int prerecord_destroy(prerecord_t *pr);
+
+/*
+ * Buffer one frame; called from the stream thread only. Returns 1 if the
+ * frame was dropped, 0 if it was kept.
+ */
+int prerecord_push(prerecord_t *pr, IMPEncoderStream *stream);
+
+/* Same for data from memory; timestamp in us */
+int prerecord_push_iov(prerecord_t *pr, const struct iovec *iov, int iovcnt,
+		int key_frame, int64_t timestamp);
+
+/*
+ * Report the motion state, e.g. from every IMP_IVS_MoveOutput. Motion
+ * starts an event or extends the running one.
+ */
+void prerecord_motion(prerecord_t *pr, int moving);
+
+void prerecord_get_stat(prerecord_t *pr, prerecord_stat_t *stat);
+void prerecord_dump_stat(prerecord_t *pr);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_PRERECORD_H__ */
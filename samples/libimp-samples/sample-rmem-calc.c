@@ -0,0 +1,264 @@
+/*
+ * sample-rmem-calc.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Reserved memory calculator, replaces res/tools/pc/rmem计算器V1.0.xlsx.
+ * Describe the pipeline with the options below, get rmem and ispmem with
+ * a breakdown per module. With a budget it also tells whether the
+ * pipeline fits, and with -n or -r how far one FS channel can go.
+ *
+ * usage: sample-rmem-calc [-s WxH] -f WxH[,nrVBs[,fmt]] ... [-e fs[,kbps[,bufsize]]] ...
+ *                         [-j fs[,bufsize]] ... [-o grp,WxH[,fmt]] ... [-i fs]
+ *                         [-d WxH[,nrKeepStream]] [-b budget | -c cmdline] [-n fs | -r fs]
+ *   -s  sensor, for ispmem
+ *   -f  FrameSource channel; fmt nv12 (default) or any other by its fmt_to_string()
+ *       name, e.g. nv21, yuyv422, gray8, bgra or raw
+ *   -e  H264 CBR channel on FS channel fs, kbps as the samples pick it by
+ *       default; bufsize as sample-enc-bufsize estimates it by default,
+ *       0 for libimp's own
+ *   -j  JPEG channel on FS channel fs
+ *   -o  OSD region of group grp; fmt bgra (default), rgb555le, another name as
+ *       for -f, or bitmap
+ *   -i  IVS on FS channel fs
+ *   -d  JPEG decoder
+ *   -b  rmem budget, like rmem= (e.g. 18M)
+ *   -c  the budget from the rmem= of a kernel command line, - for /proc/cmdline
+ *   -n  the most nrVBs FS channel fs can have within the budget
+ *   -r  the largest picture FS channel fs can have within the budget
+ * Exits 1 if the pipeline does not fit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-rmem-plan.h"
+#include "sample-enc-bufsize.h"
+
+#define TAG "Sample-Rmem-Calc"
+
+#define DEFAULT_FPS		25
+
+/* Any format by its fmt_to_string() name */
+static int parse_fmt(const char *s, IMPPixelFormat *fmt)
+{
+	int i;
+
+	for (i = 0; i < PIX_FMT_NB; i++) {
+		if (strcmp(s, fmt_to_string(i)) == 0) {
+			*fmt = i;
+			return 0;
+		}
+	}
+	IMP_LOG_ERR(TAG, "unknown pixel format %s\n", s);
+
+	return -1;
+}
+
+static int add_fs(rmem_pipeline_t *p, const char *arg)
+{
+	IMPFSChnAttr *fs;
+	char fmt[16] = "nv12";
+	int n;
+
+	if (p->nr_fs == RMEM_MAX_FS)
+		return -1;
+	fs = &p->fs[p->nr_fs];
+	fs->nrVBs = 2;
+	n = sscanf(arg, "%dx%d,%d,%15s", &fs->picWidth, &fs->picHeight, &fs->nrVBs, fmt);
+	if (n < 2 || fs->picWidth <= 0 || fs->picHeight <= 0 || fs->nrVBs <= 0
+			|| parse_fmt(fmt, &fs->pixFmt) < 0)
+		return -1;
+	fs->outFrmRateNum = DEFAULT_FPS;
+	fs->outFrmRateDen = 1;
+	fs->type = FS_PHY_CHANNEL;
+	p->nr_fs++;
+
+	return 0;
+}
+
+/* An H264 or JPEG channel on FS channel fs, rate controlled as in sample_encoder_init() */
+static int add_enc(rmem_pipeline_t *p, const char *arg, IMPPayloadType type)
+{
+	IMPEncoderCHNAttr *attr;
+	IMPFSChnAttr *fs;
+	int chn, kbps = -1, bufsize = -1, n;
+
+	if (p->nr_enc == RMEM_MAX_ENC)
+		return -1;
+	if (type == PT_H264)
+		n = sscanf(arg, "%d,%d,%d", &chn, &kbps, &bufsize);
+	else
+		n = sscanf(arg, "%d,%d", &chn, &bufsize);
+	if (n < 1 || chn < 0 || chn >= p->nr_fs)
+		return -1;
+	fs = &p->fs[chn];
+
+	p->enc[p->nr_enc].fs = chn;
+	attr = &p->enc[p->nr_enc].attr;
+	memset(attr, 0, sizeof(*attr));
+	attr->encAttr.enType = type;
+	attr->encAttr.picWidth = fs->picWidth;
+	attr->encAttr.picHeight = fs->picHeight;
+	if (type == PT_H264) {
+		attr->encAttr.profile = 1;
+		attr->rcAttr.rcMode = ENC_RC_MODE_H264CBR;
+		attr->rcAttr.attrH264Cbr.outFrmRate.frmRateNum = fs->outFrmRateNum;
+		attr->rcAttr.attrH264Cbr.outFrmRate.frmRateDen = fs->outFrmRateDen;
+		attr->rcAttr.attrH264Cbr.maxGop = 2 * fs->outFrmRateNum / fs->outFrmRateDen;
+		attr->rcAttr.attrH264Cbr.outBitRate = kbps >= 0 ? kbps
+			: 2000ULL * (fs->picWidth * fs->picHeight) / (1280 * 720);
+		attr->rcAttr.attrH264Cbr.maxQp = 38;
+		attr->rcAttr.attrH264Cbr.minQp = 15;
+	}
+	attr->encAttr.bufSize = bufsize >= 0 ? bufsize : enc_bufsize_estimate(attr, ENC_BUFSIZE_DEPTH);
+	p->nr_enc++;
+
+	return 0;
+}
+
+static int add_osd(rmem_pipeline_t *p, const char *arg)
+{
+	IMPOSDRgnAttr *attr;
+	char fmt[16] = "bgra";
+	int grp, w, h;
+
+	if (p->nr_osd == RMEM_MAX_OSD)
+		return -1;
+	if (sscanf(arg, "%d,%dx%d,%15s", &grp, &w, &h, fmt) < 3 || w <= 0 || h <= 0)
+		return -1;
+
+	p->osd[p->nr_osd].grp = grp;
+	attr = &p->osd[p->nr_osd].attr;
+	memset(attr, 0, sizeof(*attr));
+	attr->rect.p1.x = w - 1;
+	attr->rect.p1.y = h - 1;
+	if (strcmp(fmt, "bitmap") == 0) {
+		attr->type = OSD_REG_BITMAP;
+		attr->fmt = PIX_FMT_MONOWHITE;
+	} else {
+		attr->type = OSD_REG_PIC;
+		if (parse_fmt(fmt, &attr->fmt) < 0)
+			return -1;
+	}
+	p->nr_osd++;
+
+	return 0;
+}
+
+static int set_dec(rmem_pipeline_t *p, const char *arg)
+{
+	IMPDecoderAttr *attr = &p->dec.decAttr;
+
+	memset(attr, 0, sizeof(*attr));
+	attr->decType = PT_JPEG;
+	attr->pixelFormat = PIX_FMT_NV12;
+	attr->nrKeepStream = 2;
+	if (sscanf(arg, "%ux%u,%u", &attr->maxWidth, &attr->maxHeight, &attr->nrKeepStream) < 2)
+		return -1;
+	p->nr_dec = 1;
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	rmem_pipeline_t p;
+	rmem_usage_t u;
+	uint32_t budget = 0, ispmem = 0;
+	int opt, nrvbs_fs = -1, size_fs = -1, ret = 0;
+
+	memset(&p, 0, sizeof(p));
+	p.ivs_fs = -1;
+
+	while ((opt = getopt(argc, argv, "s:f:e:j:o:i:d:b:c:n:r:")) != -1) {
+		switch (opt) {
+		case 's':
+			if (sscanf(optarg, "%dx%d", &p.sensor_width, &p.sensor_height) != 2)
+				goto usage;
+			break;
+		case 'f':
+			if (add_fs(&p, optarg) < 0)
+				goto usage;
+			break;
+		case 'e':
+			if (add_enc(&p, optarg, PT_H264) < 0)
+				goto usage;
+			break;
+		case 'j':
+			if (add_enc(&p, optarg, PT_JPEG) < 0)
+				goto usage;
+			break;
+		case 'o':
+			if (add_osd(&p, optarg) < 0)
+				goto usage;
+			break;
+		case 'i':
+			p.ivs_fs = atoi(optarg);
+			break;
+		case 'd':
+			if (set_dec(&p, optarg) < 0)
+				goto usage;
+			break;
+		case 'b':
+			budget = rmem_plan_parse_size(optarg);
+			break;
+		case 'c':
+			if (rmem_plan_read_cmdline(strcmp(optarg, "-") ? optarg : NULL, &budget, &ispmem) < 0)
+				return -1;
+			break;
+		case 'n':
+			nrvbs_fs = atoi(optarg);
+			break;
+		case 'r':
+			size_fs = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (p.nr_fs == 0 || ((nrvbs_fs >= 0 || size_fs >= 0) && budget == 0))
+		goto usage;
+
+	if (nrvbs_fs >= 0) {
+		ret = rmem_plan_max_nrvbs(&p, nrvbs_fs, budget);
+		if (ret < 0)
+			printf("fs%d: nothing fits in %u\n", nrvbs_fs, budget);
+		else
+			printf("fs%d: at most %d VBs in %u\n", nrvbs_fs, ret, budget);
+	}
+	if (size_fs >= 0) {
+		ret = rmem_plan_max_size(&p, size_fs, budget);
+		if (ret < 0)
+			printf("fs%d: nothing fits in %u\n", size_fs, budget);
+		else
+			printf("fs%d: at most %dx%d in %u\n", size_fs, p.fs[size_fs].picWidth,
+					p.fs[size_fs].picHeight, budget);
+	}
+
+	if (rmem_plan(&p, &u) < 0)
+		return -1;
+	rmem_plan_dump(&p, &u);
+	printf("rmem %u ispmem %u\n", u.total, u.ispmem);
+
+	if (budget && (u.total > budget || (ispmem && u.ispmem > ispmem))) {
+		printf("does not fit: rmem %u of %u, ispmem %u of %u\n", u.total, budget, u.ispmem, ispmem);
+		return 1;
+	}
+	if (budget)
+		printf("fits: %u of rmem %u left\n", budget - u.total, budget);
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-s WxH] -f WxH[,nrVBs[,fmt]] ... [-e fs[,kbps[,bufsize]]] ...\n"
+			"       [-j fs[,bufsize]] ... [-o grp,WxH[,fmt]] ... [-i fs]\n"
+			"       [-d WxH[,nrKeepStream]] [-b budget | -c cmdline] [-n fs | -r fs]\n", argv[0]);
+	return -1;
+}
@@ -0,0 +1,332 @@
+/*
+ * sample-rmem-plan.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-rmem-plan.h"
+#include "sample-enc-bufsize.h"
+
+#define TAG "Sample-Rmem-Plan"
+
+#define PROC_CMDLINE		"/proc/cmdline"
+
+static uint32_t align_to(uint64_t n, uint32_t a)
+{
+	return (n + a - 1) / a * a;
+}
+
+/* Bits per pixel of pixFmt */
+static int bpp_x8(IMPPixelFormat pixFmt)
+{
+	const IMPPixelFormatDesc *desc = imp_pixfmt_desc(pixFmt);
+
+	/* as the calculator, 16 for what it does not know */
+	return desc ? desc->bpp : 16;
+}
+
+uint32_t rmem_frame_size(int width, int height, IMPPixelFormat pixFmt)
+{
+	uint64_t pixels = (uint64_t)align_to(width, RMEM_ALIGN) * align_to(height, RMEM_ALIGN);
+
+	return align_to(pixels * bpp_x8(pixFmt) / 8, RMEM_PAGE);
+}
+
+static uint32_t stream_buf(const IMPEncoderAttr *attr)
+{
+	if (attr->bufSize)
+		return align_to(attr->bufSize, RMEM_PAGE);
+	return align_to((uint64_t)attr->picWidth * attr->picHeight + RMEM_ENC_BUF_PAD, RMEM_PAGE);
+}
+
+static uint32_t h264_chn(const IMPEncoderAttr *attr)
+{
+	uint32_t mbs = align_to(attr->picWidth, 16) / 16 * (align_to(attr->picHeight, 16) / 16);
+
+	return 2 * rmem_frame_size(attr->picWidth, attr->picHeight, PIX_FMT_NV12)
+		+ align_to((uint64_t)mbs * RMEM_H264_MB_BYTES, RMEM_PAGE);
+}
+
+static uint32_t osd_rgn(const IMPOSDRgnAttr *attr)
+{
+	uint64_t w = abs(attr->rect.p1.x - attr->rect.p0.x) + 1;
+	uint64_t h = abs(attr->rect.p1.y - attr->rect.p0.y) + 1;
+
+	/* lines, rectangles and covers are drawn, they keep no pixels */
+	if (attr->type != OSD_REG_BITMAP && attr->type != OSD_REG_PIC)
+		return 0;
+	if (attr->type == OSD_REG_BITMAP)
+		return (w * h + 7) / 8;
+	return w * h * bpp_x8(attr->fmt) / 8;
+}
+
+int rmem_plan(const rmem_pipeline_t *p, rmem_usage_t *u)
+{
+	const IMPFSChnAttr *fs;
+	const IMPDecoderAttr *dec;
+	uint64_t total = 0, osd[RMEM_MAX_OSD_GRP];
+	int i, used[RMEM_MAX_OSD_GRP];
+
+	memset(u, 0, sizeof(*u));
+	memset(osd, 0, sizeof(osd));
+	memset(used, 0, sizeof(used));
+	if (p->nr_fs > RMEM_MAX_FS || p->nr_enc > RMEM_MAX_ENC || p->nr_osd > RMEM_MAX_OSD
+			|| p->ivs_fs >= p->nr_fs) {
+		IMP_LOG_ERR(TAG, "malformed pipeline\n");
+		return -1;
+	}
+
+	for (i = 0; i < p->nr_fs; i++) {
+		fs = &p->fs[i];
+		u->fs[i] = fs->nrVBs * rmem_frame_size(fs->picWidth, fs->picHeight, fs->pixFmt);
+		total += u->fs[i];
+	}
+
+	for (i = 0; i < p->nr_enc; i++) {
+		if (p->enc[i].fs < 0 || p->enc[i].fs >= p->nr_fs) {
+			IMP_LOG_ERR(TAG, "encoder %d on FS channel %d of %d\n", i, p->enc[i].fs, p->nr_fs);
+			return -1;
+		}
+		u->enc_stream[i] = stream_buf(&p->enc[i].attr.encAttr);
+		u->enc[i] = u->enc_stream[i];
+		if (p->enc[i].attr.encAttr.enType == PT_H264)
+			u->enc[i] += h264_chn(&p->enc[i].attr.encAttr);
+		total += u->enc[i];
+	}
+
+	for (i = 0; i < p->nr_osd; i++) {
+		if (p->osd[i].grp < 0 || p->osd[i].grp >= RMEM_MAX_OSD_GRP) {
+			IMP_LOG_ERR(TAG, "OSD region %d in group %d\n", i, p->osd[i].grp);
+			return -1;
+		}
+		osd[p->osd[i].grp] += osd_rgn(&p->osd[i].attr);
+		used[p->osd[i].grp] = 1;
+	}
+	/* a group with only drawn regions still sets up its pool */
+	for (i = 0; i < RMEM_MAX_OSD_GRP; i++) {
+		if (!used[i])
+			continue;
+		u->osd[i] = osd[i] > RMEM_OSD_GRP_POOL ? align_to(osd[i], RMEM_PAGE) : RMEM_OSD_GRP_POOL;
+		total += u->osd[i];
+	}
+
+	if (p->ivs_fs >= 0) {
+		fs = &p->fs[p->ivs_fs];
+		u->ivs = RMEM_IVS_FRAMES * rmem_frame_size(fs->picWidth, fs->picHeight, PIX_FMT_GRAY8);
+		total += u->ivs;
+	}
+
+	if (p->nr_dec) {
+		dec = &p->dec.decAttr;
+		u->dec = (dec->nrKeepStream + 1) * rmem_frame_size(dec->maxWidth, dec->maxHeight, dec->pixelFormat)
+			+ align_to((uint64_t)dec->maxWidth * dec->maxHeight, RMEM_PAGE);
+		total += u->dec;
+	}
+
+	if (total > 0xffffffffULL - RMEM_PAGE) {
+		IMP_LOG_ERR(TAG, "pipeline needs more than 4GB\n");
+		return -1;
+	}
+	u->total = align_to(total, RMEM_PAGE);
+	u->ispmem = (uint64_t)p->sensor_width * p->sensor_height * RMEM_ISP_BPP;
+
+	return 0;
+}
+
+void rmem_plan_dump(const rmem_pipeline_t *p, const rmem_usage_t *u)
+{
+	const IMPEncoderAttr *enc;
+	int i;
+
+	for (i = 0; i < p->nr_fs; i++)
+		IMP_LOG_INFO(TAG, "fs%d      %4dx%-4d %2d VBs  %9u\n", i, p->fs[i].picWidth,
+				p->fs[i].picHeight, p->fs[i].nrVBs, u->fs[i]);
+	for (i = 0; i < p->nr_enc; i++) {
+		enc = &p->enc[i].attr.encAttr;
+		IMP_LOG_INFO(TAG, "enc%d %s %4dx%-4d fs%d     %9u (stream %u)\n", i,
+				enc->enType == PT_H264 ? "h264" : "jpeg", enc->picWidth, enc->picHeight,
+				p->enc[i].fs, u->enc[i], u->enc_stream[i]);
+	}
+	for (i = 0; i < RMEM_MAX_OSD_GRP; i++) {
+		if (u->osd[i])
+			IMP_LOG_INFO(TAG, "osd grp%d                %9u\n", i, u->osd[i]);
+	}
+	if (u->ivs)
+		IMP_LOG_INFO(TAG, "ivs      fs%d            %9u\n", p->ivs_fs, u->ivs);
+	if (u->dec)
+		IMP_LOG_INFO(TAG, "dec      %4dx%-4d keep %d %9u\n", p->dec.decAttr.maxWidth,
+				p->dec.decAttr.maxHeight, p->dec.decAttr.nrKeepStream, u->dec);
+	IMP_LOG_INFO(TAG, "rmem                    %9u (%uK, rmem=%uM)\n", u->total,
+			u->total / 1024, (u->total + 0xfffff) >> 20);
+	if (u->ispmem)
+		IMP_LOG_INFO(TAG, "ispmem   %4dx%-4d       %9u (%uK, ispmem=%uM)\n", p->sensor_width,
+				p->sensor_height, u->ispmem, u->ispmem / 1024, (u->ispmem + 0xfffff) >> 20);
+}
+
+uint32_t rmem_plan_parse_size(const char *s)
+{
+	char *end;
+	uint64_t n = strtoull(s, &end, 0);
+
+	switch (*end) {
+	case 'G': case 'g':
+		n <<= 10;
+		/* fall through */
+	case 'M': case 'm':
+		n <<= 10;
+		/* fall through */
+	case 'K': case 'k':
+		n <<= 10;
+	default:
+		break;
+	}
+
+	return n > 0xffffffffULL ? 0xffffffff : n;
+}
+
+static uint32_t cmdline_size(const char *cmdline, const char *key)
+{
+	const char *s = cmdline;
+	int len = strlen(key);
+
+	while ((s = strstr(s, key)) != NULL) {
+		if (s == cmdline || s[-1] == ' ')
+			return rmem_plan_parse_size(s + len);
+		s += len;
+	}
+
+	return 0;
+}
+
+int rmem_plan_read_cmdline(const char *cmdline, uint32_t *rmem, uint32_t *ispmem)
+{
+	char buf[1024];
+	FILE *f;
+	size_t n;
+
+	if (cmdline == NULL) {
+		f = fopen(PROC_CMDLINE, "r");
+		if (f == NULL) {
+			IMP_LOG_ERR(TAG, "open %s failed\n", PROC_CMDLINE);
+			return -1;
+		}
+		n = fread(buf, 1, sizeof(buf) - 1, f);
+		fclose(f);
+		buf[n] = '\0';
+		cmdline = buf;
+	}
+
+	*rmem = cmdline_size(cmdline, "rmem=");
+	*ispmem = cmdline_size(cmdline, "ispmem=");
+
+	return 0;
+}
+
+int rmem_plan_check(const rmem_pipeline_t *p)
+{
+	rmem_usage_t u;
+	uint32_t rmem, ispmem;
+
+	if (rmem_plan(p, &u) < 0)
+		return -1;
+	if (rmem_plan_read_cmdline(NULL, &rmem, &ispmem) < 0 || rmem == 0) {
+		IMP_LOG_WARN(TAG, "no rmem= on the kernel command line, pipeline needs %u\n", u.total);
+		return 0;
+	}
+
+	if (u.total > rmem || (ispmem && u.ispmem > ispmem)) {
+		IMP_LOG_WARN(TAG, "pipeline needs rmem %u ispmem %u, reserved rmem %u ispmem %u\n",
+				u.total, u.ispmem, rmem, ispmem);
+		rmem_plan_dump(p, &u);
+		return -1;
+	}
+	IMP_LOG_DBG(TAG, "pipeline needs rmem %u of %u\n", u.total, rmem);
+
+	return 0;
+}
+
+static int fits(const rmem_pipeline_t *p, uint32_t budget)
+{
+	rmem_usage_t u;
+
+	return rmem_plan(p, &u) == 0 && u.total <= budget;
+}
+
+int rmem_plan_max_nrvbs(rmem_pipeline_t *p, int fs, uint32_t budget)
+{
+	int n;
+
+	if (fs < 0 || fs >= p->nr_fs)
+		return -1;
+
+	for (n = RMEM_MAX_NRVBS; n > 0; n--) {
+		p->fs[fs].nrVBs = n;
+		if (fits(p, budget))
+			return n;
+	}
+
+	return -1;
+}
+
+/* FS channel fs, its encoders' pictures and bitrates at width x height */
+static void set_size(rmem_pipeline_t *p, int fs, int width, int height)
+{
+	IMPFSChnAttr *attr = &p->fs[fs];
+	IMPEncoderCHNAttr *enc;
+	uint64_t area = (uint64_t)attr->picWidth * attr->picHeight;
+	uint64_t new_area = (uint64_t)width * height;
+	int i;
+
+	for (i = 0; i < p->nr_enc; i++) {
+		if (p->enc[i].fs != fs)
+			continue;
+		enc = &p->enc[i].attr;
+		enc->encAttr.picWidth = width;
+		enc->encAttr.picHeight = height;
+		if (enc->rcAttr.rcMode == ENC_RC_MODE_H264CBR)
+			enc->rcAttr.attrH264Cbr.outBitRate = enc->rcAttr.attrH264Cbr.outBitRate * new_area / area;
+		else if (enc->rcAttr.rcMode == ENC_RC_MODE_H264VBR)
+			enc->rcAttr.attrH264Vbr.maxBitRate = enc->rcAttr.attrH264Vbr.maxBitRate * new_area / area;
+		/* a sized stream buffer is sized again, libimp's follows the picture */
+		if (enc->encAttr.bufSize)
+			enc->encAttr.bufSize = enc_bufsize_estimate(enc, ENC_BUFSIZE_DEPTH);
+	}
+
+	attr->picWidth = width;
+	attr->picHeight = height;
+	attr->scaler.enable = 1;
+	attr->scaler.outwidth = width;
+	attr->scaler.outheight = height;
+}
+
+int rmem_plan_max_size(rmem_pipeline_t *p, int fs, uint32_t budget)
+{
+	int w0, h0, w, h;
+
+	if (fs < 0 || fs >= p->nr_fs || p->fs[fs].picWidth < RMEM_ALIGN)
+		return -1;
+	w0 = p->fs[fs].picWidth;
+	h0 = p->fs[fs].picHeight;
+	if (fits(p, budget))
+		return 0;
+
+	/* widths on the alignment, heights even, the aspect of the original */
+	for (w = (w0 - 1) / RMEM_ALIGN * RMEM_ALIGN; w >= RMEM_ALIGN; w -= RMEM_ALIGN) {
+		h = (int)((int64_t)h0 * w / w0) & ~1;
+		if (h < 2)
+			break;
+		set_size(p, fs, w, h);
+		if (fits(p, budget))
+			return 0;
+	}
+
+	return -1;
+}
@@ -0,0 +1,134 @@
+/*
+ * sample-rmem-plan.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_RMEM_PLAN_H__
+#define __SAMPLE_RMEM_PLAN_H__
+
+#include <stdint.h>
+#include <imp/imp_common.h>
+#include <imp/imp_framesource.h>
+#include <imp/imp_encoder.h>
+#include <imp/imp_decoder.h>
+#include <imp/imp_osd.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Reserved memory planner, in place of res/tools/pc/rmem计算器V1.0.xlsx.
+ *
+ * Takes the pipeline as the attributes the samples hand to libimp and
+ * adds up what each module takes from rmem:
+ *  - FrameSource: nrVBs frames of the channel's picture, lines and
+ *    rows padded to RMEM_ALIGN;
+ *  - H264: a reference and a reconstructed frame, RMEM_H264_MB_BYTES
+ *    per macroblock of motion and mode data, and the stream buffer;
+ *  - JPEG: the stream buffer only, it codes straight from the FS frame;
+ *  - OSD: at least RMEM_OSD_GRP_POOL per group with regions, more if
+ *    its bitmap and picture regions do not fit in there;
+ *  - IVS: RMEM_IVS_FRAMES luma planes of the analysed channel;
+ *  - Decoder: nrKeepStream + 1 frames and a stream buffer of the
+ *    largest picture.
+ * A bufSize of 0 stands for libimp's own stream buffer, the picture
+ * size plus RMEM_ENC_BUF_PAD, as the calculator had it. ispmem is a
+ * separate carve-out of RMEM_ISP_BPP bytes per sensor pixel; it is
+ * reported but not part of the rmem total.
+ */
+
+#define RMEM_ALIGN				16				/* frame lines and rows */
+#define RMEM_PAGE				4096
+#define RMEM_H264_MB_BYTES		64
+#define RMEM_ENC_BUF_PAD		(7 * 1024)
+#define RMEM_OSD_GRP_POOL		(1024 * 1024)
+#define RMEM_IVS_FRAMES			2
+#define RMEM_ISP_BPP			4
+
+#define RMEM_MAX_FS				4
+#define RMEM_MAX_ENC			8
+#define RMEM_MAX_OSD			16
+#define RMEM_MAX_OSD_GRP		4
+#define RMEM_MAX_NRVBS			16				/* search limit, as far as the VB tuner goes */
+
+typedef struct rmem_enc {
+	int					fs;				/* FS channel it codes */
+	IMPEncoderCHNAttr	attr;
+} rmem_enc_t;
+
+typedef struct rmem_osd {
+	int					grp;
+	IMPOSDRgnAttr		attr;
+} rmem_osd_t;
+
+typedef struct rmem_pipeline {
+	int					sensor_width;	/* 0: no ispmem */
+	int					sensor_height;
+
+	int					nr_fs;
+	IMPFSChnAttr		fs[RMEM_MAX_FS];
+	int					nr_enc;
+	rmem_enc_t			enc[RMEM_MAX_ENC];
+	int					nr_osd;
+	rmem_osd_t			osd[RMEM_MAX_OSD];
+	int					ivs_fs;			/* FS channel IVS analyses, -1: none */
+	int					nr_dec;			/* 0 or 1 */
+	IMPDecoderCHNAttr	dec;
+} rmem_pipeline_t;
+
+typedef struct rmem_usage {
+	uint32_t			fs[RMEM_MAX_FS];
+	uint32_t			enc[RMEM_MAX_ENC];
+	uint32_t			enc_stream[RMEM_MAX_ENC];	/* part of enc[] */
+	uint32_t			osd[RMEM_MAX_OSD_GRP];
+	uint32_t			ivs;
+	uint32_t			dec;
+	uint32_t			total;			/* rmem, page aligned */
+	uint32_t			ispmem;
+} rmem_usage_t;
+
+/* Bytes of a width x height frame in pixFmt, padded like the hardware does */
+uint32_t rmem_frame_size(int width, int height, IMPPixelFormat pixFmt);
+
+/* 0 on success, -1 if the pipeline is malformed */
+int rmem_plan(const rmem_pipeline_t *p, rmem_usage_t *u);
+void rmem_plan_dump(const rmem_pipeline_t *p, const rmem_usage_t *u);
+
+/* A kernel memparse() size: a number with an optional K, M or G */
+uint32_t rmem_plan_parse_size(const char *s);
+
+/*
+ * The rmem= and ispmem= sizes on the kernel command line, from cmdline
+ * (NULL: /proc/cmdline). Either is 0 if missing.
+ */
+int rmem_plan_read_cmdline(const char *cmdline, uint32_t *rmem, uint32_t *ispmem);
+
+/*
+ * Startup check: -1, with the breakdown, if the pipeline needs more
+ * than the rmem= reservation; whether that stops the program is up to
+ * the caller. Passes when the reservation is unknown.
+ */
+int rmem_plan_check(const rmem_pipeline_t *p);
+
+/*
+ * Search, within budget bytes of rmem:
+ *  - the most nrVBs FS channel fs can have, up to RMEM_MAX_NRVBS;
+ *  - the largest picture of FS channel fs, at most its current size
+ *    and of the same aspect; its encoders and IVS follow.
+ * -1 if nothing fits, p is left at the best fit otherwise.
+ */
+int rmem_plan_max_nrvbs(rmem_pipeline_t *p, int fs, uint32_t budget);
+int rmem_plan_max_size(rmem_pipeline_t *p, int fs, uint32_t budget);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_RMEM_PLAN_H__ */
@@ -0,0 +1,228 @@
+/*
+ * sample-rtp-probe.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+
+#include "sample-rtp-probe.h"
+
+#define TAG "Sample-RTP-Probe"
+
+#define PROBE_RECV_TIMEOUT_MS	200		/* how often the thread looks for stop */
+
+struct rtp_probe {
+	rtsp_server_t		*srv;
+	int					id;
+	char				url[128];
+	int					fd;
+	int					rtp_fd;
+	pthread_t			tid;
+	volatile int		stop;
+
+	pthread_mutex_t		mutex;
+	rtp_probe_stat_t	stat;
+	int64_t				first[RTP_PROBE_WINDOW];
+	int64_t				last[RTP_PROBE_WINDOW];
+};
+
+/* Send one request, return the status code */
+static int rtsp_request(int fd, const char *method, const char *url, int cseq,
+		const char *headers)
+{
+	char req[512], resp[1024];
+	int len, n = 0, ret;
+
+	len = snprintf(req, sizeof(req), "%s %s RTSP/1.0\r\nCSeq: %d\r\n%s\r\n",
+			method, url, cseq, headers);
+	if (send(fd, req, len, 0) != len)
+		return -1;
+
+	/* the replies to SETUP, PLAY and TEARDOWN have no body */
+	while (n < (int)sizeof(resp) - 1) {
+		ret = recv(fd, resp + n, sizeof(resp) - 1 - n, 0);
+		if (ret <= 0)
+			return -1;
+		n += ret;
+		resp[n] = '\0';
+		if (strstr(resp, "\r\n\r\n"))
+			break;
+	}
+
+	return sscanf(resp, "RTSP/1.0 %d", &ret) == 1 ? ret : -1;
+}
+
+static void *probe_thread(void *arg)
+{
+	rtp_probe_t *probe = (rtp_probe_t *)arg;
+	uint8_t pkt[2048];
+	uint16_t seq, last_seq = 0;
+	uint32_t ts, cur_ts = 0;
+	int64_t now, capture;
+	int n, in_frame = 0, k;
+
+	while (!probe->stop) {
+		n = recv(probe->rtp_fd, pkt, sizeof(pkt), 0);
+		if (n < 12)
+			continue;
+		now = IMP_System_GetTimeStamp();
+		seq = (pkt[2] << 8) | pkt[3];
+		ts = ((uint32_t)pkt[4] << 24) | (pkt[5] << 16) | (pkt[6] << 8) | pkt[7];
+		capture = rtsp_server_rtp_timestamp(probe->srv, probe->id, ts);
+
+		pthread_mutex_lock(&probe->mutex);
+		if (probe->stat.packets && seq != (uint16_t)(last_seq + 1))
+			probe->stat.seq_gaps++;
+		last_seq = seq;
+		probe->stat.packets++;
+
+		k = probe->stat.frames % RTP_PROBE_WINDOW;
+		if (!in_frame || ts != cur_ts) {
+			probe->first[k] = now - capture;
+			cur_ts = ts;
+			in_frame = 1;
+		}
+		if (pkt[1] & 0x80) {
+			probe->last[k] = now - capture;
+			if (now - capture > probe->stat.last_max_us)
+				probe->stat.last_max_us = now - capture;
+			probe->stat.frames++;
+			in_frame = 0;
+		}
+		pthread_mutex_unlock(&probe->mutex);
+	}
+
+	return NULL;
+}
+
+rtp_probe_t *rtp_probe_start(rtsp_server_t *srv, int port, int id, const char *name)
+{
+	rtp_probe_t *probe;
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	struct timeval tv;
+	char hdr[128];
+	int rtp_port;
+
+	probe = calloc(1, sizeof(rtp_probe_t));
+	if (probe == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+	probe->srv = srv;
+	probe->id = id;
+	snprintf(probe->url, sizeof(probe->url), "rtsp://127.0.0.1:%d/%s", port, name);
+	pthread_mutex_init(&probe->mutex, NULL);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	probe->rtp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	probe->fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (probe->rtp_fd < 0 || probe->fd < 0
+			|| bind(probe->rtp_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+			|| getsockname(probe->rtp_fd, (struct sockaddr *)&addr, &alen) < 0) {
+		IMP_LOG_ERR(TAG, "socket failed: %s\n", strerror(errno));
+		goto err;
+	}
+	rtp_port = ntohs(addr.sin_port);
+	tv.tv_sec = 0;
+	tv.tv_usec = PROBE_RECV_TIMEOUT_MS * 1000;
+	setsockopt(probe->rtp_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	addr.sin_port = htons(port);
+	if (connect(probe->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		IMP_LOG_ERR(TAG, "connect to %s failed: %s\n", probe->url, strerror(errno));
+		goto err;
+	}
+
+	snprintf(hdr, sizeof(hdr), "Transport: RTP/AVP;unicast;client_port=%d-%d\r\n",
+			rtp_port, rtp_port + 1);
+	if (rtsp_request(probe->fd, "SETUP", probe->url, 1, hdr) != 200
+			|| rtsp_request(probe->fd, "PLAY", probe->url, 2, "Session: x\r\n") != 200) {
+		IMP_LOG_ERR(TAG, "%s: SETUP/PLAY failed\n", probe->url);
+		goto err;
+	}
+
+	if (pthread_create(&probe->tid, NULL, probe_thread, probe)) {
+		IMP_LOG_ERR(TAG, "create probe thread failed\n");
+		goto err;
+	}
+
+	return probe;
+
+err:
+	if (probe->fd >= 0)
+		close(probe->fd);
+	if (probe->rtp_fd >= 0)
+		close(probe->rtp_fd);
+	pthread_mutex_destroy(&probe->mutex);
+	free(probe);
+	return NULL;
+}
+
+void rtp_probe_stop(rtp_probe_t *probe)
+{
+	probe->stop = 1;
+	pthread_join(probe->tid, NULL);
+
+	rtsp_request(probe->fd, "TEARDOWN", probe->url, 3, "Session: x\r\n");
+	close(probe->fd);
+	close(probe->rtp_fd);
+	pthread_mutex_destroy(&probe->mutex);
+	free(probe);
+}
+
+static int cmp_lat(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+void rtp_probe_get_stat(rtp_probe_t *probe, rtp_probe_stat_t *stat)
+{
+	int64_t first[RTP_PROBE_WINDOW], last[RTP_PROBE_WINDOW];
+	uint32_t n;
+
+	pthread_mutex_lock(&probe->mutex);
+	*stat = probe->stat;
+	n = stat->frames < RTP_PROBE_WINDOW ? stat->frames : RTP_PROBE_WINDOW;
+	memcpy(first, probe->first, n * sizeof(int64_t));
+	memcpy(last, probe->last, n * sizeof(int64_t));
+	pthread_mutex_unlock(&probe->mutex);
+
+	if (n == 0)
+		return;
+	qsort(first, n, sizeof(int64_t), cmp_lat);
+	qsort(last, n, sizeof(int64_t), cmp_lat);
+	stat->first_p50_us = first[(n - 1) * 50 / 100];
+	stat->first_p99_us = first[(n - 1) * 99 / 100];
+	stat->last_p50_us = last[(n - 1) * 50 / 100];
+	stat->last_p99_us = last[(n - 1) * 99 / 100];
+}
+
+void rtp_probe_dump_stat(rtp_probe_t *probe)
+{
+	rtp_probe_stat_t s;
+
+	rtp_probe_get_stat(probe, &s);
+	IMP_LOG_INFO(TAG, "%s: %u frames, %u packets, %u sequence gaps, capture -> first packet "
+			"p50/p99 %lld/%lld us, -> last packet p50/p99/max %lld/%lld/%lld us\n",
+			probe->url, s.frames, s.packets, s.seq_gaps,
+			(long long)s.first_p50_us, (long long)s.first_p99_us,
+			(long long)s.last_p50_us, (long long)s.last_p99_us, (long long)s.last_max_us);
+}
@@ -0,0 +1,60 @@
+/*
+ * sample-rtp-probe.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_RTP_PROBE_H__
+#define __SAMPLE_RTP_PROBE_H__
+
+#include <stdint.h>
+
+#include "sample-rtsp-server.h"
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Loopback latency probe.
+ *
+ * Plays a stream of an RTSP server in the same process over 127.0.0.1,
+ * like a viewer would, and times each frame from its capture timestamp
+ * (read back from the RTP timestamp) to the arrival of its first and of
+ * its last packet. With the encoder's frame timestamps this is glass to
+ * glass up to the viewer's network and decoder.
+ */
+
+#define RTP_PROBE_WINDOW	512		/* frames kept for the percentiles */
+
+typedef struct rtp_probe rtp_probe_t;
+
+typedef struct rtp_probe_stat {
+	uint32_t	frames;				/* complete, marker seen */
+	uint32_t	packets;
+	uint32_t	seq_gaps;
+	int64_t		first_p50_us;		/* capture -> first packet received */
+	int64_t		first_p99_us;
+	int64_t		last_p50_us;		/* capture -> last packet received */
+	int64_t		last_p99_us;
+	int64_t		last_max_us;
+} rtp_probe_stat_t;
+
+/* Plays rtsp://127.0.0.1:<port>/<name>; id is the stream's id in srv */
+rtp_probe_t *rtp_probe_start(rtsp_server_t *srv, int port, int id, const char *name);
+void rtp_probe_stop(rtp_probe_t *probe);
+
+/* Over the last RTP_PROBE_WINDOW frames */
+void rtp_probe_get_stat(rtp_probe_t *probe, rtp_probe_stat_t *stat);
+void rtp_probe_dump_stat(rtp_probe_t *probe);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_RTP_PROBE_H__ */
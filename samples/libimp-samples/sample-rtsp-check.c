@@ -0,0 +1,424 @@
+/*
+ * sample-rtsp-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check for the RTSP server: serves a recorded .h264 file as
+ * "main" and "sub" on localhost, and plays each with a stand-in client
+ * that speaks just enough RTSP (OPTIONS, DESCRIBE, SETUP, PLAY,
+ * TEARDOWN), reassembles the single NAL and FU-A packets and verifies
+ *  - sequence numbers have no gaps, the marker ends every frame and
+ *    the RTP timestamp advances once per frame,
+ *  - the reassembled NALs are the source NALs, byte for byte,
+ *  - an unknown stream gets 404 and RTP over TCP gets 461.
+ * It prints the per-client bitrate and send latency the server measured.
+ *
+ * The check runs once per frame and once in low latency mode, each with
+ * a loopback probe on "main", and compares how long the frames take
+ * from their timestamp to the first and the last packet received.
+ *
+ * A real player works too while the check runs with a long interval:
+ *   sample-rtsp-check stream.h264 8554 40 & ffplay rtsp://127.0.0.1:8554/main
+ *
+ * usage: sample-rtsp-check <in.h264> [port] [interval_ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+
+#include "sample-h264-parse.h"
+#include "sample-rtsp-server.h"
+#include "sample-rtp-probe.h"
+
+#define TAG "Sample-RTSP-Check"
+
+#define MAX_NALS_PER_FRAME	16
+#define CHECK_PORT			8554
+#define CLIENT_IDLE_MS		500		/* no packet this long: stream over */
+
+struct check_client {
+	const char		*stream;
+	int				port;
+	pthread_t		tid;
+	volatile int	playing;
+	volatile int	failed;
+
+	uint8_t			*out;			/* reassembled Annex-B, 4 byte start codes */
+	size_t			out_len;
+	size_t			out_size;
+	uint32_t		packets;
+	uint32_t		frames;
+	uint32_t		seq_gaps;
+	uint32_t		ts_errors;
+};
+
+static uint8_t *map_file(const char *path, size_t *len)
+{
+	struct stat st;
+	uint8_t *buf;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		IMP_LOG_ERR(TAG, "mmap %s failed: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	*len = st.st_size;
+
+	return buf;
+}
+
+/* Send one request, return the status code; the reply goes to resp */
+static int rtsp_request(int fd, const char *method, const char *url, int cseq,
+		const char *headers, char *resp, int size)
+{
+	char req[1024], *end, *cl;
+	int len, n = 0, ret;
+
+	len = snprintf(req, sizeof(req), "%s %s RTSP/1.0\r\nCSeq: %d\r\n%s\r\n",
+			method, url, cseq, headers);
+	if (send(fd, req, len, 0) != len)
+		return -1;
+
+	/* header block, then Content-Length bytes of body */
+	while (n < size - 1) {
+		ret = recv(fd, resp + n, size - 1 - n, 0);
+		if (ret <= 0)
+			return -1;
+		n += ret;
+		resp[n] = '\0';
+		end = strstr(resp, "\r\n\r\n");
+		cl = strstr(resp, "Content-Length:");
+		if (end && (cl == NULL || cl > end || n >= end + 4 - resp + atoi(cl + 15)))
+			break;
+	}
+
+	return sscanf(resp, "RTSP/1.0 %d", &ret) == 1 ? ret : -1;
+}
+
+static void out_append(struct check_client *cl, const void *data, size_t len)
+{
+	if (cl->out_len + len > cl->out_size) {
+		cl->out_size = (cl->out_len + len) * 2;
+		cl->out = realloc(cl->out, cl->out_size);
+	}
+	memcpy(cl->out + cl->out_len, data, len);
+	cl->out_len += len;
+}
+
+static const uint8_t start_code[4] = { 0, 0, 0, 1 };
+
+/* RFC 6184 depacketizer, single NAL unit and FU-A only */
+static void depacketize(struct check_client *cl, const uint8_t *pkt, int len,
+		uint16_t *last_seq, uint32_t *last_ts, int *in_frame)
+{
+	uint16_t seq = (pkt[2] << 8) | pkt[3];
+	uint32_t ts = (pkt[4] << 24) | (pkt[5] << 16) | (pkt[6] << 8) | pkt[7];
+	const uint8_t *p = pkt + 12;
+	int n = len - 12;
+	uint8_t nal_hdr;
+
+	if (cl->packets && seq != (uint16_t)(*last_seq + 1))
+		cl->seq_gaps++;
+	/* a new timestamp only after the marker, and never twice the same */
+	if (cl->packets && (*in_frame ? ts != *last_ts : ts == *last_ts))
+		cl->ts_errors++;
+	*last_seq = seq;
+	*last_ts = ts;
+	*in_frame = !(pkt[1] & 0x80);
+	if (!*in_frame)
+		cl->frames++;
+	cl->packets++;
+
+	if (n < 1)
+		return;
+	if ((p[0] & 0x1f) != 28) {
+		out_append(cl, start_code, 4);
+		out_append(cl, p, n);
+		return;
+	}
+	if (n < 2)
+		return;
+	if (p[1] & 0x80) {
+		nal_hdr = (p[0] & 0xe0) | (p[1] & 0x1f);
+		out_append(cl, start_code, 4);
+		out_append(cl, &nal_hdr, 1);
+	}
+	out_append(cl, p + 2, n - 2);
+}
+
+static void *client_thread(void *arg)
+{
+	struct check_client *cl = (struct check_client *)arg;
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	char url[128], resp[4096], hdr[256];
+	uint8_t pkt[2048];
+	struct timeval tv;
+	uint16_t last_seq = 0;
+	uint32_t last_ts = 0;
+	int fd, rtp_fd, rtp_port, n, in_frame = 0, rcvbuf = 4 * 1024 * 1024;
+
+	snprintf(url, sizeof(url), "rtsp://127.0.0.1:%d/%s", cl->port, cl->stream);
+
+	rtp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bind(rtp_fd, (struct sockaddr *)&addr, sizeof(addr));
+	getsockname(rtp_fd, (struct sockaddr *)&addr, &alen);
+	rtp_port = ntohs(addr.sin_port);
+	setsockopt(rtp_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	tv.tv_sec = 0;
+	tv.tv_usec = CLIENT_IDLE_MS * 1000;
+	setsockopt(rtp_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	addr.sin_port = htons(cl->port);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		IMP_LOG_ERR(TAG, "connect failed: %s\n", strerror(errno));
+		goto err;
+	}
+
+	if (rtsp_request(fd, "OPTIONS", url, 1, "", resp, sizeof(resp)) != 200
+			|| strstr(resp, "DESCRIBE") == NULL) {
+		IMP_LOG_ERR(TAG, "%s: OPTIONS failed\n", cl->stream);
+		goto err;
+	}
+	if (rtsp_request(fd, "DESCRIBE", url, 2, "Accept: application/sdp\r\n", resp, sizeof(resp)) != 200
+			|| strstr(resp, "a=rtpmap:96 H264/90000") == NULL
+			|| strstr(resp, "packetization-mode=1") == NULL) {
+		IMP_LOG_ERR(TAG, "%s: DESCRIBE failed:\n%s\n", cl->stream, resp);
+		goto err;
+	}
+	snprintf(hdr, sizeof(hdr), "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n");
+	if (rtsp_request(fd, "SETUP", url, 3, hdr, resp, sizeof(resp)) != 461) {
+		IMP_LOG_ERR(TAG, "%s: RTP over TCP not refused\n", cl->stream);
+		goto err;
+	}
+	snprintf(hdr, sizeof(hdr), "Transport: RTP/AVP;unicast;client_port=%d-%d\r\n",
+			rtp_port, rtp_port + 1);
+	strcat(url, "/track0");
+	if (rtsp_request(fd, "SETUP", url, 4, hdr, resp, sizeof(resp)) != 200
+			|| strstr(resp, "server_port=") == NULL) {
+		IMP_LOG_ERR(TAG, "%s: SETUP failed:\n%s\n", cl->stream, resp);
+		goto err;
+	}
+	if (rtsp_request(fd, "PLAY", url, 5, "Session: x\r\n", resp, sizeof(resp)) != 200
+			|| strstr(resp, "RTP-Info:") == NULL) {
+		IMP_LOG_ERR(TAG, "%s: PLAY failed:\n%s\n", cl->stream, resp);
+		goto err;
+	}
+	cl->playing = 1;
+
+	/* wait for the first packet as long as it takes, then until the stream goes quiet */
+	while ((n = recv(rtp_fd, pkt, sizeof(pkt), 0)) > 0 || (cl->packets == 0 && errno == EAGAIN)) {
+		if (n >= 12)
+			depacketize(cl, pkt, n, &last_seq, &last_ts, &in_frame);
+	}
+
+	rtsp_request(fd, "TEARDOWN", url, 6, "Session: x\r\n", resp, sizeof(resp));
+	close(fd);
+	close(rtp_fd);
+
+	return NULL;
+
+err:
+	cl->failed = 1;
+	close(fd);
+	close(rtp_fd);
+	return NULL;
+}
+
+/* The source NALs as the client must rebuild them: AUDs dropped, 4 byte start codes */
+static uint8_t *expected_stream(const uint8_t *in, size_t in_len, size_t *len)
+{
+	h264_nal_t nal[MAX_NALS_PER_FRAME];
+	uint8_t *out = malloc(in_len * 2 + 16);
+	size_t pos = 0, n = 0;
+	int i, nr;
+
+	while ((nr = h264_next_frame(in, in_len, &pos, nal, MAX_NALS_PER_FRAME)) > 0) {
+		for (i = 0; i < nr; i++) {
+			if (nal[i].type == H264_NAL_AUD)
+				continue;
+			memcpy(out + n, start_code, 4);
+			memcpy(out + n + 4, nal[i].data + nal[i].sc_len, nal[i].len - nal[i].sc_len);
+			n += 4 + nal[i].len - nal[i].sc_len;
+		}
+	}
+	*len = n;
+
+	return out;
+}
+
+static int run_check(const uint8_t *in, size_t in_len, int port, int interval_ms,
+		int low_latency, rtp_probe_stat_t *lat)
+{
+	struct check_client cl[2];
+	rtsp_client_stat_t stat[RTSP_MAX_CLIENTS];
+	h264_nal_t nal[MAX_NALS_PER_FRAME];
+	struct iovec iov[MAX_NALS_PER_FRAME];
+	rtsp_server_t *srv;
+	rtp_probe_t *probe;
+	int main_id, sub_id, i, n, nr_stat, frames = 0, ret = 0;
+	int64_t ts;
+	uint8_t *expect;
+	size_t expect_len, pos = 0;
+	char resp[1024];
+	struct sockaddr_in addr;
+	int fd;
+
+	srv = rtsp_server_create(port);
+	if (srv == NULL)
+		return -1;
+	main_id = rtsp_server_add_stream(srv, "main", 1280, 720);
+	sub_id = rtsp_server_add_stream(srv, "sub", 640, 360);
+	rtsp_server_set_low_latency(srv, low_latency);
+	if (main_id < 0 || sub_id < 0 || rtsp_server_start(srv) < 0)
+		return -1;
+
+	/* unknown stream */
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+			|| rtsp_request(fd, "DESCRIBE", "rtsp://127.0.0.1/none", 1, "", resp, sizeof(resp)) != 404) {
+		IMP_LOG_ERR(TAG, "unknown stream not refused\n");
+		return -1;
+	}
+	close(fd);
+
+	memset(cl, 0, sizeof(cl));
+	cl[0].stream = "main";
+	cl[1].stream = "sub";
+	for (i = 0; i < 2; i++) {
+		cl[i].port = port;
+		pthread_create(&cl[i].tid, NULL, client_thread, &cl[i]);
+	}
+	for (i = 0; i < 2; i++) {
+		while (!cl[i].playing && !cl[i].failed)
+			usleep(1000);
+	}
+	if (!rtsp_server_want_idr(srv, main_id) || !rtsp_server_want_idr(srv, sub_id)) {
+		IMP_LOG_ERR(TAG, "PLAY did not ask for an IDR\n");
+		ret = -1;
+	}
+
+	probe = rtp_probe_start(srv, port, main_id, "main");
+	if (probe == NULL)
+		ret = -1;
+
+	/* a frame is "captured" as it is pushed, the probe times it from there */
+	while ((n = h264_next_frame(in, in_len, &pos, nal, MAX_NALS_PER_FRAME)) > 0) {
+		for (i = 0; i < n; i++) {
+			iov[i].iov_base = (void *)nal[i].data;
+			iov[i].iov_len = nal[i].len;
+		}
+		ts = IMP_System_GetTimeStamp();
+		rtsp_server_push_iov(srv, main_id, iov, n, ts);
+		rtsp_server_push_iov(srv, sub_id, iov, n, ts);
+		frames++;
+		usleep(interval_ms * 1000);
+	}
+
+	nr_stat = rtsp_server_get_client_stat(srv, stat, RTSP_MAX_CLIENTS);
+	for (i = 0; i < 2; i++)
+		pthread_join(cl[i].tid, NULL);
+	if (probe) {
+		rtp_probe_get_stat(probe, lat);
+		rtp_probe_stop(probe);
+		if (lat->frames != (uint32_t)frames || lat->seq_gaps) {
+			IMP_LOG_ERR(TAG, "probe: %u frames of %d, %u sequence gaps\n",
+					lat->frames, frames, lat->seq_gaps);
+			ret = -1;
+		}
+	}
+
+	expect = expected_stream(in, in_len, &expect_len);
+	for (i = 0; i < 2; i++) {
+		printf("%s%s: %u packets, %u frames of %d, %zu bytes, %u sequence gaps, %u timestamp errors\n",
+				low_latency ? "low latency " : "", cl[i].stream, cl[i].packets, cl[i].frames, frames, cl[i].out_len,
+				cl[i].seq_gaps, cl[i].ts_errors);
+		if (cl[i].failed || cl[i].seq_gaps || cl[i].ts_errors || cl[i].frames != (uint32_t)frames
+				|| cl[i].out_len != expect_len || memcmp(cl[i].out, expect, expect_len)) {
+			IMP_LOG_ERR(TAG, "%s: stream does not match the input\n", cl[i].stream);
+			ret = -1;
+		}
+	}
+	for (i = 0; i < nr_stat; i++)
+		printf("server: %s %s: %u kbps, %u frames, %u packets, %u dropped, "
+				"send latency avg %lld us max %lld us\n", stat[i].addr,
+				stat[i].stream == main_id ? "main" : "sub", stat[i].kbps, stat[i].frames,
+				stat[i].packets, stat[i].dropped, (long long)stat[i].lat_avg_us,
+				(long long)stat[i].lat_max_us);
+
+	rtsp_server_destroy(srv);
+	free(expect);
+	for (i = 0; i < 2; i++)
+		free(cl[i].out);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	rtp_probe_stat_t lat[2];
+	int port = CHECK_PORT, interval_ms = 2, mode, ret = 0;
+	uint8_t *in;
+	size_t in_len;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <in.h264> [port] [interval_ms]\n", argv[0]);
+		return -1;
+	}
+	if (argc > 2)
+		port = atoi(argv[2]);
+	if (argc > 3)
+		interval_ms = atoi(argv[3]);
+
+	in = map_file(argv[1], &in_len);
+	if (in == NULL)
+		return -1;
+
+	memset(lat, 0, sizeof(lat));
+	for (mode = 0; mode < 2; mode++) {
+		if (run_check(in, in_len, port, interval_ms, mode, &lat[mode]) < 0)
+			ret = -1;
+	}
+
+	for (mode = 0; mode < 2; mode++)
+		printf("%s: capture -> first packet p50/p99 %lld/%lld us, "
+				"-> last packet p50/p99/max %lld/%lld/%lld us\n",
+				mode ? "pack by pack " : "frame by frame",
+				(long long)lat[mode].first_p50_us, (long long)lat[mode].first_p99_us,
+				(long long)lat[mode].last_p50_us, (long long)lat[mode].last_p99_us,
+				(long long)lat[mode].last_max_us);
+
+	if (ret == 0)
+		printf("rtsp ok\n");
+
+	return ret;
+}
@@ -0,0 +1,1215 @@
+/*
+ * sample-rtsp-server.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#define _GNU_SOURCE		/* sendmmsg() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-rtsp-server.h"
+
+#define TAG "Sample-RTSP-Server"
+
+#define RTP_PT_H264			96
+#define RTP_HDR_LEN			12
+#define FU_HDR_LEN			2
+#define RTP_CLOCK			90000
+
+#define RTCP_SR				200
+#define RTCP_RR				201
+#define RTCP_SR_LEN			28
+#define RTCP_RB_LEN			24		/* report block */
+#define RTCP_SR_INTERVAL_US	1000000
+#define NTP_UNIX_OFFSET		2208988800u
+
+#define NAL_TYPE(b)			((b) & 0x1f)
+#define NAL_IDR				5
+#define NAL_SPS				7
+#define NAL_PPS				8
+#define NAL_AUD				9
+#define NAL_FU_A			28
+
+#define RTSP_REQ_MAX		2048	/* one request, headers and body */
+#define RTSP_MAX_PARAM_SET	128
+#define RTSP_POLL_MS		200
+#define RTSP_SESSION_TIMEOUT	60
+
+enum {
+	CLIENT_INIT,		/* connected, nothing set up */
+	CLIENT_READY,		/* SETUP done */
+	CLIENT_PLAYING,
+};
+
+struct rtsp_stream {
+	char				name[32];
+	int					width;
+	int					height;
+	int					rtp_fd;
+	int					rtcp_fd;
+	int					rtp_port;
+	int					rtcp_port;
+	uint32_t			ts_base;		/* random RTP timestamp offset */
+	uint32_t			rtp_ts;			/* of the last frame */
+	int64_t				timestamp;		/* the same, encoder clock */
+	int					want_idr;
+
+	uint8_t				sps[RTSP_MAX_PARAM_SET];
+	uint8_t				pps[RTSP_MAX_PARAM_SET];
+	int					sps_len;
+	int					pps_len;
+
+	/* packets of the frame being sent, only the headers are stored here */
+	uint8_t				hdr[RTSP_MAX_PACKETS][RTP_HDR_LEN + FU_HDR_LEN];
+	struct iovec		iov[RTSP_MAX_PACKETS][2];
+	struct mmsghdr		msg[RTSP_MAX_PACKETS];
+};
+
+struct rtsp_client {
+	int					fd;				/* RTSP connection, -1: slot free */
+	char				buf[RTSP_REQ_MAX + 1];
+	int					len;
+	struct sockaddr_in	peer;
+
+	int					state;
+	int					stream;
+	struct sockaddr_in	rtp_addr;
+	struct sockaddr_in	rtcp_addr;
+	char				session[16];
+	uint32_t			ssrc;
+	uint16_t			seq;
+	int					wait_idr;
+	int					in_frame;		/* low latency: gets the frame being sent */
+	int					send_err;
+
+	uint32_t			frames;
+	uint32_t			packets;
+	uint64_t			bytes;
+	uint32_t			dropped;
+	int64_t				lat_total_us;
+	int64_t				lat_max_us;
+	int64_t				win_start;		/* bitrate window */
+	uint64_t			win_bytes;
+	uint32_t			kbps;
+
+	int64_t				last_sr;		/* sender report sent */
+	int64_t				last_rr;		/* receiver report received, 0: none yet */
+	int64_t				rtt_us;			/* -1: unknown */
+	uint32_t			loss_permille;	/* fraction lost of the last report */
+	uint32_t			reports;
+};
+
+struct rtsp_server {
+	int					port;
+	int					listen_fd;
+	struct rtsp_stream	*stream[RTSP_MAX_STREAMS];
+	int					nr_streams;
+	struct rtsp_client	client[RTSP_MAX_CLIENTS];
+	uint32_t			rand;
+	int					low_latency;
+
+	pthread_mutex_t		mutex;
+	pthread_t			tid;
+	int					running;
+	volatile int		stop;
+};
+
+static uint32_t rtsp_random(rtsp_server_t *srv)
+{
+	/* xorshift32, good enough for SSRCs and session ids */
+	srv->rand ^= srv->rand << 13;
+	srv->rand ^= srv->rand >> 17;
+	srv->rand ^= srv->rand << 5;
+
+	return srv->rand;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* Wall clock, 32.32 NTP format; SR timestamps and the round trip time use it */
+static void ntp_now(uint32_t *sec, uint32_t *frac)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	*sec = tv.tv_sec + NTP_UNIX_OFFSET;
+	*frac = ((uint64_t)tv.tv_usec << 32) / 1000000;
+}
+
+static int start_code_len(const uint8_t *p, size_t len)
+{
+	if (len >= 4 && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1)
+		return 4;
+	if (len >= 3 && p[0] == 0 && p[1] == 0 && p[2] == 1)
+		return 3;
+
+	return 0;
+}
+
+static int udp_socket(int *port)
+{
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+			|| getsockname(fd, (struct sockaddr *)&addr, &alen) < 0) {
+		close(fd);
+		return -1;
+	}
+	*port = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+/*
+ * Cut the NALs into RTP packets, RFC 6184 single NAL unit packets or
+ * FU-A fragments; the last packet carries the marker if they end the
+ * frame. Sequence numbers and SSRC are filled in per client. Returns
+ * the packet count, -1 if they do not fit.
+ */
+static int packetize(rtsp_server_t *srv, struct rtsp_stream *st, const struct iovec *nal,
+		int nr_nal, uint32_t rtp_ts, int frame_end, int *key_frame)
+{
+	const uint8_t *p;
+	uint8_t *h;
+	size_t len, n;
+	int i, sc, type, pkt = 0, last_pkt = -1;
+
+	*key_frame = 0;
+	for (i = 0; i < nr_nal; i++) {
+		p = nal[i].iov_base;
+		len = nal[i].iov_len;
+		sc = start_code_len(p, len);
+		p += sc;
+		len -= sc;
+		if (len == 0)
+			continue;
+
+		type = NAL_TYPE(p[0]);
+		if (type == NAL_AUD)
+			continue;
+		if (type == NAL_IDR || type == NAL_SPS)
+			*key_frame = 1;
+		if ((type == NAL_SPS || type == NAL_PPS) && len <= RTSP_MAX_PARAM_SET) {
+			/* for the SDP; DESCRIBE reads them from the control thread */
+			pthread_mutex_lock(&srv->mutex);
+			if (type == NAL_SPS) {
+				memcpy(st->sps, p, len);
+				st->sps_len = len;
+			} else {
+				memcpy(st->pps, p, len);
+				st->pps_len = len;
+			}
+			pthread_mutex_unlock(&srv->mutex);
+		}
+
+		if (len <= RTSP_RTP_PAYLOAD) {
+			if (pkt == RTSP_MAX_PACKETS)
+				goto too_big;
+			h = st->hdr[pkt];
+			st->iov[pkt][0].iov_base = h;
+			st->iov[pkt][0].iov_len = RTP_HDR_LEN;
+			st->iov[pkt][1].iov_base = (void *)p;
+			st->iov[pkt][1].iov_len = len;
+			last_pkt = pkt++;
+			continue;
+		}
+
+		/* FU-A: the NAL header moves into the FU indicator and header */
+		for (n = 1; n < len; n += RTSP_RTP_PAYLOAD - FU_HDR_LEN) {
+			if (pkt == RTSP_MAX_PACKETS)
+				goto too_big;
+			h = st->hdr[pkt];
+			h[RTP_HDR_LEN] = (p[0] & 0xe0) | NAL_FU_A;
+			h[RTP_HDR_LEN + 1] = type;
+			if (n == 1)
+				h[RTP_HDR_LEN + 1] |= 0x80;
+			st->iov[pkt][0].iov_base = h;
+			st->iov[pkt][0].iov_len = RTP_HDR_LEN + FU_HDR_LEN;
+			st->iov[pkt][1].iov_base = (void *)(p + n);
+			st->iov[pkt][1].iov_len = len - n < RTSP_RTP_PAYLOAD - FU_HDR_LEN ?
+				len - n : RTSP_RTP_PAYLOAD - FU_HDR_LEN;
+			last_pkt = pkt++;
+		}
+		st->hdr[last_pkt][RTP_HDR_LEN + 1] |= 0x40;
+	}
+
+	for (i = 0; i < pkt; i++) {
+		h = st->hdr[i];
+		h[0] = 0x80;
+		h[1] = RTP_PT_H264 | (frame_end && i == last_pkt ? 0x80 : 0);	/* marker on the last packet of the frame */
+		put32(h + 4, rtp_ts);
+		memset(&st->msg[i].msg_hdr, 0, sizeof(st->msg[i].msg_hdr));
+		st->msg[i].msg_hdr.msg_iov = st->iov[i];
+		st->msg[i].msg_hdr.msg_iovlen = 2;
+	}
+
+	return pkt;
+
+too_big:
+	IMP_LOG_ERR(TAG, "%s: frame needs more than %d packets\n", st->name, RTSP_MAX_PACKETS);
+	return -1;
+}
+
+/* Whether the frame starts a GOP, and the last NAL that is sent at all */
+static int scan_frame(const struct iovec *nal, int nr_nal, int *last_nal)
+{
+	const uint8_t *p;
+	int i, sc, type, key_frame = 0;
+
+	*last_nal = -1;
+	for (i = 0; i < nr_nal; i++) {
+		p = nal[i].iov_base;
+		sc = start_code_len(p, nal[i].iov_len);
+		if (nal[i].iov_len <= (size_t)sc)
+			continue;
+		type = NAL_TYPE(p[sc]);
+		if (type == NAL_AUD)
+			continue;
+		if (type == NAL_IDR || type == NAL_SPS)
+			key_frame = 1;
+		*last_nal = i;
+	}
+
+	return key_frame;
+}
+
+/* Called with mutex held, lets the client report the round trip time */
+static void send_sr(struct rtsp_stream *st, struct rtsp_client *c, int64_t now)
+{
+	uint8_t sr[RTCP_SR_LEN];
+	uint32_t sec, frac;
+
+	ntp_now(&sec, &frac);
+	sr[0] = 0x80;
+	sr[1] = RTCP_SR;
+	put16(sr + 2, RTCP_SR_LEN / 4 - 1);
+	put32(sr + 4, c->ssrc);
+	put32(sr + 8, sec);
+	put32(sr + 12, frac);
+	put32(sr + 16, st->rtp_ts);
+	put32(sr + 20, c->packets);
+	put32(sr + 24, c->bytes - (uint64_t)c->packets * RTP_HDR_LEN);
+	sendto(st->rtcp_fd, sr, sizeof(sr), MSG_DONTWAIT, (struct sockaddr *)&c->rtcp_addr,
+			sizeof(c->rtcp_addr));
+	c->last_sr = now;
+}
+
+/*
+ * Called with mutex held. Returns -1 if the socket did not take every
+ * packet; the client then waits for the next IDR.
+ */
+static int send_packets(struct rtsp_stream *st, struct rtsp_client *c, int nr_pkt)
+{
+	uint32_t bytes = 0;
+	int i, ret, done = 0;
+
+	for (i = 0; i < nr_pkt; i++) {
+		put16(st->hdr[i] + 2, c->seq + i);
+		put32(st->hdr[i] + 8, c->ssrc);
+		st->msg[i].msg_hdr.msg_name = &c->rtp_addr;
+		st->msg[i].msg_hdr.msg_namelen = sizeof(c->rtp_addr);
+	}
+
+	while (done < nr_pkt) {
+		ret = sendmmsg(st->rtp_fd, st->msg + done, nr_pkt - done, MSG_DONTWAIT);
+		if (ret <= 0)
+			break;
+		done += ret;
+	}
+
+	if (done < nr_pkt) {
+		/* the decoder cannot use the rest of the GOP */
+		if (errno != EAGAIN && errno != EWOULDBLOCK && c->send_err++ == 0)
+			IMP_LOG_ERR(TAG, "send to %s:%d failed: %s\n", inet_ntoa(c->rtp_addr.sin_addr),
+					ntohs(c->rtp_addr.sin_port), strerror(errno));
+		c->dropped++;
+		c->wait_idr = 1;
+	}
+
+	for (i = 0; i < done; i++)
+		bytes += st->msg[i].msg_len;
+	c->seq += done;
+	c->packets += done;
+	c->bytes += bytes;
+	c->win_bytes += bytes;
+
+	return done < nr_pkt ? -1 : 0;
+}
+
+/* Called with mutex held, once the client has all it gets of a frame */
+static void frame_done(struct rtsp_stream *st, struct rtsp_client *c, int64_t t_push)
+{
+	int64_t now, lat;
+
+	c->frames++;
+
+	now = IMP_System_GetTimeStamp();
+	lat = now - t_push;
+	c->lat_total_us += lat;
+	if (lat > c->lat_max_us)
+		c->lat_max_us = lat;
+
+	if (now - c->win_start >= 1000000) {
+		c->kbps = c->win_bytes * 8 * 1000 / (now - c->win_start);
+		c->win_start = now;
+		c->win_bytes = 0;
+	}
+
+	if (now - c->last_sr >= RTCP_SR_INTERVAL_US)
+		send_sr(st, c, now);
+}
+
+/*
+ * Low latency mode: each pack goes out to the clients as soon as it is
+ * cut into packets, before the next one is looked at. A client takes
+ * part from the first pack of a frame on; one that fails mid frame
+ * skips the rest of it and waits for the next IDR.
+ */
+static int push_packs(rtsp_server_t *srv, int id, const struct iovec *nal, int nr_nal,
+		int64_t timestamp, uint32_t rtp_ts, int64_t t_push)
+{
+	struct rtsp_stream *st = srv->stream[id];
+	struct rtsp_client *c;
+	int i, n, nr_pkt, key_frame, key, last_nal, first = 1, served = 0;
+
+	key_frame = scan_frame(nal, nr_nal, &last_nal);
+	if (last_nal < 0)
+		return 0;
+
+	for (n = 0; n <= last_nal; n++) {
+		nr_pkt = packetize(srv, st, &nal[n], 1, rtp_ts, n == last_nal, &key);
+		if (nr_pkt == 0)
+			continue;
+
+		pthread_mutex_lock(&srv->mutex);
+		if (first) {
+			st->rtp_ts = rtp_ts;
+			st->timestamp = timestamp;
+			for (i = 0; i < RTSP_MAX_CLIENTS; i++) {
+				c = &srv->client[i];
+				c->in_frame = 0;
+				if (c->fd < 0 || c->state != CLIENT_PLAYING || c->stream != id)
+					continue;
+				if (c->wait_idr) {
+					if (!key_frame)
+						continue;
+					c->wait_idr = 0;
+				}
+				c->in_frame = 1;
+				served++;
+			}
+			first = 0;
+		}
+		for (i = 0; i < RTSP_MAX_CLIENTS; i++) {
+			c = &srv->client[i];
+			if (!c->in_frame)
+				continue;
+			if (c->fd < 0 || c->state != CLIENT_PLAYING || c->stream != id) {
+				c->in_frame = 0;
+				continue;
+			}
+			/* a pack that does not fit ends the frame for everybody */
+			if (nr_pkt < 0) {
+				c->dropped++;
+				c->wait_idr = 1;
+			}
+			if (nr_pkt < 0 || send_packets(st, c, nr_pkt) < 0 || n == last_nal) {
+				c->in_frame = 0;
+				frame_done(st, c, t_push);
+			}
+		}
+		pthread_mutex_unlock(&srv->mutex);
+
+		if (nr_pkt < 0)
+			return -1;
+	}
+
+	return served;
+}
+
+int rtsp_server_push_iov(rtsp_server_t *srv, int id, const struct iovec *nal, int nr_nal,
+		int64_t timestamp)
+{
+	struct rtsp_stream *st;
+	struct rtsp_client *c;
+	int64_t t_push = IMP_System_GetTimeStamp();
+	uint32_t rtp_ts;
+	int i, nr_pkt, key_frame, served = 0;
+
+	if (id < 0 || id >= srv->nr_streams)
+		return -1;
+	st = srv->stream[id];
+
+	rtp_ts = st->ts_base + (uint32_t)(timestamp * (RTP_CLOCK / 1000) / 1000);
+	if (srv->low_latency)
+		return push_packs(srv, id, nal, nr_nal, timestamp, rtp_ts, t_push);
+
+	nr_pkt = packetize(srv, st, nal, nr_nal, rtp_ts, 1, &key_frame);
+	if (nr_pkt <= 0)
+		return nr_pkt;
+
+	pthread_mutex_lock(&srv->mutex);
+	st->rtp_ts = rtp_ts;
+	st->timestamp = timestamp;
+	for (i = 0; i < RTSP_MAX_CLIENTS; i++) {
+		c = &srv->client[i];
+		if (c->fd < 0 || c->state != CLIENT_PLAYING || c->stream != id)
+			continue;
+		if (c->wait_idr) {
+			if (!key_frame)
+				continue;
+			c->wait_idr = 0;
+		}
+		send_packets(st, c, nr_pkt);
+		frame_done(st, c, t_push);
+		served++;
+	}
+	pthread_mutex_unlock(&srv->mutex);
+
+	return served;
+}
+
+int rtsp_server_push(rtsp_server_t *srv, int id, IMPEncoderStream *stream)
+{
+	struct iovec iov[stream->packCount];
+	int i;
+
+	for (i = 0; i < stream->packCount; i++) {
+		iov[i].iov_base = (void *)(uintptr_t)stream->pack[i].virAddr;
+		iov[i].iov_len = stream->pack[i].length;
+	}
+
+	return rtsp_server_push_iov(srv, id, iov, stream->packCount,
+			stream->packCount ? stream->pack[0].timestamp : 0);
+}
+
+int64_t rtsp_server_rtp_timestamp(rtsp_server_t *srv, int id, uint32_t rtp_ts)
+{
+	struct rtsp_stream *st;
+	int64_t timestamp;
+	int32_t delta;
+
+	if (id < 0 || id >= srv->nr_streams)
+		return -1;
+	st = srv->stream[id];
+
+	/* relative to the last frame, so the 32 bit RTP clock never wraps on us */
+	pthread_mutex_lock(&srv->mutex);
+	delta = (int32_t)(rtp_ts - st->rtp_ts);
+	timestamp = st->timestamp + (int64_t)delta * 1000000 / RTP_CLOCK;
+	pthread_mutex_unlock(&srv->mutex);
+
+	return timestamp;
+}
+
+int rtsp_server_want_idr(rtsp_server_t *srv, int id)
+{
+	int want;
+
+	if (id < 0 || id >= srv->nr_streams)
+		return 0;
+
+	pthread_mutex_lock(&srv->mutex);
+	want = srv->stream[id]->want_idr;
+	srv->stream[id]->want_idr = 0;
+	pthread_mutex_unlock(&srv->mutex);
+
+	return want;
+}
+
+/* rtsp://host[:port]/<name>[/track0] -> stream id */
+static int find_stream(rtsp_server_t *srv, const char *url)
+{
+	const char *p = url;
+	size_t len;
+	int i;
+
+	if (strncasecmp(p, "rtsp://", 7) == 0) {
+		p = strchr(p + 7, '/');
+		if (p == NULL)
+			return -1;
+	}
+	while (*p == '/')
+		p++;
+	len = strcspn(p, "/?");
+
+	for (i = 0; i < srv->nr_streams; i++) {
+		if (strlen(srv->stream[i]->name) == len && strncmp(srv->stream[i]->name, p, len) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/* Value of a request header, copied into val */
+static int get_header(const char *req, const char *name, char *val, int size)
+{
+	const char *p = req;
+	size_t nlen = strlen(name), len;
+
+	while ((p = strstr(p, "\r\n")) != NULL) {
+		p += 2;
+		if (strncasecmp(p, name, nlen) || p[nlen] != ':')
+			continue;
+		p += nlen + 1;
+		while (*p == ' ')
+			p++;
+		len = strcspn(p, "\r\n");
+		if (len >= (size_t)size)
+			len = size - 1;
+		memcpy(val, p, len);
+		val[len] = '\0';
+		return 0;
+	}
+
+	return -1;
+}
+
+static void base64(const uint8_t *in, int len, char *out)
+{
+	static const char tab[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	uint32_t v;
+	int i;
+
+	for (i = 0; i < len; i += 3) {
+		v = in[i] << 16;
+		if (i + 1 < len)
+			v |= in[i + 1] << 8;
+		if (i + 2 < len)
+			v |= in[i + 2];
+		*out++ = tab[(v >> 18) & 0x3f];
+		*out++ = tab[(v >> 12) & 0x3f];
+		*out++ = i + 1 < len ? tab[(v >> 6) & 0x3f] : '=';
+		*out++ = i + 2 < len ? tab[v & 0x3f] : '=';
+	}
+	*out = '\0';
+}
+
+static void reply(struct rtsp_client *c, const char *status, const char *cseq,
+		const char *headers, const char *body)
+{
+	char buf[RTSP_REQ_MAX + 1024];
+	int len;
+
+	len = snprintf(buf, sizeof(buf), "RTSP/1.0 %s\r\nCSeq: %s\r\n%s", status, cseq, headers);
+	if (body)
+		len += snprintf(buf + len, sizeof(buf) - len, "Content-Length: %zu\r\n\r\n%s",
+				strlen(body), body);
+	else
+		len += snprintf(buf + len, sizeof(buf) - len, "\r\n");
+	if (len > (int)sizeof(buf) - 1)
+		len = sizeof(buf) - 1;
+
+	if (send(c->fd, buf, len, MSG_NOSIGNAL) != len)
+		IMP_LOG_WARN(TAG, "reply to %s failed\n", inet_ntoa(c->peer.sin_addr));
+}
+
+static void describe(rtsp_server_t *srv, struct rtsp_client *c, int id, const char *url,
+		const char *cseq)
+{
+	struct rtsp_stream *st = srv->stream[id];
+	struct sockaddr_in local;
+	socklen_t alen = sizeof(local);
+	char sdp[1280], fmtp[640], sps[RTSP_MAX_PARAM_SET * 2], pps[RTSP_MAX_PARAM_SET * 2];
+	char headers[512];
+
+	getsockname(c->fd, (struct sockaddr *)&local, &alen);
+
+	pthread_mutex_lock(&srv->mutex);
+	if (st->sps_len >= 4 && st->pps_len) {
+		base64(st->sps, st->sps_len, sps);
+		base64(st->pps, st->pps_len, pps);
+		snprintf(fmtp, sizeof(fmtp), ";profile-level-id=%02X%02X%02X;sprop-parameter-sets=%s,%s",
+				st->sps[1], st->sps[2], st->sps[3], sps, pps);
+	} else {
+		/* nothing encoded yet, the parameter sets come in-band with the IDR */
+		fmtp[0] = '\0';
+	}
+	pthread_mutex_unlock(&srv->mutex);
+
+	snprintf(sdp, sizeof(sdp),
+			"v=0\r\n"
+			"o=- %u 1 IN IP4 %s\r\n"
+			"s=%s\r\n"
+			"c=IN IP4 0.0.0.0\r\n"
+			"t=0 0\r\n"
+			"a=control:*\r\n"
+			"m=video 0 RTP/AVP %d\r\n"
+			"a=rtpmap:%d H264/%d\r\n"
+			"a=fmtp:%d packetization-mode=1%s\r\n"
+			"a=framesize:%d %d-%d\r\n"
+			"a=control:track0\r\n",
+			rtsp_random(srv), inet_ntoa(local.sin_addr), st->name,
+			RTP_PT_H264, RTP_PT_H264, RTP_CLOCK, RTP_PT_H264, fmtp,
+			RTP_PT_H264, st->width, st->height);
+
+	snprintf(headers, sizeof(headers), "Content-Base: %s%s\r\nContent-Type: application/sdp\r\n",
+			url, url[strlen(url) - 1] == '/' ? "" : "/");
+	reply(c, "200 OK", cseq, headers, sdp);
+}
+
+static void setup(rtsp_server_t *srv, struct rtsp_client *c, int id, const char *req,
+		const char *cseq)
+{
+	struct rtsp_stream *st = srv->stream[id];
+	char transport[256], headers[512];
+	const char *p;
+	int rtp_port, rtcp_port;
+
+	if (get_header(req, "Transport", transport, sizeof(transport)) < 0
+			|| strstr(transport, "TCP") || strstr(transport, "multicast")
+			|| (p = strstr(transport, "client_port=")) == NULL
+			|| sscanf(p, "client_port=%d", &rtp_port) != 1) {
+		reply(c, "461 Unsupported Transport", cseq, "", NULL);
+		return;
+	}
+	if (c->state != CLIENT_INIT && c->stream != id) {
+		reply(c, "459 Aggregate Operation Not Allowed", cseq, "", NULL);
+		return;
+	}
+
+	if (sscanf(p, "client_port=%*d-%d", &rtcp_port) != 1)
+		rtcp_port = rtp_port + 1;
+
+	pthread_mutex_lock(&srv->mutex);
+	c->stream = id;
+	c->rtp_addr = c->peer;
+	c->rtp_addr.sin_port = htons(rtp_port);
+	c->rtcp_addr = c->peer;
+	c->rtcp_addr.sin_port = htons(rtcp_port);
+	if (c->state == CLIENT_INIT) {
+		snprintf(c->session, sizeof(c->session), "%08X", rtsp_random(srv));
+		c->ssrc = rtsp_random(srv);
+		c->seq = rtsp_random(srv);
+		c->state = CLIENT_READY;
+	}
+	pthread_mutex_unlock(&srv->mutex);
+
+	snprintf(headers, sizeof(headers),
+			"Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d;ssrc=%08X\r\n"
+			"Session: %s;timeout=%d\r\n",
+			rtp_port, rtp_port + 1, st->rtp_port, st->rtcp_port, c->ssrc,
+			c->session, RTSP_SESSION_TIMEOUT);
+	reply(c, "200 OK", cseq, headers, NULL);
+}
+
+static void play(rtsp_server_t *srv, struct rtsp_client *c, const char *url, const char *cseq)
+{
+	char headers[512];
+	uint32_t rtp_ts;
+
+	if (c->state == CLIENT_INIT) {
+		reply(c, "455 Method Not Valid in This State", cseq, "", NULL);
+		return;
+	}
+
+	pthread_mutex_lock(&srv->mutex);
+	c->state = CLIENT_PLAYING;
+	c->wait_idr = 1;
+	c->win_start = IMP_System_GetTimeStamp();
+	c->last_sr = 0;
+	c->last_rr = 0;
+	c->rtt_us = -1;
+	c->loss_permille = 0;
+	c->reports = 0;
+	srv->stream[c->stream]->want_idr = 1;
+	rtp_ts = srv->stream[c->stream]->rtp_ts;
+	pthread_mutex_unlock(&srv->mutex);
+
+	snprintf(headers, sizeof(headers),
+			"Session: %s\r\nRange: npt=0.000-\r\nRTP-Info: url=%s;seq=%u;rtptime=%u\r\n",
+			c->session, url, c->seq, rtp_ts);
+	reply(c, "200 OK", cseq, headers, NULL);
+
+	IMP_LOG_INFO(TAG, "%s:%d playing %s\n", inet_ntoa(c->rtp_addr.sin_addr),
+			ntohs(c->rtp_addr.sin_port), srv->stream[c->stream]->name);
+}
+
+static void handle_request(rtsp_server_t *srv, struct rtsp_client *c, const char *req)
+{
+	char method[16], url[256], cseq[16], headers[64];
+	int id;
+
+	if (sscanf(req, "%15s %255s", method, url) != 2) {
+		reply(c, "400 Bad Request", "0", "", NULL);
+		return;
+	}
+	if (get_header(req, "CSeq", cseq, sizeof(cseq)) < 0)
+		strcpy(cseq, "0");
+
+	if (strcmp(method, "OPTIONS") == 0) {
+		reply(c, "200 OK", cseq,
+				"Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n", NULL);
+		return;
+	}
+	if (strcmp(method, "GET_PARAMETER") == 0 || strcmp(method, "SET_PARAMETER") == 0) {
+		/* keep-alive */
+		reply(c, "200 OK", cseq, "", NULL);
+		return;
+	}
+	if (strcmp(method, "TEARDOWN") == 0) {
+		pthread_mutex_lock(&srv->mutex);
+		c->state = CLIENT_INIT;
+		pthread_mutex_unlock(&srv->mutex);
+		reply(c, "200 OK", cseq, "", NULL);
+		return;
+	}
+	if (strcmp(method, "PLAY") == 0) {
+		play(srv, c, url, cseq);
+		return;
+	}
+
+	id = find_stream(srv, url);
+	if (strcmp(method, "DESCRIBE") == 0 || strcmp(method, "SETUP") == 0) {
+		if (id < 0) {
+			reply(c, "404 Not Found", cseq, "", NULL);
+			return;
+		}
+		if (method[0] == 'D')
+			describe(srv, c, id, url, cseq);
+		else
+			setup(srv, c, id, req, cseq);
+		return;
+	}
+
+	snprintf(headers, sizeof(headers), "Allow: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN\r\n");
+	reply(c, "405 Method Not Allowed", cseq, headers, NULL);
+}
+
+static void client_close(rtsp_server_t *srv, struct rtsp_client *c)
+{
+	pthread_mutex_lock(&srv->mutex);
+	if (c->state == CLIENT_PLAYING)
+		IMP_LOG_INFO(TAG, "%s:%d stopped, %u frames, %llu bytes, %u dropped\n",
+				inet_ntoa(c->rtp_addr.sin_addr), ntohs(c->rtp_addr.sin_port),
+				c->frames, (unsigned long long)c->bytes, c->dropped);
+	close(c->fd);
+	c->fd = -1;
+	c->state = CLIENT_INIT;
+	pthread_mutex_unlock(&srv->mutex);
+}
+
+static void client_accept(rtsp_server_t *srv)
+{
+	struct sockaddr_in peer;
+	socklen_t alen = sizeof(peer);
+	struct rtsp_client *c = NULL;
+	int i, fd, on = 1;
+
+	fd = accept(srv->listen_fd, (struct sockaddr *)&peer, &alen);
+	if (fd < 0)
+		return;
+
+	for (i = 0; i < RTSP_MAX_CLIENTS; i++) {
+		if (srv->client[i].fd < 0) {
+			c = &srv->client[i];
+			break;
+		}
+	}
+	if (c == NULL) {
+		IMP_LOG_WARN(TAG, "too many clients, %s refused\n", inet_ntoa(peer.sin_addr));
+		close(fd);
+		return;
+	}
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	pthread_mutex_lock(&srv->mutex);
+	memset(c, 0, sizeof(*c));
+	c->fd = fd;
+	c->peer = peer;
+	c->state = CLIENT_INIT;
+	c->stream = -1;
+	pthread_mutex_unlock(&srv->mutex);
+}
+
+/* Read what the client sent and handle every complete request */
+static void client_read(rtsp_server_t *srv, struct rtsp_client *c)
+{
+	char *end, clen[16];
+	int ret, hlen, blen;
+
+	ret = recv(c->fd, c->buf + c->len, RTSP_REQ_MAX - c->len, 0);
+	if (ret <= 0) {
+		client_close(srv, c);
+		return;
+	}
+	c->len += ret;
+	c->buf[c->len] = '\0';
+
+	while ((end = strstr(c->buf, "\r\n\r\n")) != NULL) {
+		hlen = end + 4 - c->buf;
+		end[2] = '\0';		/* get_header() stops here */
+		blen = get_header(c->buf, "Content-Length", clen, sizeof(clen)) == 0 ? atoi(clen) : 0;
+		if (hlen + blen > RTSP_REQ_MAX) {
+			client_close(srv, c);
+			return;
+		}
+		if (hlen + blen > c->len) {
+			end[2] = '\r';		/* body still on the way */
+			return;
+		}
+		handle_request(srv, c, c->buf);
+		c->len -= hlen + blen;
+		memmove(c->buf, c->buf + hlen + blen, c->len);
+		c->buf[c->len] = '\0';
+	}
+
+	if (c->len == RTSP_REQ_MAX) {
+		IMP_LOG_ERR(TAG, "request from %s too long\n", inet_ntoa(c->peer.sin_addr));
+		client_close(srv, c);
+	}
+}
+
+/*
+ * Receiver reports, in an RR or an SR, compound or not. The report block
+ * about our SSRC gives the loss, and the round trip time once the client
+ * echoes the middle 32 bits of an SR timestamp (LSR) with its delay (DLSR).
+ */
+static void rtcp_input(rtsp_server_t *srv, const uint8_t *p, int len)
+{
+	struct rtsp_client *c;
+	const uint8_t *rb;
+	uint32_t sec, frac, ssrc, lsr, dlsr, rtt;
+	int i, j, nr_rb, plen, off;
+
+	ntp_now(&sec, &frac);
+	while (len >= 8) {
+		plen = (get16(p + 2) + 1) * 4;
+		if ((p[0] >> 6) != 2 || plen > len)
+			break;
+		nr_rb = p[0] & 0x1f;
+		off = p[1] == RTCP_RR ? 8 : p[1] == RTCP_SR ? RTCP_SR_LEN : plen;
+
+		for (j = 0; j < nr_rb && off + RTCP_RB_LEN <= plen; j++, off += RTCP_RB_LEN) {
+			rb = p + off;
+			ssrc = get32(rb);
+			lsr = get32(rb + 16);
+			dlsr = get32(rb + 20);
+			/* 16.16 seconds, a negative result wraps and is thrown away */
+			rtt = ((sec << 16) | (frac >> 16)) - lsr - dlsr;
+
+			pthread_mutex_lock(&srv->mutex);
+			for (i = 0; i < RTSP_MAX_CLIENTS; i++) {
+				c = &srv->client[i];
+				if (c->fd < 0 || c->state != CLIENT_PLAYING || c->ssrc != ssrc)
+					continue;
+				c->loss_permille = rb[4] * 1000 / 256;
+				if (lsr && rtt < 10 << 16)
+					c->rtt_us = (int64_t)rtt * 1000000 / 65536;
+				c->last_rr = IMP_System_GetTimeStamp();
+				c->reports++;
+			}
+			pthread_mutex_unlock(&srv->mutex);
+		}
+		p += plen;
+		len -= plen;
+	}
+}
+
+static void *control_thread(void *arg)
+{
+	rtsp_server_t *srv = (rtsp_server_t *)arg;
+	struct pollfd pfd[1 + RTSP_MAX_STREAMS + RTSP_MAX_CLIENTS];
+	int map[1 + RTSP_MAX_STREAMS + RTSP_MAX_CLIENTS];
+	uint8_t rtcp[1500];
+	int i, n, len;
+
+	while (!srv->stop) {
+		n = 0;
+		pfd[n].fd = srv->listen_fd;
+		pfd[n++].events = POLLIN;
+		/* receiver reports */
+		for (i = 0; i < srv->nr_streams; i++) {
+			pfd[n].fd = srv->stream[i]->rtcp_fd;
+			pfd[n++].events = POLLIN;
+		}
+		for (i = 0; i < RTSP_MAX_CLIENTS; i++) {
+			if (srv->client[i].fd < 0)
+				continue;
+			map[n] = i;
+			pfd[n].fd = srv->client[i].fd;
+			pfd[n++].events = POLLIN;
+		}
+
+		if (poll(pfd, n, RTSP_POLL_MS) <= 0)
+			continue;
+
+		for (i = 1; i < n; i++) {
+			if (!(pfd[i].revents & (POLLIN | POLLERR | POLLHUP)))
+				continue;
+			if (i <= srv->nr_streams)
+				while ((len = recv(pfd[i].fd, rtcp, sizeof(rtcp), MSG_DONTWAIT)) > 0)
+					rtcp_input(srv, rtcp, len);
+			else
+				client_read(srv, &srv->client[map[i]]);
+		}
+		if (pfd[0].revents & POLLIN)
+			client_accept(srv);
+	}
+
+	return NULL;
+}
+
+rtsp_server_t *rtsp_server_create(int port)
+{
+	rtsp_server_t *srv;
+	struct sockaddr_in addr;
+	int i, on = 1;
+
+	srv = calloc(1, sizeof(rtsp_server_t));
+	if (srv == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+	srv->port = port > 0 ? port : RTSP_DEFAULT_PORT;
+	srv->rand = (uint32_t)IMP_System_GetTimeStamp() ^ ((uint32_t)getpid() << 16) ^ 0x9e3779b9;
+	for (i = 0; i < RTSP_MAX_CLIENTS; i++)
+		srv->client[i].fd = -1;
+
+	srv->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (srv->listen_fd < 0) {
+		IMP_LOG_ERR(TAG, "socket() failed: %s\n", strerror(errno));
+		free(srv);
+		return NULL;
+	}
+	setsockopt(srv->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(srv->port);
+	if (bind(srv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+			|| listen(srv->listen_fd, RTSP_MAX_CLIENTS) < 0) {
+		IMP_LOG_ERR(TAG, "listen on port %d failed: %s\n", srv->port, strerror(errno));
+		close(srv->listen_fd);
+		free(srv);
+		return NULL;
+	}
+
+	pthread_mutex_init(&srv->mutex, NULL);
+
+	return srv;
+}
+
+int rtsp_server_add_stream(rtsp_server_t *srv, const char *name, int width, int height)
+{
+	struct rtsp_stream *st;
+
+	if (srv->running || srv->nr_streams == RTSP_MAX_STREAMS) {
+		IMP_LOG_ERR(TAG, "cannot add stream %s\n", name);
+		return -1;
+	}
+
+	st = calloc(1, sizeof(struct rtsp_stream));
+	if (st == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return -1;
+	}
+	snprintf(st->name, sizeof(st->name), "%s", name);
+	st->width = width;
+	st->height = height;
+	st->ts_base = rtsp_random(srv);
+
+	st->rtp_fd = udp_socket(&st->rtp_port);
+	st->rtcp_fd = udp_socket(&st->rtcp_port);
+	if (st->rtp_fd < 0 || st->rtcp_fd < 0) {
+		IMP_LOG_ERR(TAG, "RTP socket for %s failed: %s\n", name, strerror(errno));
+		if (st->rtp_fd >= 0)
+			close(st->rtp_fd);
+		if (st->rtcp_fd >= 0)
+			close(st->rtcp_fd);
+		free(st);
+		return -1;
+	}
+
+	srv->stream[srv->nr_streams] = st;
+	return srv->nr_streams++;
+}
+
+void rtsp_server_set_low_latency(rtsp_server_t *srv, int on)
+{
+	srv->low_latency = on;
+}
+
+int rtsp_server_start(rtsp_server_t *srv)
+{
+	int i, tos = IPTOS_LOWDELAY;
+
+	srv->stop = 0;
+	if (pthread_create(&srv->tid, NULL, control_thread, srv)) {
+		IMP_LOG_ERR(TAG, "create control thread failed\n");
+		return -1;
+	}
+	srv->running = 1;
+
+	for (i = 0; i < srv->nr_streams; i++) {
+		/* ask the Wi-Fi queue and the routers to hurry */
+		if (srv->low_latency && setsockopt(srv->stream[i]->rtp_fd, IPPROTO_IP, IP_TOS,
+					&tos, sizeof(tos)) < 0)
+			IMP_LOG_WARN(TAG, "IP_TOS on %s failed: %s\n", srv->stream[i]->name, strerror(errno));
+		IMP_LOG_INFO(TAG, "serving rtsp://<ip>:%d/%s, %dx%d%s\n", srv->port,
+				srv->stream[i]->name, srv->stream[i]->width, srv->stream[i]->height,
+				srv->low_latency ? ", low latency" : "");
+	}
+
+	return 0;
+}
+
+void rtsp_server_destroy(rtsp_server_t *srv)
+{
+	int i;
+
+	if (srv->running) {
+		srv->stop = 1;
+		pthread_join(srv->tid, NULL);
+	}
+
+	for (i = 0; i < RTSP_MAX_CLIENTS; i++) {
+		if (srv->client[i].fd >= 0)
+			client_close(srv, &srv->client[i]);
+	}
+	for (i = 0; i < srv->nr_streams; i++) {
+		close(srv->stream[i]->rtp_fd);
+		close(srv->stream[i]->rtcp_fd);
+		free(srv->stream[i]);
+	}
+	close(srv->listen_fd);
+	pthread_mutex_destroy(&srv->mutex);
+	free(srv);
+}
+
+int rtsp_server_get_client_stat(rtsp_server_t *srv, rtsp_client_stat_t *stat, int max)
+{
+	struct rtsp_client *c;
+	int64_t now = IMP_System_GetTimeStamp();
+	int i, n = 0;
+
+	pthread_mutex_lock(&srv->mutex);
+	for (i = 0; i < RTSP_MAX_CLIENTS && n < max; i++) {
+		c = &srv->client[i];
+		if (c->fd < 0 || c->state != CLIENT_PLAYING)
+			continue;
+		snprintf(stat[n].addr, sizeof(stat[n].addr), "%s:%d",
+				inet_ntoa(c->rtp_addr.sin_addr), ntohs(c->rtp_addr.sin_port));
+		stat[n].stream = c->stream;
+		stat[n].frames = c->frames;
+		stat[n].packets = c->packets;
+		stat[n].bytes = c->bytes;
+		stat[n].dropped = c->dropped;
+		/* nothing sent for a while, the last window is stale */
+		stat[n].kbps = now - c->win_start > 2000000 ? 0 : c->kbps;
+		stat[n].lat_avg_us = c->frames ? c->lat_total_us / c->frames : 0;
+		stat[n].lat_max_us = c->lat_max_us;
+		stat[n].rtt_us = c->rtt_us;
+		stat[n].loss_permille = c->loss_permille;
+		n++;
+	}
+	pthread_mutex_unlock(&srv->mutex);
+
+	return n;
+}
+
+int rtsp_server_get_link_stat(rtsp_server_t *srv, int id, rtsp_link_stat_t *link)
+{
+	struct rtsp_client *c;
+	int64_t now = IMP_System_GetTimeStamp();
+	int i, queued = 0;
+
+	if (id < 0 || id >= srv->nr_streams)
+		return -1;
+
+	memset(link, 0, sizeof(*link));
+	link->rtt_us = -1;
+	link->rr_age_us = -1;
+	/* what the stack and the driver still hold, Wi-Fi backs up here */
+	if (ioctl(srv->stream[id]->rtp_fd, SIOCOUTQ, &queued) == 0)
+		link->queue_bytes = queued;
+
+	pthread_mutex_lock(&srv->mutex);
+	for (i = 0; i < RTSP_MAX_CLIENTS; i++) {
+		c = &srv->client[i];
+		if (c->fd < 0 || c->state != CLIENT_PLAYING || c->stream != id)
+			continue;
+		link->clients++;
+		link->dropped += c->dropped;
+		link->reports += c->reports;
+		if (c->rtt_us > link->rtt_us)
+			link->rtt_us = c->rtt_us;
+		if (c->loss_permille > link->loss_permille)
+			link->loss_permille = c->loss_permille;
+		if (c->last_rr && now - c->last_rr > link->rr_age_us)
+			link->rr_age_us = now - c->last_rr;
+	}
+	pthread_mutex_unlock(&srv->mutex);
+
+	return 0;
+}
+
+void rtsp_server_dump_stat(rtsp_server_t *srv)
+{
+	rtsp_client_stat_t stat[RTSP_MAX_CLIENTS];
+	int i, n;
+
+	n = rtsp_server_get_client_stat(srv, stat, RTSP_MAX_CLIENTS);
+	for (i = 0; i < n; i++)
+		IMP_LOG_INFO(TAG, "%s %s: %u kbps, %u frames, %u packets, %u dropped, "
+				"send latency avg %lld us max %lld us, rtt %lld us, loss %u.%u%%\n", stat[i].addr,
+				srv->stream[stat[i].stream]->name, stat[i].kbps, stat[i].frames,
+				stat[i].packets, stat[i].dropped, (long long)stat[i].lat_avg_us,
+				(long long)stat[i].lat_max_us, (long long)stat[i].rtt_us,
+				stat[i].loss_permille / 10, stat[i].loss_permille % 10);
+}
@@ -0,0 +1,120 @@
+/*
+ * sample-rtsp-server.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_RTSP_SERVER_H__
+#define __SAMPLE_RTSP_SERVER_H__
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <imp/imp_encoder.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Minimal RTSP server, H264 over RTP/UDP unicast.
+ *
+ * Each stream is served as rtsp://<ip>:<port>/<name>. A control thread
+ * handles OPTIONS, DESCRIBE, SETUP, PLAY and TEARDOWN; the session ends
+ * with TEARDOWN or when the client closes the RTSP connection.
+ *
+ * Frames are sent from the thread that pushes them. The packs are cut
+ * into RTP packets (RFC 6184 single NAL unit or FU-A) whose payload
+ * iovecs point straight into the pack data, only the RTP and FU headers
+ * live in server memory. All packets of a frame go to a client in one
+ * sendmmsg() call, non-blocking: a client whose socket buffer is full
+ * loses the rest of the frame and resumes at the next IDR.
+ *
+ * In low latency mode each pack is cut up and sent to the clients on
+ * its own, so the first packets of a frame leave while the rest is still
+ * being packetized, and the RTP socket asks for IPTOS_LOWDELAY.
+ *
+ * Every client gets an RTCP sender report each second; its receiver
+ * reports give the round trip time and loss that, with the send queue
+ * depth, tell a rate controller how the link is doing.
+ */
+
+#define RTSP_DEFAULT_PORT	554
+#define RTSP_MAX_STREAMS	4
+#define RTSP_MAX_CLIENTS	8
+#define RTSP_RTP_PAYLOAD	1400	/* max RTP payload, fits a 1500 byte MTU */
+#define RTSP_MAX_PACKETS	1024	/* per frame, 1.4MB */
+
+typedef struct rtsp_server rtsp_server_t;
+
+typedef struct rtsp_client_stat {
+	char		addr[32];			/* client ip:rtp port */
+	int			stream;
+	uint32_t	frames;
+	uint32_t	packets;
+	uint64_t	bytes;
+	uint32_t	dropped;			/* frames cut short, socket buffer full */
+	uint32_t	kbps;				/* over the last second */
+	int64_t		lat_avg_us;			/* push -> last packet queued to the socket */
+	int64_t		lat_max_us;
+	int64_t		rtt_us;				/* from RTCP receiver reports, -1: none yet */
+	uint32_t	loss_permille;		/* fraction lost in the last receiver report */
+} rtsp_client_stat_t;
+
+/* One stream, the worst of its clients */
+typedef struct rtsp_link_stat {
+	int			clients;
+	uint32_t	queue_bytes;		/* RTP socket send queue, SIOCOUTQ */
+	int64_t		rtt_us;				/* -1: no receiver report yet */
+	uint32_t	loss_permille;
+	int64_t		rr_age_us;			/* oldest last receiver report, -1: none */
+	uint32_t	reports;			/* receiver reports since PLAY, all clients */
+	uint32_t	dropped;			/* frames cut short since PLAY, all clients */
+} rtsp_link_stat_t;
+
+rtsp_server_t *rtsp_server_create(int port);
+void rtsp_server_destroy(rtsp_server_t *srv);
+
+/* Before rtsp_server_start(), returns the stream id */
+int rtsp_server_add_stream(rtsp_server_t *srv, const char *name, int width, int height);
+
+/* Before rtsp_server_start() */
+void rtsp_server_set_low_latency(rtsp_server_t *srv, int on);
+
+int rtsp_server_start(rtsp_server_t *srv);
+
+/*
+ * Send one H264 frame to the clients playing stream id. Packs must start
+ * with a start code. One thread per stream. Returns the number of
+ * clients served.
+ */
+int rtsp_server_push(rtsp_server_t *srv, int id, IMPEncoderStream *stream);
+int rtsp_server_push_iov(rtsp_server_t *srv, int id, const struct iovec *nal, int nr_nal,
+		int64_t timestamp);
+
+/*
+ * The pushed timestamp of a recent frame of id from its RTP timestamp,
+ * for a receiver on this host to time frames against their capture.
+ */
+int64_t rtsp_server_rtp_timestamp(rtsp_server_t *srv, int id, uint32_t rtp_ts);
+
+/*
+ * 1 once after a client started playing id, so the caller can ask the
+ * encoder for an IDR instead of letting it wait for the next GOP.
+ */
+int rtsp_server_want_idr(rtsp_server_t *srv, int id);
+
+/* Fills up to max entries, returns the number of clients */
+int rtsp_server_get_client_stat(rtsp_server_t *srv, rtsp_client_stat_t *stat, int max);
+int rtsp_server_get_link_stat(rtsp_server_t *srv, int id, rtsp_link_stat_t *link);
+void rtsp_server_dump_stat(rtsp_server_t *srv);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_RTSP_SERVER_H__ */
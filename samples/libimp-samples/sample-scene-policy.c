@@ -0,0 +1,256 @@
+/*
+ * sample-scene-policy.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-scene-policy.h"
+
+#define TAG "Sample-Scene-Policy"
+
+struct scene_policy {
+	scene_policy_attr_t	attr;
+	IMPEncoderRcAttr	full;
+	IMPEncoderRcAttr	still;
+	int					is_static;
+	int64_t				last_motion;
+	int64_t				since;			/* current profile */
+	int64_t				start;
+	pthread_mutex_t		mutex;			/* stat */
+	scene_policy_stat_t	stat;
+};
+
+/*
+ * The fields all rc modes have, bitrate NULL for FixQp. All NULL for
+ * other modes; gop and kbps may be NULL when not wanted.
+ */
+static IMPEncoderFrmRate *rc_fields(IMPEncoderRcAttr *rc, uint32_t **gop, uint32_t **kbps)
+{
+	IMPEncoderFrmRate *fr = NULL;
+	uint32_t *g = NULL, *k = NULL;
+
+	switch (rc->rcMode) {
+	case ENC_RC_MODE_H264FIXQP:
+		g = &rc->attrH264FixQp.maxGop;
+		fr = &rc->attrH264FixQp.outFrmRate;
+		break;
+	case ENC_RC_MODE_H264CBR:
+		g = &rc->attrH264Cbr.maxGop;
+		k = &rc->attrH264Cbr.outBitRate;
+		fr = &rc->attrH264Cbr.outFrmRate;
+		break;
+	case ENC_RC_MODE_H264VBR:
+		g = &rc->attrH264Vbr.maxGop;
+		k = &rc->attrH264Vbr.maxBitRate;
+		fr = &rc->attrH264Vbr.outFrmRate;
+		break;
+	default:
+		break;
+	}
+	if (gop)
+		*gop = g;
+	if (kbps)
+		*kbps = k;
+
+	return fr;
+}
+
+/* Static profile from the full one; the frame rate never goes up */
+static int make_static(scene_policy_t *sp)
+{
+	const scene_policy_attr_t *a = &sp->attr;
+	IMPEncoderFrmRate *full_fr, *fr;
+	uint32_t *full_gop, *full_kbps, *gop, *kbps;
+
+	full_fr = rc_fields(&sp->full, &full_gop, &full_kbps);
+	fr = rc_fields(&sp->still, &gop, &kbps);
+	if (full_fr == NULL || fr == NULL || full_fr->frmRateNum == 0 || full_fr->frmRateDen == 0) {
+		IMP_LOG_ERR(TAG, "chn%d: rc mode %d not supported\n", a->encChn, sp->full.rcMode);
+		return -1;
+	}
+
+	if ((uint64_t)a->static_fps_num * full_fr->frmRateDen
+			< (uint64_t)full_fr->frmRateNum * a->static_fps_den) {
+		fr->frmRateNum = a->static_fps_num;
+		fr->frmRateDen = a->static_fps_den;
+	}
+	*gop = (uint64_t)a->static_gop_ms * fr->frmRateNum / fr->frmRateDen / 1000;
+	if (*gop == 0)
+		*gop = 1;
+	/* same bits per frame as the full profile */
+	if (kbps && full_kbps) {
+		*kbps = (uint64_t)*full_kbps * fr->frmRateNum * full_fr->frmRateDen
+			/ fr->frmRateDen / full_fr->frmRateNum;
+		if (*kbps == 0)
+			*kbps = 1;
+	}
+
+	return 0;
+}
+
+static int set_profile(scene_policy_t *sp, IMPEncoderRcAttr *rc)
+{
+	int encChn = sp->attr.encChn;
+	IMPEncoderFrmRate *fr;
+
+	fr = rc_fields(rc, NULL, NULL);
+	if (fr == NULL) {
+		IMP_LOG_ERR(TAG, "chn%d: rc mode %d not supported\n", encChn, rc->rcMode);
+		return -1;
+	}
+	if (IMP_Encoder_SetChnRcAttr(encChn, rc) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_SetChnRcAttr(%d) failed\n", encChn);
+		return -1;
+	}
+	if (IMP_Encoder_SetChnFrmRate(encChn, fr) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_SetChnFrmRate(%d) failed\n", encChn);
+		return -1;
+	}
+
+	return 0;
+}
+
+scene_policy_t *scene_policy_create(const scene_policy_attr_t *attr)
+{
+	IMPEncoderCHNAttr chn_attr;
+	IMPEncoderFrmRate *fr;
+	scene_policy_t *sp;
+	uint32_t *gop, *kbps;
+
+	sp = calloc(1, sizeof(scene_policy_t));
+	if (sp == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+
+	sp->attr = *attr;
+	if (sp->attr.static_ms == 0)
+		sp->attr.static_ms = SCENE_STATIC_MS;
+	if (sp->attr.static_fps_num == 0 || sp->attr.static_fps_den == 0) {
+		sp->attr.static_fps_num = SCENE_STATIC_FPS;
+		sp->attr.static_fps_den = 1;
+	}
+	if (sp->attr.static_gop_ms == 0)
+		sp->attr.static_gop_ms = SCENE_STATIC_GOP_MS;
+
+	if (IMP_Encoder_GetChnAttr(attr->encChn, &chn_attr) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_GetChnAttr(%d) failed\n", attr->encChn);
+		goto err;
+	}
+	sp->full = chn_attr.rcAttr;
+	sp->still = chn_attr.rcAttr;
+	if (make_static(sp) < 0)
+		goto err;
+
+	fr = rc_fields(&sp->still, &gop, &kbps);
+	if (fr == NULL)
+		goto err;
+	IMP_LOG_INFO(TAG, "chn%d: static after %u ms: %u/%u fps, GOP %u, %u kbps\n", attr->encChn,
+			sp->attr.static_ms, fr->frmRateNum, fr->frmRateDen, *gop, kbps ? *kbps : 0);
+
+	pthread_mutex_init(&sp->mutex, NULL);
+	sp->start = sp->since = sp->last_motion = IMP_System_GetTimeStamp();
+
+	return sp;
+
+err:
+	free(sp);
+	return NULL;
+}
+
+int scene_policy_destroy(scene_policy_t *sp)
+{
+	int ret = 0;
+
+	if (sp->is_static)
+		ret = set_profile(sp, &sp->full);
+	pthread_mutex_destroy(&sp->mutex);
+	free(sp);
+
+	return ret;
+}
+
+int scene_policy_motion(scene_policy_t *sp, int moving)
+{
+	int64_t now = IMP_System_GetTimeStamp(), wake;
+	int ret;
+
+	if (moving) {
+		sp->last_motion = now;
+		if (!sp->is_static)
+			return 0;
+
+		/* full rate first, then the IDR is made at it */
+		ret = set_profile(sp, &sp->full);
+		if (ret < 0) {
+			/* still static: the next motion report tries again */
+			return ret;
+		}
+		if (IMP_Encoder_RequestIDR(sp->attr.encChn) < 0) {
+			IMP_LOG_ERR(TAG, "IMP_Encoder_RequestIDR(%d) failed\n", sp->attr.encChn);
+			ret = -1;
+		}
+		wake = IMP_System_GetTimeStamp() - now;
+
+		pthread_mutex_lock(&sp->mutex);
+		sp->is_static = 0;
+		sp->stat.to_motion++;
+		sp->stat.static_us += now - sp->since;
+		if (wake > sp->stat.max_wake_us)
+			sp->stat.max_wake_us = wake;
+		sp->since = now;
+		pthread_mutex_unlock(&sp->mutex);
+
+		return ret;
+	}
+
+	if (sp->is_static || now - sp->last_motion < (int64_t)sp->attr.static_ms * 1000)
+		return 0;
+
+	ret = set_profile(sp, &sp->still);
+	if (ret < 0) {
+		/* try again after another static_ms */
+		sp->last_motion = now;
+		return ret;
+	}
+
+	pthread_mutex_lock(&sp->mutex);
+	sp->is_static = 1;
+	sp->stat.to_static++;
+	sp->since = now;
+	pthread_mutex_unlock(&sp->mutex);
+
+	return 0;
+}
+
+void scene_policy_get_stat(scene_policy_t *sp, scene_policy_stat_t *stat)
+{
+	int64_t now = IMP_System_GetTimeStamp();
+
+	pthread_mutex_lock(&sp->mutex);
+	*stat = sp->stat;
+	stat->is_static = sp->is_static;
+	if (sp->is_static)
+		stat->static_us += now - sp->since;
+	stat->total_us = now - sp->start;
+	pthread_mutex_unlock(&sp->mutex);
+}
+
+void scene_policy_dump_stat(scene_policy_t *sp)
+{
+	scene_policy_stat_t s;
+
+	scene_policy_get_stat(sp, &s);
+	IMP_LOG_INFO(TAG, "chn%d: %s, static %lld of %lld s, %u times, back to full %u times, "
+			"max %lld us\n", sp->attr.encChn, s.is_static ? "static" : "full",
+			(long long)s.static_us / 1000000, (long long)s.total_us / 1000000,
+			s.to_static, s.to_motion, (long long)s.max_wake_us);
+}
@@ -0,0 +1,78 @@
+/*
+ * sample-scene-policy.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_SCENE_POLICY_H__
+#define __SAMPLE_SCENE_POLICY_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Motion adaptive encoding profile for one H264 channel.
+ *
+ * The channel starts with the profile it was created with. After
+ * static_ms without motion it drops to the static profile: static_fps,
+ * a GOP of static_gop_ms and the bitrate scaled down with the frame
+ * rate. A static scene costs a few P frames a second and one I frame
+ * every static_gop_ms instead of one every 2s.
+ *
+ * The first motion report puts the full profile back and requests an
+ * IDR, both before scene_policy_motion() returns, so the encoder makes
+ * the next frame an IDR at full rate and the event is not missing its
+ * start.
+ */
+
+#define SCENE_STATIC_MS			10000
+#define SCENE_STATIC_FPS		5
+#define SCENE_STATIC_GOP_MS		20000
+
+typedef struct scene_policy scene_policy_t;
+
+typedef struct scene_policy_attr {
+	int			encChn;
+	uint32_t	static_ms;			/* 0: SCENE_STATIC_MS */
+	uint32_t	static_fps_num;		/* 0: SCENE_STATIC_FPS / 1 */
+	uint32_t	static_fps_den;
+	uint32_t	static_gop_ms;		/* 0: SCENE_STATIC_GOP_MS */
+} scene_policy_attr_t;
+
+typedef struct scene_policy_stat {
+	int			is_static;
+	uint32_t	to_static;			/* profile switches */
+	uint32_t	to_motion;
+	int64_t		static_us;			/* total time in the static profile */
+	int64_t		total_us;
+	int64_t		max_wake_us;		/* motion report -> full profile and IDR requested */
+} scene_policy_stat_t;
+
+/* Takes the full profile from the channel, which must exist */
+scene_policy_t *scene_policy_create(const scene_policy_attr_t *attr);
+
+/* Leaves the channel with the full profile */
+int scene_policy_destroy(scene_policy_t *sp);
+
+/*
+ * Report the motion state, e.g. from every IMP_IVS_MoveOutput, always
+ * from the same thread. Returns -1 if the encoder refused a profile.
+ */
+int scene_policy_motion(scene_policy_t *sp, int moving);
+
+void scene_policy_get_stat(scene_policy_t *sp, scene_policy_stat_t *stat);
+void scene_policy_dump_stat(scene_policy_t *sp);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_SCENE_POLICY_H__ */
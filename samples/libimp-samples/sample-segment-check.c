@@ -0,0 +1,261 @@
+/*
+ * sample-segment-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check for the segmented recorder: replays a recorded .h264 file
+ * through it, then reads the segments back and verifies that
+ *  - every segment starts with an IDR,
+ *  - the segments, in order, give back the tail of the input that was
+ *    not deleted for space, byte for byte,
+ * and prints the write latency percentiles.
+ *
+ * To see what an SD card does, run it on a FAT image, e.g.
+ *   dd if=/dev/zero of=/tmp/sd.img bs=1M count=256
+ *   mkfs.vfat /tmp/sd.img
+ *   mount -o loop /tmp/sd.img /mnt/sd
+ *   sample-segment-check -d -m 64 stream.h264 /mnt/sd
+ * or point dir at the card itself.
+ *
+ * usage: sample-segment-check [-d] [-r] [-s segment_ms] [-f fps] [-m min_free_mb]
+ *                             <in.h264> <dir>
+ *   -d  O_DIRECT
+ *   -r  replay at fps, by default frames come as fast as the chunk
+ *       buffers allow, so nothing is dropped
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <imp/imp_log.h>
+
+#include "sample-common.h"
+#include "sample-h264-parse.h"
+#include "sample-segment-recorder.h"
+
+#define TAG "Sample-Segment-Check"
+
+#define MAX_NALS_PER_FRAME	16
+#define SEG_PREFIX			"check"
+
+static uint8_t *map_file(const char *path, size_t *len)
+{
+	struct stat st;
+	uint8_t *buf;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	*len = st.st_size;
+	if (st.st_size == 0) {
+		close(fd);
+		return (uint8_t *)"";
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		IMP_LOG_ERR(TAG, "mmap %s failed: %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	return buf;
+}
+
+/* Segment numbers left by this run, oldest first */
+static int list_segments(const char *dir, unsigned int *seg, int max)
+{
+	struct dirent *de;
+	unsigned int n;
+	char tail[8];
+	int i, j, cnt = 0;
+	DIR *d;
+
+	d = opendir(dir);
+	if (d == NULL)
+		return -1;
+	while ((de = readdir(d)) != NULL && cnt < max) {
+		if (sscanf(de->d_name, SEG_PREFIX "-%6u.%4s", &n, tail) != 2 || strcmp(tail, "h264"))
+			continue;
+		for (i = cnt; i > 0 && seg[i - 1] > n; i--)
+			seg[i] = seg[i - 1];
+		seg[i] = n;
+		cnt++;
+	}
+	closedir(d);
+
+	/* only the run just made, numbering continues after older ones */
+	for (i = cnt - 1; i > 0 && seg[i - 1] == seg[i] - 1; i--)
+		;
+	for (j = 0; i < cnt; )
+		seg[j++] = seg[i++];
+
+	return j;
+}
+
+/* Remove what an earlier check left behind */
+static void clean_segments(const char *dir)
+{
+	struct dirent *de;
+	unsigned int n;
+	char path[512], tail[8];
+	DIR *d;
+
+	d = opendir(dir);
+	if (d == NULL)
+		return;
+	while ((de = readdir(d)) != NULL) {
+		if (sscanf(de->d_name, SEG_PREFIX "-%6u.%4s", &n, tail) != 2 || strcmp(tail, "h264"))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		unlink(path);
+	}
+	closedir(d);
+}
+
+int main(int argc, char *argv[])
+{
+	int fps = SENSOR_FRAME_RATE_NUM / SENSOR_FRAME_RATE_DEN, realtime = 0, opt;
+	h264_nal_t nal[MAX_NALS_PER_FRAME];
+	struct iovec iov[MAX_NALS_PER_FRAME];
+	seg_recorder_attr_t attr;
+	seg_recorder_stat_t stat;
+	seg_recorder_t *rec;
+	unsigned int seg[4096];
+	const char *dir;
+	char path[512];
+	uint8_t *in, *data;
+	size_t in_len, len, pos = 0;
+	int64_t ts = 0;
+	int i, n, nr_seg, frames = 0;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prefix = SEG_PREFIX;
+	attr.segment_ms = 2000;
+	attr.min_free = 0;
+
+	while ((opt = getopt(argc, argv, "drs:f:m:")) != -1) {
+		switch (opt) {
+		case 'd':
+			attr.direct = 1;
+			break;
+		case 'r':
+			realtime = 1;
+			break;
+		case 's':
+			attr.segment_ms = atoi(optarg);
+			break;
+		case 'f':
+			fps = atoi(optarg);
+			break;
+		case 'm':
+			attr.min_free = (uint64_t)atoi(optarg) * 1024 * 1024;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (argc - optind < 2)
+		goto usage;
+	dir = argv[optind + 1];
+	attr.dir = dir;
+
+	in = map_file(argv[optind], &in_len);
+	if (in == NULL)
+		return -1;
+
+	/* size segments as the sample does: the input's average rate plus 50% */
+	while (h264_next_frame(in, in_len, &pos, nal, MAX_NALS_PER_FRAME) > 0)
+		frames++;
+	if (frames == 0) {
+		IMP_LOG_ERR(TAG, "no frames in %s\n", argv[optind]);
+		return -1;
+	}
+	attr.segment_bytes = (uint64_t)in_len * fps * attr.segment_ms / 1000 / frames * 3 / 2;
+
+	clean_segments(dir);
+	rec = seg_recorder_create(&attr);
+	if (rec == NULL)
+		return -1;
+
+	pos = 0;
+	while ((n = h264_next_frame(in, in_len, &pos, nal, MAX_NALS_PER_FRAME)) > 0) {
+		for (i = 0; i < n; i++) {
+			iov[i].iov_base = (void *)nal[i].data;
+			iov[i].iov_len = nal[i].len;
+		}
+		/* unpaced, wait for the card so a frame never finds all chunks busy */
+		while (!realtime) {
+			seg_recorder_get_stat(rec, &stat);
+			if (stat.queued < SEG_NR_CHUNKS - 2)
+				break;
+			usleep(100);
+		}
+		seg_recorder_write_iov(rec, iov, n, h264_is_key_frame(nal, n), ts);
+		ts += 1000000 / fps;
+		if (realtime)
+			usleep(1000000 / fps);
+	}
+
+	seg_recorder_flush(rec);
+	seg_recorder_get_stat(rec, &stat);
+	if (seg_recorder_destroy(rec) < 0) {
+		IMP_LOG_ERR(TAG, "recorder reported a write error\n");
+		return -1;
+	}
+
+	printf("%d frames: %u written, %u dropped, %u segments, %u deleted, %llu bytes\n",
+			frames, stat.frames, stat.dropped, stat.segments, stat.deleted,
+			(unsigned long long)stat.bytes);
+	printf("%u writes: p50 %lld us, p99 %lld us, max %lld us, %u stalls\n",
+			stat.writes, (long long)stat.lat_p50_us, (long long)stat.lat_p99_us,
+			(long long)stat.lat_max_us, stat.stalls);
+
+	nr_seg = list_segments(dir, seg, sizeof(seg) / sizeof(seg[0]));
+	if (nr_seg <= 0) {
+		IMP_LOG_ERR(TAG, "no segments in %s\n", dir);
+		return -1;
+	}
+	/* newest first: what is left must be the tail of the input */
+	if (stat.dropped)
+		printf("frames were dropped, only checking segment starts\n");
+	for (i = nr_seg - 1; i >= 0; i--) {
+		snprintf(path, sizeof(path), "%s/" SEG_PREFIX "-%06u.h264", dir, seg[i]);
+		data = map_file(path, &len);
+		if (data == NULL)
+			return -1;
+		pos = 0;
+		n = h264_next_frame(data, len, &pos, nal, MAX_NALS_PER_FRAME);
+		if (n <= 0 || !h264_is_key_frame(nal, n)) {
+			IMP_LOG_ERR(TAG, "%s does not start with an IDR\n", path);
+			return -1;
+		}
+		if (stat.dropped)
+			continue;
+		if (len > in_len || memcmp(in + in_len - len, data, len)) {
+			IMP_LOG_ERR(TAG, "%s does not match the input\n", path);
+			return -1;
+		}
+		in_len -= len;
+	}
+
+	printf("%d segments ok, %zu bytes of the input deleted for space\n",
+			nr_seg, stat.dropped ? (size_t)0 : in_len);
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-d] [-r] [-s segment_ms] [-f fps] [-m min_free_mb] <in.h264> <dir>\n",
+			argv[0]);
+	return -1;
+}
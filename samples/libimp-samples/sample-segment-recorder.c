@@ -0,0 +1,555 @@
+/*
+ * sample-segment-recorder.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#define _GNU_SOURCE		/* O_DIRECT, fallocate() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/statvfs.h>
+#include <sys/vfs.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-segment-recorder.h"
+#include "sample-h264-parse.h"
+
+#define TAG "Sample-Segment-Recorder"
+
+/* write() latency histogram: 100us steps up to 100ms, then 10ms steps up to 10s */
+#define LAT_FINE_US			100
+#define LAT_FINE_BUCKETS	1000
+#define LAT_COARSE_US		10000
+#define LAT_COARSE_BUCKETS	1000
+#define LAT_STALL_US		100000
+
+#ifndef TMPFS_MAGIC
+#define TMPFS_MAGIC			0x01021994
+#endif
+
+#define CHUNK_SEG_START		(1 << 0)	/* open a new segment before this chunk */
+#define CHUNK_SEG_END		(1 << 1)	/* close the segment after this chunk */
+
+struct seg_chunk {
+	uint8_t		*buf;
+	uint32_t	len;
+	int			flags;
+	uint32_t	seg;
+};
+
+struct seg_recorder {
+	seg_recorder_attr_t	attr;
+
+	struct seg_chunk	*chunk;
+	int					nr_chunks;
+	int					c_fill;			/* chunk the producer copies into */
+	int					c_write;		/* oldest queued chunk */
+	int					nr_queued;		/* includes the one being written */
+
+	/* producer side */
+	int					wait_idr;
+	int					seg_open;
+	uint32_t			seg_new;		/* number of the next segment */
+	int64_t				seg_start_ts;
+	uint32_t			seg_bytes;
+
+	/* writer side */
+	int					fd;
+	uint32_t			seg_first;		/* oldest segment on the card */
+	uint32_t			seg_next;
+	uint64_t			file_bytes;
+	int					direct;
+	int					prealloc;		/* not on tmpfs, where it only pins RAM */
+	int					stop;
+	int					error;
+
+	pthread_t			tid;
+	pthread_mutex_t		mutex;
+	pthread_cond_t		ready_cond;
+	pthread_cond_t		done_cond;
+
+	uint32_t			lat_fine[LAT_FINE_BUCKETS];
+	uint32_t			lat_coarse[LAT_COARSE_BUCKETS + 1];
+	seg_recorder_stat_t	stat;
+};
+
+#define FILL_CHUNK(rec)	(&(rec)->chunk[(rec)->c_fill])
+
+static void seg_path(seg_recorder_t *rec, uint32_t seg, char *path, int size)
+{
+	snprintf(path, size, "%s/%s-%06u.h264", rec->attr.dir, rec->attr.prefix, seg);
+}
+
+/* Find the segments a previous run left behind */
+static void scan_segments(seg_recorder_t *rec)
+{
+	char fmt[64], tail[8];
+	struct dirent *de;
+	unsigned int seg;
+	DIR *dir;
+
+	rec->seg_first = UINT32_MAX;
+	rec->seg_next = 0;
+
+	dir = opendir(rec->attr.dir);
+	if (dir == NULL)
+		return;
+
+	snprintf(fmt, sizeof(fmt), "%s-%%6u.%%4s", rec->attr.prefix);
+	while ((de = readdir(dir)) != NULL) {
+		if (sscanf(de->d_name, fmt, &seg, tail) != 2 || strcmp(tail, "h264"))
+			continue;
+		if (seg < rec->seg_first)
+			rec->seg_first = seg;
+		if (seg + 1 > rec->seg_next)
+			rec->seg_next = seg + 1;
+	}
+	closedir(dir);
+
+	if (rec->seg_first == UINT32_MAX)
+		rec->seg_first = rec->seg_next;
+}
+
+/* Delete the oldest segments until one more fits above the watermark */
+static void make_room(seg_recorder_t *rec)
+{
+	struct statvfs vfs;
+	uint64_t avail;
+	char path[256];
+
+	while (statvfs(rec->attr.dir, &vfs) == 0) {
+		avail = (uint64_t)vfs.f_bavail * vfs.f_frsize;
+		if (avail >= rec->attr.min_free + rec->attr.segment_bytes)
+			return;
+		if (rec->seg_first >= rec->seg_next) {
+			IMP_LOG_WARN(TAG, "%llu bytes free, nothing left to delete\n", (unsigned long long)avail);
+			return;
+		}
+
+		seg_path(rec, rec->seg_first++, path, sizeof(path));
+		if (unlink(path) == 0) {
+			IMP_LOG_INFO(TAG, "deleted %s, %llu bytes were free\n", path, (unsigned long long)avail);
+			rec->stat.deleted++;
+		} else if (errno != ENOENT) {
+			IMP_LOG_ERR(TAG, "unlink %s failed: %s\n", path, strerror(errno));
+		}
+	}
+}
+
+static int open_segment(seg_recorder_t *rec, uint32_t seg)
+{
+	char path[256];
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+	make_room(rec);
+
+	seg_path(rec, seg, path, sizeof(path));
+	rec->fd = open(path, flags | (rec->direct ? O_DIRECT : 0), 0777);
+	if (rec->fd < 0 && rec->direct && errno == EINVAL) {
+		IMP_LOG_WARN(TAG, "O_DIRECT not supported here, using buffered writes\n");
+		rec->direct = 0;
+		rec->fd = open(path, flags, 0777);
+	}
+	if (rec->fd < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	/* one contiguous cluster run for the whole segment */
+	if (rec->prealloc && fallocate(rec->fd, 0, 0, rec->attr.segment_bytes) < 0
+			&& rec->prealloc && ftruncate(rec->fd, rec->attr.segment_bytes) < 0)
+		IMP_LOG_WARN(TAG, "preallocating %s failed: %s\n", path, strerror(errno));
+
+	rec->file_bytes = 0;
+	rec->seg_next = seg + 1;
+	rec->stat.segments++;
+
+	return 0;
+}
+
+static void close_segment(seg_recorder_t *rec)
+{
+	/* give back the preallocated tail */
+	if (ftruncate(rec->fd, rec->file_bytes) < 0)
+		IMP_LOG_ERR(TAG, "ftruncate segment failed: %s\n", strerror(errno));
+	fdatasync(rec->fd);
+	close(rec->fd);
+	rec->fd = -1;
+}
+
+static void lat_add(seg_recorder_t *rec, int64_t us)
+{
+	if (us < LAT_FINE_US * LAT_FINE_BUCKETS)
+		rec->lat_fine[us / LAT_FINE_US]++;
+	else if (us < LAT_COARSE_US * LAT_COARSE_BUCKETS)
+		rec->lat_coarse[us / LAT_COARSE_US]++;
+	else
+		rec->lat_coarse[LAT_COARSE_BUCKETS]++;
+
+	if (us > rec->stat.lat_max_us)
+		rec->stat.lat_max_us = us;
+	if (us > LAT_STALL_US)
+		rec->stat.stalls++;
+	rec->stat.writes++;
+}
+
+/* Upper bound of the bucket holding the given permille, at most the max seen */
+static int64_t lat_percentile(seg_recorder_t *rec, int permille)
+{
+	uint64_t want = ((uint64_t)rec->stat.writes * permille + 999) / 1000, n = 0;
+	int64_t us = rec->stat.lat_max_us;
+	int i;
+
+	if (rec->stat.writes == 0)
+		return 0;
+
+	for (i = 0; i < LAT_FINE_BUCKETS; i++) {
+		n += rec->lat_fine[i];
+		if (n >= want) {
+			us = (int64_t)(i + 1) * LAT_FINE_US;
+			goto out;
+		}
+	}
+	for (i = 0; i < LAT_COARSE_BUCKETS; i++) {
+		n += rec->lat_coarse[i];
+		if (n >= want) {
+			us = (int64_t)(i + 1) * LAT_COARSE_US;
+			goto out;
+		}
+	}
+
+out:
+	return us < rec->stat.lat_max_us ? us : rec->stat.lat_max_us;
+}
+
+static int write_chunk(seg_recorder_t *rec, struct seg_chunk *c)
+{
+	uint32_t len = c->len;
+	int64_t t0, t1;
+	ssize_t ret;
+
+	if (len == 0)
+		return 0;
+
+	/* O_DIRECT wants whole blocks, the tail is cut off when the segment closes */
+	if (rec->direct && len % SEG_DIRECT_ALIGN) {
+		len = (len + SEG_DIRECT_ALIGN - 1) / SEG_DIRECT_ALIGN * SEG_DIRECT_ALIGN;
+		memset(c->buf + c->len, 0, len - c->len);
+	}
+
+	t0 = IMP_System_GetTimeStamp();
+	ret = write(rec->fd, c->buf, len);
+	t1 = IMP_System_GetTimeStamp();
+	if (ret != (ssize_t)len) {
+		IMP_LOG_ERR(TAG, "segment write error: %s\n", ret < 0 ? strerror(errno) : "short write");
+		return -1;
+	}
+	rec->file_bytes += c->len;
+
+	pthread_mutex_lock(&rec->mutex);
+	lat_add(rec, t1 - t0);
+	rec->stat.bytes += c->len;
+	pthread_mutex_unlock(&rec->mutex);
+
+	return 0;
+}
+
+static void *writer_thread(void *arg)
+{
+	seg_recorder_t *rec = (seg_recorder_t *)arg;
+	struct seg_chunk *c;
+	int ret;
+
+	pthread_mutex_lock(&rec->mutex);
+	while (1) {
+		while (rec->nr_queued == 0 && !rec->stop)
+			pthread_cond_wait(&rec->ready_cond, &rec->mutex);
+		if (rec->nr_queued == 0)
+			break;
+		c = &rec->chunk[rec->c_write];
+		pthread_mutex_unlock(&rec->mutex);
+
+		ret = 0;
+		if (c->flags & CHUNK_SEG_START)
+			ret = open_segment(rec, c->seg);
+		if (ret == 0 && rec->fd >= 0)
+			ret = write_chunk(rec, c);
+		/* a segment with a hole is closed, the next one starts clean */
+		if (rec->fd >= 0 && ((c->flags & CHUNK_SEG_END) || ret < 0))
+			close_segment(rec);
+
+		pthread_mutex_lock(&rec->mutex);
+		if (ret < 0)
+			rec->error = 1;
+		rec->c_write = (rec->c_write + 1) % rec->nr_chunks;
+		rec->nr_queued--;
+		pthread_cond_broadcast(&rec->done_cond);
+	}
+	pthread_mutex_unlock(&rec->mutex);
+
+	if (rec->fd >= 0)
+		close_segment(rec);
+
+	return NULL;
+}
+
+seg_recorder_t *seg_recorder_create(const seg_recorder_attr_t *attr)
+{
+	seg_recorder_t *rec;
+	struct statfs fs;
+	int i;
+
+	rec = calloc(1, sizeof(seg_recorder_t));
+	if (rec == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+
+	rec->attr = *attr;
+	if (rec->attr.chunk_size == 0)
+		rec->attr.chunk_size = SEG_CHUNK_SIZE;
+	if (rec->attr.nr_chunks < 2)
+		rec->attr.nr_chunks = SEG_NR_CHUNKS;
+	if (rec->attr.chunk_size % SEG_DIRECT_ALIGN) {
+		IMP_LOG_ERR(TAG, "chunk size %u is not a multiple of %d\n", rec->attr.chunk_size, SEG_DIRECT_ALIGN);
+		free(rec);
+		return NULL;
+	}
+	rec->nr_chunks = rec->attr.nr_chunks;
+	rec->direct = rec->attr.direct;
+	rec->prealloc = statfs(rec->attr.dir, &fs) < 0 || fs.f_type != TMPFS_MAGIC;
+	rec->fd = -1;
+	rec->wait_idr = 1;
+
+	rec->chunk = calloc(rec->nr_chunks, sizeof(struct seg_chunk));
+	if (rec->chunk == NULL)
+		goto err;
+	for (i = 0; i < rec->nr_chunks; i++) {
+		if (posix_memalign((void **)&rec->chunk[i].buf, SEG_DIRECT_ALIGN, rec->attr.chunk_size)) {
+			rec->chunk[i].buf = NULL;
+			goto err;
+		}
+	}
+
+	scan_segments(rec);
+	rec->seg_new = rec->seg_next;
+
+	pthread_mutex_init(&rec->mutex, NULL);
+	pthread_cond_init(&rec->ready_cond, NULL);
+	pthread_cond_init(&rec->done_cond, NULL);
+	if (pthread_create(&rec->tid, NULL, writer_thread, rec) != 0) {
+		IMP_LOG_ERR(TAG, "create writer thread failed\n");
+		pthread_mutex_destroy(&rec->mutex);
+		pthread_cond_destroy(&rec->ready_cond);
+		pthread_cond_destroy(&rec->done_cond);
+		goto err;
+	}
+
+	return rec;
+
+err:
+	IMP_LOG_ERR(TAG, "buffer alloc error !\n");
+	if (rec->chunk) {
+		for (i = 0; i < rec->nr_chunks; i++)
+			free(rec->chunk[i].buf);
+		free(rec->chunk);
+	}
+	free(rec);
+	return NULL;
+}
+
+/*
+ * Hand the filling chunk to the writer and move on to the next one, which
+ * must be free. Called with mutex held.
+ */
+static void submit_chunk(seg_recorder_t *rec, int flags)
+{
+	struct seg_chunk *c = FILL_CHUNK(rec);
+
+	c->flags |= flags;
+	rec->nr_queued++;
+	pthread_cond_signal(&rec->ready_cond);
+
+	rec->c_fill = (rec->c_fill + 1) % rec->nr_chunks;
+	c = FILL_CHUNK(rec);
+	c->len = 0;
+	c->flags = 0;
+}
+
+int seg_recorder_write_iov(seg_recorder_t *rec, const struct iovec *iov, int iovcnt,
+		int key_frame, int64_t timestamp)
+{
+	struct seg_chunk *c;
+	uint32_t len = 0, need, room, n;
+	const uint8_t *src;
+	size_t left;
+	int i, rotate;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	if (len == 0)
+		return 0;
+
+	pthread_mutex_lock(&rec->mutex);
+
+	if (rec->error) {
+		pthread_mutex_unlock(&rec->mutex);
+		return -1;
+	}
+	if (rec->wait_idr && !key_frame)
+		goto drop;
+
+	rotate = key_frame && (!rec->seg_open
+			|| timestamp - rec->seg_start_ts >= (int64_t)rec->attr.segment_ms * 1000
+			|| rec->seg_bytes + len > rec->attr.segment_bytes);
+
+	/* free chunks this frame takes, all or nothing: one per chunk it fills */
+	c = FILL_CHUNK(rec);
+	if (rotate && rec->seg_open)
+		need = 1 + len / rec->attr.chunk_size;
+	else
+		need = (c->len + len) / rec->attr.chunk_size;
+	if (need > (uint32_t)(rec->nr_chunks - 1 - rec->nr_queued))
+		goto drop;
+
+	if (rotate) {
+		if (rec->seg_open)
+			submit_chunk(rec, CHUNK_SEG_END);
+		c = FILL_CHUNK(rec);
+		c->flags = CHUNK_SEG_START;
+		c->seg = rec->seg_new++;
+		rec->seg_open = 1;
+		rec->seg_start_ts = timestamp;
+		rec->seg_bytes = 0;
+	}
+	rec->wait_idr = 0;
+	pthread_mutex_unlock(&rec->mutex);
+
+	/* the filling chunk belongs to this thread, copy without the lock */
+	for (i = 0; i < iovcnt; i++) {
+		src = iov[i].iov_base;
+		left = iov[i].iov_len;
+		while (left) {
+			c = FILL_CHUNK(rec);
+			room = rec->attr.chunk_size - c->len;
+			n = left < room ? left : room;
+			memcpy(c->buf + c->len, src, n);
+			c->len += n;
+			src += n;
+			left -= n;
+			if (c->len == rec->attr.chunk_size) {
+				pthread_mutex_lock(&rec->mutex);
+				submit_chunk(rec, 0);
+				pthread_mutex_unlock(&rec->mutex);
+			}
+		}
+	}
+
+	pthread_mutex_lock(&rec->mutex);
+	rec->seg_bytes += len;
+	rec->stat.frames++;
+	pthread_mutex_unlock(&rec->mutex);
+
+	return 0;
+
+drop:
+	rec->wait_idr = 1;
+	rec->stat.dropped++;
+	pthread_mutex_unlock(&rec->mutex);
+	return 1;
+}
+
+int seg_recorder_write(seg_recorder_t *rec, IMPEncoderStream *stream)
+{
+	struct iovec iov[stream->packCount];
+	int i;
+
+	for (i = 0; i < stream->packCount; i++) {
+		iov[i].iov_base = (void *)(uintptr_t)stream->pack[i].virAddr;
+		iov[i].iov_len = stream->pack[i].length;
+	}
+
+	return seg_recorder_write_iov(rec, iov, stream->packCount, h264_stream_is_key_frame(stream),
+			stream->pack[0].timestamp);
+}
+
+/* Close the running segment. Called with mutex held. */
+static void end_segment(seg_recorder_t *rec)
+{
+	if (!rec->seg_open)
+		return;
+
+	/* submit_chunk() needs the chunk after this one free */
+	while (rec->nr_queued >= rec->nr_chunks - 1)
+		pthread_cond_wait(&rec->done_cond, &rec->mutex);
+	submit_chunk(rec, CHUNK_SEG_END);
+	rec->seg_open = 0;
+	rec->wait_idr = 1;
+}
+
+void seg_recorder_flush(seg_recorder_t *rec)
+{
+	pthread_mutex_lock(&rec->mutex);
+	end_segment(rec);
+	while (rec->nr_queued)
+		pthread_cond_wait(&rec->done_cond, &rec->mutex);
+	pthread_mutex_unlock(&rec->mutex);
+}
+
+int seg_recorder_destroy(seg_recorder_t *rec)
+{
+	int i, ret;
+
+	pthread_mutex_lock(&rec->mutex);
+	end_segment(rec);
+	rec->stop = 1;
+	pthread_cond_signal(&rec->ready_cond);
+	pthread_mutex_unlock(&rec->mutex);
+	pthread_join(rec->tid, NULL);
+
+	ret = rec->error ? -1 : 0;
+
+	pthread_mutex_destroy(&rec->mutex);
+	pthread_cond_destroy(&rec->ready_cond);
+	pthread_cond_destroy(&rec->done_cond);
+	for (i = 0; i < rec->nr_chunks; i++)
+		free(rec->chunk[i].buf);
+	free(rec->chunk);
+	free(rec);
+
+	return ret;
+}
+
+void seg_recorder_get_stat(seg_recorder_t *rec, seg_recorder_stat_t *stat)
+{
+	pthread_mutex_lock(&rec->mutex);
+	*stat = rec->stat;
+	stat->queued = rec->nr_queued;
+	stat->lat_p50_us = lat_percentile(rec, 500);
+	stat->lat_p99_us = lat_percentile(rec, 990);
+	pthread_mutex_unlock(&rec->mutex);
+}
+
+void seg_recorder_dump_stat(seg_recorder_t *rec)
+{
+	seg_recorder_stat_t s;
+
+	seg_recorder_get_stat(rec, &s);
+	IMP_LOG_INFO(TAG, "%u segments, %u deleted, %u frames, %u dropped, %llu bytes in %u writes of %u\n",
+			s.segments, s.deleted, s.frames, s.dropped, (unsigned long long)s.bytes,
+			s.writes, rec->attr.chunk_size);
+	IMP_LOG_INFO(TAG, "write latency p50 %lld us, p99 %lld us, max %lld us, %u stalls over %d ms\n",
+			(long long)s.lat_p50_us, (long long)s.lat_p99_us, (long long)s.lat_max_us,
+			s.stalls, LAT_STALL_US / 1000);
+}
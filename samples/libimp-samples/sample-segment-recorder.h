@@ -0,0 +1,101 @@
+/*
+ * sample-segment-recorder.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_SEGMENT_RECORDER_H__
+#define __SAMPLE_SEGMENT_RECORDER_H__
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <imp/imp_encoder.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Segmented H264 recorder for SD cards.
+ *
+ * The stream is cut into <dir>/<prefix>-NNNNNN.h264 segments of about
+ * segment_ms, each starting with an IDR. Every segment is preallocated
+ * with fallocate() (ftruncate() where that is not supported) so FAT
+ * hands out one contiguous run of clusters, and trimmed to its real
+ * size when it is closed. On tmpfs nothing is preallocated, there it
+ * would only hold RAM.
+ *
+ * Frames are packed into chunk_size buffers, written whole by a writer
+ * thread, so the card only sees erase block sized, erase block aligned
+ * writes; optionally with O_DIRECT to keep the page cache out. Before a
+ * segment is opened the oldest segments are deleted until min_free
+ * bytes plus one segment are available.
+ *
+ * The chunk buffers are allocated once. If all of them wait for the
+ * card, new frames are dropped up to the next IDR.
+ */
+
+#define SEG_CHUNK_SIZE		(256 * 1024)	/* default write size */
+#define SEG_NR_CHUNKS		4				/* default chunk buffers */
+#define SEG_DIRECT_ALIGN	4096			/* O_DIRECT length and offset alignment */
+
+typedef struct seg_recorder seg_recorder_t;
+
+typedef struct seg_recorder_attr {
+	const char	*dir;
+	const char	*prefix;
+	int			segment_ms;		/* new segment at the first IDR after this */
+	uint32_t	segment_bytes;	/* preallocated per segment, bitrate * duration + margin */
+	uint32_t	chunk_size;		/* 0: SEG_CHUNK_SIZE, multiple of SEG_DIRECT_ALIGN */
+	int			nr_chunks;		/* 0: SEG_NR_CHUNKS */
+	int			direct;			/* open segments with O_DIRECT */
+	uint64_t	min_free;		/* bytes to keep free on the card */
+} seg_recorder_attr_t;
+
+typedef struct seg_recorder_stat {
+	uint32_t	segments;			/* segments opened */
+	uint32_t	deleted;			/* old segments removed for space */
+	uint32_t	frames;
+	uint32_t	dropped;			/* frames lost, all chunks busy */
+	uint64_t	bytes;				/* bytes written to the card */
+	uint32_t	writes;				/* write() calls */
+	int64_t		lat_p50_us;			/* write() latency percentiles */
+	int64_t		lat_p99_us;
+	int64_t		lat_max_us;
+	uint32_t	stalls;				/* writes over 100ms */
+	int			queued;				/* chunks waiting for the card now */
+} seg_recorder_stat_t;
+
+/* Segment numbering continues after the segments already in dir */
+seg_recorder_t *seg_recorder_create(const seg_recorder_attr_t *attr);
+
+/* Write what is buffered, close the segment. Returns -1 after any write error. */
+int seg_recorder_destroy(seg_recorder_t *rec);
+
+/*
+ * Called from one thread only. Returns 1 if the frame was dropped, -1
+ * without taking it once a segment write has failed.
+ */
+int seg_recorder_write(seg_recorder_t *rec, IMPEncoderStream *stream);
+int seg_recorder_write_iov(seg_recorder_t *rec, const struct iovec *iov, int iovcnt,
+		int key_frame, int64_t timestamp);
+
+/*
+ * Close the running segment and wait until it is on the card. Recording
+ * goes on in a new segment from the next IDR.
+ */
+void seg_recorder_flush(seg_recorder_t *rec);
+
+void seg_recorder_get_stat(seg_recorder_t *rec, seg_recorder_stat_t *stat);
+void seg_recorder_dump_stat(seg_recorder_t *rec);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_SEGMENT_RECORDER_H__ */
@@ -0,0 +1,406 @@
+/*
+ * sample-snap-service.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-stream-pump.h"
+#include "sample-snap-service.h"
+
+#define TAG "Sample-Snap-Service"
+
+/* Request latencies kept for the percentiles */
+#define SNAP_LAT_WINDOW		512
+
+struct snap_chn {
+	int					used;
+	int					encChn;
+	snap_t				*bufs;
+	snap_t				*latest;		/* holds a reference of its own */
+	int64_t				latest_at;		/* when it was copied */
+	int64_t				last_copy;
+	uint32_t			seq;
+	int					waiters;
+};
+
+struct snap_service {
+	snap_service_attr_t	attr;
+	int64_t				period_us;
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;
+	stream_pump_t		*pump;
+	pthread_t			thread;
+	int					running;
+	int					stopping;
+	struct snap_chn		chn[SNAP_SERVICE_MAX_CHN];
+
+	snap_service_stat_t	stat;
+	int64_t				lat[SNAP_LAT_WINDOW];
+	uint32_t			nr_lat;
+};
+
+static struct snap_chn *get_chn(snap_service_t *svc, int encChn)
+{
+	int i;
+
+	for (i = 0; i < SNAP_SERVICE_MAX_CHN; i++) {
+		if (svc->chn[i].used && svc->chn[i].encChn == encChn)
+			return &svc->chn[i];
+	}
+
+	return NULL;
+}
+
+static void put_locked(snap_service_t *svc, snap_t *snap)
+{
+	if (--snap->ref < 0) {
+		IMP_LOG_ERR(TAG, "chn%d: snapshot put twice\n", snap->encChn);
+		snap->ref = 0;
+	}
+}
+
+static void add_latency(snap_service_t *svc, int64_t us)
+{
+	svc->lat[svc->nr_lat++ % SNAP_LAT_WINDOW] = us;
+	if (us > svc->stat.lat_max_us)
+		svc->stat.lat_max_us = us;
+}
+
+/* Copies the picture into a free buffer; called with the mutex held */
+static int copy_stream(snap_service_t *svc, struct snap_chn *ch, IMPEncoderStream *stream)
+{
+	snap_t *snap = NULL;
+	uint32_t len = 0, off = 0;
+	void *buf;
+	int i;
+
+	for (i = 0; i < svc->attr.nr_bufs; i++) {
+		if (ch->bufs[i].ref == 0) {
+			snap = &ch->bufs[i];
+			break;
+		}
+	}
+	if (snap == NULL) {
+		svc->stat.skipped++;
+		return -1;
+	}
+
+	for (i = 0; i < stream->packCount; i++)
+		len += stream->pack[i].length;
+
+	if (snap->size < len) {
+		buf = realloc(snap->buf, len);
+		if (buf == NULL) {
+			IMP_LOG_ERR(TAG, "chn%d: realloc(%u) error !\n", ch->encChn, len);
+			svc->stat.skipped++;
+			return -1;
+		}
+		snap->buf = buf;
+		snap->size = len;
+	}
+
+	/* The buffer is ours alone, copy without holding up the requests */
+	snap->ref = 1;
+	pthread_mutex_unlock(&svc->mutex);
+	for (i = 0; i < stream->packCount; i++) {
+		memcpy((char *)snap->buf + off, (void *)(uintptr_t)stream->pack[i].virAddr, stream->pack[i].length);
+		off += stream->pack[i].length;
+	}
+	pthread_mutex_lock(&svc->mutex);
+
+	snap->encChn = ch->encChn;
+	snap->data = snap->buf;
+	snap->len = len;
+	snap->timestamp = stream->packCount ? stream->pack[0].timestamp : 0;
+	snap->seq = ++ch->seq;
+
+	if (ch->latest)
+		put_locked(svc, ch->latest);
+	ch->latest = snap;
+	ch->latest_at = IMP_System_GetTimeStamp();
+	svc->stat.pictures++;
+
+	return 0;
+}
+
+static int snap_pump_cb(int encChn, IMPEncoderStream *stream, void *priv)
+{
+	snap_service_t *svc = priv;
+	struct snap_chn *ch;
+	int64_t now;
+
+	if (stream == NULL)
+		return STREAM_PUMP_RELEASE;
+
+	now = IMP_System_GetTimeStamp();
+	pthread_mutex_lock(&svc->mutex);
+	ch = get_chn(svc, encChn);
+	/* Keep warm_fps pictures, or every one while somebody waits */
+	if (ch && (ch->waiters > 0 || now - ch->last_copy >= svc->period_us)) {
+		if (copy_stream(svc, ch, stream) == 0) {
+			ch->last_copy = now;
+			pthread_cond_broadcast(&svc->cond);
+		}
+	}
+	pthread_mutex_unlock(&svc->mutex);
+
+	return STREAM_PUMP_RELEASE;
+}
+
+static void *snap_thread(void *arg)
+{
+	snap_service_t *svc = arg;
+
+	if (stream_pump_run(svc->pump) < 0)
+		IMP_LOG_ERR(TAG, "stream pump failed\n");
+
+	pthread_mutex_lock(&svc->mutex);
+	svc->stopping = 1;
+	pthread_cond_broadcast(&svc->cond);
+	pthread_mutex_unlock(&svc->mutex);
+
+	return NULL;
+}
+
+snap_service_t *snap_service_create(const snap_service_attr_t *attr)
+{
+	snap_service_t *svc;
+	pthread_condattr_t cattr;
+
+	svc = calloc(1, sizeof(snap_service_t));
+	if (svc == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+
+	svc->attr = *attr;
+	if (svc->attr.warm_fps <= 0)
+		svc->attr.warm_fps = SNAP_WARM_FPS;
+	if (svc->attr.fresh_ms == 0)
+		svc->attr.fresh_ms = SNAP_FRESH_MS;
+	if (svc->attr.nr_bufs <= 0)
+		svc->attr.nr_bufs = SNAP_NR_BUFS;
+	svc->period_us = 1000000 / svc->attr.warm_fps;
+
+	svc->pump = stream_pump_create();
+	if (svc->pump == NULL) {
+		free(svc);
+		return NULL;
+	}
+
+	/* Request timeouts must not move with the wall clock */
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&svc->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+	pthread_mutex_init(&svc->mutex, NULL);
+
+	return svc;
+}
+
+void snap_service_destroy(snap_service_t *svc)
+{
+	struct snap_chn *ch;
+	int i, k;
+
+	if (svc->running) {
+		stream_pump_stop(svc->pump);
+		pthread_join(svc->thread, NULL);
+	}
+
+	for (i = 0; i < SNAP_SERVICE_MAX_CHN; i++) {
+		ch = &svc->chn[i];
+		if (!ch->used)
+			continue;
+		if (IMP_Encoder_StopRecvPic(ch->encChn) < 0)
+			IMP_LOG_ERR(TAG, "IMP_Encoder_StopRecvPic(%d) failed\n", ch->encChn);
+		if (ch->latest)
+			put_locked(svc, ch->latest);
+		for (k = 0; k < svc->attr.nr_bufs; k++) {
+			if (ch->bufs[k].ref)
+				IMP_LOG_WARN(TAG, "chn%d: snapshot %u still referenced\n", ch->encChn, ch->bufs[k].seq);
+			free(ch->bufs[k].buf);
+		}
+		free(ch->bufs);
+	}
+
+	stream_pump_destroy(svc->pump);
+	pthread_cond_destroy(&svc->cond);
+	pthread_mutex_destroy(&svc->mutex);
+	free(svc);
+}
+
+int snap_service_add_chn(snap_service_t *svc, int encChn)
+{
+	IMPEncoderFrmRate fr;
+	struct snap_chn *ch = NULL;
+	int i;
+
+	if (svc->running || get_chn(svc, encChn)) {
+		IMP_LOG_ERR(TAG, "chn%d: cannot be added\n", encChn);
+		return -1;
+	}
+	for (i = 0; i < SNAP_SERVICE_MAX_CHN; i++) {
+		if (!svc->chn[i].used) {
+			ch = &svc->chn[i];
+			break;
+		}
+	}
+	if (ch == NULL) {
+		IMP_LOG_ERR(TAG, "no room for chn%d\n", encChn);
+		return -1;
+	}
+
+	ch->bufs = calloc(svc->attr.nr_bufs, sizeof(snap_t));
+	if (ch->bufs == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return -1;
+	}
+
+	/* Fewer pictures to encode; the copies are paced by warm_fps anyway */
+	fr.frmRateNum = svc->attr.warm_fps;
+	fr.frmRateDen = 1;
+	if (IMP_Encoder_SetChnFrmRate(encChn, &fr) < 0)
+		IMP_LOG_WARN(TAG, "chn%d: IMP_Encoder_SetChnFrmRate() failed, encoding at full rate\n", encChn);
+
+	if (IMP_Encoder_StartRecvPic(encChn) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_StartRecvPic(%d) failed\n", encChn);
+		free(ch->bufs);
+		ch->bufs = NULL;
+		return -1;
+	}
+
+	if (stream_pump_add(svc->pump, encChn, 1000, snap_pump_cb, svc) < 0) {
+		IMP_Encoder_StopRecvPic(encChn);
+		free(ch->bufs);
+		ch->bufs = NULL;
+		return -1;
+	}
+
+	ch->encChn = encChn;
+	ch->used = 1;
+
+	return 0;
+}
+
+int snap_service_start(snap_service_t *svc)
+{
+	if (pthread_create(&svc->thread, NULL, snap_thread, svc) != 0) {
+		IMP_LOG_ERR(TAG, "pthread_create() failed\n");
+		return -1;
+	}
+	svc->running = 1;
+
+	return 0;
+}
+
+const snap_t *snap_service_get(snap_service_t *svc, int encChn, int max_age_ms, int timeout_ms)
+{
+	struct snap_chn *ch;
+	struct timespec ts;
+	int64_t t_req, max_age_us, deadline;
+	snap_t *snap = NULL;
+	uint32_t seq;
+	int ret = 0;
+
+	t_req = IMP_System_GetTimeStamp();
+	max_age_us = (int64_t)(max_age_ms < 0 ? (int)svc->attr.fresh_ms : max_age_ms) * 1000;
+
+	pthread_mutex_lock(&svc->mutex);
+	svc->stat.requests++;
+	ch = get_chn(svc, encChn);
+	if (ch == NULL) {
+		pthread_mutex_unlock(&svc->mutex);
+		IMP_LOG_ERR(TAG, "chn%d is not served\n", encChn);
+		return NULL;
+	}
+
+	if (ch->latest && t_req - ch->latest_at <= max_age_us) {
+		snap = ch->latest;
+		svc->stat.cached++;
+		goto found;
+	}
+
+	/* Wait for the next picture, together with whoever waits already */
+	if (ch->waiters > 0)
+		svc->stat.shared++;
+	ch->waiters++;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	deadline = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + (int64_t)timeout_ms * 1000000;
+	ts.tv_sec = deadline / 1000000000;
+	ts.tv_nsec = deadline % 1000000000;
+
+	seq = ch->seq;
+	while (ch->seq == seq && !svc->stopping && ret != ETIMEDOUT)
+		ret = pthread_cond_timedwait(&svc->cond, &svc->mutex, &ts);
+	ch->waiters--;
+
+	if (ch->seq == seq) {
+		svc->stat.timeouts++;
+		pthread_mutex_unlock(&svc->mutex);
+		return NULL;
+	}
+	snap = ch->latest;
+
+found:
+	snap->ref++;
+	add_latency(svc, IMP_System_GetTimeStamp() - t_req);
+	pthread_mutex_unlock(&svc->mutex);
+
+	return snap;
+}
+
+void snap_service_put(snap_service_t *svc, const snap_t *snap)
+{
+	pthread_mutex_lock(&svc->mutex);
+	put_locked(svc, (snap_t *)snap);
+	pthread_mutex_unlock(&svc->mutex);
+}
+
+static int cmp_lat(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+void snap_service_get_stat(snap_service_t *svc, snap_service_stat_t *stat)
+{
+	int64_t lat[SNAP_LAT_WINDOW];
+	uint32_t n;
+
+	pthread_mutex_lock(&svc->mutex);
+	*stat = svc->stat;
+	n = svc->nr_lat < SNAP_LAT_WINDOW ? svc->nr_lat : SNAP_LAT_WINDOW;
+	memcpy(lat, svc->lat, n * sizeof(int64_t));
+	pthread_mutex_unlock(&svc->mutex);
+
+	/* Over the last SNAP_LAT_WINDOW requests served */
+	if (n > 0) {
+		qsort(lat, n, sizeof(int64_t), cmp_lat);
+		stat->lat_p50_us = lat[(n - 1) * 50 / 100];
+		stat->lat_p99_us = lat[(n - 1) * 99 / 100];
+	}
+}
+
+void snap_service_dump_stat(snap_service_t *svc)
+{
+	snap_service_stat_t s;
+
+	snap_service_get_stat(svc, &s);
+	IMP_LOG_INFO(TAG, "%u requests: %u cached, %u shared, %u timeouts; %u pictures, %u skipped; "
+			"latency p50/p99/max %lld/%lld/%lld us\n",
+			s.requests, s.cached, s.shared, s.timeouts, s.pictures, s.skipped,
+			(long long)s.lat_p50_us, (long long)s.lat_p99_us, (long long)s.lat_max_us);
+}
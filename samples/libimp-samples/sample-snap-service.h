@@ -0,0 +1,98 @@
+/*
+ * sample-snap-service.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_SNAP_SERVICE_H__
+#define __SAMPLE_SNAP_SERVICE_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * JPEG snapshot service.
+ *
+ * The JPEG channels are started once and kept running at warm_fps from
+ * a stream pump in a thread of the service. The newest picture of each
+ * channel is kept in memory; a request gets it right away if it is no
+ * older than the request allows. Otherwise the request waits for the
+ * next picture, and every request waiting at that moment shares it.
+ *
+ * Pictures are handed out by reference from nr_bufs buffers per
+ * channel, allocated when first needed and grown with the pictures. A
+ * picture still referenced is never overwritten; if all buffers are
+ * referenced a new picture is skipped.
+ */
+
+#define SNAP_SERVICE_MAX_CHN	4
+#define SNAP_WARM_FPS			2
+#define SNAP_FRESH_MS			1000
+#define SNAP_NR_BUFS			4
+
+typedef struct snap_service snap_service_t;
+
+typedef struct snap_service_attr {
+	int			warm_fps;			/* 0: SNAP_WARM_FPS */
+	uint32_t	fresh_ms;			/* default max age of a picture, 0: SNAP_FRESH_MS */
+	int			nr_bufs;			/* per channel, 0: SNAP_NR_BUFS */
+} snap_service_attr_t;
+
+typedef struct snap {
+	int			encChn;
+	const void	*data;				/* the whole JPEG file */
+	uint32_t	len;
+	int64_t		timestamp;			/* encoder timestamp, us */
+	uint32_t	seq;
+
+	/* private */
+	void		*buf;
+	uint32_t	size;
+	int			ref;
+} snap_t;
+
+typedef struct snap_service_stat {
+	uint32_t	requests;
+	uint32_t	cached;				/* served at once from memory */
+	uint32_t	shared;				/* waited for a picture another request waited for too */
+	uint32_t	timeouts;
+	uint32_t	pictures;			/* copied to memory */
+	uint32_t	skipped;			/* no free buffer */
+	int64_t		lat_p50_us;			/* request -> picture */
+	int64_t		lat_p99_us;
+	int64_t		lat_max_us;
+} snap_service_stat_t;
+
+snap_service_t *snap_service_create(const snap_service_attr_t *attr);
+
+/* Stops the pump and the channels; every snapshot must have been put */
+void snap_service_destroy(snap_service_t *svc);
+
+/* Before snap_service_start(); starts the JPEG channel receiving pictures */
+int snap_service_add_chn(snap_service_t *svc, int encChn);
+int snap_service_start(snap_service_t *svc);
+
+/*
+ * A picture of encChn no older than max_age_ms (-1: fresh_ms), waiting
+ * up to timeout_ms for one. NULL on timeout. Give it back with
+ * snap_service_put().
+ */
+const snap_t *snap_service_get(snap_service_t *svc, int encChn, int max_age_ms, int timeout_ms);
+void snap_service_put(snap_service_t *svc, const snap_t *snap);
+
+void snap_service_get_stat(snap_service_t *svc, snap_service_stat_t *stat);
+void snap_service_dump_stat(snap_service_t *svc);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_SNAP_SERVICE_H__ */
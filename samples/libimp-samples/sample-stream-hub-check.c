@@ -0,0 +1,450 @@
+/*
+ * sample-stream-hub-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check for the encoder stream hub. Frames are published by hand
+ * and this file stands in for IMP_Encoder_ReleaseStream(), so every
+ * release is logged: each frame must go back exactly once, after its
+ * last reader, and in the order it was published; only a frame the hub
+ * refused may go back early. Covers two readers on one frame, the three
+ * drop policies on H264 GOPs and on JPEG, the GOP cache replayed to a
+ * late reader, its frame, byte and slot bounds, and slots held full.
+ *
+ * usage: sample-stream-hub-check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-h264-parse.h"
+#include "sample-stream-hub.h"
+
+#define TAG "Sample-Stream-Hub-Check"
+
+#define NR_FRAMES		128
+#define ENC_CHN			0
+#define FRAME_BYTES		1000
+
+static IMPEncoderPack packs[NR_FRAMES];
+static int released[NR_FRAMES];
+static int refused[NR_FRAMES];
+static int order[NR_FRAMES];
+static int nr_published, nr_order;
+static int errors;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		IMP_LOG_ERR(TAG, "line %d: %s\n", __LINE__, #cond); \
+		errors++; \
+	} \
+} while (0)
+
+int IMP_Encoder_ReleaseStream(int encChn, IMPEncoderStream *stream)
+{
+	int i = stream->pack - packs;
+
+	if (encChn != ENC_CHN || i < 0 || i >= nr_published || stream->packCount != 1) {
+		IMP_LOG_ERR(TAG, "release of a stream never published\n");
+		errors++;
+		return -1;
+	}
+	if (released[i]++)
+		IMP_LOG_ERR(TAG, "frame %d released twice\n", i), errors++;
+	order[nr_order++] = i;
+
+	return 0;
+}
+
+/* The hub is fed by hand, its thread is never started */
+int IMP_Encoder_PollingStream(int encChn, uint32_t timeoutMsec)
+{
+	return -1;
+}
+
+int IMP_Encoder_GetStream(int encChn, IMPEncoderStream *stream, bool blockFlag)
+{
+	return -1;
+}
+
+int IMP_Encoder_StartRecvPic(int encChn)
+{
+	return 0;
+}
+
+int IMP_Encoder_StopRecvPic(int encChn)
+{
+	return 0;
+}
+
+static int publish(stream_hub_t *hub, int key, uint32_t len)
+{
+	IMPEncoderPack *pack = &packs[nr_published];
+	IMPEncoderStream stream;
+	int i = nr_published, ret;
+
+	pack->virAddr = 0x10000000 + nr_published * 0x10000;
+	pack->phyAddr = 0x20000000 + nr_published * 0x10000;
+	pack->length = len;
+	pack->timestamp = (int64_t)nr_published * 40000;
+	pack->frameEnd = 1;
+	pack->dataType.h264Type = key ? IMP_H264_NAL_SLICE_IDR : (IMPEncoderH264NaluType)H264_NAL_SLICE;
+	stream.pack = pack;
+	stream.packCount = 1;
+	stream.seq = nr_published;
+	nr_published++;
+
+	ret = stream_hub_publish(hub, &stream);
+	if (ret < 0)
+		refused[i] = 1;
+
+	return ret;
+}
+
+/* Frame index of a hub frame */
+static int index_of(stream_hub_frame_t *frame)
+{
+	return frame ? frame->stream.pack - packs : -1;
+}
+
+static int get_index(stream_hub_sub_t *sub)
+{
+	stream_hub_frame_t *frame = stream_hub_get(sub, 0);
+	int i = index_of(frame);
+
+	if (frame)
+		stream_hub_put(sub, frame);
+
+	return i;
+}
+
+/* Two readers share every frame; it goes back after both, in order */
+static void check_shared(void)
+{
+	stream_hub_t *hub = stream_hub_create(ENC_CHN, PT_H264, 4);
+	stream_hub_sub_t *a = stream_hub_subscribe(hub, "record", 4, HUB_DROP_OLDEST);
+	stream_hub_sub_t *b = stream_hub_subscribe(hub, "rtsp", 4, HUB_DROP_OLDEST);
+	stream_hub_frame_t *fa[2], *fb[2];
+	stream_hub_stat_t stat;
+	int first = nr_published;
+
+	/* a new H264 reader waits for the IDR */
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(released[first] == 1);
+	CHECK(stream_hub_get(a, 0) == NULL);
+
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, 2 * FRAME_BYTES) == 0);
+	fa[0] = stream_hub_get(a, 0);
+	fa[1] = stream_hub_get(a, 0);
+	fb[0] = stream_hub_get(b, 0);
+	fb[1] = stream_hub_get(b, 0);
+	CHECK(fa[0] == fb[0] && fa[1] == fb[1]);
+	CHECK(index_of(fa[0]) == first + 1 && fa[0]->key_frame);
+	CHECK(index_of(fa[1]) == first + 2 && !fa[1]->key_frame);
+	CHECK(fa[1]->bytes == 2 * FRAME_BYTES);
+	CHECK(fa[1]->timestamp == packs[first + 2].timestamp);
+	CHECK(fa[1]->seq == fa[0]->seq + 1);
+
+	stream_hub_put(a, fa[0]);
+	stream_hub_put(a, fa[1]);
+	CHECK(!released[first + 1] && !released[first + 2]);
+	/* the newer frame is done first, it waits for the older one */
+	stream_hub_put(b, fb[1]);
+	CHECK(!released[first + 2]);
+	stream_hub_put(b, fb[0]);
+	CHECK(released[first + 1] == 1 && released[first + 2] == 1);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.in_flight == 0 && stat.max_in_flight == 2 && stat.frames == 3);
+
+	/* a frame with no reader goes back at once */
+	stream_hub_unsubscribe(a);
+	stream_hub_unsubscribe(b);
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(released[nr_published - 1] == 1);
+
+	stream_hub_destroy(hub);
+}
+
+/* OLDEST drops the whole oldest GOP */
+static void check_drop_oldest(void)
+{
+	stream_hub_t *hub = stream_hub_create(ENC_CHN, PT_H264, 8);
+	stream_hub_sub_t *sub = stream_hub_subscribe(hub, "slow", 4, HUB_DROP_OLDEST);
+	stream_hub_sub_stat_t stat;
+	int first = nr_published;
+
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(released[first] && released[first + 1] && released[first + 2]);
+	CHECK(get_index(sub) == first + 3);
+	CHECK(get_index(sub) == first + 4);
+	CHECK(get_index(sub) < 0);
+	stream_hub_get_sub_stat(sub, &stat);
+	CHECK(stat.dropped == 3 && stat.frames == 2 && stat.max_queued == 4);
+
+	stream_hub_unsubscribe(sub);
+	stream_hub_destroy(hub);
+}
+
+/* NEWEST drops the incoming frame and the rest of its GOP */
+static void check_drop_newest(void)
+{
+	stream_hub_t *hub = stream_hub_create(ENC_CHN, PT_H264, 8);
+	stream_hub_sub_t *sub = stream_hub_subscribe(hub, "slow", 2, HUB_DROP_NEWEST);
+	stream_hub_sub_stat_t stat;
+	int first = nr_published;
+
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	/* done with, but it waits for the frames queued before it */
+	CHECK(!released[first + 2]);
+	CHECK(get_index(sub) == first);
+	CHECK(get_index(sub) == first + 1);
+	CHECK(released[first + 2] == 1);
+	/* room again, but P3 belongs to the GOP that lost P2 */
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(get_index(sub) == first + 4);
+	stream_hub_get_sub_stat(sub, &stat);
+	CHECK(stat.dropped == 2 && stat.frames == 3);
+
+	stream_hub_unsubscribe(sub);
+	stream_hub_destroy(hub);
+}
+
+/* TO_IDR flushes the queue and resumes at the next key frame */
+static void check_drop_to_idr(void)
+{
+	stream_hub_t *hub = stream_hub_create(ENC_CHN, PT_H264, 8);
+	stream_hub_sub_t *sub = stream_hub_subscribe(hub, "slow", 2, HUB_DROP_TO_IDR);
+	stream_hub_sub_stat_t stat;
+	int first = nr_published;
+
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(released[first] && released[first + 1] && released[first + 2] && released[first + 3]);
+	CHECK(get_index(sub) < 0);
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	/* a key frame into a full queue replaces it */
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(get_index(sub) == first + 6);
+	CHECK(get_index(sub) < 0);
+	stream_hub_get_sub_stat(sub, &stat);
+	CHECK(stat.dropped == 6 && stat.frames == 1);
+
+	stream_hub_unsubscribe(sub);
+	stream_hub_destroy(hub);
+}
+
+/* Every JPEG frame stands alone: no IDR wait, one frame dropped at a time */
+static void check_jpeg(void)
+{
+	stream_hub_t *hub = stream_hub_create(ENC_CHN, PT_JPEG, 8);
+	stream_hub_sub_t *sub = stream_hub_subscribe(hub, "snap", 2, HUB_DROP_OLDEST);
+	stream_hub_sub_stat_t stat;
+	int first = nr_published;
+
+	CHECK(stream_hub_set_gop_cache(hub, 4, 0) < 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(released[first] == 1 && !released[first + 1]);
+	CHECK(get_index(sub) == first + 1);
+	CHECK(get_index(sub) == first + 2);
+	stream_hub_get_sub_stat(sub, &stat);
+	CHECK(stat.dropped == 1 && stat.frames == 2);
+
+	stream_hub_unsubscribe(sub);
+	stream_hub_destroy(hub);
+}
+
+/* A late reader starts from the cached GOP if it fits its queue */
+static void check_gop_cache(void)
+{
+	stream_hub_t *hub = stream_hub_create(ENC_CHN, PT_H264, 8);
+	stream_hub_sub_t *late, *short_q, *later;
+	stream_hub_sub_stat_t sstat;
+	stream_hub_stat_t stat;
+	int first = nr_published;
+
+	CHECK(stream_hub_set_gop_cache(hub, 4, 0) == 0);
+	/* nothing cached before the first IDR */
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(released[first] == 1);
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.cache_frames == 3 && stat.cache_bytes == 3 * FRAME_BYTES && stat.in_flight == 3);
+
+	late = stream_hub_subscribe(hub, "late", 4, HUB_DROP_OLDEST);
+	CHECK(get_index(late) == first + 1);
+	CHECK(get_index(late) == first + 2);
+	CHECK(get_index(late) == first + 3);
+	stream_hub_get_sub_stat(late, &sstat);
+	CHECK(sstat.replayed == 3 && sstat.frames == 3);
+	/* still held by the cache */
+	CHECK(!released[first + 1]);
+
+	short_q = stream_hub_subscribe(hub, "short", 2, HUB_DROP_OLDEST);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.cache_hits == 1 && stat.cache_misses == 1);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(get_index(short_q) < 0);
+	CHECK(get_index(late) == first + 4);
+
+	/* the GOP outgrows the cache, it empties until the next IDR */
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.cache_frames == 0 && stat.cache_overflows == 1);
+	CHECK(released[first + 1] && released[first + 4]);
+	later = stream_hub_subscribe(hub, "later", 4, HUB_DROP_OLDEST);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.cache_misses == 2);
+	CHECK(get_index(later) < 0);
+
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(get_index(short_q) == first + 6);
+	CHECK(get_index(later) == first + 6);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.cache_frames == 1);
+
+	stream_hub_unsubscribe(late);
+	stream_hub_unsubscribe(short_q);
+	stream_hub_unsubscribe(later);
+	stream_hub_destroy(hub);
+}
+
+/* The cache keeps to its byte bound, and to one slot less than the hub */
+static void check_gop_cache_bounds(void)
+{
+	stream_hub_t *hub = stream_hub_create(ENC_CHN, PT_H264, 8);
+	stream_hub_stat_t stat;
+
+	CHECK(stream_hub_set_gop_cache(hub, 7, 3 * FRAME_BYTES) == 0);
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.cache_frames == 3 && stat.cache_overflows == 0);
+	CHECK(publish(hub, 0, 1) == 0);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.cache_frames == 0 && stat.cache_overflows == 1 && stat.in_flight == 0);
+	stream_hub_destroy(hub);
+
+	hub = stream_hub_create(ENC_CHN, PT_H264, 4);
+	CHECK(stream_hub_set_gop_cache(hub, 16, 0) == 0);
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.cache_frames == 3 && stat.in_flight == 3);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.cache_frames == 0 && stat.cache_overflows == 1 && stat.overruns == 0);
+	stream_hub_destroy(hub);
+}
+
+/*
+ * With every slot busy the cache goes first, then queued frames; a hub
+ * held full by a reader loses the new frame for everyone.
+ */
+static void check_full(void)
+{
+	stream_hub_t *hub = stream_hub_create(ENC_CHN, PT_H264, 2);
+	stream_hub_sub_t *lazy = stream_hub_subscribe(hub, "lazy", 2, HUB_DROP_OLDEST);
+	stream_hub_sub_t *hog;
+	stream_hub_frame_t *held;
+	stream_hub_sub_stat_t sstat;
+	stream_hub_stat_t stat;
+	int first = nr_published;
+
+	/* queued frames nobody started on are reclaimed */
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(released[first] && released[first + 1]);
+	CHECK(get_index(lazy) == first + 2);
+	stream_hub_get_sub_stat(lazy, &sstat);
+	CHECK(sstat.dropped == 2);
+	stream_hub_unsubscribe(lazy);
+	stream_hub_destroy(hub);
+
+	hub = stream_hub_create(ENC_CHN, PT_H264, 4);
+	CHECK(stream_hub_set_gop_cache(hub, 3, 0) == 0);
+	hog = stream_hub_subscribe(hub, "hog", 4, HUB_DROP_OLDEST);
+	first = nr_published;
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	held = stream_hub_get(hog, 0);
+	CHECK(index_of(held) == first);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.in_flight == 4 && stat.cache_frames == 1);
+
+	/* the cache and hog's queue are given up, I0 still blocks the slots */
+	CHECK(publish(hub, 0, FRAME_BYTES) < 0);
+	CHECK(released[first + 4] == 1 && !released[first + 1]);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.cache_overflows == 1 && stat.overruns == 1 && stat.cache_frames == 0);
+	stream_hub_get_sub_stat(hog, &sstat);
+	CHECK(sstat.dropped == 3 && sstat.queued == 0);
+
+	stream_hub_put(hog, held);
+	CHECK(released[first + 1] && released[first + 2] && released[first + 3]);
+	stream_hub_get_stat(hub, &stat);
+	CHECK(stat.in_flight == 0);
+	/* hog waits for the next IDR */
+	CHECK(publish(hub, 0, FRAME_BYTES) == 0);
+	CHECK(get_index(hog) < 0);
+	CHECK(publish(hub, 1, FRAME_BYTES) == 0);
+	CHECK(get_index(hog) == first + 6);
+
+	stream_hub_unsubscribe(hog);
+	stream_hub_destroy(hub);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, last = -1;
+
+	check_shared();
+	check_drop_oldest();
+	check_drop_newest();
+	check_drop_to_idr();
+	check_jpeg();
+	check_gop_cache();
+	check_gop_cache_bounds();
+	check_full();
+
+	/* every frame back exactly once, those the hub took in publish order */
+	for (i = 0; i < nr_published; i++)
+		CHECK(released[i] == 1);
+	for (i = 0; i < nr_order; i++) {
+		if (refused[order[i]])
+			continue;
+		CHECK(order[i] > last);
+		last = order[i];
+	}
+	printf("%d frames published, %d released\n", nr_published, nr_order);
+
+	if (errors)
+		return -1;
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,615 @@
+/*
+ * sample-stream-hub.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-stream-hub.h"
+#include "sample-h264-parse.h"
+
+#define TAG "Sample-Stream-Hub"
+
+#define HUB_POLLING_TIMEOUT_MS	100
+
+struct held_frame {
+	stream_hub_frame_t	*frame;
+	int64_t				t_get;
+};
+
+struct stream_hub_sub {
+	stream_hub_t		*hub;
+	char				name[32];
+	stream_hub_drop_policy_t policy;
+	int					wait_idr;
+
+	stream_hub_frame_t	**queue;
+	int					queue_len;
+	int					q_head;
+	int					q_count;
+
+	struct held_frame	*held;		/* hub->max_frames entries */
+	int64_t				t_subscribe;
+	pthread_cond_t		cond;
+	stream_hub_sub_stat_t stat;
+};
+
+struct stream_hub {
+	int					encChn;
+	IMPPayloadType		enType;
+
+	stream_hub_frame_t	*slot;
+	int					max_frames;
+	int					s_head;		/* oldest frame not yet released */
+	int					nr_inflight;
+	uint32_t			seq;
+
+	stream_hub_frame_t	**cache;	/* IDR first, empty while waiting for one */
+	int					cache_max;
+	uint32_t			cache_max_bytes;
+	int					cache_count;
+	uint32_t			cache_bytes;
+
+	stream_hub_sub_t	*sub[STREAM_HUB_MAX_SUBSCRIBERS];
+
+	pthread_mutex_t		mutex;
+	pthread_t			tid;
+	int					running;
+	int					stop;
+	stream_hub_stat_t	stat;
+};
+
+/* Called with hub->mutex held */
+static void frame_unref(stream_hub_t *hub, stream_hub_frame_t *frame)
+{
+	stream_hub_frame_t *head;
+
+	if (--frame->ref > 0)
+		return;
+
+	/* The encoder gets its buffers back in the order it handed them out */
+	while (hub->nr_inflight) {
+		head = &hub->slot[hub->s_head];
+		if (head->ref > 0)
+			break;
+		IMP_Encoder_ReleaseStream(hub->encChn, &head->stream);
+		head->busy = 0;
+		hub->s_head = (hub->s_head + 1) % hub->max_frames;
+		hub->nr_inflight--;
+	}
+}
+
+/* Called with hub->mutex held */
+static void cache_clear(stream_hub_t *hub)
+{
+	int i;
+
+	for (i = 0; i < hub->cache_count; i++)
+		frame_unref(hub, hub->cache[i]);
+	hub->cache_count = 0;
+	hub->cache_bytes = 0;
+}
+
+static void cache_add(stream_hub_t *hub, stream_hub_frame_t *frame)
+{
+	if (frame->key_frame) {
+		cache_clear(hub);
+	} else if (hub->cache_count == 0) {
+		return;
+	} else if (hub->cache_count == hub->cache_max
+			|| (hub->cache_max_bytes && hub->cache_bytes + frame->bytes > hub->cache_max_bytes)) {
+		cache_clear(hub);
+		hub->stat.cache_overflows++;
+		return;
+	}
+
+	frame->ref++;
+	hub->cache[hub->cache_count++] = frame;
+	hub->cache_bytes += frame->bytes;
+}
+
+static stream_hub_frame_t *sub_pop(stream_hub_sub_t *sub)
+{
+	stream_hub_frame_t *frame = sub->queue[sub->q_head];
+
+	sub->q_head = (sub->q_head + 1) % sub->queue_len;
+	sub->q_count--;
+
+	return frame;
+}
+
+static void sub_drop_head(stream_hub_sub_t *sub)
+{
+	sub->stat.dropped++;
+	frame_unref(sub->hub, sub_pop(sub));
+}
+
+/*
+ * Make room in a full queue. For H264 a P-frame is useless without the
+ * frames before it, so OLDEST drops the whole oldest GOP, and NEWEST
+ * drops everything up to the next key frame.
+ */
+static int sub_make_room(stream_hub_sub_t *sub, stream_hub_frame_t *frame)
+{
+	int h264 = (sub->hub->enType == PT_H264);
+
+	switch (sub->policy) {
+	case HUB_DROP_OLDEST:
+		sub_drop_head(sub);
+		while (h264 && sub->q_count && !sub->queue[sub->q_head]->key_frame)
+			sub_drop_head(sub);
+		if (h264 && sub->q_count == 0 && !frame->key_frame) {
+			sub->wait_idr = 1;
+			return -1;
+		}
+		return 0;
+	case HUB_DROP_NEWEST:
+		if (h264)
+			sub->wait_idr = 1;
+		return -1;
+	case HUB_DROP_TO_IDR:
+	default:
+		while (sub->q_count)
+			sub_drop_head(sub);
+		if (!frame->key_frame) {
+			sub->wait_idr = 1;
+			return -1;
+		}
+		return 0;
+	}
+}
+
+static void sub_deliver(stream_hub_sub_t *sub, stream_hub_frame_t *frame)
+{
+	if (sub->wait_idr) {
+		if (!frame->key_frame) {
+			sub->stat.dropped++;
+			return;
+		}
+		sub->wait_idr = 0;
+	}
+
+	if (sub->q_count == sub->queue_len && sub_make_room(sub, frame) < 0) {
+		sub->stat.dropped++;
+		return;
+	}
+
+	frame->ref++;
+	sub->queue[(sub->q_head + sub->q_count) % sub->queue_len] = frame;
+	sub->q_count++;
+	if (sub->q_count > sub->stat.max_queued)
+		sub->stat.max_queued = sub->q_count;
+	pthread_cond_signal(&sub->cond);
+}
+
+int stream_hub_publish(stream_hub_t *hub, IMPEncoderStream *stream)
+{
+	stream_hub_frame_t *frame;
+	int i;
+
+	pthread_mutex_lock(&hub->mutex);
+	/* The cache is the cheapest to lose, late joiners wait for the IDR */
+	if (hub->nr_inflight == hub->max_frames && hub->cache_count) {
+		cache_clear(hub);
+		hub->stat.cache_overflows++;
+	}
+	if (hub->nr_inflight == hub->max_frames) {
+		/* Reclaim frames nobody has started on yet */
+		for (i = 0; i < STREAM_HUB_MAX_SUBSCRIBERS; i++) {
+			if (hub->sub[i] && hub->sub[i]->q_count) {
+				sub_drop_head(hub->sub[i]);
+				if (hub->enType == PT_H264)
+					hub->sub[i]->wait_idr = 1;
+				while (hub->sub[i]->q_count && hub->enType == PT_H264)
+					sub_drop_head(hub->sub[i]);
+			}
+		}
+	}
+
+	if (hub->nr_inflight == hub->max_frames) {
+		/* Every slot is held by a subscriber, the frame is lost for all */
+		IMP_Encoder_ReleaseStream(hub->encChn, stream);
+		hub->stat.overruns++;
+		for (i = 0; i < STREAM_HUB_MAX_SUBSCRIBERS; i++) {
+			if (hub->sub[i] && hub->enType == PT_H264)
+				hub->sub[i]->wait_idr = 1;
+		}
+		pthread_mutex_unlock(&hub->mutex);
+		return -1;
+	}
+
+	frame = &hub->slot[(hub->s_head + hub->nr_inflight) % hub->max_frames];
+	frame->stream = *stream;
+	frame->key_frame = (hub->enType == PT_H264) ? h264_stream_is_key_frame(stream) : 1;
+	frame->timestamp = stream->packCount ? stream->pack[0].timestamp : 0;
+	frame->bytes = 0;
+	for (i = 0; i < stream->packCount; i++)
+		frame->bytes += stream->pack[i].length;
+	frame->seq = hub->seq++;
+	frame->ref = 1;
+	frame->busy = 1;
+	hub->nr_inflight++;
+	hub->stat.frames++;
+	if (hub->nr_inflight > hub->stat.max_in_flight)
+		hub->stat.max_in_flight = hub->nr_inflight;
+
+	for (i = 0; i < STREAM_HUB_MAX_SUBSCRIBERS; i++) {
+		if (hub->sub[i])
+			sub_deliver(hub->sub[i], frame);
+	}
+	if (hub->cache_max)
+		cache_add(hub, frame);
+
+	/* Drop the hub's own reference, releases at once if nobody took it */
+	frame_unref(hub, frame);
+	pthread_mutex_unlock(&hub->mutex);
+
+	return 0;
+}
+
+static void *hub_thread(void *arg)
+{
+	stream_hub_t *hub = (stream_hub_t *)arg;
+	IMPEncoderStream stream;
+	int ret;
+
+	while (!hub->stop) {
+		ret = IMP_Encoder_PollingStream(hub->encChn, HUB_POLLING_TIMEOUT_MS);
+		if (ret < 0)
+			continue;
+
+		ret = IMP_Encoder_GetStream(hub->encChn, &stream, 1);
+		if (ret < 0) {
+			IMP_LOG_ERR(TAG, "IMP_Encoder_GetStream(%d) failed\n", hub->encChn);
+			continue;
+		}
+
+		stream_hub_publish(hub, &stream);
+	}
+
+	return NULL;
+}
+
+stream_hub_t *stream_hub_create(int encChn, IMPPayloadType enType, int max_frames)
+{
+	stream_hub_t *hub;
+
+	hub = calloc(1, sizeof(stream_hub_t));
+	if (hub == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+
+	hub->encChn = encChn;
+	hub->enType = enType;
+	hub->max_frames = max_frames > 0 ? max_frames : STREAM_HUB_MAX_FRAMES;
+	hub->slot = calloc(hub->max_frames, sizeof(stream_hub_frame_t));
+	if (hub->slot == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() slots error !\n");
+		free(hub);
+		return NULL;
+	}
+
+	pthread_mutex_init(&hub->mutex, NULL);
+
+	return hub;
+}
+
+int stream_hub_set_gop_cache(stream_hub_t *hub, int cache_frames, uint32_t cache_bytes)
+{
+	stream_hub_frame_t **cache = NULL;
+
+	if (hub->enType != PT_H264) {
+		IMP_LOG_ERR(TAG, "chn%d: GOP cache is for H264 only\n", hub->encChn);
+		return -1;
+	}
+	/* a slot must stay free for the next frame */
+	if (cache_frames >= hub->max_frames)
+		cache_frames = hub->max_frames - 1;
+	if (cache_frames > 0) {
+		cache = calloc(cache_frames, sizeof(stream_hub_frame_t *));
+		if (cache == NULL) {
+			IMP_LOG_ERR(TAG, "calloc() cache error !\n");
+			return -1;
+		}
+	}
+
+	pthread_mutex_lock(&hub->mutex);
+	cache_clear(hub);
+	free(hub->cache);
+	hub->cache = cache;
+	hub->cache_max = cache_frames > 0 ? cache_frames : 0;
+	hub->cache_max_bytes = cache_bytes;
+	pthread_mutex_unlock(&hub->mutex);
+
+	return 0;
+}
+
+int stream_hub_start(stream_hub_t *hub)
+{
+	int ret;
+
+	ret = IMP_Encoder_StartRecvPic(hub->encChn);
+	if (ret < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_StartRecvPic(%d) failed\n", hub->encChn);
+		return -1;
+	}
+
+	hub->stop = 0;
+	if (pthread_create(&hub->tid, NULL, hub_thread, hub)) {
+		IMP_LOG_ERR(TAG, "create hub thread failed\n");
+		IMP_Encoder_StopRecvPic(hub->encChn);
+		return -1;
+	}
+	hub->running = 1;
+
+	return 0;
+}
+
+int stream_hub_stop(stream_hub_t *hub)
+{
+	int i;
+
+	if (!hub->running)
+		return 0;
+
+	hub->stop = 1;
+	pthread_join(hub->tid, NULL);
+	hub->running = 0;
+
+	pthread_mutex_lock(&hub->mutex);
+	for (i = 0; i < STREAM_HUB_MAX_SUBSCRIBERS; i++) {
+		if (hub->sub[i])
+			pthread_cond_broadcast(&hub->sub[i]->cond);
+	}
+	pthread_mutex_unlock(&hub->mutex);
+
+	if (IMP_Encoder_StopRecvPic(hub->encChn) < 0) {
+		IMP_LOG_ERR(TAG, "IMP_Encoder_StopRecvPic(%d) failed\n", hub->encChn);
+		return -1;
+	}
+
+	return 0;
+}
+
+int stream_hub_destroy(stream_hub_t *hub)
+{
+	int i;
+
+	stream_hub_stop(hub);
+
+	for (i = 0; i < STREAM_HUB_MAX_SUBSCRIBERS; i++) {
+		if (hub->sub[i])
+			stream_hub_unsubscribe(hub->sub[i]);
+	}
+
+	pthread_mutex_lock(&hub->mutex);
+	cache_clear(hub);
+	pthread_mutex_unlock(&hub->mutex);
+
+	if (hub->nr_inflight)
+		IMP_LOG_ERR(TAG, "chn%d: %d frames still held at destroy\n", hub->encChn, hub->nr_inflight);
+	while (hub->nr_inflight) {
+		IMP_Encoder_ReleaseStream(hub->encChn, &hub->slot[hub->s_head].stream);
+		hub->s_head = (hub->s_head + 1) % hub->max_frames;
+		hub->nr_inflight--;
+	}
+
+	pthread_mutex_destroy(&hub->mutex);
+	free(hub->cache);
+	free(hub->slot);
+	free(hub);
+
+	return 0;
+}
+
+stream_hub_sub_t *stream_hub_subscribe(stream_hub_t *hub, const char *name,
+		int queue_len, stream_hub_drop_policy_t policy)
+{
+	stream_hub_sub_t *sub;
+	int i, n;
+
+	if (queue_len <= 0 || queue_len > hub->max_frames)
+		queue_len = hub->max_frames;
+
+	sub = calloc(1, sizeof(stream_hub_sub_t));
+	if (sub == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+	sub->queue = calloc(queue_len, sizeof(stream_hub_frame_t *));
+	sub->held = calloc(hub->max_frames, sizeof(struct held_frame));
+	if (sub->queue == NULL || sub->held == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() queue error !\n");
+		goto err_calloc;
+	}
+
+	sub->hub = hub;
+	snprintf(sub->name, sizeof(sub->name), "%s", name);
+	sub->queue_len = queue_len;
+	sub->policy = policy;
+	/* A late joiner cannot decode anything before the next IDR */
+	sub->wait_idr = (hub->enType == PT_H264);
+	sub->stat.first_frame_us = -1;
+	sub->t_subscribe = IMP_System_GetTimeStamp();
+	pthread_cond_init(&sub->cond, NULL);
+
+	pthread_mutex_lock(&hub->mutex);
+	for (i = 0; i < STREAM_HUB_MAX_SUBSCRIBERS; i++) {
+		if (hub->sub[i] == NULL) {
+			hub->sub[i] = sub;
+			break;
+		}
+	}
+	/* unless the GOP so far is cached and fits in its queue */
+	if (i < STREAM_HUB_MAX_SUBSCRIBERS && hub->cache_max) {
+		if (hub->cache_count && hub->cache_count <= queue_len) {
+			for (n = 0; n < hub->cache_count; n++) {
+				hub->cache[n]->ref++;
+				sub->queue[n] = hub->cache[n];
+			}
+			sub->q_count = sub->stat.max_queued = sub->stat.replayed = hub->cache_count;
+			sub->wait_idr = 0;
+			hub->stat.cache_hits++;
+		} else {
+			hub->stat.cache_misses++;
+		}
+	}
+	pthread_mutex_unlock(&hub->mutex);
+
+	if (i == STREAM_HUB_MAX_SUBSCRIBERS) {
+		IMP_LOG_ERR(TAG, "chn%d: too many subscribers\n", hub->encChn);
+		pthread_cond_destroy(&sub->cond);
+		goto err_calloc;
+	}
+
+	return sub;
+
+err_calloc:
+	free(sub->held);
+	free(sub->queue);
+	free(sub);
+	return NULL;
+}
+
+void stream_hub_unsubscribe(stream_hub_sub_t *sub)
+{
+	stream_hub_t *hub = sub->hub;
+	int i;
+
+	pthread_mutex_lock(&hub->mutex);
+	for (i = 0; i < STREAM_HUB_MAX_SUBSCRIBERS; i++) {
+		if (hub->sub[i] == sub)
+			hub->sub[i] = NULL;
+	}
+	while (sub->q_count)
+		frame_unref(hub, sub_pop(sub));
+	for (i = 0; i < hub->max_frames; i++) {
+		if (sub->held[i].frame) {
+			IMP_LOG_WARN(TAG, "%s: frame %u not put before unsubscribe\n",
+					sub->name, sub->held[i].frame->seq);
+			frame_unref(hub, sub->held[i].frame);
+		}
+	}
+	pthread_mutex_unlock(&hub->mutex);
+
+	pthread_cond_destroy(&sub->cond);
+	free(sub->held);
+	free(sub->queue);
+	free(sub);
+}
+
+stream_hub_frame_t *stream_hub_get(stream_hub_sub_t *sub, int timeout_ms)
+{
+	stream_hub_t *hub = sub->hub;
+	stream_hub_frame_t *frame = NULL;
+	struct timespec ts;
+	int i, ret = 0;
+
+	if (timeout_ms >= 0) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += timeout_ms / 1000;
+		ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock(&hub->mutex);
+	while (sub->q_count == 0 && !hub->stop && ret != ETIMEDOUT) {
+		if (timeout_ms >= 0)
+			ret = pthread_cond_timedwait(&sub->cond, &hub->mutex, &ts);
+		else
+			pthread_cond_wait(&sub->cond, &hub->mutex);
+	}
+
+	if (sub->q_count) {
+		frame = sub_pop(sub);
+		for (i = 0; i < hub->max_frames; i++) {
+			if (sub->held[i].frame == NULL) {
+				sub->held[i].frame = frame;
+				sub->held[i].t_get = IMP_System_GetTimeStamp();
+				break;
+			}
+		}
+		if (sub->stat.frames++ == 0)
+			sub->stat.first_frame_us = IMP_System_GetTimeStamp() - sub->t_subscribe;
+	}
+	pthread_mutex_unlock(&hub->mutex);
+
+	return frame;
+}
+
+void stream_hub_put(stream_hub_sub_t *sub, stream_hub_frame_t *frame)
+{
+	stream_hub_t *hub = sub->hub;
+	int64_t hold;
+	int i;
+
+	pthread_mutex_lock(&hub->mutex);
+	for (i = 0; i < hub->max_frames; i++) {
+		if (sub->held[i].frame == frame) {
+			hold = IMP_System_GetTimeStamp() - sub->held[i].t_get;
+			if (hold > sub->stat.max_hold_us)
+				sub->stat.max_hold_us = hold;
+			sub->held[i].frame = NULL;
+			break;
+		}
+	}
+	frame_unref(hub, frame);
+	pthread_mutex_unlock(&hub->mutex);
+}
+
+void stream_hub_get_stat(stream_hub_t *hub, stream_hub_stat_t *stat)
+{
+	pthread_mutex_lock(&hub->mutex);
+	*stat = hub->stat;
+	stat->in_flight = hub->nr_inflight;
+	stat->cache_frames = hub->cache_count;
+	stat->cache_bytes = hub->cache_bytes;
+	pthread_mutex_unlock(&hub->mutex);
+}
+
+void stream_hub_get_sub_stat(stream_hub_sub_t *sub, stream_hub_sub_stat_t *stat)
+{
+	pthread_mutex_lock(&sub->hub->mutex);
+	*stat = sub->stat;
+	stat->queued = sub->q_count;
+	pthread_mutex_unlock(&sub->hub->mutex);
+}
+
+void stream_hub_dump_stat(stream_hub_t *hub)
+{
+	int i;
+
+	pthread_mutex_lock(&hub->mutex);
+	IMP_LOG_INFO(TAG, "chn%d: %u frames, %u overruns, %d in flight (max %u of %d)\n",
+			hub->encChn, hub->stat.frames, hub->stat.overruns, hub->nr_inflight,
+			hub->stat.max_in_flight, hub->max_frames);
+	if (hub->cache_max)
+		IMP_LOG_INFO(TAG, "  GOP cache: %d frames, %u bytes; %u hits, %u misses, %u overflows\n",
+				hub->cache_count, hub->cache_bytes, hub->stat.cache_hits,
+				hub->stat.cache_misses, hub->stat.cache_overflows);
+	for (i = 0; i < STREAM_HUB_MAX_SUBSCRIBERS; i++) {
+		stream_hub_sub_t *sub = hub->sub[i];
+		if (sub == NULL)
+			continue;
+		IMP_LOG_INFO(TAG, "  %s: %u frames, %u dropped, %d queued (max %u of %d), max hold %lld us, "
+				"first frame after %lld us (%u replayed)\n",
+				sub->name, sub->stat.frames, sub->stat.dropped, sub->q_count,
+				sub->stat.max_queued, sub->queue_len, (long long)sub->stat.max_hold_us,
+				(long long)sub->stat.first_frame_us, sub->stat.replayed);
+	}
+	pthread_mutex_unlock(&hub->mutex);
+}
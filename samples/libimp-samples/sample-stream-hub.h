@@ -0,0 +1,136 @@
+/*
+ * sample-stream-hub.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_STREAM_HUB_H__
+#define __SAMPLE_STREAM_HUB_H__
+
+#include <stdint.h>
+#include <imp/imp_common.h>
+#include <imp/imp_encoder.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Encoder stream hub.
+ *
+ * Gets every IMPEncoderStream of one encoder channel once and hands it,
+ * without copying, to any number of subscribers (recorder, network,
+ * pre-event buffer...). Each frame carries a reference count; the frame
+ * is given back with IMP_Encoder_ReleaseStream() once the last subscriber
+ * has put it. Frames are released in the order they were taken.
+ *
+ * A subscriber owns a bounded queue. When it is full the subscriber's
+ * drop policy decides what goes, so a slow subscriber loses frames but
+ * never stalls the encoder or the other subscribers.
+ *
+ * With the GOP cache on, the hub also keeps references to the last
+ * SPS/PPS/IDR frame and the P frames after it. A new H264 subscriber gets
+ * them queued at once and decodes right away instead of waiting up to a
+ * GOP for the next IDR; the first frames it gets are then up to a GOP
+ * old. The cache holds at most cache_frames frames and cache_bytes bytes
+ * of encoder buffer: a GOP growing past that empties it until the next
+ * IDR, and so does the hub running out of slots.
+ */
+
+#define STREAM_HUB_MAX_FRAMES		16	/* default frames held at once */
+#define STREAM_HUB_MAX_SUBSCRIBERS	8
+
+typedef enum {
+	HUB_DROP_OLDEST,		/* discard the oldest queued frame */
+	HUB_DROP_NEWEST,		/* discard the incoming frame */
+	HUB_DROP_TO_IDR,		/* flush the queue, resume at the next key frame */
+} stream_hub_drop_policy_t;
+
+typedef struct stream_hub stream_hub_t;
+typedef struct stream_hub_sub stream_hub_sub_t;
+
+typedef struct stream_hub_frame {
+	IMPEncoderStream	stream;		/* packs point into the encoder buffer */
+	int					key_frame;	/* IDR/SPS for H264, always 1 for JPEG */
+	int64_t				timestamp;	/* timestamp of the first pack */
+	uint32_t			bytes;		/* sum of all pack lengths */
+	uint32_t			seq;		/* hub sequence number */
+
+	/* private */
+	stream_hub_t		*hub;
+	int					ref;
+	int					busy;
+} stream_hub_frame_t;
+
+typedef struct stream_hub_sub_stat {
+	uint32_t	frames;				/* frames delivered */
+	uint32_t	dropped;			/* frames lost to the drop policy */
+	uint32_t	queued;				/* frames waiting now */
+	uint32_t	max_queued;			/* high-water mark */
+	int64_t		max_hold_us;		/* longest get -> put interval */
+	uint32_t	replayed;			/* frames queued from the GOP cache at subscribe */
+	int64_t		first_frame_us;		/* subscribe -> first frame got, -1: none yet */
+} stream_hub_sub_stat_t;
+
+typedef struct stream_hub_stat {
+	uint32_t	frames;				/* frames taken from the encoder */
+	uint32_t	overruns;			/* frames released unseen, all slots busy */
+	uint32_t	in_flight;			/* frames held now */
+	uint32_t	max_in_flight;		/* high-water mark */
+	uint32_t	cache_frames;		/* in the GOP cache now */
+	uint32_t	cache_bytes;
+	uint32_t	cache_hits;			/* subscribers started from the cache */
+	uint32_t	cache_misses;		/* subscribers left to wait for an IDR */
+	uint32_t	cache_overflows;	/* GOPs that did not fit */
+} stream_hub_stat_t;
+
+/*
+ * max_frames bounds how many encoder frames the hub keeps at once, it
+ * must stay below what the channel's stream buffer can hold.
+ */
+stream_hub_t *stream_hub_create(int encChn, IMPPayloadType enType, int max_frames);
+int stream_hub_destroy(stream_hub_t *hub);
+
+/*
+ * Keep the current GOP for late subscribers, H264 only. cache_frames is
+ * capped below max_frames; cache_bytes 0 means no byte bound. Subscribers
+ * whose queue is shorter than the cached GOP wait for the IDR as before.
+ */
+int stream_hub_set_gop_cache(stream_hub_t *hub, int cache_frames, uint32_t cache_bytes);
+
+/* Run the GetStream loop in a thread of the hub */
+int stream_hub_start(stream_hub_t *hub);
+int stream_hub_stop(stream_hub_t *hub);
+
+/*
+ * Hand a stream obtained elsewhere to the hub, which then owns it and
+ * releases it. Returns -1 if the stream had to be released right away.
+ */
+int stream_hub_publish(stream_hub_t *hub, IMPEncoderStream *stream);
+
+stream_hub_sub_t *stream_hub_subscribe(stream_hub_t *hub, const char *name,
+		int queue_len, stream_hub_drop_policy_t policy);
+void stream_hub_unsubscribe(stream_hub_sub_t *sub);
+
+/*
+ * Wait up to timeout_ms (-1 forever) for the next frame. Returns NULL on
+ * timeout or when the hub stops. Every frame returned must be given back
+ * with stream_hub_put().
+ */
+stream_hub_frame_t *stream_hub_get(stream_hub_sub_t *sub, int timeout_ms);
+void stream_hub_put(stream_hub_sub_t *sub, stream_hub_frame_t *frame);
+
+void stream_hub_get_stat(stream_hub_t *hub, stream_hub_stat_t *stat);
+void stream_hub_get_sub_stat(stream_hub_sub_t *sub, stream_hub_sub_stat_t *stat);
+void stream_hub_dump_stat(stream_hub_t *hub);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_STREAM_HUB_H__ */
@@ -0,0 +1,310 @@
+/*
+ * sample-stream-pump.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-stream-pump.h"
+
+#define TAG "Sample-Stream-Pump"
+
+struct pump_chn {
+	int					active;
+	int					encChn;
+	int64_t				deadline_us;
+	int64_t				next_deadline;
+	int64_t				last_frame;
+	int64_t				interval_us;	/* running average between two streams */
+	int64_t				last_release;
+	stream_pump_cb_t	cb;
+	void				*priv;
+	stream_pump_stat_t	stat;
+};
+
+struct stream_pump {
+	struct pump_chn		chn[STREAM_PUMP_MAX_CHANNELS];
+	int					nr_chn;
+	int					nr_active;
+	int					rr;
+	int					max_block_ms;
+	volatile int		stop;
+	enc_telemetry_t		*tel;
+};
+
+stream_pump_t *stream_pump_create(void)
+{
+	stream_pump_t *pump;
+
+	pump = calloc(1, sizeof(stream_pump_t));
+	if (pump == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+	/* cleared here only, so a stop that comes before run is not lost */
+	pump->stop = 0;
+
+	return pump;
+}
+
+void stream_pump_destroy(stream_pump_t *pump)
+{
+	free(pump);
+}
+
+static struct pump_chn *find_chn(stream_pump_t *pump, int encChn)
+{
+	int i;
+
+	for (i = 0; i < pump->nr_chn; i++) {
+		if (pump->chn[i].active && pump->chn[i].encChn == encChn)
+			return &pump->chn[i];
+	}
+
+	return NULL;
+}
+
+static void telemetry_add(stream_pump_t *pump, int encChn)
+{
+	IMPEncoderCHNAttr attr;
+
+	if (IMP_Encoder_GetChnAttr(encChn, &attr) < 0) {
+		IMP_LOG_WARN(TAG, "IMP_Encoder_GetChnAttr(%d) failed, no telemetry\n", encChn);
+		return;
+	}
+	enc_telemetry_add_chn(pump->tel, encChn, &attr);
+}
+
+int stream_pump_add(stream_pump_t *pump, int encChn, int deadline_ms,
+		stream_pump_cb_t cb, void *priv)
+{
+	struct pump_chn *ch = NULL;
+	int i;
+
+	if (find_chn(pump, encChn)) {
+		IMP_LOG_ERR(TAG, "chn%d already pumped\n", encChn);
+		return -1;
+	}
+
+	for (i = 0; i < STREAM_PUMP_MAX_CHANNELS; i++) {
+		if (!pump->chn[i].active) {
+			ch = &pump->chn[i];
+			break;
+		}
+	}
+	if (ch == NULL) {
+		IMP_LOG_ERR(TAG, "no room for chn%d\n", encChn);
+		return -1;
+	}
+
+	memset(ch, 0, sizeof(struct pump_chn));
+	ch->encChn = encChn;
+	ch->cb = cb;
+	ch->priv = priv;
+	ch->deadline_us = (int64_t)deadline_ms * 1000;
+	ch->last_frame = IMP_System_GetTimeStamp();
+	ch->last_release = ch->last_frame;
+	ch->next_deadline = ch->last_frame + ch->deadline_us;
+	ch->active = 1;
+	if (pump->tel)
+		telemetry_add(pump, encChn);
+
+	if (i >= pump->nr_chn)
+		pump->nr_chn = i + 1;
+	pump->nr_active++;
+
+	return 0;
+}
+
+int stream_pump_remove(stream_pump_t *pump, int encChn)
+{
+	struct pump_chn *ch = find_chn(pump, encChn);
+
+	if (ch == NULL)
+		return -1;
+
+	ch->active = 0;
+	pump->nr_active--;
+
+	return 0;
+}
+
+void stream_pump_stop(stream_pump_t *pump)
+{
+	pump->stop = 1;
+}
+
+void stream_pump_set_max_block(stream_pump_t *pump, int max_block_ms)
+{
+	pump->max_block_ms = max_block_ms > 0 ? max_block_ms : 0;
+}
+
+void stream_pump_set_telemetry(stream_pump_t *pump, enc_telemetry_t *tel)
+{
+	int i;
+
+	pump->tel = tel;
+	for (i = 0; i < pump->nr_chn; i++) {
+		if (tel && pump->chn[i].active)
+			telemetry_add(pump, pump->chn[i].encChn);
+	}
+}
+
+static void service(stream_pump_t *pump, struct pump_chn *ch, int64_t t_ready)
+{
+	IMPEncoderStream stream;
+	int64_t t_get, t_done;
+	int ret;
+
+	ret = IMP_Encoder_GetStream(ch->encChn, &stream, 0);
+	if (ret < 0) {
+		ch->stat.get_errors++;
+		return;
+	}
+	t_get = IMP_System_GetTimeStamp();
+
+	ch->stat.frames++;
+	if (t_get - t_ready > ch->stat.max_wait_us)
+		ch->stat.max_wait_us = t_get - t_ready;
+	ch->stat.total_wait_us += t_get - t_ready;
+	if (ch->stat.frames > 1) {
+		if (t_get - ch->last_frame > ch->stat.max_interval_us)
+			ch->stat.max_interval_us = t_get - ch->last_frame;
+		ch->interval_us = ch->interval_us ?
+			(ch->interval_us * 7 + t_get - ch->last_frame) / 8 : t_get - ch->last_frame;
+	}
+	ch->last_frame = t_get;
+	ch->next_deadline = t_get + ch->deadline_us;
+	if (pump->tel)
+		enc_telemetry_get(pump->tel, ch->encChn, &stream, t_ready - ch->last_release, t_get - t_ready);
+
+	ret = ch->cb(ch->encChn, &stream, ch->priv);
+	if (ret != STREAM_PUMP_RETAIN)
+		IMP_Encoder_ReleaseStream(ch->encChn, &stream);
+
+	t_done = IMP_System_GetTimeStamp();
+	ch->last_release = t_done;
+	if (pump->tel && ret != STREAM_PUMP_RETAIN)
+		enc_telemetry_release(pump->tel, ch->encChn, t_done - t_get);
+	if (t_done - t_get > ch->stat.max_handle_us)
+		ch->stat.max_handle_us = t_done - t_get;
+	ch->stat.total_handle_us += t_done - t_get;
+
+	if (ret < 0 && ch->active) {
+		ch->active = 0;
+		pump->nr_active--;
+	}
+}
+
+/*
+ * When ch's next stream should come: one interval after the last, or
+ * as many as it is late by; its deadline until an interval is known.
+ */
+static int64_t expected(struct pump_chn *ch, int64_t now)
+{
+	int64_t t;
+
+	if (ch->interval_us == 0)
+		return ch->next_deadline;
+	t = ch->last_frame + ch->interval_us;
+	if (t < now)
+		t += ((now - t) / ch->interval_us + 1) * ch->interval_us;
+
+	return t;
+}
+
+int stream_pump_run(stream_pump_t *pump)
+{
+	struct pump_chn *ch, *due;
+	int64_t now, block;
+	int i, k, idx, ready, due_ready;
+
+	while (!pump->stop && pump->nr_active > 0) {
+		/*
+		 * Block on the channel whose stream should come first, up to
+		 * the nearest deadline of any channel.
+		 */
+		now = IMP_System_GetTimeStamp();
+		due = NULL;
+		block = 0;
+		for (i = 0; i < pump->nr_chn; i++) {
+			ch = &pump->chn[i];
+			if (!ch->active)
+				continue;
+			if (due == NULL || ch->next_deadline - now < block)
+				block = ch->next_deadline - now;
+			if (due == NULL || expected(ch, now) < expected(due, now))
+				due = ch;
+		}
+		block = block > 0 ? (block + 999) / 1000 : 0;
+		if (pump->max_block_ms && pump->nr_active > 1 && block > pump->max_block_ms)
+			block = pump->max_block_ms;
+		due_ready = IMP_Encoder_PollingStream(due->encChn, block) == 0;
+		now = IMP_System_GetTimeStamp();
+
+		/* Then one stream per ready channel, starting point rotates */
+		for (k = 0; k < pump->nr_chn; k++) {
+			idx = (pump->rr + k) % pump->nr_chn;
+			ch = &pump->chn[idx];
+			if (!ch->active)
+				continue;
+
+			if (ch == due)
+				ready = due_ready;
+			else
+				ready = IMP_Encoder_PollingStream(ch->encChn, 0) == 0;
+			if (ready) {
+				service(pump, ch, now);
+			} else if (IMP_System_GetTimeStamp() >= ch->next_deadline) {
+				ch->stat.deadline_misses++;
+				ch->next_deadline = IMP_System_GetTimeStamp() + ch->deadline_us;
+				if (ch->cb(ch->encChn, NULL, ch->priv) < 0 && ch->active) {
+					ch->active = 0;
+					pump->nr_active--;
+				}
+			}
+		}
+		pump->rr = (pump->rr + 1) % pump->nr_chn;
+	}
+
+	return 0;
+}
+
+int stream_pump_get_stat(stream_pump_t *pump, int encChn, stream_pump_stat_t *stat)
+{
+	int i;
+
+	for (i = 0; i < pump->nr_chn; i++) {
+		if (pump->chn[i].encChn == encChn) {
+			*stat = pump->chn[i].stat;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+void stream_pump_dump_stat(stream_pump_t *pump)
+{
+	stream_pump_stat_t *s;
+	int i;
+
+	for (i = 0; i < pump->nr_chn; i++) {
+		s = &pump->chn[i].stat;
+		if (s->frames == 0 && s->deadline_misses == 0)
+			continue;
+		IMP_LOG_INFO(TAG, "chn%d: %u frames, %u deadline misses, %u get errors, "
+				"wait avg/max %lld/%lld us, handle avg/max %lld/%lld us, max interval %lld us\n",
+				pump->chn[i].encChn, s->frames, s->deadline_misses, s->get_errors,
+				(long long)(s->frames ? s->total_wait_us / s->frames : 0), (long long)s->max_wait_us,
+				(long long)(s->frames ? s->total_handle_us / s->frames : 0), (long long)s->max_handle_us,
+				(long long)s->max_interval_us);
+	}
+}
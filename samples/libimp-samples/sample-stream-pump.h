@@ -0,0 +1,101 @@
+/*
+ * sample-stream-pump.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_STREAM_PUMP_H__
+#define __SAMPLE_STREAM_PUMP_H__
+
+#include <stdint.h>
+#include <imp/imp_encoder.h>
+
+#include "sample-enc-telemetry.h"
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Single-threaded stream pump.
+ *
+ * Services any number of encoder channels (H264 and JPEG alike) from the
+ * calling thread instead of one pthread per channel. Each pass blocks in
+ * IMP_Encoder_PollingStream() on the channel whose stream should come
+ * first, up to the nearest deadline, then checks the others without
+ * waiting; ready channels are serviced round-robin, one stream each per
+ * pass, so a busy channel cannot starve the others. Every channel has a
+ * deadline: if no stream arrives in time the callback runs with
+ * stream == NULL.
+ */
+
+#define STREAM_PUMP_MAX_CHANNELS	8
+
+/* Callback return values */
+#define STREAM_PUMP_RELEASE		0	/* pump releases the stream */
+#define STREAM_PUMP_RETAIN		1	/* callback kept the stream and releases it itself */
+
+/*
+ * Called with a fresh stream of encChn, or with stream == NULL when the
+ * channel missed its deadline. A negative return removes the channel.
+ */
+typedef int (*stream_pump_cb_t)(int encChn, IMPEncoderStream *stream, void *priv);
+
+typedef struct stream_pump stream_pump_t;
+
+typedef struct stream_pump_stat {
+	uint32_t	frames;
+	uint32_t	deadline_misses;
+	uint32_t	get_errors;
+	int64_t		max_interval_us;	/* longest gap between two streams */
+	int64_t		max_wait_us;		/* readiness -> GetStream, queued behind other channels */
+	int64_t		total_wait_us;
+	int64_t		max_handle_us;		/* time spent in the callback */
+	int64_t		total_handle_us;
+} stream_pump_stat_t;
+
+stream_pump_t *stream_pump_create(void);
+void stream_pump_destroy(stream_pump_t *pump);
+
+/* The caller starts and stops IMP_Encoder_StartRecvPic() itself */
+int stream_pump_add(stream_pump_t *pump, int encChn, int deadline_ms,
+		stream_pump_cb_t cb, void *priv);
+
+/* Safe to call from a callback */
+int stream_pump_remove(stream_pump_t *pump, int encChn);
+
+/*
+ * How long a stream of another channel may wait while the pump blocks
+ * on the one due next; up to the nearest deadline by default, shorter
+ * for low latency, at some CPU cost.
+ */
+void stream_pump_set_max_block(stream_pump_t *pump, int max_block_ms);
+
+/*
+ * Pump until stream_pump_stop() or until no channel is left; a stop
+ * from another thread before run starts makes run return at once,
+ * one during run is seen by the next pass.
+ */
+int stream_pump_run(stream_pump_t *pump);
+void stream_pump_stop(stream_pump_t *pump);
+
+/*
+ * Publish every channel's counters to tel, channels added before and
+ * after. Hold times cover the streams the pump releases, not those a
+ * callback retains.
+ */
+void stream_pump_set_telemetry(stream_pump_t *pump, enc_telemetry_t *tel);
+
+int stream_pump_get_stat(stream_pump_t *pump, int encChn, stream_pump_stat_t *stat);
+void stream_pump_dump_stat(stream_pump_t *pump);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_STREAM_PUMP_H__ */
@@ -0,0 +1,148 @@
+/*
+ * sample-stream-writer-bench.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host benchmark for the asynchronous stream writer: replays a recorded
+ * .h264 file through it at 2x and 4x real time and reports queue depth,
+ * throughput and worst-case enqueue latency. The seek index is written
+ * to <out.h264>.idx as during a recording.
+ *
+ * usage: sample-stream-writer-bench <in.h264> [out.h264] [fps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+
+#include "sample-common.h"
+#include "sample-h264-parse.h"
+#include "sample-stream-writer.h"
+#include "sample-h264-index.h"
+
+#define TAG "Sample-Stream-Writer-Bench"
+
+#define MAX_NALS_PER_FRAME	16
+
+static void timespec_add_us(struct timespec *ts, int64_t us)
+{
+	ts->tv_nsec += (us % 1000000) * 1000;
+	ts->tv_sec += us / 1000000 + ts->tv_nsec / 1000000000;
+	ts->tv_nsec %= 1000000000;
+}
+
+static int replay(const uint8_t *buf, size_t len, const char *out_path, int fps, int speed)
+{
+	h264_nal_t nal[MAX_NALS_PER_FRAME];
+	struct iovec iov[MAX_NALS_PER_FRAME];
+	stream_writer_t *writer;
+	stream_writer_stat_t stat;
+	struct timespec deadline;
+	int64_t period_us = 1000000 / (fps * speed), start, elapsed;
+	size_t pos = 0;
+	char index_path[256];
+	int i, n, fd, index_fd, ret, frames = 0, key_frames = 0;
+
+	fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", out_path, strerror(errno));
+		return -1;
+	}
+
+	snprintf(index_path, sizeof(index_path), "%s%s", out_path, H264_INDEX_SUFFIX);
+	index_fd = h264_index_create(index_path);
+	writer = stream_writer_create(fd, PT_H264, STREAM_BUFFER_SIZE, 0);
+	if (writer == NULL || index_fd < 0) {
+		close(fd);
+		return -1;
+	}
+	stream_writer_set_index(writer, index_fd);
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	start = IMP_System_GetTimeStamp();
+	while ((n = h264_next_frame(buf, len, &pos, nal, MAX_NALS_PER_FRAME)) > 0) {
+		for (i = 0; i < n; i++) {
+			iov[i].iov_base = (void *)nal[i].data;
+			iov[i].iov_len = nal[i].len;
+		}
+		ret = stream_writer_enqueue_iov(writer, iov, n, h264_is_key_frame(nal, n),
+				(int64_t)frames * 1000000 / fps);
+		if (ret < 0)
+			break;
+		frames++;
+		key_frames += h264_is_key_frame(nal, n);
+
+		timespec_add_us(&deadline, period_us);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+	}
+
+	ret = stream_writer_flush(writer);
+	elapsed = IMP_System_GetTimeStamp() - start;
+	stream_writer_get_stat(writer, &stat);
+	stream_writer_destroy(writer);
+	close(index_fd);
+	close(fd);
+
+	printf("%dx real time (%d fps): %d frames (%d key) in %lld ms\n",
+			speed, fps * speed, frames, key_frames, (long long)elapsed / 1000);
+	printf("  written      %llu bytes, %llu frames, %u writev calls (%.1f frames/call)\n",
+			(unsigned long long)stat.bytes, (unsigned long long)stat.frames, stat.writev_calls,
+			stat.writev_calls ? (double)stat.frames / stat.writev_calls : 0.0);
+	printf("  throughput   %.2f MB/s average, %u B/s last window\n",
+			elapsed ? stat.bytes / (double)elapsed : 0.0, stat.bytes_per_sec);
+	printf("  queue depth  max %u frames / %u bytes of %u\n",
+			stat.max_queue_frames, stat.max_queue_bytes, STREAM_BUFFER_SIZE);
+	printf("  latency      max enqueue %lld us, max writev %lld us\n",
+			(long long)stat.max_enqueue_us, (long long)stat.max_write_us);
+	printf("  dropped      %u frames\n", stat.dropped_frames);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *out_path = "/tmp/stream-writer-bench.h264";
+	int fd, fps = SENSOR_FRAME_RATE_NUM / SENSOR_FRAME_RATE_DEN;
+	struct stat st;
+	uint8_t *buf;
+	int ret;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <in.h264> [out.h264] [fps]\n", argv[0]);
+		return -1;
+	}
+	if (argc > 2)
+		out_path = argv[2];
+	if (argc > 3)
+		fps = atoi(argv[3]);
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", argv[1], strerror(errno));
+		return -1;
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (buf == MAP_FAILED) {
+		IMP_LOG_ERR(TAG, "mmap %s failed: %s\n", argv[1], strerror(errno));
+		return -1;
+	}
+
+	ret = replay(buf, st.st_size, out_path, fps, 2);
+	if (ret == 0)
+		ret = replay(buf, st.st_size, out_path, fps, 4);
+
+	munmap(buf, st.st_size);
+	close(fd);
+
+	return ret;
+}
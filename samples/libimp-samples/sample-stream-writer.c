@@ -0,0 +1,443 @@
+/*
+ * sample-stream-writer.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+
+#include "sample-stream-writer.h"
+#include "sample-h264-index.h"
+#include "sample-h264-parse.h"
+
+#define TAG "Sample-Stream-Writer"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+struct frame_desc {
+	uint32_t	off;
+	uint32_t	len;
+	int			key_frame;
+	int64_t		timestamp;
+};
+
+struct stream_writer {
+	int					fd;
+	IMPPayloadType		enType;
+
+	uint8_t				*ring;
+	uint32_t			ring_size;
+	uint32_t			head;			/* next free byte */
+	uint32_t			tail;			/* first byte not yet written */
+
+	struct frame_desc	*desc;
+	uint32_t			max_frames;
+	uint32_t			d_in;			/* next descriptor to fill */
+	uint32_t			d_out;			/* next descriptor to write */
+	uint32_t			nr_frames;		/* reserved, including in flight */
+	uint32_t			nr_ready;		/* committed, not yet taken */
+	uint32_t			queue_bytes;
+
+	int					wait_idr;
+	int					index_fd;		/* -1: no seek index */
+	uint64_t			file_off;		/* where the next batch lands */
+	int					stop;
+	int					error;
+	int					busy;
+
+	pthread_t			tid;
+	pthread_mutex_t		mutex;
+	pthread_cond_t		ready_cond;
+	pthread_cond_t		done_cond;
+
+	int64_t				win_start;
+	uint64_t			win_bytes;
+	stream_writer_stat_t stat;
+};
+
+/* Find len contiguous bytes in the ring, called with mutex held */
+static int ring_reserve(stream_writer_t *w, uint32_t len, uint32_t *off)
+{
+	if (w->nr_frames == 0)
+		w->head = w->tail = 0;
+
+	if (w->nr_frames >= w->max_frames)
+		return -1;
+
+	if (w->head >= w->tail && !(w->nr_frames && w->head == w->tail)) {
+		if (w->ring_size - w->head >= len)
+			*off = w->head;
+		else if (w->tail >= len)
+			*off = 0;
+		else
+			return -1;
+	} else {
+		if (w->tail - w->head >= len)
+			*off = w->head;
+		else
+			return -1;
+	}
+
+	w->head = *off + len;
+	return 0;
+}
+
+/* NAL type after the start code the frame begins with */
+static uint32_t first_nal_type(const uint8_t *p, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 1 < len && i < 4 && p[i] == 0; i++)
+		;
+	return (i >= 2 && p[i] == 1 && i + 1 < len) ? p[i + 1] & 0x1f : 0;
+}
+
+/* Index the key frames of a written batch, n frames from descriptor d */
+static void index_batch(stream_writer_t *w, uint32_t d, uint32_t n)
+{
+	h264_index_entry_t entry[STREAM_WRITER_BATCH_FRAMES];
+	struct frame_desc *desc;
+	uint64_t off = w->file_off;
+	int cnt = 0;
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		desc = &w->desc[(d + i) % w->max_frames];
+		if (desc->key_frame) {
+			entry[cnt].offset = off;
+			entry[cnt].timestamp = desc->timestamp;
+			entry[cnt].size = desc->len;
+			entry[cnt].type = first_nal_type(w->ring + desc->off, desc->len);
+			cnt++;
+		}
+		off += desc->len;
+	}
+
+	/* a lost index only costs seeking, the recording goes on */
+	if (cnt && h264_index_append(w->index_fd, entry, cnt) < 0) {
+		close(w->index_fd);
+		w->index_fd = -1;
+	}
+}
+
+static int write_all(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t ret;
+
+	while (iovcnt > 0) {
+		ret = writev(fd, iov, iovcnt > IOV_MAX ? IOV_MAX : iovcnt);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		while (iovcnt > 0 && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+
+static void *writer_thread(void *arg)
+{
+	stream_writer_t *w = (stream_writer_t *)arg;
+	struct iovec iov[STREAM_WRITER_BATCH_FRAMES];
+	uint32_t i, n, idx, first, bytes;
+	int iovcnt, ret;
+	int64_t t0, t1;
+
+	pthread_mutex_lock(&w->mutex);
+	while (1) {
+		while (w->nr_ready == 0 && !w->stop)
+			pthread_cond_wait(&w->ready_cond, &w->mutex);
+		if (w->nr_ready == 0 && w->stop)
+			break;
+
+		n = w->nr_ready < STREAM_WRITER_BATCH_FRAMES ? w->nr_ready : STREAM_WRITER_BATCH_FRAMES;
+		iovcnt = 0;
+		bytes = 0;
+		for (i = 0; i < n; i++) {
+			idx = (w->d_out + i) % w->max_frames;
+			/* Frames that follow each other in the ring share one iovec */
+			if (iovcnt && (uint8_t *)iov[iovcnt - 1].iov_base + iov[iovcnt - 1].iov_len
+					== w->ring + w->desc[idx].off) {
+				iov[iovcnt - 1].iov_len += w->desc[idx].len;
+			} else {
+				iov[iovcnt].iov_base = w->ring + w->desc[idx].off;
+				iov[iovcnt].iov_len = w->desc[idx].len;
+				iovcnt++;
+			}
+			bytes += w->desc[idx].len;
+		}
+		first = w->d_out;
+		idx = (w->d_out + n - 1) % w->max_frames;
+		w->d_out = (w->d_out + n) % w->max_frames;
+		w->nr_ready -= n;
+		w->busy = 1;
+		pthread_mutex_unlock(&w->mutex);
+
+		t0 = IMP_System_GetTimeStamp();
+		ret = w->error ? -1 : write_all(w->fd, iov, iovcnt);
+		t1 = IMP_System_GetTimeStamp();
+		if (ret < 0 && !w->error)
+			IMP_LOG_ERR(TAG, "stream write error:%s\n", strerror(errno));
+		/* the descriptors stay ours until nr_frames drops below */
+		if (ret == 0 && w->index_fd >= 0)
+			index_batch(w, first, n);
+		if (ret == 0)
+			w->file_off += bytes;
+
+		pthread_mutex_lock(&w->mutex);
+		if (ret < 0)
+			w->error = 1;
+		w->tail = w->desc[idx].off + w->desc[idx].len;
+		w->nr_frames -= n;
+		w->queue_bytes -= bytes;
+		w->busy = 0;
+
+		w->stat.writev_calls++;
+		if (ret == 0) {
+			w->stat.frames += n;
+			w->stat.bytes += bytes;
+			w->win_bytes += bytes;
+		}
+		if (t1 - t0 > w->stat.max_write_us)
+			w->stat.max_write_us = t1 - t0;
+		if (t1 - w->win_start >= 1000000) {
+			w->stat.bytes_per_sec = w->win_bytes * 1000000 / (t1 - w->win_start);
+			w->win_start = t1;
+			w->win_bytes = 0;
+		}
+		pthread_cond_broadcast(&w->done_cond);
+	}
+	pthread_mutex_unlock(&w->mutex);
+
+	return NULL;
+}
+
+stream_writer_t *stream_writer_create(int fd, IMPPayloadType enType,
+		uint32_t ring_size, uint32_t max_frames)
+{
+	stream_writer_t *w;
+
+	w = calloc(1, sizeof(stream_writer_t));
+	if (w == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+
+	w->fd = fd;
+	w->enType = enType;
+	w->ring_size = ring_size;
+	w->max_frames = max_frames ? max_frames : STREAM_WRITER_MAX_FRAMES;
+	w->wait_idr = (enType == PT_H264);
+	w->index_fd = -1;
+	w->win_start = IMP_System_GetTimeStamp();
+
+	w->ring = malloc(ring_size);
+	w->desc = malloc(w->max_frames * sizeof(struct frame_desc));
+	if (w->ring == NULL || w->desc == NULL) {
+		IMP_LOG_ERR(TAG, "malloc() ring of %u bytes error !\n", ring_size);
+		goto err_malloc;
+	}
+
+	pthread_mutex_init(&w->mutex, NULL);
+	pthread_cond_init(&w->ready_cond, NULL);
+	pthread_cond_init(&w->done_cond, NULL);
+
+	if (pthread_create(&w->tid, NULL, writer_thread, w)) {
+		IMP_LOG_ERR(TAG, "create writer thread failed\n");
+		goto err_pthread_create;
+	}
+
+	return w;
+
+err_pthread_create:
+	pthread_cond_destroy(&w->done_cond);
+	pthread_cond_destroy(&w->ready_cond);
+	pthread_mutex_destroy(&w->mutex);
+err_malloc:
+	free(w->desc);
+	free(w->ring);
+	free(w);
+	return NULL;
+}
+
+static int writer_enqueue(stream_writer_t *w, const struct iovec *iov, int iovcnt,
+		int key_frame, int64_t timestamp)
+{
+	int64_t t0 = IMP_System_GetTimeStamp(), dt;
+	uint32_t i, len = 0, off, d;
+	uint8_t *dst;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	pthread_mutex_lock(&w->mutex);
+	if (w->error) {
+		pthread_mutex_unlock(&w->mutex);
+		return -1;
+	}
+
+	if (key_frame)
+		w->wait_idr = 0;
+
+	if (w->wait_idr || len == 0 || ring_reserve(w, len, &off) < 0) {
+		/* Anything referencing the lost frame is useless until the next IDR */
+		if (w->enType == PT_H264 && len)
+			w->wait_idr = 1;
+		w->stat.dropped_frames++;
+		pthread_mutex_unlock(&w->mutex);
+		return 1;
+	}
+
+	d = w->d_in;
+	w->desc[d].off = off;
+	w->desc[d].len = len;
+	w->desc[d].key_frame = key_frame && w->enType == PT_H264;
+	w->desc[d].timestamp = timestamp;
+	w->d_in = (w->d_in + 1) % w->max_frames;
+	w->nr_frames++;
+	pthread_mutex_unlock(&w->mutex);
+
+	/* Single producer: the reserved area belongs to us until committed */
+	dst = w->ring + off;
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+		dst += iov[i].iov_len;
+	}
+
+	pthread_mutex_lock(&w->mutex);
+	w->nr_ready++;
+	w->queue_bytes += len;
+	if (w->nr_frames > w->stat.max_queue_frames)
+		w->stat.max_queue_frames = w->nr_frames;
+	if (w->queue_bytes > w->stat.max_queue_bytes)
+		w->stat.max_queue_bytes = w->queue_bytes;
+	dt = IMP_System_GetTimeStamp() - t0;
+	if (dt > w->stat.max_enqueue_us)
+		w->stat.max_enqueue_us = dt;
+	pthread_cond_signal(&w->ready_cond);
+	pthread_mutex_unlock(&w->mutex);
+
+	return 0;
+}
+
+int stream_writer_enqueue_iov(stream_writer_t *writer, const struct iovec *iov,
+		int iovcnt, int key_frame, int64_t timestamp)
+{
+	return writer_enqueue(writer, iov, iovcnt, key_frame, timestamp);
+}
+
+int stream_writer_enqueue(stream_writer_t *writer, IMPEncoderStream *stream)
+{
+	struct iovec iov[stream->packCount ? stream->packCount : 1];
+	int i, key_frame;
+
+	for (i = 0; i < stream->packCount; i++) {
+		iov[i].iov_base = (void *)(uintptr_t)stream->pack[i].virAddr;
+		iov[i].iov_len = stream->pack[i].length;
+	}
+	key_frame = (writer->enType == PT_H264) ? h264_stream_is_key_frame(stream) : 1;
+
+	return writer_enqueue(writer, iov, stream->packCount, key_frame,
+			stream->packCount ? stream->pack[0].timestamp : 0);
+}
+
+int stream_writer_set_index(stream_writer_t *writer, int index_fd)
+{
+	off_t off;
+
+	if (writer->enType != PT_H264) {
+		IMP_LOG_ERR(TAG, "seek index is for H264 only\n");
+		return -1;
+	}
+
+	/* offsets count from where the stream starts in the file */
+	off = lseek(writer->fd, 0, SEEK_CUR);
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->file_off = off > 0 ? off : 0;
+	writer->index_fd = index_fd;
+	pthread_mutex_unlock(&writer->mutex);
+
+	return 0;
+}
+
+int stream_writer_flush(stream_writer_t *writer)
+{
+	int ret;
+
+	pthread_mutex_lock(&writer->mutex);
+	while ((writer->nr_ready || writer->busy) && !writer->error)
+		pthread_cond_wait(&writer->done_cond, &writer->mutex);
+	ret = writer->error ? -1 : 0;
+	pthread_mutex_unlock(&writer->mutex);
+
+	return ret;
+}
+
+void stream_writer_get_stat(stream_writer_t *writer, stream_writer_stat_t *stat)
+{
+	pthread_mutex_lock(&writer->mutex);
+	*stat = writer->stat;
+	stat->queue_frames = writer->nr_frames;
+	stat->queue_bytes = writer->queue_bytes;
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+void stream_writer_dump_stat(stream_writer_t *writer, const char *name)
+{
+	stream_writer_stat_t stat;
+
+	stream_writer_get_stat(writer, &stat);
+	IMP_LOG_INFO(TAG, "%s: queue %u frames/%u bytes (max %u/%u), written %llu frames/%llu bytes, "
+			"%u B/s, %u dropped, %u writev, max enqueue %lld us, max write %lld us\n",
+			name, stat.queue_frames, stat.queue_bytes, stat.max_queue_frames, stat.max_queue_bytes,
+			(unsigned long long)stat.frames, (unsigned long long)stat.bytes,
+			stat.bytes_per_sec, stat.dropped_frames, stat.writev_calls,
+			(long long)stat.max_enqueue_us, (long long)stat.max_write_us);
+}
+
+int stream_writer_destroy(stream_writer_t *writer)
+{
+	int ret;
+
+	ret = stream_writer_flush(writer);
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->stop = 1;
+	pthread_cond_signal(&writer->ready_cond);
+	pthread_mutex_unlock(&writer->mutex);
+	pthread_join(writer->tid, NULL);
+
+	pthread_cond_destroy(&writer->done_cond);
+	pthread_cond_destroy(&writer->ready_cond);
+	pthread_mutex_destroy(&writer->mutex);
+	free(writer->desc);
+	free(writer->ring);
+	free(writer);
+
+	return ret;
+}
@@ -0,0 +1,96 @@
+/*
+ * sample-stream-writer.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_STREAM_WRITER_H__
+#define __SAMPLE_STREAM_WRITER_H__
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <imp/imp_common.h>
+#include <imp/imp_encoder.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * Asynchronous stream writer.
+ *
+ * The polling thread copies every IMPEncoderStream into a ring allocated
+ * once at create time and releases the encoder buffer right away. A
+ * dedicated thread drains the ring with writev(), several frames per
+ * syscall, so a slow SD card never holds an encoder buffer.
+ *
+ * stream_writer_enqueue() must only be called from one thread.
+ */
+
+#define STREAM_WRITER_MAX_FRAMES	128	/* default frame descriptor count */
+#define STREAM_WRITER_BATCH_FRAMES	16	/* max frames per writev() */
+
+typedef struct stream_writer stream_writer_t;
+
+typedef struct stream_writer_stat {
+	uint32_t	queue_frames;		/* frames waiting in the ring now */
+	uint32_t	queue_bytes;		/* bytes waiting in the ring now */
+	uint32_t	max_queue_frames;	/* high-water mark of queue_frames */
+	uint32_t	max_queue_bytes;	/* high-water mark of queue_bytes */
+	uint64_t	frames;				/* frames written */
+	uint64_t	bytes;				/* bytes written */
+	uint32_t	dropped_frames;		/* frames dropped because the ring was full */
+	uint32_t	bytes_per_sec;		/* write throughput over the last second */
+	int64_t		max_enqueue_us;		/* worst-case stream_writer_enqueue() latency */
+	int64_t		max_write_us;		/* worst-case single writev() latency */
+	uint32_t	writev_calls;		/* number of writev() syscalls */
+} stream_writer_stat_t;
+
+/*
+ * Create a writer for fd. ring_size is the byte budget for queued data,
+ * max_frames the number of frames that may be queued at once (0 selects
+ * STREAM_WRITER_MAX_FRAMES). enType selects key frame detection: for
+ * PT_H264 a dropped frame makes the writer skip everything up to the next
+ * IDR so the file stays decodable.
+ */
+stream_writer_t *stream_writer_create(int fd, IMPPayloadType enType,
+		uint32_t ring_size, uint32_t max_frames);
+
+/*
+ * Copy all packs of stream into the ring. Never blocks on I/O: returns 1
+ * if the frame was dropped, 0 if it was queued and -1 if the writer hit
+ * a write error.
+ */
+int stream_writer_enqueue(stream_writer_t *writer, IMPEncoderStream *stream);
+
+/* Same as above for data that does not come from the encoder, timestamp in us */
+int stream_writer_enqueue_iov(stream_writer_t *writer, const struct iovec *iov,
+		int iovcnt, int key_frame, int64_t timestamp);
+
+/*
+ * Append an entry to the seek index on index_fd (see sample-h264-index.h)
+ * for every key frame, once it is written. Offsets start at the current
+ * position of the stream fd. Set before the first enqueue; the caller
+ * closes index_fd after stream_writer_destroy().
+ */
+int stream_writer_set_index(stream_writer_t *writer, int index_fd);
+
+/* Block until every queued frame has been written */
+int stream_writer_flush(stream_writer_t *writer);
+
+void stream_writer_get_stat(stream_writer_t *writer, stream_writer_stat_t *stat);
+void stream_writer_dump_stat(stream_writer_t *writer, const char *name);
+
+/* Flush, stop the writer thread and free the ring. fd is not closed. */
+int stream_writer_destroy(stream_writer_t *writer);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_STREAM_WRITER_H__ */
@@ -0,0 +1,236 @@
+/*
+ * sample-vb-tuner-check.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ *
+ * Host check for the FrameSource buffer tuner. A producer fills a frame
+ * every interval into one of nrVBs buffers and drops the frame if none
+ * is free when it starts; the encoder, IVS and a GetFrame user hold each
+ * frame for a time that depends on the frame alone (encoder I frames,
+ * IVS hiccups, a slow user every few frames), so every run sees the
+ * same load. The tuner is fed from a roomy run, then its
+ * recommendation is run and must meet the drop target; the run with one
+ * buffer less is shown next to it. A starved run must be told to grow.
+ *
+ * usage: sample-vb-tuner-check [-n frames] [-p drop_ppm] [-f fps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_common.h>
+#include <imp/imp_framesource.h>
+
+#include "sample-vb-tuner.h"
+
+#define TAG "Sample-VB-Tuner-Check"
+
+#define ROOMY_VBS		VB_TUNER_MAX_VBS
+#define START_US		1000000
+
+struct hold {
+	int64_t		capture;
+	int64_t		release;
+	vb_hold_t	who;
+};
+
+struct sim {
+	int			frames;
+	int64_t		interval;
+	struct hold	*holds;
+	int			nr_holds;
+};
+
+/* Deterministic per frame and consumer */
+static uint32_t frame_rand(int k, int who)
+{
+	uint32_t x = k * 2654435761u + who * 40503u + 12345;
+
+	x ^= x >> 15;
+	x *= 2246822519u;
+	x ^= x >> 13;
+	return x;
+}
+
+static int64_t hold_us(int k, vb_hold_t who)
+{
+	uint32_t r = frame_rand(k, who);
+
+	switch (who) {
+	case VB_HOLD_ENC:
+		/* 25-55 ms, I frames every 50 take 60 ms more */
+		return 25000 + r % 30000 + (k % 50 == 0 ? 60000 : 0);
+	case VB_HOLD_IVS:
+		/* 8 ms, now and then the algorithm stalls for 150-260 ms */
+		return r % 100 < 4 ? 150000 + r % 110000 : 8000;
+	default:
+		/* every fifth frame, 80-120 ms */
+		return k % 5 == 0 ? (int64_t)(80000 + r % 40000) : -1;
+	}
+}
+
+static int cmp_release(const void *a, const void *b)
+{
+	const struct hold *x = a, *y = b;
+
+	return x->release < y->release ? -1 : x->release > y->release;
+}
+
+/* Frames the producer has to drop with nrVBs buffers; fills sim->holds */
+static int produce(struct sim *sim, int nrVBs)
+{
+	int64_t *release, capture, start, h, end;
+	int k, j, busy, drops = 0, who, n = 0;
+
+	release = calloc(sim->frames, sizeof(int64_t));
+	if (release == NULL)
+		return -1;
+
+	sim->nr_holds = 0;
+	for (k = 0; k < sim->frames; k++) {
+		capture = START_US + k * sim->interval;
+		start = capture - sim->interval;
+		busy = 1;
+		for (j = n - 1; j >= 0 && j >= n - ROOMY_VBS * 8; j--) {
+			if (release[j] > start)
+				busy++;
+		}
+		if (busy > nrVBs) {
+			drops++;
+			continue;
+		}
+
+		end = capture;
+		for (who = 0; who < VB_HOLD_NR; who++) {
+			h = hold_us(k, who);
+			if (h < 0)
+				continue;
+			sim->holds[sim->nr_holds].capture = capture;
+			sim->holds[sim->nr_holds].release = capture + h;
+			sim->holds[sim->nr_holds].who = who;
+			sim->nr_holds++;
+			if (capture + h > end)
+				end = capture + h;
+		}
+		release[n++] = end;
+	}
+	free(release);
+
+	return drops;
+}
+
+static int tune(struct sim *sim, int nrVBs, uint32_t drop_ppm, vb_tuner_stat_t *stat, int *drops)
+{
+	IMPFSChnAttr attr;
+	vb_tuner_t *tuner;
+	int i;
+
+	*drops = produce(sim, nrVBs);
+	if (*drops < 0)
+		return -1;
+
+	tuner = vb_tuner_create(drop_ppm);
+	if (tuner == NULL)
+		return -1;
+	memset(&attr, 0, sizeof(attr));
+	attr.picWidth = 640;
+	attr.picHeight = 360;
+	attr.nrVBs = nrVBs;
+	attr.outFrmRateNum = 1000000 / sim->interval;
+	attr.outFrmRateDen = 1;
+	if (vb_tuner_add_chn(tuner, 1, &attr) < 0)
+		return -1;
+
+	/* consumers let go in time order, as they would report it */
+	qsort(sim->holds, sim->nr_holds, sizeof(struct hold), cmp_release);
+	for (i = 0; i < sim->nr_holds; i++)
+		vb_tuner_hold(tuner, 1, sim->holds[i].who, sim->holds[i].capture, sim->holds[i].release);
+	/* one more frame far ahead settles everything */
+	vb_tuner_hold(tuner, 1, VB_HOLD_ENC, sim->holds[sim->nr_holds - 1].release + 2 * VB_TUNER_SETTLE_US,
+			sim->holds[sim->nr_holds - 1].release + 2 * VB_TUNER_SETTLE_US);
+
+	vb_tuner_dump_stat(tuner);
+	vb_tuner_get_stat(tuner, 1, stat);
+	vb_tuner_destroy(tuner);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sim sim;
+	vb_tuner_stat_t stat, starved;
+	uint32_t drop_ppm = VB_TUNER_DROP_PPM;
+	int opt, fps = 25, drops, rec, ret = 0;
+	int d_rec, d_less;
+
+	memset(&sim, 0, sizeof(sim));
+	sim.frames = 30000;
+
+	while ((opt = getopt(argc, argv, "n:p:f:")) != -1) {
+		switch (opt) {
+		case 'n':
+			sim.frames = atoi(optarg);
+			break;
+		case 'p':
+			drop_ppm = atoi(optarg);
+			break;
+		case 'f':
+			fps = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (sim.frames < VB_TUNER_MIN_FRAMES || fps <= 0 || drop_ppm == 0)
+		goto usage;
+	sim.interval = 1000000 / fps;
+	sim.holds = calloc(sim.frames * VB_HOLD_NR, sizeof(struct hold));
+	if (sim.holds == NULL)
+		return -1;
+
+	/* Step.1 Tune on a run with buffers to spare */
+	if (tune(&sim, ROOMY_VBS, drop_ppm, &stat, &drops) < 0)
+		return -1;
+	rec = stat.rec_nrVBs;
+	printf("%d frames at %d fps, %d buffers: %d dropped, recommended %d for %u ppm\n",
+			sim.frames, fps, ROOMY_VBS, drops, rec, drop_ppm);
+	if (drops || stat.drops || stat.frames != (uint32_t)sim.frames || rec < VB_TUNER_MIN_VBS) {
+		IMP_LOG_ERR(TAG, "roomy run: %d dropped, tuner saw %u frames %u drops\n",
+				drops, stat.frames, stat.drops);
+		ret = -1;
+	}
+
+	/* Step.2 The recommendation meets the target, one less shown for scale */
+	d_rec = produce(&sim, rec);
+	d_less = produce(&sim, rec - 1);
+	printf("%d buffers: %d dropped (%llu ppm), %d buffers: %d dropped (%llu ppm)\n",
+			rec, d_rec, (unsigned long long)d_rec * 1000000 / sim.frames,
+			rec - 1, d_less, (unsigned long long)d_less * 1000000 / sim.frames);
+	if ((uint64_t)d_rec * 1000000 > (uint64_t)drop_ppm * sim.frames) {
+		IMP_LOG_ERR(TAG, "recommended %d buffers miss the target\n", rec);
+		ret = -1;
+	}
+
+	/* Step.3 A starved channel is told to grow */
+	if (tune(&sim, VB_TUNER_MIN_VBS, drop_ppm, &starved, &drops) < 0)
+		return -1;
+	printf("%d buffers: %d dropped, tuner counted %u, recommended %d\n",
+			VB_TUNER_MIN_VBS, drops, starved.drops, starved.rec_nrVBs);
+	if (drops && (starved.drops != (uint32_t)drops || starved.rec_nrVBs <= VB_TUNER_MIN_VBS)) {
+		IMP_LOG_ERR(TAG, "starved run not detected\n");
+		ret = -1;
+	}
+
+	free(sim.holds);
+	if (ret == 0)
+		printf("ok\n");
+	return ret;
+
+usage:
+	fprintf(stderr, "usage: %s [-n frames] [-p drop_ppm] [-f fps]\n", argv[0]);
+	return -1;
+}
@@ -0,0 +1,506 @@
+/*
+ * sample-vb-tuner.c
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <imp/imp_log.h>
+#include <imp/imp_system.h>
+#include <imp/imp_framesource.h>
+#include <imp/imp_encoder.h>
+#include <imp/imp_ivs.h>
+
+#include "sample-vb-tuner.h"
+
+#define TAG "Sample-VB-Tuner"
+
+struct vb_frame {
+	int64_t		capture;
+	int64_t		release;			/* last consumer done */
+	int			settled;
+};
+
+struct vb_chn {
+	int				used;
+	int				fsChn;
+	int				width;
+	int				height;
+	int				nrVBs;
+	int64_t			interval;		/* frame interval, us */
+
+	struct vb_frame	ring[VB_TUNER_RING];
+	int				head;			/* next slot to fill */
+	int64_t			newest;			/* latest release seen */
+	int64_t			last_capture;	/* of the last settled frame */
+
+	uint32_t		frames;
+	uint32_t		drops;
+	uint32_t		holds[VB_HOLD_NR];
+	uint64_t		hold_total[VB_HOLD_NR];
+	uint32_t		hold_max[VB_HOLD_NR];
+	uint32_t		busy[VB_TUNER_MAX_VBS + 1];
+	int				user_held;
+	int				user_peak;
+};
+
+struct vb_tuner {
+	pthread_mutex_t	mutex;
+	uint32_t		drop_ppm;
+	struct vb_chn	chn[VB_TUNER_MAX_FS];
+};
+
+struct conf_entry {
+	int			fsChn;
+	int			width;
+	int			height;
+	int			nrVBs;
+	int			depth;
+	uint32_t	frames;
+	uint32_t	drops;
+};
+
+/* IVS calls ProcessAsync without a context, one trampoline per slot */
+struct ivs_wrap {
+	vb_tuner_t			*tuner;
+	int					fsChn;
+	IMPIVSInterface		*ivs;
+	IMPIVSInterface		wrap;
+};
+
+static struct ivs_wrap ivs_wraps[VB_TUNER_MAX_FS];
+
+vb_tuner_t *vb_tuner_create(uint32_t drop_ppm)
+{
+	vb_tuner_t *tuner;
+
+	tuner = calloc(1, sizeof(vb_tuner_t));
+	if (tuner == NULL) {
+		IMP_LOG_ERR(TAG, "calloc() error !\n");
+		return NULL;
+	}
+	tuner->drop_ppm = drop_ppm ? drop_ppm : VB_TUNER_DROP_PPM;
+	pthread_mutex_init(&tuner->mutex, NULL);
+
+	return tuner;
+}
+
+void vb_tuner_destroy(vb_tuner_t *tuner)
+{
+	int i;
+
+	for (i = 0; i < VB_TUNER_MAX_FS; i++) {
+		if (ivs_wraps[i].tuner == tuner)
+			memset(&ivs_wraps[i], 0, sizeof(struct ivs_wrap));
+	}
+	pthread_mutex_destroy(&tuner->mutex);
+	free(tuner);
+}
+
+static struct vb_chn *tuner_chn(vb_tuner_t *tuner, int fsChn)
+{
+	int i;
+
+	for (i = 0; i < VB_TUNER_MAX_FS; i++) {
+		if (tuner->chn[i].used && tuner->chn[i].fsChn == fsChn)
+			return &tuner->chn[i];
+	}
+
+	return NULL;
+}
+
+int vb_tuner_add_chn(vb_tuner_t *tuner, int fsChn, const IMPFSChnAttr *attr)
+{
+	struct vb_chn *ch = NULL;
+	int i;
+
+	if (attr->outFrmRateNum <= 0 || attr->outFrmRateDen <= 0) {
+		IMP_LOG_ERR(TAG, "fs%d: no frame rate\n", fsChn);
+		return -1;
+	}
+
+	pthread_mutex_lock(&tuner->mutex);
+	for (i = 0; i < VB_TUNER_MAX_FS; i++) {
+		if (!tuner->chn[i].used) {
+			ch = &tuner->chn[i];
+			break;
+		}
+	}
+	if (ch == NULL || tuner_chn(tuner, fsChn)) {
+		pthread_mutex_unlock(&tuner->mutex);
+		IMP_LOG_ERR(TAG, "fs%d: no free slot or added twice\n", fsChn);
+		return -1;
+	}
+
+	memset(ch, 0, sizeof(struct vb_chn));
+	ch->used = 1;
+	ch->fsChn = fsChn;
+	ch->width = attr->picWidth;
+	ch->height = attr->picHeight;
+	ch->nrVBs = attr->nrVBs;
+	ch->interval = 1000000LL * attr->outFrmRateDen / attr->outFrmRateNum;
+	pthread_mutex_unlock(&tuner->mutex);
+
+	return 0;
+}
+
+/* Buffers busy when the producer started on frame f, f's own included */
+static void settle(struct vb_chn *ch, struct vb_frame *f)
+{
+	int64_t start = f->capture - ch->interval, gap;
+	int i, busy = 1;
+
+	for (i = 0; i < VB_TUNER_RING; i++) {
+		if (&ch->ring[i] != f && ch->ring[i].capture && ch->ring[i].capture < f->capture
+				&& ch->ring[i].release > start)
+			busy++;
+	}
+	ch->busy[busy > VB_TUNER_MAX_VBS ? VB_TUNER_MAX_VBS : busy]++;
+	ch->frames++;
+
+	gap = f->capture - ch->last_capture;
+	if (ch->last_capture && gap > ch->interval * 3 / 2)
+		ch->drops += (gap + ch->interval / 2) / ch->interval - 1;
+	ch->last_capture = f->capture;
+	f->settled = 1;
+}
+
+/* Settle, oldest first, the frames nobody can be holding any more */
+static void settle_old(struct vb_chn *ch, int64_t before)
+{
+	struct vb_frame *oldest;
+	int i;
+
+	for (;;) {
+		oldest = NULL;
+		for (i = 0; i < VB_TUNER_RING; i++) {
+			if (ch->ring[i].capture && !ch->ring[i].settled
+					&& (oldest == NULL || ch->ring[i].capture < oldest->capture))
+				oldest = &ch->ring[i];
+		}
+		if (oldest == NULL || oldest->capture >= before)
+			return;
+		settle(ch, oldest);
+	}
+}
+
+void vb_tuner_hold(vb_tuner_t *tuner, int fsChn, vb_hold_t who, int64_t capture_us, int64_t release_us)
+{
+	struct vb_chn *ch;
+	struct vb_frame *f = NULL;
+	int64_t held = release_us - capture_us;
+	int i;
+
+	if (who >= VB_HOLD_NR || capture_us <= 0 || held < 0)
+		return;
+
+	pthread_mutex_lock(&tuner->mutex);
+	ch = tuner_chn(tuner, fsChn);
+	if (ch == NULL)
+		goto out;
+
+	ch->holds[who]++;
+	ch->hold_total[who] += held;
+	if (held > ch->hold_max[who])
+		ch->hold_max[who] = held;
+
+	/* too late, its buffer has been counted */
+	if (capture_us <= ch->last_capture)
+		goto out;
+
+	for (i = 0; i < VB_TUNER_RING; i++) {
+		if (ch->ring[i].capture == capture_us) {
+			f = &ch->ring[i];
+			break;
+		}
+	}
+	if (f == NULL) {
+		f = &ch->ring[ch->head];
+		if (f->capture && !f->settled) {
+			settle_old(ch, f->capture + 1);
+			if (capture_us <= ch->last_capture)
+				goto out;
+		}
+		ch->head = (ch->head + 1) % VB_TUNER_RING;
+		memset(f, 0, sizeof(struct vb_frame));
+		f->capture = capture_us;
+	}
+	if (release_us > f->release)
+		f->release = release_us;
+	if (release_us > ch->newest)
+		ch->newest = release_us;
+
+	settle_old(ch, ch->newest - VB_TUNER_SETTLE_US);
+
+out:
+	pthread_mutex_unlock(&tuner->mutex);
+}
+
+void vb_tuner_enc_stream(vb_tuner_t *tuner, int fsChn, const IMPEncoderStream *stream)
+{
+	if (stream->packCount)
+		vb_tuner_hold(tuner, fsChn, VB_HOLD_ENC, stream->pack[0].timestamp, IMP_System_GetTimeStamp());
+}
+
+int vb_tuner_get_frame(vb_tuner_t *tuner, int fsChn, IMPFrameInfo **frame)
+{
+	struct vb_chn *ch;
+	int ret;
+
+	ret = IMP_FrameSource_GetFrame(fsChn, frame);
+	if (ret < 0)
+		return ret;
+
+	pthread_mutex_lock(&tuner->mutex);
+	ch = tuner_chn(tuner, fsChn);
+	if (ch && ++ch->user_held > ch->user_peak)
+		ch->user_peak = ch->user_held;
+	pthread_mutex_unlock(&tuner->mutex);
+
+	return ret;
+}
+
+int vb_tuner_release_frame(vb_tuner_t *tuner, int fsChn, IMPFrameInfo *frame)
+{
+	struct vb_chn *ch;
+	int64_t capture = frame->timeStamp;
+	int ret;
+
+	ret = IMP_FrameSource_ReleaseFrame(fsChn, frame);
+	vb_tuner_hold(tuner, fsChn, VB_HOLD_USER, capture, IMP_System_GetTimeStamp());
+
+	pthread_mutex_lock(&tuner->mutex);
+	ch = tuner_chn(tuner, fsChn);
+	if (ch && ch->user_held > 0)
+		ch->user_held--;
+	pthread_mutex_unlock(&tuner->mutex);
+
+	return ret;
+}
+
+static int ivs_process(struct ivs_wrap *w, IMPFrameInfo *frame)
+{
+	int64_t capture = frame->timeStamp;		/* frame is gone once released */
+	int ret;
+
+	ret = w->ivs->ProcessAsync(frame);
+	if (w->tuner)
+		vb_tuner_hold(w->tuner, w->fsChn, VB_HOLD_IVS, capture, IMP_System_GetTimeStamp());
+
+	return ret;
+}
+
+#define IVS_PROCESS(n) \
+	static int ivs_process_##n(IMPFrameInfo *frame) { return ivs_process(&ivs_wraps[n], frame); }
+IVS_PROCESS(0)
+IVS_PROCESS(1)
+IVS_PROCESS(2)
+IVS_PROCESS(3)
+
+static int (*const ivs_process_fn[VB_TUNER_MAX_FS])(IMPFrameInfo *frame) = {
+	ivs_process_0, ivs_process_1, ivs_process_2, ivs_process_3,
+};
+
+IMPIVSInterface *vb_tuner_wrap_ivs(vb_tuner_t *tuner, int fsChn, IMPIVSInterface *ivs)
+{
+	struct ivs_wrap *w;
+	int i;
+
+	for (i = 0; i < VB_TUNER_MAX_FS; i++) {
+		w = &ivs_wraps[i];
+		if (w->tuner == NULL) {
+			w->tuner = tuner;
+			w->fsChn = fsChn;
+			w->ivs = ivs;
+			w->wrap = *ivs;
+			w->wrap.ProcessAsync = ivs_process_fn[i];
+			return &w->wrap;
+		}
+	}
+	IMP_LOG_ERR(TAG, "no free IVS slot, fs%d goes untimed\n", fsChn);
+
+	return ivs;
+}
+
+/* Smallest nrVBs that starves on no more than drop_ppm of the frames */
+static void recommend(vb_tuner_t *tuner, struct vb_chn *ch, vb_tuner_stat_t *stat)
+{
+	uint64_t starved;
+	int n, b;
+
+	stat->rec_nrVBs = 0;
+	stat->rec_depth = ch->user_peak;
+	if (ch->frames == 0)
+		return;
+
+	for (n = VB_TUNER_MIN_VBS; n < VB_TUNER_MAX_VBS; n++) {
+		for (starved = 0, b = n + 1; b <= VB_TUNER_MAX_VBS; b++)
+			starved += ch->busy[b];
+		if (starved * 1000000 <= (uint64_t)tuner->drop_ppm * ch->frames)
+			break;
+	}
+
+	/* it starved already, frames that never came could not be counted */
+	if ((uint64_t)ch->drops * 1000000 > (uint64_t)tuner->drop_ppm * (ch->frames + ch->drops)
+			&& n <= ch->nrVBs)
+		n = ch->nrVBs + 1 > VB_TUNER_MAX_VBS ? VB_TUNER_MAX_VBS : ch->nrVBs + 1;
+	stat->rec_nrVBs = n;
+}
+
+void vb_tuner_get_stat(vb_tuner_t *tuner, int fsChn, vb_tuner_stat_t *stat)
+{
+	struct vb_chn *ch;
+	int i;
+
+	memset(stat, 0, sizeof(vb_tuner_stat_t));
+	pthread_mutex_lock(&tuner->mutex);
+	ch = tuner_chn(tuner, fsChn);
+	if (ch) {
+		stat->nrVBs = ch->nrVBs;
+		stat->frames = ch->frames;
+		stat->drops = ch->drops;
+		for (i = 0; i < VB_HOLD_NR; i++) {
+			stat->holds[i] = ch->holds[i];
+			stat->hold_avg_us[i] = ch->holds[i] ? ch->hold_total[i] / ch->holds[i] : 0;
+			stat->hold_max_us[i] = ch->hold_max[i];
+		}
+		memcpy(stat->busy, ch->busy, sizeof(stat->busy));
+		stat->user_peak = ch->user_peak;
+		recommend(tuner, ch, stat);
+	}
+	pthread_mutex_unlock(&tuner->mutex);
+}
+
+void vb_tuner_dump_stat(vb_tuner_t *tuner)
+{
+	static const char *who[VB_HOLD_NR] = { "enc", "ivs", "user" };
+	vb_tuner_stat_t s;
+	char busy[VB_TUNER_MAX_VBS * 16], *p;
+	int i, k;
+
+	for (i = 0; i < VB_TUNER_MAX_FS; i++) {
+		if (!tuner->chn[i].used)
+			continue;
+		vb_tuner_get_stat(tuner, tuner->chn[i].fsChn, &s);
+
+		p = busy;
+		for (k = 1; k <= VB_TUNER_MAX_VBS; k++) {
+			if (s.busy[k])
+				p += sprintf(p, " %d:%u", k, s.busy[k]);
+		}
+		IMP_LOG_INFO(TAG, "fs%d: %u frames, %u dropped, buffers busy at capture%s; "
+				"nrVBs %d, recommended %d for %u ppm, depth %d\n", tuner->chn[i].fsChn,
+				s.frames, s.drops, busy, s.nrVBs, s.rec_nrVBs, tuner->drop_ppm, s.rec_depth);
+		for (k = 0; k < VB_HOLD_NR; k++) {
+			if (s.holds[k])
+				IMP_LOG_INFO(TAG, "fs%d: %-4s held %u frames, avg/max %u/%u us\n",
+						tuner->chn[i].fsChn, who[k], s.holds[k], s.hold_avg_us[k], s.hold_max_us[k]);
+		}
+	}
+}
+
+static int conf_read(const char *conf, struct conf_entry *e, int max)
+{
+	char line[128];
+	FILE *f;
+	int n = 0;
+
+	f = fopen(conf, "r");
+	if (f == NULL)
+		return 0;
+
+	while (n < max && fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%d %dx%d %d %d %u %u", &e[n].fsChn, &e[n].width, &e[n].height,
+					&e[n].nrVBs, &e[n].depth, &e[n].frames, &e[n].drops) == 7)
+			n++;
+	}
+	fclose(f);
+
+	return n;
+}
+
+int vb_tuner_write(vb_tuner_t *tuner, const char *conf)
+{
+	struct conf_entry e[VB_TUNER_MAX_FS];
+	struct vb_chn *ch;
+	vb_tuner_stat_t s;
+	FILE *f;
+	int i, k, n;
+
+	if (conf == NULL)
+		conf = VB_TUNER_CONF;
+	n = conf_read(conf, e, VB_TUNER_MAX_FS);
+
+	for (i = 0; i < VB_TUNER_MAX_FS; i++) {
+		ch = &tuner->chn[i];
+		if (!ch->used)
+			continue;
+		vb_tuner_get_stat(tuner, ch->fsChn, &s);
+		if (s.frames < VB_TUNER_MIN_FRAMES) {
+			IMP_LOG_WARN(TAG, "fs%d: %u frames are too few to tune on\n", ch->fsChn, s.frames);
+			continue;
+		}
+		if ((uint64_t)s.frames * tuner->drop_ppm < 1000000)
+			IMP_LOG_WARN(TAG, "fs%d: %u frames cannot show %u ppm, run longer\n",
+					ch->fsChn, s.frames, tuner->drop_ppm);
+		for (k = 0; k < n; k++) {
+			if (e[k].fsChn == ch->fsChn)
+				break;
+		}
+		if (k == n) {
+			if (n == VB_TUNER_MAX_FS)
+				continue;
+			n++;
+		}
+		e[k].fsChn = ch->fsChn;
+		e[k].width = ch->width;
+		e[k].height = ch->height;
+		e[k].nrVBs = s.rec_nrVBs;
+		e[k].depth = s.rec_depth;
+		e[k].frames = s.frames;
+		e[k].drops = s.drops;
+	}
+
+	f = fopen(conf, "w");
+	if (f == NULL) {
+		IMP_LOG_ERR(TAG, "open %s failed: %s\n", conf, strerror(errno));
+		return -1;
+	}
+	fprintf(f, "# fsChn WxH nrVBs depth frames drops\n");
+	for (k = 0; k < n; k++)
+		fprintf(f, "%d %dx%d %d %d %u %u\n", e[k].fsChn, e[k].width, e[k].height,
+				e[k].nrVBs, e[k].depth, e[k].frames, e[k].drops);
+	if (fclose(f) != 0) {
+		IMP_LOG_ERR(TAG, "write %s failed: %s\n", conf, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+int vb_tuner_get(const char *conf, int fsChn, IMPFSChnAttr *attr, int *depth)
+{
+	struct conf_entry e[VB_TUNER_MAX_FS];
+	int i, n;
+
+	n = conf_read(conf ? conf : VB_TUNER_CONF, e, VB_TUNER_MAX_FS);
+	for (i = 0; i < n; i++) {
+		if (e[i].fsChn == fsChn && e[i].width == attr->picWidth
+				&& e[i].height == attr->picHeight && e[i].nrVBs >= VB_TUNER_MIN_VBS) {
+			IMP_LOG_INFO(TAG, "fs%d: %d VBs tuned, was %d\n", fsChn, e[i].nrVBs, attr->nrVBs);
+			attr->nrVBs = e[i].nrVBs;
+			if (depth)
+				*depth = e[i].depth;
+			return 1;
+		}
+	}
+
+	return 0;
+}
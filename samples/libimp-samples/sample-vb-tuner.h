@@ -0,0 +1,120 @@
+/*
+ * sample-vb-tuner.h
+ *
+ * Copyright (C) 2016 Ingenic Semiconductor Co.,Ltd
+ */
+
+#ifndef __SAMPLE_VB_TUNER_H__
+#define __SAMPLE_VB_TUNER_H__
+
+#include <stdint.h>
+#include <imp/imp_common.h>
+#include <imp/imp_framesource.h>
+#include <imp/imp_encoder.h>
+#include <imp/imp_ivs.h>
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"
+{
+#endif
+#endif /* __cplusplus */
+
+/*
+ * FrameSource buffer (nrVBs) and frame depth tuning.
+ *
+ * Every consumer reports how long it kept each frame, from its capture
+ * timestamp to the moment it let go:
+ *  - the encoder until the stream of the frame comes out, fed from the
+ *    stream loop with vb_tuner_enc_stream();
+ *  - IVS for as long as ProcessAsync runs, through the interface
+ *    vb_tuner_wrap_ivs() puts in front of the algorithm;
+ *  - GetFrame users from GetFrame to ReleaseFrame, through
+ *    vb_tuner_get_frame() and vb_tuner_release_frame().
+ * A frame's buffer is free again when its last consumer is done. Once
+ * a frame has settled, the tuner counts the buffers that were busy when
+ * the producer started filling it: its own, the previous frame's and
+ * every older one still held a frame interval before its capture. A
+ * channel with N buffers starves on every frame that needed more than
+ * N; the recommendation is the smallest N that starves on no more than
+ * drop_ppm of the frames. Frames the producer could not deliver show up
+ * as gaps in the capture timestamps; if those already exceed the target
+ * the channel is given one buffer more than it has.
+ *
+ * A tuning run writes the recommendation to a small config file, later
+ * runs take nrVBs from there for a channel of the same picture size.
+ */
+
+#define VB_TUNER_CONF			"/tmp/vb-tuner.conf"
+#define VB_TUNER_MAX_FS			4
+#define VB_TUNER_MAX_VBS		16
+#define VB_TUNER_MIN_VBS		2				/* one filling, one being consumed */
+#define VB_TUNER_DROP_PPM		1000			/* default target, frames per million */
+#define VB_TUNER_MIN_FRAMES		100				/* before a recommendation is written */
+#define VB_TUNER_RING			64				/* frames in flight per channel */
+#define VB_TUNER_SETTLE_US		1000000			/* no consumer holds a frame longer */
+
+typedef enum {
+	VB_HOLD_ENC,
+	VB_HOLD_IVS,
+	VB_HOLD_USER,
+	VB_HOLD_NR,
+} vb_hold_t;
+
+typedef struct vb_tuner vb_tuner_t;
+
+typedef struct vb_tuner_stat {
+	int			nrVBs;				/* as configured */
+	uint32_t	frames;				/* settled */
+	uint32_t	drops;				/* missing from the capture timestamps */
+	uint32_t	holds[VB_HOLD_NR];
+	uint32_t	hold_avg_us[VB_HOLD_NR];
+	uint32_t	hold_max_us[VB_HOLD_NR];
+	uint32_t	busy[VB_TUNER_MAX_VBS + 1];	/* frames by buffers busy at their capture */
+	int			user_peak;			/* most frames GetFrame users held at once */
+	int			rec_nrVBs;			/* 0: no frames yet */
+	int			rec_depth;			/* for SetFrameDepth, 0: no GetFrame user */
+} vb_tuner_stat_t;
+
+/* drop_ppm 0: VB_TUNER_DROP_PPM */
+vb_tuner_t *vb_tuner_create(uint32_t drop_ppm);
+void vb_tuner_destroy(vb_tuner_t *tuner);
+
+int vb_tuner_add_chn(vb_tuner_t *tuner, int fsChn, const IMPFSChnAttr *attr);
+
+/* A consumer held the frame captured at capture_us until release_us */
+void vb_tuner_hold(vb_tuner_t *tuner, int fsChn, vb_hold_t who, int64_t capture_us, int64_t release_us);
+
+/* The encoder coding fsChn has let go of the frame of stream */
+void vb_tuner_enc_stream(vb_tuner_t *tuner, int fsChn, const IMPEncoderStream *stream);
+
+/* IMP_FrameSource_GetFrame/ReleaseFrame, timed */
+int vb_tuner_get_frame(vb_tuner_t *tuner, int fsChn, IMPFrameInfo **frame);
+int vb_tuner_release_frame(vb_tuner_t *tuner, int fsChn, IMPFrameInfo *frame);
+
+/*
+ * An interface to create the IVS channel with instead of ivs, timing
+ * ivs->ProcessAsync on frames of fsChn. Lives until the tuner does.
+ */
+IMPIVSInterface *vb_tuner_wrap_ivs(vb_tuner_t *tuner, int fsChn, IMPIVSInterface *ivs);
+
+void vb_tuner_get_stat(vb_tuner_t *tuner, int fsChn, vb_tuner_stat_t *stat);
+void vb_tuner_dump_stat(vb_tuner_t *tuner);
+
+/* Updates the tuned channels in conf (NULL: VB_TUNER_CONF), keeps the others */
+int vb_tuner_write(vb_tuner_t *tuner, const char *conf);
+
+/*
+ * Sets attr->nrVBs from conf (NULL: VB_TUNER_CONF) if fsChn was tuned
+ * at this picture size, and *depth (may be NULL) to the frame depth for
+ * its GetFrame users. 1 if the channel was found, 0 if not.
+ */
+int vb_tuner_get(const char *conf, int fsChn, IMPFSChnAttr *attr, int *depth);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
+
+#endif /* __SAMPLE_VB_TUNER_H__ */